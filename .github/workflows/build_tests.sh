@@ -76,3 +76,21 @@ make -j$(nproc)
 # - mbedtls TLS option
 cmake .. -G "Unix Makefiles" -DCONFIG_MENDER_PLATFORM_FLASH_TYPE="posix" -DCONFIG_MENDER_PLATFORM_LOG_TYPE="posix" -DCONFIG_MENDER_PLATFORM_NET_TYPE="generic/curl" -DCONFIG_MENDER_PLATFORM_SCHEDULER_TYPE="posix" -DCONFIG_MENDER_PLATFORM_STORAGE_TYPE="posix" -DCONFIG_MENDER_PLATFORM_TLS_TYPE="generic/mbedtls" -DCONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE=ON -DCONFIG_MENDER_CLIENT_CONFIGURE_STORAGE=ON -DCONFIG_MENDER_CLIENT_ADD_ON_INVENTORY=ON -DCONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT=ON -DCONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL=ON -DCONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER=ON -DCONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING=ON
 make -j$(nproc)
+
+# Build and run the simulations:
+# - Poll backoff over 24 hours of the virtual clock
+cd ../simulation
+mkdir -p build
+cd build
+cmake .. -G "Unix Makefiles"
+make -j$(nproc)
+./mender-mcu-client-simulation.elf
+
+# Build and run the artifact parser benchmark:
+# - Corpus processed with several chunk lengths and random split points
+cd ../../artifact
+mkdir -p build
+cd build
+cmake .. -G "Unix Makefiles"
+make -j$(nproc)
+./mender-mcu-client-artifact.elf
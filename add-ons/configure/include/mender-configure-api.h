@@ -24,18 +24,30 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include "mender-tls.h"
 #include "mender-utils.h"
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
+/**
+ * @brief Version of the configuration downloaded from the mender-server, used to detect that the configuration has not changed
+ */
+typedef struct {
+    char   *etag;                                    /**< Entity tag of the configuration given by the mender-server, NULL if not provided */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< SHA-256 digest of the configuration, all zero if no configuration has been downloaded */
+} mender_configure_api_version_t;
+
 /**
  * @brief Download configure data of the device from the mender-server
+ * @note The request is conditional, the mender-server sends the configuration only if its entity tag has changed, the digest of the configuration is
+ * compared if the mender-server does not give an entity tag
+ * @param version Version of the configuration downloaded previously, updated when a new configuration is downloaded
  * @param configuration Mender configuration key/value pairs table, ends with a NULL/NULL element, NULL if not defined
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @return MENDER_OK if the function succeeds, MENDER_DONE if the configuration has not changed, error code otherwise
  */
-mender_err_t mender_configure_api_download_configuration_data(mender_keystore_t **configuration);
+mender_err_t mender_configure_api_download_configuration_data(mender_configure_api_version_t *version, mender_keystore_t **configuration);
 
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
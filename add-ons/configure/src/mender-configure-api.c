@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CONFIGURE
+
 #include "mender-api.h"
 #include "mender-log.h"
 #include "mender-configure-api.h"
@@ -31,53 +36,111 @@
 #define MENDER_API_PATH_GET_DEVICE_CONFIGURATION "/api/devices/v1/deviceconfig/configuration"
 #define MENDER_API_PATH_PUT_DEVICE_CONFIGURATION "/api/devices/v1/deviceconfig/configuration"
 
+/**
+ * @brief Write the body of the configuration publication, the configuration is written while it is sent
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Configuration (mender_keystore_t)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_configure_api_write_body(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
+/**
+ * @brief Response of the configuration download
+ */
+typedef struct {
+    mender_api_response_t response; /**< Text response */
+    char                 *etag;     /**< Entity tag of the configuration, NULL if not provided */
+} mender_configure_api_response_t;
+
+/**
+ * @brief HTTP callback used to download the configuration, the entity tag is saved and the response is handled by mender_api_http_text_callback
+ * @param event HTTP client event
+ * @param data Data received
+ * @param data_length Data length
+ * @param params Callback parameters, the response of type mender_configure_api_response_t
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_configure_api_http_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+
+/**
+ * @brief Compute the digest of the configuration
+ * @param data Configuration, NULL if empty
+ * @param length Length of the configuration
+ * @param digest Digest of the configuration (MENDER_TLS_SHA256_DIGEST_LENGTH bytes)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_configure_api_compute_digest(char *data, size_t length, uint8_t *digest);
+
 mender_err_t
-mender_configure_api_download_configuration_data(mender_keystore_t **configuration) {
+mender_configure_api_download_configuration_data(mender_configure_api_version_t *version, mender_keystore_t **configuration) {
 
+    assert(NULL != version);
     assert(NULL != configuration);
-    mender_err_t ret;
-    char        *response = NULL;
-    int          status   = 0;
+    mender_err_t                    ret;
+    mender_configure_api_response_t response = { .response = { .data = NULL, .length = 0, .size = 0, .retry_after = 0 }, .etag = NULL };
+    int                             status   = 0;
+    uint8_t                         digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
 
-    /* Perform HTTP request */
+    /* Perform HTTP request, the configuration is not sent again if the entity tag has not changed */
     if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_get_authentication_token(),
-                                      MENDER_API_PATH_GET_DEVICE_CONFIGURATION,
-                                      MENDER_HTTP_GET,
-                                      NULL,
-                                      NULL,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
+        != (ret = mender_http_perform_body(mender_api_get_authentication_token(),
+                                           MENDER_API_PATH_GET_DEVICE_CONFIGURATION,
+                                           MENDER_HTTP_GET,
+                                           NULL,
+                                           NULL,
+                                           NULL,
+                                           version->etag,
+                                           CONFIG_MENDER_HTTP_RECV_BUF_LENGTH,
+                                           &mender_configure_api_http_callback,
+                                           (void *)&response,
+                                           &status))) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
     /* Treatment depending of the status */
-    if (200 == status) {
-        cJSON *json_response = cJSON_Parse(response);
-        if (NULL == json_response) {
-            mender_log_error("Unable to set configuration");
+    if (304 == status) {
+        /* The configuration has not changed */
+        ret = MENDER_DONE;
+    } else if (200 == status) {
+        /* Compare the digest of the configuration, it is not parsed if it has not changed */
+        if (MENDER_OK != (ret = mender_configure_api_compute_digest(response.response.data, response.response.length, digest))) {
+            mender_log_error("Unable to compute digest of the configuration");
             goto END;
         }
-        if (MENDER_OK != (ret = mender_utils_keystore_from_json(configuration, json_response))) {
+        if (0 == memcmp(version->digest, digest, sizeof(digest))) {
+            ret = MENDER_DONE;
+            goto END;
+        }
+        /* Read the configuration without building a cJSON tree, the response is kept to compute the digest */
+        mender_utils_keystore_delete(*configuration);
+        if (MENDER_OK != (ret = mender_json_read_keystore(response.response.data, response.response.length, configuration))) {
             mender_log_error("Unable to set configuration");
-            cJSON_Delete(json_response);
             goto END;
         }
-        cJSON_Delete(json_response);
+        /* Save the version of the configuration */
+        if (NULL != version->etag) {
+            mender_free(version->etag);
+        }
+        version->etag = response.etag;
+        response.etag = NULL;
+        memcpy(version->digest, digest, sizeof(digest));
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
+    if (NULL != response.response.data) {
+        mender_free(response.response.data);
+    }
+    if (NULL != response.etag) {
+        mender_free(response.etag);
     }
 
     return ret;
@@ -88,33 +151,24 @@ END:
 mender_err_t
 mender_configure_api_publish_configuration_data(mender_keystore_t *configuration) {
 
-    mender_err_t ret;
-    cJSON       *json_configuration = NULL;
-    char        *payload            = NULL;
-    char        *response           = NULL;
-    int          status             = 0;
-
-    /* Format payload */
-    if (MENDER_OK != (ret = mender_utils_keystore_to_json(configuration, &json_configuration))) {
-        mender_log_error("Unable to format payload");
-        goto END;
-    }
-    if (NULL == (payload = cJSON_PrintUnformatted(json_configuration))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
+    mender_err_t          ret;
+    mender_http_body_t    body     = { .callback = &mender_configure_api_write_body, .params = configuration };
+    mender_api_response_t response = { .data = NULL, .length = 0, .size = 0, .retry_after = 0 };
+    int                   status   = 0;
 
-    /* Perform HTTP request */
+    /* Perform HTTP request, the payload is written while it is sent */
     if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_get_authentication_token(),
-                                      MENDER_API_PATH_PUT_DEVICE_CONFIGURATION,
-                                      MENDER_HTTP_PUT,
-                                      payload,
-                                      NULL,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
+        != (ret = mender_http_perform_body(mender_api_get_authentication_token(),
+                                           MENDER_API_PATH_PUT_DEVICE_CONFIGURATION,
+                                           MENDER_HTTP_PUT,
+                                           &body,
+                                           NULL,
+                                           NULL,
+                                           NULL,
+                                           CONFIG_MENDER_HTTP_RECV_BUF_LENGTH,
+                                           &mender_api_http_text_callback,
+                                           (void *)&response,
+                                           &status))) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
@@ -124,24 +178,71 @@ mender_configure_api_publish_configuration_data(mender_keystore_t *configuration
         /* No response expected */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
+    if (NULL != response.data) {
+        mender_free(response.data);
     }
-    if (NULL != payload) {
-        free(payload);
+
+    return ret;
+}
+
+static mender_err_t
+mender_configure_api_write_body(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+
+    /* Write the configuration as JSON object */
+    return mender_utils_keystore_write_json((mender_keystore_t *)params, write, ctx);
+}
+
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+static mender_err_t
+mender_configure_api_http_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+
+    assert(NULL != params);
+    mender_configure_api_response_t *response = (mender_configure_api_response_t *)params;
+
+    /* Save the entity tag of the configuration */
+    if ((MENDER_HTTP_EVENT_HEADERS_RECEIVED == event) && (NULL != data) && (NULL != ((mender_http_headers_t *)data)->etag)) {
+        if (NULL != response->etag) {
+            mender_free(response->etag);
+        }
+        if (NULL == (response->etag = mender_strdup(((mender_http_headers_t *)data)->etag))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Accumulate the response */
+    return mender_api_http_text_callback(event, data, data_length, &response->response);
+}
+
+static mender_err_t
+mender_configure_api_compute_digest(char *data, size_t length, uint8_t *digest) {
+
+    assert(NULL != digest);
+    mender_err_t ret;
+    void        *handle;
+
+    /* Compute the digest of the configuration */
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&handle))) {
+        return ret;
     }
-    if (NULL != json_configuration) {
-        cJSON_Delete(json_configuration);
+    if ((NULL != data) && (MENDER_OK != (ret = mender_tls_sha256_update(handle, data, length)))) {
+        mender_tls_sha256_end(handle, NULL);
+        return ret;
     }
 
-    return ret;
+    return mender_tls_sha256_end(handle, digest);
 }
 
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
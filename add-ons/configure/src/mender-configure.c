@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CONFIGURE
+
 #include "mender-api.h"
 #include "mender-client.h"
 #include "mender-configure.h"
@@ -34,12 +39,6 @@
 #define CONFIG_MENDER_CLIENT_CONFIGURE_REFRESH_INTERVAL (28800)
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_REFRESH_INTERVAL */
 
-/**
- * @brief Mender configure instance
- */
-const mender_addon_instance_t mender_configure_addon_instance
-    = { .init = mender_configure_init, .activate = mender_configure_activate, .deactivate = mender_configure_deactivate, .exit = mender_configure_exit };
-
 /**
  * @brief Mender configure configuration
  */
@@ -56,6 +55,15 @@ static mender_configure_callbacks_t mender_configure_callbacks;
 static mender_keystore_t *mender_configure_keystore = NULL;
 static void              *mender_configure_mutex    = NULL;
 
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+/**
+ * @brief Mender configure version of the configuration downloaded, used to skip the update if the configuration has not changed
+ */
+static mender_configure_api_version_t mender_configure_version;
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+
 /**
  * @brief Mender configure artifact name
  */
@@ -72,6 +80,19 @@ static void *mender_configure_work_handle = NULL;
  */
 static mender_err_t mender_configure_work_function(void);
 
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+/**
+ * @brief Compute the items added, changed and removed between two configurations
+ * @param previous Previous configuration key/value pairs table, must end with a NULL/NULL element, NULL if not defined
+ * @param current Current configuration key/value pairs table, must end with a NULL/NULL element, NULL if not defined
+ * @param diff Diff of the configurations, the key-stores must be released by the caller
+ * @return MENDER_OK if the configurations differ, MENDER_DONE if they are the same, error code otherwise
+ */
+static mender_err_t mender_configure_diff(mender_keystore_t *previous, mender_keystore_t *current, mender_configure_diff_t *diff);
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "mender-configure"
  * @param id ID of the deployment
@@ -88,6 +109,29 @@ static mender_err_t mender_configure_work_function(void);
 static mender_err_t mender_configure_download_artifact_callback(
     char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
 
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+
+/**
+ * @brief Get the period of the configure work performed during the check-in of the client
+ * @return Period of the configure work (seconds)
+ */
+static int32_t mender_configure_get_check_in_period(void);
+
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
+
+/**
+ * @brief Mender configure instance
+ */
+const mender_addon_instance_t mender_configure_addon_instance = { .init                = mender_configure_init,
+                                                                  .activate            = mender_configure_activate,
+                                                                  .deactivate          = mender_configure_deactivate,
+                                                                  .exit                = mender_configure_exit,
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+                                                                  .check_in            = mender_configure_work_function,
+                                                                  .get_check_in_period = mender_configure_get_check_in_period
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
+};
+
 mender_err_t
 mender_configure_init(void *config, void *callbacks) {
 
@@ -143,7 +187,7 @@ mender_configure_init(void *config, void *callbacks) {
 
         /* Retrieve artifact name if it is available */
         if (NULL != (artifact_name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json_device_config, "artifact_name")))) {
-            if (NULL == (mender_configure_artifact_name = strdup(artifact_name))) {
+            if (NULL == (mender_configure_artifact_name = mender_strdup(artifact_name))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto END;
@@ -164,8 +208,14 @@ mender_configure_init(void *config, void *callbacks) {
     /* Create mender configure work */
     mender_scheduler_work_params_t configure_work_params;
     configure_work_params.function = mender_configure_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+    configure_work_params.period   = 0; /* Periodic work is performed during the check-in of the client */
+#else
     configure_work_params.period   = mender_configure_config.refresh_interval;
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
     configure_work_params.name     = "mender_configure";
+    configure_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_DEFAULT;
+    configure_work_params.slack    = CONFIG_MENDER_CLIENT_WORK_SLACK;
     if (MENDER_OK != (ret = mender_scheduler_work_create(&configure_work_params, &mender_configure_work_handle))) {
         mender_log_error("Unable to create configure work");
         goto END;
@@ -175,7 +225,7 @@ END:
 
     /* Release memory */
     if (NULL != device_config) {
-        free(device_config);
+        mender_free(device_config);
     }
     if (NULL != json_device_config) {
         cJSON_Delete(json_device_config);
@@ -236,9 +286,8 @@ END:
 mender_err_t
 mender_configure_set(mender_keystore_t *configuration) {
 
-    cJSON       *json_device_config = NULL;
-    cJSON       *json_config        = NULL;
-    char        *device_config      = NULL;
+    char        *json_config   = NULL;
+    char        *device_config = NULL;
     mender_err_t ret;
 
     /* Take mutex used to protect access to the configuration key-store */
@@ -253,35 +302,34 @@ mender_configure_set(mender_keystore_t *configuration) {
         goto END;
     }
 
-    /* Copy the new configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_configure_keystore, configuration))) {
+    /* Copy the new configuration, it is packed because its items are not set */
+    if (MENDER_OK != (ret = mender_utils_keystore_pack(&mender_configure_keystore, configuration))) {
         mender_log_error("Unable to copy configuration");
         goto END;
     }
 
-#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
-    /* Save the device configuration */
-    if (NULL == (json_device_config = cJSON_CreateObject())) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
+    /* Forget the version of the configuration downloaded so that the next download updates the configuration */
+    if (NULL != mender_configure_version.etag) {
+        mender_free(mender_configure_version.etag);
     }
-    if (MENDER_OK != (ret = mender_utils_keystore_to_json(mender_configure_keystore, &json_config))) {
-        mender_log_error("Unable to format configuration");
-        goto END;
-    }
-    if (NULL == json_config) {
+    memset(&mender_configure_version, 0, sizeof(mender_configure_api_version_t));
+
+#else
+
+    /* Save the device configuration, it is formatted without building a cJSON tree */
+    if (MENDER_OK != (ret = mender_utils_keystore_to_json_string(mender_configure_keystore, &json_config))) {
         mender_log_error("Unable to format configuration");
-        ret = MENDER_FAIL;
         goto END;
     }
-    cJSON_AddItemToObject(json_device_config, "config", json_config);
-    if (NULL == (device_config = cJSON_PrintUnformatted(json_device_config))) {
+    size_t str_length = strlen("{\"config\":}") + strlen(json_config) + 1;
+    if (NULL == (device_config = (char *)mender_malloc(str_length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
+    snprintf(device_config, str_length, "{\"config\":%s}", json_config);
     if (MENDER_OK != (ret = mender_storage_set_device_config(device_config))) {
         mender_log_error("Unable to record configuration");
         goto END;
@@ -292,11 +340,11 @@ mender_configure_set(mender_keystore_t *configuration) {
 END:
 
     /* Release memory */
-    if (NULL != json_device_config) {
-        cJSON_Delete(json_device_config);
+    if (NULL != json_config) {
+        mender_free(json_config);
     }
     if (NULL != device_config) {
-        free(device_config);
+        mender_free(device_config);
     }
 
     /* Release mutex used to protect access to the configuration key-store */
@@ -338,11 +386,17 @@ mender_configure_exit(void) {
     mender_configure_config.refresh_interval = 0;
     mender_utils_keystore_delete(mender_configure_keystore);
     mender_configure_keystore = NULL;
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    if (NULL != mender_configure_version.etag) {
+        mender_free(mender_configure_version.etag);
+    }
+    memset(&mender_configure_version, 0, sizeof(mender_configure_api_version_t));
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
     mender_scheduler_mutex_give(mender_configure_mutex);
     mender_scheduler_mutex_delete(mender_configure_mutex);
     mender_configure_mutex = NULL;
     if (NULL != mender_configure_artifact_name) {
-        free(mender_configure_artifact_name);
+        mender_free(mender_configure_artifact_name);
         mender_configure_artifact_name = NULL;
     }
 
@@ -353,6 +407,10 @@ static mender_err_t
 mender_configure_work_function(void) {
 
     mender_err_t ret;
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    mender_configure_diff_t diff        = { .added = NULL, .changed = NULL, .removed = NULL };
+    mender_err_t            diff_status = MENDER_DONE;
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
     /* Take mutex used to protect access to the configuration key-store */
     if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_mutex, -1))) {
@@ -368,21 +426,31 @@ mender_configure_work_function(void) {
 
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
-    /* Download configuration */
+    /* Download configuration, nothing is done if it has not changed */
     mender_keystore_t *configuration = NULL;
-    if (MENDER_OK != (ret = mender_configure_api_download_configuration_data(&configuration))) {
+    if (MENDER_DONE == (ret = mender_configure_api_download_configuration_data(&mender_configure_version, &configuration))) {
+        mender_log_debug("Configuration has not changed");
+        ret = MENDER_OK;
+        goto RELEASE;
+    } else if (MENDER_OK != ret) {
         mender_log_error("Unable to get configuration data");
         goto RELEASE;
     }
 
+    /* Compute the diff with the previous configuration, the changes are not notified if it fails */
+    if ((NULL != mender_configure_callbacks.config_changed)
+        && (MENDER_OK != (diff_status = mender_configure_diff(mender_configure_keystore, configuration, &diff))) && (MENDER_DONE != diff_status)) {
+        mender_log_error("Unable to compute configuration diff");
+    }
+
     /* Release previous configuration */
     if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_configure_keystore))) {
         mender_log_error("Unable to delete device configuration");
         goto RELEASE;
     }
 
-    /* Update device configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_configure_keystore, configuration))) {
+    /* Update device configuration, the packed configuration downloaded is copied at once */
+    if (MENDER_OK != (ret = mender_utils_keystore_pack(&mender_configure_keystore, configuration))) {
         mender_log_error("Unable to update device configuration");
         goto RELEASE;
     }
@@ -392,6 +460,11 @@ mender_configure_work_function(void) {
         mender_configure_callbacks.config_updated(mender_configure_keystore);
     }
 
+    /* Invoke the change callback only if the configuration differs */
+    if (MENDER_OK == diff_status) {
+        mender_configure_callbacks.config_changed(&diff);
+    }
+
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
     /* Publish configuration */
@@ -414,6 +487,9 @@ END:
 
     /* Release memeory */
     mender_utils_keystore_delete(configuration);
+    mender_utils_keystore_delete(diff.added);
+    mender_utils_keystore_delete(diff.changed);
+    mender_utils_keystore_delete(diff.removed);
 
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
@@ -423,6 +499,65 @@ END:
     return ret;
 }
 
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+static mender_err_t
+mender_configure_diff(mender_keystore_t *previous, mender_keystore_t *current, mender_configure_diff_t *diff) {
+
+    assert(NULL != diff);
+    size_t previous_length = mender_utils_keystore_length(previous);
+    size_t current_length  = mender_utils_keystore_length(current);
+    size_t added           = 0;
+    size_t changed         = 0;
+    size_t removed         = 0;
+    int    index;
+
+    /* Allocate the key-stores for the worst case */
+    if ((NULL == (diff->added = mender_utils_keystore_new(current_length))) || (NULL == (diff->changed = mender_utils_keystore_new(current_length)))
+        || (NULL == (diff->removed = mender_utils_keystore_new(previous_length)))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    /* Look for the items added or changed */
+    for (size_t current_index = 0; current_index < current_length; current_index++) {
+        if (0 > (index = mender_utils_keystore_get_item_index(previous, current[current_index].name))) {
+            if (MENDER_OK != mender_utils_keystore_set_item(diff->added, added++, current[current_index].name, current[current_index].value)) {
+                goto FAIL;
+            }
+        } else if (0 != strcmp(previous[index].value, current[current_index].value)) {
+            if (MENDER_OK != mender_utils_keystore_set_item(diff->changed, changed++, current[current_index].name, current[current_index].value)) {
+                goto FAIL;
+            }
+        }
+    }
+
+    /* Look for the items removed */
+    for (size_t previous_index = 0; previous_index < previous_length; previous_index++) {
+        if (0 > mender_utils_keystore_get_item_index(current, previous[previous_index].name)) {
+            if (MENDER_OK != mender_utils_keystore_set_item(diff->removed, removed++, previous[previous_index].name, previous[previous_index].value)) {
+                goto FAIL;
+            }
+        }
+    }
+
+    return ((0 != added) || (0 != changed) || (0 != removed)) ? MENDER_OK : MENDER_DONE;
+
+FAIL:
+
+    /* Release memory */
+    mender_utils_keystore_delete(diff->added);
+    diff->added = NULL;
+    mender_utils_keystore_delete(diff->changed);
+    diff->changed = NULL;
+    mender_utils_keystore_delete(diff->removed);
+    diff->removed = NULL;
+
+    return MENDER_FAIL;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
 static mender_err_t
@@ -476,11 +611,21 @@ END:
         cJSON_Delete(json_device_config);
     }
     if (NULL != device_config) {
-        free(device_config);
+        mender_free(device_config);
     }
     return ret;
 }
 
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+
+static int32_t
+mender_configure_get_check_in_period(void) {
+
+    return mender_configure_config.refresh_interval;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
+
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
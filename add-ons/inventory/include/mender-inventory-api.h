@@ -30,12 +30,17 @@ extern "C" {
 
 /**
  * @brief Publish inventory data of the device to the mender-server
- * @param artifact_name Artifact name
- * @param device_type Device type
+ * @param artifact_name Artifact name, NULL if not published
+ * @param device_type Device type, NULL if not published
  * @param inventory Mender inventory key/value pairs table, must end with a NULL/NULL element, NULL if not defined
+ * @param changed Flags of the inventory items to be published, NULL to publish all the items
+ * @param provided Mender inventory items provided, must end with a NULL/NULL element, NULL if not defined
+ * @param provided_changed Flags of the items provided to be published, NULL to publish all the items provided
+ * @note The whole inventory of the device is replaced if changed is NULL, the attributes published are updated and the others are kept otherwise
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_inventory_api_publish_inventory_data(char *artifact_name, char *device_type, mender_keystore_t *inventory);
+mender_err_t mender_inventory_api_publish_inventory_data(
+    char *artifact_name, char *device_type, mender_keystore_t *inventory, bool *changed, mender_keystore_t *provided, bool *provided_changed);
 
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
 
@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_INVENTORY
+
 #include "mender-api.h"
 #include "mender-log.h"
 #include "mender-inventory-api.h"
@@ -28,110 +33,189 @@
 /**
  * @brief Paths of the mender-server APIs
  */
-#define MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES "/api/devices/v1/inventory/device/attributes"
+#define MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES   "/api/devices/v1/inventory/device/attributes"
+#define MENDER_API_PATH_PATCH_DEVICE_ATTRIBUTES "/api/devices/v1/inventory/device/attributes"
+
+/**
+ * @brief Inventory data published to the server
+ */
+typedef struct {
+    char              *artifact_name;    /**< Artifact name, NULL if not published */
+    char              *device_type;      /**< Device type, NULL if not published */
+    mender_keystore_t *inventory;        /**< Inventory key/value pairs, NULL if not published */
+    bool              *changed;          /**< Flags of the inventory items to be published, NULL to publish all the items */
+    mender_keystore_t *provided;         /**< Inventory items provided, NULL if not published */
+    bool              *provided_changed; /**< Flags of the items provided to be published, NULL to publish all the items provided */
+} mender_inventory_api_data_t;
+
+/**
+ * @brief Body callback used to write the inventory data in JSON format without building the document
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Inventory data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_inventory_api_write_body(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
+/**
+ * @brief Write an inventory attribute in JSON format
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param name Name of the attribute
+ * @param value Value of the attribute
+ * @param first Attribute is the first of the array
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_inventory_api_write_attribute(mender_err_t (*write)(void *, size_t, void *), void *ctx, char *name, char *value, bool first);
+
+/**
+ * @brief Write the inventory attributes flagged in JSON format
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param inventory Inventory key/value pairs, NULL if not published
+ * @param changed Flags of the inventory items to be published, NULL to publish all the items
+ * @param first Attribute is the first of the array, cleared if attributes are written
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_inventory_api_write_attributes(
+    mender_err_t (*write)(void *, size_t, void *), void *ctx, mender_keystore_t *inventory, bool *changed, bool *first);
 
 mender_err_t
-mender_inventory_api_publish_inventory_data(char *artifact_name, char *device_type, mender_keystore_t *inventory) {
+mender_inventory_api_publish_inventory_data(
+    char *artifact_name, char *device_type, mender_keystore_t *inventory, bool *changed, mender_keystore_t *provided, bool *provided_changed) {
 
-    mender_err_t ret;
-    cJSON       *item;
-    char        *payload  = NULL;
-    char        *response = NULL;
-    int          status   = 0;
-
-    /* Format payload */
-    cJSON *object = cJSON_CreateArray();
-    if (NULL == object) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    mender_err_t                ret;
+    mender_inventory_api_data_t data     = { .artifact_name    = artifact_name,
+                                             .device_type      = device_type,
+                                             .inventory        = inventory,
+                                             .changed          = changed,
+                                             .provided         = provided,
+                                             .provided_changed = (NULL != changed) ? provided_changed : NULL };
+    mender_http_body_t          body     = { .callback = &mender_inventory_api_write_body, .params = &data };
+    mender_api_response_t       response = { .data = NULL, .length = 0, .size = 0, .retry_after = 0 };
+    int                         status   = 0;
+
+    /* Perform HTTP request, the payload is written while it is sent, only the attributes changed are updated with a PATCH */
+    if (MENDER_OK
+        != (ret = mender_http_perform_body(mender_api_get_authentication_token(),
+                                           (NULL != changed) ? MENDER_API_PATH_PATCH_DEVICE_ATTRIBUTES : MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES,
+                                           (NULL != changed) ? MENDER_HTTP_PATCH : MENDER_HTTP_PUT,
+                                           &body,
+                                           NULL,
+                                           NULL,
+                                           NULL,
+                                           CONFIG_MENDER_HTTP_RECV_BUF_LENGTH,
+                                           &mender_api_http_text_callback,
+                                           (void *)&response,
+                                           &status))) {
+        mender_log_error("Unable to perform HTTP request");
         goto END;
     }
-    if (NULL != artifact_name) {
-        if (NULL == (item = cJSON_CreateObject())) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+
+    /* Treatment depending of the status */
+    if (200 == status) {
+        /* No response expected */
+        ret = MENDER_OK;
+    } else {
+        mender_api_print_response_error(response.data, status);
+        ret = MENDER_FAIL;
+    }
+
+END:
+
+    /* Release memory */
+    if (NULL != response.data) {
+        mender_free(response.data);
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_inventory_api_write_body(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+    assert(NULL != params);
+    mender_inventory_api_data_t *data  = (mender_inventory_api_data_t *)params;
+    mender_err_t                 ret;
+    bool                         first = true;
+
+    /* Write the array of attributes */
+    if (MENDER_OK != (ret = write("[", 1, ctx))) {
+        return ret;
+    }
+    if (NULL != data->artifact_name) {
+        if (MENDER_OK != (ret = mender_inventory_api_write_attribute(write, ctx, "artifact_name", data->artifact_name, first))) {
+            return ret;
         }
-        cJSON_AddStringToObject(item, "name", "artifact_name");
-        cJSON_AddStringToObject(item, "value", artifact_name);
-        cJSON_AddItemToArray(object, item);
-        item = cJSON_CreateObject();
-        if (NULL == item) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+        if (MENDER_OK != (ret = mender_inventory_api_write_attribute(write, ctx, "rootfs-image.version", data->artifact_name, false))) {
+            return ret;
         }
-        cJSON_AddStringToObject(item, "name", "rootfs-image.version");
-        cJSON_AddStringToObject(item, "value", artifact_name);
-        cJSON_AddItemToArray(object, item);
+        first = false;
     }
-    if (NULL != device_type) {
-        if (NULL == (item = cJSON_CreateObject())) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+    if (NULL != data->device_type) {
+        if (MENDER_OK != (ret = mender_inventory_api_write_attribute(write, ctx, "device_type", data->device_type, first))) {
+            return ret;
         }
-        cJSON_AddStringToObject(item, "name", "device_type");
-        cJSON_AddStringToObject(item, "value", device_type);
-        cJSON_AddItemToArray(object, item);
+        first = false;
+    }
+    if (MENDER_OK != (ret = mender_inventory_api_write_attributes(write, ctx, data->inventory, data->changed, &first))) {
+        return ret;
     }
+    if (MENDER_OK != (ret = mender_inventory_api_write_attributes(write, ctx, data->provided, data->provided_changed, &first))) {
+        return ret;
+    }
+
+    return write("]", 1, ctx);
+}
+
+static mender_err_t
+mender_inventory_api_write_attributes(mender_err_t (*write)(void *, size_t, void *), void *ctx, mender_keystore_t *inventory, bool *changed, bool *first) {
+
+    assert(NULL != write);
+    assert(NULL != first);
+    mender_err_t ret;
+
+    /* Write the attributes flagged */
     if (NULL != inventory) {
         size_t index = 0;
         while ((NULL != inventory[index].name) && (NULL != inventory[index].value)) {
-            if (NULL == (item = cJSON_CreateObject())) {
-                mender_log_error("Unable to allocate memory");
-                ret = MENDER_FAIL;
-                goto END;
+            if ((NULL == changed) || (true == changed[index])) {
+                if (MENDER_OK != (ret = mender_inventory_api_write_attribute(write, ctx, inventory[index].name, inventory[index].value, *first))) {
+                    return ret;
+                }
+                *first = false;
             }
-            cJSON_AddStringToObject(item, "name", inventory[index].name);
-            cJSON_AddStringToObject(item, "value", inventory[index].value);
-            cJSON_AddItemToArray(object, item);
             index++;
         }
     }
-    if (NULL == (payload = cJSON_PrintUnformatted(object))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
 
-    /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_get_authentication_token(),
-                                      MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES,
-                                      MENDER_HTTP_PUT,
-                                      payload,
-                                      NULL,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
-        mender_log_error("Unable to perform HTTP request");
-        goto END;
-    }
+    return MENDER_OK;
+}
 
-    /* Treatment depending of the status */
-    if (200 == status) {
-        /* No response expected */
-        ret = MENDER_OK;
-    } else {
-        mender_api_print_response_error(response, status);
-        ret = MENDER_FAIL;
-    }
+static mender_err_t
+mender_inventory_api_write_attribute(mender_err_t (*write)(void *, size_t, void *), void *ctx, char *name, char *value, bool first) {
 
-END:
+    assert(NULL != write);
+    assert(NULL != name);
+    assert(NULL != value);
+    mender_err_t ret;
 
-    /* Release memory */
-    if (NULL != response) {
-        free(response);
+    /* Write the attribute object */
+    if (MENDER_OK != (ret = write((true == first) ? "{\"name\":" : ",{\"name\":", (true == first) ? 8 : 9, ctx))) {
+        return ret;
     }
-    if (NULL != payload) {
-        free(payload);
+    if (MENDER_OK != (ret = mender_utils_json_write_string(write, ctx, name))) {
+        return ret;
     }
-    if (NULL != object) {
-        cJSON_Delete(object);
+    if (MENDER_OK != (ret = write(",\"value\":", 9, ctx))) {
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_utils_json_write_string(write, ctx, value))) {
+        return ret;
     }
 
-    return ret;
+    return write("}", 1, ctx);
 }
 
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
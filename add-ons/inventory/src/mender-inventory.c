@@ -17,11 +17,17 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_INVENTORY
+
 #include "mender-api.h"
 #include "mender-client.h"
 #include "mender-inventory.h"
 #include "mender-inventory-api.h"
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-scheduler.h"
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
@@ -34,10 +40,34 @@
 #endif /* CONFIG_MENDER_CLIENT_INVENTORY_REFRESH_INTERVAL */
 
 /**
- * @brief Mender inventory instance
+ * @brief Default length of the buffer given to the inventory providers, including the NUL terminator
+ */
+#ifndef CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_LENGTH
+#define CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_LENGTH (64)
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_LENGTH */
+
+/**
+ * @brief Default delay used to publish the urgent inventory items (milliseconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_INVENTORY_URGENT_DELAY
+#define CONFIG_MENDER_CLIENT_INVENTORY_URGENT_DELAY (2000)
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_URGENT_DELAY */
+
+/**
+ * @brief Default mask of the metrics published as inventory attributes, bit N selects the metric N of mender_metrics_t
  */
-const mender_addon_instance_t mender_inventory_addon_instance
-    = { .init = mender_inventory_init, .activate = mender_inventory_activate, .deactivate = mender_inventory_deactivate, .exit = mender_inventory_exit };
+#ifndef CONFIG_MENDER_CLIENT_INVENTORY_METRICS_MASK
+#define CONFIG_MENDER_CLIENT_INVENTORY_METRICS_MASK (0xFFFFFFFF)
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS_MASK */
+
+/**
+ * @brief Mender inventory provider
+ */
+typedef struct {
+    mender_err_t (*callback)(char *, char *, size_t); /**< Provider callback writing the value of the item */
+    uint32_t ttl;                                     /**< Time during which the value is kept (seconds) */
+    uint64_t expires_at;                              /**< Uptime at which the value expires (microseconds), 0 if the value has never been read */
+} mender_inventory_provider_t;
 
 /**
  * @brief Mender inventory configuration
@@ -50,17 +80,123 @@ static mender_inventory_config_t mender_inventory_config;
 static mender_keystore_t *mender_inventory_keystore = NULL;
 static void              *mender_inventory_mutex    = NULL;
 
+/**
+ * @brief Mender inventory keystore index, so that the items are looked up in constant time when they are updated one by one
+ */
+static mender_keystore_index_t mender_inventory_index = { .length = 0, .size = 0, .buckets = NULL };
+
+/**
+ * @brief Mender inventory items changed since the last publication, one flag per item, NULL if the whole inventory must be published
+ */
+static bool *mender_inventory_changed = NULL;
+
+/**
+ * @brief Mender inventory providers, the items provided with the cached values, and flags of the items changed since the last publication
+ */
+static mender_inventory_provider_t *mender_inventory_providers        = NULL;
+static size_t                       mender_inventory_providers_count  = 0;
+static mender_keystore_t           *mender_inventory_provided         = NULL;
+static bool                        *mender_inventory_provided_changed = NULL;
+
+/**
+ * @brief Mender inventory artifact name published, NULL if not published yet
+ */
+static char *mender_inventory_artifact_name = NULL;
+
 /**
  * @brief Mender inventory work handle
  */
 static void *mender_inventory_work_handle = NULL;
 
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS
+
+/**
+ * @brief Heap statistics published as inventory attributes, the peak of each subsystem, and flags of the attributes changed since the last publication
+ */
+static mender_keystore_t *mender_inventory_heap_keystore = NULL;
+static bool              *mender_inventory_heap_changed  = NULL;
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS */
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_METRICS
+
+/**
+ * @brief Metrics published as inventory attributes, and flags of the attributes changed since the last publication
+ */
+static mender_keystore_t *mender_inventory_metrics_keystore = NULL;
+static bool              *mender_inventory_metrics_changed  = NULL;
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
+
 /**
  * @brief Mender inventory work function
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_inventory_work_function(void);
 
+/**
+ * @brief Compare an inventory to the current inventory and flag the items changed
+ * @param inventory Mender inventory key/value pairs table, must end with a NULL/NULL element, NULL if not defined
+ * @return Flags of the items changed since the last publication, NULL if the names of the items are not the same or if the whole inventory must be published
+ */
+static bool *mender_inventory_compare(mender_keystore_t *inventory);
+
+/**
+ * @brief Read the value of the items provided which have expired and flag the items changed
+ * @return true if items provided have changed since the last publication, false otherwise
+ */
+static bool mender_inventory_providers_update(void);
+
+/**
+ * @brief Check if an inventory item is urgent
+ * @param name Name of the item
+ * @return true if the item is urgent, false otherwise
+ */
+static bool mender_inventory_is_urgent(char *name);
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS
+
+/**
+ * @brief Update the heap statistics published as inventory attributes and flag the attributes changed
+ * @return true if attributes have changed since the last publication, false otherwise
+ */
+static bool mender_inventory_heap_update(void);
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS */
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_METRICS
+
+/**
+ * @brief Update the metrics published as inventory attributes and flag the attributes changed
+ * @return true if attributes have changed since the last publication, false otherwise
+ */
+static bool mender_inventory_metrics_update(void);
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
+
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+
+/**
+ * @brief Get the period of the inventory work performed during the check-in of the client
+ * @return Period of the inventory work (seconds)
+ */
+static int32_t mender_inventory_get_check_in_period(void);
+
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
+
+/**
+ * @brief Mender inventory instance
+ */
+const mender_addon_instance_t mender_inventory_addon_instance = { .init                = mender_inventory_init,
+                                                                  .activate            = mender_inventory_activate,
+                                                                  .deactivate          = mender_inventory_deactivate,
+                                                                  .exit                = mender_inventory_exit,
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+                                                                  .check_in            = mender_inventory_work_function,
+                                                                  .get_check_in_period = mender_inventory_get_check_in_period
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
+};
+
 mender_err_t
 mender_inventory_init(void *config, void *callbacks) {
 
@@ -74,6 +210,12 @@ mender_inventory_init(void *config, void *callbacks) {
     } else {
         mender_inventory_config.refresh_interval = CONFIG_MENDER_CLIENT_INVENTORY_REFRESH_INTERVAL;
     }
+    mender_inventory_config.urgent_items = ((mender_inventory_config_t *)config)->urgent_items;
+    if (0 != ((mender_inventory_config_t *)config)->urgent_delay) {
+        mender_inventory_config.urgent_delay = ((mender_inventory_config_t *)config)->urgent_delay;
+    } else {
+        mender_inventory_config.urgent_delay = CONFIG_MENDER_CLIENT_INVENTORY_URGENT_DELAY;
+    }
 
     /* Create inventory mutex */
     if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_inventory_mutex))) {
@@ -84,8 +226,14 @@ mender_inventory_init(void *config, void *callbacks) {
     /* Create mender inventory work */
     mender_scheduler_work_params_t inventory_work_params;
     inventory_work_params.function = mender_inventory_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+    inventory_work_params.period   = 0; /* Periodic work is performed during the check-in of the client */
+#else
     inventory_work_params.period   = mender_inventory_config.refresh_interval;
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
     inventory_work_params.name     = "mender_inventory";
+    inventory_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_DEFAULT;
+    inventory_work_params.slack    = CONFIG_MENDER_CLIENT_WORK_SLACK;
     if (MENDER_OK != (ret = mender_scheduler_work_create(&inventory_work_params, &mender_inventory_work_handle))) {
         mender_log_error("Unable to create inventory work");
         return ret;
@@ -147,6 +295,7 @@ mender_err_t
 mender_inventory_set(mender_keystore_t *inventory) {
 
     mender_err_t ret;
+    bool        *changed;
 
     /* Take mutex used to protect access to the inventory key-store */
     if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
@@ -154,6 +303,13 @@ mender_inventory_set(mender_keystore_t *inventory) {
         return ret;
     }
 
+    /* Flag the items changed, the whole inventory is published if the names of the items are not the same */
+    changed = mender_inventory_compare(inventory);
+    if (NULL != mender_inventory_changed) {
+        mender_free(mender_inventory_changed);
+    }
+    mender_inventory_changed = changed;
+
     /* Release previous inventory */
     if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_inventory_keystore))) {
         mender_log_error("Unable to delete inventory");
@@ -163,9 +319,13 @@ mender_inventory_set(mender_keystore_t *inventory) {
     /* Copy the new inventory */
     if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_inventory_keystore, inventory))) {
         mender_log_error("Unable to copy inventory");
+        mender_utils_keystore_index_build(mender_inventory_keystore, &mender_inventory_index);
         goto END;
     }
 
+    /* Index the new inventory, the lookups fall back to a linear search if it fails */
+    mender_utils_keystore_index_build(mender_inventory_keystore, &mender_inventory_index);
+
 END:
 
     /* Release mutex used to protect access to the inventory key-store */
@@ -179,6 +339,7 @@ mender_inventory_set_item(char *name, char *value) {
 
     mender_err_t ret;
     int          index;
+    bool         changed;
 
     /* Take mutex used to protect access to the inventory key-store */
     if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
@@ -187,17 +348,103 @@ mender_inventory_set_item(char *name, char *value) {
     }
 
     /* Get item index in inventory key-store */
-    if (0 > (index = mender_utils_keystore_get_item_index(mender_inventory_keystore, name))) {
+    if (0 > (index = mender_utils_keystore_index_lookup(mender_inventory_keystore, &mender_inventory_index, name))) {
         mender_log_error("Unable to find item index in key-store");
         ret = MENDER_NOT_FOUND;
         goto END;
     }
 
-    /* Set item value in inventory key-store */
+    /* Flag the item if its value changes, the whole inventory is published if the item is removed */
+    changed = (NULL == value) || (0 != strcmp(mender_inventory_keystore[index].value, value));
+    if (NULL != mender_inventory_changed) {
+        if (NULL == value) {
+            mender_free(mender_inventory_changed);
+            mender_inventory_changed = NULL;
+        } else if (true == changed) {
+            mender_inventory_changed[index] = true;
+        }
+    }
+
+    /* Set item value in inventory key-store, the inventory ends at the item if it is removed so that it is indexed again */
     if (MENDER_OK != (ret = mender_utils_keystore_set_item(mender_inventory_keystore, index, name, value))) {
         mender_log_error("Unable to allocate memory");
+        mender_utils_keystore_index_build(mender_inventory_keystore, &mender_inventory_index);
+        goto END;
+    }
+    if (NULL == value) {
+        mender_utils_keystore_index_build(mender_inventory_keystore, &mender_inventory_index);
+    }
+
+    /* Publish the urgent item after the delay, the changes occurring meanwhile are published with it */
+    if ((true == changed) && (true == mender_inventory_is_urgent(name))) {
+        if (MENDER_OK != mender_scheduler_work_execute_after(mender_inventory_work_handle, mender_inventory_config.urgent_delay)) {
+            mender_log_error("Unable to trigger inventory work");
+        }
+    }
+
+END:
+
+    /* Release mutex used to protect access to the inventory key-store */
+    mender_scheduler_mutex_give(mender_inventory_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_inventory_register_provider(char *name, mender_err_t (*provider)(char *name, char *value, size_t size), uint32_t ttl) {
+
+    assert(NULL != name);
+    assert(NULL != provider);
+    mender_err_t                 ret;
+    mender_inventory_provider_t *providers;
+    mender_keystore_t           *provided;
+    bool                        *provided_changed;
+    size_t                       count;
+
+    /* Take mutex used to protect access to the inventory key-store */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Check if the item is already provided */
+    if (0 <= mender_utils_keystore_get_item_index(mender_inventory_provided, name)) {
+        mender_log_error("Inventory item '%s' is already provided", name);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Add the provider, the tables are kept if the memory can not be allocated */
+    count = mender_inventory_providers_count;
+    if (NULL == (providers = (mender_inventory_provider_t *)mender_realloc(mender_inventory_providers, (count + 1) * sizeof(mender_inventory_provider_t)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_inventory_providers = providers;
+    if (NULL == (provided = (mender_keystore_t *)mender_realloc(mender_inventory_provided, (count + 2) * sizeof(mender_keystore_item_t)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_inventory_provided = provided;
+    memset(&mender_inventory_provided[count], 0, 2 * sizeof(mender_keystore_item_t));
+    if (NULL == (provided_changed = (bool *)mender_realloc(mender_inventory_provided_changed, (count + 1) * sizeof(bool)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_inventory_provided_changed = provided_changed;
+    if (MENDER_OK != (ret = mender_utils_keystore_set_item(mender_inventory_provided, count, name, ""))) {
+        mender_log_error("Unable to allocate memory");
+        mender_utils_keystore_set_item(mender_inventory_provided, count, NULL, NULL);
         goto END;
     }
+    mender_inventory_providers[count].callback   = provider;
+    mender_inventory_providers[count].ttl        = ttl;
+    mender_inventory_providers[count].expires_at = 0;
+    mender_inventory_provided_changed[count]     = true;
+    mender_inventory_providers_count             = count + 1;
 
 END:
 
@@ -238,8 +485,46 @@ mender_inventory_exit(void) {
 
     /* Release memory */
     mender_inventory_config.refresh_interval = 0;
+    mender_inventory_config.urgent_items     = NULL;
+    mender_inventory_config.urgent_delay     = 0;
     mender_utils_keystore_delete(mender_inventory_keystore);
     mender_inventory_keystore = NULL;
+    mender_utils_keystore_index_release(&mender_inventory_index);
+    if (NULL != mender_inventory_changed) {
+        mender_free(mender_inventory_changed);
+        mender_inventory_changed = NULL;
+    }
+    if (NULL != mender_inventory_artifact_name) {
+        mender_free(mender_inventory_artifact_name);
+        mender_inventory_artifact_name = NULL;
+    }
+    if (NULL != mender_inventory_providers) {
+        mender_free(mender_inventory_providers);
+        mender_inventory_providers = NULL;
+    }
+    mender_inventory_providers_count = 0;
+    mender_utils_keystore_delete(mender_inventory_provided);
+    mender_inventory_provided = NULL;
+    if (NULL != mender_inventory_provided_changed) {
+        mender_free(mender_inventory_provided_changed);
+        mender_inventory_provided_changed = NULL;
+    }
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS
+    mender_utils_keystore_delete(mender_inventory_heap_keystore);
+    mender_inventory_heap_keystore = NULL;
+    if (NULL != mender_inventory_heap_changed) {
+        mender_free(mender_inventory_heap_changed);
+        mender_inventory_heap_changed = NULL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS */
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_METRICS
+    mender_utils_keystore_delete(mender_inventory_metrics_keystore);
+    mender_inventory_metrics_keystore = NULL;
+    if (NULL != mender_inventory_metrics_changed) {
+        mender_free(mender_inventory_metrics_changed);
+        mender_inventory_metrics_changed = NULL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
     mender_scheduler_mutex_give(mender_inventory_mutex);
     mender_scheduler_mutex_delete(mender_inventory_mutex);
     mender_inventory_mutex = NULL;
@@ -251,6 +536,17 @@ static mender_err_t
 mender_inventory_work_function(void) {
 
     mender_err_t ret;
+    char        *artifact_name = mender_client_get_artifact_name();
+    bool         publish_artifact_name;
+    bool         publish_inventory       = true;
+    bool         publish_provided;
+    bool         publish_heap_statistics = false;
+    bool         publish_metrics         = false;
+    size_t       length;
+    size_t       index;
+#if defined(CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS) || defined(CONFIG_MENDER_CLIENT_INVENTORY_METRICS)
+    bool replace_inventory;
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS || CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
 
     /* Take mutex used to protect access to the inventory key-store */
     if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
@@ -258,18 +554,108 @@ mender_inventory_work_function(void) {
         return ret;
     }
 
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+    /* Defer the publication while the memory is under pressure, the changes are kept and published once it is released */
+    if (MENDER_UTILS_MEMORY_PRESSURE_NONE != mender_utils_memory_pressure_get()) {
+        mender_log_warning("Memory is under pressure, publication of the inventory is deferred");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+
+    /* Check if the inventory has changed since the last publication, the network is not used otherwise */
+    publish_artifact_name = (NULL != artifact_name)
+                            && ((NULL == mender_inventory_changed) || (NULL == mender_inventory_artifact_name)
+                                || (0 != strcmp(mender_inventory_artifact_name, artifact_name)));
+    length                = (NULL != mender_inventory_index.buckets) ? mender_inventory_index.length : mender_utils_keystore_length(mender_inventory_keystore);
+    if ((NULL != mender_inventory_changed) && (false == publish_artifact_name)) {
+        index = 0;
+        while ((index < length) && (false == mender_inventory_changed[index])) {
+            index++;
+        }
+        publish_inventory = (index != length);
+    }
+    publish_provided = mender_inventory_providers_update();
+#if defined(CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS) || defined(CONFIG_MENDER_CLIENT_INVENTORY_METRICS)
+    replace_inventory = (true == publish_inventory) && (NULL == mender_inventory_changed);
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS || CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS
+    /* The heap statistics are published if they have changed or if the whole inventory is replaced */
+    publish_heap_statistics = mender_inventory_heap_update() || replace_inventory;
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS */
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_METRICS
+    /* The metrics are published if they have changed or if the whole inventory is replaced */
+    publish_metrics = mender_inventory_metrics_update() || replace_inventory;
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
+    if ((false == publish_inventory) && (false == publish_provided) && (false == publish_heap_statistics) && (false == publish_metrics)) {
+        mender_log_debug("Inventory has not changed");
+        goto END;
+    }
+
     /* Request access to the network */
     if (MENDER_OK != (ret = mender_client_network_connect())) {
         mender_log_error("Requesting access to the network failed");
         goto END;
     }
 
-    /* Publish inventory */
-    if (MENDER_OK
-        != (ret = mender_inventory_api_publish_inventory_data(mender_client_get_artifact_name(), mender_client_get_device_type(), mender_inventory_keystore))) {
+    /* Publish inventory and items provided, only the items changed are published if the whole inventory has already been published */
+    if ((false == publish_inventory) && (false == publish_provided)) {
+        ret = MENDER_OK;
+    } else if (MENDER_OK
+               != (ret = mender_inventory_api_publish_inventory_data((true == publish_artifact_name) ? artifact_name : NULL,
+                                                                     (NULL == mender_inventory_changed) ? mender_client_get_device_type() : NULL,
+                                                                     mender_inventory_keystore,
+                                                                     mender_inventory_changed,
+                                                                     mender_inventory_provided,
+                                                                     mender_inventory_provided_changed))) {
         mender_log_error("Unable to publish inventory data");
+    } else {
+        if (NULL != mender_inventory_provided_changed) {
+            memset(mender_inventory_provided_changed, 0, mender_inventory_providers_count * sizeof(bool));
+        }
+        /* Clear the flags, the whole inventory is published again if the memory can not be allocated */
+        if (NULL != mender_inventory_changed) {
+            mender_free(mender_inventory_changed);
+        }
+        mender_inventory_changed = (bool *)mender_calloc((0 != length) ? length : 1, sizeof(bool));
+        if (true == publish_artifact_name) {
+            if (NULL != mender_inventory_artifact_name) {
+                mender_free(mender_inventory_artifact_name);
+            }
+            mender_inventory_artifact_name = mender_strdup(artifact_name);
+        }
     }
 
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS
+    /* Publish the heap statistics changed, all of them if the whole inventory has been replaced, they are merged with the inventory */
+    if ((MENDER_OK == ret) && (true == publish_heap_statistics) && (NULL != mender_inventory_heap_keystore)) {
+        for (index = 0; (NULL != mender_inventory_heap_keystore[index].name) && (true == replace_inventory); index++) {
+            mender_inventory_heap_changed[index] = true;
+        }
+        if (MENDER_OK
+            != (ret = mender_inventory_api_publish_inventory_data(NULL, NULL, mender_inventory_heap_keystore, mender_inventory_heap_changed, NULL, NULL))) {
+            mender_log_error("Unable to publish heap statistics");
+        } else {
+            memset(mender_inventory_heap_changed, 0, (MENDER_UTILS_HEAP_SUBSYSTEM_ALL + 1) * sizeof(bool));
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS */
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_METRICS
+    /* Publish the metrics changed, all of them if the whole inventory has been replaced, they are merged with the inventory */
+    if ((MENDER_OK == ret) && (true == publish_metrics) && (NULL != mender_inventory_metrics_keystore)) {
+        for (index = 0; (NULL != mender_inventory_metrics_keystore[index].name) && (true == replace_inventory); index++) {
+            mender_inventory_metrics_changed[index] = true;
+        }
+        if (MENDER_OK
+            != (ret = mender_inventory_api_publish_inventory_data(
+                    NULL, NULL, mender_inventory_metrics_keystore, mender_inventory_metrics_changed, NULL, NULL))) {
+            mender_log_error("Unable to publish metrics");
+        } else {
+            memset(mender_inventory_metrics_changed, 0, MENDER_METRICS_COUNT * sizeof(bool));
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
+
     /* Release access to the network */
     mender_client_network_release();
 
@@ -281,4 +667,175 @@ END:
     return ret;
 }
 
+static bool *
+mender_inventory_compare(mender_keystore_t *inventory) {
+
+    bool  *changed;
+    size_t length = mender_utils_keystore_length(inventory);
+
+    /* Check if the whole inventory must be published */
+    if ((NULL == mender_inventory_changed) || (length != mender_utils_keystore_length(mender_inventory_keystore))) {
+        return NULL;
+    }
+
+    /* Compare the items, the items already flagged remain flagged */
+    if (NULL == (changed = (bool *)mender_calloc((0 != length) ? length : 1, sizeof(bool)))) {
+        return NULL;
+    }
+    for (size_t index = 0; index < length; index++) {
+        if (0 != strcmp(inventory[index].name, mender_inventory_keystore[index].name)) {
+            mender_free(changed);
+            return NULL;
+        }
+        changed[index] = (true == mender_inventory_changed[index]) || (0 != strcmp(inventory[index].value, mender_inventory_keystore[index].value));
+    }
+
+    return changed;
+}
+
+static bool
+mender_inventory_providers_update(void) {
+
+    char     value[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_LENGTH];
+    char    *tmp;
+    uint64_t now     = mender_scheduler_get_uptime_us();
+    bool     changed = false;
+
+    /* Read the value of the items expired, the previous value is kept if the provider fails */
+    for (size_t index = 0; index < mender_inventory_providers_count; index++) {
+        mender_inventory_provider_t *provider = &mender_inventory_providers[index];
+        if ((0 == provider->expires_at) || (now >= provider->expires_at)) {
+            memset(value, 0, sizeof(value));
+            if (MENDER_OK != provider->callback(mender_inventory_provided[index].name, value, sizeof(value))) {
+                mender_log_error("Unable to read inventory item '%s'", mender_inventory_provided[index].name);
+            } else {
+                value[sizeof(value) - 1] = '\0';
+                provider->expires_at     = now + (uint64_t)provider->ttl * 1000000;
+                if ((0 != strcmp(mender_inventory_provided[index].value, value)) && (NULL != (tmp = mender_strdup(value)))) {
+                    mender_free(mender_inventory_provided[index].value);
+                    mender_inventory_provided[index].value   = tmp;
+                    mender_inventory_provided_changed[index] = true;
+                }
+            }
+        }
+        changed |= mender_inventory_provided_changed[index];
+    }
+
+    return changed;
+}
+
+static bool
+mender_inventory_is_urgent(char *name) {
+
+    assert(NULL != name);
+
+    /* Look for the item in the urgent items */
+    if (NULL != mender_inventory_config.urgent_items) {
+        for (size_t index = 0; NULL != mender_inventory_config.urgent_items[index]; index++) {
+            if (0 == strcmp(mender_inventory_config.urgent_items[index], name)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_CHECK_IN
+
+static int32_t
+mender_inventory_get_check_in_period(void) {
+
+    return mender_inventory_config.refresh_interval;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CHECK_IN */
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS
+
+static bool
+mender_inventory_heap_update(void) {
+
+    mender_utils_heap_statistics_t statistics;
+    char                           name[32];
+    char                           value[24];
+    bool                           changed = false;
+
+    /* Create the heap statistics attributes */
+    if (NULL == mender_inventory_heap_keystore) {
+        if (NULL == (mender_inventory_heap_keystore = mender_utils_keystore_new(MENDER_UTILS_HEAP_SUBSYSTEM_ALL + 1))) {
+            mender_log_error("Unable to allocate memory");
+            return false;
+        }
+        if (NULL == (mender_inventory_heap_changed = (bool *)mender_calloc(MENDER_UTILS_HEAP_SUBSYSTEM_ALL + 1, sizeof(bool)))) {
+            mender_log_error("Unable to allocate memory");
+            mender_utils_keystore_delete(mender_inventory_heap_keystore);
+            mender_inventory_heap_keystore = NULL;
+            return false;
+        }
+    }
+
+    /* Update the peak of each subsystem, the peaks only grow so that the attributes change rarely */
+    for (mender_utils_heap_subsystem_t subsystem = 0; subsystem <= MENDER_UTILS_HEAP_SUBSYSTEM_ALL; subsystem++) {
+        mender_utils_get_heap_statistics(subsystem, &statistics);
+        snprintf(name, sizeof(name), "mender_heap_peak_%s", mender_utils_heap_subsystem_to_string(subsystem));
+        snprintf(value, sizeof(value), "%zu", statistics.peak);
+        if ((NULL == mender_inventory_heap_keystore[subsystem].value) || (0 != strcmp(mender_inventory_heap_keystore[subsystem].value, value))) {
+            if (MENDER_OK == mender_utils_keystore_set_item(mender_inventory_heap_keystore, subsystem, name, value)) {
+                mender_inventory_heap_changed[subsystem] = true;
+            }
+        }
+        changed |= mender_inventory_heap_changed[subsystem];
+    }
+
+    return changed;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_HEAP_STATISTICS */
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_METRICS
+
+static bool
+mender_inventory_metrics_update(void) {
+
+    char   name[48];
+    char   value[12];
+    size_t index   = 0;
+    bool   changed = false;
+
+    /* Create the metrics attributes */
+    if (NULL == mender_inventory_metrics_keystore) {
+        if (NULL == (mender_inventory_metrics_keystore = mender_utils_keystore_new(MENDER_METRICS_COUNT))) {
+            mender_log_error("Unable to allocate memory");
+            return false;
+        }
+        if (NULL == (mender_inventory_metrics_changed = (bool *)mender_calloc(MENDER_METRICS_COUNT, sizeof(bool)))) {
+            mender_log_error("Unable to allocate memory");
+            mender_utils_keystore_delete(mender_inventory_metrics_keystore);
+            mender_inventory_metrics_keystore = NULL;
+            return false;
+        }
+    }
+
+    /* Update the metrics selected by the mask, they are packed at the beginning of the keystore */
+    for (mender_metrics_t metric = 0; metric < MENDER_METRICS_COUNT; metric++) {
+        if (0 == (CONFIG_MENDER_CLIENT_INVENTORY_METRICS_MASK & (1UL << metric))) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "mender_metrics_%s", mender_metrics_to_string(metric));
+        snprintf(value, sizeof(value), "%lu", (unsigned long)mender_metrics_get(metric));
+        if ((NULL == mender_inventory_metrics_keystore[index].value) || (0 != strcmp(mender_inventory_metrics_keystore[index].value, value))) {
+            if (MENDER_OK == mender_utils_keystore_set_item(mender_inventory_metrics_keystore, index, name, value)) {
+                mender_inventory_metrics_changed[index] = true;
+            }
+        }
+        changed |= mender_inventory_metrics_changed[index];
+        index++;
+    }
+
+    return changed;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_METRICS */
+
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
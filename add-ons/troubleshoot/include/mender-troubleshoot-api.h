@@ -28,6 +28,15 @@ extern "C" {
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 
+/**
+ * @brief Lanes of the messages sent to the server
+ */
+typedef enum {
+    MENDER_TROUBLESHOOT_API_LANE_CONTROL = 0, /**< Control messages, acks, errors and interactive shell data, sent first */
+    MENDER_TROUBLESHOOT_API_LANE_BULK,        /**< Bulk data of the file transfers and of the port forwarding connections */
+    MENDER_TROUBLESHOOT_API_LANE_COUNT        /**< Number of lanes, not a lane */
+} mender_troubleshoot_api_lane_t;
+
 /**
  * @brief Mender troubleshoot API configuration
  */
@@ -56,12 +65,55 @@ mender_err_t mender_troubleshoot_api_connect(mender_err_t (*callback)(void *, si
 bool mender_troubleshoot_api_is_connected(void);
 
 /**
- * @brief Send binary data to the server
- * @param payload Payload to send
- * @param length Length of the payload
+ * @brief Get the time elapsed since the last frame received from the server, the pings and the pongs are taken into account
+ * @return Time elapsed since the last frame received (seconds), UINT32_MAX if the connection has been lost
+ */
+uint32_t mender_troubleshoot_api_get_inactivity(void);
+
+/**
+ * @brief Send a websocket ping to the server, the pong is taken into account to check the connection is alive
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_troubleshoot_api_send(void *payload, size_t length);
+mender_err_t mender_troubleshoot_api_ping(void);
+
+/**
+ * @brief Send binary data to the server, the data is queued in its lane and sent by the send task if the send queue is enabled
+ * @param payload Payload to send, a pack buffer which is given back once it has been sent if there is no callback
+ * @param length Length of the payload
+ * @param lane Lane of the message, the messages of the control lane are sent ahead of the bulk data
+ * @param delay_ms Delay to wait for free space in the lane, -1 to block indefinitely (without a timeout)
+ * @param callback Callback invoked with the result once the payload has been sent, the payload remains owned by the caller, NULL if not used
+ * @param params Callback parameters
+ * @return MENDER_OK if the function succeeds, error code otherwise and the callback is not invoked
+ */
+mender_err_t mender_troubleshoot_api_send(
+    void *payload, size_t length, mender_troubleshoot_api_lane_t lane, int32_t delay_ms, void (*callback)(mender_err_t, void *), void *params);
+
+/**
+ * @brief Take a pack buffer used to encode a message sent to the server, the buffers are reused for all the messages
+ * @param size Size of the buffer
+ * @return Buffer if the function succeeds, NULL otherwise
+ */
+void *mender_troubleshoot_api_buffer_take(size_t *size);
+
+/**
+ * @brief Grow a pack buffer for a large message
+ * @param data Buffer
+ * @param size New size of the buffer
+ * @return Buffer if the function succeeds, NULL otherwise and the previous buffer remains valid
+ */
+void *mender_troubleshoot_api_buffer_grow(void *data, size_t size);
+
+/**
+ * @brief Give back a pack buffer once the message has been sent
+ * @param data Buffer
+ */
+void mender_troubleshoot_api_buffer_give(void *data);
+
+/**
+ * @brief Release the pack buffers which are not in use, invoked once a session is closed so that they are not kept in memory between the sessions
+ */
+void mender_troubleshoot_api_buffer_release(void);
 
 /**
  * @brief Disconnect the device
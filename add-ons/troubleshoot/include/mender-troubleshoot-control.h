@@ -34,14 +34,6 @@ extern "C" {
  */
 mender_err_t mender_troubleshoot_control_init(void);
 
-/**
- * @brief Function called to perform the treatment of the control messages
- * @param protomsg Received proto message
- * @param response Response to be sent back to the server, NULL if no response to send
- * @return MENDER_OK if the function succeeds, error code if an error occured
- */
-mender_err_t mender_troubleshoot_control_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
-
 /**
  * @brief Close mender troubleshoot add-on control connection
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -39,6 +39,7 @@ typedef struct {
     mender_err_t (*read)(void *, void *, size_t *);                                            /**< Invoked to read data from the file */
     mender_err_t (*write)(void *, void *, size_t);                                             /**< Invoked to write data to the file */
     mender_err_t (*close)(void *);                                                             /**< Invoked to close the file */
+    mender_err_t (*list)(char *, mender_err_t (*)(char *, void *), void *);                    /**< Invoked to list the entries of a directory (optional) */
 } mender_troubleshoot_file_transfer_callbacks_t;
 
 /**
@@ -48,14 +49,6 @@ typedef struct {
  */
 mender_err_t mender_troubleshoot_file_transfer_init(mender_troubleshoot_file_transfer_callbacks_t *callbacks);
 
-/**
- * @brief Function called to perform the treatment of the file transfer messages
- * @param protomsg Received proto message
- * @param response Response to be sent back to the server, NULL if no response to send
- * @return MENDER_OK if the function succeeds, error code if an error occured
- */
-mender_err_t mender_troubleshoot_file_transfer_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
-
 /**
  * @brief Release mender troubleshoot add-on file transfer handler
  * @return MENDER_OK if the function succeeds, error code otherwise
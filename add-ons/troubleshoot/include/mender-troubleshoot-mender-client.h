@@ -34,14 +34,6 @@ extern "C" {
  */
 mender_err_t mender_troubleshoot_mender_client_init(void);
 
-/**
- * @brief Function called to perform the treatment of the mender client messages
- * @param protomsg Received proto message
- * @param response Response to be sent back to the server, NULL if no response to send
- * @return MENDER_OK if the function succeeds, error code if an error occured
- */
-mender_err_t mender_troubleshoot_mender_client_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
-
 /**
  * @brief Release mender troubleshoot add-on mender client handler
  * @return MENDER_OK if the function succeeds, error code otherwise
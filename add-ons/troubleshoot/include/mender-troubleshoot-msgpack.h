@@ -42,6 +42,14 @@ extern "C" {
 #define MSGPACK_OBJECT_FIX_INT32  0x86
 #define MSGPACK_OBJECT_FIX_INT64  0x87
 
+/**
+ * @brief Initialize msgpack packer writing to a msgpack sbuffer
+ * @param sbuffer msgpack sbuffer, data to be released with msgpack_sbuffer_destroy or by the caller of the function which returns it
+ * @param packer msgpack packer
+ * @param MENDER_OK if the function succeeds, error code if an error occured
+ */
+mender_err_t mender_troubleshoot_msgpack_packer_init(msgpack_sbuffer *sbuffer, msgpack_packer *packer);
+
 /**
  * @brief Pack msgpack object
  * @param object msgpack object
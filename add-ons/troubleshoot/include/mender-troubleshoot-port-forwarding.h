@@ -37,6 +37,7 @@ typedef struct {
     mender_err_t (*connect)(char *, uint16_t, char *, void **); /**< Open connection to remote host */
     mender_err_t (*send)(void *, void *, size_t);               /**< Send data to remote host */
     mender_err_t (*close)(void *);                              /**< Close connection to remote host */
+    mender_err_t (*credits)(void *, size_t);                    /**< Credits available again after a stall, must not forward data itself, NULL if not used */
 } mender_troubleshoot_port_forwarding_callbacks_t;
 
 /**
@@ -47,23 +48,34 @@ typedef struct {
 mender_err_t mender_troubleshoot_port_forwarding_init(mender_troubleshoot_port_forwarding_callbacks_t *callbacks);
 
 /**
- * @brief Function called to perform the treatment of the port forwarding messages
- * @param protomsg Received proto message
- * @param response Response to be sent back to the server, NULL if no response to send
+ * @brief Send port forwarding data to the server
+ * @param handle Connection handle returned by the connect callback
+ * @param data Data to send to the server
+ * @param length Length of the data to send to the server
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-mender_err_t mender_troubleshoot_port_forwarding_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
+mender_err_t mender_troubleshoot_port_forwarding_forward(void *handle, void *data, size_t length);
 
 /**
- * @brief Send port forwarding data to the server
- * @param data Data to send to the server
- * @param length Length of the data to send to the server
+ * @brief Get the buffer of the connection to write the data to send to the server without copy
+ * @note The size is the credits available, the application should stop reading the remote host when it is 0 and until the credits callback is invoked
+ * @param handle Connection handle returned by the connect callback
+ * @param data Buffer where the data to send to the server should be written
+ * @param size Size available in the buffer, 0 if the data previously committed is being sent
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+mender_err_t mender_troubleshoot_port_forwarding_get_buffer(void *handle, void **data, size_t *size);
+
+/**
+ * @brief Commit the data written in the buffer of the connection and send it to the server, the header is packed in place in front of the data
+ * @param handle Connection handle returned by the connect callback
+ * @param length Length of the data written in the buffer, must not exceed the size returned by mender_troubleshoot_port_forwarding_get_buffer
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-mender_err_t mender_troubleshoot_port_forwarding_forward(void *data, size_t length);
+mender_err_t mender_troubleshoot_port_forwarding_commit(void *handle, size_t length);
 
 /**
- * @brief Close mender troubleshoot add-on port forwarding connection
+ * @brief Close mender troubleshoot add-on port forwarding connections
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
 mender_err_t mender_troubleshoot_port_forwarding_close(void);
@@ -63,6 +63,11 @@ typedef struct {
     size_t                                               *offset;          /**< Offset */
 } mender_troubleshoot_protomsg_hdr_properties_t;
 
+/**
+ * @brief Proto message type
+ */
+typedef struct mender_troubleshoot_protomsg_type_s mender_troubleshoot_protomsg_type_t;
+
 /**
  * @brief Proto message header
  */
@@ -71,6 +76,7 @@ typedef struct {
     char                                          *typ;        /**< Message type */
     char                                          *sid;        /**< Session ID */
     mender_troubleshoot_protomsg_hdr_properties_t *properties; /**< Properties */
+    const mender_troubleshoot_protomsg_type_t     *type;       /**< Message type resolved when the header is decoded, NULL if it is not registered */
 } mender_troubleshoot_protomsg_hdr_t;
 
 /**
@@ -87,19 +93,110 @@ typedef struct {
 typedef struct {
     mender_troubleshoot_protomsg_hdr_t  *hdr;  /**< Header */
     mender_troubleshoot_protomsg_body_t *body; /**< Body */
+    msgpack_zone                        *zone; /**< msgpack zone the message is allocated from if it has been unpacked, NULL otherwise */
 } mender_troubleshoot_protomsg_t;
 
+/**
+ * @brief Proto message type, the messages are dispatched to the handler of their type
+ */
+struct mender_troubleshoot_protomsg_type_s {
+    const char *typ;                                                                                            /**< Message type */
+    mender_err_t (*handler)(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response); /**< Handler, NULL if nothing to do */
+};
+
+/**
+ * @brief Proto registered to dispatch its messages
+ */
+typedef struct {
+    mender_troubleshoot_protomsg_hdr_proto_t   proto; /**< Proto type */
+    const mender_troubleshoot_protomsg_type_t *types; /**< Message types of the proto */
+    size_t                                     count; /**< Number of message types */
+    bool                                       sid;   /**< The messages must have a session ID */
+} mender_troubleshoot_protomsg_proto_t;
+
+/**
+ * @brief Proto message header template, the header is packed once and reused for all the messages sent with it
+ */
+typedef struct {
+    void  *data;   /**< Packed header, without the value of the offset if any, NULL if not created */
+    size_t length; /**< Length of the packed header */
+    bool   offset; /**< The header has an offset property, its value is packed with each message */
+} mender_troubleshoot_protomsg_hdr_template_t;
+
+/**
+ * @brief Register a proto, the type of its messages is resolved when they are decoded
+ * @note The protos are registered and unregistered while the device is not connected to the server
+ * @param proto Proto, it must remain valid until it is unregistered
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_troubleshoot_protomsg_register(const mender_troubleshoot_protomsg_proto_t *proto);
+
+/**
+ * @brief Unregister a proto, its messages are not supported anymore
+ * @param proto Proto type
+ */
+void mender_troubleshoot_protomsg_unregister(mender_troubleshoot_protomsg_hdr_proto_t proto);
+
 /**
  * @brief Encode and pack proto message
  * @param protomsg Proto message
- * @param data Packed data encoded
+ * @param data Packed data encoded, to be released with mender_troubleshoot_api_buffer_give
  * @param length Length of the data encoded
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_troubleshoot_protomsg_pack(mender_troubleshoot_protomsg_t *protomsg, void **data, size_t *length);
 
+/**
+ * @brief Create proto message header template
+ * @param hdr Proto message header, the offset property is the only one which can be modified for each message
+ * @param hdr_template Proto message header template, to be released with mender_troubleshoot_protomsg_hdr_template_release
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_troubleshoot_protomsg_hdr_template_create(mender_troubleshoot_protomsg_hdr_t           *hdr,
+                                                              mender_troubleshoot_protomsg_hdr_template_t *hdr_template);
+
+/**
+ * @brief Pack proto message using a header template
+ * @param hdr_template Proto message header template
+ * @param offset Offset packed with the header, ignored if the header has no offset property
+ * @param body Body of the message, NULL if the message has no body
+ * @param body_length Length of the body
+ * @param data Packed data encoded, to be released with mender_troubleshoot_api_buffer_give
+ * @param length Length of the data encoded
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_troubleshoot_protomsg_hdr_template_pack(
+    mender_troubleshoot_protomsg_hdr_template_t *hdr_template, size_t offset, void *body, size_t body_length, void **data, size_t *length);
+
+/**
+ * @brief Get the size to be reserved in front of the body to pack proto message in place using a header template
+ * @param hdr_template Proto message header template
+ * @return Maximum size of the data packed in front of the body
+ */
+size_t mender_troubleshoot_protomsg_hdr_template_headroom(mender_troubleshoot_protomsg_hdr_template_t *hdr_template);
+
+/**
+ * @brief Pack proto message in place using a header template, the header is packed in front of the body so that it is not copied
+ * @param hdr_template Proto message header template
+ * @param offset Offset packed with the header, ignored if the header has no offset property
+ * @param body Body of the message, at least mender_troubleshoot_protomsg_hdr_template_headroom bytes must be available in front of it
+ * @param body_length Length of the body, must not be 0
+ * @param data Packed data encoded, it points to the reserved area in front of the body
+ * @param length Length of the data encoded
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_troubleshoot_protomsg_hdr_template_prepend(
+    mender_troubleshoot_protomsg_hdr_template_t *hdr_template, size_t offset, void *body, size_t body_length, void **data, size_t *length);
+
+/**
+ * @brief Release proto message header template
+ * @param hdr_template Proto message header template
+ */
+void mender_troubleshoot_protomsg_hdr_template_release(mender_troubleshoot_protomsg_hdr_template_t *hdr_template);
+
 /**
  * @brief Unpack and decode proto message
+ * @note The message is allocated from a msgpack zone and the body points to the packed data, which must remain valid until the message is released
  * @param data Packed data to be decoded
  * @param length Length of the data to be decoded
  * @return Proto message if the function succeeds, NULL otherwise
@@ -38,12 +38,13 @@ typedef struct {
 
 /**
  * @brief Mender troubleshoot shell callbacks
+ * @note Several sessions can be opened at the same time, the session given to the callbacks permits to print the output to the session
  */
 typedef struct {
-    mender_err_t (*open)(uint16_t, uint16_t);   /**< Invoked when shell is connected */
-    mender_err_t (*resize)(uint16_t, uint16_t); /**< Invoked when shell is resized */
-    mender_err_t (*write)(void *, size_t);      /**< Invoked when shell data is received */
-    mender_err_t (*close)(void);                /**< Invoked when shell is disconnected */
+    mender_err_t (*open)(void *, uint16_t, uint16_t);   /**< Invoked when shell is connected */
+    mender_err_t (*resize)(void *, uint16_t, uint16_t); /**< Invoked when shell is resized */
+    mender_err_t (*write)(void *, void *, size_t);      /**< Invoked when shell data is received */
+    mender_err_t (*close)(void *);                      /**< Invoked when shell is disconnected */
 } mender_troubleshoot_shell_callbacks_t;
 
 /**
@@ -54,14 +55,6 @@ typedef struct {
  */
 mender_err_t mender_troubleshoot_shell_init(mender_troubleshoot_shell_config_t *config, mender_troubleshoot_shell_callbacks_t *callbacks);
 
-/**
- * @brief Function called to perform the treatment of the shell messages
- * @param protomsg Received proto message
- * @param response Response to be sent back to the server, NULL if no response to send
- * @return MENDER_OK if the function succeeds, error code if an error occured
- */
-mender_err_t mender_troubleshoot_shell_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
-
 /**
  * @brief Mender troubleshoot shell handler healthcheck
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -70,14 +63,15 @@ mender_err_t mender_troubleshoot_shell_healthcheck(void);
 
 /**
  * @brief Send shell data to the server
+ * @param session Session given to the callbacks, NULL to print to all the sessions opened
  * @param data Data to send to the server for printing in the console
  * @param length Length of data to send to the server
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_troubleshoot_shell_print(void *data, size_t length);
+mender_err_t mender_troubleshoot_shell_print(void *session, void *data, size_t length);
 
 /**
- * @brief Close mender troubleshoot add-on shell connection
+ * @brief Close mender troubleshoot add-on shell connection, all the sessions opened are closed
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_troubleshoot_shell_close(void);
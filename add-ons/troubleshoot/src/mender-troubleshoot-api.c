@@ -17,8 +17,14 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-api.h"
 #include "mender-log.h"
+#include "mender-scheduler.h"
 #include "mender-troubleshoot-api.h"
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
@@ -30,6 +36,84 @@
  */
 #define MENDER_TROUBLESHOOT_API_PATH_GET_DEVICE_CONNECT "/api/devices/v1/deviceconnect/connect"
 
+/**
+ * @brief Default number of pack buffers
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS (2)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS */
+
+/**
+ * @brief Default size of the pack buffers (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE (512)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE */
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+/**
+ * @brief Default number of messages of the control lane of the send queue
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_CONTROL_LENGTH
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_CONTROL_LENGTH (8)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_CONTROL_LENGTH */
+
+/**
+ * @brief Default number of messages of the bulk lane of the send queue
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_BULK_LENGTH
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_BULK_LENGTH (4)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_BULK_LENGTH */
+
+/**
+ * @brief Default send task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_STACK_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_STACK_SIZE (4)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_STACK_SIZE */
+
+/**
+ * @brief Default send task priority
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_PRIORITY
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_PRIORITY */
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
+/**
+ * @brief Pack buffer
+ */
+typedef struct {
+    void  *data; /**< Data of the buffer, NULL if not allocated */
+    size_t size; /**< Size of the buffer */
+    bool   used; /**< Buffer in use */
+} mender_troubleshoot_api_buffer_t;
+
+/**
+ * @brief Message queued to be sent to the server
+ */
+typedef struct {
+    void  *payload;                         /**< Payload to send */
+    size_t length;                          /**< Length of the payload */
+    void (*callback)(mender_err_t, void *); /**< Callback invoked once the payload has been sent, NULL to give back the pack buffer */
+    void *params;                           /**< Callback parameters */
+} mender_troubleshoot_api_message_t;
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+/**
+ * @brief Send queue, a token is queued for each message so that the send task waits for the messages of all the lanes at once
+ */
+typedef struct {
+    void *lanes[MENDER_TROUBLESHOOT_API_LANE_COUNT]; /**< Messages queued in each lane */
+    void *tokens;                                    /**< Tokens of the messages queued, true to stop the send task */
+    void *task;                                      /**< Send task handle, NULL if not started */
+} mender_troubleshoot_api_send_queue_t;
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
 /**
  * @brief Mender troubleshoot API config
  */
@@ -40,6 +124,69 @@ static mender_troubleshoot_api_config_t mender_troubleshoot_api_config;
  */
 static void *mender_troubleshoot_api_handle = NULL;
 
+/**
+ * @brief Uptime of the last frame received from the server (seconds)
+ */
+static uint32_t mender_troubleshoot_api_heartbeat = 0;
+
+/**
+ * @brief Connection lost, the disconnection has been reported by the websocket
+ */
+static bool mender_troubleshoot_api_lost = false;
+
+/**
+ * @brief Pack buffers, they are allocated when they are used for the first time and reused for all the messages until the session is closed
+ */
+static mender_troubleshoot_api_buffer_t mender_troubleshoot_api_buffers[CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS];
+
+/**
+ * @brief Mutex used to protect access to the pack buffers
+ */
+static void *mender_troubleshoot_api_buffers_mutex = NULL;
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+/**
+ * @brief Send queue
+ */
+static mender_troubleshoot_api_send_queue_t mender_troubleshoot_api_send_queue;
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
+/**
+ * @brief Find the pack buffer owning data
+ * @param data Data of the buffer
+ * @return Pack buffer, NULL if the data is not owned by a pack buffer
+ */
+static mender_troubleshoot_api_buffer_t *mender_troubleshoot_api_buffer_find(void *data);
+
+/**
+ * @brief Complete a message, the callback is invoked or the pack buffer is given back
+ * @param message Message
+ * @param result Result of the send
+ */
+static void mender_troubleshoot_api_complete(mender_troubleshoot_api_message_t *message, mender_err_t result);
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+/**
+ * @brief Send task, the messages of the control lane are sent ahead of the bulk data
+ * @param arg Not used
+ */
+static void mender_troubleshoot_api_send_task(void *arg);
+
+/**
+ * @brief Stop the send task once the messages queued have been sent, the messages queued meanwhile are discarded
+ */
+static void mender_troubleshoot_api_send_task_stop(void);
+
+/**
+ * @brief Discard the messages and the tokens of the send queue, the messages are completed with a failure
+ */
+static void mender_troubleshoot_api_send_queue_flush(void);
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
 /**
  * @brief Websocket callback used to handle websocket data
  * @param event Websocket client event
@@ -60,6 +207,36 @@ mender_troubleshoot_api_init(mender_troubleshoot_api_config_t *config) {
     /* Save configuration */
     memcpy(&mender_troubleshoot_api_config, config, sizeof(mender_troubleshoot_api_config_t));
 
+    /* Create pack buffers mutex */
+    memset(mender_troubleshoot_api_buffers, 0, sizeof(mender_troubleshoot_api_buffers));
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_api_buffers_mutex))) {
+        mender_log_error("Unable to create pack buffers mutex");
+        return ret;
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+    /* Create send queue, the tokens queue can hold a token for each message and the stop token */
+    memset(&mender_troubleshoot_api_send_queue, 0, sizeof(mender_troubleshoot_api_send_queue_t));
+    if ((MENDER_OK
+         != (ret = mender_scheduler_queue_create(CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_CONTROL_LENGTH,
+                                                 sizeof(mender_troubleshoot_api_message_t),
+                                                 &mender_troubleshoot_api_send_queue.lanes[MENDER_TROUBLESHOOT_API_LANE_CONTROL])))
+        || (MENDER_OK
+            != (ret = mender_scheduler_queue_create(CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_BULK_LENGTH,
+                                                    sizeof(mender_troubleshoot_api_message_t),
+                                                    &mender_troubleshoot_api_send_queue.lanes[MENDER_TROUBLESHOOT_API_LANE_BULK])))
+        || (MENDER_OK
+            != (ret = mender_scheduler_queue_create(
+                    CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_CONTROL_LENGTH + CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE_BULK_LENGTH + 1,
+                    sizeof(bool),
+                    &mender_troubleshoot_api_send_queue.tokens)))) {
+        mender_log_error("Unable to create send queue");
+        return ret;
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
     /* Initializations */
     mender_websocket_config_t mender_websocket_config = { .host = mender_troubleshoot_api_config.host };
     if (MENDER_OK != (ret = mender_websocket_init(&mender_websocket_config))) {
@@ -75,7 +252,24 @@ mender_troubleshoot_api_connect(mender_err_t (*callback)(void *, size_t)) {
 
     mender_err_t ret;
 
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+    /* Create send task before the connection is opened so that the responses to the first messages can be queued */
+    mender_scheduler_task_params_t task_params = { .function   = mender_troubleshoot_api_send_task,
+                                                   .arg        = NULL,
+                                                   .name       = "mender_troubleshoot_send",
+                                                   .stack_size = CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_STACK_SIZE,
+                                                   .priority   = CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_TASK_PRIORITY };
+    if (MENDER_OK != (ret = mender_scheduler_task_create(&task_params, &mender_troubleshoot_api_send_queue.task))) {
+        mender_log_error("Unable to create send task");
+        goto END;
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
     /* Open websocket connection */
+    mender_troubleshoot_api_heartbeat = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
+    mender_troubleshoot_api_lost      = false;
     if (MENDER_OK
         != (ret = mender_websocket_connect(mender_api_get_authentication_token(),
                                            MENDER_TROUBLESHOOT_API_PATH_GET_DEVICE_CONNECT,
@@ -83,6 +277,9 @@ mender_troubleshoot_api_connect(mender_err_t (*callback)(void *, size_t)) {
                                            callback,
                                            &mender_troubleshoot_api_handle))) {
         mender_log_error("Unable to open websocket connection");
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+        mender_troubleshoot_api_send_task_stop();
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
         goto END;
     }
 
@@ -98,20 +295,212 @@ mender_troubleshoot_api_is_connected(void) {
     return (NULL != mender_troubleshoot_api_handle) ? true : false;
 }
 
+uint32_t
+mender_troubleshoot_api_get_inactivity(void) {
+
+    /* Return the time elapsed since the last frame received */
+    if (true == mender_troubleshoot_api_lost) {
+        return UINT32_MAX;
+    }
+
+    return (uint32_t)(mender_scheduler_get_uptime_us() / 1000000) - mender_troubleshoot_api_heartbeat;
+}
+
 mender_err_t
-mender_troubleshoot_api_send(void *payload, size_t length) {
+mender_troubleshoot_api_ping(void) {
 
-    mender_err_t ret;
+    /* Check if the device is connected */
+    if (NULL == mender_troubleshoot_api_handle) {
+        mender_log_error("Troubleshoot client is not connected");
+        return MENDER_FAIL;
+    }
+
+    /* Send ping over websocket connection */
+    return mender_websocket_ping(mender_troubleshoot_api_handle);
+}
+
+mender_err_t
+mender_troubleshoot_api_send(
+    void *payload, size_t length, mender_troubleshoot_api_lane_t lane, int32_t delay_ms, void (*callback)(mender_err_t, void *), void *params) {
+
+    assert(NULL != payload);
+    assert(lane < MENDER_TROUBLESHOOT_API_LANE_COUNT);
+    mender_troubleshoot_api_message_t message = { .payload = payload, .length = length, .callback = callback, .params = params };
+    mender_err_t                      ret;
+
+    /* Check if the device is connected */
+    if (NULL == mender_troubleshoot_api_handle) {
+        mender_log_error("Troubleshoot client is not connected");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+    /* Queue the message in its lane, the lane is full if the delay expires */
+    bool stop = false;
+    if (MENDER_OK != (ret = mender_scheduler_queue_send(mender_troubleshoot_api_send_queue.lanes[lane], &message, delay_ms))) {
+        mender_log_error("Unable to queue message, the send queue is full");
+        goto FAIL;
+    }
+
+    /* Wake up the send task, there is always room for the token */
+    mender_scheduler_queue_send(mender_troubleshoot_api_send_queue.tokens, &stop, -1);
+
+#else
 
     /* Send data over websocket connection */
+    (void)lane;
+    (void)delay_ms;
     if (MENDER_OK != (ret = mender_websocket_send(mender_troubleshoot_api_handle, payload, length))) {
         mender_log_error("Unable to send data over websocket connection");
+        goto FAIL;
+    }
+    mender_troubleshoot_api_complete(&message, ret);
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
+    return ret;
+
+FAIL:
+
+    /* Give back the pack buffer, the callback is not invoked */
+    if (NULL == callback) {
+        mender_troubleshoot_api_buffer_give(payload);
+    }
+
+    return ret;
+}
+
+void *
+mender_troubleshoot_api_buffer_take(size_t *size) {
+
+    assert(NULL != size);
+    void *data = NULL;
+
+    /* Take mutex used to protect access to the pack buffers */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_api_buffers_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return NULL;
+    }
+
+    /* Take the first pack buffer available */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS; index++) {
+        mender_troubleshoot_api_buffer_t *buffer = &mender_troubleshoot_api_buffers[index];
+        if (false == buffer->used) {
+            if (NULL == buffer->data) {
+                if (NULL == (buffer->data = mender_malloc(CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE))) {
+                    break;
+                }
+                buffer->size = CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE;
+            }
+            buffer->used = true;
+            data         = buffer->data;
+            *size        = buffer->size;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the pack buffers */
+    mender_scheduler_mutex_give(mender_troubleshoot_api_buffers_mutex);
+
+    /* Allocate a temporary buffer if all the pack buffers are in use */
+    if (NULL == data) {
+        if (NULL == (data = mender_malloc(CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE))) {
+            mender_log_error("Unable to allocate memory");
+            return NULL;
+        }
+        *size = CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE;
+    }
+
+    return data;
+}
+
+void *
+mender_troubleshoot_api_buffer_grow(void *data, size_t size) {
+
+    assert(NULL != data);
+    mender_troubleshoot_api_buffer_t *buffer;
+    void                             *tmp;
+
+    /* Take mutex used to protect access to the pack buffers */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_api_buffers_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return NULL;
+    }
+
+    /* Grow the buffer, it remains valid if the allocation fails */
+    buffer = mender_troubleshoot_api_buffer_find(data);
+    if (NULL == (tmp = mender_realloc(data, size))) {
+        mender_log_error("Unable to allocate memory");
         goto END;
     }
+    if (NULL != buffer) {
+        buffer->data = tmp;
+        buffer->size = size;
+    }
 
 END:
 
-    return ret;
+    /* Release mutex used to protect access to the pack buffers */
+    mender_scheduler_mutex_give(mender_troubleshoot_api_buffers_mutex);
+
+    return tmp;
+}
+
+void
+mender_troubleshoot_api_buffer_give(void *data) {
+
+    mender_troubleshoot_api_buffer_t *buffer;
+
+    /* Check data */
+    if (NULL == data) {
+        return;
+    }
+
+    /* Take mutex used to protect access to the pack buffers */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_api_buffers_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return;
+    }
+
+    /* Give back the pack buffer, the buffers grown for large messages are released so that they are not kept in memory */
+    if (NULL != (buffer = mender_troubleshoot_api_buffer_find(data))) {
+        if (buffer->size > CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFER_SIZE) {
+            mender_free(buffer->data);
+            buffer->data = NULL;
+            buffer->size = 0;
+        }
+        buffer->used = false;
+    } else {
+        mender_free(data);
+    }
+
+    /* Release mutex used to protect access to the pack buffers */
+    mender_scheduler_mutex_give(mender_troubleshoot_api_buffers_mutex);
+}
+
+void
+mender_troubleshoot_api_buffer_release(void) {
+
+    /* Take mutex used to protect access to the pack buffers */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_api_buffers_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return;
+    }
+
+    /* Release the pack buffers not in use, the buffers in use are given back by the messages being sent */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS; index++) {
+        mender_troubleshoot_api_buffer_t *buffer = &mender_troubleshoot_api_buffers[index];
+        if ((false == buffer->used) && (NULL != buffer->data)) {
+            mender_free(buffer->data);
+            buffer->data = NULL;
+            buffer->size = 0;
+        }
+    }
+
+    /* Release mutex used to protect access to the pack buffers */
+    mender_scheduler_mutex_give(mender_troubleshoot_api_buffers_mutex);
 }
 
 mender_err_t
@@ -119,12 +508,23 @@ mender_troubleshoot_api_disconnect(void) {
 
     mender_err_t ret;
 
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+    /* Stop send task */
+    mender_troubleshoot_api_send_task_stop();
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
     /* Close websocket connection */
     if (MENDER_OK != (ret = mender_websocket_disconnect(mender_troubleshoot_api_handle))) {
         mender_log_error("Unable to close websocket connection");
         goto END;
     }
     mender_troubleshoot_api_handle = NULL;
+    mender_troubleshoot_api_lost   = false;
+
+    /* Release the pack buffers, only the control messages are exchanged until the next connection */
+    mender_troubleshoot_api_buffer_release();
 
 END:
 
@@ -137,9 +537,133 @@ mender_troubleshoot_api_exit(void) {
     /* Release all modules */
     mender_websocket_exit();
 
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+    /* Release send queue */
+    mender_troubleshoot_api_send_queue_flush();
+    for (size_t index = 0; index < MENDER_TROUBLESHOOT_API_LANE_COUNT; index++) {
+        if (NULL != mender_troubleshoot_api_send_queue.lanes[index]) {
+            mender_scheduler_queue_delete(mender_troubleshoot_api_send_queue.lanes[index]);
+        }
+    }
+    if (NULL != mender_troubleshoot_api_send_queue.tokens) {
+        mender_scheduler_queue_delete(mender_troubleshoot_api_send_queue.tokens);
+    }
+    memset(&mender_troubleshoot_api_send_queue, 0, sizeof(mender_troubleshoot_api_send_queue_t));
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
+    /* Release memory */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS; index++) {
+        mender_free(mender_troubleshoot_api_buffers[index].data);
+    }
+    memset(mender_troubleshoot_api_buffers, 0, sizeof(mender_troubleshoot_api_buffers));
+    mender_scheduler_mutex_delete(mender_troubleshoot_api_buffers_mutex);
+    mender_troubleshoot_api_buffers_mutex = NULL;
+
     return MENDER_OK;
 }
 
+static mender_troubleshoot_api_buffer_t *
+mender_troubleshoot_api_buffer_find(void *data) {
+
+    /* Search the pack buffer in use owning the data */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PACK_BUFFERS; index++) {
+        if ((true == mender_troubleshoot_api_buffers[index].used) && (data == mender_troubleshoot_api_buffers[index].data)) {
+            return &mender_troubleshoot_api_buffers[index];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+mender_troubleshoot_api_complete(mender_troubleshoot_api_message_t *message, mender_err_t result) {
+
+    assert(NULL != message);
+
+    /* Invoke the callback, or give back the pack buffer */
+    if (NULL != message->callback) {
+        message->callback(result, message->params);
+    } else {
+        mender_troubleshoot_api_buffer_give(message->payload);
+    }
+}
+
+#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE
+
+static void
+mender_troubleshoot_api_send_task(void *arg) {
+
+    (void)arg;
+    mender_troubleshoot_api_message_t message;
+    mender_err_t                      ret;
+    bool                              stop = false;
+
+    /* Send the messages until the stop token is received, there is a token for each message queued */
+    while ((false == stop) && (MENDER_OK == mender_scheduler_queue_receive(mender_troubleshoot_api_send_queue.tokens, &stop, -1))) {
+        if (true == stop) {
+            break;
+        }
+
+        /* Take the message with the highest priority available */
+        ret = MENDER_FAIL;
+        for (size_t index = 0; (MENDER_OK != ret) && (index < MENDER_TROUBLESHOOT_API_LANE_COUNT); index++) {
+            ret = mender_scheduler_queue_receive(mender_troubleshoot_api_send_queue.lanes[index], &message, 0);
+        }
+        if (MENDER_OK != ret) {
+            continue;
+        }
+
+        /* Send data over websocket connection */
+        if (MENDER_OK != (ret = mender_websocket_send(mender_troubleshoot_api_handle, message.payload, message.length))) {
+            mender_log_error("Unable to send data over websocket connection");
+        }
+        mender_troubleshoot_api_complete(&message, ret);
+    }
+}
+
+static void
+mender_troubleshoot_api_send_task_stop(void) {
+
+    bool stop = true;
+
+    /* Stop send task, the stop token is received once the messages queued have been sent */
+    if (NULL != mender_troubleshoot_api_send_queue.task) {
+        mender_scheduler_queue_send(mender_troubleshoot_api_send_queue.tokens, &stop, -1);
+        mender_scheduler_task_join(mender_troubleshoot_api_send_queue.task);
+        mender_troubleshoot_api_send_queue.task = NULL;
+    }
+
+    /* Discard the messages queued meanwhile */
+    mender_troubleshoot_api_send_queue_flush();
+}
+
+static void
+mender_troubleshoot_api_send_queue_flush(void) {
+
+    mender_troubleshoot_api_message_t message;
+    bool                              stop;
+
+    /* Complete the messages with a failure */
+    for (size_t index = 0; index < MENDER_TROUBLESHOOT_API_LANE_COUNT; index++) {
+        if (NULL != mender_troubleshoot_api_send_queue.lanes[index]) {
+            while (MENDER_OK == mender_scheduler_queue_receive(mender_troubleshoot_api_send_queue.lanes[index], &message, 0)) {
+                mender_troubleshoot_api_complete(&message, MENDER_FAIL);
+            }
+        }
+    }
+
+    /* Discard the tokens */
+    if (NULL != mender_troubleshoot_api_send_queue.tokens) {
+        while (MENDER_OK == mender_scheduler_queue_receive(mender_troubleshoot_api_send_queue.tokens, &stop, 0)) {
+            /* Nothing to do */
+        }
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SEND_QUEUE */
+
 static mender_err_t
 mender_troubleshoot_api_websocket_callback(mender_websocket_client_event_t event, void *data, size_t data_length, void *params) {
 
@@ -150,10 +674,13 @@ mender_troubleshoot_api_websocket_callback(mender_websocket_client_event_t event
     /* Treatment depending of the event */
     switch (event) {
         case MENDER_WEBSOCKET_EVENT_CONNECTED:
-            /* Nothing to do */
+            /* Connection is alive */
             mender_log_info("Troubleshoot client connected");
+            mender_troubleshoot_api_heartbeat = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
             break;
         case MENDER_WEBSOCKET_EVENT_DATA_RECEIVED:
+            /* Connection is alive */
+            mender_troubleshoot_api_heartbeat = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
             /* Check input data */
             if ((NULL == data) || (0 == data_length)) {
                 mender_log_error("Invalid data received");
@@ -166,9 +693,14 @@ mender_troubleshoot_api_websocket_callback(mender_websocket_client_event_t event
                 break;
             }
             break;
+        case MENDER_WEBSOCKET_EVENT_HEARTBEAT:
+            /* Connection is alive */
+            mender_troubleshoot_api_heartbeat = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
+            break;
         case MENDER_WEBSOCKET_EVENT_DISCONNECTED:
-            /* Nothing to do */
+            /* Connection is lost, it is closed and opened again by the healthcheck */
             mender_log_info("Troubleshoot client disconnected");
+            mender_troubleshoot_api_lost = true;
             break;
         case MENDER_WEBSOCKET_EVENT_ERROR:
             /* Websocket connection fails */
@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-log.h"
 #include "mender-troubleshoot-control.h"
 #include "mender-troubleshoot-msgpack.h"
@@ -85,58 +90,40 @@ static mender_err_t mender_troubleshoot_control_accept_pack(void **data, size_t
  */
 static mender_err_t mender_troubleshoot_control_encode_accept_data(msgpack_object *object);
 
-mender_err_t
-mender_troubleshoot_control_init(void) {
+/**
+ * @brief Message types of the control proto
+ */
+static const mender_troubleshoot_protomsg_type_t mender_troubleshoot_control_message_types[] = {
+    { .typ = MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_PING, .handler = mender_troubleshoot_control_ping_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_PONG, .handler = NULL },
+    { .typ = MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_OPEN, .handler = mender_troubleshoot_control_open_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_ACCEPT, .handler = NULL },
+    { .typ = MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_CLOSE, .handler = NULL },
+    { .typ = MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_ERROR, .handler = NULL },
+};
 
-    /* Nothing to do */
-    return MENDER_OK;
-}
+/**
+ * @brief Control proto
+ */
+static const mender_troubleshoot_protomsg_proto_t mender_troubleshoot_control_proto
+    = { .proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_CONTROL,
+        .types = mender_troubleshoot_control_message_types,
+        .count = sizeof(mender_troubleshoot_control_message_types) / sizeof(mender_troubleshoot_control_message_types[0]),
+        .sid   = false };
 
 mender_err_t
-mender_troubleshoot_control_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
-
-    assert(NULL != protomsg);
-    assert(NULL != protomsg->hdr);
-    mender_err_t ret = MENDER_OK;
-
-    /* Verify integrity of the message */
-    if (NULL == protomsg->hdr->typ) {
-        mender_log_error("Invalid message received");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-
-    /* Treatment of the message depending of the message type */
-    if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_PING)) {
-        /* Format pong */
-        ret = mender_troubleshoot_control_ping_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_PONG)) {
-        /* Nothing to do */
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_OPEN)) {
-        /* Open session */
-        ret = mender_troubleshoot_control_open_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_ACCEPT)) {
-        /* Nothing to do */
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_CLOSE)) {
-        /* Nothing to do */
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_ERROR)) {
-        /* Nothing to do */
-    } else {
-        /* Not supported */
-        mender_log_error("Unsupported control message received with message type '%s'", protomsg->hdr->typ);
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-
-FAIL:
+mender_troubleshoot_control_init(void) {
 
-    return ret;
+    /* Register control proto */
+    return mender_troubleshoot_protomsg_register(&mender_troubleshoot_control_proto);
 }
 
 mender_err_t
 mender_troubleshoot_control_exit(void) {
 
-    /* Nothing to do */
+    /* Unregister control proto */
+    mender_troubleshoot_protomsg_unregister(MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_CONTROL);
+
     return MENDER_OK;
 }
 
@@ -182,26 +169,26 @@ mender_troubleshoot_control_format_pong(mender_troubleshoot_protomsg_t *protomsg
     mender_err_t ret = MENDER_OK;
 
     /* Format control pong message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_PONG))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_PONG))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -227,32 +214,32 @@ mender_troubleshoot_control_format_accept(mender_troubleshoot_protomsg_t *protom
     mender_err_t ret = MENDER_OK;
 
     /* Format control accept message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_ACCEPT))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_CONTROL_MESSAGE_TYPE_ACCEPT))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     }
-    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
+    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -320,7 +307,7 @@ mender_troubleshoot_control_encode_accept_data(msgpack_object *object) {
     /* Create accept */
     object->type         = MSGPACK_OBJECT_MAP;
     object->via.map.size = 2;
-    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)mender_malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -329,7 +316,7 @@ mender_troubleshoot_control_encode_accept_data(msgpack_object *object) {
     /* Parse accept */
     p           = object->via.map.ptr;
     p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("version"))) {
+    if (NULL == (p->key.via.str.ptr = mender_strdup("version"))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -339,7 +326,7 @@ mender_troubleshoot_control_encode_accept_data(msgpack_object *object) {
     p->val.via.u64      = MENDER_TROUBLESHOOT_CONTROL_VERSION;
     ++p;
     p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("protocols"))) {
+    if (NULL == (p->key.via.str.ptr = mender_strdup("protocols"))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -357,7 +344,7 @@ mender_troubleshoot_control_encode_accept_data(msgpack_object *object) {
         1 +
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
         1;
-    if (NULL == (p->val.via.array.ptr = (struct msgpack_object *)malloc(p->val.via.array.size * sizeof(struct msgpack_object)))) {
+    if (NULL == (p->val.via.array.ptr = (struct msgpack_object *)mender_malloc(p->val.via.array.size * sizeof(struct msgpack_object)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
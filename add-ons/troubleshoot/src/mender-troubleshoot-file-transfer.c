@@ -17,7 +17,13 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-log.h"
+#include "mender-scheduler.h"
 #include "mender-troubleshoot-api.h"
 #include "mender-troubleshoot-file-transfer.h"
 #include "mender-troubleshoot-msgpack.h"
@@ -28,21 +34,52 @@
 /**
  * @brief Message type
  */
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_GET       "get_file"
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_PUT       "put_file"
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ACK       "ack"
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_STAT      "stat"
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO "file_info"
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_CHUNK     "file_chunk"
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ERROR     "error"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_GET             "get_file"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_PUT             "put_file"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ACK             "ack"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_STAT            "stat"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO       "file_info"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_STAT_BATCH      "stat_batch"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_LIST_DIR        "list_dir"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO_BATCH "file_info_batch"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_CHUNK           "file_chunk"
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ERROR           "error"
+
+/**
+ * @brief Default chunk size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE (1024)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE */
+
+/**
+ * @brief Default maximum number of chunks sent and not acknowledged by the server
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW (32)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW */
+
+/**
+ * @brief Default size of the write-behind buffer of the files received from the server (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WRITE_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WRITE_BUFFER_SIZE (8192)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WRITE_BUFFER_SIZE */
+
+/**
+ * @brief Default maximum number of file info in a batch message, the entries of larger batches are sent in several messages
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_BATCH_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_BATCH_SIZE (32)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_BATCH_SIZE */
 
 /**
- * @brief Chunk size
+ * @brief Delay before draining the write-behind buffer again, the chunks queued while the work is completing are written (milliseconds)
  */
-#define MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE 1024
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_UPLOAD_RETRY_DELAY (100)
 
 /**
- * @brief Number of chunks packets to send/receive before waiting/sending an ack
+ * @brief Number of chunks packets to receive before sending an ack, and initial number of chunks sent before waiting an ack
  */
 #define MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_PACKETS 10
 
@@ -89,6 +126,14 @@ typedef struct {
     char *id;          /**< ID */
 } mender_troubleshoot_file_transfer_error_t;
 
+/**
+ * @brief Batch of file info sent to the server, the memory is bounded by the number of entries of a message
+ */
+typedef struct {
+    mender_troubleshoot_protomsg_t *protomsg; /**< Received proto message, the header of the messages sent is copied from it */
+    msgpack_object                  files;    /**< Array of file info of the message being filled */
+} mender_troubleshoot_file_transfer_batch_t;
+
 /**
  * @brief State machine used for sending files to the server
  */
@@ -99,6 +144,45 @@ enum {
 } mender_troubleshoot_file_transfer_state_machine
     = MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE;
 
+/**
+ * @brief Sliding window used for sending files to the server
+ */
+typedef struct {
+    mender_troubleshoot_protomsg_hdr_template_t hdr_template; /**< Header of the chunks sent */
+    uint8_t                                    *data;         /**< Chunk read from the file */
+    size_t                                      offset;       /**< Offset of the next chunk to be sent */
+    size_t                                      acked;        /**< Offset acknowledged by the server */
+    uint32_t                                    size;         /**< Number of chunks which can be sent and not acknowledged */
+} mender_troubleshoot_file_transfer_window_t;
+
+/**
+ * @brief Chunk queued to be written to the file received from the server
+ */
+typedef struct mender_troubleshoot_file_transfer_upload_chunk_s {
+    struct mender_troubleshoot_file_transfer_upload_chunk_s *next;   /**< Next chunk of the queue */
+    mender_troubleshoot_protomsg_t                          *ack;    /**< Ack sent once the chunk is written, NULL if already sent */
+    size_t                                                   length; /**< Length of the data */
+    uint8_t                                                 *data;   /**< Data of the chunk, allocated with the chunk */
+} mender_troubleshoot_file_transfer_upload_chunk_t;
+
+/**
+ * @brief Write-behind buffer used for receiving files from the server
+ */
+typedef struct {
+    void                                             *mutex;     /**< Mutex used to protect access to the queue */
+    void                                             *work;      /**< Work writing the chunks queued to the file */
+    mender_troubleshoot_file_transfer_upload_chunk_t *head;      /**< First chunk of the queue */
+    mender_troubleshoot_file_transfer_upload_chunk_t *tail;      /**< Last chunk of the queue */
+    size_t                                            queued;    /**< Data queued and not written yet */
+    uint32_t                                          chunks;    /**< Number of chunks received since the latest ack */
+    bool                                              writing;   /**< Chunks received are queued, false once the end of the file is received */
+    bool                                              closing;   /**< File must be closed once the queue is empty */
+    bool                                              failed;    /**< File has been closed after an error, chunks queued are discarded */
+    mender_troubleshoot_protomsg_t                   *close_ack; /**< Ack sent once the file is closed, NULL if none */
+    char                                             *sid;       /**< Session ID from the server, used to report errors */
+    char                                             *user_id;   /**< User ID from the server, used to report errors */
+} mender_troubleshoot_file_transfer_upload_t;
+
 /**
  * @brief Mender troubleshoot file transfer callbacks
  */
@@ -109,6 +193,16 @@ static mender_troubleshoot_file_transfer_callbacks_t mender_troubleshoot_file_tr
  */
 static void *mender_troubleshoot_file_transfer_handle = NULL;
 
+/**
+ * @brief Sliding window of the file sent to the server
+ */
+static mender_troubleshoot_file_transfer_window_t mender_troubleshoot_file_transfer_window;
+
+/**
+ * @brief Write-behind buffer of the file received from the server
+ */
+static mender_troubleshoot_file_transfer_upload_t mender_troubleshoot_file_transfer_upload;
+
 /**
  * @brief Function called to perform the treatment of the file transfer get messages
  * @param protomsg Received proto message
@@ -141,6 +235,24 @@ static mender_err_t mender_troubleshoot_file_transfer_ack_message_handler(mender
  */
 static mender_err_t mender_troubleshoot_file_transfer_stat_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
 
+/**
+ * @brief Function called to perform the treatment of the file transfer stat batch messages, the file info of all the paths are sent in batch messages
+ * @param protomsg Received proto message
+ * @param response Response to be sent back to the server, NULL if no response to send
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_stat_batch_message_handler(mender_troubleshoot_protomsg_t  *protomsg,
+                                                                                 mender_troubleshoot_protomsg_t **response);
+
+/**
+ * @brief Function called to perform the treatment of the file transfer list directory messages, the file info of the entries are sent in batch messages
+ * @param protomsg Received proto message
+ * @param response Response to be sent back to the server, NULL if no response to send
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_list_dir_message_handler(mender_troubleshoot_protomsg_t  *protomsg,
+                                                                               mender_troubleshoot_protomsg_t **response);
+
 /**
  * @brief Function called to perform the treatment of the file transfer chunk messages
  * @param protomsg Received proto message
@@ -246,6 +358,36 @@ static mender_err_t mender_troubleshoot_file_transfer_file_info_encode(mender_tr
  */
 static void mender_troubleshoot_file_transfer_file_info_release(mender_troubleshoot_file_transfer_file_info_t *file_info);
 
+/**
+ * @brief Add the file info of a path to a batch, the message being filled is sent if it is full
+ * @param path Path
+ * @param params Batch
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_batch_add(char *path, void *params);
+
+/**
+ * @brief Format the message of a batch being filled, the messages preceding the last one are sent immediately
+ * @param batch Batch
+ * @param last Flag used to indicate the message is the last one of the batch
+ * @param response Response to be sent back to the server with the last message, NULL if not the last message
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_batch_flush(mender_troubleshoot_file_transfer_batch_t *batch,
+                                                                  bool                                       last,
+                                                                  mender_troubleshoot_protomsg_t           **response);
+
+/**
+ * @brief Function used to format file transfer message with the header of the received proto message and an empty body
+ * @param protomsg Received proto message
+ * @param typ Message type
+ * @param response Response to be sent back to the server
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_format_response(mender_troubleshoot_protomsg_t  *protomsg,
+                                                                      char                            *typ,
+                                                                      mender_troubleshoot_protomsg_t **response);
+
 /**
  * @brief Function used to format file transfer file info message
  * @param protomsg Received proto message
@@ -295,70 +437,139 @@ static mender_err_t mender_troubleshoot_file_transfer_error_message_pack(mender_
 static mender_err_t mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_transfer_error_t *error, msgpack_object *object);
 
 /**
- * @brief Function called to send file transfer chunk protomsg
+ * @brief Function called to create the header of the file transfer chunk protomsg, it is reused for all the chunks sent
  * @param sid Session ID from the server
  * @param user_id User ID from the server
+ * @param hdr_template Header of the chunks
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_create_chunk_hdr(char *sid, char *user_id, mender_troubleshoot_protomsg_hdr_template_t *hdr_template);
+
+/**
+ * @brief Function called to read and send the chunks of the file until the sliding window is full or the end of the file is reached
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_send_window(void);
+
+/**
+ * @brief Function called to close the file sent to the server and release the sliding window
+ */
+static void mender_troubleshoot_file_transfer_close_window(void);
+
+/**
+ * @brief Function called to send file transfer chunk protomsg
+ * @param hdr_template Header of the chunks
  * @param offset Offset of data sent to the server
  * @param data Data to send to the server
  * @param length Length of the data to send to the server
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-static mender_err_t mender_troubleshoot_file_transfer_send_chunk(char *sid, char *user_id, size_t offset, void *data, size_t length);
+static mender_err_t mender_troubleshoot_file_transfer_send_chunk(mender_troubleshoot_protomsg_hdr_template_t *hdr_template,
+                                                                 size_t                                       offset,
+                                                                 void                                        *data,
+                                                                 size_t                                       length);
+
+/**
+ * @brief Mender troubleshoot file transfer upload work function, it writes the chunks queued to the file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_file_transfer_upload_work_function(void);
+
+/**
+ * @brief Function called to write a chunk queued to the file received from the server, the ack or an error is sent to the server
+ * @param chunk Chunk to be written
+ */
+static void mender_troubleshoot_file_transfer_upload_write(mender_troubleshoot_file_transfer_upload_chunk_t *chunk);
+
+/**
+ * @brief Function called to close the file received from the server once all the chunks have been written
+ * @param ack Ack sent once the file is closed, NULL if none
+ */
+static void mender_troubleshoot_file_transfer_upload_close(mender_troubleshoot_protomsg_t *ack);
+
+/**
+ * @brief Function called to stop queuing the chunks received, the file is closed once the queue is empty
+ * @param ack Ack sent once the file is closed, NULL if none
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_upload_stop(mender_troubleshoot_protomsg_t *ack);
+
+/**
+ * @brief Function called to report an error of the file received from the server
+ * @param description Description of the error
+ */
+static void mender_troubleshoot_file_transfer_upload_error(char *description);
+
+/**
+ * @brief Function called to send a proto message to the server outside of the treatment of the received messages
+ * @param protomsg Proto message to be sent
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_send_protomsg(mender_troubleshoot_protomsg_t *protomsg);
+
+/**
+ * @brief Message types of the file transfer proto
+ */
+static const mender_troubleshoot_protomsg_type_t mender_troubleshoot_file_transfer_message_types[] = {
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_GET, .handler = mender_troubleshoot_file_transfer_get_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_PUT, .handler = mender_troubleshoot_file_transfer_put_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ACK, .handler = mender_troubleshoot_file_transfer_ack_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_STAT, .handler = mender_troubleshoot_file_transfer_stat_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO, .handler = NULL },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_STAT_BATCH, .handler = mender_troubleshoot_file_transfer_stat_batch_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_LIST_DIR, .handler = mender_troubleshoot_file_transfer_list_dir_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO_BATCH, .handler = NULL },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_CHUNK, .handler = mender_troubleshoot_file_transfer_chunk_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ERROR, .handler = mender_troubleshoot_file_transfer_error_message_handler },
+};
+
+/**
+ * @brief File transfer proto
+ */
+static const mender_troubleshoot_protomsg_proto_t mender_troubleshoot_file_transfer_proto
+    = { .proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_FILE_TRANSFER,
+        .types = mender_troubleshoot_file_transfer_message_types,
+        .count = sizeof(mender_troubleshoot_file_transfer_message_types) / sizeof(mender_troubleshoot_file_transfer_message_types[0]),
+        .sid   = false };
 
 mender_err_t
 mender_troubleshoot_file_transfer_init(mender_troubleshoot_file_transfer_callbacks_t *callbacks) {
 
+    mender_err_t ret;
+
     /* Save callbacks */
     if (NULL != callbacks) {
         memcpy(&mender_troubleshoot_file_transfer_callbacks, callbacks, sizeof(mender_troubleshoot_file_transfer_callbacks_t));
     }
 
-    return MENDER_OK;
-}
-
-mender_err_t
-mender_troubleshoot_file_transfer_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
-
-    assert(NULL != protomsg);
-    assert(NULL != protomsg->hdr);
-    mender_err_t ret = MENDER_OK;
-
-    /* Verify integrity of the message */
-    if (NULL == protomsg->hdr->typ) {
-        mender_log_error("Invalid message received");
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Create write-behind buffer mutex */
+    memset(&mender_troubleshoot_file_transfer_upload, 0, sizeof(mender_troubleshoot_file_transfer_upload_t));
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_file_transfer_upload.mutex))) {
+        mender_log_error("Unable to create write-behind buffer mutex");
+        return ret;
     }
 
-    /* Treatment of the message depending of the message type */
-    if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_GET)) {
-        /* Open file for reading */
-        ret = mender_troubleshoot_file_transfer_get_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_PUT)) {
-        /* Open file for writing */
-        ret = mender_troubleshoot_file_transfer_put_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ACK)) {
-        /* Continue reading file */
-        ret = mender_troubleshoot_file_transfer_ack_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_STAT)) {
-        /* Get file statistics */
-        ret = mender_troubleshoot_file_transfer_stat_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO)) {
-        /* Nothing to do */
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_CHUNK)) {
-        /* Write data to the file */
-        ret = mender_troubleshoot_file_transfer_chunk_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ERROR)) {
-        /* Close file */
-        ret = mender_troubleshoot_file_transfer_error_message_handler(protomsg, response);
-    } else {
-        /* Not supported */
-        mender_log_error("Unsupported message received with message type '%s'", protomsg->hdr->typ);
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Create file transfer upload work, it is executed when chunks are queued and can last long on slow filesystems */
+    mender_scheduler_work_params_t upload_work_params;
+    upload_work_params.function = mender_troubleshoot_file_transfer_upload_work_function;
+    upload_work_params.period   = 0;
+    upload_work_params.name     = "mender_troubleshoot_file_transfer_upload";
+    upload_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_DEFAULT;
+    upload_work_params.slack    = 0;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&upload_work_params, &mender_troubleshoot_file_transfer_upload.work))) {
+        mender_log_error("Unable to create file transfer upload work");
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_troubleshoot_file_transfer_upload.work))) {
+        mender_log_error("Unable to activate file transfer upload work");
+        return ret;
     }
 
-FAIL:
+    /* Register file transfer proto */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_register(&mender_troubleshoot_file_transfer_proto))) {
+        mender_log_error("Unable to register file transfer proto");
+        return ret;
+    }
 
     return ret;
 }
@@ -366,7 +577,41 @@ FAIL:
 mender_err_t
 mender_troubleshoot_file_transfer_exit(void) {
 
-    /* Nothing to do */
+    mender_troubleshoot_file_transfer_upload_t       *upload = &mender_troubleshoot_file_transfer_upload;
+    mender_troubleshoot_file_transfer_upload_chunk_t *chunk;
+
+    /* Unregister file transfer proto */
+    mender_troubleshoot_protomsg_unregister(MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_FILE_TRANSFER);
+
+    /* Deactivate and delete file transfer upload work */
+    mender_scheduler_work_deactivate(upload->work);
+    mender_scheduler_work_delete(upload->work);
+    upload->work = NULL;
+
+    /* Close the file received from the server, the chunks not written are discarded */
+    if (((true == upload->writing) || (true == upload->closing)) && (false == upload->failed)) {
+        if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
+            if (MENDER_OK != mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle)) {
+                mender_log_error("Unable to close the file");
+            }
+        }
+    }
+    while (NULL != (chunk = upload->head)) {
+        upload->head = chunk->next;
+        mender_troubleshoot_protomsg_release(chunk->ack);
+        mender_free(chunk);
+    }
+
+    /* Close the file sent to the server */
+    mender_troubleshoot_file_transfer_close_window();
+
+    /* Release memory */
+    mender_troubleshoot_protomsg_release(upload->close_ack);
+    mender_free(upload->sid);
+    mender_free(upload->user_id);
+    mender_scheduler_mutex_delete(upload->mutex);
+    memset(upload, 0, sizeof(mender_troubleshoot_file_transfer_upload_t));
+
     return MENDER_OK;
 }
 
@@ -376,11 +621,7 @@ mender_troubleshoot_file_transfer_get_message_handler(mender_troubleshoot_protom
     assert(NULL != protomsg);
     mender_troubleshoot_file_transfer_error_t     error;
     mender_troubleshoot_file_transfer_get_file_t *get_file = NULL;
-    uint8_t                                      *data     = NULL;
-    size_t                                        length;
-    size_t                                        offset;
-    int                                           chunk_index = 0;
-    mender_err_t                                  ret         = MENDER_OK;
+    mender_err_t                                  ret      = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
@@ -451,52 +692,48 @@ mender_troubleshoot_file_transfer_get_message_handler(mender_troubleshoot_protom
             }
         }
         mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_READING;
-    }
-    /* Intentional pass-through */
-    if (MENDER_TROUBLESHOOT_FILE_TRANSFER_READING == mender_troubleshoot_file_transfer_state_machine) {
 
-        /* Read and send file chunk by chunk */
-        if (NULL == (data = (uint8_t *)malloc(MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE))) {
+        /* Initialize the sliding window */
+        if (NULL == (mender_troubleshoot_file_transfer_window.data = (uint8_t *)mender_malloc(CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE))) {
             mender_log_error("Unable to allocate memory");
             error.description = "Internal error";
+            ret               = MENDER_FAIL;
             goto FAIL;
         }
-        offset = 0;
-        do {
-            length = MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE;
-            if (NULL != mender_troubleshoot_file_transfer_callbacks.read) {
-                if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.read(mender_troubleshoot_file_transfer_handle, data, &length))) {
-                    mender_log_error("Unable to read file");
-                    error.description = "Unable to read file";
-                    goto FAIL;
-                }
-            }
-            if (MENDER_OK
-                != (ret = mender_troubleshoot_file_transfer_send_chunk(protomsg->hdr->sid, protomsg->hdr->properties->user_id, offset, data, length))) {
-                mender_log_error("Unable to send chunk");
-                error.description = "Unable to send file";
-                goto FAIL;
-            }
-            offset += length;
-            chunk_index++;
-        } while ((chunk_index < MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_PACKETS) && (length > 0));
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_file_transfer_create_chunk_hdr(
+                    protomsg->hdr->sid, protomsg->hdr->properties->user_id, &mender_troubleshoot_file_transfer_window.hdr_template))) {
+            mender_log_error("Unable to create chunk header");
+            error.description = "Internal error";
+            goto FAIL;
+        }
+        mender_troubleshoot_file_transfer_window.offset = 0;
+        mender_troubleshoot_file_transfer_window.acked  = 0;
+        mender_troubleshoot_file_transfer_window.size   = MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_PACKETS;
+        if (mender_troubleshoot_file_transfer_window.size > CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW) {
+            mender_troubleshoot_file_transfer_window.size = CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW;
+        }
+    }
+    /* Intentional pass-through */
+    if (MENDER_TROUBLESHOOT_FILE_TRANSFER_READING == mender_troubleshoot_file_transfer_state_machine) {
 
-        /* Check if the end of the file has been reached */
-        if (0 == length) {
-            mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_EOF;
+        /* Read and send file chunk by chunk until the window is full */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_window())) {
+            error.description = "Unable to send file";
+            goto FAIL;
         }
     }
 
     /* Release memory */
     mender_troubleshoot_file_transfer_get_file_release(get_file);
-    if (NULL != data) {
-        free(data);
-    }
 
     return ret;
 
 FAIL:
 
+    /* Abort the transfer */
+    mender_troubleshoot_file_transfer_close_window();
+
     /* Format error */
     if (MENDER_OK != mender_troubleshoot_file_transfer_format_error(protomsg, &error, response)) {
         mender_log_error("Unable to format response");
@@ -504,9 +741,6 @@ FAIL:
 
     /* Release memory */
     mender_troubleshoot_file_transfer_get_file_release(get_file);
-    if (NULL != data) {
-        free(data);
-    }
 
     return ret;
 }
@@ -515,9 +749,12 @@ static mender_err_t
 mender_troubleshoot_file_transfer_put_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
+    assert(NULL != protomsg->hdr);
+    mender_troubleshoot_file_transfer_upload_t         *upload = &mender_troubleshoot_file_transfer_upload;
     mender_troubleshoot_file_transfer_error_t           error;
     mender_troubleshoot_file_transfer_upload_request_t *upload_request = NULL;
-    mender_err_t                                        ret            = MENDER_OK;
+    bool                                                busy;
+    mender_err_t                                        ret = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
@@ -552,6 +789,40 @@ mender_troubleshoot_file_transfer_put_message_handler(mender_troubleshoot_protom
         goto FAIL;
     }
 
+    /* Verify no file is being received, the chunks of the previous file must have been written */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(upload->mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+    busy = (true == upload->writing) || (true == upload->closing) || (0 != upload->queued);
+    mender_scheduler_mutex_give(upload->mutex);
+    if (true == busy) {
+        mender_log_error("Unable to receive file '%s', another file is being received", upload_request->path);
+        error.description = "Another file is being received";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Save session, the errors occurring while the file is written are reported by the upload work */
+    mender_free(upload->sid);
+    mender_free(upload->user_id);
+    upload->sid     = NULL;
+    upload->user_id = NULL;
+    if ((NULL != protomsg->hdr->sid) && (NULL == (upload->sid = mender_strdup(protomsg->hdr->sid)))) {
+        mender_log_error("Unable to allocate memory");
+        error.description = "Internal error";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+    if ((NULL != protomsg->hdr->properties) && (NULL != protomsg->hdr->properties->user_id)
+        && (NULL == (upload->user_id = mender_strdup(protomsg->hdr->properties->user_id)))) {
+        mender_log_error("Unable to allocate memory");
+        error.description = "Internal error";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
     /* Open file for writing */
     if (NULL != mender_troubleshoot_file_transfer_callbacks.open) {
         if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.open(upload_request->path, "wb", &mender_troubleshoot_file_transfer_handle))) {
@@ -565,9 +836,17 @@ mender_troubleshoot_file_transfer_put_message_handler(mender_troubleshoot_protom
     if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_format_ack(protomsg, response))) {
         mender_log_error("Unable to format response");
         error.description = "Unable to format response";
+        if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
+            mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle);
+        }
         goto FAIL;
     }
 
+    /* Queue the chunks received, the upload work is idle until the first chunk is queued */
+    upload->chunks  = 0;
+    upload->failed  = false;
+    upload->writing = true;
+
     /* Release memory */
     mender_troubleshoot_file_transfer_upload_request_release(upload_request);
 
@@ -591,11 +870,7 @@ mender_troubleshoot_file_transfer_ack_message_handler(mender_troubleshoot_protom
 
     assert(NULL != protomsg);
     mender_troubleshoot_file_transfer_error_t error;
-    uint8_t                                  *data = NULL;
-    size_t                                    length;
-    size_t                                    offset;
-    int                                       chunk_index = 0;
-    mender_err_t                              ret         = MENDER_OK;
+    mender_err_t                              ret = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
@@ -635,75 +910,51 @@ mender_troubleshoot_file_transfer_ack_message_handler(mender_troubleshoot_protom
     /* Treatment depending of the state machine */
     if (MENDER_TROUBLESHOOT_FILE_TRANSFER_READING == mender_troubleshoot_file_transfer_state_machine) {
 
-        /* Read and send file chunk by chunk */
-        if (NULL == (data = (uint8_t *)malloc(MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE))) {
-            mender_log_error("Unable to allocate memory");
-            error.description = "Internal error";
-            goto FAIL;
-        }
-        offset = *protomsg->hdr->properties->offset;
-        do {
-            length = MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE;
-            if (NULL != mender_troubleshoot_file_transfer_callbacks.read) {
-                if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.read(mender_troubleshoot_file_transfer_handle, data, &length))) {
-                    mender_log_error("Unable to read file");
-                    error.description = "Unable to read file";
-                    goto FAIL;
-                }
+        /* Slide the window, it is enlarged if all the chunks were waiting for the ack so that more data is sent per round trip */
+        if ((*protomsg->hdr->properties->offset > mender_troubleshoot_file_transfer_window.acked)
+            && (*protomsg->hdr->properties->offset <= mender_troubleshoot_file_transfer_window.offset)) {
+            if ((mender_troubleshoot_file_transfer_window.offset - mender_troubleshoot_file_transfer_window.acked
+                 >= (size_t)mender_troubleshoot_file_transfer_window.size * CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE)
+                && (mender_troubleshoot_file_transfer_window.size < CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW)) {
+                mender_troubleshoot_file_transfer_window.size
+                    = (2 * mender_troubleshoot_file_transfer_window.size < CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW)
+                          ? 2 * mender_troubleshoot_file_transfer_window.size
+                          : CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW;
             }
-            if (MENDER_OK
-                != (ret = mender_troubleshoot_file_transfer_send_chunk(protomsg->hdr->sid, protomsg->hdr->properties->user_id, offset, data, length))) {
-                mender_log_error("Unable to send chunk");
-                error.description = "Unable to send file";
-                goto FAIL;
-            }
-            offset += length;
-            chunk_index++;
-        } while ((chunk_index < MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_PACKETS) && (length > 0));
+            mender_troubleshoot_file_transfer_window.acked = *protomsg->hdr->properties->offset;
+        }
 
-        /* Check if the end of the file has been reached */
-        if (0 == length) {
-            mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_EOF;
+        /* Read and send file chunk by chunk until the window is full */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_window())) {
+            error.description = "Unable to send file";
+            goto FAIL;
         }
 
     } else if (MENDER_TROUBLESHOOT_FILE_TRANSFER_EOF == mender_troubleshoot_file_transfer_state_machine) {
 
-        /* Close file */
-        if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
-            if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle))) {
-                mender_log_error("Unable to close the file");
-            }
-        }
-        mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE;
+        /* Close file, the latest ack has been received */
+        mender_troubleshoot_file_transfer_close_window();
 
     } else {
 
         /* Should not append */
         mender_log_error("An error occured");
-        error.description                               = "Internal error";
-        mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE;
+        error.description = "Internal error";
         goto FAIL;
     }
 
-    /* Release memory */
-    if (NULL != data) {
-        free(data);
-    }
-
     return ret;
 
 FAIL:
 
+    /* Abort the transfer */
+    mender_troubleshoot_file_transfer_close_window();
+
     /* Format error */
     if (MENDER_OK != mender_troubleshoot_file_transfer_format_error(protomsg, &error, response)) {
         mender_log_error("Unable to format response");
     }
 
-    /* Release memory */
-    if (NULL != data) {
-        free(data);
-    }
-
     return ret;
 }
 
@@ -750,14 +1001,14 @@ mender_troubleshoot_file_transfer_stat_message_handler(mender_troubleshoot_proto
     }
 
     /* Prepare file info */
-    if (NULL == (file_info = (mender_troubleshoot_file_transfer_file_info_t *)malloc(sizeof(mender_troubleshoot_file_transfer_file_info_t)))) {
+    if (NULL == (file_info = (mender_troubleshoot_file_transfer_file_info_t *)mender_malloc(sizeof(mender_troubleshoot_file_transfer_file_info_t)))) {
         mender_log_error("Unable to allocate memory");
         error.description = "Internal error";
         ret               = MENDER_FAIL;
         goto FAIL;
     }
     memset(file_info, 0, sizeof(mender_troubleshoot_file_transfer_file_info_t));
-    if (NULL == (file_info->path = strdup(stat_file->path))) {
+    if (NULL == (file_info->path = mender_strdup(stat_file->path))) {
         mender_log_error("Unable to allocate memory");
         error.description = "Internal error";
         ret               = MENDER_FAIL;
@@ -803,63 +1054,280 @@ FAIL:
 }
 
 static mender_err_t
-mender_troubleshoot_file_transfer_chunk_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+mender_troubleshoot_file_transfer_stat_batch_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
     mender_troubleshoot_file_transfer_error_t error;
-    static int                                chunk_index = 0;
-    mender_err_t                              ret         = MENDER_OK;
+    mender_troubleshoot_file_transfer_batch_t batch = { .protomsg = protomsg, .files = { .type = MSGPACK_OBJECT_ARRAY } };
+    msgpack_zone                              zone;
+    msgpack_object                            object;
+    msgpack_object                           *paths = NULL;
+    char                                     *path;
+    mender_err_t                              ret   = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
 
-    /* Check if data are provided */
-    if (NULL != protomsg->body) {
+    /* Verify integrity of the message */
+    if ((NULL == protomsg->body) || (NULL == protomsg->body->data)) {
+        mender_log_error("Invalid message received");
+        error.description = "Invalid message received";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
 
-        /* Write to the file */
-        if (NULL != mender_troubleshoot_file_transfer_callbacks.write) {
-            if (MENDER_OK
-                != (ret = mender_troubleshoot_file_transfer_callbacks.write(
-                        mender_troubleshoot_file_transfer_handle, protomsg->body->data, protomsg->body->length))) {
-                mender_log_error("Unable to write to the file");
-                error.description = "Unable to write to the file";
-                goto FAIL;
+    /* Unpack the message, the paths are read from the object */
+    if (MENDER_OK != mender_troubleshoot_msgpack_unpack_object(protomsg->body->data, protomsg->body->length, &zone, &object)) {
+        mender_log_error("Unable to unpack the data");
+        error.description = "Unable to decode stat batch";
+        ret               = MENDER_FAIL;
+        goto END;
+    }
+    if ((MSGPACK_OBJECT_MAP == object.type) && (0 != object.via.map.size)) {
+        msgpack_object_kv *p = object.via.map.ptr;
+        do {
+            if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "paths", p->key.via.str.size)) && (MSGPACK_OBJECT_ARRAY == p->val.type)) {
+                paths = &p->val;
             }
+            ++p;
+        } while (p < object.via.map.ptr + object.via.map.size);
+    }
+    if (NULL == paths) {
+        mender_log_error("Invalid message received");
+        error.description = "Invalid message received";
+        ret               = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Get statistics of the files */
+    for (uint32_t index = 0; index < paths->via.array.size; index++) {
+        if (MSGPACK_OBJECT_STR != paths->via.array.ptr[index].type) {
+            continue;
+        }
+        if (NULL == (path = (char *)mender_malloc(paths->via.array.ptr[index].via.str.size + 1))) {
+            mender_log_error("Unable to allocate memory");
+            error.description = "Internal error";
+            ret               = MENDER_FAIL;
+            goto END;
         }
-        chunk_index++;
+        memcpy(path, paths->via.array.ptr[index].via.str.ptr, paths->via.array.ptr[index].via.str.size);
+        path[paths->via.array.ptr[index].via.str.size] = '\0';
+        ret                                              = mender_troubleshoot_file_transfer_batch_add(path, &batch);
+        mender_free(path);
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to add file info to the batch");
+            error.description = "Internal error";
+            goto END;
+        }
+    }
 
-    } else {
+    /* Format the last message of the batch */
+    if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_batch_flush(&batch, true, response))) {
+        mender_log_error("Unable to format response");
+        error.description = "Internal error";
+    }
 
-        /* Close file */
-        if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
-            if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle))) {
-                mender_log_error("Unable to close the file");
-                error.description = "Unable to close the file";
-            }
+END:
+
+    /* Release memory */
+    msgpack_zone_destroy(&zone);
+    if (MENDER_OK == ret) {
+        return ret;
+    }
+
+FAIL:
+
+    /* Format error */
+    if (MENDER_OK != mender_troubleshoot_file_transfer_format_error(protomsg, &error, response)) {
+        mender_log_error("Unable to format response");
+    }
+
+    /* Release memory */
+    mender_troubleshoot_msgpack_release_object(&batch.files);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_list_dir_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+
+    assert(NULL != protomsg);
+    mender_troubleshoot_file_transfer_error_t      error;
+    mender_troubleshoot_file_transfer_batch_t      batch     = { .protomsg = protomsg, .files = { .type = MSGPACK_OBJECT_ARRAY } };
+    mender_troubleshoot_file_transfer_stat_file_t *stat_file = NULL;
+    mender_err_t                                   ret       = MENDER_OK;
+
+    /* Initialize error message */
+    memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
+
+    /* Verify integrity of the message */
+    if ((NULL == protomsg->body) || (NULL == protomsg->body->data)) {
+        mender_log_error("Invalid message received");
+        error.description = "Invalid message received";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Check listing directories is supported */
+    if (NULL == mender_troubleshoot_file_transfer_callbacks.list) {
+        mender_log_error("Listing directories is not supported");
+        error.description = "Listing directories is not supported";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Unpack and decode data, the directory is given as the path of a stat file */
+    if (NULL == (stat_file = mender_troubleshoot_file_transfer_stat_file_unpack(protomsg->body->data, protomsg->body->length))) {
+        mender_log_error("Unable to decode list directory");
+        error.description = "Unable to decode list directory";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (NULL == stat_file->path) {
+        mender_log_error("Invalid message received");
+        error.description = "Invalid message received";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* List the directory, the file info of the entries are added to the batch */
+    if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.list(stat_file->path, &mender_troubleshoot_file_transfer_batch_add, &batch))) {
+        mender_log_error("Unable to list the directory '%s'", stat_file->path);
+        error.description = "Unable to list the directory";
+        goto FAIL;
+    }
+
+    /* Format the last message of the batch */
+    if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_batch_flush(&batch, true, response))) {
+        mender_log_error("Unable to format response");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+
+    /* Release memory */
+    mender_troubleshoot_file_transfer_stat_file_release(stat_file);
+
+    return ret;
+
+FAIL:
+
+    /* Format error */
+    if (MENDER_OK != mender_troubleshoot_file_transfer_format_error(protomsg, &error, response)) {
+        mender_log_error("Unable to format response");
+    }
+
+    /* Release memory */
+    mender_troubleshoot_file_transfer_stat_file_release(stat_file);
+    mender_troubleshoot_msgpack_release_object(&batch.files);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_chunk_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+
+    assert(NULL != protomsg);
+    mender_troubleshoot_file_transfer_upload_t       *upload = &mender_troubleshoot_file_transfer_upload;
+    mender_troubleshoot_file_transfer_error_t         error;
+    mender_troubleshoot_file_transfer_upload_chunk_t *chunk = NULL;
+    mender_troubleshoot_protomsg_t                   *ack   = NULL;
+    size_t                                            length;
+    mender_err_t                                      ret = MENDER_OK;
+
+    /* Initialize error message */
+    memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
+
+    /* Drop the chunks received once the transfer is completed or aborted */
+    if (false == upload->writing) {
+        mender_log_debug("Chunk received while no file is being received, dropping it");
+        return MENDER_OK;
+    }
+
+    /* Format ack if it must be sent */
+    if (NULL != protomsg->body) {
+        upload->chunks++;
+    }
+    if ((upload->chunks >= MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_PACKETS) || (NULL == protomsg->body)) {
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_format_ack(protomsg, &ack))) {
+            mender_log_error("Unable to format response");
+            error.description = "Internal error";
+            goto FAIL;
         }
+        upload->chunks = 0;
+    }
+
+    /* Close the file once the chunks queued have been written, the latest ack is sent when the file is closed */
+    if (NULL == protomsg->body) {
+        return mender_troubleshoot_file_transfer_upload_stop(ack);
+    }
+
+    /* Copy the chunk, it is written to the file by the upload work */
+    if (0 < (length = protomsg->body->length)) {
+        if (NULL
+            == (chunk = (mender_troubleshoot_file_transfer_upload_chunk_t *)mender_malloc(sizeof(mender_troubleshoot_file_transfer_upload_chunk_t) + length))) {
+            mender_log_error("Unable to allocate memory");
+            error.description = "Internal error";
+            ret               = MENDER_FAIL;
+            goto FAIL;
+        }
+        chunk->next   = NULL;
+        chunk->ack    = NULL;
+        chunk->length = length;
+        chunk->data   = (uint8_t *)chunk + sizeof(mender_troubleshoot_file_transfer_upload_chunk_t);
+        memcpy(chunk->data, protomsg->body->data, length);
+    }
+
+    /* Take mutex used to protect access to the queue */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(upload->mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+
+    /* Drop the chunk if the transfer has been aborted meanwhile */
+    if (false == upload->writing) {
+        mender_scheduler_mutex_give(upload->mutex);
+        mender_troubleshoot_protomsg_release(ack);
+        mender_free(chunk);
+        return ret;
+    }
+
+    /* Acknowledge immediately while the write-behind buffer is not full, otherwise the ack is sent once the chunk is written to pace the server */
+    if ((NULL != ack) && ((NULL == chunk) || (upload->queued + length <= CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WRITE_BUFFER_SIZE))) {
+        *response = ack;
+        ack       = NULL;
     }
 
-    /* Check if ack must be sent */
-    if ((chunk_index >= MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_PACKETS) || (NULL == protomsg->body)) {
-        /* Format ack */
-        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_format_ack(protomsg, response))) {
-            mender_log_error("Unable to format response");
-            error.description = "Internal error";
-            goto FAIL;
+    /* Queue the chunk */
+    if (NULL != chunk) {
+        chunk->ack = ack;
+        if (NULL != upload->tail) {
+            upload->tail->next = chunk;
+        } else {
+            upload->head = chunk;
         }
-        chunk_index = 0;
+        upload->tail = chunk;
+        upload->queued += length;
+    }
+
+    /* Release mutex used to protect access to the queue */
+    mender_scheduler_mutex_give(upload->mutex);
+
+    /* Write the chunk */
+    if (NULL != chunk) {
+        mender_scheduler_work_execute(upload->work);
     }
 
     return ret;
 
 FAIL:
 
-    /* Close file */
-    if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
-        if (MENDER_OK != mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle)) {
-            mender_log_error("Unable to close the file");
-        }
-    }
+    /* Release memory */
+    mender_troubleshoot_protomsg_release(ack);
+    mender_free(chunk);
+
+    /* Abort the transfer, the file is closed once the chunks queued have been written */
+    mender_troubleshoot_file_transfer_upload_stop(NULL);
 
     /* Format error */
     if (MENDER_OK != mender_troubleshoot_file_transfer_format_error(protomsg, &error, response)) {
@@ -873,22 +1341,16 @@ static mender_err_t
 mender_troubleshoot_file_transfer_error_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
+    (void)protomsg;
     (void)response;
-    mender_err_t ret = MENDER_OK;
 
-    /* Treatment depending of the state machine */
-    if (MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE != mender_troubleshoot_file_transfer_state_machine) {
-
-        /* Close file */
-        if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
-            if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle))) {
-                mender_log_error("Unable to close the file");
-            }
-        }
-        mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE;
+    /* Abort the transfers */
+    mender_troubleshoot_file_transfer_close_window();
+    if (true == mender_troubleshoot_file_transfer_upload.writing) {
+        mender_troubleshoot_file_transfer_upload_stop(NULL);
     }
 
-    return ret;
+    return MENDER_OK;
 }
 
 static mender_troubleshoot_file_transfer_get_file_t *
@@ -932,7 +1394,7 @@ mender_troubleshoot_file_transfer_get_file_decode(msgpack_object *object) {
     mender_troubleshoot_file_transfer_get_file_t *get_file;
 
     /* Create get file */
-    if (NULL == (get_file = (mender_troubleshoot_file_transfer_get_file_t *)malloc(sizeof(mender_troubleshoot_file_transfer_get_file_t)))) {
+    if (NULL == (get_file = (mender_troubleshoot_file_transfer_get_file_t *)mender_malloc(sizeof(mender_troubleshoot_file_transfer_get_file_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
@@ -942,7 +1404,7 @@ mender_troubleshoot_file_transfer_get_file_decode(msgpack_object *object) {
     msgpack_object_kv *p = object->via.map.ptr;
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "path", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (get_file->path = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (get_file->path = (char *)mender_malloc(p->val.via.str.size + 1))) {
                 mender_log_error("Unable to allocate memory");
                 goto FAIL;
             }
@@ -968,9 +1430,9 @@ mender_troubleshoot_file_transfer_get_file_release(mender_troubleshoot_file_tran
     /* Release memory */
     if (NULL != get_file) {
         if (NULL != get_file->path) {
-            free(get_file->path);
+            mender_free(get_file->path);
         }
-        free(get_file);
+        mender_free(get_file);
     }
 }
 
@@ -1015,7 +1477,9 @@ mender_troubleshoot_file_transfer_upload_request_decode(msgpack_object *object)
     mender_troubleshoot_file_transfer_upload_request_t *upload_request;
 
     /* Create upload request */
-    if (NULL == (upload_request = (mender_troubleshoot_file_transfer_upload_request_t *)malloc(sizeof(mender_troubleshoot_file_transfer_upload_request_t)))) {
+    if (NULL
+        == (upload_request
+            = (mender_troubleshoot_file_transfer_upload_request_t *)mender_malloc(sizeof(mender_troubleshoot_file_transfer_upload_request_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
@@ -1025,14 +1489,14 @@ mender_troubleshoot_file_transfer_upload_request_decode(msgpack_object *object)
     msgpack_object_kv *p = object->via.map.ptr;
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "src_path", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (upload_request->src_path = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (upload_request->src_path = (char *)mender_malloc(p->val.via.str.size + 1))) {
                 mender_log_error("Unable to allocate memory");
                 goto FAIL;
             }
             memcpy(upload_request->src_path, p->val.via.str.ptr, p->val.via.str.size);
             upload_request->src_path[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "path", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (upload_request->path = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (upload_request->path = (char *)mender_malloc(p->val.via.str.size + 1))) {
                 mender_log_error("Unable to allocate memory");
                 goto FAIL;
             }
@@ -1058,12 +1522,12 @@ mender_troubleshoot_file_transfer_upload_request_release(mender_troubleshoot_fil
     /* Release memory */
     if (NULL != upload_request) {
         if (NULL != upload_request->src_path) {
-            free(upload_request->src_path);
+            mender_free(upload_request->src_path);
         }
         if (NULL != upload_request->path) {
-            free(upload_request->path);
+            mender_free(upload_request->path);
         }
-        free(upload_request);
+        mender_free(upload_request);
     }
 }
 
@@ -1108,7 +1572,7 @@ mender_troubleshoot_file_transfer_stat_file_decode(msgpack_object *object) {
     mender_troubleshoot_file_transfer_stat_file_t *stat_file;
 
     /* Create stat file */
-    if (NULL == (stat_file = (mender_troubleshoot_file_transfer_stat_file_t *)malloc(sizeof(mender_troubleshoot_file_transfer_stat_file_t)))) {
+    if (NULL == (stat_file = (mender_troubleshoot_file_transfer_stat_file_t *)mender_malloc(sizeof(mender_troubleshoot_file_transfer_stat_file_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
@@ -1118,7 +1582,7 @@ mender_troubleshoot_file_transfer_stat_file_decode(msgpack_object *object) {
     msgpack_object_kv *p = object->via.map.ptr;
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "path", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (stat_file->path = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (stat_file->path = (char *)mender_malloc(p->val.via.str.size + 1))) {
                 mender_log_error("Unable to allocate memory");
                 goto FAIL;
             }
@@ -1144,9 +1608,9 @@ mender_troubleshoot_file_transfer_stat_file_release(mender_troubleshoot_file_tra
     /* Release memory */
     if (NULL != stat_file) {
         if (NULL != stat_file->path) {
-            free(stat_file->path);
+            mender_free(stat_file->path);
         }
-        free(stat_file);
+        mender_free(stat_file);
     }
 }
 
@@ -1199,7 +1663,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
                                    + ((NULL != file_info->gid) ? 1 : 0) + ((NULL != file_info->mode) ? 1 : 0) + ((NULL != file_info->time) ? 1 : 0))) {
         goto END;
     }
-    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)mender_calloc(object->via.map.size, sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -1209,7 +1673,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
     p = object->via.map.ptr;
     if (NULL != file_info->path) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("path"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("path"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1217,7 +1681,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
         p->key.via.str.size = (uint32_t)strlen("path");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = (uint32_t)strlen(file_info->path);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1227,7 +1691,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
     }
     if (NULL != file_info->size) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("size"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("size"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1239,7 +1703,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
     }
     if (NULL != file_info->uid) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("uid"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("uid"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1251,7 +1715,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
     }
     if (NULL != file_info->gid) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("gid"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("gid"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1263,7 +1727,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
     }
     if (NULL != file_info->mode) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("mode"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("mode"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1276,7 +1740,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
 
     if (NULL != file_info->time) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("modtime"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("modtime"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1285,7 +1749,7 @@ mender_troubleshoot_file_transfer_file_info_encode(mender_troubleshoot_file_tran
         p->val.type         = MSGPACK_OBJECT_EXT;
         p->val.via.ext.size = 4;
         p->val.via.ext.type = -1;
-        if (NULL == (p->val.via.ext.ptr = malloc(p->val.via.ext.size))) {
+        if (NULL == (p->val.via.ext.ptr = mender_malloc(p->val.via.ext.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1306,57 +1770,174 @@ mender_troubleshoot_file_transfer_file_info_release(mender_troubleshoot_file_tra
     /* Release memory */
     if (NULL != file_info) {
         if (NULL != file_info->path) {
-            free(file_info->path);
+            mender_free(file_info->path);
         }
         if (NULL != file_info->size) {
-            free(file_info->size);
+            mender_free(file_info->size);
         }
         if (NULL != file_info->uid) {
-            free(file_info->uid);
+            mender_free(file_info->uid);
         }
         if (NULL != file_info->gid) {
-            free(file_info->gid);
+            mender_free(file_info->gid);
         }
         if (NULL != file_info->mode) {
-            free(file_info->mode);
+            mender_free(file_info->mode);
         }
         if (NULL != file_info->time) {
-            free(file_info->time);
+            mender_free(file_info->time);
         }
-        free(file_info);
+        mender_free(file_info);
     }
 }
 
 static mender_err_t
-mender_troubleshoot_file_transfer_format_file_info(mender_troubleshoot_protomsg_t                *protomsg,
-                                                   mender_troubleshoot_file_transfer_file_info_t *file_info,
-                                                   mender_troubleshoot_protomsg_t               **response) {
+mender_troubleshoot_file_transfer_batch_add(char *path, void *params) {
+
+    assert(NULL != path);
+    assert(NULL != params);
+    mender_troubleshoot_file_transfer_batch_t     *batch     = (mender_troubleshoot_file_transfer_batch_t *)params;
+    mender_troubleshoot_file_transfer_file_info_t *file_info = NULL;
+    mender_err_t                                   ret;
+
+    /* Send the message being filled if it is full */
+    if (CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_BATCH_SIZE == batch->files.via.array.size) {
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_batch_flush(batch, false, NULL))) {
+            return ret;
+        }
+    }
+    if (NULL == batch->files.via.array.ptr) {
+        batch->files.via.array.ptr = (msgpack_object *)mender_calloc(CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_BATCH_SIZE, sizeof(msgpack_object));
+        if (NULL == batch->files.via.array.ptr) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Prepare file info */
+    if (NULL == (file_info = (mender_troubleshoot_file_transfer_file_info_t *)mender_calloc(1, sizeof(mender_troubleshoot_file_transfer_file_info_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (NULL == (file_info->path = mender_strdup(path))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Get statistics of the file, the file info only has the path if they are not available */
+    if (NULL != mender_troubleshoot_file_transfer_callbacks.stat) {
+        if (MENDER_OK
+            != mender_troubleshoot_file_transfer_callbacks.stat(
+                path, &(file_info->size), &(file_info->uid), &(file_info->gid), &(file_info->mode), &(file_info->time))) {
+            mender_log_warning("Unable to get statistics of the file '%s'", path);
+        }
+    }
+
+    /* Encode file info, it is released with the message even if it is incomplete */
+    ret = mender_troubleshoot_file_transfer_file_info_encode(file_info, &batch->files.via.array.ptr[batch->files.via.array.size]);
+    batch->files.via.array.size++;
+
+END:
+
+    /* Release memory */
+    mender_troubleshoot_file_transfer_file_info_release(file_info);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_batch_flush(mender_troubleshoot_file_transfer_batch_t *batch, bool last, mender_troubleshoot_protomsg_t **response) {
+
+    assert(NULL != batch);
+    assert((false == last) || (NULL != response));
+    mender_troubleshoot_protomsg_t *message = NULL;
+    msgpack_object                  object;
+    mender_err_t                    ret = MENDER_OK;
+
+    /* Create the body, the file info of the message are moved to it */
+    object.type         = MSGPACK_OBJECT_MAP;
+    object.via.map.size = 2;
+    if (NULL == (object.via.map.ptr = (msgpack_object_kv *)mender_calloc(object.via.map.size, sizeof(struct msgpack_object_kv)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    object.via.map.ptr[0].val      = batch->files;
+    batch->files.via.array.ptr     = NULL;
+    batch->files.via.array.size    = 0;
+    object.via.map.ptr[0].key.type = MSGPACK_OBJECT_STR;
+    if (NULL == (object.via.map.ptr[0].key.via.str.ptr = mender_strdup("files"))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    object.via.map.ptr[0].key.via.str.size = (uint32_t)strlen("files");
+    object.via.map.ptr[1].key.type         = MSGPACK_OBJECT_STR;
+    if (NULL == (object.via.map.ptr[1].key.via.str.ptr = mender_strdup("last"))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    object.via.map.ptr[1].key.via.str.size = (uint32_t)strlen("last");
+    object.via.map.ptr[1].val.type         = MSGPACK_OBJECT_BOOLEAN;
+    object.via.map.ptr[1].val.via.boolean  = last;
+
+    /* Format file transfer file info batch message */
+    ret = mender_troubleshoot_file_transfer_format_response(batch->protomsg, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO_BATCH, &message);
+    if (MENDER_OK != ret) {
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_troubleshoot_msgpack_pack_object(&object, &(message->body->data), &(message->body->length)))) {
+        mender_log_error("Unable to encode message");
+        goto END;
+    }
+
+    /* The last message is the response, the previous ones are sent immediately */
+    if (true == last) {
+        *response = message;
+        message   = NULL;
+    } else if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_protomsg(message))) {
+        mender_log_error("Unable to send message");
+    }
+
+END:
+
+    /* Release memory */
+    mender_troubleshoot_msgpack_release_object(&object);
+    mender_troubleshoot_protomsg_release(message);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_format_response(mender_troubleshoot_protomsg_t *protomsg, char *typ, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
     assert(NULL != protomsg->hdr);
+    assert(NULL != typ);
     mender_err_t ret = MENDER_OK;
 
-    /* Format file transfer file info message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    /* Format file transfer message */
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(typ))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1365,27 +1946,51 @@ mender_troubleshoot_file_transfer_format_file_info(mender_troubleshoot_protomsg_
     if (NULL != protomsg->hdr->properties) {
         if (NULL
             == ((*response)->hdr->properties
-                = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+                = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
         memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
         if (NULL != protomsg->hdr->properties->user_id) {
-            if (NULL == ((*response)->hdr->properties->user_id = strdup(protomsg->hdr->properties->user_id))) {
+            if (NULL == ((*response)->hdr->properties->user_id = mender_strdup(protomsg->hdr->properties->user_id))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
             }
         }
     }
-    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
+    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->body, 0, sizeof(mender_troubleshoot_protomsg_body_t));
 
+    return ret;
+
+FAIL:
+
+    /* Release memory */
+    mender_troubleshoot_protomsg_release(*response);
+    *response = NULL;
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_format_file_info(mender_troubleshoot_protomsg_t                *protomsg,
+                                                   mender_troubleshoot_file_transfer_file_info_t *file_info,
+                                                   mender_troubleshoot_protomsg_t               **response) {
+
+    assert(NULL != protomsg);
+    mender_err_t ret;
+
+    /* Format file transfer file info message */
+    if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_format_response(protomsg, MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_FILE_INFO, response))) {
+        return ret;
+    }
+
     /* Encode and pack file info data message */
     if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_file_info_pack(file_info, &((*response)->body->data), &((*response)->body->length)))) {
         mender_log_error("Unable to encode message");
@@ -1411,26 +2016,26 @@ mender_troubleshoot_file_transfer_format_ack(mender_troubleshoot_protomsg_t *pro
     mender_err_t ret = MENDER_OK;
 
     /* Format file transfer ack message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ACK))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ACK))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1439,21 +2044,21 @@ mender_troubleshoot_file_transfer_format_ack(mender_troubleshoot_protomsg_t *pro
     if (NULL != protomsg->hdr->properties) {
         if (NULL
             == ((*response)->hdr->properties
-                = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+                = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
         memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
         if (NULL != protomsg->hdr->properties->user_id) {
-            if (NULL == ((*response)->hdr->properties->user_id = strdup(protomsg->hdr->properties->user_id))) {
+            if (NULL == ((*response)->hdr->properties->user_id = mender_strdup(protomsg->hdr->properties->user_id))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
             }
         }
 
-        if (NULL == ((*response)->hdr->properties->offset = (size_t *)malloc(sizeof(size_t)))) {
+        if (NULL == ((*response)->hdr->properties->offset = (size_t *)mender_malloc(sizeof(size_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1486,26 +2091,26 @@ mender_troubleshoot_file_transfer_format_error(mender_troubleshoot_protomsg_t
     mender_err_t ret = MENDER_OK;
 
     /* Format file transfer error message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ERROR))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_ERROR))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1514,21 +2119,21 @@ mender_troubleshoot_file_transfer_format_error(mender_troubleshoot_protomsg_t
     if (NULL != protomsg->hdr->properties) {
         if (NULL
             == ((*response)->hdr->properties
-                = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+                = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
         memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
         if (NULL != protomsg->hdr->properties->user_id) {
-            if (NULL == ((*response)->hdr->properties->user_id = strdup(protomsg->hdr->properties->user_id))) {
+            if (NULL == ((*response)->hdr->properties->user_id = mender_strdup(protomsg->hdr->properties->user_id))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
             }
         }
     }
-    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
+    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -1606,7 +2211,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
     if (0 == (object->via.map.size = ((NULL != error->description) ? 1 : 0) + ((NULL != error->type) ? 1 : 0) + ((NULL != error->id) ? 1 : 0))) {
         goto END;
     }
-    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)mender_malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -1616,7 +2221,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
     p = object->via.map.ptr;
     if (NULL != error->description) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("err"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("err"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1624,7 +2229,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
         p->key.via.str.size = (uint32_t)strlen("err");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = (uint32_t)strlen(error->description);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1634,7 +2239,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
     }
     if (NULL != error->type) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("msgtype"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("msgtype"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1642,7 +2247,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
         p->key.via.str.size = (uint32_t)strlen("msgtype");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = (uint32_t)strlen(error->type);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1652,7 +2257,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
     }
     if (NULL != error->id) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("msgid"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("msgid"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1660,7 +2265,7 @@ mender_troubleshoot_file_transfer_error_message_encode(mender_troubleshoot_file_
         p->key.via.str.size = (uint32_t)strlen("msgid");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = (uint32_t)strlen(error->id);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1676,79 +2281,322 @@ FAIL:
 }
 
 static mender_err_t
-mender_troubleshoot_file_transfer_send_chunk(char *sid, char *user_id, size_t offset, void *data, size_t length) {
+mender_troubleshoot_file_transfer_send_window(void) {
+
+    mender_troubleshoot_file_transfer_window_t *window = &mender_troubleshoot_file_transfer_window;
+    size_t                                      length;
+    mender_err_t                                ret = MENDER_OK;
+
+    /* Read and send file chunk by chunk, the window limits the data sent and not acknowledged by the server */
+    while ((MENDER_TROUBLESHOOT_FILE_TRANSFER_READING == mender_troubleshoot_file_transfer_state_machine)
+           && (window->offset - window->acked < (size_t)window->size * CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE)) {
+        length = CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE;
+        if (NULL != mender_troubleshoot_file_transfer_callbacks.read) {
+            if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_callbacks.read(mender_troubleshoot_file_transfer_handle, window->data, &length))) {
+                mender_log_error("Unable to read file");
+                break;
+            }
+        }
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_chunk(&window->hdr_template, window->offset, window->data, length))) {
+            mender_log_error("Unable to send chunk");
+            break;
+        }
+        window->offset += length;
+
+        /* Check if the end of the file has been reached, the empty chunk has been sent */
+        if (0 == length) {
+            mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_EOF;
+        }
+    }
+
+    return ret;
+}
+
+static void
+mender_troubleshoot_file_transfer_close_window(void) {
+
+    /* Close file */
+    if (MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE != mender_troubleshoot_file_transfer_state_machine) {
+        if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
+            if (MENDER_OK != mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle)) {
+                mender_log_error("Unable to close the file");
+            }
+        }
+        mender_troubleshoot_file_transfer_state_machine = MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE;
+    }
+
+    /* Release memory */
+    mender_free(mender_troubleshoot_file_transfer_window.data);
+    mender_troubleshoot_protomsg_hdr_template_release(&mender_troubleshoot_file_transfer_window.hdr_template);
+    memset(&mender_troubleshoot_file_transfer_window, 0, sizeof(mender_troubleshoot_file_transfer_window_t));
+
+    /* Release the pack buffers, they are allocated again by the next session */
+    mender_troubleshoot_api_buffer_release();
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_create_chunk_hdr(char *sid, char *user_id, mender_troubleshoot_protomsg_hdr_template_t *hdr_template) {
 
     assert(NULL != sid);
     assert(NULL != user_id);
-    mender_troubleshoot_protomsg_t *protomsg = NULL;
-    mender_err_t                    ret      = MENDER_OK;
-    void                           *payload  = NULL;
+    assert(NULL != hdr_template);
+    size_t                                        offset     = 0;
+    mender_troubleshoot_protomsg_hdr_properties_t properties = { .user_id = user_id, .offset = &offset };
+    mender_troubleshoot_protomsg_hdr_t            hdr        = { .proto      = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_FILE_TRANSFER,
+                                                                 .typ        = MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_CHUNK,
+                                                                 .sid        = sid,
+                                                                 .properties = &properties };
+
+    /* Create file transfer chunk header, the offset is packed with each chunk */
+    return mender_troubleshoot_protomsg_hdr_template_create(&hdr, hdr_template);
+}
 
-    /* Send file transfer chunk message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+static mender_err_t
+mender_troubleshoot_file_transfer_send_chunk(mender_troubleshoot_protomsg_hdr_template_t *hdr_template, size_t offset, void *data, size_t length) {
+
+    assert(NULL != hdr_template);
+    mender_err_t ret     = MENDER_OK;
+    void        *payload = NULL;
+
+    /* Pack file transfer chunk message */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_template_pack(hdr_template, offset, data, length, &payload, &length))) {
+        mender_log_error("Unable to encode message");
         goto FAIL;
     }
-    memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+
+    /* Send message, the pack buffer is given back once it has been sent */
+    ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_BULK, -1, NULL, NULL);
+    payload = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to send message");
         goto FAIL;
     }
-    memset(protomsg->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
-    protomsg->hdr->proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_FILE_TRANSFER;
-    if (NULL == (protomsg->hdr->typ = strdup(MENDER_TROUBLESHOOT_FILE_TRANSFER_MESSAGE_TYPE_CHUNK))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != payload) {
+        mender_troubleshoot_api_buffer_give(payload);
     }
-    if (NULL == (protomsg->hdr->sid = strdup(sid))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_upload_work_function(void) {
+
+    mender_troubleshoot_file_transfer_upload_t       *upload = &mender_troubleshoot_file_transfer_upload;
+    mender_troubleshoot_file_transfer_upload_chunk_t *chunk;
+    mender_troubleshoot_protomsg_t                   *ack;
+    bool                                              closing;
+    bool                                              processed = false;
+    mender_err_t                                      ret;
+
+    /* Write the chunks queued, the file is closed once all the chunks have been written */
+    do {
+
+        /* Take mutex used to protect access to the queue */
+        if (MENDER_OK != (ret = mender_scheduler_mutex_take(upload->mutex, -1))) {
+            mender_log_error("Unable to take mutex");
+            return ret;
+        }
+
+        /* Get the next chunk of the queue */
+        if (NULL != (chunk = upload->head)) {
+            if (NULL == (upload->head = chunk->next)) {
+                upload->tail = NULL;
+            }
+        }
+        closing = (NULL == chunk) && (true == upload->closing);
+        ack     = NULL;
+        if (true == closing) {
+            ack               = upload->close_ack;
+            upload->close_ack = NULL;
+        }
+
+        /* Release mutex used to protect access to the queue */
+        mender_scheduler_mutex_give(upload->mutex);
+
+        /* Write the chunk or close the file, the data written is released from the write-behind buffer */
+        if (NULL != chunk) {
+            mender_troubleshoot_file_transfer_upload_write(chunk);
+        } else if (true == closing) {
+            mender_troubleshoot_file_transfer_upload_close(ack);
+        }
+        if ((NULL != chunk) || (true == closing)) {
+            if (MENDER_OK != (ret = mender_scheduler_mutex_take(upload->mutex, -1))) {
+                mender_log_error("Unable to take mutex");
+                return ret;
+            }
+            if (NULL != chunk) {
+                upload->queued -= chunk->length;
+            } else {
+                upload->closing = false;
+            }
+            mender_scheduler_mutex_give(upload->mutex);
+            processed = true;
+        }
+
+        /* Release memory */
+        if (NULL != chunk) {
+            mender_troubleshoot_protomsg_release(chunk->ack);
+            mender_free(chunk);
+        }
+        mender_troubleshoot_protomsg_release(ack);
+
+    } while ((NULL != chunk) || (true == closing));
+
+    /* The execution requested while the work is completing is ignored, the work is executed again to write the chunks queued meanwhile */
+    if (true == processed) {
+        mender_scheduler_work_execute_after(upload->work, MENDER_TROUBLESHOOT_FILE_TRANSFER_UPLOAD_RETRY_DELAY);
     }
-    if (NULL == (protomsg->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+
+    return MENDER_OK;
+}
+
+static void
+mender_troubleshoot_file_transfer_upload_write(mender_troubleshoot_file_transfer_upload_chunk_t *chunk) {
+
+    assert(NULL != chunk);
+
+    /* Discard the chunk if the file has been closed after an error */
+    if (true == mender_troubleshoot_file_transfer_upload.failed) {
+        return;
     }
-    memset(protomsg->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
-    if (NULL == (protomsg->hdr->properties->user_id = strdup(user_id))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+
+    /* Write to the file */
+    if (NULL != mender_troubleshoot_file_transfer_callbacks.write) {
+        if (MENDER_OK != mender_troubleshoot_file_transfer_callbacks.write(mender_troubleshoot_file_transfer_handle, chunk->data, chunk->length)) {
+            mender_log_error("Unable to write to the file");
+            if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
+                if (MENDER_OK != mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle)) {
+                    mender_log_error("Unable to close the file");
+                }
+            }
+            mender_troubleshoot_file_transfer_upload_error("Unable to write to the file");
+            return;
+        }
     }
-    if (NULL == (protomsg->hdr->properties->offset = (size_t *)malloc(sizeof(size_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+
+    /* Send ack delayed until the chunk is written */
+    if (NULL != chunk->ack) {
+        mender_troubleshoot_file_transfer_send_protomsg(chunk->ack);
     }
-    *protomsg->hdr->properties->offset = offset;
-    if ((NULL != data) && (0 != length)) {
-        if (NULL == (protomsg->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memset(protomsg->body, 0, sizeof(mender_troubleshoot_protomsg_body_t));
-        if (NULL == (protomsg->body->data = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
+}
+
+static void
+mender_troubleshoot_file_transfer_upload_close(mender_troubleshoot_protomsg_t *ack) {
+
+    /* Nothing to do if the file has been closed after an error */
+    if (true == mender_troubleshoot_file_transfer_upload.failed) {
+        return;
+    }
+
+    /* Close file */
+    if (NULL != mender_troubleshoot_file_transfer_callbacks.close) {
+        if (MENDER_OK != mender_troubleshoot_file_transfer_callbacks.close(mender_troubleshoot_file_transfer_handle)) {
+            mender_log_error("Unable to close the file");
         }
-        memcpy(protomsg->body->data, data, length);
-        protomsg->body->length = length;
     }
 
+    /* Send the latest ack */
+    if (NULL != ack) {
+        mender_troubleshoot_file_transfer_send_protomsg(ack);
+    }
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_upload_stop(mender_troubleshoot_protomsg_t *ack) {
+
+    mender_troubleshoot_file_transfer_upload_t *upload = &mender_troubleshoot_file_transfer_upload;
+    mender_err_t                                ret;
+
+    /* Take mutex used to protect access to the queue */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(upload->mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        mender_troubleshoot_protomsg_release(ack);
+        return ret;
+    }
+
+    /* Stop queuing the chunks received, the ack is dropped if the transfer has been aborted meanwhile */
+    if (true == upload->writing) {
+        upload->writing   = false;
+        upload->closing   = true;
+        upload->close_ack = ack;
+        ack               = NULL;
+    }
+
+    /* Release mutex used to protect access to the queue */
+    mender_scheduler_mutex_give(upload->mutex);
+
+    /* Release memory */
+    mender_troubleshoot_protomsg_release(ack);
+
+    /* Close the file once the chunks queued have been written */
+    mender_scheduler_work_execute(upload->work);
+
+    return ret;
+}
+
+static void
+mender_troubleshoot_file_transfer_upload_error(char *description) {
+
+    assert(NULL != description);
+    mender_troubleshoot_file_transfer_upload_t   *upload = &mender_troubleshoot_file_transfer_upload;
+    mender_troubleshoot_file_transfer_error_t     error;
+    mender_troubleshoot_protomsg_t               *response = NULL;
+    mender_troubleshoot_protomsg_hdr_properties_t properties;
+    mender_troubleshoot_protomsg_hdr_t            hdr;
+    mender_troubleshoot_protomsg_t                protomsg;
+
+    /* Stop queuing the chunks received, the chunks queued are discarded */
+    upload->failed = true;
+    if (MENDER_OK == mender_scheduler_mutex_take(upload->mutex, -1)) {
+        upload->writing = false;
+        mender_scheduler_mutex_give(upload->mutex);
+    }
+
+    /* Format error for the session of the file */
+    memset(&error, 0, sizeof(mender_troubleshoot_file_transfer_error_t));
+    memset(&properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
+    memset(&hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
+    memset(&protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
+    error.description  = description;
+    properties.user_id = upload->user_id;
+    hdr.proto          = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_FILE_TRANSFER;
+    hdr.sid            = upload->sid;
+    hdr.properties     = &properties;
+    protomsg.hdr       = &hdr;
+    if (MENDER_OK != mender_troubleshoot_file_transfer_format_error(&protomsg, &error, &response)) {
+        mender_log_error("Unable to format error");
+        return;
+    }
+
+    /* Send error */
+    mender_troubleshoot_file_transfer_send_protomsg(response);
+
+    /* Release memory */
+    mender_troubleshoot_protomsg_release(response);
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_send_protomsg(mender_troubleshoot_protomsg_t *protomsg) {
+
+    assert(NULL != protomsg);
+    mender_err_t ret;
+    void        *payload = NULL;
+    size_t       length;
+
     /* Encode and pack the message */
     if (MENDER_OK != (ret = mender_troubleshoot_protomsg_pack(protomsg, &payload, &length))) {
         mender_log_error("Unable to encode message");
         goto FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
+    /* Send message, the pack buffer is given back once it has been sent */
+    ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_CONTROL, -1, NULL, NULL);
+    payload = NULL;
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to send message");
         goto FAIL;
     }
@@ -1756,9 +2604,8 @@ mender_troubleshoot_file_transfer_send_chunk(char *sid, char *user_id, size_t of
 FAIL:
 
     /* Release memory */
-    mender_troubleshoot_protomsg_release(protomsg);
     if (NULL != payload) {
-        free(payload);
+        mender_troubleshoot_api_buffer_give(payload);
     }
 
     return ret;
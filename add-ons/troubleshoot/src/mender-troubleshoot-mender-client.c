@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-client.h"
 #include "mender-inventory.h"
 #include "mender-log.h"
@@ -63,52 +68,38 @@ static mender_err_t mender_troubleshoot_mender_client_format_ack(mender_troubles
                                                                  mender_troubleshoot_protomsg_hdr_properties_status_t status,
                                                                  mender_troubleshoot_protomsg_t                     **response);
 
-mender_err_t
-mender_troubleshoot_mender_client_init(void) {
-
-    /* Nothing to do */
-    return MENDER_OK;
-}
-
-mender_err_t
-mender_troubleshoot_mender_client_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
-
-    assert(NULL != protomsg);
-    assert(NULL != protomsg->hdr);
-    mender_err_t ret = MENDER_OK;
-
-    /* Verify integrity of the message */
-    if (NULL == protomsg->hdr->typ) {
-        mender_log_error("Invalid message received");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-
-    /* Treatment of the message depending of the message type */
-    if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_MENDER_CLIENT_MESSAGE_TYPE_CHECK_UPDATE)) {
-        /* Check update */
-        ret = mender_troubleshoot_mender_client_check_update_message_handler(protomsg, response);
+/**
+ * @brief Message types of the mender client proto
+ */
+static const mender_troubleshoot_protomsg_type_t mender_troubleshoot_mender_client_message_types[] = {
+    { .typ = MENDER_TROUBLESHOOT_MENDER_CLIENT_MESSAGE_TYPE_CHECK_UPDATE, .handler = mender_troubleshoot_mender_client_check_update_message_handler },
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_MENDER_CLIENT_MESSAGE_TYPE_SEND_INVENTORY)) {
-        /* Send inventory */
-        ret = mender_troubleshoot_mender_client_send_inventory_message_handler(protomsg, response);
+    { .typ = MENDER_TROUBLESHOOT_MENDER_CLIENT_MESSAGE_TYPE_SEND_INVENTORY, .handler = mender_troubleshoot_mender_client_send_inventory_message_handler },
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
-    } else {
-        /* Not supported */
-        mender_log_error("Unsupported mender client message received with message type '%s'", protomsg->hdr->typ);
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
+};
 
-FAIL:
+/**
+ * @brief Mender client proto
+ */
+static const mender_troubleshoot_protomsg_proto_t mender_troubleshoot_mender_client_proto
+    = { .proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_MENDER_CLIENT,
+        .types = mender_troubleshoot_mender_client_message_types,
+        .count = sizeof(mender_troubleshoot_mender_client_message_types) / sizeof(mender_troubleshoot_mender_client_message_types[0]),
+        .sid   = false };
 
-    return ret;
+mender_err_t
+mender_troubleshoot_mender_client_init(void) {
+
+    /* Register mender client proto */
+    return mender_troubleshoot_protomsg_register(&mender_troubleshoot_mender_client_proto);
 }
 
 mender_err_t
 mender_troubleshoot_mender_client_exit(void) {
 
-    /* Nothing to do */
+    /* Unregister mender client proto */
+    mender_troubleshoot_protomsg_unregister(MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_MENDER_CLIENT);
+
     return MENDER_OK;
 }
 
@@ -116,26 +107,20 @@ static mender_err_t
 mender_troubleshoot_mender_client_check_update_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_protomsg_hdr_properties_status_t status = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL;
+    mender_err_t                                         ret;
 
-    /* Trigger execution of the mender-client update work */
-    if (MENDER_OK != (ret = mender_client_execute())) {
+    /* Trigger execution of the mender-client update work, the deployment is checked right away, the server is informed if it fails */
+    if (MENDER_OK != mender_client_execute()) {
         mender_log_error("Unable to execute mender-client");
-        goto FAIL;
+        status = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR;
     }
 
     /* Format acknowledgment */
-    if (MENDER_OK
-        != (ret = mender_troubleshoot_mender_client_format_ack(protomsg,
-                                                               (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL
-                                                                                  : MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR,
-                                                               response))) {
+    if (MENDER_OK != (ret = mender_troubleshoot_mender_client_format_ack(protomsg, status, response))) {
         mender_log_error("Unable to format acknowledgment");
-        goto FAIL;
     }
 
-FAIL:
-
     return ret;
 }
 
@@ -145,26 +130,20 @@ static mender_err_t
 mender_troubleshoot_mender_client_send_inventory_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_protomsg_hdr_properties_status_t status = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL;
+    mender_err_t                                         ret;
 
-    /* Trigger execution of the mender-inventory work */
-    if (MENDER_OK != (ret = mender_inventory_execute())) {
+    /* Trigger execution of the mender-inventory work, the inventory is published right away, the server is informed if it fails */
+    if (MENDER_OK != mender_inventory_execute()) {
         mender_log_error("Unable to execute mender-inventory");
-        goto FAIL;
+        status = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR;
     }
 
     /* Format acknowledgment */
-    if (MENDER_OK
-        != (ret = mender_troubleshoot_mender_client_format_ack(protomsg,
-                                                               (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL
-                                                                                  : MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR,
-                                                               response))) {
+    if (MENDER_OK != (ret = mender_troubleshoot_mender_client_format_ack(protomsg, status, response))) {
         mender_log_error("Unable to format acknowledgment");
-        goto FAIL;
     }
 
-FAIL:
-
     return ret;
 }
 
@@ -180,33 +159,34 @@ mender_troubleshoot_mender_client_format_ack(mender_troubleshoot_protomsg_t
     mender_err_t ret = MENDER_OK;
 
     /* Format mender client ack message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(protomsg->hdr->typ))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(protomsg->hdr->typ))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     }
     if (NULL
-        == ((*response)->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+        == ((*response)->hdr->properties
+            = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -214,7 +194,7 @@ mender_troubleshoot_mender_client_format_ack(mender_troubleshoot_protomsg_t
     memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
     if (NULL
         == ((*response)->hdr->properties->status
-            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
+            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-log.h"
 #include "mender-troubleshoot-msgpack.h"
 
@@ -41,27 +46,41 @@
  */
 int msgpack_pack_object_with_fixint(msgpack_packer *pk, msgpack_object d);
 
+mender_err_t
+mender_troubleshoot_msgpack_packer_init(msgpack_sbuffer *sbuffer, msgpack_packer *packer) {
+
+    assert(NULL != sbuffer);
+    assert(NULL != packer);
+
+    /* Initialize msgpack sbuffer */
+    msgpack_sbuffer_init(sbuffer);
+    sbuffer->alloc = MENDER_TROUBLESHOOT_SBUFFER_INIT_SIZE;
+    if (NULL == (sbuffer->data = (char *)mender_malloc(sbuffer->alloc))) {
+        mender_log_error("Unable  to allocate memory");
+        sbuffer->alloc = 0;
+        return MENDER_FAIL;
+    }
+
+    /* Initialize msgpack packer */
+    msgpack_packer_init(packer, sbuffer, msgpack_sbuffer_write);
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_troubleshoot_msgpack_pack_object(msgpack_object *object, void **data, size_t *length) {
 
     assert(NULL != data);
     assert(NULL != length);
-    mender_err_t    ret = MENDER_OK;
+    mender_err_t    ret;
     msgpack_sbuffer sbuffer;
     msgpack_packer  packer;
 
-    /* Initialize msgpack sbuffer */
-    msgpack_sbuffer_init(&sbuffer);
-    sbuffer.alloc = MENDER_TROUBLESHOOT_SBUFFER_INIT_SIZE;
-    if (NULL == (sbuffer.data = (char *)malloc(sbuffer.alloc))) {
-        mender_log_error("Unable  to allocate memory");
-        ret = MENDER_FAIL;
+    /* Initialize msgpack packer */
+    if (MENDER_OK != (ret = mender_troubleshoot_msgpack_packer_init(&sbuffer, &packer))) {
         goto FAIL;
     }
 
-    /* Initialize msgpack packer */
-    msgpack_packer_init(&packer, &sbuffer, msgpack_sbuffer_write);
-
     /* Pack the message */
     if (0 != msgpack_pack_object_with_fixint(&packer, *object)) {
         mender_log_error("Unable to pack the message");
@@ -252,17 +271,17 @@ mender_troubleshoot_msgpack_release_object(msgpack_object *object) {
                 break;
             case MSGPACK_OBJECT_STR:
                 if (NULL != object->via.str.ptr) {
-                    free((void *)object->via.str.ptr);
+                    mender_free((void *)object->via.str.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_BIN:
                 if (NULL != object->via.ext.ptr) {
-                    free((void *)object->via.bin.ptr);
+                    mender_free((void *)object->via.bin.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_EXT:
                 if (NULL != object->via.ext.ptr) {
-                    free((void *)object->via.ext.ptr);
+                    mender_free((void *)object->via.ext.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_ARRAY:
@@ -272,7 +291,7 @@ mender_troubleshoot_msgpack_release_object(msgpack_object *object) {
                         mender_troubleshoot_msgpack_release_object(p);
                         ++p;
                     } while (p < object->via.array.ptr + object->via.array.size);
-                    free(object->via.array.ptr);
+                    mender_free(object->via.array.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_MAP:
@@ -283,7 +302,7 @@ mender_troubleshoot_msgpack_release_object(msgpack_object *object) {
                         mender_troubleshoot_msgpack_release_object(&(p->val));
                         ++p;
                     } while (p < object->via.map.ptr + object->via.map.size);
-                    free(object->via.map.ptr);
+                    mender_free(object->via.map.ptr);
                 }
                 break;
             default:
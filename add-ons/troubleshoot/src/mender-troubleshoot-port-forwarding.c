@@ -17,7 +17,13 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-log.h"
+#include "mender-scheduler.h"
 #include "mender-troubleshoot-api.h"
 #include "mender-troubleshoot-port-forwarding.h"
 #include "mender-troubleshoot-msgpack.h"
@@ -34,6 +40,20 @@
 #define MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ACK     "ack"
 #define MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ERROR   "error"
 
+/**
+ * @brief Default maximum number of port forwarding connections opened at the same time
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS (4)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS */
+
+/**
+ * @brief Default size of the buffer of the data forwarded to the server for each connection (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE (1024)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE */
+
 /**
  * @brief Connect request
  */
@@ -61,25 +81,51 @@ enum {
 } mender_troubleshoot_port_forwarding_state_machine
     = MENDER_TROUBLESHOOT_FILE_TRANSFER_IDLE;
 
+/**
+ * @brief Port forwarding connection
+ */
+typedef struct {
+    char                                       *sid;           /**< Session ID, NULL if the connection is not used */
+    char                                       *connection_id; /**< Connection ID */
+    void                                       *handle;        /**< Connection handle used to store temporary connection reference */
+    mender_troubleshoot_protomsg_hdr_template_t hdr_template;  /**< Header of the forward messages, packed once for the connection */
+    uint8_t                                    *buffer;        /**< Buffer of the connection, the header of the messages is packed in front of the data */
+    uint8_t                                    *data;          /**< Data pending to be forwarded to the server */
+    size_t                                      length;        /**< Length of the data pending */
+    bool                                        sending;       /**< Data pending being sent to the server, no data can be added meanwhile */
+    bool                                        stalled;       /**< No credit was available, the credits callback is invoked once the data is sent */
+} mender_troubleshoot_port_forwarding_connection_t;
+
 /**
  * @brief Mender troubleshoot port forwarding callbacks
  */
 static mender_troubleshoot_port_forwarding_callbacks_t mender_troubleshoot_port_forwarding_callbacks;
 
 /**
- * @brief Mender troubleshoot port forwarding session ID
+ * @brief Mender troubleshoot port forwarding connections
+ */
+static mender_troubleshoot_port_forwarding_connection_t
+    mender_troubleshoot_port_forwarding_connections[CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS];
+
+/**
+ * @brief Index of the connection served first by the next round of forward messages sent to the server
+ */
+static size_t mender_troubleshoot_port_forwarding_next = 0;
+
+/**
+ * @brief Mutex used to protect access to the connections
  */
-static char *mender_troubleshoot_port_forwarding_sid = NULL;
+static void *mender_troubleshoot_port_forwarding_mutex = NULL;
 
 /**
- * @brief Mender troubleshoot port forwarding connection ID
+ * @brief Mutex used to send the rounds of forward messages one at a time
  */
-static char *mender_troubleshoot_port_forwarding_connection_id = NULL;
+static void *mender_troubleshoot_port_forwarding_send_mutex = NULL;
 
 /**
- * @brief Connection handle used to store temporary connection reference
+ * @brief Queue used to wait for the end of the send of the forward messages, the buffers of the connections are sent without copy
  */
-static void *mender_troubleshoot_port_forwarding_handle = NULL;
+static void *mender_troubleshoot_port_forwarding_sent_queue = NULL;
 
 /**
  * @brief Function called to perform the treatment of the port forwarding new messages
@@ -166,153 +212,238 @@ static mender_err_t mender_troubleshoot_port_forwarding_error_message_pack(mende
  */
 static mender_err_t mender_troubleshoot_port_forwarding_error_message_encode(mender_troubleshoot_port_forwarding_error_t *error, msgpack_object *object);
 
+/**
+ * @brief Function called to get a port forwarding connection, the connections mutex must be taken
+ * @param connection_id Connection ID, NULL to get a connection not used
+ * @return Connection if it is found, NULL otherwise
+ */
+static mender_troubleshoot_port_forwarding_connection_t *mender_troubleshoot_port_forwarding_get_connection(char *connection_id);
+
+/**
+ * @brief Function called to release a port forwarding connection, the data pending are discarded
+ * @param connection Connection
+ */
+static void mender_troubleshoot_port_forwarding_release_connection(mender_troubleshoot_port_forwarding_connection_t *connection);
+
+/**
+ * @brief Function called to get a port forwarding connection using the connection handle, the connections mutex must be taken
+ * @param handle Connection handle returned by the connect callback
+ * @return Connection if it is found, NULL otherwise
+ */
+static mender_troubleshoot_port_forwarding_connection_t *mender_troubleshoot_port_forwarding_get_connection_by_handle(void *handle);
+
+/**
+ * @brief Function called to detach a port forwarding connection, it is not used by the forward functions anymore once it is detached
+ * @param entry Connection in the connections
+ * @param connection Copy of the connection detached, to be released by the caller
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_port_forwarding_detach_connection(mender_troubleshoot_port_forwarding_connection_t *entry,
+                                                                          mender_troubleshoot_port_forwarding_connection_t *connection);
+
+/**
+ * @brief Function called to send a round of forward messages, the data pending of the connections is sent in turn so that none is starved
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_port_forwarding_send_round(void);
+
+/**
+ * @brief Function called once a forward message has been sent
+ * @param result Result of the send
+ * @param params Not used
+ */
+static void mender_troubleshoot_port_forwarding_sent_callback(mender_err_t result, void *params);
+
+/**
+ * @brief Function called to send the data pending, one round at a time
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_port_forwarding_send(void);
+
 /**
  * @brief Function called to send port forwarding stop protomsg
+ * @param connection Connection
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-static mender_err_t mender_troubleshoot_port_forwarding_send_stop(void);
+static mender_err_t mender_troubleshoot_port_forwarding_send_stop(mender_troubleshoot_port_forwarding_connection_t *connection);
+
+/**
+ * @brief Message types of the port forwarding proto
+ */
+static const mender_troubleshoot_protomsg_type_t mender_troubleshoot_port_forwarding_message_types[] = {
+    { .typ = MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_NEW, .handler = mender_troubleshoot_port_forwarding_connect_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_STOP, .handler = mender_troubleshoot_port_forwarding_close_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_FORWARD, .handler = mender_troubleshoot_port_forwarding_forward_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ACK, .handler = NULL },
+    { .typ = MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ERROR, .handler = NULL },
+};
+
+/**
+ * @brief Port forwarding proto
+ */
+static const mender_troubleshoot_protomsg_proto_t mender_troubleshoot_port_forwarding_proto
+    = { .proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_PORT_FORWARD,
+        .types = mender_troubleshoot_port_forwarding_message_types,
+        .count = sizeof(mender_troubleshoot_port_forwarding_message_types) / sizeof(mender_troubleshoot_port_forwarding_message_types[0]),
+        .sid   = false };
 
 mender_err_t
 mender_troubleshoot_port_forwarding_init(mender_troubleshoot_port_forwarding_callbacks_t *callbacks) {
 
+    mender_err_t ret;
+
     /* Save callbacks */
     if (NULL != callbacks) {
         memcpy(&mender_troubleshoot_port_forwarding_callbacks, callbacks, sizeof(mender_troubleshoot_port_forwarding_callbacks_t));
     }
 
-    return MENDER_OK;
+    /* Create port forwarding mutexes */
+    memset(mender_troubleshoot_port_forwarding_connections, 0, sizeof(mender_troubleshoot_port_forwarding_connections));
+    mender_troubleshoot_port_forwarding_next = 0;
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_port_forwarding_mutex))) {
+        mender_log_error("Unable to create port forwarding mutex");
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_port_forwarding_send_mutex))) {
+        mender_log_error("Unable to create port forwarding mutex");
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_queue_create(1, sizeof(mender_err_t), &mender_troubleshoot_port_forwarding_sent_queue))) {
+        mender_log_error("Unable to create port forwarding queue");
+        return ret;
+    }
+
+    /* Register port forwarding proto */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_register(&mender_troubleshoot_port_forwarding_proto))) {
+        mender_log_error("Unable to register port forwarding proto");
+        return ret;
+    }
+
+    return ret;
 }
 
 mender_err_t
-mender_troubleshoot_port_forwarding_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+mender_troubleshoot_port_forwarding_forward(void *handle, void *data, size_t length) {
 
-    assert(NULL != protomsg);
-    assert(NULL != protomsg->hdr);
-    mender_err_t ret = MENDER_OK;
+    assert(NULL != handle);
+    assert(NULL != data);
+    mender_troubleshoot_port_forwarding_connection_t *connection;
+    size_t                                            size;
+    bool                                              pending;
+    mender_err_t                                      ret;
 
-    /* Verify integrity of the message */
-    if (NULL == protomsg->hdr->typ) {
-        mender_log_error("Invalid message received");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
+    do {
 
-    /* Treatment of the message depending of the message type */
-    if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_NEW)) {
-        /* Connect to the remote host */
-        ret = mender_troubleshoot_port_forwarding_connect_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_STOP)) {
-        /* Close connection to the remote host */
-        ret = mender_troubleshoot_port_forwarding_close_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_FORWARD)) {
-        /* Send data to the remote host */
-        ret = mender_troubleshoot_port_forwarding_forward_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ACK)) {
-        /* Nothing to do */
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ERROR)) {
-        /* Nothing to do */
-    } else {
-        /* Not supported */
-        mender_log_error("Unsupported message received with message type '%s'", protomsg->hdr->typ);
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
+        /* Take mutex used to protect access to the connections */
+        if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+            mender_log_error("Unable to take mutex");
+            return ret;
+        }
 
-FAIL:
+        /* Retrieve the connection, it is closed if it is not found anymore */
+        if (NULL == (connection = mender_troubleshoot_port_forwarding_get_connection_by_handle(handle))) {
+            mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+            mender_log_error("No port forwarding connection opened");
+            return MENDER_FAIL;
+        }
+
+        /* Add the data to the buffer of the connection, nothing is added while the data pending is being sent */
+        size = (true == connection->sending) ? 0 : (CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE - connection->length);
+        if (size > length) {
+            size = length;
+        }
+        memcpy(&connection->data[connection->length], data, size);
+        connection->length += size;
+        data = (uint8_t *)data + size;
+        length -= size;
+        pending = (0 < connection->length);
+
+        /* Release mutex used to protect access to the connections */
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+
+        /* Send a round of forward messages, the data of the connection may have been sent by the round of another connection meanwhile */
+        if (true == pending) {
+            if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_send())) {
+                return ret;
+            }
+        }
+
+    } while ((0 < length) || (true == pending));
 
     return ret;
 }
 
 mender_err_t
-mender_troubleshoot_port_forwarding_forward(void *data, size_t length) {
+mender_troubleshoot_port_forwarding_get_buffer(void *handle, void **data, size_t *size) {
 
-    mender_troubleshoot_protomsg_t *protomsg = NULL;
-    mender_err_t                    ret      = MENDER_OK;
-    void                           *payload  = NULL;
+    assert(NULL != handle);
+    assert(NULL != data);
+    assert(NULL != size);
+    mender_troubleshoot_port_forwarding_connection_t *connection;
+    mender_err_t                                      ret;
 
-    /* Check if a session is already opened */
-    if (NULL == mender_troubleshoot_port_forwarding_sid) {
-        mender_log_error("No port forwarding session opened");
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
     }
 
-    /* Check if a connection is already opened */
-    if (NULL == mender_troubleshoot_port_forwarding_connection_id) {
+    /* Retrieve the connection, it is closed if it is not found anymore */
+    if (NULL == (connection = mender_troubleshoot_port_forwarding_get_connection_by_handle(handle))) {
         mender_log_error("No port forwarding connection opened");
         ret = MENDER_FAIL;
-        goto FAIL;
+        goto END;
     }
 
-    /* Send port forwarding forward message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
-    protomsg->hdr->proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_PORT_FORWARD;
-    if (NULL == (protomsg->hdr->typ = strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_FORWARD))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if (NULL == (protomsg->hdr->sid = strdup(mender_troubleshoot_port_forwarding_sid))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if (NULL == (protomsg->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Return the free space of the buffer, no credit is available while the data pending is being sent */
+    *data = &connection->data[connection->length];
+    *size = (true == connection->sending) ? 0 : (CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE - connection->length);
+    if (0 == *size) {
+        connection->stalled = true;
     }
-    memset(protomsg->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
-    if (NULL == (protomsg->hdr->properties->connection_id = strdup(mender_troubleshoot_port_forwarding_connection_id))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if ((NULL != data) && (0 != length)) {
-        if (NULL == (protomsg->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memset(protomsg->body, 0, sizeof(mender_troubleshoot_protomsg_body_t));
-        if (NULL == (protomsg->body->data = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memcpy(protomsg->body->data, data, length);
-        protomsg->body->length = length;
+
+END:
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_troubleshoot_port_forwarding_commit(void *handle, size_t length) {
+
+    assert(NULL != handle);
+    mender_troubleshoot_port_forwarding_connection_t *connection;
+    mender_err_t                                      ret;
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
     }
 
-    /* Encode and pack the message */
-    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_pack(protomsg, &payload, &length))) {
-        mender_log_error("Unable to encode message");
-        goto FAIL;
+    /* Retrieve the connection, it is closed if it is not found anymore */
+    if (NULL == (connection = mender_troubleshoot_port_forwarding_get_connection_by_handle(handle))) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+        mender_log_error("No port forwarding connection opened");
+        return MENDER_FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
-        mender_log_error("Unable to send message");
-        goto FAIL;
+    /* Add the data written by the application to the data pending */
+    if ((true == connection->sending) || (length > CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE - connection->length)) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+        mender_log_error("Not enough credits to commit the data");
+        return MENDER_FAIL;
     }
+    connection->length += length;
 
-FAIL:
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
 
-    /* Release memory */
-    mender_troubleshoot_protomsg_release(protomsg);
-    if (NULL != payload) {
-        free(payload);
+    /* Send the data pending */
+    if (0 < length) {
+        ret = mender_troubleshoot_port_forwarding_send();
     }
 
     return ret;
@@ -321,34 +452,37 @@ FAIL:
 mender_err_t
 mender_troubleshoot_port_forwarding_close(void) {
 
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_port_forwarding_connection_t connection;
+    mender_err_t                                     ret = MENDER_OK;
 
-    /* Check if a session is already opened */
-    if (NULL != mender_troubleshoot_port_forwarding_sid) {
+    /* Close all the connections */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS; index++) {
+
+        /* Remove the connection from the connections, it is not used by the forward functions anymore */
+        if (MENDER_OK
+            != mender_troubleshoot_port_forwarding_detach_connection(&mender_troubleshoot_port_forwarding_connections[index], &connection)) {
+            return MENDER_FAIL;
+        }
 
-        /* Check if a connection is already opened */
-        if (NULL != mender_troubleshoot_port_forwarding_connection_id) {
+        /* Check if the connection is opened */
+        if (NULL != connection.sid) {
 
             /* Invoke port forwarding close callback */
             if (NULL != mender_troubleshoot_port_forwarding_callbacks.close) {
-                if (MENDER_OK != mender_troubleshoot_port_forwarding_callbacks.close(mender_troubleshoot_port_forwarding_handle)) {
+                if (MENDER_OK != mender_troubleshoot_port_forwarding_callbacks.close(connection.handle)) {
                     mender_log_error("An error occured");
                 }
             }
 
             /* Send stop message to the server */
-            if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_send_stop())) {
+            if (MENDER_OK != mender_troubleshoot_port_forwarding_send_stop(&connection)) {
                 mender_log_error("Unable to send stop message to the server");
+                ret = MENDER_FAIL;
             }
 
-            /* Release connection ID */
-            free(mender_troubleshoot_port_forwarding_connection_id);
-            mender_troubleshoot_port_forwarding_connection_id = NULL;
+            /* Release connection */
+            mender_troubleshoot_port_forwarding_release_connection(&connection);
         }
-
-        /* Release session ID */
-        free(mender_troubleshoot_port_forwarding_sid);
-        mender_troubleshoot_port_forwarding_sid = NULL;
     }
 
     return ret;
@@ -359,11 +493,22 @@ mender_troubleshoot_port_forwarding_exit(void) {
 
     mender_err_t ret;
 
-    /* Close connection if it is opened */
+    /* Unregister port forwarding proto */
+    mender_troubleshoot_protomsg_unregister(MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_PORT_FORWARD);
+
+    /* Close connections if they are opened */
     if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_close())) {
         mender_log_error("Unable to close connection");
     }
 
+    /* Release memory */
+    mender_scheduler_mutex_delete(mender_troubleshoot_port_forwarding_mutex);
+    mender_troubleshoot_port_forwarding_mutex = NULL;
+    mender_scheduler_mutex_delete(mender_troubleshoot_port_forwarding_send_mutex);
+    mender_troubleshoot_port_forwarding_send_mutex = NULL;
+    mender_scheduler_queue_delete(mender_troubleshoot_port_forwarding_sent_queue);
+    mender_troubleshoot_port_forwarding_sent_queue = NULL;
+
     return ret;
 }
 
@@ -371,9 +516,13 @@ static mender_err_t
 mender_troubleshoot_port_forwarding_connect_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_troubleshoot_port_forwarding_error_t    error;
-    mender_troubleshoot_port_forwarding_connect_t *connect = NULL;
-    mender_err_t                                   ret     = MENDER_OK;
+    mender_troubleshoot_port_forwarding_error_t       error;
+    mender_troubleshoot_protomsg_hdr_properties_t     properties;
+    mender_troubleshoot_protomsg_hdr_t                hdr;
+    size_t                                            headroom;
+    mender_troubleshoot_port_forwarding_connect_t    *connect    = NULL;
+    mender_troubleshoot_port_forwarding_connection_t *connection = NULL;
+    mender_err_t                                      ret        = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_port_forwarding_error_t));
@@ -422,30 +571,70 @@ mender_troubleshoot_port_forwarding_connect_message_handler(mender_troubleshoot_
         goto FAIL;
     }
 
-    /* Check is a session is already opened */
-    if ((NULL != mender_troubleshoot_port_forwarding_sid) || (NULL != mender_troubleshoot_port_forwarding_connection_id)) {
-        mender_log_warning("A port forwarding session is already opened");
-        error.description = "A port forwarding session is already opened";
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+
+    /* Check if the connection is already opened and if the maximum number of connections is reached */
+    if (NULL != mender_troubleshoot_port_forwarding_get_connection(protomsg->hdr->properties->connection_id)) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+        mender_log_warning("A port forwarding connection is already opened");
+        error.description = "A port forwarding connection is already opened";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (NULL == (connection = mender_troubleshoot_port_forwarding_get_connection(NULL))) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+        mender_log_warning("Maximum number of port forwarding connections reached");
+        error.description = "Maximum number of port forwarding connections reached";
         ret               = MENDER_FAIL;
         goto FAIL;
     }
 
-    /* Start port forwarding session */
-    mender_log_info("Starting a new port forwarding session");
+    /* Start port forwarding connection */
+    mender_log_info("Starting a new port forwarding connection");
 
-    /* Save the session ID and connection ID */
-    if (NULL == (mender_troubleshoot_port_forwarding_sid = strdup(protomsg->hdr->sid))) {
+    /* Save the session ID and connection ID, the connection is reserved until it is opened */
+    if ((NULL == (connection->sid = mender_strdup(protomsg->hdr->sid)))
+        || (NULL == (connection->connection_id = mender_strdup(protomsg->hdr->properties->connection_id)))) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
         mender_log_error("Unable to allocate memory");
         error.description = "Internal error";
         ret               = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (mender_troubleshoot_port_forwarding_connection_id = strdup(protomsg->hdr->properties->connection_id))) {
+
+    /* Create the header of the port forwarding forward messages, it is reused until the connection is closed */
+    memset(&properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
+    properties.connection_id = connection->connection_id;
+    memset(&hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
+    hdr.proto      = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_PORT_FORWARD;
+    hdr.typ        = MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_FORWARD;
+    hdr.sid        = connection->sid;
+    hdr.properties = &properties;
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_template_create(&hdr, &connection->hdr_template))) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+        mender_log_error("Unable to encode header");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+
+    /* Allocate the buffer of the connection, room is reserved in front of the data so that the forward messages are packed in place */
+    headroom = mender_troubleshoot_protomsg_hdr_template_headroom(&connection->hdr_template);
+    if (NULL == (connection->buffer = (uint8_t *)mender_malloc(headroom + CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE))) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
         mender_log_error("Unable to allocate memory");
         error.description = "Internal error";
         ret               = MENDER_FAIL;
         goto FAIL;
     }
+    connection->data = connection->buffer + headroom;
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
 
     /* Unpack and decode data */
     if (NULL == (connect = mender_troubleshoot_port_forwarding_connect_unpack(protomsg->body->data, protomsg->body->length))) {
@@ -463,11 +652,11 @@ mender_troubleshoot_port_forwarding_connect_message_handler(mender_troubleshoot_
         goto FAIL;
     }
 
-    /* Connect to the remote host */
+    /* Connect to the remote host, the connection handle is saved in the connection so that data can be forwarded immediately */
     if (NULL != mender_troubleshoot_port_forwarding_callbacks.connect) {
         if (MENDER_OK
             != (ret = mender_troubleshoot_port_forwarding_callbacks.connect(
-                    connect->remote_host, connect->remote_port, connect->protocol, &mender_troubleshoot_port_forwarding_handle))) {
+                    connect->remote_host, connect->remote_port, connect->protocol, &connection->handle))) {
             mender_log_error("Unable to connect to '%s:%d' with protocol '%s'", connect->remote_host, connect->remote_port, connect->protocol);
             error.description = "Unable to connect to remote host";
             goto FAIL;
@@ -496,16 +685,12 @@ FAIL:
     /* Release memory */
     mender_troubleshoot_port_forwarding_connect_release(connect);
 
-    /* Release connection ID */
-    if (NULL != mender_troubleshoot_port_forwarding_connection_id) {
-        free(mender_troubleshoot_port_forwarding_connection_id);
-        mender_troubleshoot_port_forwarding_connection_id = NULL;
-    }
-
-    /* Release session ID */
-    if (NULL != mender_troubleshoot_port_forwarding_sid) {
-        free(mender_troubleshoot_port_forwarding_sid);
-        mender_troubleshoot_port_forwarding_sid = NULL;
+    /* Release connection */
+    if (NULL != connection) {
+        mender_troubleshoot_port_forwarding_connection_t copy;
+        if (MENDER_OK == mender_troubleshoot_port_forwarding_detach_connection(connection, &copy)) {
+            mender_troubleshoot_port_forwarding_release_connection(&copy);
+        }
     }
 
     return ret;
@@ -515,27 +700,14 @@ static mender_err_t
 mender_troubleshoot_port_forwarding_close_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_troubleshoot_port_forwarding_error_t error;
-    mender_err_t                                ret = MENDER_OK;
+    mender_troubleshoot_port_forwarding_error_t       error;
+    mender_troubleshoot_port_forwarding_connection_t  connection;
+    mender_troubleshoot_port_forwarding_connection_t *entry;
+    mender_err_t                                      ret = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_port_forwarding_error_t));
-
-    /* Check if a session is already opened */
-    if (NULL == mender_troubleshoot_port_forwarding_sid) {
-        mender_log_error("No port forwarding session opened");
-        error.description = "No port forwarding session opened";
-        ret               = MENDER_FAIL;
-        goto FAIL;
-    }
-
-    /* Check if a connection is already opened */
-    if (NULL == mender_troubleshoot_port_forwarding_connection_id) {
-        mender_log_error("No port forwarding connection opened");
-        error.description = "No port forwarding connection opened";
-        ret               = MENDER_FAIL;
-        goto FAIL;
-    }
+    memset(&connection, 0, sizeof(mender_troubleshoot_port_forwarding_connection_t));
 
     /* Verify integrity of the message */
     if (NULL == protomsg->hdr) {
@@ -569,9 +741,40 @@ mender_troubleshoot_port_forwarding_close_message_handler(mender_troubleshoot_pr
         goto FAIL;
     }
 
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+
+    /* Check if the connection is opened */
+    entry = mender_troubleshoot_port_forwarding_get_connection(protomsg->hdr->properties->connection_id);
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+
+    /* Remove the connection from the connections so that it is not used by the forward functions anymore */
+    if (NULL == entry) {
+        mender_log_error("No port forwarding connection opened");
+        error.description = "No port forwarding connection opened";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_detach_connection(entry, &connection))) {
+        error.description = "Internal error";
+        goto FAIL;
+    }
+    if (NULL == connection.sid) {
+        mender_log_error("No port forwarding connection opened");
+        error.description = "No port forwarding connection opened";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
     /* Close connection to the remote host */
     if (NULL != mender_troubleshoot_port_forwarding_callbacks.close) {
-        if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_callbacks.close(mender_troubleshoot_port_forwarding_handle))) {
+        if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_callbacks.close(connection.handle))) {
             mender_log_error("Unable to close connection");
             error.description = "Unable to close connection";
             goto FAIL;
@@ -585,17 +788,8 @@ mender_troubleshoot_port_forwarding_close_message_handler(mender_troubleshoot_pr
         goto FAIL;
     }
 
-    /* Release connection ID */
-    if (NULL != mender_troubleshoot_port_forwarding_connection_id) {
-        free(mender_troubleshoot_port_forwarding_connection_id);
-        mender_troubleshoot_port_forwarding_connection_id = NULL;
-    }
-
-    /* Release session ID */
-    if (NULL != mender_troubleshoot_port_forwarding_sid) {
-        free(mender_troubleshoot_port_forwarding_sid);
-        mender_troubleshoot_port_forwarding_sid = NULL;
-    }
+    /* Release connection */
+    mender_troubleshoot_port_forwarding_release_connection(&connection);
 
     return ret;
 
@@ -606,6 +800,9 @@ FAIL:
         mender_log_error("Unable to format response");
     }
 
+    /* Release connection */
+    mender_troubleshoot_port_forwarding_release_connection(&connection);
+
     return ret;
 }
 
@@ -613,28 +810,14 @@ static mender_err_t
 mender_troubleshoot_port_forwarding_forward_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_troubleshoot_port_forwarding_error_t error;
-    mender_err_t                                ret = MENDER_OK;
+    mender_troubleshoot_port_forwarding_error_t       error;
+    mender_troubleshoot_port_forwarding_connection_t *connection;
+    void                                             *handle;
+    mender_err_t                                      ret = MENDER_OK;
 
     /* Initialize error message */
     memset(&error, 0, sizeof(mender_troubleshoot_port_forwarding_error_t));
 
-    /* Check if a session is already opened */
-    if (NULL == mender_troubleshoot_port_forwarding_sid) {
-        mender_log_error("No port forwarding session opened");
-        error.description = "No port forwarding session opened";
-        ret               = MENDER_FAIL;
-        goto FAIL;
-    }
-
-    /* Check if a connection is already opened */
-    if (NULL == mender_troubleshoot_port_forwarding_connection_id) {
-        mender_log_error("No port forwarding connection opened");
-        error.description = "No port forwarding connection opened";
-        ret               = MENDER_FAIL;
-        goto FAIL;
-    }
-
     /* Verify integrity of the message */
     if (NULL == protomsg->hdr) {
         mender_log_error("Invalid message received");
@@ -679,11 +862,25 @@ mender_troubleshoot_port_forwarding_forward_message_handler(mender_troubleshoot_
         goto FAIL;
     }
 
-    /* Send data to the remote host */
+    /* Retrieve the connection handle */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        error.description = "Internal error";
+        goto FAIL;
+    }
+    connection = mender_troubleshoot_port_forwarding_get_connection(protomsg->hdr->properties->connection_id);
+    handle     = (NULL != connection) ? connection->handle : NULL;
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+    if (NULL == connection) {
+        mender_log_error("No port forwarding connection opened");
+        error.description = "No port forwarding connection opened";
+        ret               = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Send data to the remote host, the mutex is not taken so that the data forwarded to the server meanwhile is not blocked */
     if (NULL != mender_troubleshoot_port_forwarding_callbacks.send) {
-        if (MENDER_OK
-            != (ret = mender_troubleshoot_port_forwarding_callbacks.send(
-                    mender_troubleshoot_port_forwarding_handle, protomsg->body->data, protomsg->body->length))) {
+        if (MENDER_OK != (ret = mender_troubleshoot_port_forwarding_callbacks.send(handle, protomsg->body->data, protomsg->body->length))) {
             mender_log_error("Unable to send data to remote host");
             error.description = "Unable to send data to remote host";
             goto FAIL;
@@ -750,7 +947,7 @@ mender_troubleshoot_port_forwarding_connect_decode(msgpack_object *object) {
     mender_troubleshoot_port_forwarding_connect_t *connect;
 
     /* Create connect */
-    if (NULL == (connect = (mender_troubleshoot_port_forwarding_connect_t *)malloc(sizeof(mender_troubleshoot_port_forwarding_connect_t)))) {
+    if (NULL == (connect = (mender_troubleshoot_port_forwarding_connect_t *)mender_malloc(sizeof(mender_troubleshoot_port_forwarding_connect_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
@@ -760,7 +957,7 @@ mender_troubleshoot_port_forwarding_connect_decode(msgpack_object *object) {
     msgpack_object_kv *p = object->via.map.ptr;
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "remote_host", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (connect->remote_host = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (connect->remote_host = (char *)mender_malloc(p->val.via.str.size + 1))) {
                 mender_log_error("Unable to allocate memory");
                 goto FAIL;
             }
@@ -771,7 +968,7 @@ mender_troubleshoot_port_forwarding_connect_decode(msgpack_object *object) {
             connect->remote_port = (uint16_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "protocol", p->key.via.str.size))
                    && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (connect->protocol = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (connect->protocol = (char *)mender_malloc(p->val.via.str.size + 1))) {
                 mender_log_error("Unable to allocate memory");
                 goto FAIL;
             }
@@ -797,12 +994,12 @@ mender_troubleshoot_port_forwarding_connect_release(mender_troubleshoot_port_for
     /* Release memory */
     if (NULL != connect) {
         if (NULL != connect->remote_host) {
-            free(connect->remote_host);
+            mender_free(connect->remote_host);
         }
         if (NULL != connect->protocol) {
-            free(connect->protocol);
+            mender_free(connect->protocol);
         }
-        free(connect);
+        mender_free(connect);
     }
 }
 
@@ -814,13 +1011,13 @@ mender_troubleshoot_port_forwarding_format_ack(mender_troubleshoot_protomsg_t *p
     mender_err_t ret = MENDER_OK;
 
     /* Format port forwarding ack message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -828,20 +1025,20 @@ mender_troubleshoot_port_forwarding_format_ack(mender_troubleshoot_protomsg_t *p
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
     if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_FORWARD)) {
-        if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ACK))) {
+        if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ACK))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     } else {
-        if (NULL == ((*response)->hdr->typ = strdup(protomsg->hdr->typ))) {
+        if (NULL == ((*response)->hdr->typ = mender_strdup(protomsg->hdr->typ))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -850,14 +1047,14 @@ mender_troubleshoot_port_forwarding_format_ack(mender_troubleshoot_protomsg_t *p
     if (NULL != protomsg->hdr->properties) {
         if (NULL
             == ((*response)->hdr->properties
-                = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+                = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
         memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
         if (NULL != protomsg->hdr->properties->connection_id) {
-            if (NULL == ((*response)->hdr->properties->connection_id = strdup(protomsg->hdr->properties->connection_id))) {
+            if (NULL == ((*response)->hdr->properties->connection_id = mender_strdup(protomsg->hdr->properties->connection_id))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -886,26 +1083,26 @@ mender_troubleshoot_port_forwarding_format_error(mender_troubleshoot_protomsg_t
     mender_err_t ret = MENDER_OK;
 
     /* Format port forwarding error message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ERROR))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_ERROR))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -914,21 +1111,21 @@ mender_troubleshoot_port_forwarding_format_error(mender_troubleshoot_protomsg_t
     if (NULL != protomsg->hdr->properties) {
         if (NULL
             == ((*response)->hdr->properties
-                = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+                = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
         memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
         if (NULL != protomsg->hdr->properties->user_id) {
-            if (NULL == ((*response)->hdr->properties->user_id = strdup(protomsg->hdr->properties->user_id))) {
+            if (NULL == ((*response)->hdr->properties->user_id = mender_strdup(protomsg->hdr->properties->user_id))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
             }
         }
     }
-    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
+    if (NULL == ((*response)->body = (mender_troubleshoot_protomsg_body_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -1006,7 +1203,7 @@ mender_troubleshoot_port_forwarding_error_message_encode(mender_troubleshoot_por
     if (0 == (object->via.map.size = ((NULL != error->description) ? 1 : 0) + ((NULL != error->type) ? 1 : 0))) {
         goto END;
     }
-    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)mender_malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -1016,7 +1213,7 @@ mender_troubleshoot_port_forwarding_error_message_encode(mender_troubleshoot_por
     p = object->via.map.ptr;
     if (NULL != error->description) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("err"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("err"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1024,7 +1221,7 @@ mender_troubleshoot_port_forwarding_error_message_encode(mender_troubleshoot_por
         p->key.via.str.size = (uint32_t)strlen("err");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = (uint32_t)strlen(error->description);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1034,7 +1231,7 @@ mender_troubleshoot_port_forwarding_error_message_encode(mender_troubleshoot_por
     }
     if (NULL != error->type) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("msgtype"))) {
+        if (NULL == (p->key.via.str.ptr = mender_strdup("msgtype"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1042,7 +1239,7 @@ mender_troubleshoot_port_forwarding_error_message_encode(mender_troubleshoot_por
         p->key.via.str.size = (uint32_t)strlen("msgtype");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = (uint32_t)strlen(error->type);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1057,8 +1254,194 @@ FAIL:
     return ret;
 }
 
+static mender_troubleshoot_port_forwarding_connection_t *
+mender_troubleshoot_port_forwarding_get_connection(char *connection_id) {
+
+    /* Search the connection, or a connection not used */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS; index++) {
+        mender_troubleshoot_port_forwarding_connection_t *connection = &mender_troubleshoot_port_forwarding_connections[index];
+        if (NULL == connection_id) {
+            if (NULL == connection->sid) {
+                return connection;
+            }
+        } else if ((NULL != connection->sid) && (!strcmp(connection->connection_id, connection_id))) {
+            return connection;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+mender_troubleshoot_port_forwarding_release_connection(mender_troubleshoot_port_forwarding_connection_t *connection) {
+
+    assert(NULL != connection);
+
+    /* Release memory */
+    mender_free(connection->sid);
+    mender_free(connection->connection_id);
+    mender_troubleshoot_protomsg_hdr_template_release(&connection->hdr_template);
+    mender_free(connection->buffer);
+    memset(connection, 0, sizeof(mender_troubleshoot_port_forwarding_connection_t));
+
+    /* Release the pack buffers, they are allocated again by the next session */
+    mender_troubleshoot_api_buffer_release();
+}
+
+static mender_troubleshoot_port_forwarding_connection_t *
+mender_troubleshoot_port_forwarding_get_connection_by_handle(void *handle) {
+
+    /* Search the connection */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS; index++) {
+        mender_troubleshoot_port_forwarding_connection_t *connection = &mender_troubleshoot_port_forwarding_connections[index];
+        if ((NULL != connection->sid) && (handle == connection->handle)) {
+            return connection;
+        }
+    }
+
+    return NULL;
+}
+
+static mender_err_t
+mender_troubleshoot_port_forwarding_detach_connection(mender_troubleshoot_port_forwarding_connection_t *entry,
+                                                      mender_troubleshoot_port_forwarding_connection_t *connection) {
+
+    assert(NULL != entry);
+    assert(NULL != connection);
+
+    /* Take mutex used to send the rounds of forward messages, the buffer of the connection may be being sent */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_send_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return MENDER_FAIL;
+    }
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1)) {
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_send_mutex);
+        mender_log_error("Unable to take mutex");
+        return MENDER_FAIL;
+    }
+
+    /* Remove the connection from the connections */
+    memcpy(connection, entry, sizeof(mender_troubleshoot_port_forwarding_connection_t));
+    memset(entry, 0, sizeof(mender_troubleshoot_port_forwarding_connection_t));
+
+    /* Release mutexes */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_send_mutex);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_troubleshoot_port_forwarding_send_round(void) {
+
+    mender_troubleshoot_port_forwarding_connection_t *connection;
+    void                                             *stalled[CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS];
+    size_t                                            count = 0;
+    size_t                                            first;
+    void                                             *payload;
+    size_t                                            length;
+    mender_err_t                                      ret;
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* The next round is started with the following connection */
+    first                                    = mender_troubleshoot_port_forwarding_next;
+    mender_troubleshoot_port_forwarding_next = (first + 1) % CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS;
+
+    /* Send the data pending of each connection in turn */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS; index++) {
+        connection = &mender_troubleshoot_port_forwarding_connections[(first + index) % CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_MAX_CONNECTIONS];
+        if ((NULL == connection->sid) || (0 == connection->length)) {
+            continue;
+        }
+
+        /* Pack the message in place, the header is packed in the room reserved in front of the data pending */
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_protomsg_hdr_template_prepend(
+                    &connection->hdr_template, 0, connection->data, connection->length, &payload, &length))) {
+            mender_log_error("Unable to encode message");
+            connection->length = 0;
+            continue;
+        }
+
+        /* Send message, the mutex is released so that the data can be added to the buffers of the other connections meanwhile */
+        connection->sending = true;
+        mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+        if (MENDER_OK
+            == (ret = mender_troubleshoot_api_send(
+                    payload, length, MENDER_TROUBLESHOOT_API_LANE_BULK, -1, &mender_troubleshoot_port_forwarding_sent_callback, NULL))) {
+            mender_scheduler_queue_receive(mender_troubleshoot_port_forwarding_sent_queue, &ret, -1);
+        }
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to send message");
+        }
+        if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_mutex, -1)) {
+            mender_log_error("Unable to take mutex");
+            return MENDER_FAIL;
+        }
+
+        /* The data pending is released from the buffer, the connection can not be closed meanwhile because the send mutex is taken */
+        connection->sending = false;
+        connection->length  = 0;
+        if (true == connection->stalled) {
+            connection->stalled = false;
+            stalled[count++]    = connection->handle;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_mutex);
+
+    /* Invoke port forwarding credits callback, the stalled connections can forward data again */
+    if (NULL != mender_troubleshoot_port_forwarding_callbacks.credits) {
+        for (size_t index = 0; index < count; index++) {
+            if (MENDER_OK
+                != mender_troubleshoot_port_forwarding_callbacks.credits(stalled[index], CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING_BUFFER_SIZE)) {
+                mender_log_error("An error occured");
+            }
+        }
+    }
+
+    return ret;
+}
+
+static void
+mender_troubleshoot_port_forwarding_sent_callback(mender_err_t result, void *params) {
+
+    (void)params;
+
+    /* Wake up the round waiting for the end of the send */
+    mender_scheduler_queue_send(mender_troubleshoot_port_forwarding_sent_queue, &result, -1);
+}
+
+static mender_err_t
+mender_troubleshoot_port_forwarding_send(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to send the rounds of forward messages */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_port_forwarding_send_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Send a round of forward messages */
+    ret = mender_troubleshoot_port_forwarding_send_round();
+
+    /* Release mutex used to send the rounds of forward messages */
+    mender_scheduler_mutex_give(mender_troubleshoot_port_forwarding_send_mutex);
+
+    return ret;
+}
+
 static mender_err_t
-mender_troubleshoot_port_forwarding_send_stop(void) {
+mender_troubleshoot_port_forwarding_send_stop(mender_troubleshoot_port_forwarding_connection_t *connection) {
 
     mender_troubleshoot_protomsg_t *protomsg = NULL;
     mender_err_t                    ret      = MENDER_OK;
@@ -1066,39 +1449,41 @@ mender_troubleshoot_port_forwarding_send_stop(void) {
     size_t                          length   = 0;
 
     /* Send port forwarding close message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     protomsg->hdr->proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_PORT_FORWARD;
-    if (NULL == (protomsg->hdr->typ = strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_STOP))) {
+    if (NULL == (protomsg->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_PORT_FORWARD_MESSAGE_TYPE_STOP))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL != mender_troubleshoot_port_forwarding_sid) {
-        if (NULL == (protomsg->hdr->sid = strdup(mender_troubleshoot_port_forwarding_sid))) {
+    if (NULL != connection->sid) {
+        if (NULL == (protomsg->hdr->sid = mender_strdup(connection->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     }
-    if (NULL == (protomsg->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+    if (NULL
+        == (protomsg->hdr->properties
+            = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
-    if (NULL != mender_troubleshoot_port_forwarding_connection_id) {
-        if (NULL == (protomsg->hdr->properties->connection_id = strdup(mender_troubleshoot_port_forwarding_connection_id))) {
+    if (NULL != connection->connection_id) {
+        if (NULL == (protomsg->hdr->properties->connection_id = mender_strdup(connection->connection_id))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -1111,8 +1496,10 @@ mender_troubleshoot_port_forwarding_send_stop(void) {
         goto FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
+    /* Send message, the pack buffer is given back once it has been sent */
+    ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_CONTROL, -1, NULL, NULL);
+    payload = NULL;
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to send message");
         goto FAIL;
     }
@@ -1122,7 +1509,7 @@ FAIL:
     /* Release memory */
     mender_troubleshoot_protomsg_release(protomsg);
     if (NULL != payload) {
-        free(payload);
+        mender_troubleshoot_api_buffer_give(payload);
     }
 
     return ret;
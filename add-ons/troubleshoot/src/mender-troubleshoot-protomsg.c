@@ -17,73 +17,137 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include <assert.h>
 #include "mender-log.h"
+#include "mender-troubleshoot-api.h"
 #include "mender-troubleshoot-msgpack.h"
 #include "mender-troubleshoot-protomsg.h"
 #include <stdlib.h>
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 
+/**
+ * @brief Size of a packed fixed size int64 (bytes)
+ */
+#define MENDER_TROUBLESHOOT_PROTOMSG_FIX_INT64_SIZE (9)
+
+/**
+ * @brief Maximum size of the packed map of the proto message, of the packed body key and of the packed header of the body (bytes)
+ */
+#define MENDER_TROUBLESHOOT_PROTOMSG_MAP_SIZE      (1)
+#define MENDER_TROUBLESHOOT_PROTOMSG_BODY_KEY_SIZE (5)
+#define MENDER_TROUBLESHOOT_PROTOMSG_BIN_SIZE      (5)
+
+/**
+ * @brief Maximum number of protos registered
+ */
+#define MENDER_TROUBLESHOOT_PROTOMSG_PROTO_COUNT (8)
+
+/**
+ * @brief Protos registered, NULL if the entry is not used
+ */
+static const mender_troubleshoot_protomsg_proto_t *mender_troubleshoot_protomsg_protos[MENDER_TROUBLESHOOT_PROTOMSG_PROTO_COUNT];
+
+/**
+ * @brief Write packed data to the sbuffer, it is backed by a pack buffer of the troubleshoot API
+ * @param data msgpack sbuffer
+ * @param buf Packed data
+ * @param len Length of the packed data
+ * @return 0 if the function succeeds, -1 otherwise
+ */
+static int mender_troubleshoot_protomsg_sbuffer_write(void *data, const char *buf, size_t len);
+
 /**
  * @brief Encode proto message
  * @param protomsg Proto message
- * @param p Object key-value
+ * @param packer msgpack packer
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_troubleshoot_protomsg_encode(mender_troubleshoot_protomsg_t *protomsg, msgpack_object *object);
+static mender_err_t mender_troubleshoot_protomsg_encode(mender_troubleshoot_protomsg_t *protomsg, msgpack_packer *packer);
 
 /**
  * @brief Encode proto message header
  * @param hdr Proto message header
- * @param p Object key-value
+ * @param packer msgpack packer
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_troubleshoot_protomsg_hdr_encode(mender_troubleshoot_protomsg_hdr_t *hdr, msgpack_object_kv *p);
+static mender_err_t mender_troubleshoot_protomsg_hdr_encode(mender_troubleshoot_protomsg_hdr_t *hdr, msgpack_packer *packer);
 
 /**
  * @brief Encode proto message header properties
  * @param properties Proto message header properties
- * @param p Object key-value
+ * @param packer msgpack packer
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_troubleshoot_protomsg_hdr_properties_encode(mender_troubleshoot_protomsg_hdr_properties_t *properties, msgpack_object_kv *p);
+static mender_err_t mender_troubleshoot_protomsg_hdr_properties_encode(mender_troubleshoot_protomsg_hdr_properties_t *properties, msgpack_packer *packer);
 
 /**
  * @brief Encode proto message body
  * @param body Proto message body
- * @param p Object key-value
+ * @param packer msgpack packer
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_protomsg_body_encode(mender_troubleshoot_protomsg_body_t *body, msgpack_packer *packer);
+
+/**
+ * @brief Encode string
+ * @param str String
+ * @param packer msgpack packer
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_troubleshoot_protomsg_body_encode(mender_troubleshoot_protomsg_body_t *body, msgpack_object_kv *p);
+static mender_err_t mender_troubleshoot_protomsg_str_encode(const char *str, msgpack_packer *packer);
 
 /**
  * @brief Decode proto message object
+ * @param zone msgpack zone the proto message is allocated from
  * @param object Proto message object
  * @return Proto message if the function succeeds, NULL otherwise
  */
-static mender_troubleshoot_protomsg_t *mender_troubleshoot_protomsg_decode(msgpack_object *object);
+static mender_troubleshoot_protomsg_t *mender_troubleshoot_protomsg_decode(msgpack_zone *zone, msgpack_object *object);
 
 /**
  * @brief Decode proto message header object
+ * @param zone msgpack zone the proto header is allocated from
  * @param object Proto message header object
  * @return Proto header if the function succeeds, NULL otherwise
  */
-static mender_troubleshoot_protomsg_hdr_t *mender_troubleshoot_protomsg_hdr_decode(msgpack_object *object);
+static mender_troubleshoot_protomsg_hdr_t *mender_troubleshoot_protomsg_hdr_decode(msgpack_zone *zone, msgpack_object *object);
 
 /**
  * @brief Decode proto message header properties object
+ * @param zone msgpack zone the proto header properties are allocated from
  * @param object Proto message header properties object
  * @return Proto header properties if the function succeeds, NULL otherwise
  */
-static mender_troubleshoot_protomsg_hdr_properties_t *mender_troubleshoot_protomsg_hdr_properties_decode(msgpack_object *object);
+static mender_troubleshoot_protomsg_hdr_properties_t *mender_troubleshoot_protomsg_hdr_properties_decode(msgpack_zone *zone, msgpack_object *object);
 
 /**
- * @brief Decode proto message body object
+ * @brief Decode proto message body object, the data is not copied
+ * @param zone msgpack zone the body is allocated from
  * @param object Proto message body object
  * @return Body if the function succeeds, NULL otherwise
  */
-static mender_troubleshoot_protomsg_body_t *mender_troubleshoot_protomsg_body_decode(msgpack_object *object);
+static mender_troubleshoot_protomsg_body_t *mender_troubleshoot_protomsg_body_decode(msgpack_zone *zone, msgpack_object *object);
+
+/**
+ * @brief Decode string object
+ * @param zone msgpack zone the string is allocated from
+ * @param object String object
+ * @return String with a NUL terminator if the function succeeds, NULL otherwise
+ */
+static char *mender_troubleshoot_protomsg_str_decode(msgpack_zone *zone, msgpack_object *object);
+
+/**
+ * @brief Resolve the message type of a proto message header among the ones of the protos registered
+ * @param hdr Proto message header
+ * @return Message type if it is registered, NULL otherwise
+ */
+static const mender_troubleshoot_protomsg_type_t *mender_troubleshoot_protomsg_hdr_type_resolve(mender_troubleshoot_protomsg_hdr_t *hdr);
 
 /**
  * @brief Release proto message header
@@ -103,340 +167,456 @@ static void mender_troubleshoot_protomsg_hdr_properties_release(mender_troublesh
  */
 static void mender_troubleshoot_protomsg_body_release(mender_troubleshoot_protomsg_body_t *body);
 
+mender_err_t
+mender_troubleshoot_protomsg_register(const mender_troubleshoot_protomsg_proto_t *proto) {
+
+    assert(NULL != proto);
+    assert((NULL != proto->types) || (0 == proto->count));
+    const mender_troubleshoot_protomsg_proto_t **entry = NULL;
+
+    /* Search for the proto, it is replaced if it is already registered, or for a free entry */
+    for (size_t index = 0; index < MENDER_TROUBLESHOOT_PROTOMSG_PROTO_COUNT; index++) {
+        if ((NULL != mender_troubleshoot_protomsg_protos[index]) && (proto->proto == mender_troubleshoot_protomsg_protos[index]->proto)) {
+            entry = &mender_troubleshoot_protomsg_protos[index];
+            break;
+        } else if ((NULL == mender_troubleshoot_protomsg_protos[index]) && (NULL == entry)) {
+            entry = &mender_troubleshoot_protomsg_protos[index];
+        }
+    }
+    if (NULL == entry) {
+        mender_log_error("Unable to register proto type 0x%04x, too many protos registered", proto->proto);
+        return MENDER_FAIL;
+    }
+    *entry = proto;
+
+    return MENDER_OK;
+}
+
+void
+mender_troubleshoot_protomsg_unregister(mender_troubleshoot_protomsg_hdr_proto_t proto) {
+
+    /* Release the entry of the proto */
+    for (size_t index = 0; index < MENDER_TROUBLESHOOT_PROTOMSG_PROTO_COUNT; index++) {
+        if ((NULL != mender_troubleshoot_protomsg_protos[index]) && (proto == mender_troubleshoot_protomsg_protos[index]->proto)) {
+            mender_troubleshoot_protomsg_protos[index] = NULL;
+        }
+    }
+}
+
 mender_err_t
 mender_troubleshoot_protomsg_pack(mender_troubleshoot_protomsg_t *protomsg, void **data, size_t *length) {
 
     assert(NULL != protomsg);
     assert(NULL != data);
     assert(NULL != length);
-    mender_err_t   ret = MENDER_OK;
-    msgpack_object object;
+    mender_err_t    ret;
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
 
-    /* Encode protomsg */
-    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_encode(protomsg, &object))) {
-        mender_log_error("Invalid protomsg object");
-        goto FAIL;
+    /* Initialize msgpack packer, the sbuffer uses a pack buffer which is reused for all the messages */
+    msgpack_sbuffer_init(&sbuffer);
+    if (NULL == (sbuffer.data = (char *)mender_troubleshoot_api_buffer_take(&sbuffer.alloc))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
     }
+    msgpack_packer_init(&packer, &sbuffer, mender_troubleshoot_protomsg_sbuffer_write);
 
-    /* Pack protomsg */
-    if (MENDER_OK != (ret = mender_troubleshoot_msgpack_pack_object(&object, data, length))) {
+    /* Pack protomsg, it is written directly to the sbuffer */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_encode(protomsg, &packer))) {
         mender_log_error("Unable to pack protomsg object");
         goto FAIL;
     }
 
-    /* Release memory */
-    mender_troubleshoot_msgpack_release_object(&object);
+    /* Return sbuffer data and size */
+    *data   = sbuffer.data;
+    *length = sbuffer.size;
 
     return ret;
 
 FAIL:
 
     /* Release memory */
-    mender_troubleshoot_msgpack_release_object(&object);
+    mender_troubleshoot_api_buffer_give(sbuffer.data);
 
     return ret;
 }
 
-static mender_err_t
-mender_troubleshoot_protomsg_encode(mender_troubleshoot_protomsg_t *protomsg, msgpack_object *object) {
+mender_err_t
+mender_troubleshoot_protomsg_hdr_template_create(mender_troubleshoot_protomsg_hdr_t *hdr, mender_troubleshoot_protomsg_hdr_template_t *hdr_template) {
 
-    assert(NULL != protomsg);
-    assert(NULL != object);
-    mender_err_t       ret = MENDER_OK;
-    msgpack_object_kv *p;
+    assert(NULL != hdr);
+    assert(NULL != hdr_template);
+    mender_err_t    ret;
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
 
-    /* Create protomsg */
-    object->type = MSGPACK_OBJECT_MAP;
-    if (0 == (object->via.map.size = ((NULL != protomsg->hdr) ? 1 : 0) + ((NULL != protomsg->body) ? 1 : 0))) {
+    memset(hdr_template, 0, sizeof(mender_troubleshoot_protomsg_hdr_template_t));
+
+    /* Initialize msgpack packer */
+    msgpack_sbuffer_init(&sbuffer);
+    if (NULL == (sbuffer.data = (char *)mender_troubleshoot_api_buffer_take(&sbuffer.alloc))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    msgpack_packer_init(&packer, &sbuffer, mender_troubleshoot_protomsg_sbuffer_write);
+
+    /* Pack header */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_encode(hdr, &packer))) {
+        mender_log_error("Unable to encode header");
         goto END;
     }
-    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
+
+    /* Save the header, the offset is the last field and it has a fixed size so that its value is packed with each message */
+    hdr_template->offset = ((NULL != hdr->properties) && (NULL != hdr->properties->offset)) ? true : false;
+    hdr_template->length = sbuffer.size - ((true == hdr_template->offset) ? MENDER_TROUBLESHOOT_PROTOMSG_FIX_INT64_SIZE : 0);
+    if (NULL == (hdr_template->data = mender_malloc(hdr_template->length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
+        goto END;
+    }
+    memcpy(hdr_template->data, sbuffer.data, hdr_template->length);
+
+END:
+
+    /* Release memory */
+    mender_troubleshoot_api_buffer_give(sbuffer.data);
+
+    return ret;
+}
+
+mender_err_t
+mender_troubleshoot_protomsg_hdr_template_pack(
+    mender_troubleshoot_protomsg_hdr_template_t *hdr_template, size_t offset, void *body, size_t body_length, void **data, size_t *length) {
+
+    assert(NULL != hdr_template);
+    assert(NULL != hdr_template->data);
+    assert(NULL != data);
+    assert(NULL != length);
+    mender_troubleshoot_protomsg_body_t protomsg_body = { .data = body, .length = body_length };
+    msgpack_sbuffer                     sbuffer;
+    msgpack_packer                      packer;
+
+    /* Initialize msgpack packer, the sbuffer uses a pack buffer which is reused for all the messages */
+    msgpack_sbuffer_init(&sbuffer);
+    if (NULL == (sbuffer.data = (char *)mender_troubleshoot_api_buffer_take(&sbuffer.alloc))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    msgpack_packer_init(&packer, &sbuffer, mender_troubleshoot_protomsg_sbuffer_write);
+
+    /* Pack protomsg, the header is copied from the template */
+    if ((0 != msgpack_pack_map(&packer, ((NULL != body) && (0 != body_length)) ? 2 : 1))
+        || (0 != mender_troubleshoot_protomsg_sbuffer_write(&sbuffer, hdr_template->data, hdr_template->length))) {
+        mender_log_error("Unable to pack header");
+        goto FAIL;
+    }
+    if ((true == hdr_template->offset) && (0 != msgpack_pack_fix_int64(&packer, (int64_t)offset))) {
+        mender_log_error("Unable to pack header");
         goto FAIL;
     }
+    if ((NULL != body) && (0 != body_length)) {
+        if (MENDER_OK != mender_troubleshoot_protomsg_body_encode(&protomsg_body, &packer)) {
+            mender_log_error("Unable to encode body");
+            goto FAIL;
+        }
+    }
+
+    /* Return sbuffer data and size */
+    *data   = sbuffer.data;
+    *length = sbuffer.size;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_troubleshoot_api_buffer_give(sbuffer.data);
+
+    return MENDER_FAIL;
+}
+
+size_t
+mender_troubleshoot_protomsg_hdr_template_headroom(mender_troubleshoot_protomsg_hdr_template_t *hdr_template) {
+
+    assert(NULL != hdr_template);
+
+    /* Map, header, offset of the header and body key and header */
+    return MENDER_TROUBLESHOOT_PROTOMSG_MAP_SIZE + hdr_template->length + ((true == hdr_template->offset) ? MENDER_TROUBLESHOOT_PROTOMSG_FIX_INT64_SIZE : 0)
+           + MENDER_TROUBLESHOOT_PROTOMSG_BODY_KEY_SIZE + MENDER_TROUBLESHOOT_PROTOMSG_BIN_SIZE;
+}
+
+mender_err_t
+mender_troubleshoot_protomsg_hdr_template_prepend(
+    mender_troubleshoot_protomsg_hdr_template_t *hdr_template, size_t offset, void *body, size_t body_length, void **data, size_t *length) {
+
+    assert(NULL != hdr_template);
+    assert(NULL != hdr_template->data);
+    assert(NULL != body);
+    assert(0 != body_length);
+    assert(NULL != data);
+    assert(NULL != length);
+    char            map[MENDER_TROUBLESHOOT_PROTOMSG_MAP_SIZE];
+    char            tail[MENDER_TROUBLESHOOT_PROTOMSG_FIX_INT64_SIZE + MENDER_TROUBLESHOOT_PROTOMSG_BODY_KEY_SIZE + MENDER_TROUBLESHOOT_PROTOMSG_BIN_SIZE];
+    msgpack_sbuffer map_sbuffer  = { .size = 0, .data = map, .alloc = sizeof(map) };
+    msgpack_sbuffer tail_sbuffer = { .size = 0, .data = tail, .alloc = sizeof(tail) };
+    msgpack_packer  packer;
+    uint8_t        *ptr;
+
+    /* Pack the map, it is the first field and it is followed by the header */
+    msgpack_packer_init(&packer, &map_sbuffer, msgpack_sbuffer_write);
+    if (0 != msgpack_pack_map(&packer, 2)) {
+        mender_log_error("Unable to pack header");
+        return MENDER_FAIL;
+    }
+
+    /* Pack the offset of the header and the key and header of the body, the sbuffers are large enough so that they are never reallocated */
+    msgpack_packer_init(&packer, &tail_sbuffer, msgpack_sbuffer_write);
+    if ((true == hdr_template->offset) && (0 != msgpack_pack_fix_int64(&packer, (int64_t)offset))) {
+        mender_log_error("Unable to pack header");
+        return MENDER_FAIL;
+    }
+    if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("body", &packer)) || (0 != msgpack_pack_bin(&packer, body_length))) {
+        mender_log_error("Unable to pack body");
+        return MENDER_FAIL;
+    }
+
+    /* Copy the packed data in front of the body */
+    *length = map_sbuffer.size + hdr_template->length + tail_sbuffer.size;
+    ptr     = (uint8_t *)body - *length;
+    memcpy(ptr, map_sbuffer.data, map_sbuffer.size);
+    memcpy(ptr + map_sbuffer.size, hdr_template->data, hdr_template->length);
+    memcpy(ptr + map_sbuffer.size + hdr_template->length, tail_sbuffer.data, tail_sbuffer.size);
+    *data = ptr;
+    *length += body_length;
+
+    return MENDER_OK;
+}
+
+void
+mender_troubleshoot_protomsg_hdr_template_release(mender_troubleshoot_protomsg_hdr_template_t *hdr_template) {
+
+    /* Release memory */
+    if (NULL != hdr_template) {
+        mender_free(hdr_template->data);
+        memset(hdr_template, 0, sizeof(mender_troubleshoot_protomsg_hdr_template_t));
+    }
+}
+
+static int
+mender_troubleshoot_protomsg_sbuffer_write(void *data, const char *buf, size_t len) {
+
+    assert(NULL != data);
+    msgpack_sbuffer *sbuffer = (msgpack_sbuffer *)data;
+
+    /* Grow the pack buffer if the packed data does not fit */
+    if (sbuffer->alloc - sbuffer->size < len) {
+        size_t alloc = (2 * sbuffer->alloc > sbuffer->size + len) ? 2 * sbuffer->alloc : sbuffer->size + len;
+        char  *tmp;
+        if (NULL == (tmp = (char *)mender_troubleshoot_api_buffer_grow(sbuffer->data, alloc))) {
+            return -1;
+        }
+        sbuffer->data  = tmp;
+        sbuffer->alloc = alloc;
+    }
+
+    /* Copy packed data */
+    memcpy(sbuffer->data + sbuffer->size, buf, len);
+    sbuffer->size += len;
+
+    return 0;
+}
+
+static mender_err_t
+mender_troubleshoot_protomsg_encode(mender_troubleshoot_protomsg_t *protomsg, msgpack_packer *packer) {
+
+    assert(NULL != protomsg);
+    assert(NULL != packer);
+    mender_err_t ret;
+
+    /* Create protomsg */
+    if (0 != msgpack_pack_map(packer, ((NULL != protomsg->hdr) ? 1 : 0) + ((NULL != protomsg->body) ? 1 : 0))) {
+        mender_log_error("Unable to pack protomsg");
+        return MENDER_FAIL;
+    }
 
     /* Parse protomsg */
-    p = object->via.map.ptr;
     if (NULL != protomsg->hdr) {
-        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_encode(protomsg->hdr, p))) {
+        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_encode(protomsg->hdr, packer))) {
             mender_log_error("Unable to encode header");
-            goto FAIL;
+            return ret;
         }
-        ++p;
     }
     if (NULL != protomsg->body) {
-        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_body_encode(protomsg->body, p))) {
+        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_body_encode(protomsg->body, packer))) {
             mender_log_error("Unable to encode body");
-            goto FAIL;
+            return ret;
         }
     }
 
-END:
-FAIL:
-
-    return ret;
+    return MENDER_OK;
 }
 
 static mender_err_t
-mender_troubleshoot_protomsg_hdr_encode(mender_troubleshoot_protomsg_hdr_t *hdr, msgpack_object_kv *p) {
+mender_troubleshoot_protomsg_hdr_encode(mender_troubleshoot_protomsg_hdr_t *hdr, msgpack_packer *packer) {
 
     assert(NULL != hdr);
-    assert(NULL != p);
+    assert(NULL != packer);
     mender_err_t ret = MENDER_OK;
 
     /* Create header */
-    p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("hdr"))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    p->key.via.str.size = (uint32_t)strlen("hdr");
-    p->val.type         = MSGPACK_OBJECT_MAP;
-    if (0 == (p->val.via.map.size = 1 + ((NULL != hdr->typ) ? 1 : 0) + ((NULL != hdr->sid) ? 1 : 0) + ((NULL != hdr->properties) ? 1 : 0))) {
-        goto END;
-    }
-    if (NULL == (p->val.via.map.ptr = (msgpack_object_kv *)malloc(p->val.via.map.size * sizeof(struct msgpack_object_kv)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    if ((MENDER_OK != (ret = mender_troubleshoot_protomsg_str_encode("hdr", packer)))
+        || (0 != msgpack_pack_map(packer, 1 + ((NULL != hdr->typ) ? 1 : 0) + ((NULL != hdr->sid) ? 1 : 0) + ((NULL != hdr->properties) ? 1 : 0)))) {
         goto FAIL;
     }
 
     /* Parse header */
-    p           = p->val.via.map.ptr;
-    p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("proto"))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    if ((MENDER_OK != (ret = mender_troubleshoot_protomsg_str_encode("proto", packer))) || (0 != msgpack_pack_uint64(packer, hdr->proto))) {
         goto FAIL;
     }
-    p->key.via.str.size = (uint32_t)strlen("proto");
-    p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
-    p->val.via.u64      = hdr->proto;
-    ++p;
     if (NULL != hdr->typ) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("typ"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != (ret = mender_troubleshoot_protomsg_str_encode("typ", packer)))
+            || (MENDER_OK != (ret = mender_troubleshoot_protomsg_str_encode(hdr->typ, packer)))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("typ");
-        p->val.type         = MSGPACK_OBJECT_STR;
-        p->val.via.str.size = (uint32_t)strlen(hdr->typ);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memcpy((void *)p->val.via.str.ptr, hdr->typ, p->val.via.str.size);
-        ++p;
     }
     if (NULL != hdr->sid) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("sid"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        p->key.via.str.size = (uint32_t)strlen("sid");
-        p->val.type         = MSGPACK_OBJECT_STR;
-        p->val.via.str.size = (uint32_t)strlen(hdr->sid);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != (ret = mender_troubleshoot_protomsg_str_encode("sid", packer)))
+            || (MENDER_OK != (ret = mender_troubleshoot_protomsg_str_encode(hdr->sid, packer)))) {
             goto FAIL;
         }
-        memcpy((void *)p->val.via.str.ptr, hdr->sid, p->val.via.str.size);
-        ++p;
     }
     if (NULL != hdr->properties) {
-        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_properties_encode(hdr->properties, p))) {
+        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_properties_encode(hdr->properties, packer))) {
             mender_log_error("Unable to encode header properties");
-            goto FAIL;
+            return ret;
         }
     }
 
-END:
+    return ret;
+
 FAIL:
 
-    return ret;
+    mender_log_error("Unable to pack header");
+
+    return MENDER_FAIL;
 }
 
 static mender_err_t
-mender_troubleshoot_protomsg_hdr_properties_encode(mender_troubleshoot_protomsg_hdr_properties_t *properties, msgpack_object_kv *p) {
+mender_troubleshoot_protomsg_hdr_properties_encode(mender_troubleshoot_protomsg_hdr_properties_t *properties, msgpack_packer *packer) {
 
     assert(NULL != properties);
-    assert(NULL != p);
-    mender_err_t ret = MENDER_OK;
+    assert(NULL != packer);
 
     /* Create properties */
-    p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("props"))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    p->key.via.str.size = (uint32_t)strlen("props");
-    p->val.type         = MSGPACK_OBJECT_MAP;
-    if (0
-        == (p->val.via.map.size = ((NULL != properties->terminal_width) ? 1 : 0) + ((NULL != properties->terminal_height) ? 1 : 0)
-                                  + ((NULL != properties->connection_id) ? 1 : 0) + ((NULL != properties->user_id) ? 1 : 0)
-                                  + ((NULL != properties->timeout) ? 1 : 0) + ((NULL != properties->status) ? 1 : 0)
-                                  + ((NULL != properties->offset) ? 1 : 0))) {
-        goto END;
-    }
-    if (NULL == (p->val.via.map.ptr = (msgpack_object_kv *)malloc(p->val.via.map.size * sizeof(struct msgpack_object_kv)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("props", packer))
+        || (0
+            != msgpack_pack_map(packer,
+                                ((NULL != properties->terminal_width) ? 1 : 0) + ((NULL != properties->terminal_height) ? 1 : 0)
+                                    + ((NULL != properties->connection_id) ? 1 : 0) + ((NULL != properties->user_id) ? 1 : 0)
+                                    + ((NULL != properties->timeout) ? 1 : 0) + ((NULL != properties->status) ? 1 : 0)
+                                    + ((NULL != properties->offset) ? 1 : 0)))) {
         goto FAIL;
     }
 
     /* Parse properties */
-    p = p->val.via.map.ptr;
     if (NULL != properties->terminal_width) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("terminal_width"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("terminal_width", packer))
+            || (0 != msgpack_pack_uint64(packer, *properties->terminal_width))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("terminal_width");
-        p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
-        p->val.via.u64      = *properties->terminal_width;
-        ++p;
     }
     if (NULL != properties->terminal_height) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("terminal_height"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("terminal_height", packer))
+            || (0 != msgpack_pack_uint64(packer, *properties->terminal_height))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("terminal_height");
-        p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
-        p->val.via.u64      = *properties->terminal_height;
-        ++p;
     }
     if (NULL != properties->connection_id) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("connection_id"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("connection_id", packer))
+            || (MENDER_OK != mender_troubleshoot_protomsg_str_encode(properties->connection_id, packer))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("connection_id");
-        p->val.type         = MSGPACK_OBJECT_STR;
-        p->val.via.str.size = (uint32_t)strlen(properties->connection_id);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memcpy((void *)p->val.via.str.ptr, properties->connection_id, p->val.via.str.size);
-        ++p;
     }
     if (NULL != properties->user_id) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("user_id"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("user_id", packer))
+            || (MENDER_OK != mender_troubleshoot_protomsg_str_encode(properties->user_id, packer))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("user_id");
-        p->val.type         = MSGPACK_OBJECT_STR;
-        p->val.via.str.size = (uint32_t)strlen(properties->user_id);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memcpy((void *)p->val.via.str.ptr, properties->user_id, p->val.via.str.size);
-        ++p;
     }
     if (NULL != properties->timeout) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("timeout"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("timeout", packer)) || (0 != msgpack_pack_uint64(packer, *properties->timeout))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("timeout");
-        p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
-        p->val.via.u64      = *properties->timeout;
-        ++p;
     }
     if (NULL != properties->status) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("status"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("status", packer)) || (0 != msgpack_pack_uint64(packer, *properties->status))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("status");
-        p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
-        p->val.via.u64      = *properties->status;
-        ++p;
     }
     if (NULL != properties->offset) {
-        p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("offset"))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+        /* Fixed size integer is mandatory so that the mender-server has the correct type */
+        if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("offset", packer)) || (0 != msgpack_pack_fix_int64(packer, (int64_t)*properties->offset))) {
             goto FAIL;
         }
-        p->key.via.str.size = (uint32_t)strlen("offset");
-        p->val.type         = MSGPACK_OBJECT_FIX_INT64; /* Mandatory so that the mender-server has the correct type */
-        p->val.via.i64      = *properties->offset;
     }
 
-END:
+    return MENDER_OK;
+
 FAIL:
 
-    return ret;
+    mender_log_error("Unable to pack header properties");
+
+    return MENDER_FAIL;
 }
 
 static mender_err_t
-mender_troubleshoot_protomsg_body_encode(mender_troubleshoot_protomsg_body_t *body, msgpack_object_kv *p) {
+mender_troubleshoot_protomsg_body_encode(mender_troubleshoot_protomsg_body_t *body, msgpack_packer *packer) {
 
     assert(NULL != body);
     assert(NULL != body->data);
-    assert(NULL != p);
-    mender_err_t ret = MENDER_OK;
+    assert(NULL != packer);
 
-    /* Create body */
-    p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("body"))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Create body, the data is copied directly to the sbuffer */
+    if ((MENDER_OK != mender_troubleshoot_protomsg_str_encode("body", packer)) || (0 != msgpack_pack_bin(packer, body->length))
+        || (0 != msgpack_pack_bin_body(packer, body->data, body->length))) {
+        mender_log_error("Unable to pack body");
+        return MENDER_FAIL;
     }
-    p->key.via.str.size = (uint32_t)strlen("body");
-    p->val.type         = MSGPACK_OBJECT_BIN;
-    p->val.via.bin.size = (uint32_t)body->length;
-    if (NULL == (p->val.via.bin.ptr = (char *)malloc(p->val.via.bin.size * sizeof(uint8_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memcpy((void *)p->val.via.bin.ptr, body->data, p->val.via.bin.size);
 
-FAIL:
+    return MENDER_OK;
+}
 
-    return ret;
+static mender_err_t
+mender_troubleshoot_protomsg_str_encode(const char *str, msgpack_packer *packer) {
+
+    assert(NULL != str);
+    assert(NULL != packer);
+    size_t length = strlen(str);
+
+    /* Pack string */
+    if ((0 != msgpack_pack_str(packer, length)) || (0 != msgpack_pack_str_body(packer, str, length))) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
 }
 
 mender_troubleshoot_protomsg_t *
 mender_troubleshoot_protomsg_unpack(void *data, size_t length) {
 
     assert(NULL != data);
-    msgpack_zone                    zone;
+    msgpack_zone                   *zone;
     msgpack_object                  object;
     mender_troubleshoot_protomsg_t *protomsg = NULL;
 
+    /* Create msgpack zone, it holds the proto message until it is released */
+    if (NULL == (zone = (msgpack_zone *)mender_malloc(sizeof(msgpack_zone)))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+
     /* Unpack the message */
-    if (MENDER_OK != mender_troubleshoot_msgpack_unpack_object(data, length, &zone, &object)) {
+    if (MENDER_OK != mender_troubleshoot_msgpack_unpack_object(data, length, zone, &object)) {
         mender_log_error("Unable to unpack the message");
         goto FAIL;
     }
@@ -448,71 +628,70 @@ mender_troubleshoot_protomsg_unpack(void *data, size_t length) {
     }
 
     /* Decode protomsg */
-    if (NULL == (protomsg = mender_troubleshoot_protomsg_decode(&object))) {
+    if (NULL == (protomsg = mender_troubleshoot_protomsg_decode(zone, &object))) {
         mender_log_error("Invalid protomsg object");
         goto FAIL;
     }
 
+    return protomsg;
+
 FAIL:
 
     /* Release memory */
-    msgpack_zone_destroy(&zone);
+    msgpack_zone_destroy(zone);
+    mender_free(zone);
 
-    return protomsg;
+    return NULL;
 }
 
 static mender_troubleshoot_protomsg_t *
-mender_troubleshoot_protomsg_decode(msgpack_object *object) {
+mender_troubleshoot_protomsg_decode(msgpack_zone *zone, msgpack_object *object) {
 
+    assert(NULL != zone);
     assert(NULL != object);
     mender_troubleshoot_protomsg_t *protomsg;
 
     /* Create protomsg */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)msgpack_zone_malloc(zone, sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
-        goto FAIL;
+        return NULL;
     }
     memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
+    protomsg->zone = zone;
 
     /* Parse protomsg */
     msgpack_object_kv *p = object->via.map.ptr;
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "hdr", p->key.via.str.size)) && (MSGPACK_OBJECT_MAP == p->val.type)
             && (0 != p->val.via.map.size)) {
-            if (NULL == (protomsg->hdr = mender_troubleshoot_protomsg_hdr_decode(&p->val))) {
+            if (NULL == (protomsg->hdr = mender_troubleshoot_protomsg_hdr_decode(zone, &p->val))) {
                 mender_log_error("Invalid protomsg object");
-                goto FAIL;
+                return NULL;
             }
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "body", p->key.via.str.size)) && (MSGPACK_OBJECT_BIN == p->val.type)
                    && (0 != p->val.via.bin.size)) {
-            if (NULL == (protomsg->body = mender_troubleshoot_protomsg_body_decode(&p->val))) {
+            if (NULL == (protomsg->body = mender_troubleshoot_protomsg_body_decode(zone, &p->val))) {
                 mender_log_error("Invalid protomsg object");
-                goto FAIL;
+                return NULL;
             }
         }
         ++p;
     } while (p < object->via.map.ptr + object->via.map.size);
 
     return protomsg;
-
-FAIL:
-
-    /* Release memory */
-    mender_troubleshoot_protomsg_release(protomsg);
-
-    return NULL;
 }
 
 static mender_troubleshoot_protomsg_hdr_t *
-mender_troubleshoot_protomsg_hdr_decode(msgpack_object *object) {
+mender_troubleshoot_protomsg_hdr_decode(msgpack_zone *zone, msgpack_object *object) {
 
+    assert(NULL != zone);
     assert(NULL != object);
     mender_troubleshoot_protomsg_hdr_t *hdr;
 
     /* Create header */
-    if (NULL == (hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == (hdr = (mender_troubleshoot_protomsg_hdr_t *)msgpack_zone_malloc(zone, sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
-        goto FAIL;
+        return NULL;
     }
     memset(hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
 
@@ -523,49 +702,41 @@ mender_troubleshoot_protomsg_hdr_decode(msgpack_object *object) {
             && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
             hdr->proto = (mender_troubleshoot_protomsg_hdr_proto_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "typ", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (hdr->typ = (char *)malloc(p->val.via.str.size + 1))) {
-                mender_log_error("Unable to allocate memory");
-                goto FAIL;
+            if (NULL == (hdr->typ = mender_troubleshoot_protomsg_str_decode(zone, &p->val))) {
+                return NULL;
             }
-            memcpy(hdr->typ, p->val.via.str.ptr, p->val.via.str.size);
-            hdr->typ[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "sid", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (hdr->sid = (char *)malloc(p->val.via.str.size + 1))) {
-                mender_log_error("Unable to allocate memory");
-                goto FAIL;
+            if (NULL == (hdr->sid = mender_troubleshoot_protomsg_str_decode(zone, &p->val))) {
+                return NULL;
             }
-            memcpy(hdr->sid, p->val.via.str.ptr, p->val.via.str.size);
-            hdr->sid[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "props", p->key.via.str.size)) && (MSGPACK_OBJECT_MAP == p->val.type)
                    && (0 != p->val.via.map.size)) {
-            if (NULL == (hdr->properties = mender_troubleshoot_protomsg_hdr_properties_decode(&p->val))) {
+            if (NULL == (hdr->properties = mender_troubleshoot_protomsg_hdr_properties_decode(zone, &p->val))) {
                 mender_log_error("Invalid header properties object");
-                goto FAIL;
+                return NULL;
             }
         }
         ++p;
     } while (p < object->via.map.ptr + object->via.map.size);
 
-    return hdr;
-
-FAIL:
-
-    /* Release memory */
-    mender_troubleshoot_protomsg_hdr_release(hdr);
+    /* Resolve the message type, so that the message is dispatched without comparing it again */
+    hdr->type = mender_troubleshoot_protomsg_hdr_type_resolve(hdr);
 
-    return NULL;
+    return hdr;
 }
 
 static mender_troubleshoot_protomsg_hdr_properties_t *
-mender_troubleshoot_protomsg_hdr_properties_decode(msgpack_object *object) {
+mender_troubleshoot_protomsg_hdr_properties_decode(msgpack_zone *zone, msgpack_object *object) {
 
+    assert(NULL != zone);
     assert(NULL != object);
-    mender_troubleshoot_protomsg_hdr_properties_t *properties = NULL;
+    mender_troubleshoot_protomsg_hdr_properties_t *properties;
 
     /* Create header properties */
-    if (NULL == (properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+    if (NULL
+        == (properties = (mender_troubleshoot_protomsg_hdr_properties_t *)msgpack_zone_malloc(zone, sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
-        goto FAIL;
+        return NULL;
     }
     memset(properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
 
@@ -574,54 +745,43 @@ mender_troubleshoot_protomsg_hdr_properties_decode(msgpack_object *object) {
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "terminal_width", p->key.via.str.size))
             && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->terminal_width = (uint16_t *)malloc(sizeof(uint16_t)))) {
-                mender_log_error("Unable to allocate memory");
+            if (NULL == (properties->terminal_width = (uint16_t *)msgpack_zone_malloc(zone, sizeof(uint16_t)))) {
                 goto FAIL;
             }
             *properties->terminal_width = (uint16_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "terminal_height", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->terminal_height = (uint16_t *)malloc(sizeof(uint16_t)))) {
-                mender_log_error("Unable to allocate memory");
+            if (NULL == (properties->terminal_height = (uint16_t *)msgpack_zone_malloc(zone, sizeof(uint16_t)))) {
                 goto FAIL;
             }
             *properties->terminal_height = (uint16_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "connection_id", p->key.via.str.size))
                    && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (properties->connection_id = (char *)malloc(p->val.via.str.size + 1))) {
-                mender_log_error("Unable to allocate memory");
-                goto FAIL;
+            if (NULL == (properties->connection_id = mender_troubleshoot_protomsg_str_decode(zone, &p->val))) {
+                return NULL;
             }
-            memcpy(properties->connection_id, p->val.via.str.ptr, p->val.via.str.size);
-            properties->connection_id[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "user_id", p->key.via.str.size))
                    && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (properties->user_id = (char *)malloc(p->val.via.str.size + 1))) {
-                mender_log_error("Unable to allocate memory");
-                goto FAIL;
+            if (NULL == (properties->user_id = mender_troubleshoot_protomsg_str_decode(zone, &p->val))) {
+                return NULL;
             }
-            memcpy(properties->user_id, p->val.via.str.ptr, p->val.via.str.size);
-            properties->user_id[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "timeout", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->timeout = (uint32_t *)malloc(sizeof(uint32_t)))) {
-                mender_log_error("Unable to allocate memory");
+            if (NULL == (properties->timeout = (uint32_t *)msgpack_zone_malloc(zone, sizeof(uint32_t)))) {
                 goto FAIL;
             }
             *properties->timeout = (uint32_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "status", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
             if (NULL
-                == (properties->status
-                    = (mender_troubleshoot_protomsg_hdr_properties_status_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
-                mender_log_error("Unable to allocate memory");
+                == (properties->status = (mender_troubleshoot_protomsg_hdr_properties_status_t *)msgpack_zone_malloc(
+                        zone, sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
                 goto FAIL;
             }
             *properties->status = (mender_troubleshoot_protomsg_hdr_properties_status_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "offset", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->offset = (size_t *)malloc(sizeof(size_t)))) {
-                mender_log_error("Unable to allocate memory");
+            if (NULL == (properties->offset = (size_t *)msgpack_zone_malloc(zone, sizeof(size_t)))) {
                 goto FAIL;
             }
             *properties->offset = (size_t)p->val.via.u64;
@@ -633,37 +793,72 @@ mender_troubleshoot_protomsg_hdr_properties_decode(msgpack_object *object) {
 
 FAIL:
 
-    /* Release memory */
-    mender_troubleshoot_protomsg_hdr_properties_release(properties);
+    mender_log_error("Unable to allocate memory");
 
     return NULL;
 }
 
 static mender_troubleshoot_protomsg_body_t *
-mender_troubleshoot_protomsg_body_decode(msgpack_object *object) {
+mender_troubleshoot_protomsg_body_decode(msgpack_zone *zone, msgpack_object *object) {
 
+    assert(NULL != zone);
     assert(NULL != object);
     mender_troubleshoot_protomsg_body_t *body;
 
-    /* Create body */
-    if (NULL == (body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
+    /* Create body, the data points to the packed data, which remains valid until the message is released */
+    if (NULL == (body = (mender_troubleshoot_protomsg_body_t *)msgpack_zone_malloc(zone, sizeof(mender_troubleshoot_protomsg_body_t)))) {
         mender_log_error("Unable to allocate memory");
-        goto FAIL;
+        return NULL;
     }
-    memset(body, 0, sizeof(mender_troubleshoot_protomsg_body_t));
-    if (NULL == (body->data = malloc(object->via.bin.size))) {
-        mender_log_error("Unable to allocate memory");
-        goto FAIL;
-    }
-    memcpy(body->data, object->via.bin.ptr, object->via.bin.size);
+    body->data   = (void *)object->via.bin.ptr;
     body->length = object->via.bin.size;
 
     return body;
+}
 
-FAIL:
+static char *
+mender_troubleshoot_protomsg_str_decode(msgpack_zone *zone, msgpack_object *object) {
 
-    /* Release memory */
-    mender_troubleshoot_protomsg_body_release(body);
+    assert(NULL != zone);
+    assert(NULL != object);
+    char *str;
+
+    /* Copy the string to the zone, the packed data has no NUL terminator */
+    if (NULL == (str = (char *)msgpack_zone_malloc(zone, object->via.str.size + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+    memcpy(str, object->via.str.ptr, object->via.str.size);
+    str[object->via.str.size] = '\0';
+
+    return str;
+}
+
+static const mender_troubleshoot_protomsg_type_t *
+mender_troubleshoot_protomsg_hdr_type_resolve(mender_troubleshoot_protomsg_hdr_t *hdr) {
+
+    assert(NULL != hdr);
+
+    /* Verify integrity of the header */
+    if (NULL == hdr->typ) {
+        return NULL;
+    }
+
+    /* Search for the proto and then for the message type */
+    for (size_t index = 0; index < MENDER_TROUBLESHOOT_PROTOMSG_PROTO_COUNT; index++) {
+        const mender_troubleshoot_protomsg_proto_t *proto = mender_troubleshoot_protomsg_protos[index];
+        if ((NULL != proto) && (hdr->proto == proto->proto)) {
+            if ((true == proto->sid) && (NULL == hdr->sid)) {
+                return NULL;
+            }
+            for (size_t type_index = 0; type_index < proto->count; type_index++) {
+                if (!strcmp(hdr->typ, proto->types[type_index].typ)) {
+                    return &proto->types[type_index];
+                }
+            }
+            return NULL;
+        }
+    }
 
     return NULL;
 }
@@ -671,11 +866,15 @@ FAIL:
 void
 mender_troubleshoot_protomsg_release(mender_troubleshoot_protomsg_t *protomsg) {
 
-    /* Release memory */
-    if (NULL != protomsg) {
+    /* Release memory, unpacked messages are allocated from the msgpack zone */
+    if ((NULL != protomsg) && (NULL != protomsg->zone)) {
+        msgpack_zone *zone = protomsg->zone;
+        msgpack_zone_destroy(zone);
+        mender_free(zone);
+    } else if (NULL != protomsg) {
         mender_troubleshoot_protomsg_hdr_release(protomsg->hdr);
         mender_troubleshoot_protomsg_body_release(protomsg->body);
-        free(protomsg);
+        mender_free(protomsg);
     }
 }
 
@@ -685,13 +884,13 @@ mender_troubleshoot_protomsg_hdr_release(mender_troubleshoot_protomsg_hdr_t *hdr
     /* Release memory */
     if (NULL != hdr) {
         if (NULL != hdr->typ) {
-            free(hdr->typ);
+            mender_free(hdr->typ);
         }
         if (NULL != hdr->sid) {
-            free(hdr->sid);
+            mender_free(hdr->sid);
         }
         mender_troubleshoot_protomsg_hdr_properties_release(hdr->properties);
-        free(hdr);
+        mender_free(hdr);
     }
 }
 
@@ -701,27 +900,27 @@ mender_troubleshoot_protomsg_hdr_properties_release(mender_troubleshoot_protomsg
     /* Release memory */
     if (NULL != properties) {
         if (NULL != properties->terminal_width) {
-            free(properties->terminal_width);
+            mender_free(properties->terminal_width);
         }
         if (NULL != properties->terminal_height) {
-            free(properties->terminal_height);
+            mender_free(properties->terminal_height);
         }
         if (NULL != properties->connection_id) {
-            free(properties->connection_id);
+            mender_free(properties->connection_id);
         }
         if (NULL != properties->user_id) {
-            free(properties->user_id);
+            mender_free(properties->user_id);
         }
         if (NULL != properties->timeout) {
-            free(properties->timeout);
+            mender_free(properties->timeout);
         }
         if (NULL != properties->status) {
-            free(properties->status);
+            mender_free(properties->status);
         }
         if (NULL != properties->offset) {
-            free(properties->offset);
+            mender_free(properties->offset);
         }
-        free(properties);
+        mender_free(properties);
     }
 }
 
@@ -731,9 +930,9 @@ mender_troubleshoot_protomsg_body_release(mender_troubleshoot_protomsg_body_t *b
     /* Release memory */
     if (NULL != body) {
         if (NULL != body->data) {
-            free(body->data);
+            mender_free(body->data);
         }
-        free(body);
+        mender_free(body);
     }
 }
 
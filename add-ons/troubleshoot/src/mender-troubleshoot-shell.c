@@ -17,7 +17,13 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-log.h"
+#include "mender-scheduler.h"
 #include "mender-troubleshoot-api.h"
 #include "mender-troubleshoot-msgpack.h"
 #include "mender-troubleshoot-shell.h"
@@ -35,6 +41,39 @@
 #define MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SPAWN  "new"
 #define MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_STOP   "stop"
 
+/**
+ * @brief Default maximum size of the output merged into a single message (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_SIZE (512)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_SIZE */
+
+/**
+ * @brief Default maximum delay the output is kept to be merged with the following output (milliseconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_DELAY
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_DELAY (50)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_DELAY */
+
+/**
+ * @brief Default maximum number of shell sessions opened at the same time
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX (2)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX */
+
+/**
+ * @brief Mender troubleshoot shell session, the output printed is merged to reduce the number of messages sent
+ */
+typedef struct {
+    char                                       *sid;          /**< Session ID, NULL if free */
+    mender_troubleshoot_protomsg_hdr_template_t hdr_template; /**< Messages header, packed once */
+    uint64_t                                    activity;     /**< Latest message received (microseconds) */
+    uint8_t                                    *data;         /**< Output pending, allocated while the session is opened */
+    size_t                                      length;       /**< Length of the output pending */
+    uint64_t                                    sent;         /**< Latest message sent (microseconds) */
+} mender_troubleshoot_shell_session_t;
+
 /**
  * @brief Mender troubleshoot shell config
  */
@@ -46,9 +85,19 @@ static mender_troubleshoot_shell_config_t mender_troubleshoot_shell_config;
 static mender_troubleshoot_shell_callbacks_t mender_troubleshoot_shell_callbacks;
 
 /**
- * @brief Mender troubleshoot shell session ID
+ * @brief Mender troubleshoot shell sessions, the output buffers are allocated when the sessions are opened and released when they are closed
+ */
+static mender_troubleshoot_shell_session_t mender_troubleshoot_shell_sessions[CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX];
+
+/**
+ * @brief Mutex used to protect access to the sessions and their output pending
  */
-static char *mender_troubleshoot_shell_sid = NULL;
+static void *mender_troubleshoot_shell_mutex = NULL;
+
+/**
+ * @brief Work sending the output pending of the sessions once the coalesce delay is elapsed
+ */
+static void *mender_troubleshoot_shell_coalescer_work = NULL;
 
 /**
  * @brief Function called to perform the treatment of the shell ping messages
@@ -58,6 +107,14 @@ static char *mender_troubleshoot_shell_sid = NULL;
  */
 static mender_err_t mender_troubleshoot_shell_ping_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
 
+/**
+ * @brief Function called to perform the treatment of the shell pong messages
+ * @param protomsg Received proto message
+ * @param response Response to be sent back to the server, NULL if no response to send
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_shell_pong_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
+
 /**
  * @brief Function called to perform the treatment of the shell resize messages
  * @param protomsg Received proto message
@@ -111,19 +168,95 @@ static mender_err_t mender_troubleshoot_shell_format_ack(mender_troubleshoot_pro
 
 /**
  * @brief Function called to send shell ping protomsg
+ * @param session Shell session
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-static mender_err_t mender_troubleshoot_shell_send_ping(void);
+static mender_err_t mender_troubleshoot_shell_send_ping(mender_troubleshoot_shell_session_t *session);
 
 /**
  * @brief Function called to send shell stop protomsg
+ * @param session Shell session
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-static mender_err_t mender_troubleshoot_shell_send_stop(void);
+static mender_err_t mender_troubleshoot_shell_send_stop(mender_troubleshoot_shell_session_t *session);
+
+/**
+ * @brief Mender troubleshoot shell coalescer work function, it sends the output pending of the sessions
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_shell_coalescer_work_function(void);
+
+/**
+ * @brief Function called to print data to a session, the mutex must be taken
+ * @param session Shell session
+ * @param data Data to send to the server
+ * @param length Length of the data to send to the server
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_shell_write(mender_troubleshoot_shell_session_t *session, void *data, size_t length);
+
+/**
+ * @brief Function called to send the output pending of a session, the mutex must be taken
+ * @param session Shell session
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_shell_flush(mender_troubleshoot_shell_session_t *session);
+
+/**
+ * @brief Function called to send shell data protomsg, the mutex must be taken
+ * @param session Shell session
+ * @param data Data to send to the server
+ * @param length Length of the data to send to the server
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_shell_send_data(mender_troubleshoot_shell_session_t *session, void *data, size_t length);
+
+/**
+ * @brief Function called to retrieve the session of a message, the activity of the session is updated
+ * @param protomsg Received proto message
+ * @return Shell session, NULL if the session is not opened
+ */
+static mender_troubleshoot_shell_session_t *mender_troubleshoot_shell_session_get(mender_troubleshoot_protomsg_t *protomsg);
+
+/**
+ * @brief Function called to close a session, the close callback is invoked and the stop message is sent to the server
+ * @param session Shell session
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_shell_session_close(mender_troubleshoot_shell_session_t *session);
+
+/**
+ * @brief Function called to release a session, the output pending is discarded
+ * @param session Shell session
+ */
+static void mender_troubleshoot_shell_release(mender_troubleshoot_shell_session_t *session);
+
+/**
+ * @brief Message types of the shell proto
+ */
+static const mender_troubleshoot_protomsg_type_t mender_troubleshoot_shell_message_types[] = {
+    { .typ = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PING, .handler = mender_troubleshoot_shell_ping_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PONG, .handler = mender_troubleshoot_shell_pong_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_RESIZE, .handler = mender_troubleshoot_shell_resize_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SHELL, .handler = mender_troubleshoot_shell_shell_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SPAWN, .handler = mender_troubleshoot_shell_spawn_message_handler },
+    { .typ = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_STOP, .handler = mender_troubleshoot_shell_stop_message_handler },
+};
+
+/**
+ * @brief Shell proto
+ */
+static const mender_troubleshoot_protomsg_proto_t mender_troubleshoot_shell_proto
+    = { .proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL,
+        .types = mender_troubleshoot_shell_message_types,
+        .count = sizeof(mender_troubleshoot_shell_message_types) / sizeof(mender_troubleshoot_shell_message_types[0]),
+        .sid   = true };
 
 mender_err_t
 mender_troubleshoot_shell_init(mender_troubleshoot_shell_config_t *config, mender_troubleshoot_shell_callbacks_t *callbacks) {
 
+    mender_err_t ret;
+
     /* Save configuration */
     memcpy(&mender_troubleshoot_shell_config, config, sizeof(mender_troubleshoot_shell_config_t));
 
@@ -132,49 +265,34 @@ mender_troubleshoot_shell_init(mender_troubleshoot_shell_config_t *config, mende
         memcpy(&mender_troubleshoot_shell_callbacks, callbacks, sizeof(mender_troubleshoot_shell_callbacks_t));
     }
 
-    return MENDER_OK;
-}
-
-mender_err_t
-mender_troubleshoot_shell_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
-
-    assert(NULL != protomsg);
-    assert(NULL != protomsg->hdr);
-    mender_err_t ret = MENDER_OK;
-
-    /* Verify integrity of the message */
-    if ((NULL == protomsg->hdr->typ) || (NULL == protomsg->hdr->sid)) {
-        mender_log_error("Invalid message received");
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Create shell mutex */
+    memset(mender_troubleshoot_shell_sessions, 0, sizeof(mender_troubleshoot_shell_sessions));
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_shell_mutex))) {
+        mender_log_error("Unable to create shell mutex");
+        return ret;
     }
 
-    /* Treatment of the message depending of the message type */
-    if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PING)) {
-        /* Format pong */
-        ret = mender_troubleshoot_shell_ping_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PONG)) {
-        /* Nothing to do */
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_RESIZE)) {
-        /* Resize shell */
-        ret = mender_troubleshoot_shell_resize_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SHELL)) {
-        /* Shell data */
-        ret = mender_troubleshoot_shell_shell_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SPAWN)) {
-        /* Spawn shell */
-        ret = mender_troubleshoot_shell_spawn_message_handler(protomsg, response);
-    } else if (!strcmp(protomsg->hdr->typ, MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_STOP)) {
-        /* Stop shell */
-        ret = mender_troubleshoot_shell_stop_message_handler(protomsg, response);
-    } else {
-        /* Not supported */
-        mender_log_error("Unsupported message received with message type '%s'", protomsg->hdr->typ);
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Create shell coalescer work, it is executed once the coalesce delay of the output pending is elapsed */
+    mender_scheduler_work_params_t coalescer_work_params;
+    coalescer_work_params.function = mender_troubleshoot_shell_coalescer_work_function;
+    coalescer_work_params.period   = 0;
+    coalescer_work_params.name     = "mender_troubleshoot_shell_coalescer";
+    coalescer_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    coalescer_work_params.slack    = 0;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&coalescer_work_params, &mender_troubleshoot_shell_coalescer_work))) {
+        mender_log_error("Unable to create shell coalescer work");
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_troubleshoot_shell_coalescer_work))) {
+        mender_log_error("Unable to activate shell coalescer work");
+        return ret;
     }
 
-FAIL:
+    /* Register shell proto */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_register(&mender_troubleshoot_shell_proto))) {
+        mender_log_error("Unable to register shell proto");
+        return ret;
+    }
 
     return ret;
 }
@@ -184,11 +302,23 @@ mender_troubleshoot_shell_healthcheck(void) {
 
     mender_err_t ret = MENDER_OK;
 
-    /* Check if a session is already opened */
-    if (NULL != mender_troubleshoot_shell_sid) {
+    /* Check each session opened */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX; index++) {
+        mender_troubleshoot_shell_session_t *session = &mender_troubleshoot_shell_sessions[index];
+        if (NULL == session->sid) {
+            continue;
+        }
+
+        /* Close the session if nothing has been received before the timeout given in the ping messages, the server has left it */
+        if ((mender_troubleshoot_shell_config.healthcheck_interval > 0)
+            && (mender_scheduler_get_uptime_us() - session->activity >= (uint64_t)mender_troubleshoot_shell_config.healthcheck_interval * 2 * 1000000)) {
+            mender_log_warning("Shell session expired");
+            mender_troubleshoot_shell_session_close(session);
+            continue;
+        }
 
         /* Send healthcheck ping message over websocket connection */
-        if (MENDER_OK != (ret = mender_troubleshoot_shell_send_ping())) {
+        if (MENDER_OK != (ret = mender_troubleshoot_shell_send_ping(session))) {
             mender_log_error("Unable to send healthcheck message to the server");
             goto FAIL;
         }
@@ -200,92 +330,47 @@ FAIL:
 }
 
 mender_err_t
-mender_troubleshoot_shell_print(void *data, size_t length) {
+mender_troubleshoot_shell_print(void *session, void *data, size_t length) {
 
-    mender_troubleshoot_protomsg_t *protomsg = NULL;
-    mender_err_t                    ret      = MENDER_OK;
-    void                           *payload  = NULL;
+    mender_err_t ret;
+    mender_err_t result;
+    bool         opened = false;
 
-    /* Check if a session is already opened */
-    if (NULL == mender_troubleshoot_shell_sid) {
-        mender_log_error("No shell session opened");
-        ret = MENDER_FAIL;
-        goto FAIL;
+    /* Take mutex used to protect access to the sessions */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_shell_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
     }
 
-    /* Send shell body */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
-    protomsg->hdr->proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL;
-    if (NULL == (protomsg->hdr->typ = strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SHELL))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if (NULL == (protomsg->hdr->sid = strdup(mender_troubleshoot_shell_sid))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if (NULL == (protomsg->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
-    if (NULL
-        == (protomsg->hdr->properties->status
-            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    *(protomsg->hdr->properties->status) = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL;
-    if ((NULL != data) && (0 != length)) {
-        if (NULL == (protomsg->body = (mender_troubleshoot_protomsg_body_t *)malloc(sizeof(mender_troubleshoot_protomsg_body_t)))) {
-            mender_log_error("Unable to allocate memory");
+    /* Print to the session given */
+    if (NULL != session) {
+        if (NULL == ((mender_troubleshoot_shell_session_t *)session)->sid) {
+            mender_log_error("Shell session not opened");
             ret = MENDER_FAIL;
-            goto FAIL;
+            goto END;
         }
-        memset(protomsg->body, 0, sizeof(mender_troubleshoot_protomsg_body_t));
-        if (NULL == (protomsg->body->data = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto FAIL;
-        }
-        memcpy(protomsg->body->data, data, length);
-        protomsg->body->length = length;
+        ret = mender_troubleshoot_shell_write((mender_troubleshoot_shell_session_t *)session, data, length);
+        goto END;
     }
 
-    /* Encode and pack the message */
-    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_pack(protomsg, &payload, &length))) {
-        mender_log_error("Unable to encode message");
-        goto FAIL;
+    /* Print to all the sessions opened otherwise */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX; index++) {
+        if (NULL != mender_troubleshoot_shell_sessions[index].sid) {
+            opened = true;
+            if (MENDER_OK != (result = mender_troubleshoot_shell_write(&mender_troubleshoot_shell_sessions[index], data, length))) {
+                ret = result;
+            }
+        }
     }
-
-    /* Send message */
-    if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
-        mender_log_error("Unable to send message");
-        goto FAIL;
+    if (false == opened) {
+        mender_log_error("No shell session opened");
+        ret = MENDER_FAIL;
     }
 
-FAIL:
+END:
 
-    /* Release memory */
-    mender_troubleshoot_protomsg_release(protomsg);
-    if (NULL != payload) {
-        free(payload);
-    }
+    /* Release mutex used to protect access to the sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_shell_mutex);
 
     return ret;
 }
@@ -294,25 +379,15 @@ mender_err_t
 mender_troubleshoot_shell_close(void) {
 
     mender_err_t ret = MENDER_OK;
+    mender_err_t result;
 
-    /* Check if a session is already opened */
-    if (NULL != mender_troubleshoot_shell_sid) {
-
-        /* Invoke shell close callback */
-        if (NULL != mender_troubleshoot_shell_callbacks.close) {
-            if (MENDER_OK != mender_troubleshoot_shell_callbacks.close()) {
-                mender_log_error("An error occured");
+    /* Close each session opened */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX; index++) {
+        if (NULL != mender_troubleshoot_shell_sessions[index].sid) {
+            if (MENDER_OK != (result = mender_troubleshoot_shell_session_close(&mender_troubleshoot_shell_sessions[index]))) {
+                ret = result;
             }
         }
-
-        /* Send stop message to the server */
-        if (MENDER_OK != (ret = mender_troubleshoot_shell_send_stop())) {
-            mender_log_error("Unable to send stop message to the server");
-        }
-
-        /* Release session ID */
-        free(mender_troubleshoot_shell_sid);
-        mender_troubleshoot_shell_sid = NULL;
     }
 
     return ret;
@@ -321,11 +396,22 @@ mender_troubleshoot_shell_close(void) {
 mender_err_t
 mender_troubleshoot_shell_exit(void) {
 
+    /* Unregister shell proto */
+    mender_troubleshoot_protomsg_unregister(MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL);
+
+    /* Deactivate and delete shell coalescer work */
+    mender_scheduler_work_deactivate(mender_troubleshoot_shell_coalescer_work);
+    mender_scheduler_work_delete(mender_troubleshoot_shell_coalescer_work);
+    mender_troubleshoot_shell_coalescer_work = NULL;
+
     /* Release memory */
-    if (NULL != mender_troubleshoot_shell_sid) {
-        free(mender_troubleshoot_shell_sid);
-        mender_troubleshoot_shell_sid = NULL;
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX; index++) {
+        if (NULL != mender_troubleshoot_shell_sessions[index].sid) {
+            mender_troubleshoot_shell_release(&mender_troubleshoot_shell_sessions[index]);
+        }
     }
+    mender_scheduler_mutex_delete(mender_troubleshoot_shell_mutex);
+    mender_troubleshoot_shell_mutex = NULL;
 
     return MENDER_OK;
 }
@@ -336,6 +422,9 @@ mender_troubleshoot_shell_ping_message_handler(mender_troubleshoot_protomsg_t *p
     assert(NULL != protomsg);
     mender_err_t ret = MENDER_OK;
 
+    /* Update the activity of the session */
+    mender_troubleshoot_shell_session_get(protomsg);
+
     /* Format pong */
     if (MENDER_OK != (ret = mender_troubleshoot_shell_format_pong(protomsg, response))) {
         mender_log_error("Unable to format pong message");
@@ -347,12 +436,25 @@ FAIL:
     return ret;
 }
 
+static mender_err_t
+mender_troubleshoot_shell_pong_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+
+    assert(NULL != protomsg);
+    (void)response;
+
+    /* Update the activity of the session */
+    mender_troubleshoot_shell_session_get(protomsg);
+
+    return MENDER_OK;
+}
+
 static mender_err_t
 mender_troubleshoot_shell_resize_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
     (void)response;
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_shell_session_t *session;
+    mender_err_t                         ret = MENDER_OK;
 
     /* Verify integrity of the message */
     if ((NULL == protomsg->hdr->properties) || (NULL == protomsg->hdr->properties->terminal_width) || (NULL == protomsg->hdr->properties->terminal_height)) {
@@ -361,10 +463,18 @@ mender_troubleshoot_shell_resize_message_handler(mender_troubleshoot_protomsg_t
         goto FAIL;
     }
 
+    /* Retrieve the session */
+    if (NULL == (session = mender_troubleshoot_shell_session_get(protomsg))) {
+        mender_log_error("Shell session not opened");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
     /* Invoke shell resize callback */
     if (NULL != mender_troubleshoot_shell_callbacks.resize) {
         if (MENDER_OK
-            != (ret = mender_troubleshoot_shell_callbacks.resize(*protomsg->hdr->properties->terminal_width, *protomsg->hdr->properties->terminal_height))) {
+            != (ret = mender_troubleshoot_shell_callbacks.resize(
+                    session, *protomsg->hdr->properties->terminal_width, *protomsg->hdr->properties->terminal_height))) {
             mender_log_error("An error occured");
             goto FAIL;
         }
@@ -380,7 +490,8 @@ mender_troubleshoot_shell_shell_message_handler(mender_troubleshoot_protomsg_t *
 
     assert(NULL != protomsg);
     (void)response;
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_shell_session_t *session;
+    mender_err_t                         ret = MENDER_OK;
 
     /* Verify integrity of the message */
     if (NULL == protomsg->body) {
@@ -394,9 +505,16 @@ mender_troubleshoot_shell_shell_message_handler(mender_troubleshoot_protomsg_t *
         goto FAIL;
     }
 
+    /* Retrieve the session */
+    if (NULL == (session = mender_troubleshoot_shell_session_get(protomsg))) {
+        mender_log_error("Shell session not opened");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
     /* Invoke shell data write callback */
     if (NULL != mender_troubleshoot_shell_callbacks.write) {
-        if (MENDER_OK != (ret = mender_troubleshoot_shell_callbacks.write(protomsg->body->data, protomsg->body->length))) {
+        if (MENDER_OK != (ret = mender_troubleshoot_shell_callbacks.write(session, protomsg->body->data, protomsg->body->length))) {
             mender_log_error("An error occured");
             goto FAIL;
         }
@@ -411,30 +529,64 @@ static mender_err_t
 mender_troubleshoot_shell_spawn_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_shell_session_t *session = NULL;
+    mender_err_t                         ret     = MENDER_OK;
+
+    /* Check is the session is already opened */
+    if (NULL != mender_troubleshoot_shell_session_get(protomsg)) {
+        mender_log_warning("The shell session is already opened");
+        goto FAIL;
+    }
 
-    /* Check is a session is already opened */
-    if (NULL != mender_troubleshoot_shell_sid) {
-        mender_log_warning("A shell session is already opened");
+    /* Look for a free session, the new session is refused if the maximum number of sessions is reached */
+    for (size_t index = 0; (NULL == session) && (index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX); index++) {
+        if (NULL == mender_troubleshoot_shell_sessions[index].sid) {
+            session = &mender_troubleshoot_shell_sessions[index];
+        }
+    }
+    if (NULL == session) {
+        mender_log_warning("Maximum number of shell sessions reached");
+        if (MENDER_OK != (ret = mender_troubleshoot_shell_format_ack(protomsg, MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR, response))) {
+            mender_log_error("Unable to format response");
+        }
         goto FAIL;
     }
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+    /* The new session is refused while the memory is under pressure, the sessions opened are kept */
+    if (MENDER_UTILS_MEMORY_PRESSURE_NONE != mender_utils_memory_pressure_get()) {
+        mender_log_warning("Memory is under pressure, the shell session is refused");
+        if (MENDER_OK != (ret = mender_troubleshoot_shell_format_ack(protomsg, MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR, response))) {
+            mender_log_error("Unable to format response");
+        }
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
 
     /* Start shell session */
     mender_log_info("Starting a new shell session");
 
-    /* Save the session ID */
-    if (NULL == (mender_troubleshoot_shell_sid = strdup(protomsg->hdr->sid))) {
+    /* Save the session ID, the session is used by the coalescer work once the ID is set */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_shell_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        goto FAIL;
+    }
+    if ((NULL == (session->data = (uint8_t *)mender_malloc(CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_SIZE)))
+        || (NULL == (session->sid = mender_strdup(protomsg->hdr->sid)))) {
         mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+        mender_free(session->data);
+        session->data = NULL;
+        ret           = MENDER_FAIL;
+    }
+    session->activity = mender_scheduler_get_uptime_us();
+    session->length   = 0;
+    session->sent     = 0;
+    mender_scheduler_mutex_give(mender_troubleshoot_shell_mutex);
+    if (MENDER_OK != ret) {
         goto FAIL;
     }
 
     /* Format acknowledgment */
-    if (MENDER_OK
-        != (ret = mender_troubleshoot_shell_format_ack(protomsg,
-                                                       (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL
-                                                                          : MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_ERROR,
-                                                       response))) {
+    if (MENDER_OK != (ret = mender_troubleshoot_shell_format_ack(protomsg, MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL, response))) {
         mender_log_error("Unable to format response");
         goto FAIL;
     }
@@ -443,9 +595,10 @@ mender_troubleshoot_shell_spawn_message_handler(mender_troubleshoot_protomsg_t *
     if (NULL != mender_troubleshoot_shell_callbacks.open) {
         if ((NULL != protomsg->hdr->properties) && (NULL != protomsg->hdr->properties->terminal_width)
             && (NULL != protomsg->hdr->properties->terminal_height)) {
-            ret = mender_troubleshoot_shell_callbacks.open(*protomsg->hdr->properties->terminal_width, *protomsg->hdr->properties->terminal_height);
+            ret = mender_troubleshoot_shell_callbacks.open(
+                session, *protomsg->hdr->properties->terminal_width, *protomsg->hdr->properties->terminal_height);
         } else {
-            ret = mender_troubleshoot_shell_callbacks.open(0, 0);
+            ret = mender_troubleshoot_shell_callbacks.open(session, 0, 0);
         }
         if (MENDER_OK != ret) {
             mender_log_error("An error occured");
@@ -462,20 +615,21 @@ static mender_err_t
 mender_troubleshoot_shell_stop_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
 
     assert(NULL != protomsg);
-    mender_err_t ret = MENDER_OK;
+    mender_troubleshoot_shell_session_t *session;
+    mender_err_t                         ret = MENDER_OK;
 
-    /* Check is a session is already opened */
-    if (NULL == mender_troubleshoot_shell_sid) {
-        mender_log_warning("No shell session opened");
+    /* Check is the session is already opened */
+    if (NULL == (session = mender_troubleshoot_shell_session_get(protomsg))) {
+        mender_log_warning("Shell session not opened");
         goto FAIL;
     }
 
     /* Stop shell session */
-    mender_log_info("Stopping current shell session");
+    mender_log_info("Stopping shell session");
 
     /* Invoke shell close callback */
     if (NULL != mender_troubleshoot_shell_callbacks.close) {
-        if (MENDER_OK != (ret = mender_troubleshoot_shell_callbacks.close())) {
+        if (MENDER_OK != (ret = mender_troubleshoot_shell_callbacks.close(session))) {
             mender_log_error("An error occured");
         }
     }
@@ -489,11 +643,8 @@ mender_troubleshoot_shell_stop_message_handler(mender_troubleshoot_protomsg_t *p
         mender_log_error("Unable to format response");
     }
 
-    /* Release session ID */
-    if (NULL != mender_troubleshoot_shell_sid) {
-        free(mender_troubleshoot_shell_sid);
-        mender_troubleshoot_shell_sid = NULL;
-    }
+    /* Release session */
+    mender_troubleshoot_shell_release(session);
 
 FAIL:
 
@@ -508,26 +659,26 @@ mender_troubleshoot_shell_format_pong(mender_troubleshoot_protomsg_t *protomsg,
     mender_err_t ret = MENDER_OK;
 
     /* Format shell pong message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PONG))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PONG))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != protomsg->hdr->sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(protomsg->hdr->sid))) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -555,33 +706,34 @@ mender_troubleshoot_shell_format_ack(mender_troubleshoot_protomsg_t
     mender_err_t ret = MENDER_OK;
 
     /* Format acknowledgment message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == ((*response)->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     (*response)->hdr->proto = protomsg->hdr->proto;
-    if (NULL == ((*response)->hdr->typ = strdup(protomsg->hdr->typ))) {
+    if (NULL == ((*response)->hdr->typ = mender_strdup(protomsg->hdr->typ))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL != mender_troubleshoot_shell_sid) {
-        if (NULL == ((*response)->hdr->sid = strdup(mender_troubleshoot_shell_sid))) {
+    if (NULL != protomsg->hdr->sid) {
+        if (NULL == ((*response)->hdr->sid = mender_strdup(protomsg->hdr->sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     }
     if (NULL
-        == ((*response)->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+        == ((*response)->hdr->properties
+            = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -589,7 +741,7 @@ mender_troubleshoot_shell_format_ack(mender_troubleshoot_protomsg_t
     memset((*response)->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
     if (NULL
         == ((*response)->hdr->properties->status
-            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
+            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -608,45 +760,48 @@ FAIL:
 }
 
 static mender_err_t
-mender_troubleshoot_shell_send_ping(void) {
+mender_troubleshoot_shell_send_ping(mender_troubleshoot_shell_session_t *session) {
 
+    assert(NULL != session);
     mender_troubleshoot_protomsg_t *protomsg = NULL;
     mender_err_t                    ret      = MENDER_OK;
     void                           *payload  = NULL;
     size_t                          length   = 0;
 
     /* Send shell ping message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     protomsg->hdr->proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL;
-    if (NULL == (protomsg->hdr->typ = strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PING))) {
+    if (NULL == (protomsg->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_PING))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->hdr->sid = strdup(mender_troubleshoot_shell_sid))) {
+    if (NULL == (protomsg->hdr->sid = mender_strdup(session->sid))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+    if (NULL
+        == (protomsg->hdr->properties
+            = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
     if (mender_troubleshoot_shell_config.healthcheck_interval > 0) {
-        if (NULL == (protomsg->hdr->properties->timeout = (uint32_t *)malloc(sizeof(uint32_t)))) {
+        if (NULL == (protomsg->hdr->properties->timeout = (uint32_t *)mender_malloc(sizeof(uint32_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -655,7 +810,7 @@ mender_troubleshoot_shell_send_ping(void) {
     }
     if (NULL
         == (protomsg->hdr->properties->status
-            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
+            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -668,8 +823,10 @@ mender_troubleshoot_shell_send_ping(void) {
         goto FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
+    /* Send message, the pack buffer is given back once it has been sent */
+    ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_CONTROL, -1, NULL, NULL);
+    payload = NULL;
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to send message");
         goto FAIL;
     }
@@ -679,45 +836,48 @@ FAIL:
     /* Release memory */
     mender_troubleshoot_protomsg_release(protomsg);
     if (NULL != payload) {
-        free(payload);
+        mender_troubleshoot_api_buffer_give(payload);
     }
 
     return ret;
 }
 
 static mender_err_t
-mender_troubleshoot_shell_send_stop(void) {
+mender_troubleshoot_shell_send_stop(mender_troubleshoot_shell_session_t *session) {
 
+    assert(NULL != session);
     mender_troubleshoot_protomsg_t *protomsg = NULL;
     mender_err_t                    ret      = MENDER_OK;
     void                           *payload  = NULL;
     size_t                          length   = 0;
 
     /* Send shell stop message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
+    if (NULL == (protomsg->hdr = (mender_troubleshoot_protomsg_hdr_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->hdr, 0, sizeof(mender_troubleshoot_protomsg_hdr_t));
     protomsg->hdr->proto = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL;
-    if (NULL == (protomsg->hdr->typ = strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_STOP))) {
+    if (NULL == (protomsg->hdr->typ = mender_strdup(MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_STOP))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->hdr->sid = strdup(mender_troubleshoot_shell_sid))) {
+    if (NULL == (protomsg->hdr->sid = mender_strdup(session->sid))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->hdr->properties = (mender_troubleshoot_protomsg_hdr_properties_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
+    if (NULL
+        == (protomsg->hdr->properties
+            = (mender_troubleshoot_protomsg_hdr_properties_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -725,7 +885,7 @@ mender_troubleshoot_shell_send_stop(void) {
     memset(protomsg->hdr->properties, 0, sizeof(mender_troubleshoot_protomsg_hdr_properties_t));
     if (NULL
         == (protomsg->hdr->properties->status
-            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
+            = (mender_troubleshoot_protomsg_hdr_properties_status_t *)mender_malloc(sizeof(mender_troubleshoot_protomsg_hdr_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -738,8 +898,10 @@ mender_troubleshoot_shell_send_stop(void) {
         goto FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
+    /* Send message, the pack buffer is given back once it has been sent */
+    ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_CONTROL, -1, NULL, NULL);
+    payload = NULL;
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to send message");
         goto FAIL;
     }
@@ -749,11 +911,205 @@ FAIL:
     /* Release memory */
     mender_troubleshoot_protomsg_release(protomsg);
     if (NULL != payload) {
-        free(payload);
+        mender_troubleshoot_api_buffer_give(payload);
     }
 
     return ret;
 }
 
+static mender_err_t
+mender_troubleshoot_shell_coalescer_work_function(void) {
+
+    mender_err_t ret;
+    mender_err_t result;
+
+    /* Take mutex used to protect access to the sessions */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_shell_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Send the output pending of the sessions still opened */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX; index++) {
+        if (NULL != mender_troubleshoot_shell_sessions[index].sid) {
+            if (MENDER_OK != (result = mender_troubleshoot_shell_flush(&mender_troubleshoot_shell_sessions[index]))) {
+                ret = result;
+            }
+        }
+    }
+
+    /* Release mutex used to protect access to the sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_shell_mutex);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_shell_write(mender_troubleshoot_shell_session_t *session, void *data, size_t length) {
+
+    assert(NULL != session);
+    mender_err_t ret;
+
+    /* Send immediately the output printed while nothing has been sent during the coalesce delay, this is the case of the interactive echo */
+    if ((0 == session->length)
+        && (mender_scheduler_get_uptime_us() - session->sent >= (uint64_t)CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_DELAY * 1000)) {
+        return mender_troubleshoot_shell_send_data(session, data, length);
+    }
+
+    /* Flush the output pending if the new output does not fit */
+    if (session->length + length > CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_SIZE) {
+        if (MENDER_OK != (ret = mender_troubleshoot_shell_flush(session))) {
+            return ret;
+        }
+    }
+
+    /* Send immediately the output which can not be merged, otherwise it is merged with the output pending until the coalesce delay is elapsed */
+    if (length >= CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_SIZE) {
+        return mender_troubleshoot_shell_send_data(session, data, length);
+    }
+    if (0 == session->length) {
+        mender_scheduler_work_execute_after(mender_troubleshoot_shell_coalescer_work, CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_COALESCE_DELAY);
+    }
+    memcpy(&session->data[session->length], data, length);
+    session->length += length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_troubleshoot_shell_flush(mender_troubleshoot_shell_session_t *session) {
+
+    assert(NULL != session);
+    mender_err_t ret = MENDER_OK;
+
+    /* Send the output pending, it is discarded if it can not be sent */
+    if (0 < session->length) {
+        ret             = mender_troubleshoot_shell_send_data(session, session->data, session->length);
+        session->length = 0;
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_shell_send_data(mender_troubleshoot_shell_session_t *session, void *data, size_t length) {
+
+    assert(NULL != session);
+    mender_err_t ret     = MENDER_OK;
+    void        *payload = NULL;
+
+    /* Create the header of the shell messages, it is reused until the session is closed */
+    if (NULL == session->hdr_template.data) {
+        mender_troubleshoot_protomsg_hdr_properties_status_t status     = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROPERTIES_STATUS_TYPE_NORMAL;
+        mender_troubleshoot_protomsg_hdr_properties_t        properties = { .status = &status };
+        mender_troubleshoot_protomsg_hdr_t                   hdr        = { .proto      = MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL,
+                                                                            .typ        = MENDER_TROUBLESHOOT_SHELL_MESSAGE_TYPE_SHELL,
+                                                                            .sid        = session->sid,
+                                                                            .properties = &properties };
+        if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_template_create(&hdr, &session->hdr_template))) {
+            mender_log_error("Unable to encode header");
+            goto FAIL;
+        }
+    }
+
+    /* Pack the message */
+    if (MENDER_OK != (ret = mender_troubleshoot_protomsg_hdr_template_pack(&session->hdr_template, 0, data, length, &payload, &length))) {
+        mender_log_error("Unable to encode message");
+        goto FAIL;
+    }
+
+    /* Send message, the pack buffer is given back once it has been sent */
+    ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_CONTROL, -1, NULL, NULL);
+    payload = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to send message");
+        goto FAIL;
+    }
+    session->sent = mender_scheduler_get_uptime_us();
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != payload) {
+        mender_troubleshoot_api_buffer_give(payload);
+    }
+
+    return ret;
+}
+
+static mender_troubleshoot_shell_session_t *
+mender_troubleshoot_shell_session_get(mender_troubleshoot_protomsg_t *protomsg) {
+
+    assert(NULL != protomsg);
+    assert(NULL != protomsg->hdr);
+
+    /* Look for the session of the message, the session ID is verified when the message is decoded */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL_SESSIONS_MAX; index++) {
+        mender_troubleshoot_shell_session_t *session = &mender_troubleshoot_shell_sessions[index];
+        if ((NULL != session->sid) && (0 == strcmp(session->sid, protomsg->hdr->sid))) {
+            session->activity = mender_scheduler_get_uptime_us();
+            return session;
+        }
+    }
+
+    return NULL;
+}
+
+static mender_err_t
+mender_troubleshoot_shell_session_close(mender_troubleshoot_shell_session_t *session) {
+
+    assert(NULL != session);
+    mender_err_t ret;
+
+    /* Invoke shell close callback */
+    if (NULL != mender_troubleshoot_shell_callbacks.close) {
+        if (MENDER_OK != mender_troubleshoot_shell_callbacks.close(session)) {
+            mender_log_error("An error occured");
+        }
+    }
+
+    /* Send the output pending */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_troubleshoot_shell_mutex, -1)) {
+        mender_troubleshoot_shell_flush(session);
+        mender_scheduler_mutex_give(mender_troubleshoot_shell_mutex);
+    }
+
+    /* Send stop message to the server */
+    if (MENDER_OK != (ret = mender_troubleshoot_shell_send_stop(session))) {
+        mender_log_error("Unable to send stop message to the server");
+    }
+
+    /* Release session */
+    mender_troubleshoot_shell_release(session);
+
+    return ret;
+}
+
+static void
+mender_troubleshoot_shell_release(mender_troubleshoot_shell_session_t *session) {
+
+    assert(NULL != session);
+
+    /* Take mutex used to protect access to the sessions, the session must not be used by the coalescer work meanwhile */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_shell_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return;
+    }
+
+    /* Release memory, the slot is free for a new session */
+    mender_free(session->sid);
+    session->sid = NULL;
+    mender_troubleshoot_protomsg_hdr_template_release(&session->hdr_template);
+    mender_free(session->data);
+    session->data   = NULL;
+    session->length = 0;
+
+    /* Release mutex used to protect access to the sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_shell_mutex);
+
+    /* Release the pack buffers, they are allocated again by the next session */
+    mender_troubleshoot_api_buffer_release();
+}
+
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
@@ -17,8 +17,14 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include "mender-client.h"
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-scheduler.h"
 #include "mender-troubleshoot.h"
 #include "mender-troubleshoot-api.h"
@@ -45,6 +51,34 @@
 #define CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL (30)
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL */
 
+/**
+ * @brief Default maximum reconnect interval reached by the backoff when the connections fail (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL (3600)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL */
+
+/**
+ * @brief Default reconnect jitter (percentage of the reconnect interval)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_JITTER
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_JITTER (10)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_JITTER */
+
+/**
+ * @brief Default idle timeout, the connection is closed when no session message has been received during this delay (minutes), 0 to keep the connection
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT (0)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT */
+
+/**
+ * @brief Default reconnect interval once the connection has been closed because it is idle (seconds), 0 to wait for mender_troubleshoot_connect
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_RECONNECT_INTERVAL
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_RECONNECT_INTERVAL (0)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_RECONNECT_INTERVAL */
+
 /**
  * @brief Mender troubleshoot instance
  */
@@ -61,12 +95,44 @@ static mender_troubleshoot_config_t mender_troubleshoot_config;
  */
 static void *mender_troubleshoot_healthcheck_work_handle = NULL;
 
+/**
+ * @brief Number of consecutive failures to connect, used to back off the next connections
+ */
+static uint32_t mender_troubleshoot_healthcheck_failures = 0;
+
+/**
+ * @brief State of the pseudo-random generator used to add jitter to the reconnect interval
+ */
+static uint32_t mender_troubleshoot_healthcheck_jitter = 0;
+
+#if (0 < CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT)
+
+/**
+ * @brief Uptime of the last session message received from the server (seconds)
+ */
+static uint32_t mender_troubleshoot_session_activity = 0;
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT */
+
 /**
  * @brief Mender troubleshoot healthcheck work function
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_troubleshoot_healthcheck_work_function(void);
 
+/**
+ * @brief Set the period of the healthcheck work depending of the result of the last connection, a backoff with a random jitter is applied if it has failed
+ * @param result Result of the last connection
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_healthcheck_set_period(mender_err_t result);
+
+/**
+ * @brief Disconnect the device of the server, the shell session is closed and the access to the network is released
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_disconnect(void);
+
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the websocket
  * @param data Received data
@@ -127,11 +193,20 @@ mender_troubleshoot_init(void *config, void *callbacks) {
     }
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
 
+    /* Seed the jitter of the reconnect interval, the uptime differs from one device to another */
+    mender_troubleshoot_healthcheck_failures = 0;
+    mender_troubleshoot_healthcheck_jitter   = (uint32_t)mender_scheduler_get_uptime_us() ^ 2166136261U;
+    if (0 == mender_troubleshoot_healthcheck_jitter) {
+        mender_troubleshoot_healthcheck_jitter = 1;
+    }
+
     /* Create troubleshoot healthcheck work */
     mender_scheduler_work_params_t healthcheck_work_params;
     healthcheck_work_params.function = mender_troubleshoot_healthcheck_work_function;
     healthcheck_work_params.period   = mender_troubleshoot_config.healthcheck_interval;
     healthcheck_work_params.name     = "mender_troubleshoot_healthcheck";
+    healthcheck_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    healthcheck_work_params.slack    = 0;
     if (MENDER_OK != (ret = mender_scheduler_work_create(&healthcheck_work_params, &mender_troubleshoot_healthcheck_work_handle))) {
         mender_log_error("Unable to create healthcheck work");
         goto END;
@@ -156,6 +231,15 @@ mender_troubleshoot_activate(void) {
     return ret;
 }
 
+mender_err_t
+mender_troubleshoot_connect(void) {
+
+    /* Connect the device to the server now, the backoff is reset */
+    mender_troubleshoot_healthcheck_failures = 0;
+
+    return mender_scheduler_work_execute(mender_troubleshoot_healthcheck_work_handle);
+}
+
 mender_err_t
 mender_troubleshoot_deactivate(void) {
 
@@ -166,23 +250,7 @@ mender_troubleshoot_deactivate(void) {
 
     /* Check if connection is established */
     if (true == mender_troubleshoot_api_is_connected()) {
-
-#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL
-
-        /* Deactivate shell handler */
-        if (MENDER_OK != mender_troubleshoot_shell_close()) {
-            mender_log_error("Unable to deactivate shell handler");
-        }
-
-#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
-
-        /* Disconnect the device of the server */
-        if (MENDER_OK != (ret = mender_troubleshoot_api_disconnect())) {
-            mender_log_error("Unable to disconnect the device of the server");
-        }
-
-        /* Release access to the network */
-        mender_client_network_release();
+        ret = mender_troubleshoot_disconnect();
     }
 
     return ret;
@@ -220,67 +288,145 @@ mender_troubleshoot_exit(void) {
 static mender_err_t
 mender_troubleshoot_healthcheck_work_function(void) {
 
+    uint32_t     interval = (mender_troubleshoot_config.healthcheck_interval > 0) ? (uint32_t)mender_troubleshoot_config.healthcheck_interval : 0;
+    uint32_t     inactivity;
     mender_err_t ret = MENDER_OK;
 
     /* Check if connection is established */
     if (true == mender_troubleshoot_api_is_connected()) {
 
+        /* Close the connection if it has been lost or if nothing has been received since the last ping, it is opened again with a backoff */
+        inactivity = mender_troubleshoot_api_get_inactivity();
+        if ((UINT32_MAX == inactivity) || ((0 != interval) && (inactivity >= 2 * interval))) {
+            mender_log_warning("Troubleshoot connection lost");
+            mender_troubleshoot_disconnect();
+            ret = MENDER_FAIL;
+            goto END;
+        }
+
+#if (0 < CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT)
+
+        /* Close the connection if no session message has been received during the idle timeout, it is opened again on demand or periodically */
+        if ((uint32_t)(mender_scheduler_get_uptime_us() / 1000000) - mender_troubleshoot_session_activity
+            >= (uint32_t)CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT * 60) {
+            mender_log_info("Troubleshoot connection idle, disconnecting the device of the server");
+            if (MENDER_OK != (ret = mender_troubleshoot_disconnect())) {
+                return ret;
+            }
+            return mender_scheduler_work_set_period(mender_troubleshoot_healthcheck_work_handle, CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_RECONNECT_INTERVAL);
+        }
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT */
+
 #ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL
 
         /* Shell handler healthcheck */
         if (MENDER_OK != (ret = mender_troubleshoot_shell_healthcheck())) {
             mender_log_error("Unable to perform shell healthcheck");
-            goto FAIL;
+            mender_troubleshoot_disconnect();
+            goto END;
         }
 
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
 
-    } else {
-
-        /* Request access to the network */
-        if (MENDER_OK != (ret = mender_client_network_connect())) {
-            mender_log_error("Requesting access to the network failed");
-            goto END;
+        /* Send a ping if nothing has been received during the healthcheck interval, a frame is expected before the next healthcheck */
+        if ((0 != interval) && (inactivity >= interval)) {
+            if (MENDER_OK != mender_troubleshoot_api_ping()) {
+                mender_log_warning("Unable to send ping to the server");
+            }
         }
 
-        /* Connect the device to the server */
-        if (MENDER_OK != (ret = mender_troubleshoot_api_connect(&mender_troubleshoot_data_received_callback))) {
-            mender_log_error("Unable to connect the device to the server");
-            goto END;
-        }
+        /* The connection is alive */
+        return ret;
+    }
+
+    /* Request access to the network */
+    if (MENDER_OK != (ret = mender_client_network_connect())) {
+        mender_log_error("Requesting access to the network failed");
+        goto END;
     }
 
+    /* Connect the device to the server, access to the network is released if it fails */
+    if (MENDER_OK != (ret = mender_troubleshoot_api_connect(&mender_troubleshoot_data_received_callback))) {
+        mender_log_error("Unable to connect the device to the server");
+        mender_client_network_release();
+        goto END;
+    }
+    MENDER_METRICS_ADD(MENDER_METRICS_WEBSOCKET_CONNECTIONS, 1);
+#if (0 < CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT)
+    mender_troubleshoot_session_activity = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT */
+
 END:
 
+    /* Set the period of the next connection */
+    mender_troubleshoot_healthcheck_set_period(ret);
+
     return ret;
+}
 
-#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL
+static mender_err_t
+mender_troubleshoot_healthcheck_set_period(mender_err_t result) {
 
-FAIL:
+    uint32_t period;
+    uint32_t jitter;
 
-#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
+    /* Periodic execution may be disabled */
+    if (mender_troubleshoot_config.healthcheck_interval <= 0) {
+        return MENDER_OK;
+    }
+    period = (uint32_t)mender_troubleshoot_config.healthcheck_interval;
 
-    /* Check if connection is established */
-    if (true == mender_troubleshoot_api_is_connected()) {
+    if (MENDER_OK != result) {
+
+        /* Back off exponentially on consecutive failures so that unreachable servers do not drain the battery */
+        uint32_t count = mender_troubleshoot_healthcheck_failures;
+        while ((count-- > 0) && (period < CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL)) {
+            period *= 2;
+        }
+        if ((period > CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL)
+            && ((uint32_t)mender_troubleshoot_config.healthcheck_interval < CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL)) {
+            period = CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_BACKOFF_MAX_INTERVAL;
+        }
+        mender_troubleshoot_healthcheck_failures++;
+
+        /* Add a random jitter (xorshift32) so that the devices do not reconnect at the same time */
+        jitter = (uint32_t)(((uint64_t)period * CONFIG_MENDER_CLIENT_TROUBLESHOOT_RECONNECT_JITTER) / 100);
+        if (0 != jitter) {
+            mender_troubleshoot_healthcheck_jitter ^= mender_troubleshoot_healthcheck_jitter << 13;
+            mender_troubleshoot_healthcheck_jitter ^= mender_troubleshoot_healthcheck_jitter >> 17;
+            mender_troubleshoot_healthcheck_jitter ^= mender_troubleshoot_healthcheck_jitter << 5;
+            period = period - jitter + (mender_troubleshoot_healthcheck_jitter % (2 * jitter + 1));
+        }
+    } else {
+        mender_troubleshoot_healthcheck_failures = 0;
+    }
+
+    return mender_scheduler_work_set_period(mender_troubleshoot_healthcheck_work_handle, (0 != period) ? period : 1);
+}
+
+static mender_err_t
+mender_troubleshoot_disconnect(void) {
+
+    mender_err_t ret;
 
 #ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL
 
-        /* Deactivate shell handler */
-        if (MENDER_OK != mender_troubleshoot_shell_close()) {
-            mender_log_error("Unable to deactivate shell handler");
-        }
+    /* Deactivate shell handler */
+    if (MENDER_OK != mender_troubleshoot_shell_close()) {
+        mender_log_error("Unable to deactivate shell handler");
+    }
 
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
 
-        /* Disconnect the device of the server */
-        if (MENDER_OK != mender_troubleshoot_api_disconnect()) {
-            mender_log_error("Unable to disconnect the device of the server");
-        }
-
-        /* Release access to the network */
-        mender_client_network_release();
+    /* Disconnect the device of the server */
+    if (MENDER_OK != (ret = mender_troubleshoot_api_disconnect())) {
+        mender_log_error("Unable to disconnect the device of the server");
     }
 
+    /* Release access to the network */
+    mender_client_network_release();
+
     return ret;
 }
 
@@ -307,37 +453,25 @@ mender_troubleshoot_data_received_callback(void *data, size_t length) {
         goto FAIL;
     }
 
-    /* Treatment of the message depending of the proto type */
-    switch (protomsg->hdr->proto) {
-        case MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_INVALID:
-            mender_log_error("Invalid message received");
-            ret = MENDER_FAIL;
-            break;
-#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL
-        case MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_SHELL:
-            ret = mender_troubleshoot_shell_message_handler(protomsg, &response);
-            break;
-#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_SHELL */
-        case MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_MENDER_CLIENT:
-            ret = mender_troubleshoot_mender_client_message_handler(protomsg, &response);
-            break;
-        case MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_CONTROL:
-            ret = mender_troubleshoot_control_message_handler(protomsg, &response);
-            break;
-#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER
-        case MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_FILE_TRANSFER:
-            ret = mender_troubleshoot_file_transfer_message_handler(protomsg, &response);
-            break;
-#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER */
-#ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING
-        case MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_PORT_FORWARD:
-            ret = mender_troubleshoot_port_forwarding_message_handler(protomsg, &response);
-            break;
-#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING */
-        default:
-            mender_log_error("Unsupported message received with proto type 0x%04x", protomsg->hdr->proto);
-            ret = MENDER_FAIL;
-            break;
+#if (0 < CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT)
+
+    /* Session messages keep the connection open, the control messages are not considered */
+    if (MENDER_TROUBLESHOOT_PROTOMSG_HDR_PROTO_CONTROL != protomsg->hdr->proto) {
+        mender_troubleshoot_session_activity = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_IDLE_TIMEOUT */
+
+    /* Treatment of the message depending of its type, it is resolved when the message is decoded */
+    if (NULL == protomsg->hdr->type) {
+        mender_log_error("Unsupported message received with proto type 0x%04x and message type '%s'",
+                         protomsg->hdr->proto,
+                         (NULL != protomsg->hdr->typ) ? protomsg->hdr->typ : "");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (NULL != protomsg->hdr->type->handler) {
+        ret = protomsg->hdr->type->handler(protomsg, &response);
     }
 
     /* Check if response is available */
@@ -349,8 +483,10 @@ mender_troubleshoot_data_received_callback(void *data, size_t length) {
             goto FAIL;
         }
 
-        /* Send response */
-        if (MENDER_OK != (ret = mender_troubleshoot_api_send(payload, length))) {
+        /* Send response, the pack buffer is given back once it has been sent */
+        ret     = mender_troubleshoot_api_send(payload, length, MENDER_TROUBLESHOOT_API_LANE_CONTROL, -1, NULL, NULL);
+        payload = NULL;
+        if (MENDER_OK != ret) {
             mender_log_error("Unable to send response");
             goto FAIL;
         }
@@ -362,7 +498,7 @@ FAIL:
     mender_troubleshoot_protomsg_release(protomsg);
     mender_troubleshoot_protomsg_release(response);
     if (NULL != payload) {
-        free(payload);
+        mender_troubleshoot_api_buffer_give(payload);
     }
 
     return ret;
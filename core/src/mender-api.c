@@ -17,18 +17,55 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_API
+
 #include "mender-api.h"
 #include "mender-artifact.h"
 #include "mender-http.h"
 #include "mender-log.h"
+#include "mender-metrics.h"
+#include "mender-scheduler.h"
+#include "mender-storage.h"
 #include "mender-tls.h"
+#include "mender-trace.h"
 
 /**
  * @brief Paths of the mender-server APIs
  */
 #define MENDER_API_PATH_POST_AUTHENTICATION_REQUESTS "/api/devices/v1/authentication/auth_requests"
 #define MENDER_API_PATH_GET_NEXT_DEPLOYMENT          "/api/devices/v1/deployments/device/deployments/next"
+#define MENDER_API_PATH_POST_NEXT_DEPLOYMENT         "/api/devices/v2/deployments/device/deployments/next"
 #define MENDER_API_PATH_PUT_DEPLOYMENT_STATUS        "/api/devices/v1/deployments/device/deployments/%s/status"
+#define MENDER_API_PATH_PUT_DEPLOYMENT_LOGS          "/api/devices/v1/deployments/device/deployments/%s/log"
+
+/**
+ * @brief Minimum size of the buffer allocated to store the text responses when the content length is not known
+ */
+#define MENDER_API_RESPONSE_MIN_SIZE (64)
+
+/**
+ * @brief Size of the blocks of the arenas used by the requests for their temporaries, large enough for the path and the response of the usual requests
+ */
+#define MENDER_API_ARENA_BLOCK_SIZE (512)
+
+/**
+ * @brief Capacity of the token bucket limiting the rate of the artifact downloads, given as the duration of the download at the maximum rate (milliseconds)
+ */
+#define MENDER_API_DOWNLOAD_RATE_LIMIT_BURST (250)
+
+/**
+ * @brief Interval at which the paused artifact download checks if it is resumed (milliseconds)
+ */
+#define MENDER_API_DOWNLOAD_PAUSE_POLL_INTERVAL (100)
+
+/**
+ * @brief Length of the chunks read back when the artifact download is seeked, the size of the download buffer rounded up to the TAR block size (bytes)
+ */
+#define MENDER_API_DOWNLOAD_SEEK_CHUNK_SIZE \
+    ((CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH + MENDER_ARTIFACT_STREAM_BLOCK_SIZE - 1) & ~(MENDER_ARTIFACT_STREAM_BLOCK_SIZE - 1))
 
 /**
  * @brief Mender API configuration
@@ -40,6 +77,264 @@ static mender_api_config_t mender_api_config;
  */
 static char *mender_api_jwt = NULL;
 
+/**
+ * @brief Authentication request, the payload and its signature only depend on the identity, the authentication keys and the tenant token
+ */
+static struct {
+    char *payload;   /**< Payload of the request */
+    char *signature; /**< Signature of the payload */
+} mender_api_authentication_request = { .payload = NULL, .signature = NULL };
+
+/**
+ * @brief Path of the next deployment request, it only depends on the artifact name and the device type so that it is computed once for all the polls
+ */
+static char *mender_api_next_deployment_path = NULL;
+
+/**
+ * @brief Delay requested by the server when the last authentication or check for deployments has been rejected (seconds), 0 if none
+ */
+static uint32_t mender_api_retry_after = 0;
+
+/**
+ * @brief Deployment available, read from the response as it is received
+ */
+typedef struct {
+    char **id;            /**< ID of the deployment */
+    char **artifact_name; /**< Artifact name of the deployment */
+    char **uri;           /**< URI of the artifact */
+} mender_api_deployment_t;
+
+/**
+ * @brief Artifact download
+ */
+typedef struct {
+    mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t); /**< Callback invoked to perform the treatment of the data from the artifact */
+    mender_err_t (*stage)(void *, size_t, size_t); /**< Callback invoked to store the data of the artifact without parsing it, NULL otherwise */
+    mender_artifact_ctx_t *ctx;         /**< Artifact context, kept in RAM when the download is interrupted so that it can be resumed, lost on reset */
+    size_t                 offset;      /**< Length of the artifact data already processed (bytes) */
+    size_t                 size;        /**< Total length of the artifact (bytes), 0 if unknown */
+    bool                   resumed;     /**< The download is resumed from the offset, the content of the response must be partial */
+    int                    status;      /**< HTTP status of the response, known before the data are received */
+    size_t                 received;    /**< Length of the artifact data received by the request (bytes) */
+    uint64_t               start;       /**< Uptime when the request has started (microseconds) */
+    uint32_t               allocations; /**< Number of allocations performed when the request has started */
+} mender_api_artifact_download_t;
+
+/**
+ * @brief Artifact download of the deployment
+ */
+static mender_api_artifact_download_t mender_api_artifact_download
+    = { .callback = NULL, .stage = NULL, .ctx = NULL, .offset = 0, .size = 0, .resumed = false, .status = 0 };
+
+/**
+ * @brief Token bucket limiting the rate of the artifact downloads
+ */
+static struct {
+    uint32_t rate;   /**< Maximum rate (bytes per second), 0 if unlimited */
+    int64_t  tokens; /**< Length which can be received without waiting (bytes), negative when the rate is exceeded */
+    uint64_t time;   /**< Uptime of the last refill of the bucket (microseconds) */
+} mender_api_download_rate_limit = { .rate = 0, .tokens = 0, .time = 0 };
+
+/**
+ * @brief Artifact download paused flag, accessed atomically because it is set by the application
+ */
+static bool mender_api_download_paused = false;
+
+/**
+ * @brief The connection of the artifact download has been closed because the pause lasted too long, accessed atomically
+ */
+static bool mender_api_download_pause_interrupted = false;
+
+/**
+ * @brief Perform authentication with the mender server and save the authentication token
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_request_authentication(void);
+
+/**
+ * @brief Format and sign the authentication request, which is saved to be reused by the next authentications
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_build_authentication_request(void);
+
+/**
+ * @brief Release the authentication request, it is formatted and signed again by the next authentication
+ */
+static void mender_api_release_authentication_request(void);
+
+/**
+ * @brief Perform HTTP request with the authentication token, the device is authenticated again and the request is performed once more if the token is rejected
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if none
+ * @param response Response of the request
+ * @param status Status code
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_perform_authenticated_request(char *path, mender_http_method_t method, char *payload, mender_api_response_t *response, int *status);
+
+/**
+ * @brief Resize the buffer of a text response, from the arena of the response if it has one
+ * @param response Response of the request
+ * @param size New size of the buffer
+ * @return Buffer resized, NULL if an error occurred
+ */
+static char *mender_api_response_realloc(mender_api_response_t *response, size_t size);
+
+/**
+ * @brief Check if a response is parsed as it is received
+ * @param response Response of the request
+ * @return true if the response is parsed by its JSON reader, false if it is stored
+ */
+static bool mender_api_response_is_parsed(mender_api_response_t *response);
+
+/**
+ * @brief Callback used to read the deployment available, the ID, the artifact name and the URI of the artifact are saved
+ * @param path Path of the value
+ * @param depth Depth of the value
+ * @param type Type of the value
+ * @param value Value
+ * @param params Deployment (mender_api_deployment_t)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_read_deployment_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params);
+
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+
+/**
+ * @brief Write the body of the deployment logs request, the logs captured are written in JSON format
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Parameters, not used
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_write_deployment_logs(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
+/**
+ * @brief Perform the download of the artifact of the deployment, the download is resumed if it has been interrupted
+ * @param uri URI of the deployment received from mender_api_check_for_deployment function
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_perform_artifact_download(char *uri);
+
+/**
+ * @brief Create the artifact context used to parse an artifact
+ * @return Artifact context if the function succeeds, NULL otherwise
+ */
+static mender_artifact_ctx_t *mender_api_create_artifact_ctx(void);
+
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
+
+/**
+ * @brief Default length of the leading part of the artifact downloaded to check it before the download (bytes)
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_PREFLIGHT_SIZE
+#define CONFIG_MENDER_ARTIFACT_PREFLIGHT_SIZE (32768)
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT_SIZE */
+
+/**
+ * @brief Artifact pre-flight check
+ */
+static struct {
+    mender_err_t (*callback)(char *, cJSON *, char *, size_t); /**< Callback invoked to check the payloads of the artifact */
+    mender_api_artifact_download_t download;                   /**< Download of the leading part of the artifact */
+    bool                           done;                       /**< The header of the artifact and the first file of the payload have been checked */
+} mender_api_artifact_check;
+
+/**
+ * @brief HTTP callback used to handle the leading part of the artifact content, the reading of the response is stopped when the check is done
+ * @param event HTTP client event
+ * @param data Data received
+ * @param data_length Data length
+ * @param params Callback parameters
+ * @return MENDER_OK if the function succeeds, MENDER_DONE if the check is done, error code otherwise
+ */
+static mender_err_t mender_api_http_artifact_check_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+
+/**
+ * @brief Artifact callback used to check the payloads of the artifact, data are not delivered
+ * @param type Type of the current payload
+ * @param meta_data Meta-data from the header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_artifact_check_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+/**
+ * @brief Callback invoked at the beginning of the payloads while the download of the artifact is seeked
+ */
+static mender_err_t (*mender_api_artifact_seek_payload_callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t) = NULL;
+
+/**
+ * @brief HTTP callback used to handle the leading part of the artifact while the download is seeked, the artifact context is kept at the end of the response
+ * @param event HTTP client event
+ * @param data Data received
+ * @param data_length Data length
+ * @param params Artifact download
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_http_artifact_seek_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+
+/**
+ * @brief Artifact seek callback, the payloads are resolved but no data is expected before the file
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_artifact_seek_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+/**
+ * @brief HTTP callback used to handle artifact content
+ * @param event HTTP client event
+ * @param data Data received
+ * @param data_length Data length
+ * @param params Artifact download
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_http_artifact_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+
+/**
+ * @brief Release the artifact context of a download, the download can not be resumed anymore
+ * @param download Artifact download
+ */
+static void mender_api_release_artifact_download(mender_api_artifact_download_t *download);
+
+/**
+ * @brief Pace the reception of the artifact data, the HTTP backend does not read the connection while waiting so that the server slows down
+ * @param length Length of the data received (bytes)
+ */
+static void mender_api_pace_artifact_download(size_t length);
+
+/**
+ * @brief Wait while the artifact download is paused
+ * @param connected The download is connected, the connection is closed by returning an error if the pause lasts longer than the pause timeout
+ * @return MENDER_OK if the download can continue, MENDER_FAIL if the connection must be closed
+ */
+static mender_err_t mender_api_wait_artifact_download(bool connected);
+
+/**
+ * @brief Print the statistics of an artifact download, so that the throughput of the download path can be compared between changes
+ * @param download Artifact download
+ */
+static void mender_api_print_artifact_download_statistics(mender_api_artifact_download_t *download);
+
 mender_err_t
 mender_api_init(mender_api_config_t *config) {
 
@@ -50,8 +345,13 @@ mender_api_init(mender_api_config_t *config) {
     assert(NULL != config->host);
     mender_err_t ret;
 
-    /* Save configuration */
+    /* Save configuration, the path of the next deployment request is computed again with the new artifact name and device type */
     memcpy(&mender_api_config, config, sizeof(mender_api_config_t));
+    if (NULL != mender_api_next_deployment_path) {
+        mender_free(mender_api_next_deployment_path);
+        mender_api_next_deployment_path = NULL;
+    }
+    mender_api_set_artifact_download_rate_limit(mender_api_config.artifact_download_rate_limit);
 
     /* Initializations */
     mender_http_config_t mender_http_config = { .host = mender_api_config.host };
@@ -66,243 +366,792 @@ mender_api_init(mender_api_config_t *config) {
 mender_err_t
 mender_api_perform_authentication(void) {
 
-    mender_err_t ret;
-    char        *public_key_pem   = NULL;
-    cJSON       *json_identity    = NULL;
-    char        *identity         = NULL;
-    cJSON       *json_payload     = NULL;
-    char        *payload          = NULL;
-    char        *response         = NULL;
-    char        *signature        = NULL;
-    size_t       signature_length = 0;
-    int          status           = 0;
-
-    /* Get public key in PEM format */
-    if (MENDER_OK != (ret = mender_tls_get_public_key_pem(&public_key_pem))) {
-        mender_log_error("Unable to get public key");
-        goto END;
+#ifdef CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE
+    /* Reuse the authentication token saved by a previous authentication if it is available */
+    if (NULL == mender_api_jwt) {
+        if (MENDER_OK == mender_storage_get_authentication_token(&mender_api_jwt)) {
+            mender_log_info("Using saved authentication token");
+            return MENDER_OK;
+        }
+        mender_api_jwt = NULL;
     }
+#endif /* CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE */
 
-    /* Format identity */
-    if (MENDER_OK != (ret = mender_utils_keystore_to_json(mender_api_config.identity, &json_identity))) {
-        mender_log_error("Unable to format identity");
-        goto END;
-    }
-    if (NULL == (identity = cJSON_PrintUnformatted(json_identity))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
+    /* Perform authentication with the mender server */
+    return mender_api_request_authentication();
+}
 
-    /* Format payload */
-    if (NULL == (json_payload = cJSON_CreateObject())) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    cJSON_AddStringToObject(json_payload, "id_data", identity);
-    cJSON_AddStringToObject(json_payload, "pubkey", public_key_pem);
-    if (NULL != mender_api_config.tenant_token) {
-        cJSON_AddStringToObject(json_payload, "tenant_token", mender_api_config.tenant_token);
-    }
-    if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
+char *
+mender_api_get_authentication_token(void) {
 
-    /* Sign payload */
-    if (MENDER_OK != (ret = mender_tls_sign_payload(payload, &signature, &signature_length))) {
-        mender_log_error("Unable to sign payload");
-        goto END;
-    }
+    /* Return authentication token */
+    return mender_api_jwt;
+}
 
-    /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(NULL,
-                                      MENDER_API_PATH_POST_AUTHENTICATION_REQUESTS,
-                                      MENDER_HTTP_POST,
-                                      payload,
-                                      signature,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
-        mender_log_error("Unable to perform HTTP request");
-        goto END;
+mender_err_t
+mender_api_check_for_deployment(mender_keystore_t *device_provides, char **id, char **artifact_name, char **uri) {
+
+    assert(NULL != id);
+    assert(NULL != artifact_name);
+    assert(NULL != uri);
+    mender_err_t            ret;
+    mender_json_reader_t    json;
+    mender_utils_arena_t    arena                = MENDER_UTILS_ARENA_INIT(MENDER_API_ARENA_BLOCK_SIZE);
+    cJSON                  *json_payload         = NULL;
+    cJSON                  *json_device_provides = NULL;
+    char                   *payload              = NULL;
+    int                     status               = 0;
+    mender_api_response_t   response             = { .data = NULL, .length = 0, .size = 0, .arena = &arena, .json = &json, .status = &status };
+    mender_api_deployment_t deployment           = { .id = id, .artifact_name = artifact_name, .uri = uri };
+
+    /* Reset the delay requested by the server */
+    mender_api_retry_after = 0;
+
+    /* The deployment is read from the response as it is received, the response is neither stored nor parsed to a cJSON tree */
+    if (MENDER_OK != (ret = mender_json_reader_init(&json, &mender_api_read_deployment_value, &deployment))) {
+        return ret;
     }
 
-    /* Treatment depending of the status */
-    if (200 == status) {
-        if (NULL == response) {
-            mender_log_error("Response is empty");
-            ret = MENDER_FAIL;
+    if (NULL != device_provides) {
+
+        /* Format payload, the server selects an artifact compatible with all the attributes, the artifact name and the device type are always provided */
+        if (MENDER_OK != (ret = mender_utils_keystore_to_json(device_provides, &json_device_provides))) {
+            mender_log_error("Unable to format device provides");
             goto END;
         }
-        if (NULL != mender_api_jwt) {
-            free(mender_api_jwt);
+        cJSON_DeleteItemFromObjectCaseSensitive(json_device_provides, "artifact_name");
+        cJSON_DeleteItemFromObjectCaseSensitive(json_device_provides, "device_type");
+        cJSON_AddStringToObject(json_device_provides, "artifact_name", mender_api_config.artifact_name);
+        cJSON_AddStringToObject(json_device_provides, "device_type", mender_api_config.device_type);
+        if (NULL == (json_payload = cJSON_CreateObject())) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
         }
-        if (NULL == (mender_api_jwt = strdup(response))) {
+        cJSON_AddItemToObject(json_payload, "device_provides", json_device_provides);
+        json_device_provides = NULL;
+        if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
         }
+
+        /* Perform HTTP request */
+        if (MENDER_OK
+            != (ret = mender_api_perform_authenticated_request(MENDER_API_PATH_POST_NEXT_DEPLOYMENT, MENDER_HTTP_POST, payload, &response, &status))) {
+            mender_log_error("Unable to perform HTTP request");
+            goto END;
+        }
+    } else {
+
+        /* Compute path on the first poll, it is kept for the next ones */
+        if (NULL == mender_api_next_deployment_path) {
+            size_t str_length = strlen("?artifact_name=&device_type=") + strlen(MENDER_API_PATH_GET_NEXT_DEPLOYMENT) + strlen(mender_api_config.artifact_name)
+                                + strlen(mender_api_config.device_type) + 1;
+            if (NULL == (mender_api_next_deployment_path = (char *)mender_malloc(str_length))) {
+                mender_log_error("Unable to allocate memory");
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            snprintf(mender_api_next_deployment_path,
+                     str_length,
+                     "%s?artifact_name=%s&device_type=%s",
+                     MENDER_API_PATH_GET_NEXT_DEPLOYMENT,
+                     mender_api_config.artifact_name,
+                     mender_api_config.device_type);
+        }
+
+        /* Perform HTTP request */
+        if (MENDER_OK != (ret = mender_api_perform_authenticated_request(mender_api_next_deployment_path, MENDER_HTTP_GET, NULL, &response, &status))) {
+            mender_log_error("Unable to perform HTTP request");
+            goto END;
+        }
+    }
+
+    /* Treatment depending of the status */
+    if (200 == status) {
+        if ((MENDER_OK != (ret = mender_json_reader_end(&json))) || (NULL == *uri)) {
+            mender_log_error("Invalid response");
+            ret = MENDER_FAIL;
+        }
+    } else if (204 == status) {
+        /* No response expected */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
+        if ((429 == status) || (503 == status)) {
+            mender_api_retry_after = response.retry_after;
+        }
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
-    if (NULL != signature) {
-        free(signature);
-    }
+    mender_json_reader_release(&json);
+    mender_utils_arena_release(&arena);
     if (NULL != payload) {
-        free(payload);
+        mender_free(payload);
     }
     if (NULL != json_payload) {
         cJSON_Delete(json_payload);
     }
-    if (NULL != identity) {
-        free(identity);
-    }
-    if (NULL != json_identity) {
-        cJSON_Delete(json_identity);
-    }
-    if (NULL != public_key_pem) {
-        free(public_key_pem);
+    if (NULL != json_device_provides) {
+        cJSON_Delete(json_device_provides);
     }
 
     return ret;
 }
 
-char *
-mender_api_get_authentication_token(void) {
+uint32_t
+mender_api_get_retry_after(void) {
 
-    /* Return authentication token */
-    return mender_api_jwt;
+    return mender_api_retry_after;
 }
 
 mender_err_t
-mender_api_check_for_deployment(char **id, char **artifact_name, char **uri) {
+mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status) {
 
     assert(NULL != id);
-    assert(NULL != artifact_name);
-    assert(NULL != uri);
-    mender_err_t ret;
-    char        *path     = NULL;
-    char        *response = NULL;
-    int          status   = 0;
+    mender_err_t          ret;
+    char                 *value        = NULL;
+    cJSON                *json_payload = NULL;
+    char                 *payload      = NULL;
+    char                 *path         = NULL;
+    mender_api_response_t response     = { .data = NULL, .length = 0, .size = 0, .retry_after = 0 };
+    int                   status       = 0;
+
+    /* Deployment status to string */
+    if (NULL == (value = mender_utils_deployment_status_to_string(deployment_status))) {
+        mender_log_error("Invalid status");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Format payload */
+    if (NULL == (json_payload = cJSON_CreateObject())) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    cJSON_AddStringToObject(json_payload, "status", value);
+    if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
 
     /* Compute path */
-    size_t str_length = strlen("?artifact_name=&device_type=") + strlen(MENDER_API_PATH_GET_NEXT_DEPLOYMENT) + strlen(mender_api_config.artifact_name)
-                        + strlen(mender_api_config.device_type) + 1;
-    if (NULL == (path = (char *)malloc(str_length))) {
+    size_t str_length = strlen(MENDER_API_PATH_PUT_DEPLOYMENT_STATUS) - strlen("%s") + strlen(id) + 1;
+    if (NULL == (path = (char *)mender_malloc(str_length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    snprintf(path,
-             str_length,
-             "%s?artifact_name=%s&device_type=%s",
-             MENDER_API_PATH_GET_NEXT_DEPLOYMENT,
-             mender_api_config.artifact_name,
-             mender_api_config.device_type);
+    snprintf(path, str_length, MENDER_API_PATH_PUT_DEPLOYMENT_STATUS, id);
 
     /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt, path, MENDER_HTTP_GET, NULL, NULL, &mender_api_http_text_callback, (void *)&response, &status))) {
+    if (MENDER_OK != (ret = mender_api_perform_authenticated_request(path, MENDER_HTTP_PUT, payload, &response, &status))) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
     /* Treatment depending of the status */
-    if (200 == status) {
-        cJSON *json_response = cJSON_Parse(response);
-        if (NULL != json_response) {
-            cJSON *json_id = cJSON_GetObjectItem(json_response, "id");
-            if (NULL != json_id) {
-                if (NULL == (*id = strdup(cJSON_GetStringValue(json_id)))) {
-                    ret = MENDER_FAIL;
-                    goto END;
-                }
-            }
-            cJSON *json_artifact = cJSON_GetObjectItem(json_response, "artifact");
-            if (NULL != json_artifact) {
-                cJSON *json_artifact_name = cJSON_GetObjectItem(json_artifact, "artifact_name");
-                if (NULL != json_artifact_name) {
-                    if (NULL == (*artifact_name = strdup(cJSON_GetStringValue(json_artifact_name)))) {
-                        ret = MENDER_FAIL;
-                        goto END;
-                    }
+    if (204 == status) {
+        /* No response expected */
+        ret = MENDER_OK;
+    } else if ((404 == status) || (409 == status)) {
+        /* The deployment does not exist anymore or has been aborted, publishing the status again is useless */
+        mender_api_print_response_error(response.data, status);
+        ret = MENDER_NOT_FOUND;
+    } else {
+        mender_api_print_response_error(response.data, status);
+        ret = MENDER_FAIL;
+    }
+
+END:
+
+    /* Release memory */
+    if (NULL != response.data) {
+        mender_free(response.data);
+    }
+    if (NULL != path) {
+        mender_free(path);
+    }
+    if (NULL != payload) {
+        mender_free(payload);
+    }
+    if (NULL != json_payload) {
+        cJSON_Delete(json_payload);
+    }
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+
+mender_err_t
+mender_api_publish_deployment_logs(char *id) {
+
+    assert(NULL != id);
+    mender_err_t          ret;
+    char                 *path     = NULL;
+    mender_http_body_t    body     = { .callback = &mender_api_write_deployment_logs, .params = NULL };
+    mender_api_response_t response = { .data = NULL, .length = 0, .size = 0, .retry_after = 0 };
+    int                   status   = 0;
+
+    /* Compute path */
+    size_t str_length = strlen(MENDER_API_PATH_PUT_DEPLOYMENT_LOGS) - strlen("%s") + strlen(id) + 1;
+    if (NULL == (path = (char *)mender_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    snprintf(path, str_length, MENDER_API_PATH_PUT_DEPLOYMENT_LOGS, id);
+
+    /* Perform HTTP request, the logs are written while they are sent and they are compressed if gzip is enabled */
+    if (MENDER_OK
+        != (ret = mender_http_perform_body(
+                mender_api_jwt, path, MENDER_HTTP_PUT, &body, NULL, NULL, NULL, CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, &mender_api_http_text_callback, (void *)&response, &status))) {
+        mender_log_error("Unable to perform HTTP request");
+        goto END;
+    }
+
+    /* Treatment depending of the status */
+    if (204 == status) {
+        /* No response expected */
+        ret = MENDER_OK;
+    } else {
+        mender_api_print_response_error(response.data, status);
+        ret = MENDER_FAIL;
+    }
+
+END:
+
+    /* Release memory */
+    if (NULL != response.data) {
+        mender_free(response.data);
+    }
+    if (NULL != path) {
+        mender_free(path);
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
+mender_err_t
+mender_api_download_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != uri);
+    assert(NULL != callback);
+
+    /* Parse the artifact while it is downloaded */
+    mender_api_artifact_download.callback = callback;
+    mender_api_artifact_download.stage    = NULL;
+
+    return mender_api_perform_artifact_download(uri);
+}
+
+size_t
+mender_api_get_artifact_download_offset(void) {
+
+    return mender_api_artifact_download.offset;
+}
+
+size_t
+mender_api_get_artifact_download_size(void) {
+
+    return (0 != mender_api_artifact_download.offset) ? mender_api_artifact_download.size : 0;
+}
+
+void
+mender_api_cancel_artifact_download(void) {
+
+    /* Release the artifact context, the next download starts from the beginning */
+    mender_api_release_artifact_download(&mender_api_artifact_download);
+}
+
+void
+mender_api_set_artifact_download_rate_limit(uint32_t rate) {
+
+    /* Set the rate, it applies to the download in progress */
+    mender_api_download_rate_limit.rate = rate;
+}
+
+void
+mender_api_pause_artifact_download(void) {
+
+    /* Pause the download, it is waiting the next time data are received */
+    __atomic_store_n(&mender_api_download_paused, true, __ATOMIC_RELAXED);
+}
+
+bool
+mender_api_resume_artifact_download(void) {
+
+    /* Resume the download */
+    __atomic_store_n(&mender_api_download_paused, false, __ATOMIC_RELAXED);
+
+    return __atomic_exchange_n(&mender_api_download_pause_interrupted, false, __ATOMIC_RELAXED);
+}
+
+mender_err_t
+mender_api_stage_artifact(char *uri, mender_err_t (*callback)(void *, size_t, size_t)) {
+
+    assert(NULL != uri);
+    assert(NULL != callback);
+
+    /* Store the data of the artifact, no artifact context is created */
+    mender_api_artifact_download.callback = NULL;
+    mender_api_artifact_download.stage    = callback;
+
+    return mender_api_perform_artifact_download(uri);
+}
+
+mender_err_t
+mender_api_process_staged_artifact(size_t                 size,
+                                   mender_err_t (*read)(void *, size_t, size_t),
+                                   mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != read);
+    assert(NULL != callback);
+    mender_err_t           ret = MENDER_OK;
+    mender_artifact_ctx_t *ctx;
+    void                  *buffer;
+    size_t                 length;
+
+    /* Create new artifact context */
+    if (NULL == (ctx = mender_api_create_artifact_ctx())) {
+        mender_log_error("Unable to create artifact context");
+        return MENDER_FAIL;
+    }
+
+    /* Allocate memory to read back the artifact by chunks of the size of the download buffer */
+    if (NULL == (buffer = mender_malloc(CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Parse the artifact as if it were downloaded */
+    for (size_t index = 0; index < size; index += length) {
+        length = ((size - index) < CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH) ? (size - index) : CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH;
+        if (MENDER_OK != (ret = read(buffer, index, length))) {
+            mender_log_error("Unable to read staged artifact");
+            goto END;
+        }
+        MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_ARTIFACT_PROCESS_DATA);
+        ret = mender_artifact_process_data(ctx, buffer, length, callback);
+        MENDER_TRACE_END(MENDER_TRACE_EVENT_ARTIFACT_PROCESS_DATA);
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to process data");
+            goto END;
+        }
+    }
+
+    /* Check the staged artifact is complete */
+    ret = mender_artifact_check_complete(ctx);
+
+END:
+
+    /* Release memory */
+    mender_free(buffer);
+    mender_artifact_release_ctx(ctx);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
+
+mender_err_t
+mender_api_check_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t)) {
+
+    assert(NULL != uri);
+    assert(NULL != callback);
+    mender_err_t ret;
+    char         range[32];
+
+    /* Initialize the check */
+    mender_api_artifact_check.callback         = callback;
+    mender_api_artifact_check.download.resumed = false;
+    mender_api_artifact_check.download.status  = 0;
+    mender_api_artifact_check.done             = false;
+
+    /* Perform HTTP request, only the leading part of the artifact is requested, the reading is stopped anyway if the server ignores the range */
+    snprintf(range, sizeof(range), "bytes=0-%d", CONFIG_MENDER_ARTIFACT_PREFLIGHT_SIZE - 1);
+    if (MENDER_OK
+        != (ret = mender_http_perform(NULL,
+                                      uri,
+                                      MENDER_HTTP_GET,
+                                      NULL,
+                                      NULL,
+                                      range,
+                                      CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH,
+                                      &mender_api_http_artifact_check_callback,
+                                      &mender_api_artifact_check.download,
+                                      &mender_api_artifact_check.download.status))) {
+        mender_log_error("Unable to perform HTTP request");
+        goto END;
+    }
+
+    /* Treatment depending of the status */
+    if ((206 == mender_api_artifact_check.download.status) || (200 == mender_api_artifact_check.download.status)) {
+        if (false == mender_api_artifact_check.done) {
+            mender_log_warning("Header of the artifact is larger than the pre-flight size, it is checked during the download");
+        }
+        ret = MENDER_OK;
+    } else {
+        mender_api_print_response_error(NULL, mender_api_artifact_check.download.status);
+        ret = MENDER_FAIL;
+    }
+
+END:
+
+    /* Release the artifact context, the leading part of the artifact is never resumed */
+    mender_api_release_artifact_download(&mender_api_artifact_check.download);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+mender_err_t
+mender_api_get_artifact_file_position(char **name, size_t *offset) {
+
+    assert(NULL != name);
+    assert(NULL != offset);
+    mender_artifact_ctx_t *ctx = mender_api_artifact_download.ctx;
+
+    /* The offset of the data of the file is not known if it is compressed */
+    if ((NULL == ctx) || (MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA != ctx->stream_state) || (0 == ctx->file.offset)) {
+        return MENDER_NOT_FOUND;
+    }
+    *name   = ctx->file.name;
+    *offset = ctx->file.offset;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_api_seek_artifact_download(char *uri,
+                                  mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t),
+                                  char  *name,
+                                  size_t offset,
+                                  size_t index,
+                                  mender_err_t (*read)(void *, size_t, size_t)) {
+
+    assert(NULL != uri);
+    assert(NULL != callback);
+    assert(NULL != name);
+    assert(0 != offset);
+    assert(NULL != read);
+    mender_err_t           ret;
+    char                   range[32];
+    mender_artifact_ctx_t *ctx;
+    void                  *buffer = NULL;
+    size_t                 length;
+
+    /* Release the interrupted download, the artifact is parsed again from the beginning */
+    mender_api_release_artifact_download(&mender_api_artifact_download);
+
+    /* Download the artifact up to the data of the file, the content must be partial so that no data of the file is received */
+    mender_api_artifact_seek_payload_callback = callback;
+    mender_api_artifact_download.stage        = NULL;
+    mender_api_artifact_download.resumed      = true;
+    mender_api_artifact_download.status       = 0;
+    mender_api_artifact_download.received     = 0;
+    mender_api_artifact_download.start        = mender_scheduler_get_uptime_us();
+    snprintf(range, sizeof(range), "bytes=0-%zu", offset - 1);
+    if (MENDER_OK
+        != (ret = mender_http_perform(NULL,
+                                      uri,
+                                      MENDER_HTTP_GET,
+                                      NULL,
+                                      NULL,
+                                      range,
+                                      CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH,
+                                      &mender_api_http_artifact_seek_callback,
+                                      &mender_api_artifact_download,
+                                      &mender_api_artifact_download.status))) {
+        mender_log_error("Unable to perform HTTP request");
+        goto END;
+    }
+    if (206 != mender_api_artifact_download.status) {
+        mender_api_print_response_error(NULL, mender_api_artifact_download.status);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Check the data of the file are reached */
+    ctx = mender_api_artifact_download.ctx;
+    if ((offset != mender_api_artifact_download.offset) || (NULL == ctx) || (MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA != ctx->stream_state)
+        || (strcmp(ctx->file.name, name)) || (offset != ctx->file.offset) || (0 != ctx->file.index)) {
+        mender_log_error("Unable to seek to the data of the file '%s'", name);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Allocate memory to read back the data by chunks of the size of the download buffer, rounded to the TAR block size */
+    if (NULL == (buffer = mender_malloc(MENDER_API_DOWNLOAD_SEEK_CHUNK_SIZE))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Read back the data already written, they are skipped once the checksum of the file has been updated */
+    for (size_t i = 0; i < index; i += length) {
+        length = ((index - i) < MENDER_API_DOWNLOAD_SEEK_CHUNK_SIZE) ? (index - i) : MENDER_API_DOWNLOAD_SEEK_CHUNK_SIZE;
+        if (MENDER_OK != (ret = read(buffer, i, length))) {
+            mender_log_error("Unable to read back the data of the file '%s'", name);
+            goto END;
+        }
+        if (MENDER_OK != (ret = mender_artifact_skip_data(ctx, buffer, length))) {
+            mender_log_error("Unable to skip the data of the file '%s'", name);
+            goto END;
+        }
+    }
+
+    /* The download is then resumed from the data which have not been written */
+    mender_api_artifact_download.offset = offset + index;
+
+END:
+
+    /* Release memory, the artifact context is released if the download can not be resumed */
+    mender_free(buffer);
+    if (MENDER_OK != ret) {
+        mender_api_release_artifact_download(&mender_api_artifact_download);
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+mender_err_t
+mender_api_http_text_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+
+    assert(NULL != params);
+    mender_api_response_t *response = (mender_api_response_t *)params;
+    mender_err_t           ret      = MENDER_OK;
+    char                  *tmp;
+    size_t                 size;
+
+    /* Treatment depending of the event */
+    switch (event) {
+        case MENDER_HTTP_EVENT_CONNECTED:
+            /* Nothing to do */
+            break;
+        case MENDER_HTTP_EVENT_HEADERS_RECEIVED:
+            /* Save the delay requested by the server */
+            if (NULL != data) {
+                response->retry_after = ((mender_http_headers_t *)data)->retry_after;
+            }
+            /* Allocate the buffer of the response at once if the content length is known, the buffer grows when the data are received otherwise */
+            if ((0 != data_length) && (response->length + data_length + 1 > response->size) && (false == mender_api_response_is_parsed(response))) {
+                if (NULL != (tmp = mender_api_response_realloc(response, response->length + data_length + 1))) {
+                    response->data = tmp;
+                    response->size = response->length + data_length + 1;
                 }
-                cJSON *json_source = cJSON_GetObjectItem(json_artifact, "source");
-                if (NULL != json_source) {
-                    cJSON *json_uri = cJSON_GetObjectItem(json_source, "uri");
-                    if (NULL != json_uri) {
-                        if (NULL == (*uri = strdup(cJSON_GetStringValue(json_uri)))) {
-                            ret = MENDER_FAIL;
-                            goto END;
-                        }
-                        ret = MENDER_OK;
-                    } else {
-                        mender_log_error("Invalid response");
-                        ret = MENDER_FAIL;
-                    }
-                } else {
+            }
+            break;
+        case MENDER_HTTP_EVENT_DATA_RECEIVED:
+            /* Check input data */
+            if ((NULL == data) || (0 == data_length)) {
+                mender_log_error("Invalid data received");
+                ret = MENDER_FAIL;
+                break;
+            }
+            /* Parse the response as it is received if it is expected to be JSON, it is not stored */
+            if (true == mender_api_response_is_parsed(response)) {
+                if (MENDER_OK != (ret = mender_json_reader_process(response->json, data, data_length))) {
                     mender_log_error("Invalid response");
+                }
+                break;
+            }
+            /* Grow the buffer of the response geometrically if the data do not fit */
+            if (response->length + data_length + 1 > response->size) {
+                size = (0 != response->size) ? response->size : MENDER_API_RESPONSE_MIN_SIZE;
+                while (size < response->length + data_length + 1) {
+                    size *= 2;
+                }
+                if (NULL == (tmp = mender_api_response_realloc(response, size))) {
+                    mender_log_error("Unable to allocate memory");
                     ret = MENDER_FAIL;
+                    break;
                 }
+                response->data = tmp;
+                response->size = size;
+            }
+            /* Concatenate data to the response */
+            memcpy(response->data + response->length, data, data_length);
+            response->length += data_length;
+            response->data[response->length] = '\0';
+            break;
+        case MENDER_HTTP_EVENT_DISCONNECTED:
+            /* Nothing to do */
+            break;
+        case MENDER_HTTP_EVENT_ERROR:
+            /* Downloading the response fails */
+            mender_log_error("An error occurred");
+            ret = MENDER_FAIL;
+            break;
+        default:
+            /* Should no occur */
+            ret = MENDER_FAIL;
+            break;
+    }
+
+    return ret;
+}
+
+void
+mender_api_print_response_error(char *response, int status) {
+
+    char *desc;
+
+    /* Treatment depending of the status */
+    if (NULL != (desc = mender_utils_http_status_to_string(status))) {
+        if (NULL != response) {
+            cJSON *json_response = cJSON_Parse(response);
+            if (NULL != json_response) {
+                cJSON *json_error = cJSON_GetObjectItemCaseSensitive(json_response, "error");
+                if (NULL != json_error) {
+                    mender_log_error("[%d] %s: %s", status, desc, cJSON_GetStringValue(json_error));
+                } else {
+                    mender_log_error("[%d] %s: unknown error", status, desc);
+                }
+                cJSON_Delete(json_response);
             } else {
-                mender_log_error("Invalid response");
-                ret = MENDER_FAIL;
+                mender_log_error("[%d] %s: unknown error", status, desc);
             }
-            cJSON_Delete(json_response);
         } else {
-            mender_log_error("Invalid response");
+            mender_log_error("[%d] %s: unknown error", status, desc);
+        }
+    } else {
+        mender_log_error("Unknown error occurred, status=%d", status);
+    }
+}
+
+mender_err_t
+mender_api_exit(void) {
+
+    /* Release all modules */
+    mender_http_exit();
+
+    /* Release memory */
+    mender_api_release_artifact_download(&mender_api_artifact_download);
+    mender_api_release_authentication_request();
+    if (NULL != mender_api_jwt) {
+        mender_free(mender_api_jwt);
+        mender_api_jwt = NULL;
+    }
+    if (NULL != mender_api_next_deployment_path) {
+        mender_free(mender_api_next_deployment_path);
+        mender_api_next_deployment_path = NULL;
+    }
+    mender_api_retry_after = 0;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_api_request_authentication(void) {
+
+    mender_err_t          ret;
+    mender_api_response_t response = { .data = NULL, .length = 0, .size = 0, .retry_after = 0 };
+    int                   status   = 0;
+
+    /* Reset the delay requested by the server */
+    mender_api_retry_after = 0;
+    MENDER_METRICS_ADD(MENDER_METRICS_AUTHENTICATION_ATTEMPTS, 1);
+
+    /* Format and sign the authentication request if it has not been done yet */
+    if (NULL == mender_api_authentication_request.payload) {
+        if (MENDER_OK != (ret = mender_api_build_authentication_request())) {
+            mender_log_error("Unable to build authentication request");
+            goto END;
+        }
+    }
+
+    /* Perform HTTP request */
+    if (MENDER_OK
+        != (ret = mender_http_perform(NULL,
+                                      MENDER_API_PATH_POST_AUTHENTICATION_REQUESTS,
+                                      MENDER_HTTP_POST,
+                                      mender_api_authentication_request.payload,
+                                      mender_api_authentication_request.signature,
+                                      NULL,
+                                      CONFIG_MENDER_HTTP_RECV_BUF_LENGTH,
+                                      &mender_api_http_text_callback,
+                                      (void *)&response,
+                                      &status))) {
+        mender_log_error("Unable to perform HTTP request");
+        goto END;
+    }
+
+    /* Treatment depending of the status */
+    if (200 == status) {
+        if (NULL == response.data) {
+            mender_log_error("Response is empty");
             ret = MENDER_FAIL;
+            goto END;
         }
-    } else if (204 == status) {
-        /* No response expected */
+        if (NULL != mender_api_jwt) {
+            mender_free(mender_api_jwt);
+        }
+        if (NULL == (mender_api_jwt = mender_strdup(response.data))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+#ifdef CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE
+        /* Save the authentication token so that it can be reused after a restart */
+        if (MENDER_OK != mender_storage_set_authentication_token(mender_api_jwt)) {
+            mender_log_error("Unable to save authentication token");
+        }
+#endif /* CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
+        if ((429 == status) || (503 == status)) {
+            mender_api_retry_after = response.retry_after;
+        }
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
-    if (NULL != path) {
-        free(path);
+    if (NULL != response.data) {
+        mender_free(response.data);
     }
 
     return ret;
 }
 
-mender_err_t
-mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status) {
-
-    assert(NULL != id);
+static mender_err_t
+mender_api_build_authentication_request(void) {
+
     mender_err_t ret;
-    char        *value        = NULL;
-    cJSON       *json_payload = NULL;
-    char        *payload      = NULL;
-    char        *path         = NULL;
-    char        *response     = NULL;
-    int          status       = 0;
+    char        *public_key_pem   = NULL;
+    char        *identity         = NULL;
+    cJSON       *json_payload     = NULL;
+    char        *payload          = NULL;
+    char        *signature        = NULL;
+    size_t       signature_length = 0;
 
-    /* Deployment status to string */
-    if (NULL == (value = mender_utils_deployment_status_to_string(deployment_status))) {
-        mender_log_error("Invalid status");
-        ret = MENDER_FAIL;
+    /* Get public key in PEM format */
+    if (MENDER_OK != (ret = mender_tls_get_public_key_pem(&public_key_pem))) {
+        mender_log_error("Unable to get public key");
+        goto END;
+    }
+
+    /* Format identity */
+    if (MENDER_OK != (ret = mender_utils_keystore_to_json_string(mender_api_config.identity, &identity))) {
+        mender_log_error("Unable to format identity");
         goto END;
     }
 
@@ -312,152 +1161,296 @@ mender_api_publish_deployment_status(char *id, mender_deployment_status_t deploy
         ret = MENDER_FAIL;
         goto END;
     }
-    cJSON_AddStringToObject(json_payload, "status", value);
-    if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
+    cJSON_AddStringToObject(json_payload, "id_data", identity);
+    cJSON_AddStringToObject(json_payload, "pubkey", public_key_pem);
+    if (NULL != mender_api_config.tenant_token) {
+        cJSON_AddStringToObject(json_payload, "tenant_token", mender_api_config.tenant_token);
     }
-
-    /* Compute path */
-    size_t str_length = strlen(MENDER_API_PATH_PUT_DEPLOYMENT_STATUS) - strlen("%s") + strlen(id) + 1;
-    if (NULL == (path = (char *)malloc(str_length))) {
+    if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    snprintf(path, str_length, MENDER_API_PATH_PUT_DEPLOYMENT_STATUS, id);
 
-    /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt, path, MENDER_HTTP_PUT, payload, NULL, &mender_api_http_text_callback, (void *)&response, &status))) {
-        mender_log_error("Unable to perform HTTP request");
+    /* Sign payload */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_TLS_SIGN_PAYLOAD);
+    ret = mender_tls_sign_payload(payload, &signature, &signature_length);
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_TLS_SIGN_PAYLOAD);
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to sign payload");
         goto END;
     }
 
-    /* Treatment depending of the status */
-    if (204 == status) {
-        /* No response expected */
-        ret = MENDER_OK;
-    } else {
-        mender_api_print_response_error(response, status);
-        ret = MENDER_FAIL;
-    }
+    /* Save the authentication request, the memory is released with the cache */
+    mender_api_release_authentication_request();
+    mender_api_authentication_request.payload   = payload;
+    mender_api_authentication_request.signature = signature;
+    payload                                     = NULL;
+    signature                                   = NULL;
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
-    if (NULL != path) {
-        free(path);
+    if (NULL != signature) {
+        mender_free(signature);
     }
     if (NULL != payload) {
-        free(payload);
+        mender_free(payload);
     }
     if (NULL != json_payload) {
         cJSON_Delete(json_payload);
     }
+    if (NULL != identity) {
+        mender_free(identity);
+    }
 
     return ret;
 }
 
-mender_err_t
-mender_api_download_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+static void
+mender_api_release_authentication_request(void) {
 
-    assert(NULL != uri);
-    assert(NULL != callback);
+    /* Release memory */
+    if (NULL != mender_api_authentication_request.payload) {
+        mender_free(mender_api_authentication_request.payload);
+        mender_api_authentication_request.payload = NULL;
+    }
+    if (NULL != mender_api_authentication_request.signature) {
+        mender_free(mender_api_authentication_request.signature);
+        mender_api_authentication_request.signature = NULL;
+    }
+}
+
+static char *
+mender_api_response_realloc(mender_api_response_t *response, size_t size) {
+
+    assert(NULL != response);
+
+    /* Resize the buffer from the arena of the response, the previous buffer is released with the arena */
+    if (NULL != response->arena) {
+        return (char *)mender_utils_arena_realloc(response->arena, response->data, response->size, size);
+    }
+
+    return (char *)mender_realloc(response->data, size);
+}
+
+static bool
+mender_api_response_is_parsed(mender_api_response_t *response) {
+
+    assert(NULL != response);
+
+    /* The responses with an error status are stored so that the error can be printed */
+    return (NULL != response->json) && (NULL != response->status) && (200 == *response->status);
+}
+
+static mender_err_t
+mender_api_read_deployment_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params) {
+
+    assert(NULL != path);
+    assert(NULL != value);
+    assert(NULL != params);
+    mender_api_deployment_t *deployment = (mender_api_deployment_t *)params;
+    char                   **field;
+
+    /* Retrieve the field of the value, the other values are ignored */
+    if ((1 == depth) && (!strcmp(path, "id"))) {
+        field = deployment->id;
+    } else if ((2 == depth) && (!strcmp(path, "artifact.artifact_name"))) {
+        field = deployment->artifact_name;
+    } else if ((3 == depth) && (!strcmp(path, "artifact.source.uri"))) {
+        field = deployment->uri;
+    } else {
+        return MENDER_OK;
+    }
+    if (MENDER_JSON_TYPE_STRING != type) {
+        mender_log_error("Invalid response");
+        return MENDER_FAIL;
+    }
+
+    /* Save the value, the last one is kept if it is duplicated */
+    if (NULL != *field) {
+        mender_free(*field);
+    }
+    if (NULL == (*field = mender_strdup(value))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+
+static mender_err_t
+mender_api_write_deployment_logs(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+    (void)params;
+
+    /* Write the logs captured */
+    return mender_log_capture_write_json(write, ctx);
+}
+
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
+static mender_err_t
+mender_api_perform_authenticated_request(char *path, mender_http_method_t method, char *payload, mender_api_response_t *response, int *status) {
+
+    assert(NULL != path);
+    assert(NULL != response);
+    assert(NULL != status);
     mender_err_t ret;
-    int          status = 0;
 
     /* Perform HTTP request */
-    if (MENDER_OK != (ret = mender_http_perform(NULL, uri, MENDER_HTTP_GET, NULL, NULL, &mender_api_http_artifact_callback, callback, &status))) {
+    if (MENDER_OK
+        != (ret = mender_http_perform(
+                mender_api_jwt, path, method, payload, NULL, NULL, CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, &mender_api_http_text_callback, (void *)response, status))) {
+        return ret;
+    }
+
+    /* Check if the authentication token has been rejected, it is probably expired or the device has been decommissioned */
+    if (401 != *status) {
+        return MENDER_OK;
+    }
+    mender_log_info("Authentication token rejected, authenticating again");
+
+    /* Release the response and the authentication token, the buffer allocated from an arena is released with the arena */
+    if ((NULL != response->data) && (NULL == response->arena)) {
+        mender_free(response->data);
+    }
+    response->data        = NULL;
+    response->length      = 0;
+    response->size        = 0;
+    response->retry_after = 0;
+    if (NULL != mender_api_jwt) {
+        mender_free(mender_api_jwt);
+        mender_api_jwt = NULL;
+    }
+#ifdef CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE
+    mender_storage_delete_authentication_token();
+#endif /* CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE */
+
+    /* Perform authentication with the mender server */
+    if (MENDER_OK != (ret = mender_api_request_authentication())) {
+        mender_log_error("Unable to perform authentication");
+        return ret;
+    }
+
+    /* Perform HTTP request again with the new authentication token */
+    *status = 0;
+    return mender_http_perform(
+        mender_api_jwt, path, method, payload, NULL, NULL, CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, &mender_api_http_text_callback, (void *)response, status);
+}
+
+static mender_err_t
+mender_api_perform_artifact_download(char *uri) {
+
+    assert(NULL != uri);
+    mender_err_t ret;
+    char         range[32];
+
+    /* Wait before connecting if the download is paused */
+    mender_api_wait_artifact_download(false);
+
+    /* Resume the download from the end of the data already processed if it has been interrupted */
+    mender_api_artifact_download.resumed  = (0 != mender_api_artifact_download.offset);
+    mender_api_artifact_download.status   = 0;
+    mender_api_artifact_download.received = 0;
+    mender_api_artifact_download.start    = mender_scheduler_get_uptime_us();
+    mender_api_download_rate_limit.tokens = 0;
+    mender_api_download_rate_limit.time   = mender_api_artifact_download.start;
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+    mender_utils_heap_statistics_t statistics;
+    if (MENDER_OK == mender_utils_get_heap_statistics(MENDER_UTILS_HEAP_SUBSYSTEM_ALL, &statistics)) {
+        mender_api_artifact_download.allocations = statistics.allocations;
+    }
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+    if (true == mender_api_artifact_download.resumed) {
+        mender_log_info("Resuming download of the artifact at offset %zu", mender_api_artifact_download.offset);
+        MENDER_METRICS_ADD(MENDER_METRICS_DOWNLOAD_RETRIES, 1);
+        snprintf(range, sizeof(range), "bytes=%zu-", mender_api_artifact_download.offset);
+    }
+
+    /* Perform HTTP request, the artifact context is kept if the connection is lost */
+    if (MENDER_OK
+        != (ret = mender_http_perform(NULL,
+                                      uri,
+                                      MENDER_HTTP_GET,
+                                      NULL,
+                                      NULL,
+                                      (true == mender_api_artifact_download.resumed) ? range : NULL,
+                                      CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH,
+                                      &mender_api_http_artifact_callback,
+                                      &mender_api_artifact_download,
+                                      &mender_api_artifact_download.status))) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
     /* Treatment depending of the status */
-    if (200 == status) {
-        /* Nothing to do */
+    if ((200 == mender_api_artifact_download.status) || (206 == mender_api_artifact_download.status)) {
+        mender_api_print_artifact_download_statistics(&mender_api_artifact_download);
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(NULL, status);
+        mender_api_print_response_error(NULL, mender_api_artifact_download.status);
         ret = MENDER_FAIL;
     }
 
 END:
 
+    /* Release the artifact context if the download can not be resumed */
+    if (0 == mender_api_artifact_download.offset) {
+        mender_api_release_artifact_download(&mender_api_artifact_download);
+    }
+
     return ret;
 }
 
-mender_err_t
-mender_api_http_text_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+static mender_artifact_ctx_t *
+mender_api_create_artifact_ctx(void) {
 
-    assert(NULL != params);
-    char       **response = (char **)params;
-    mender_err_t ret      = MENDER_OK;
-    char        *tmp;
+    mender_artifact_ctx_t *ctx;
 
-    /* Treatment depending of the event */
-    switch (event) {
-        case MENDER_HTTP_EVENT_CONNECTED:
-            /* Nothing to do */
-            break;
-        case MENDER_HTTP_EVENT_DATA_RECEIVED:
-            /* Check input data */
-            if ((NULL == data) || (0 == data_length)) {
-                mender_log_error("Invalid data received");
-                ret = MENDER_FAIL;
-                break;
-            }
-            /* Concatenate data to the response */
-            size_t response_length = (NULL != *response) ? strlen(*response) : 0;
-            if (NULL == (tmp = realloc(*response, response_length + data_length + 1))) {
-                mender_log_error("Unable to allocate memory");
-                ret = MENDER_FAIL;
-                break;
-            }
-            *response = tmp;
-            memcpy((*response) + response_length, data, data_length);
-            *((*response) + response_length + data_length) = '\0';
-            break;
-        case MENDER_HTTP_EVENT_DISCONNECTED:
-            /* Nothing to do */
-            break;
-        case MENDER_HTTP_EVENT_ERROR:
-            /* Downloading the response fails */
-            mender_log_error("An error occurred");
-            ret = MENDER_FAIL;
-            break;
-        default:
-            /* Should no occur */
-            ret = MENDER_FAIL;
-            break;
+    /* Create new artifact context */
+    if (NULL == (ctx = mender_artifact_create_ctx())) {
+        return NULL;
     }
 
-    return ret;
+    /* Set function used to select the meta-data values of the artifact */
+    ctx->meta_data_filter = mender_api_config.artifact_meta_data_filter;
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    /* Set public key used to verify the signature of the artifact */
+    ctx->signature.key = mender_api_config.artifact_verify_key;
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
+    return ctx;
 }
 
-mender_err_t
+static mender_err_t
 mender_api_http_artifact_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
 
     assert(NULL != params);
-    mender_err_t ret = MENDER_OK;
-
-    /* Artifact context */
-    static mender_artifact_ctx_t *mender_artifact_ctx = NULL;
+    mender_api_artifact_download_t *download = (mender_api_artifact_download_t *)params;
+    mender_err_t                    ret      = MENDER_OK;
 
     /* Treatment depending of the event */
     switch (event) {
         case MENDER_HTTP_EVENT_CONNECTED:
+            /* Check if the download is resumed, the artifact context is kept in this case, there is no artifact context if the artifact is staged */
+            if ((NULL != download->ctx) || (NULL != download->stage)) {
+                break;
+            }
             /* Create new artifact context */
-            if (NULL == (mender_artifact_ctx = mender_artifact_create_ctx())) {
+            if (NULL == (download->ctx = mender_api_create_artifact_ctx())) {
                 mender_log_error("Unable to create artifact context");
                 ret = MENDER_FAIL;
                 break;
             }
             break;
+        case MENDER_HTTP_EVENT_HEADERS_RECEIVED:
+            /* Compute the total length of the artifact from the content length, which is the remaining length if the download is resumed */
+            download->size = (0 != data_length) ? (download->offset + data_length) : 0;
+            break;
         case MENDER_HTTP_EVENT_DATA_RECEIVED:
             /* Check input data */
             if ((NULL == data) || (0 == data_length)) {
@@ -466,29 +1459,60 @@ mender_api_http_artifact_callback(mender_http_client_event_t event, void *data,
                 break;
             }
             /* Check artifact context */
-            if (NULL == mender_artifact_ctx) {
+            if ((NULL == download->ctx) && (NULL == download->stage)) {
                 mender_log_error("Invalid artifact context");
                 ret = MENDER_FAIL;
                 break;
             }
-            /* Parse input data */
-            if (MENDER_OK != (ret = mender_artifact_process_data(mender_artifact_ctx, data, data_length, params))) {
+            /* Check the status, the content must be partial if the download is resumed */
+            if ((206 != download->status) && ((200 != download->status) || (true == download->resumed))) {
+                mender_log_error("Unexpected HTTP status %d", download->status);
+                mender_api_release_artifact_download(download);
+                ret = MENDER_FAIL;
+                break;
+            }
+            /* Parse or store input data, the download can not be resumed if an error occurs */
+            if (NULL != download->stage) {
+                ret = download->stage(data, download->offset, data_length);
+            } else {
+                MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_ARTIFACT_PROCESS_DATA);
+                ret = mender_artifact_process_data(download->ctx, data, data_length, download->callback);
+                MENDER_TRACE_END(MENDER_TRACE_EVENT_ARTIFACT_PROCESS_DATA);
+            }
+            if (MENDER_OK != ret) {
                 mender_log_error("Unable to process data");
+                mender_api_release_artifact_download(download);
+                break;
+            }
+            download->offset   += data_length;
+            download->received += data_length;
+            MENDER_METRICS_ADD(MENDER_METRICS_BYTES_DOWNLOADED, (uint32_t)data_length);
+            mender_api_pace_artifact_download(data_length);
+            /* Stop reading while the download of the deployment is paused, it is resumed from the offset if the connection is closed */
+            if ((&mender_api_artifact_download == download) && (MENDER_OK != (ret = mender_api_wait_artifact_download(true)))) {
                 break;
             }
+            /* Report the progress of the download of the deployment, the leading part downloaded to check the artifact is not reported */
+            if ((&mender_api_artifact_download == download) && (NULL != mender_api_config.artifact_download_progress)) {
+                mender_api_config.artifact_download_progress(download->offset, download->size);
+            }
             break;
         case MENDER_HTTP_EVENT_DISCONNECTED:
+            /* Check the artifact of the deployment is complete, the response may end before the end of the artifact */
+            if ((&mender_api_artifact_download == download) && (NULL != download->ctx)
+                && (MENDER_OK != (ret = mender_artifact_check_complete(download->ctx)))) {
+                mender_log_error("Unable to process data");
+            }
             /* Release artifact context */
-            mender_artifact_release_ctx(mender_artifact_ctx);
-            mender_artifact_ctx = NULL;
+            mender_api_release_artifact_download(download);
             break;
         case MENDER_HTTP_EVENT_ERROR:
-            /* Downloading the artifact fails */
+            /* Downloading the artifact fails, the artifact context is kept if data have already been processed so that the download can be resumed */
             mender_log_error("An error occurred");
             ret = MENDER_FAIL;
-            /* Release artifact context */
-            mender_artifact_release_ctx(mender_artifact_ctx);
-            mender_artifact_ctx = NULL;
+            if (0 == download->offset) {
+                mender_api_release_artifact_download(download);
+            }
             break;
         default:
             /* Should not occur */
@@ -499,45 +1523,183 @@ mender_api_http_artifact_callback(mender_http_client_event_t event, void *data,
     return ret;
 }
 
-void
-mender_api_print_response_error(char *response, int status) {
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
 
-    char *desc;
+static mender_err_t
+mender_api_http_artifact_check_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
 
-    /* Treatment depending of the status */
-    if (NULL != (desc = mender_utils_http_status_to_string(status))) {
-        if (NULL != response) {
-            cJSON *json_response = cJSON_Parse(response);
-            if (NULL != json_response) {
-                cJSON *json_error = cJSON_GetObjectItemCaseSensitive(json_response, "error");
-                if (NULL != json_error) {
-                    mender_log_error("[%d] %s: %s", status, desc, cJSON_GetStringValue(json_error));
-                } else {
-                    mender_log_error("[%d] %s: unknown error", status, desc);
-                }
-                cJSON_Delete(json_response);
-            } else {
-                mender_log_error("[%d] %s: unknown error", status, desc);
-            }
-        } else {
-            mender_log_error("[%d] %s: unknown error", status, desc);
+    (void)params;
+    mender_err_t ret;
+
+    /* Stop reading the response if the check is already done */
+    if ((MENDER_HTTP_EVENT_DATA_RECEIVED == event) && (true == mender_api_artifact_check.done)) {
+        return MENDER_DONE;
+    }
+
+    /* Parse the artifact without delivering data */
+    mender_api_artifact_check.download.callback = &mender_api_artifact_check_callback;
+    if (MENDER_OK != (ret = mender_api_http_artifact_callback(event, data, data_length, params))) {
+        return ret;
+    }
+
+    return ((MENDER_HTTP_EVENT_DATA_RECEIVED == event) && (true == mender_api_artifact_check.done)) ? MENDER_DONE : MENDER_OK;
+}
+
+static mender_err_t
+mender_api_artifact_check_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    assert(NULL != type);
+    (void)data;
+    (void)length;
+    mender_err_t ret;
+
+    /* Nothing to do if the check is already done */
+    if (true == mender_api_artifact_check.done) {
+        return MENDER_OK;
+    }
+
+    /* Check the payload at the beginning of its data file, and the first file of the payload when its size is known */
+    if ((NULL == filename) || (0 == index)) {
+        if (MENDER_OK != (ret = mender_api_artifact_check.callback(type, meta_data, filename, size))) {
+            return ret;
         }
+    }
+
+    /* The check is done once the first file of the payload has been checked */
+    if (NULL != filename) {
+        mender_api_artifact_check.done = true;
+    }
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+static mender_err_t
+mender_api_http_artifact_seek_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+
+    /* The artifact context is kept at the end of the response, the download is resumed from it */
+    if (MENDER_HTTP_EVENT_DISCONNECTED == event) {
+        return MENDER_OK;
+    }
+
+    /* Parse the artifact without delivering data */
+    mender_api_artifact_download.callback = &mender_api_artifact_seek_callback;
+
+    return mender_api_http_artifact_callback(event, data, data_length, params);
+}
+
+static mender_err_t
+mender_api_artifact_seek_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    /* The payloads are resolved at their beginning */
+    if (NULL == filename) {
+        return mender_api_artifact_seek_payload_callback(type, meta_data, filename, size, data, index, length);
+    }
+
+    /* The data of the files preceding the file can not be delivered again */
+    mender_log_error("Unexpected data of the file '%s' before the file to be resumed", filename);
+
+    return MENDER_FAIL;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+static void
+mender_api_release_artifact_download(mender_api_artifact_download_t *download) {
+
+    assert(NULL != download);
+
+    /* Release artifact context */
+    if (NULL != download->ctx) {
+        mender_artifact_release_ctx(download->ctx);
+        download->ctx = NULL;
+    }
+    download->offset = 0;
+}
+
+static void
+mender_api_pace_artifact_download(size_t length) {
+
+    /* Check if the rate is limited */
+    uint32_t rate = mender_api_download_rate_limit.rate;
+    if (0 == rate) {
+        return;
+    }
+
+    /* Refill the bucket with the time elapsed, up to its capacity */
+    uint64_t now      = mender_scheduler_get_uptime_us();
+    int64_t  capacity = ((int64_t)rate * MENDER_API_DOWNLOAD_RATE_LIMIT_BURST) / 1000;
+    uint64_t elapsed  = now - mender_api_download_rate_limit.time;
+    if (elapsed >= (uint64_t)MENDER_API_DOWNLOAD_RATE_LIMIT_BURST * 1000) {
+        mender_api_download_rate_limit.tokens = capacity;
     } else {
-        mender_log_error("Unknown error occurred, status=%d", status);
+        mender_api_download_rate_limit.tokens += (int64_t)((elapsed * rate) / 1000000);
+        if (mender_api_download_rate_limit.tokens > capacity) {
+            mender_api_download_rate_limit.tokens = capacity;
+        }
+    }
+    mender_api_download_rate_limit.time = now;
+
+    /* Consume the data received and wait until the bucket is refilled if the rate is exceeded */
+    mender_api_download_rate_limit.tokens -= (int64_t)length;
+    if (mender_api_download_rate_limit.tokens < 0) {
+        mender_scheduler_yield((uint32_t)(((uint64_t)(-mender_api_download_rate_limit.tokens) * 1000 + rate - 1) / rate));
     }
 }
 
-mender_err_t
-mender_api_exit(void) {
+static mender_err_t
+mender_api_wait_artifact_download(bool connected) {
 
-    /* Release all modules */
-    mender_http_exit();
+    uint64_t start = mender_scheduler_get_uptime_us();
 
-    /* Release memory */
-    if (NULL != mender_api_jwt) {
-        free(mender_api_jwt);
-        mender_api_jwt = NULL;
+    /* Check if the download is paused */
+    if (true != __atomic_load_n(&mender_api_download_paused, __ATOMIC_RELAXED)) {
+        return MENDER_OK;
+    }
+    mender_log_info("Download of the artifact is paused");
+
+    /* Wait until the download is resumed, the connection is closed if the pause lasts too long so that the server does not keep it */
+    while (true == __atomic_load_n(&mender_api_download_paused, __ATOMIC_RELAXED)) {
+        if ((true == connected) && (0 != mender_api_config.artifact_download_pause_timeout)
+            && (mender_scheduler_get_uptime_us() - start >= (uint64_t)mender_api_config.artifact_download_pause_timeout * 1000000)) {
+            mender_log_info("Download of the artifact is paused for too long, closing the connection");
+            __atomic_store_n(&mender_api_download_pause_interrupted, true, __ATOMIC_RELAXED);
+            return MENDER_FAIL;
+        }
+        mender_scheduler_yield(MENDER_API_DOWNLOAD_PAUSE_POLL_INTERVAL);
     }
+    mender_log_info("Download of the artifact is resumed");
 
     return MENDER_OK;
 }
+
+static void
+mender_api_print_artifact_download_statistics(mender_api_artifact_download_t *download) {
+
+    assert(NULL != download);
+    uint64_t elapsed = mender_scheduler_get_uptime_us() - download->start;
+
+    /* Save the duration of the download */
+    MENDER_METRICS_SET(MENDER_METRICS_DOWNLOAD_DURATION, (uint32_t)(elapsed / 1000));
+
+    /* Print the length of the data received by the request, the duration and the throughput */
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+    mender_utils_heap_statistics_t statistics;
+    if (MENDER_OK == mender_utils_get_heap_statistics(MENDER_UTILS_HEAP_SUBSYSTEM_ALL, &statistics)) {
+        mender_log_info("Artifact downloaded: %zu bytes in %u ms, %u kB/s, %u allocations, heap peak %zu bytes",
+                        download->received,
+                        (unsigned int)(elapsed / 1000),
+                        (unsigned int)((0 != elapsed) ? (((uint64_t)download->received * 1000000) / (elapsed * 1024)) : 0),
+                        (unsigned int)(statistics.allocations - download->allocations),
+                        statistics.peak);
+        return;
+    }
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+    mender_log_info("Artifact downloaded: %zu bytes in %u ms, %u kB/s",
+                    download->received,
+                    (unsigned int)(elapsed / 1000),
+                    (unsigned int)((0 != elapsed) ? (((uint64_t)download->received * 1000000) / (elapsed * 1024)) : 0));
+}
@@ -0,0 +1,290 @@
+/**
+ * @file      mender-artifact-decompress.c
+ * @brief     Mender artifact decompression interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_ARTIFACT
+
+#include "mender-artifact-decompress.h"
+#include "mender-log.h"
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP
+#include <zlib.h>
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ
+#include <xz.h>
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD
+#include <zstd.h>
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+
+/**
+ * @brief Default gzip window size (base two logarithm of the window size in bytes)
+ * @note The window size must be at least the one used to compress the artifact
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS
+#define CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS (15)
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS */
+
+/**
+ * @brief Default xz maximum dictionary size (bytes)
+ * @note The dictionary size must be at least the one used to compress the artifact
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_XZ_DICTIONARY_SIZE
+#define CONFIG_MENDER_ARTIFACT_XZ_DICTIONARY_SIZE (65536)
+#endif /* CONFIG_MENDER_ARTIFACT_XZ_DICTIONARY_SIZE */
+
+/**
+ * @brief Default zstd maximum window size (base two logarithm of the window size in bytes)
+ * @note The window size must be at least the one used to compress the artifact
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_ZSTD_WINDOW_LOG_MAX
+#define CONFIG_MENDER_ARTIFACT_ZSTD_WINDOW_LOG_MAX (17)
+#endif /* CONFIG_MENDER_ARTIFACT_ZSTD_WINDOW_LOG_MAX */
+
+/**
+ * @brief Decompression handle
+ */
+typedef struct {
+    mender_artifact_compression_t type; /**< Compression type */
+    union {
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP
+        z_stream *gzip; /**< zlib stream */
+#endif                  /* CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ
+        struct xz_dec *xz; /**< xz-embedded decoder */
+#endif                     /* CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD
+        ZSTD_DStream *zstd; /**< zstd stream */
+#endif                      /* CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+        void *ptr;          /**< Generic pointer to the decoder */
+    } decoder;              /**< Decoder */
+} mender_artifact_decompress_handle_t;
+
+mender_artifact_compression_t
+mender_artifact_decompress_get_type(char *filename) {
+
+    assert(NULL != filename);
+
+    /* Retrieve compression type from the extension */
+    if (true == mender_utils_strendwith(filename, ".gz")) {
+        return MENDER_ARTIFACT_COMPRESSION_GZIP;
+    } else if (true == mender_utils_strendwith(filename, ".xz")) {
+        return MENDER_ARTIFACT_COMPRESSION_XZ;
+    } else if (true == mender_utils_strendwith(filename, ".zst")) {
+        return MENDER_ARTIFACT_COMPRESSION_ZSTD;
+    }
+
+    return MENDER_ARTIFACT_COMPRESSION_NONE;
+}
+
+mender_err_t
+mender_artifact_decompress_begin(mender_artifact_compression_t type, void **handle) {
+
+    assert(NULL != handle);
+    mender_artifact_decompress_handle_t *decompress_handle;
+
+    /* Create new handle */
+    if (NULL == (decompress_handle = (mender_artifact_decompress_handle_t *)mender_malloc(sizeof(mender_artifact_decompress_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(decompress_handle, 0, sizeof(mender_artifact_decompress_handle_t));
+    decompress_handle->type = type;
+
+    /* Initialize decoder */
+    switch (type) {
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP
+        case MENDER_ARTIFACT_COMPRESSION_GZIP:
+            if (NULL == (decompress_handle->decoder.gzip = (z_stream *)mender_malloc(sizeof(z_stream)))) {
+                mender_log_error("Unable to allocate memory");
+                goto FAIL;
+            }
+            memset(decompress_handle->decoder.gzip, 0, sizeof(z_stream));
+            /* Adding 16 to the window bits permits to decode gzip header and trailer */
+            if (Z_OK != inflateInit2(decompress_handle->decoder.gzip, CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS + 16)) {
+                mender_log_error("Unable to initialize gzip decoder");
+                mender_free(decompress_handle->decoder.gzip);
+                goto FAIL;
+            }
+            break;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ
+        case MENDER_ARTIFACT_COMPRESSION_XZ:
+            xz_crc32_init();
+#ifdef XZ_USE_CRC64
+            xz_crc64_init();
+#endif /* XZ_USE_CRC64 */
+            /* Dictionary is allocated on demand, up to the maximum size */
+            if (NULL == (decompress_handle->decoder.xz = xz_dec_init(XZ_DYNALLOC, CONFIG_MENDER_ARTIFACT_XZ_DICTIONARY_SIZE))) {
+                mender_log_error("Unable to initialize xz decoder");
+                goto FAIL;
+            }
+            break;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD
+        case MENDER_ARTIFACT_COMPRESSION_ZSTD:
+            if (NULL == (decompress_handle->decoder.zstd = ZSTD_createDStream())) {
+                mender_log_error("Unable to initialize zstd decoder");
+                goto FAIL;
+            }
+            /* Frames requiring a bigger window are rejected */
+            if (ZSTD_isError(ZSTD_DCtx_setParameter(decompress_handle->decoder.zstd, ZSTD_d_windowLogMax, CONFIG_MENDER_ARTIFACT_ZSTD_WINDOW_LOG_MAX))) {
+                mender_log_error("Unable to initialize zstd decoder");
+                ZSTD_freeDStream(decompress_handle->decoder.zstd);
+                goto FAIL;
+            }
+            break;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+        default:
+            /* Compression type is not supported */
+            mender_free(decompress_handle);
+            return MENDER_NOT_IMPLEMENTED;
+    }
+
+    /* Return handle */
+    *handle = decompress_handle;
+
+    return MENDER_OK;
+
+#if defined(CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP) || defined(CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ) || defined(CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD)
+FAIL:
+
+    /* Release memory */
+    mender_free(decompress_handle);
+
+    return MENDER_FAIL;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP || CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ || CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+}
+
+mender_err_t
+mender_artifact_decompress_process(void *handle, void *input_data, size_t *input_length, void *output_data, size_t *output_length) {
+
+    assert(NULL != handle);
+    assert(NULL != input_length);
+    assert(NULL != output_length);
+    mender_artifact_decompress_handle_t *decompress_handle = (mender_artifact_decompress_handle_t *)handle;
+    mender_err_t                         ret               = MENDER_FAIL;
+#if !defined(CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP) && !defined(CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ) && !defined(CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD)
+    (void)input_data;
+    (void)input_length;
+    (void)output_data;
+    (void)output_length;
+#endif /* !CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP && !CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ && !CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+
+    /* Decompress data */
+    switch (decompress_handle->type) {
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP
+        case MENDER_ARTIFACT_COMPRESSION_GZIP: {
+            z_stream *stream  = decompress_handle->decoder.gzip;
+            stream->next_in   = (Bytef *)input_data;
+            stream->avail_in  = (uInt)*input_length;
+            stream->next_out  = (Bytef *)output_data;
+            stream->avail_out = (uInt)*output_length;
+            int result        = inflate(stream, Z_NO_FLUSH);
+            if ((Z_OK == result) || (Z_BUF_ERROR == result)) {
+                ret = MENDER_OK;
+            } else if (Z_STREAM_END == result) {
+                ret = MENDER_DONE;
+            } else {
+                mender_log_error("Unable to decompress data (%d)", result);
+            }
+            *input_length -= stream->avail_in;
+            *output_length -= stream->avail_out;
+            break;
+        }
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ
+        case MENDER_ARTIFACT_COMPRESSION_XZ: {
+            struct xz_buf buffer = { .in = input_data, .in_pos = 0, .in_size = *input_length, .out = output_data, .out_pos = 0, .out_size = *output_length };
+            enum xz_ret   result = xz_dec_run(decompress_handle->decoder.xz, &buffer);
+            if (XZ_OK == result) {
+                ret = MENDER_OK;
+            } else if (XZ_STREAM_END == result) {
+                ret = MENDER_DONE;
+            } else if (XZ_MEMLIMIT_ERROR == result) {
+                mender_log_error("Unable to decompress data, dictionary is too small");
+            } else {
+                mender_log_error("Unable to decompress data (%d)", result);
+            }
+            *input_length  = buffer.in_pos;
+            *output_length = buffer.out_pos;
+            break;
+        }
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD
+        case MENDER_ARTIFACT_COMPRESSION_ZSTD: {
+            ZSTD_inBuffer  input  = { .src = input_data, .size = *input_length, .pos = 0 };
+            ZSTD_outBuffer output = { .dst = output_data, .size = *output_length, .pos = 0 };
+            size_t         result = ZSTD_decompressStream(decompress_handle->decoder.zstd, &output, &input);
+            if (ZSTD_isError(result)) {
+                mender_log_error("Unable to decompress data (%s)", ZSTD_getErrorName(result));
+            } else if (0 == result) {
+                ret = MENDER_DONE;
+            } else {
+                ret = MENDER_OK;
+            }
+            *input_length  = input.pos;
+            *output_length = output.pos;
+            break;
+        }
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+        default:
+            /* Should not occur */
+            break;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_artifact_decompress_end(void *handle) {
+
+    mender_artifact_decompress_handle_t *decompress_handle = (mender_artifact_decompress_handle_t *)handle;
+
+    /* Release decoder */
+    if (NULL != decompress_handle) {
+        if (NULL != decompress_handle->decoder.ptr) {
+            switch (decompress_handle->type) {
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP
+                case MENDER_ARTIFACT_COMPRESSION_GZIP:
+                    inflateEnd(decompress_handle->decoder.gzip);
+                    mender_free(decompress_handle->decoder.gzip);
+                    break;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_GZIP */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ
+                case MENDER_ARTIFACT_COMPRESSION_XZ:
+                    xz_dec_end(decompress_handle->decoder.xz);
+                    break;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_XZ */
+#ifdef CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD
+                case MENDER_ARTIFACT_COMPRESSION_ZSTD:
+                    ZSTD_freeDStream(decompress_handle->decoder.zstd);
+                    break;
+#endif /* CONFIG_MENDER_ARTIFACT_COMPRESSION_ZSTD */
+                default:
+                    /* Should not occur */
+                    break;
+            }
+        }
+        mender_free(decompress_handle);
+    }
+
+    return MENDER_OK;
+}
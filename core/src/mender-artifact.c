@@ -17,13 +17,30 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_ARTIFACT
+
 #include "mender-artifact.h"
+#include "mender-artifact-decompress.h"
 #include "mender-log.h"
 
 /**
- * @brief TAR block size
+ * @brief Default input ring buffer size (bytes)
+ * @note The ring buffer must be large enough to store the version and manifest files and the TAR extended headers of the artifact, other files are parsed as they are received
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_RING_BUFFER_SIZE
+#define CONFIG_MENDER_ARTIFACT_RING_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_ARTIFACT_RING_BUFFER_SIZE */
+
+/**
+ * @brief Default maximum length of the payload data delivered to the callback at once (bytes)
+ * @note The value is rounded down to a multiple of the block size, the effective length is also limited by the contiguous data available in the input ring buffer
  */
-#define MENDER_ARTIFACT_STREAM_BLOCK_SIZE (512)
+#ifndef CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE
+#define CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE (4096)
+#endif /* CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE */
 
 /**
  * @brief TAR file header
@@ -53,6 +70,14 @@ typedef struct {
 #define MENDER_ARTIFACT_VERSION_FORMAT "mender"
 #define MENDER_ARTIFACT_VERSION_VALUE  3
 
+/**
+ * @brief Parse data available in the input ring buffer
+ * @param ctx Artifact context
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_OK if there is not enough data to continue parsing, error code if an error occurred
+ */
+static mender_err_t mender_artifact_parse_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+
 /**
  * @brief Parse header of TAR file
  * @param ctx Artifact context
@@ -60,6 +85,49 @@ typedef struct {
  */
 static mender_err_t mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx);
 
+/**
+ * @brief Parse a numeric field of a TAR header, given in octal or in base-256 (GNU extension) when the value does not fit in octal
+ * @param field Field of the TAR header
+ * @param length Length of the field
+ * @param value Value of the field
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_parse_tar_number(char *field, size_t length, uint64_t *value);
+
+/**
+ * @brief Verify the checksum of a TAR header, sum of the bytes of the header block with the checksum field taken as spaces
+ * @param tar_header TAR header
+ * @return MENDER_OK if the checksum is valid, error code otherwise
+ */
+static mender_err_t mender_artifact_check_tar_checksum(mender_artifact_tar_header_t *tar_header);
+
+/**
+ * @brief Parse an extended header of TAR file, PAX headers and GNU long names give the attributes of the next member
+ * @param ctx Artifact context
+ * @param typeflag Type of the extended header
+ * @param size Size of the data of the extended header (bytes)
+ * @return MENDER_DONE if the data have been parsed, MENDER_OK if there is not enough data to parse, error code if an error occurred
+ */
+static mender_err_t mender_artifact_parse_tar_extended_header(mender_artifact_ctx_t *ctx, char typeflag, uint64_t size);
+
+/**
+ * @brief Parse the records of a PAX extended header, the size and the path of the next member are retained
+ * @param ctx Artifact context
+ * @param data Records of the PAX extended header
+ * @param length Length of the records (bytes)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_parse_pax_records(mender_artifact_ctx_t *ctx, char *data, size_t length);
+
+/**
+ * @brief Append a name to the name of the file currently parsed, separated with '/' if it is not empty
+ * @param ctx Artifact context
+ * @param name Name to append, not necessarily null-terminated
+ * @param length Length of the name
+ * @return MENDER_OK if the function succeeds, error code if the name is too long
+ */
+static mender_err_t mender_artifact_append_file_name(mender_artifact_ctx_t *ctx, char *name, size_t length);
+
 /**
  * @brief Check version file of the artifact
  * @param ctx Artifact context
@@ -67,6 +135,28 @@ static mender_err_t mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx)
  */
 static mender_err_t mender_artifact_check_version(mender_artifact_ctx_t *ctx);
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+
+/**
+ * @brief Read manifest file of the artifact
+ * @param ctx Artifact context
+ * @return MENDER_DONE if the data have been parsed and checksums retrieved, MENDER_OK if there is not enough data to parse, error code if an error occurred
+ */
+static mender_err_t mender_artifact_read_manifest(mender_artifact_ctx_t *ctx);
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+
+/**
+ * @brief Read manifest signature file of the artifact
+ * @param ctx Artifact context
+ * @return MENDER_DONE if the data have been parsed and signature verified, MENDER_OK if there is not enough data to parse, error code if an error occurred
+ */
+static mender_err_t mender_artifact_read_manifest_signature(mender_artifact_ctx_t *ctx);
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
 /**
  * @brief Read header-info file of the artifact
  * @param ctx Artifact context
@@ -81,6 +171,36 @@ static mender_err_t mender_artifact_read_header_info(mender_artifact_ctx_t *ctx)
  */
 static mender_err_t mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx);
 
+/**
+ * @brief Callback invoked for each value of the header-info file, retrieve the types of the payloads
+ * @param path Path of the value
+ * @param depth Depth of the value
+ * @param type Type of the value
+ * @param value Value
+ * @param params Artifact context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_read_header_info_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params);
+
+/**
+ * @brief Callback invoked for each value of the meta-data file, retrieve the top-level values selected by the meta-data filter
+ * @param path Path of the value
+ * @param depth Depth of the value
+ * @param type Type of the value
+ * @param value Value
+ * @param params Artifact context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_read_meta_data_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params);
+
+/**
+ * @brief Read JSON file block by block as it is received, the file is never stored entirely in the input ring buffer
+ * @param ctx Artifact context
+ * @param callback Callback invoked for each value of the file
+ * @return MENDER_DONE if the file has been parsed, MENDER_OK if more data are expected, error code if an error occurred
+ */
+static mender_err_t mender_artifact_read_json(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *));
+
 /**
  * @brief Read data file of the artifact
  * @param ctx Artifact context
@@ -89,6 +209,106 @@ static mender_err_t mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx);
  */
 static mender_err_t mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
 
+/**
+ * @brief Pass payload data of the artifact to the callback directly from the input data, without copying them to the input ring buffer
+ * @param ctx Artifact context
+ * @param input_data Input data, updated to point to the data not consumed
+ * @param input_length Input length, updated to the length of the data not consumed
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ * @note Only whole blocks are consumed, the remaining data must be copied to the input ring buffer by the caller
+ */
+static mender_err_t mender_artifact_pass_through_data(mender_artifact_ctx_t *ctx,
+                                                      uint8_t              **input_data,
+                                                      size_t                *input_length,
+                                                      mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+
+/**
+ * @brief Deliver a span of payload data of the artifact to the callback
+ * @param ctx Artifact context
+ * @param index Payload index
+ * @param data Payload data
+ * @param span Length of the payload data, multiple of the block size including padding at the end of the file
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_deliver_data(mender_artifact_ctx_t *ctx,
+                                                 size_t                 index,
+                                                 void                  *data,
+                                                 size_t                 span,
+                                                 mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+
+/**
+ * @brief Check if the parser is reading payload data of the artifact
+ * @param ctx Artifact context
+ * @return true if payload data of the current data file remain to be read, false otherwise
+ */
+static bool mender_artifact_is_payload_data(mender_artifact_ctx_t *ctx);
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+
+/**
+ * @brief Compute checksum of the current data file of the artifact and verify it against the manifest at the end of the file
+ * @param ctx Artifact context
+ * @param data Payload data
+ * @param length Length of the payload data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_check_checksum(mender_artifact_ctx_t *ctx, void *data, size_t length);
+
+/**
+ * @brief Begin computation of the checksum of the header tarball of the artifact, the tarball is hashed while the data are shifted
+ * @param ctx Artifact context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_begin_header_checksum(mender_artifact_ctx_t *ctx);
+
+/**
+ * @brief Update checksum of the header tarball of the artifact, and verify it at the end of the tarball
+ * @param ctx Artifact context
+ * @param data Data of the header tarball, shifted from the input ring buffer or compressed data
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_update_header_checksum(mender_artifact_ctx_t *ctx, void *data, size_t length);
+
+/**
+ * @brief Verify a checksum against the manifest
+ * @param ctx Artifact context
+ * @param filename Name of the file in the manifest
+ * @param checksum Checksum computed
+ * @return MENDER_OK if the checksum is valid, error code otherwise
+ */
+static mender_err_t mender_artifact_verify_checksum(mender_artifact_ctx_t *ctx, char *filename, uint8_t *checksum);
+
+/**
+ * @brief Compute checksum of data available at once
+ * @param data Data
+ * @param length Length of the data
+ * @param checksum Checksum computed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_compute_checksum(void *data, size_t length, uint8_t *checksum);
+
+/**
+ * @brief Convert hexadecimal string to binary data
+ * @param hex Hexadecimal string
+ * @param data Binary data
+ * @param length Length of the binary data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_hex_to_bin(char *hex, uint8_t *data, size_t length);
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+
+/**
+ * @brief Get payload index of the current data file of the artifact
+ * @param ctx Artifact context
+ * @param index Payload index
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_get_payload_index(mender_artifact_ctx_t *ctx, size_t *index);
+
 /**
  * @brief Drop content of the current file of the artifact
  * @param ctx Artifact context
@@ -97,13 +317,62 @@ static mender_err_t mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender
 static mender_err_t mender_artifact_drop_file(mender_artifact_ctx_t *ctx);
 
 /**
- * @brief Shift data after parsing
+ * @brief Begin decompression of the current member of the artifact, data already available in the input ring buffer are moved to the pending data
+ * @param ctx Artifact context
+ * @param type Compression type
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_begin_decompression(mender_artifact_ctx_t *ctx, mender_artifact_compression_t type);
+
+/**
+ * @brief Decompress data of the current member of the artifact to the input ring buffer
+ * @param ctx Artifact context
+ * @param input_data Input data, updated to point to the data not consumed
+ * @param input_length Input length, updated to the length of the data not consumed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_decompress_data(mender_artifact_ctx_t *ctx, uint8_t **input_data, size_t *input_length);
+
+/**
+ * @brief Write data at the end of the input ring buffer
+ * @param ctx Artifact context
+ * @param data Data to be written
+ * @param length Length of the data to be written
+ * @return Length of the data written, which is lower than the length of the data if the ring buffer is full
+ */
+static size_t mender_artifact_write_data(mender_artifact_ctx_t *ctx, uint8_t *data, size_t length);
+
+/**
+ * @brief Get contiguous free space at the end of the input ring buffer
+ * @param ctx Artifact context
+ * @param length Length of the contiguous free space
+ * @return Pointer to the free space
+ */
+static uint8_t *mender_artifact_get_free_space(mender_artifact_ctx_t *ctx, size_t *length);
+
+/**
+ * @brief Get contiguous data from the input ring buffer, the content of the ring buffer is rotated if the data wrap around
+ * @param ctx Artifact context
+ * @param length Length of the contiguous data wanted
+ * @return Pointer to the data if enough data are available, NULL otherwise
+ */
+static void *mender_artifact_get_data(mender_artifact_ctx_t *ctx, size_t length);
+
+/**
+ * @brief Shift data after parsing, this only advances the read index of the input ring buffer
  * @param ctx Artifact context
  * @param length Length of data to shift
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_t length);
 
+/**
+ * @brief Reverse content of a buffer
+ * @param data Buffer
+ * @param length Length of the buffer
+ */
+static void mender_artifact_reverse(uint8_t *data, size_t length);
+
 /**
  * @brief Compute length rounded up to increment (usually the block size)
  * @param length Length
@@ -118,11 +387,18 @@ mender_artifact_create_ctx(void) {
     mender_artifact_ctx_t *ctx;
 
     /* Create new context */
-    if (NULL == (ctx = (mender_artifact_ctx_t *)malloc(sizeof(mender_artifact_ctx_t)))) {
+    if (NULL == (ctx = (mender_artifact_ctx_t *)mender_malloc(sizeof(mender_artifact_ctx_t)))) {
         return NULL;
     }
     memset(ctx, 0, sizeof(mender_artifact_ctx_t));
 
+    /* Create input ring buffer, the size is a multiple of the block size so that a block never wraps around */
+    ctx->input.size = mender_artifact_round_up(CONFIG_MENDER_ARTIFACT_RING_BUFFER_SIZE, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+    if (NULL == (ctx->input.data = (uint8_t *)mender_malloc(ctx->input.size))) {
+        mender_free(ctx);
+        return NULL;
+    }
+
     return ctx;
 }
 
@@ -134,20 +410,205 @@ mender_artifact_process_data(mender_artifact_ctx_t *ctx,
 
     assert(NULL != ctx);
     assert(NULL != callback);
-    mender_err_t ret = MENDER_OK;
-    void        *tmp;
+    mender_err_t ret;
+
+    /* Copy data to the input ring buffer and parse them, until all the input data are consumed */
+    do {
+
+        size_t remaining = input_length;
+
+        if (NULL != ctx->decompress.handle) {
+
+            /* Decompress data of the current member to the input ring buffer */
+            if (MENDER_OK != (ret = mender_artifact_decompress_data(ctx, (uint8_t **)&input_data, &input_length))) {
+                return ret;
+            }
+
+        } else {
+
+            /* Pass payload data directly to the callback when possible, this avoids copying them to the input ring buffer */
+            if ((NULL != input_data) && (0 != input_length)) {
+                if (MENDER_OK != (ret = mender_artifact_pass_through_data(ctx, (uint8_t **)&input_data, &input_length, callback))) {
+                    return ret;
+                }
+            }
+
+            /* Copy as much data as possible to the end of the input ring buffer, only the data straddling a block boundary when parsing payload data */
+            if ((NULL != input_data) && (0 != input_length)) {
+                size_t length = input_length;
+                if ((true == mender_artifact_is_payload_data(ctx))
+                    && (length > MENDER_ARTIFACT_STREAM_BLOCK_SIZE - ctx->input.length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+                    length = MENDER_ARTIFACT_STREAM_BLOCK_SIZE - ctx->input.length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+                }
+                length        = mender_artifact_write_data(ctx, (uint8_t *)input_data, length);
+                input_data    = (void *)(((uint8_t *)input_data) + length);
+                input_length -= length;
+            }
+        }
+
+        /* Count the input data consumed, this gives the offset of the files in the artifact stream */
+        ctx->input.received += remaining - input_length;
+
+        /* Parse data */
+        if (MENDER_OK != (ret = mender_artifact_parse_data(ctx, callback))) {
+            return ret;
+        }
+
+        /* At the end of a compressed member, the decompressed TAR file must have been parsed entirely, remaining data are zero padding of the TAR file */
+        if ((NULL == ctx->decompress.handle) && (true == ctx->decompress.done)) {
+            if (true == ctx->decompress.compressed) {
+                mender_log_error("Invalid compressed member");
+                return MENDER_FAIL;
+            }
+            ctx->input.index     = 0;
+            ctx->input.length    = 0;
+            ctx->decompress.done = false;
+        }
+
+        /* Process data moved out of the input ring buffer when the decompression of a member began, they precede the remaining input data */
+        if (NULL != ctx->decompress.pending) {
+            uint8_t *pending               = ctx->decompress.pending;
+            size_t   pending_length        = ctx->decompress.pending_length;
+            ctx->decompress.pending        = NULL;
+            ctx->decompress.pending_length = 0;
+            ctx->input.received           -= pending_length;
+            ret                            = mender_artifact_process_data(ctx, pending, pending_length, callback);
+            mender_free(pending);
+            if (MENDER_OK != ret) {
+                return ret;
+            }
+        }
+
+        /* Check if the parser is waiting for more data than the input ring buffer is able to store */
+        if (ctx->input.length == ctx->input.size) {
+            mender_log_error("Input ring buffer is too small to parse the artifact");
+            return MENDER_FAIL;
+        }
+
+    } while (((NULL != input_data) && (0 != input_length)) || ((NULL != ctx->decompress.handle) && (true == ctx->decompress.output_pending)));
+
+    return ret;
+}
+
+mender_err_t
+mender_artifact_skip_data(mender_artifact_ctx_t *ctx, void *data, size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != data);
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    mender_err_t ret;
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+
+    /* Skipping is only possible when parsing payload data and if the input ring buffer is empty, so that the TAR alignment is known */
+    if ((false == mender_artifact_is_payload_data(ctx)) || (0 != ctx->input.length) || (0 != length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE)
+        || (ctx->file.index + length >= ctx->file.size)) {
+        mender_log_error("Unable to skip data of '%s'", ctx->file.name);
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    /* Compute checksum, the data skipped are checked with the remaining data at the end of the file */
+    if (MENDER_OK != (ret = mender_artifact_check_checksum(ctx, data, length))) {
+        return ret;
+    }
+
+#else
+    (void)data;
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    /* Update index */
+    ctx->file.index += length;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_artifact_check_complete(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* Check the stream ends between two files at the root of the artifact, it is truncated otherwise */
+    if ((MENDER_ARTIFACT_STREAM_STATE_PARSING_HEADER != ctx->stream_state) || ('\0' != ctx->file.name[0]) || (NULL != ctx->decompress.handle)
+        || (true == ctx->decompress.compressed)) {
+        mender_log_error("Artifact is incomplete");
+        return MENDER_FAIL;
+    }
 
-    /* Copy data to the end of the internal buffer */
-    if ((NULL != input_data) && (0 != input_length)) {
-        if (NULL == (tmp = realloc(ctx->input.data, ctx->input.length + input_length))) {
-            /* Unable to allocate memory */
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    /* Check the manifest has been read and the checksums of all its data files have been verified, a data file may have been dropped otherwise */
+    if (true != ctx->checksums.manifest) {
+        mender_log_error("Manifest not found in the artifact");
+        return MENDER_FAIL;
+    }
+    for (size_t index = 0; index < ctx->checksums.size; index++) {
+        if ((true == mender_utils_strbeginwith(ctx->checksums.values[index].filename, "data/")) && (true != ctx->checksums.values[index].verified)) {
+            mender_log_error("File '%s' of the manifest not found in the artifact", ctx->checksums.values[index].filename);
             return MENDER_FAIL;
         }
-        ctx->input.data = tmp;
-        memcpy((void *)(((uint8_t *)ctx->input.data) + ctx->input.length), input_data, input_length);
-        ctx->input.length += input_length;
     }
 
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    return MENDER_OK;
+}
+
+void
+mender_artifact_release_ctx(mender_artifact_ctx_t *ctx) {
+
+    /* Release memory */
+    if (NULL != ctx) {
+        if (NULL != ctx->input.data) {
+            mender_free(ctx->input.data);
+        }
+        if (NULL != ctx->decompress.handle) {
+            mender_artifact_decompress_end(ctx->decompress.handle);
+        }
+        if (NULL != ctx->decompress.pending) {
+            mender_free(ctx->decompress.pending);
+        }
+        if (NULL != ctx->payloads.values) {
+            for (size_t index = 0; index < ctx->payloads.size; index++) {
+                if (NULL != ctx->payloads.values[index].type) {
+                    mender_free(ctx->payloads.values[index].type);
+                }
+                if (NULL != ctx->payloads.values[index].meta_data) {
+                    cJSON_Delete(ctx->payloads.values[index].meta_data);
+                }
+            }
+            mender_free(ctx->payloads.values);
+        }
+        if (NULL != ctx->json) {
+            mender_json_reader_release(ctx->json);
+            mender_free(ctx->json);
+        }
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+        if (NULL != ctx->checksums.values) {
+            for (size_t index = 0; index < ctx->checksums.size; index++) {
+                if (NULL != ctx->checksums.values[index].filename) {
+                    mender_free(ctx->checksums.values[index].filename);
+                }
+            }
+            mender_free(ctx->checksums.values);
+        }
+        if (NULL != ctx->checksums.header_sha256) {
+            mender_tls_sha256_end(ctx->checksums.header_sha256, NULL);
+        }
+        if (NULL != ctx->checksums.header_filename) {
+            mender_free(ctx->checksums.header_filename);
+        }
+        if (NULL != ctx->file.sha256) {
+            mender_tls_sha256_end(ctx->file.sha256, NULL);
+        }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+        mender_free(ctx);
+    }
+}
+
+static mender_err_t
+mender_artifact_parse_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    mender_err_t ret = MENDER_OK;
+
     /* Parse data */
     do {
 
@@ -165,6 +626,20 @@ mender_artifact_process_data(mender_artifact_ctx_t *ctx,
                 /* Validate artifact version */
                 ret = mender_artifact_check_version(ctx);
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+            } else if (!strcmp(ctx->file.name, "manifest")) {
+
+                /* Read manifest file */
+                ret = mender_artifact_read_manifest(ctx);
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+            } else if (!strcmp(ctx->file.name, "manifest.sig")) {
+
+                /* Read manifest signature file */
+                ret = mender_artifact_read_manifest_signature(ctx);
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
             } else if (!strcmp(ctx->file.name, "header.tar/header-info")) {
 
                 /* Read header-info file */
@@ -200,8 +675,7 @@ mender_artifact_process_data(mender_artifact_ctx_t *ctx,
                 if (NULL != substring) {
                     *(substring + strlen(".tar")) = '\0';
                 } else {
-                    free(ctx->file.name);
-                    ctx->file.name = NULL;
+                    ctx->file.name[0] = '\0';
                 }
                 ctx->file.size  = 0;
                 ctx->file.index = 0;
@@ -215,46 +689,19 @@ mender_artifact_process_data(mender_artifact_ctx_t *ctx,
     return ret;
 }
 
-void
-mender_artifact_release_ctx(mender_artifact_ctx_t *ctx) {
-
-    /* Release memory */
-    if (NULL != ctx) {
-        if (NULL != ctx->input.data) {
-            free(ctx->input.data);
-        }
-        if (NULL != ctx->payloads.values) {
-            for (size_t index = 0; index < ctx->payloads.size; index++) {
-                if (NULL != ctx->payloads.values[index].type) {
-                    free(ctx->payloads.values[index].type);
-                }
-                if (NULL != ctx->payloads.values[index].meta_data) {
-                    cJSON_Delete(ctx->payloads.values[index].meta_data);
-                }
-            }
-            free(ctx->payloads.values);
-        }
-        if (NULL != ctx->file.name) {
-            free(ctx->file.name);
-        }
-        free(ctx);
-    }
-}
-
 static mender_err_t
 mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    char *tmp;
+    mender_artifact_tar_header_t *tar_header;
+    uint64_t                      size;
+    bool                          root;
 
-    /* Check if enough data are received (at least one block) */
-    if ((NULL == ctx->input.data) || (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+    /* Check if enough data are received (at least one block) and cast block to TAR header structure */
+    if (NULL == (tar_header = (mender_artifact_tar_header_t *)mender_artifact_get_data(ctx, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
         return MENDER_OK;
     }
 
-    /* Cast block to TAR header structure */
-    mender_artifact_tar_header_t *tar_header = (mender_artifact_tar_header_t *)ctx->input.data;
-
     /* Check if file name is provided, else the end of the current TAR file is reached */
     if ('\0' == tar_header->name[0]) {
 
@@ -264,21 +711,22 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
         }
 
         /* Remove the TAR file name */
-        if (NULL != ctx->file.name) {
-            char *substring = mender_utils_strrstr(ctx->file.name, ".tar");
+        char *substring = mender_utils_strrstr(ctx->file.name, ".tar");
+        if (NULL != substring) {
+            *substring = '\0';
+            substring  = mender_utils_strrstr(ctx->file.name, ".tar");
             if (NULL != substring) {
-                *substring = '\0';
-                substring  = mender_utils_strrstr(ctx->file.name, ".tar");
-                if (NULL != substring) {
-                    *(substring + strlen(".tar")) = '\0';
-                } else {
-                    free(ctx->file.name);
-                    ctx->file.name = NULL;
-                }
+                *(substring + strlen(".tar")) = '\0';
             } else {
-                free(ctx->file.name);
-                ctx->file.name = NULL;
+                ctx->file.name[0] = '\0';
             }
+        } else {
+            ctx->file.name[0] = '\0';
+        }
+
+        /* The end of the decompressed TAR file is reached when returning to the root of the artifact */
+        if ('\0' == ctx->file.name[0]) {
+            ctx->decompress.compressed = false;
         }
 
         /* Shift data in the buffer */
@@ -290,6 +738,12 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
         return MENDER_DONE;
     }
 
+    /* Check checksum, the download is aborted immediately if the stream is corrupted */
+    if (MENDER_OK != mender_artifact_check_tar_checksum(tar_header)) {
+        mender_log_error("Invalid TAR header checksum");
+        return MENDER_FAIL;
+    }
+
     /* Check magic */
     if (strncmp(tar_header->magic, "ustar", strlen("ustar"))) {
         /* Invalid magic */
@@ -297,25 +751,40 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
         return MENDER_FAIL;
     }
 
-    /* Compute the new file name */
-    if (NULL != ctx->file.name) {
-        size_t str_length = strlen(ctx->file.name) + strlen("/") + strlen(tar_header->name) + 1;
-        if (NULL == (tmp = (char *)malloc(str_length))) {
-            mender_log_error("Unable to allocate memory");
-            return MENDER_FAIL;
-        }
-        snprintf(tmp, str_length, "%s/%s", ctx->file.name, tar_header->name);
-        free(ctx->file.name);
+    /* Retrieve file size */
+    if (MENDER_OK != mender_artifact_parse_tar_number(tar_header->size, sizeof(tar_header->size), &size)) {
+        mender_log_error("Invalid TAR header size");
+        return MENDER_FAIL;
+    }
+
+    /* Parse extended headers, they give the attributes of the next member */
+    if (('x' == tar_header->typeflag) || ('g' == tar_header->typeflag) || ('L' == tar_header->typeflag)) {
+        return mender_artifact_parse_tar_extended_header(ctx, tar_header->typeflag, size);
+    }
+
+    /* Compute the new file name, the prefix is only defined by the POSIX format, the name may have been given by an extended header */
+    if (true == ctx->file.extended.has_name) {
+        root = ctx->file.extended.root;
     } else {
-        if (NULL == (tmp = strdup(tar_header->name))) {
-            mender_log_error("Unable to allocate memory");
+        root = ('\0' == ctx->file.name[0]);
+        if (('\0' == tar_header->magic[5]) && ('\0' != tar_header->prefix[0])) {
+            if (MENDER_OK != mender_artifact_append_file_name(ctx, tar_header->prefix, strnlen(tar_header->prefix, sizeof(tar_header->prefix)))) {
+                return MENDER_FAIL;
+            }
+        }
+        if (MENDER_OK != mender_artifact_append_file_name(ctx, tar_header->name, strnlen(tar_header->name, sizeof(tar_header->name)))) {
             return MENDER_FAIL;
         }
     }
-    ctx->file.name = tmp;
-
-    /* Retrieve file size */
-    sscanf(tar_header->size, "%o", (unsigned int *)&(ctx->file.size));
+    if (true == ctx->file.extended.has_size) {
+        size = ctx->file.extended.size;
+    }
+    memset(&ctx->file.extended, 0, sizeof(ctx->file.extended));
+    if (size > (uint64_t)SIZE_MAX) {
+        mender_log_error("Size of '%s' is too large", ctx->file.name);
+        return MENDER_FAIL;
+    }
+    ctx->file.size  = (size_t)size;
     ctx->file.index = 0;
 
     /* Shift data in the buffer */
@@ -324,26 +793,240 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
         return MENDER_FAIL;
     }
 
+    /* Compute the offset of the data of the file in the artifact stream, the data following the header are in the input ring buffer */
+    ctx->file.offset = ((NULL == ctx->decompress.handle) && (false == ctx->decompress.compressed)) ? (ctx->input.received - ctx->input.length) : 0;
+
+    /* Treatment of the members at the root of the artifact */
+    if (true == root) {
+
+        /* Retrieve compression type of the member */
+        mender_artifact_compression_t type = mender_artifact_decompress_get_type(ctx->file.name);
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+        /* Begin computation of the checksum of the header tarball, computed on the compressed data if the tarball is compressed */
+        if ((!strcmp(ctx->file.name, "header.tar"))
+            || ((MENDER_ARTIFACT_COMPRESSION_NONE != type) && (true == mender_utils_strbeginwith(ctx->file.name, "header.tar.")))) {
+            if (MENDER_OK != mender_artifact_begin_header_checksum(ctx)) {
+                return MENDER_FAIL;
+            }
+        }
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+        /* Begin decompression of the member, the decompressed TAR file is then parsed as if it was not compressed */
+        if (MENDER_ARTIFACT_COMPRESSION_NONE != type) {
+            if (MENDER_OK != mender_artifact_begin_decompression(ctx, type)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
     /* Update the stream state machine */
     ctx->stream_state = MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA;
 
     return MENDER_DONE;
 }
 
+static mender_err_t
+mender_artifact_parse_tar_number(char *field, size_t length, uint64_t *value) {
+
+    assert(NULL != field);
+    assert(NULL != value);
+    size_t index = 0;
+
+    /* Base-256 encoding, the most significant bit of the first byte is set, negative values are not supported */
+    *value = 0;
+    if (0 != ((uint8_t)field[0] & 0x80)) {
+        if (0 != ((uint8_t)field[0] & 0x40)) {
+            return MENDER_FAIL;
+        }
+        *value = (uint8_t)field[0] & 0x3F;
+        for (index = 1; index < length; index++) {
+            if (0 != (*value >> 56)) {
+                return MENDER_FAIL;
+            }
+            *value = (*value << 8) | (uint8_t)field[index];
+        }
+        return MENDER_OK;
+    }
+
+    /* Octal encoding, leading spaces and terminated by a space or a null character */
+    while ((index < length) && (' ' == field[index])) {
+        index++;
+    }
+    for (; (index < length) && ('0' <= field[index]) && (field[index] <= '7'); index++) {
+        if (0 != (*value >> 61)) {
+            return MENDER_FAIL;
+        }
+        *value = (*value << 3) | (uint64_t)(field[index] - '0');
+    }
+    if ((index < length) && (' ' != field[index]) && ('\0' != field[index])) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_check_tar_checksum(mender_artifact_tar_header_t *tar_header) {
+
+    assert(NULL != tar_header);
+    uint64_t expected;
+    uint8_t *block        = (uint8_t *)tar_header;
+    uint32_t unsigned_sum = 0;
+    int32_t  signed_sum   = 0;
+
+    /* Retrieve the expected checksum */
+    if (MENDER_OK != mender_artifact_parse_tar_number(tar_header->chksum, sizeof(tar_header->chksum), &expected)) {
+        return MENDER_FAIL;
+    }
+
+    /* Compute the checksum of the block, some historic implementations sum signed bytes */
+    for (size_t index = 0; index < MENDER_ARTIFACT_STREAM_BLOCK_SIZE; index++) {
+        uint8_t byte = block[index];
+        if ((index >= offsetof(mender_artifact_tar_header_t, chksum))
+            && (index < offsetof(mender_artifact_tar_header_t, chksum) + sizeof(tar_header->chksum))) {
+            byte = ' ';
+        }
+        unsigned_sum += byte;
+        signed_sum += (int8_t)byte;
+    }
+
+    return ((expected == unsigned_sum) || ((int64_t)expected == signed_sum)) ? MENDER_OK : MENDER_FAIL;
+}
+
+static mender_err_t
+mender_artifact_parse_tar_extended_header(mender_artifact_ctx_t *ctx, char typeflag, uint64_t size) {
+
+    assert(NULL != ctx);
+    char *data;
+
+    /* Check if the header and its data are received, they must fit in the input ring buffer */
+    size_t length
+        = (size < ctx->input.size) ? (MENDER_ARTIFACT_STREAM_BLOCK_SIZE + mender_artifact_round_up((size_t)size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) : SIZE_MAX;
+    if (length > ctx->input.size) {
+        mender_log_error("Input ring buffer is too small to parse the extended header");
+        return MENDER_FAIL;
+    }
+    if (NULL == (data = (char *)mender_artifact_get_data(ctx, length))) {
+        return MENDER_OK;
+    }
+    data += MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+
+    /* Treatment depending of the type, the global PAX headers are ignored */
+    if ('x' == typeflag) {
+        if (MENDER_OK != mender_artifact_parse_pax_records(ctx, data, (size_t)size)) {
+            mender_log_error("Invalid PAX extended header");
+            return MENDER_FAIL;
+        }
+    } else if ('L' == typeflag) {
+        ctx->file.extended.root = ('\0' == ctx->file.name[0]);
+        if (MENDER_OK != mender_artifact_append_file_name(ctx, data, strnlen(data, (size_t)size))) {
+            return MENDER_FAIL;
+        }
+        ctx->file.extended.has_name = true;
+    }
+
+    /* Shift data in the buffer */
+    if (MENDER_OK != mender_artifact_shift_data(ctx, length)) {
+        mender_log_error("Unable to shift input data");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_DONE;
+}
+
+static mender_err_t
+mender_artifact_parse_pax_records(mender_artifact_ctx_t *ctx, char *data, size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != data);
+    size_t index = 0;
+
+    /* Parse the records, formatted as "<length> <key>=<value>\n" where the length includes the whole record */
+    while (index < length) {
+        char  *record        = data + index;
+        size_t remaining     = length - index;
+        size_t record_length = 0;
+        size_t position      = 0;
+        while ((position < remaining) && ('0' <= record[position]) && (record[position] <= '9') && (record_length <= remaining)) {
+            record_length = record_length * 10 + (size_t)(record[position] - '0');
+            position++;
+        }
+        if ((0 == position) || (record_length > remaining) || (record_length < position + strlen(" =\n")) || (' ' != record[position])
+            || ('\n' != record[record_length - 1])) {
+            return MENDER_FAIL;
+        }
+        char *key   = record + position + 1;
+        char *end   = record + record_length - 1;
+        char *value = memchr(key, '=', (size_t)(end - key));
+        if (NULL == value) {
+            return MENDER_FAIL;
+        }
+        size_t key_length = (size_t)(value - key);
+        value++;
+
+        /* Retrieve the size and the path of the next member, other records are ignored */
+        if ((strlen("size") == key_length) && (!strncmp(key, "size", key_length))) {
+            ctx->file.extended.size = 0;
+            for (char *digit = value; digit < end; digit++) {
+                if ((*digit < '0') || (*digit > '9') || (ctx->file.extended.size > (UINT64_MAX - 9) / 10)) {
+                    return MENDER_FAIL;
+                }
+                ctx->file.extended.size = ctx->file.extended.size * 10 + (uint64_t)(*digit - '0');
+            }
+            ctx->file.extended.has_size = true;
+        } else if ((strlen("path") == key_length) && (!strncmp(key, "path", key_length))) {
+            ctx->file.extended.root = ('\0' == ctx->file.name[0]);
+            if (MENDER_OK != mender_artifact_append_file_name(ctx, value, (size_t)(end - value))) {
+                return MENDER_FAIL;
+            }
+            ctx->file.extended.has_name = true;
+        }
+        index += record_length;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_append_file_name(mender_artifact_ctx_t *ctx, char *name, size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != name);
+
+    /* Check the length of the name, the separator is not added at the root of the artifact */
+    size_t offset    = strlen(ctx->file.name);
+    size_t separator = (0 != offset) ? 1 : 0;
+    if (offset + separator + length >= sizeof(ctx->file.name)) {
+        mender_log_error("Name of the file is too long, the maximum length is %d", (int)sizeof(ctx->file.name) - 1);
+        return MENDER_FAIL;
+    }
+
+    /* Append the name */
+    if (0 != separator) {
+        ctx->file.name[offset++] = '/';
+    }
+    memcpy(&ctx->file.name[offset], name, length);
+    ctx->file.name[offset + length] = '\0';
+
+    return MENDER_OK;
+}
+
 static mender_err_t
 mender_artifact_check_version(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
     cJSON       *object = NULL;
     mender_err_t ret    = MENDER_DONE;
+    void        *data;
 
     /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+    if (NULL == (data = mender_artifact_get_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)))) {
         return MENDER_OK;
     }
 
     /* Check version file */
-    if (NULL == (object = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
+    if (NULL == (object = cJSON_ParseWithLength(data, ctx->file.size))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -373,6 +1056,15 @@ mender_artifact_check_version(mender_artifact_ctx_t *ctx) {
     }
     mender_log_info("Artifact has valid version");
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    /* Compute checksum of the version file, the manifest is not known yet */
+    if (MENDER_OK != mender_artifact_compute_checksum(data, ctx->file.size, ctx->checksums.version)) {
+        mender_log_error("Unable to compute checksum of the version file");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+
     /* Shift data in the buffer */
     if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
         mender_log_error("Unable to shift input data");
@@ -390,109 +1082,128 @@ END:
     return ret;
 }
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+
 static mender_err_t
-mender_artifact_read_header_info(mender_artifact_ctx_t *ctx) {
+mender_artifact_read_manifest(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    cJSON       *object = NULL;
-    mender_err_t ret    = MENDER_DONE;
+    char  *data;
+    char  *line;
+    size_t length;
+
+    /* The manifest must be unique and located before its signature, otherwise the checksums of another manifest could be added to the signed ones */
+    if ((true == ctx->checksums.manifest)
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+        || (true == ctx->signature.read)
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+    ) {
+        mender_log_error("Invalid artifact format, unexpected manifest");
+        return MENDER_FAIL;
+    }
 
     /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+    if (NULL == (data = (char *)mender_artifact_get_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)))) {
         return MENDER_OK;
     }
 
-    /* Read header-info */
-    if (NULL == (object = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
-        mender_log_error("Unable to allocate memory");
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    /* Compute checksum of the manifest, it is signed */
+    if (MENDER_OK != mender_artifact_compute_checksum(data, ctx->file.size, ctx->signature.manifest)) {
+        mender_log_error("Unable to compute checksum of the manifest");
         return MENDER_FAIL;
     }
-    cJSON *json_payloads = cJSON_GetObjectItemCaseSensitive(object, "payloads");
-    if (true == cJSON_IsArray(json_payloads)) {
-        ctx->payloads.size = cJSON_GetArraySize(json_payloads);
-        if (NULL == (ctx->payloads.values = (mender_artifact_payload_t *)malloc(ctx->payloads.size * sizeof(mender_artifact_payload_t)))) {
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+    /* Parse each line of the manifest, the format is "<checksum>  <filename>" */
+    for (line = data; line < data + ctx->file.size; line += length + 1) {
+
+        /* Compute length of the line */
+        char *end = memchr(line, '\n', data + ctx->file.size - line);
+        length    = (NULL != end) ? (size_t)(end - line) : (size_t)(data + ctx->file.size - line);
+        if (0 == length) {
+            continue;
+        }
+        if ((length <= 2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 2) || (' ' != line[2 * MENDER_TLS_SHA256_DIGEST_LENGTH])
+            || (' ' != line[2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 1])) {
+            mender_log_error("Invalid manifest format");
+            return MENDER_FAIL;
+        }
+
+        /* Retrieve file name */
+        char  *filename        = line + 2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 2;
+        size_t filename_length = length - 2 * MENDER_TLS_SHA256_DIGEST_LENGTH - 2;
+
+        /* Add checksum to the list */
+        mender_artifact_checksum_t *tmp;
+        if (NULL
+            == (tmp = (mender_artifact_checksum_t *)mender_realloc(ctx->checksums.values, (ctx->checksums.size + 1) * sizeof(mender_artifact_checksum_t)))) {
             mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+            return MENDER_FAIL;
         }
-        memset(ctx->payloads.values, 0, ctx->payloads.size * sizeof(mender_artifact_payload_t));
-        size_t index        = 0;
-        cJSON *json_payload = NULL;
-        cJSON_ArrayForEach(json_payload, json_payloads) {
-            if (true == cJSON_IsObject(json_payload)) {
-                cJSON *json_payload_type = cJSON_GetObjectItemCaseSensitive(json_payload, "type");
-                if (cJSON_IsString(json_payload_type)) {
-                    if (NULL == (ctx->payloads.values[index].type = strdup(cJSON_GetStringValue(json_payload_type)))) {
-                        mender_log_error("Unable to allocate memory");
-                        ret = MENDER_FAIL;
-                        goto END;
-                    }
-                } else {
-                    mender_log_error("Invalid header-info file");
-                    ret = MENDER_FAIL;
-                    goto END;
-                }
-            } else {
-                mender_log_error("Invalid header-info file");
-                ret = MENDER_FAIL;
-                goto END;
-            }
-            index++;
+        ctx->checksums.values = tmp;
+        memset(&ctx->checksums.values[ctx->checksums.size], 0, sizeof(mender_artifact_checksum_t));
+        if (NULL == (ctx->checksums.values[ctx->checksums.size].filename = mender_strndup(filename, filename_length))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        ctx->checksums.size++;
+        if (MENDER_OK != mender_artifact_hex_to_bin(line, ctx->checksums.values[ctx->checksums.size - 1].checksum, MENDER_TLS_SHA256_DIGEST_LENGTH)) {
+            mender_log_error("Invalid manifest format");
+            return MENDER_FAIL;
         }
-    } else {
-        mender_log_error("Invalid header-info file");
-        ret = MENDER_FAIL;
-        goto END;
+    }
+
+    ctx->checksums.manifest = true;
+
+    /* Verify checksum of the version file */
+    if (MENDER_OK != mender_artifact_verify_checksum(ctx, "version", ctx->checksums.version)) {
+        return MENDER_FAIL;
     }
 
     /* Shift data in the buffer */
     if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
         mender_log_error("Unable to shift input data");
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
 
-END:
+    return MENDER_DONE;
+}
 
-    /* Release memory */
-    if (NULL != object) {
-        cJSON_Delete(object);
-    }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
 
-    return ret;
-}
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
 
 static mender_err_t
-mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx) {
+mender_artifact_read_manifest_signature(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    size_t index = 0;
+    char  *data;
+    size_t length;
 
-    /* Retrieve payload index */
-    if (1 != sscanf(ctx->file.name, "header.tar/headers/%u/meta-data", (unsigned int *)&index)) {
-        mender_log_error("Invalid artifact format");
-        return MENDER_FAIL;
-    }
-    if (index >= ctx->payloads.size) {
-        mender_log_error("Invalid artifact format");
+    /* The signature must be unique and located after the manifest */
+    if ((true == ctx->signature.read) || (true != ctx->checksums.manifest)) {
+        mender_log_error("Invalid artifact format, unexpected manifest signature");
         return MENDER_FAIL;
     }
 
-    /* Check size of the meta-data */
-    if (0 == mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
-        /* Nothing to do */
-        return MENDER_DONE;
-    }
-
     /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+    if (NULL == (data = (char *)mender_artifact_get_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)))) {
         return MENDER_OK;
     }
+    ctx->signature.read = true;
 
-    /* Read meta-data */
-    if (NULL == (ctx->payloads.values[index].meta_data = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
+    /* Verify signature of the manifest if a public key is defined, trailing line breaks are ignored */
+    if (NULL != ctx->signature.key) {
+        for (length = ctx->file.size; (length > 0) && (('\n' == data[length - 1]) || ('\r' == data[length - 1])); length--) {
+            ;
+        }
+        if (MENDER_OK != mender_tls_verify_signature(ctx->signature.key, ctx->signature.manifest, data, length)) {
+            mender_log_error("Invalid artifact signature");
+            return MENDER_FAIL;
+        }
+        ctx->signature.verified = true;
+        mender_log_info("Artifact has valid signature");
     }
 
     /* Shift data in the buffer */
@@ -504,16 +1215,36 @@ mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx) {
     return MENDER_DONE;
 }
 
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
 static mender_err_t
-mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+mender_artifact_read_header_info(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    assert(NULL != callback);
-    size_t       index = 0;
     mender_err_t ret;
 
+    /* Read header-info */
+    if (MENDER_DONE != (ret = mender_artifact_read_json(ctx, &mender_artifact_read_header_info_value))) {
+        return ret;
+    }
+
+    /* Check payloads have been found */
+    if (0 == ctx->payloads.size) {
+        mender_log_error("Invalid header-info file");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_DONE;
+}
+
+static mender_err_t
+mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    size_t index = 0;
+
     /* Retrieve payload index */
-    if (1 != sscanf(ctx->file.name, "data/%u.tar", (unsigned int *)&index)) {
+    if (1 != sscanf(ctx->file.name, "header.tar/headers/%u/meta-data", (unsigned int *)&index)) {
         mender_log_error("Invalid artifact format");
         return MENDER_FAIL;
     }
@@ -522,63 +1253,563 @@ mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(c
         return MENDER_FAIL;
     }
 
-    /* Check if a file name is provided (we don't check the extension because we don't know it) */
-    if (strlen("data/xxxx.tar") == strlen(ctx->file.name)) {
-
-        /* Beginning of the data file */
-        if (MENDER_OK != (ret = callback(ctx->payloads.values[index].type, ctx->payloads.values[index].meta_data, NULL, 0, NULL, 0, 0))) {
-            mender_log_error("An error occurred");
-            return ret;
-        }
-
-        return MENDER_DONE;
-    }
-
-    /* Check size of the data */
+    /* Check size of the meta-data */
     if (0 == mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
         /* Nothing to do */
         return MENDER_DONE;
     }
 
-    /* Parse data until the end of the file has been reached */
-    do {
-
-        /* Check if enough data are received (at least one block) */
-        if ((NULL == ctx->input.data) || (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
-            return MENDER_OK;
+    /* Create meta-data object, values are added while the file is read */
+    if ((0 == ctx->file.index) && (NULL == ctx->payloads.values[index].meta_data)) {
+        if (NULL == (ctx->payloads.values[index].meta_data = cJSON_CreateObject())) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
         }
+    }
 
-        /* Compute length */
-        size_t length
-            = ((ctx->file.size - ctx->file.index) > MENDER_ARTIFACT_STREAM_BLOCK_SIZE) ? MENDER_ARTIFACT_STREAM_BLOCK_SIZE : (ctx->file.size - ctx->file.index);
+    /* Read meta-data */
+    return mender_artifact_read_json(ctx, &mender_artifact_read_meta_data_value);
+}
 
-        /* Invoke callback */
-        if (MENDER_OK
-            != (ret = callback(ctx->payloads.values[index].type,
-                               ctx->payloads.values[index].meta_data,
-                               strstr(ctx->file.name, ".tar") + strlen(".tar") + 1,
-                               ctx->file.size,
-                               ctx->input.data,
-                               ctx->file.index,
-                               length))) {
-            mender_log_error("An error occurred");
-            return ret;
+static mender_err_t
+mender_artifact_read_header_info_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params) {
+
+    assert(NULL != path);
+    assert(NULL != value);
+    assert(NULL != params);
+    mender_artifact_ctx_t     *ctx    = (mender_artifact_ctx_t *)params;
+    unsigned int               index  = 0;
+    int                        length = 0;
+    mender_artifact_payload_t *tmp;
+
+    /* Only the types of the payloads are retrieved */
+    if ((3 != depth) || (1 != sscanf(path, "payloads[%u].type%n", &index, &length)) || ('\0' != path[length])) {
+        return MENDER_OK;
+    }
+    if ((MENDER_JSON_TYPE_STRING != type) || (index > ctx->payloads.size) || ((index < ctx->payloads.size) && (NULL != ctx->payloads.values[index].type))) {
+        mender_log_error("Invalid header-info file");
+        return MENDER_FAIL;
+    }
+
+    /* Add new payload, they are listed in order */
+    if (index == ctx->payloads.size) {
+        if (NULL == (tmp = (mender_artifact_payload_t *)mender_realloc(ctx->payloads.values, (ctx->payloads.size + 1) * sizeof(mender_artifact_payload_t)))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
         }
+        ctx->payloads.values = tmp;
+        memset(&ctx->payloads.values[ctx->payloads.size], 0, sizeof(mender_artifact_payload_t));
+        ctx->payloads.size++;
+    }
 
-        /* Update index */
-        ctx->file.index += MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+    /* Save type of the payload */
+    if (NULL == (ctx->payloads.values[index].type = mender_strdup(value))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_read_meta_data_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params) {
+
+    assert(NULL != path);
+    assert(NULL != value);
+    assert(NULL != params);
+    mender_artifact_ctx_t *ctx   = (mender_artifact_ctx_t *)params;
+    size_t                 index = 0;
+    cJSON                 *item  = NULL;
+
+    /* Meta-data must be an object */
+    if ((0 == depth) || ('{' != ctx->json->stack[0].type)) {
+        mender_log_error("Invalid meta-data file");
+        return MENDER_FAIL;
+    }
+
+    /* Only the top-level values needed to handle the payload type are retrieved */
+    sscanf(ctx->file.name, "header.tar/headers/%u/meta-data", (unsigned int *)&index);
+    if ((1 != depth) || ((NULL != ctx->meta_data_filter) && (false == ctx->meta_data_filter(ctx->payloads.values[index].type, path)))) {
+        return MENDER_OK;
+    }
+
+    /* Add value to the meta-data */
+    switch (type) {
+        case MENDER_JSON_TYPE_STRING:
+            item = cJSON_CreateString(value);
+            break;
+        case MENDER_JSON_TYPE_NUMBER:
+            item = cJSON_CreateNumber(strtod(value, NULL));
+            break;
+        case MENDER_JSON_TYPE_TRUE:
+            item = cJSON_CreateTrue();
+            break;
+        case MENDER_JSON_TYPE_FALSE:
+            item = cJSON_CreateFalse();
+            break;
+        default:
+            item = cJSON_CreateNull();
+            break;
+    }
+    if (NULL == item) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    cJSON_AddItemToObject(ctx->payloads.values[index].meta_data, path, item);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_read_json(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *)) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    void        *data;
+    mender_err_t ret;
+
+    /* Begin parsing of the file */
+    if (NULL == ctx->json) {
+        if (NULL == (ctx->json = (mender_json_reader_t *)mender_malloc(sizeof(mender_json_reader_t)))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        if (MENDER_OK != (ret = mender_json_reader_init(ctx->json, callback, ctx))) {
+            mender_free(ctx->json);
+            ctx->json = NULL;
+            return ret;
+        }
+    }
+
+    /* Parse data until the end of the file has been reached */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Compute the length of the data to parse, it is the largest contiguous data available in the input ring buffer, without rotating it */
+        size_t span = ctx->input.size - ctx->input.index;
+        if (span > ctx->input.length) {
+            span = ctx->input.length;
+        }
+        if (span > mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+            span = mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        }
+        span -= span % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+
+        /* Check if enough data are received (at least one block) */
+        if ((0 == span) || (NULL == (data = mender_artifact_get_data(ctx, span)))) {
+            return MENDER_OK;
+        }
+
+        /* Parse data, padding at the end of the file is ignored */
+        if (MENDER_OK
+            != (ret = mender_json_reader_process(
+                    ctx->json, data, ((ctx->file.size - ctx->file.index) > span) ? span : (ctx->file.size - ctx->file.index)))) {
+            mender_log_error("Unable to parse '%s'", ctx->file.name);
+            return ret;
+        }
+        ctx->file.index += span;
 
         /* Shift data in the buffer */
-        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, span))) {
             mender_log_error("Unable to shift input data");
             return ret;
         }
+    }
 
-    } while (ctx->file.index < ctx->file.size);
+    /* End parsing of the file */
+    ret = mender_json_reader_end(ctx->json);
+    mender_free(ctx->json);
+    ctx->json = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to parse '%s'", ctx->file.name);
+        return ret;
+    }
 
     return MENDER_DONE;
 }
 
+static mender_err_t
+mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    size_t       index;
+    void        *data;
+    mender_err_t ret;
+
+    /* Retrieve payload index */
+    if (MENDER_OK != (ret = mender_artifact_get_payload_index(ctx, &index))) {
+        return ret;
+    }
+
+    /* Check if a file name is provided (we don't check the extension because we don't know it) */
+    if (strlen("data/xxxx.tar") == strlen(ctx->file.name)) {
+
+        /* Beginning of the data file */
+        if (MENDER_OK != (ret = callback(ctx->payloads.values[index].type, ctx->payloads.values[index].meta_data, NULL, 0, NULL, 0, 0))) {
+            mender_log_error("An error occurred");
+            return ret;
+        }
+
+        return MENDER_DONE;
+    }
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    /* Verify checksum of empty files, there is no data to deliver */
+    if (0 == ctx->file.size) {
+        if (MENDER_OK != (ret = mender_artifact_check_checksum(ctx, NULL, 0))) {
+            return ret;
+        }
+    }
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    /* Parse data until the end of the file has been reached, the file may have already been passed through entirely */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Compute the length of the span to deliver, it is the largest contiguous data available in the input ring buffer, without rotating it */
+        size_t span = ctx->input.size - ctx->input.index;
+        if (span > ctx->input.length) {
+            span = ctx->input.length;
+        }
+        if (span > mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+            span = mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        }
+        if (span > CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE) {
+            span = CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE;
+        }
+        span -= span % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+
+        /* Check if enough data are received (at least one block) */
+        if ((0 == span) || (NULL == (data = mender_artifact_get_data(ctx, span)))) {
+            return MENDER_OK;
+        }
+
+        /* Deliver data */
+        if (MENDER_OK != (ret = mender_artifact_deliver_data(ctx, index, data, span, callback))) {
+            return ret;
+        }
+
+        /* Shift data in the buffer */
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, span))) {
+            mender_log_error("Unable to shift input data");
+            return ret;
+        }
+    }
+
+    return MENDER_DONE;
+}
+
+static mender_err_t
+mender_artifact_pass_through_data(mender_artifact_ctx_t *ctx,
+                                  uint8_t              **input_data,
+                                  size_t                *input_length,
+                                  mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != ctx);
+    assert(NULL != input_data);
+    assert(NULL != input_length);
+    assert(NULL != callback);
+    size_t       index;
+    mender_err_t ret;
+
+    /* Pass through is only possible when parsing payload data and if the input ring buffer is empty, so that the TAR alignment is known */
+    if ((false == mender_artifact_is_payload_data(ctx)) || (0 != ctx->input.length)) {
+        return MENDER_OK;
+    }
+
+    /* Retrieve payload index */
+    if (MENDER_OK != (ret = mender_artifact_get_payload_index(ctx, &index))) {
+        return ret;
+    }
+
+    /* Deliver whole blocks until the end of the file has been reached */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Compute the length of the span to deliver */
+        size_t span = *input_length;
+        if (span > mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+            span = mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        }
+        if (span > CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE) {
+            span = CONFIG_MENDER_ARTIFACT_PAYLOAD_SPAN_SIZE;
+        }
+        span -= span % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+
+        /* Check if enough data are received (at least one block) */
+        if (0 == span) {
+            break;
+        }
+
+        /* Deliver data */
+        if (MENDER_OK != (ret = mender_artifact_deliver_data(ctx, index, *input_data, span, callback))) {
+            return ret;
+        }
+
+        /* Consume input data */
+        *input_data += span;
+        *input_length -= span;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_deliver_data(mender_artifact_ctx_t *ctx,
+                             size_t                 index,
+                             void                  *data,
+                             size_t                 span,
+                             mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != ctx);
+    assert(NULL != data);
+    assert(NULL != callback);
+    mender_err_t ret;
+
+    /* Compute length, padding at the end of the file is not delivered */
+    size_t length = ((ctx->file.size - ctx->file.index) > span) ? span : (ctx->file.size - ctx->file.index);
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    /* Compute and verify checksum, this is done before invoking the callback so that invalid data are never delivered at the end of the file */
+    if (MENDER_OK != (ret = mender_artifact_check_checksum(ctx, data, length))) {
+        return ret;
+    }
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    /* Invoke callback */
+    if (MENDER_OK
+        != (ret = callback(ctx->payloads.values[index].type,
+                           ctx->payloads.values[index].meta_data,
+                           strstr(ctx->file.name, ".tar") + strlen(".tar") + 1,
+                           ctx->file.size,
+                           data,
+                           ctx->file.index,
+                           length))) {
+        mender_log_error("An error occurred");
+        return ret;
+    }
+
+    /* Update index */
+    ctx->file.index += span;
+
+    return MENDER_OK;
+}
+
+static bool
+mender_artifact_is_payload_data(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* Check if a payload file of a data file is currently parsed and if data remain (we don't check the extension because we don't know it) */
+    return (MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA == ctx->stream_state) && (true == mender_utils_strbeginwith(ctx->file.name, "data"))
+           && (strlen("data/xxxx.tar") < strlen(ctx->file.name)) && (ctx->file.index < ctx->file.size);
+}
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+
+static mender_err_t
+mender_artifact_check_checksum(mender_artifact_ctx_t *ctx, void *data, size_t length) {
+
+    assert(NULL != ctx);
+    uint8_t      digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    mender_err_t ret;
+
+    /* Retrieve expected checksum and begin computation at the beginning of the file, the name of the file in the manifest is "data/xxxx/<filename>" */
+    if (0 == ctx->file.index) {
+        ctx->file.checksum = NULL;
+        for (size_t index = 0; (NULL == ctx->file.checksum) && (index < ctx->checksums.size); index++) {
+            if ((!strncmp(ctx->checksums.values[index].filename, ctx->file.name, strlen("data/xxxx")))
+                && (!strcmp(ctx->checksums.values[index].filename + strlen("data/xxxx"), ctx->file.name + strlen("data/xxxx.tar")))) {
+                ctx->file.checksum = &ctx->checksums.values[index];
+            }
+        }
+        if (NULL == ctx->file.checksum) {
+            mender_log_error("Checksum of '%s' not found in the manifest", ctx->file.name);
+            return MENDER_FAIL;
+        }
+        if (MENDER_OK != (ret = mender_tls_sha256_begin(&ctx->file.sha256))) {
+            mender_log_error("Unable to begin checksum computation");
+            return ret;
+        }
+    }
+
+    /* Update checksum computation */
+    if ((0 != length) && (MENDER_OK != (ret = mender_tls_sha256_update(ctx->file.sha256, data, length)))) {
+        mender_log_error("Unable to update checksum computation");
+        return ret;
+    }
+
+    /* Verify checksum at the end of the file */
+    if (ctx->file.index + length >= ctx->file.size) {
+        ret              = mender_tls_sha256_end(ctx->file.sha256, digest);
+        ctx->file.sha256 = NULL;
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to end checksum computation");
+            return ret;
+        }
+        if (0 != memcmp(digest, ctx->file.checksum->checksum, MENDER_TLS_SHA256_DIGEST_LENGTH)) {
+            mender_log_error("Invalid checksum of '%s'", ctx->file.name);
+            return MENDER_FAIL;
+        }
+        ctx->file.checksum->verified = true;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_begin_header_checksum(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    /* The manifest signature is located before the header tarball, check it has been verified */
+    if ((NULL != ctx->signature.key) && (true != ctx->signature.verified)) {
+        mender_log_error("Artifact is not signed");
+        return MENDER_FAIL;
+    }
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+    /* Begin computation of the checksum */
+    if (MENDER_OK != mender_tls_sha256_begin(&ctx->checksums.header_sha256)) {
+        mender_log_error("Unable to begin checksum computation");
+        return MENDER_FAIL;
+    }
+    ctx->checksums.header_length = ctx->file.size;
+
+    /* Save the name of the header tarball, used to retrieve the checksum from the manifest */
+    if (NULL != ctx->checksums.header_filename) {
+        mender_free(ctx->checksums.header_filename);
+    }
+    if (NULL == (ctx->checksums.header_filename = mender_strdup(ctx->file.name))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_update_header_checksum(mender_artifact_ctx_t *ctx, void *data, size_t length) {
+
+    assert(NULL != ctx);
+    uint8_t      checksum[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    mender_err_t ret;
+
+    /* Compute the length of the data belonging to the header tarball */
+    if (length > ctx->checksums.header_length) {
+        length = ctx->checksums.header_length;
+    }
+
+    /* Update checksum computation */
+    if (MENDER_OK != (ret = mender_tls_sha256_update(ctx->checksums.header_sha256, data, length))) {
+        mender_log_error("Unable to update checksum computation");
+        return ret;
+    }
+    ctx->checksums.header_length -= length;
+
+    /* Verify checksum at the end of the header tarball */
+    if (0 == ctx->checksums.header_length) {
+        ret                          = mender_tls_sha256_end(ctx->checksums.header_sha256, checksum);
+        ctx->checksums.header_sha256 = NULL;
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to end checksum computation");
+            return ret;
+        }
+        if (MENDER_OK != (ret = mender_artifact_verify_checksum(ctx, ctx->checksums.header_filename, checksum))) {
+            return ret;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_verify_checksum(mender_artifact_ctx_t *ctx, char *filename, uint8_t *checksum) {
+
+    assert(NULL != ctx);
+    assert(NULL != filename);
+    assert(NULL != checksum);
+
+    /* Search file name in the manifest and compare checksums */
+    for (size_t index = 0; index < ctx->checksums.size; index++) {
+        if (!strcmp(ctx->checksums.values[index].filename, filename)) {
+            if (0 != memcmp(checksum, ctx->checksums.values[index].checksum, MENDER_TLS_SHA256_DIGEST_LENGTH)) {
+                mender_log_error("Invalid checksum of '%s'", filename);
+                return MENDER_FAIL;
+            }
+            ctx->checksums.values[index].verified = true;
+            return MENDER_OK;
+        }
+    }
+    mender_log_error("Checksum of '%s' not found in the manifest", filename);
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_artifact_compute_checksum(void *data, size_t length, uint8_t *checksum) {
+
+    assert(NULL != checksum);
+    void        *sha256;
+    mender_err_t ret;
+
+    /* Compute checksum */
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&sha256))) {
+        return ret;
+    }
+    if ((0 != length) && (MENDER_OK != (ret = mender_tls_sha256_update(sha256, data, length)))) {
+        mender_tls_sha256_end(sha256, NULL);
+        return ret;
+    }
+
+    return mender_tls_sha256_end(sha256, checksum);
+}
+
+static mender_err_t
+mender_artifact_hex_to_bin(char *hex, uint8_t *data, size_t length) {
+
+    assert(NULL != hex);
+    assert(NULL != data);
+
+    /* Convert each pair of hexadecimal characters */
+    for (size_t index = 0; index < 2 * length; index++) {
+        uint8_t value;
+        if ((hex[index] >= '0') && (hex[index] <= '9')) {
+            value = hex[index] - '0';
+        } else if ((hex[index] >= 'a') && (hex[index] <= 'f')) {
+            value = hex[index] - 'a' + 10;
+        } else if ((hex[index] >= 'A') && (hex[index] <= 'F')) {
+            value = hex[index] - 'A' + 10;
+        } else {
+            return MENDER_FAIL;
+        }
+        data[index / 2] = (0 == index % 2) ? (value << 4) : (data[index / 2] | value);
+    }
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+
+static mender_err_t
+mender_artifact_get_payload_index(mender_artifact_ctx_t *ctx, size_t *index) {
+
+    assert(NULL != ctx);
+    assert(NULL != index);
+
+    /* Retrieve payload index */
+    *index = 0;
+    if (1 != sscanf(ctx->file.name, "data/%u.tar", (unsigned int *)index)) {
+        mender_log_error("Invalid artifact format");
+        return MENDER_FAIL;
+    }
+    if (*index >= ctx->payloads.size) {
+        mender_log_error("Invalid artifact format");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 static mender_err_t
 mender_artifact_drop_file(mender_artifact_ctx_t *ctx) {
 
@@ -595,7 +1826,7 @@ mender_artifact_drop_file(mender_artifact_ctx_t *ctx) {
     do {
 
         /* Check if enough data are received (at least one block) */
-        if ((NULL == ctx->input.data) || (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+        if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
             return MENDER_OK;
         }
 
@@ -614,31 +1845,231 @@ mender_artifact_drop_file(mender_artifact_ctx_t *ctx) {
 }
 
 static mender_err_t
-mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_t length) {
+mender_artifact_begin_decompression(mender_artifact_ctx_t *ctx, mender_artifact_compression_t type) {
 
     assert(NULL != ctx);
-    char *tmp;
-
-    /* Shift data */
-    if (length > 0) {
-        if (ctx->input.length > length) {
-            memcpy(ctx->input.data, (void *)(((uint8_t *)ctx->input.data) + length), ctx->input.length - length);
-            if (NULL == (tmp = realloc(ctx->input.data, ctx->input.length - length))) {
-                mender_log_error("Unable to allocate memory");
+    mender_err_t ret;
+
+    /* Begin decompression */
+    if (MENDER_OK != (ret = mender_artifact_decompress_begin(type, &ctx->decompress.handle))) {
+        if (MENDER_NOT_IMPLEMENTED == ret) {
+            mender_log_error("Compression of '%s' is not supported", ctx->file.name);
+        } else {
+            mender_log_error("Unable to begin decompression");
+        }
+        return MENDER_FAIL;
+    }
+    ctx->decompress.length         = ctx->file.size;
+    ctx->decompress.padding        = mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE) - ctx->file.size;
+    ctx->decompress.done           = false;
+    ctx->decompress.output_pending = false;
+    ctx->decompress.compressed     = true;
+
+    /* Remove the extension of the file name */
+    *strrchr(ctx->file.name, '.') = '\0';
+
+    /* Move data available in the input ring buffer out of it, so that it can receive the decompressed data */
+    if (0 != ctx->input.length) {
+        if (NULL == (ctx->decompress.pending = (uint8_t *)mender_malloc(ctx->input.length))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        size_t first_part = (ctx->input.length > ctx->input.size - ctx->input.index) ? (ctx->input.size - ctx->input.index) : ctx->input.length;
+        memcpy(ctx->decompress.pending, ctx->input.data + ctx->input.index, first_part);
+        memcpy(ctx->decompress.pending + first_part, ctx->input.data, ctx->input.length - first_part);
+        ctx->decompress.pending_length = ctx->input.length;
+    }
+    ctx->input.index  = 0;
+    ctx->input.length = 0;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_decompress_data(mender_artifact_ctx_t *ctx, uint8_t **input_data, size_t *input_length) {
+
+    assert(NULL != ctx);
+    assert(NULL != input_data);
+    assert(NULL != input_length);
+    uint8_t     *output_data;
+    size_t       output_length;
+    size_t       length;
+    size_t       available;
+    mender_err_t ret;
+
+    /* Decompress data directly to the free space of the input ring buffer, until it is full or more input data are required */
+    while (false == ctx->decompress.done) {
+
+        /* Retrieve free space of the input ring buffer, the decompression is resumed when data have been parsed */
+        output_data = mender_artifact_get_free_space(ctx, &output_length);
+        if (0 == (available = output_length)) {
+            ctx->decompress.output_pending = true;
+            return MENDER_OK;
+        }
+
+        /* Decompress data, the compressed data of the member are followed by the padding and the next members */
+        length = (*input_length > ctx->decompress.length) ? ctx->decompress.length : *input_length;
+        if (MENDER_OK > (ret = mender_artifact_decompress_process(ctx->decompress.handle, *input_data, &length, output_data, &output_length))) {
+            mender_log_error("Unable to decompress '%s'", ctx->file.name);
+            return ret;
+        }
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+        /* Update checksum of the header tarball with the compressed data */
+        if ((NULL != ctx->checksums.header_sha256) && (0 != length)) {
+            if (MENDER_OK != mender_artifact_update_header_checksum(ctx, *input_data, length)) {
                 return MENDER_FAIL;
             }
-            ctx->input.data = tmp;
-            ctx->input.length -= length;
-        } else {
-            free(ctx->input.data);
-            ctx->input.data   = NULL;
-            ctx->input.length = 0;
+        }
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+        /* Consume input data and append output data to the input ring buffer */
+        *input_data                    += length;
+        *input_length                  -= length;
+        ctx->decompress.length         -= length;
+        ctx->input.length              += output_length;
+        ctx->decompress.output_pending  = (output_length == available);
+
+        /* Check if the end of the compressed stream has been reached, remaining data of the member are ignored */
+        if (MENDER_DONE == ret) {
+            ctx->decompress.done            = true;
+            ctx->decompress.output_pending  = false;
+            ctx->decompress.padding        += ctx->decompress.length;
+            ctx->decompress.length          = 0;
+        } else if (false == ctx->decompress.output_pending) {
+            if (0 == ctx->decompress.length) {
+                mender_log_error("Unable to decompress '%s', compressed data are truncated", ctx->file.name);
+                return MENDER_FAIL;
+            }
+            return MENDER_OK;
+        }
+    }
+
+    /* Skip padding at the end of the member */
+    length = (*input_length > ctx->decompress.padding) ? ctx->decompress.padding : *input_length;
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    if ((NULL != ctx->checksums.header_sha256) && (0 != length)) {
+        if (MENDER_OK != mender_artifact_update_header_checksum(ctx, *input_data, length)) {
+            return MENDER_FAIL;
+        }
+    }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    *input_data             += length;
+    *input_length           -= length;
+    ctx->decompress.padding -= length;
+
+    /* End decompression at the end of the member */
+    if (0 == ctx->decompress.padding) {
+        mender_artifact_decompress_end(ctx->decompress.handle);
+        ctx->decompress.handle = NULL;
+    }
+
+    return MENDER_OK;
+}
+
+static size_t
+mender_artifact_write_data(mender_artifact_ctx_t *ctx, uint8_t *data, size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != data);
+
+    /* Compute the length of the data that can be written */
+    if (length > ctx->input.size - ctx->input.length) {
+        length = ctx->input.size - ctx->input.length;
+    }
+
+    /* Copy data after the last data available, in two parts if wrapping around the end of the ring buffer */
+    size_t write_index = (ctx->input.index + ctx->input.length) % ctx->input.size;
+    size_t first_part  = (length > ctx->input.size - write_index) ? (ctx->input.size - write_index) : length;
+    memcpy(ctx->input.data + write_index, data, first_part);
+    memcpy(ctx->input.data, data + first_part, length - first_part);
+    ctx->input.length += length;
+
+    return length;
+}
+
+static uint8_t *
+mender_artifact_get_free_space(mender_artifact_ctx_t *ctx, size_t *length) {
+
+    assert(NULL != ctx);
+    assert(NULL != length);
+
+    /* Restart from the beginning of the input ring buffer if it is empty, this maximizes the contiguous free space */
+    if (0 == ctx->input.length) {
+        ctx->input.index = 0;
+    }
+
+    /* Compute the contiguous free space after the last data available */
+    size_t write_index = (ctx->input.index + ctx->input.length) % ctx->input.size;
+    *length            = (ctx->input.index + ctx->input.length < ctx->input.size) ? (ctx->input.size - write_index) : (ctx->input.index - write_index);
+
+    return ctx->input.data + write_index;
+}
+
+static void *
+mender_artifact_get_data(mender_artifact_ctx_t *ctx, size_t length) {
+
+    assert(NULL != ctx);
+
+    /* Check if enough data are available */
+    if (ctx->input.length < length) {
+        return NULL;
+    }
+
+    /* Rotate the content of the ring buffer if the data wrap around, this only occurs with files bigger than one block */
+    if (ctx->input.index + length > ctx->input.size) {
+        mender_artifact_reverse(ctx->input.data, ctx->input.index);
+        mender_artifact_reverse(ctx->input.data + ctx->input.index, ctx->input.size - ctx->input.index);
+        mender_artifact_reverse(ctx->input.data, ctx->input.size);
+        ctx->input.index = 0;
+    }
+
+    return ctx->input.data + ctx->input.index;
+}
+
+static mender_err_t
+mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_t length) {
+
+    assert(NULL != ctx);
+
+    /* Check if enough data are available */
+    if (length > ctx->input.length) {
+        mender_log_error("Invalid length of data to shift");
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    /* Update checksum of the header tarball, in two parts if the data wrap around the end of the ring buffer, compressed data are hashed when decompressed */
+    if ((NULL != ctx->checksums.header_sha256) && (NULL == ctx->decompress.handle)) {
+        size_t first_part = (length > ctx->input.size - ctx->input.index) ? (ctx->input.size - ctx->input.index) : length;
+        if ((MENDER_OK != mender_artifact_update_header_checksum(ctx, ctx->input.data + ctx->input.index, first_part))
+            || ((first_part < length) && (NULL != ctx->checksums.header_sha256)
+                && (MENDER_OK != mender_artifact_update_header_checksum(ctx, ctx->input.data, length - first_part)))) {
+            return MENDER_FAIL;
         }
     }
 
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    /* Advance read index */
+    ctx->input.index = (ctx->input.index + length) % ctx->input.size;
+    ctx->input.length -= length;
+
     return MENDER_OK;
 }
 
+static void
+mender_artifact_reverse(uint8_t *data, size_t length) {
+
+    assert(NULL != data);
+
+    /* Reverse data in place */
+    for (size_t index = 0; index < length / 2; index++) {
+        uint8_t tmp              = data[index];
+        data[index]              = data[length - 1 - index];
+        data[length - 1 - index] = tmp;
+    }
+}
+
 static size_t
 mender_artifact_round_up(size_t length, size_t incr) {
     return length + (incr - length % incr) % incr;
@@ -0,0 +1,275 @@
+/**
+ * @file      mender-client-flash-pipeline.c
+ * @brief     Mender MCU client flash pipeline, the data received are written to the flash by a dedicated task while the download continues
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
+#include "mender-client-flash.h"
+#include "mender-client-flash-pipeline.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+/**
+ * @brief Default flash pipeline buffer count
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT
+#define CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT (4)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT */
+
+/**
+ * @brief Default flash pipeline buffer size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE */
+
+/**
+ * @brief Default flash pipeline task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_STACK_SIZE
+#define CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_STACK_SIZE (4)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_STACK_SIZE */
+
+/**
+ * @brief Default flash pipeline task priority
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_PRIORITY
+#define CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_PRIORITY */
+
+/**
+ * @brief Flash pipeline buffer
+ */
+typedef struct {
+    void        *data;   /**< Data to be written */
+    size_t       index;  /**< Index of the data */
+    size_t       length; /**< Length of the data, 0 to ask the flash pipeline task to terminate */
+    mender_err_t ret;    /**< Result of the flash writes, set by the flash pipeline task when the buffer is given back */
+} mender_client_flash_pipeline_buffer_t;
+
+/**
+ * @brief Flash pipeline, the data received are copied to free buffers and written to the flash by a dedicated task which gives the buffers back
+ */
+static struct {
+    void                                 *task;                                                     /**< Flash pipeline task handle, NULL if not started */
+    void                                 *free_queue;                                               /**< Queue of the free buffers */
+    void                                 *write_queue;                                              /**< Queue of the buffers to be written */
+    mender_err_t                          ret;                                                      /**< Result of the flash writes */
+    mender_client_flash_pipeline_buffer_t buffers[CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT]; /**< Buffers */
+} mender_client_flash_pipeline;
+
+/**
+ * @brief Flash pipeline task function, write the buffers to the flash until it is asked to terminate
+ * @param arg Not used
+ */
+static void mender_client_flash_pipeline_task(void *arg);
+
+/**
+ * @brief Release the queues and the buffers of the flash pipeline
+ */
+static void mender_client_flash_pipeline_release(void);
+
+mender_err_t
+mender_client_flash_pipeline_start(void) {
+
+    mender_err_t ret;
+
+    /* Check if the flash pipeline is already started */
+    if (NULL != mender_client_flash_pipeline.task) {
+        return MENDER_OK;
+    }
+
+    /* Create queues */
+    if (MENDER_OK
+        != (ret = mender_scheduler_queue_create(
+                CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT, sizeof(mender_client_flash_pipeline_buffer_t *), &mender_client_flash_pipeline.free_queue))) {
+        mender_log_error("Unable to create free buffers queue");
+        goto FAIL;
+    }
+    if (MENDER_OK
+        != (ret = mender_scheduler_queue_create(
+                CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT, sizeof(mender_client_flash_pipeline_buffer_t *), &mender_client_flash_pipeline.write_queue))) {
+        mender_log_error("Unable to create write buffers queue");
+        goto FAIL;
+    }
+
+    /* Allocate buffers */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT; index++) {
+        mender_client_flash_pipeline_buffer_t *buffer = &mender_client_flash_pipeline.buffers[index];
+        if (NULL == (buffer->data = mender_malloc(CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto FAIL;
+        }
+        buffer->ret = MENDER_OK;
+        if (MENDER_OK != (ret = mender_scheduler_queue_send(mender_client_flash_pipeline.free_queue, &buffer, -1))) {
+            mender_log_error("Unable to give buffer");
+            goto FAIL;
+        }
+    }
+
+    /* Create flash pipeline task */
+    mender_scheduler_task_params_t task_params = { .function   = mender_client_flash_pipeline_task,
+                                                   .arg        = NULL,
+                                                   .name       = "mender_client_flash_pipeline",
+                                                   .stack_size = CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_STACK_SIZE,
+                                                   .priority   = CONFIG_MENDER_CLIENT_FLASH_PIPELINE_TASK_PRIORITY };
+    mender_client_flash_pipeline.ret           = MENDER_OK;
+    if (MENDER_OK != (ret = mender_scheduler_task_create(&task_params, &mender_client_flash_pipeline.task))) {
+        mender_log_error("Unable to create flash pipeline task");
+        goto FAIL;
+    }
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_client_flash_pipeline_release();
+
+    return ret;
+}
+
+mender_err_t
+mender_client_flash_pipeline_write(void *data, size_t index, size_t length) {
+
+    assert(NULL != mender_client_flash_pipeline.task);
+    mender_err_t                           ret;
+    mender_client_flash_pipeline_buffer_t *buffer;
+
+    /* Copy data to the buffers, the data are split if they are larger than the buffers */
+    while (length > 0) {
+
+        /* Take a free buffer */
+        if (MENDER_OK != (ret = mender_scheduler_queue_receive(mender_client_flash_pipeline.free_queue, &buffer, -1))) {
+            mender_log_error("Unable to take buffer");
+            return ret;
+        }
+
+        /* Check the result of the previous flash writes, the buffer is given back to stop the flash pipeline */
+        if (MENDER_OK != buffer->ret) {
+            ret = buffer->ret;
+            mender_scheduler_queue_send(mender_client_flash_pipeline.free_queue, &buffer, -1);
+            return ret;
+        }
+
+        /* Copy data and submit the buffer to the flash pipeline task */
+        buffer->index  = index;
+        buffer->length = (length < CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE) ? length : CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE;
+        memcpy(buffer->data, data, buffer->length);
+        data = (uint8_t *)data + buffer->length;
+        index += buffer->length;
+        length -= buffer->length;
+        if (MENDER_OK != (ret = mender_scheduler_queue_send(mender_client_flash_pipeline.write_queue, &buffer, -1))) {
+            mender_log_error("Unable to submit buffer");
+            return ret;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_client_flash_pipeline_stop(void) {
+
+    mender_err_t                           ret;
+    mender_client_flash_pipeline_buffer_t *buffer;
+
+    /* Check if the flash pipeline is started */
+    if (NULL == mender_client_flash_pipeline.task) {
+        return MENDER_OK;
+    }
+
+    /* Submit an empty buffer, this ask the flash pipeline task to terminate once the previous buffers have been written */
+    if (MENDER_OK != (ret = mender_scheduler_queue_receive(mender_client_flash_pipeline.free_queue, &buffer, -1))) {
+        mender_log_error("Unable to take buffer");
+        return ret;
+    }
+    buffer->length = 0;
+    if (MENDER_OK != (ret = mender_scheduler_queue_send(mender_client_flash_pipeline.write_queue, &buffer, -1))) {
+        mender_log_error("Unable to submit buffer");
+        return ret;
+    }
+
+    /* Wait for the end of the flash pipeline task */
+    if (MENDER_OK != (ret = mender_scheduler_task_join(mender_client_flash_pipeline.task))) {
+        mender_log_error("Unable to join flash pipeline task");
+        return ret;
+    }
+    mender_client_flash_pipeline.task = NULL;
+    ret                               = mender_client_flash_pipeline.ret;
+
+    /* Release memory */
+    mender_client_flash_pipeline_release();
+
+    return ret;
+}
+
+static void
+mender_client_flash_pipeline_task(void *arg) {
+
+    (void)arg;
+    mender_err_t                           ret = MENDER_OK;
+    mender_client_flash_pipeline_buffer_t *buffer;
+
+    /* Write the buffers until an empty buffer is received, the buffers are given back with the result of the flash writes */
+    while (MENDER_OK == mender_scheduler_queue_receive(mender_client_flash_pipeline.write_queue, &buffer, -1)) {
+        if (0 == buffer->length) {
+            break;
+        }
+        if (MENDER_OK == ret) {
+            if (MENDER_OK != (ret = mender_client_flash_write(buffer->data, buffer->index, buffer->length))) {
+                mender_log_error("Unable to write data to flash");
+            }
+        }
+        buffer->ret = ret;
+        mender_scheduler_queue_send(mender_client_flash_pipeline.free_queue, &buffer, -1);
+    }
+
+    /* Save the result of the flash writes */
+    mender_client_flash_pipeline.ret = ret;
+}
+
+static void
+mender_client_flash_pipeline_release(void) {
+
+    /* Release queues */
+    if (NULL != mender_client_flash_pipeline.free_queue) {
+        mender_scheduler_queue_delete(mender_client_flash_pipeline.free_queue);
+        mender_client_flash_pipeline.free_queue = NULL;
+    }
+    if (NULL != mender_client_flash_pipeline.write_queue) {
+        mender_scheduler_queue_delete(mender_client_flash_pipeline.write_queue);
+        mender_client_flash_pipeline.write_queue = NULL;
+    }
+
+    /* Release buffers */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_COUNT; index++) {
+        if (NULL != mender_client_flash_pipeline.buffers[index].data) {
+            mender_free(mender_client_flash_pipeline.buffers[index].data);
+            mender_client_flash_pipeline.buffers[index].data = NULL;
+        }
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
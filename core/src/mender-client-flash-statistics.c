@@ -0,0 +1,164 @@
+/**
+ * @file      mender-client-flash-statistics.c
+ * @brief     Mender MCU client flash statistics, the calls to the flash API are measured while the image is written
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
+#include "mender-client.h"
+#include "mender-client-flash-statistics.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+
+/**
+ * @brief Number of buckets of the flash latency histograms, the bucket n counts the latencies lower than 2^n microseconds
+ */
+#define MENDER_CLIENT_FLASH_STATISTICS_BUCKET_COUNT (32)
+
+/**
+ * @brief Flash operation statistics, the average and the 99th percentile latencies are computed when the statistics are retrieved
+ */
+typedef struct {
+    mender_client_flash_operation_statistics_t summary;                                                /**< Calls, bytes, failures, minimum and maximum latencies */
+    uint64_t                                   total_us;                                               /**< Cumulated latency */
+    uint32_t                                   histogram[MENDER_CLIENT_FLASH_STATISTICS_BUCKET_COUNT]; /**< Latency histogram */
+} mender_client_flash_statistics_operation_t;
+
+/**
+ * @brief Flash statistics, measured around the calls to the flash API, indexed by flash operation
+ */
+static mender_client_flash_statistics_operation_t mender_client_flash_statistics[MENDER_CLIENT_FLASH_OPERATION_COUNT];
+
+/**
+ * @brief Compute the statistics of a flash operation
+ * @param operation Flash operation
+ * @param statistics Statistics computed
+ */
+static void mender_client_flash_statistics_compute(mender_client_flash_operation_t operation, mender_client_flash_operation_statistics_t *statistics);
+
+void
+mender_client_flash_statistics_reset(void) {
+
+    /* Reset the statistics of all the flash operations */
+    memset(mender_client_flash_statistics, 0, sizeof(mender_client_flash_statistics));
+}
+
+void
+mender_client_flash_statistics_record(mender_client_flash_operation_t operation, uint64_t start_us, size_t bytes, mender_err_t ret) {
+
+    assert(operation < MENDER_CLIENT_FLASH_OPERATION_COUNT);
+    mender_client_flash_statistics_operation_t *statistics = &mender_client_flash_statistics[operation];
+    uint64_t                                    elapsed_us = mender_scheduler_get_uptime_us() - start_us;
+    uint32_t                                    bucket     = 0;
+
+    /* Saturate the latency */
+    if (elapsed_us > UINT32_MAX) {
+        elapsed_us = UINT32_MAX;
+    }
+
+    /* Update counters */
+    if (MENDER_OK != ret) {
+        statistics->summary.failures++;
+    }
+    if ((0 == statistics->summary.calls) || (elapsed_us < statistics->summary.min_us)) {
+        statistics->summary.min_us = (uint32_t)elapsed_us;
+    }
+    if (elapsed_us > statistics->summary.max_us) {
+        statistics->summary.max_us = (uint32_t)elapsed_us;
+    }
+    statistics->summary.calls++;
+    statistics->summary.bytes += bytes;
+    statistics->total_us       += elapsed_us;
+
+    /* Update histogram, the bucket is the number of significant bits of the latency */
+    while ((bucket < MENDER_CLIENT_FLASH_STATISTICS_BUCKET_COUNT - 1) && (0 != (elapsed_us >> bucket))) {
+        bucket++;
+    }
+    statistics->histogram[bucket]++;
+}
+
+void
+mender_client_flash_statistics_log(void) {
+
+    mender_client_flash_statistics_t statistics;
+
+    /* Compute and log the flash statistics */
+    mender_client_get_flash_statistics(&statistics);
+    mender_log_info("Flash write: %u calls, %lu bytes, %u failures, latency min/avg/max/p99 %u/%u/%u/%u us",
+                    (unsigned int)statistics.write.calls,
+                    (unsigned long)statistics.write.bytes,
+                    (unsigned int)statistics.write.failures,
+                    (unsigned int)statistics.write.min_us,
+                    (unsigned int)statistics.write.avg_us,
+                    (unsigned int)statistics.write.max_us,
+                    (unsigned int)statistics.write.p99_us);
+    mender_log_info("Flash close latency: %u us, set pending image latency: %u us",
+                    (unsigned int)statistics.close.max_us,
+                    (unsigned int)statistics.set_pending_image.max_us);
+}
+
+mender_err_t
+mender_client_get_flash_statistics(mender_client_flash_statistics_t *statistics) {
+
+    assert(NULL != statistics);
+
+    /* Compute the statistics of each flash operation */
+    mender_client_flash_statistics_compute(MENDER_CLIENT_FLASH_OPERATION_WRITE, &statistics->write);
+    mender_client_flash_statistics_compute(MENDER_CLIENT_FLASH_OPERATION_CLOSE, &statistics->close);
+    mender_client_flash_statistics_compute(MENDER_CLIENT_FLASH_OPERATION_SET_PENDING_IMAGE, &statistics->set_pending_image);
+
+    return MENDER_OK;
+}
+
+static void
+mender_client_flash_statistics_compute(mender_client_flash_operation_t operation, mender_client_flash_operation_statistics_t *statistics) {
+
+    assert(operation < MENDER_CLIENT_FLASH_OPERATION_COUNT);
+    assert(NULL != statistics);
+    mender_client_flash_statistics_operation_t *source = &mender_client_flash_statistics[operation];
+    uint32_t                                    rank;
+    uint32_t                                    count  = 0;
+    uint32_t                                    bucket = 0;
+
+    /* Copy counters */
+    memcpy(statistics, &source->summary, sizeof(mender_client_flash_operation_statistics_t));
+    if (0 == statistics->calls) {
+        return;
+    }
+    statistics->avg_us = (uint32_t)(source->total_us / statistics->calls);
+
+    /* Search the bucket of the histogram reaching the rank of the 99th percentile */
+    rank = (uint32_t)(((uint64_t)statistics->calls * 99 + 99) / 100);
+    while (bucket < MENDER_CLIENT_FLASH_STATISTICS_BUCKET_COUNT) {
+        count += source->histogram[bucket];
+        if (count >= rank) {
+            break;
+        }
+        bucket++;
+    }
+    statistics->p99_us = (uint32_t)((1ULL << bucket) - 1);
+    if (statistics->p99_us > statistics->max_us) {
+        statistics->p99_us = statistics->max_us;
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
@@ -0,0 +1,489 @@
+/**
+ * @file      mender-client-flash.c
+ * @brief     Mender MCU client flash handle, the data are gathered in the flash write buffer and the image is verified once written
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
+#include "mender-client-flash.h"
+#include "mender-client-flash-statistics.h"
+#include "mender-client-install-checkpoint.h"
+#include "mender-flash.h"
+#include "mender-log.h"
+#include "mender-metrics.h"
+#include "mender-scheduler.h"
+#include "mender-tls.h"
+#include "mender-trace.h"
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER
+
+/**
+ * @brief Default flash write buffer size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE */
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+
+/**
+ * @brief Default flash verification buffer size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE */
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+/**
+ * @brief Flash handle used to store temporary reference to write rootfs-image data
+ */
+static void *mender_client_flash_handle = NULL;
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER
+
+/**
+ * @brief Flash write buffer, the data are gathered to be written to the flash by chunks of the size of the buffer
+ */
+static struct {
+    uint8_t *data;   /**< Data to be written, allocated with the first write */
+    size_t   index;  /**< Index of the data */
+    size_t   length; /**< Length of the data */
+} mender_client_flash_write_buffer = { .data = NULL, .index = 0, .length = 0 };
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+
+/**
+ * @brief Flash verification, the digest of the data written is compared with the digest of the data read back when the image is complete
+ */
+static struct {
+    void  *sha256; /**< SHA-256 context of the data written, NULL if not computing */
+    size_t length; /**< Length of the data written */
+} mender_client_flash_verify = { .sha256 = NULL, .length = 0 };
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+/**
+ * @brief Write data to the flash handle, the write is measured if the flash statistics are enabled
+ * @param data Data
+ * @param index Data index
+ * @param length Data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_flash_write_data(void *data, size_t index, size_t length);
+
+/**
+ * @brief Close the flash handle, the close is measured if the flash statistics are enabled
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_flash_close_handle(void);
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+
+/**
+ * @brief Update the digest of the data written to the flash, the digest is restarted when a new image begins
+ * @param data Data
+ * @param index Data index
+ * @param length Data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_flash_verify_update(void *data, size_t index, size_t length);
+
+/**
+ * @brief Read back the image from the flash and compare its digest with the digest of the data written
+ * @return MENDER_OK if the image is valid or if the flash can't be read back, error code otherwise
+ */
+static mender_err_t mender_client_flash_verify_check(void);
+
+/**
+ * @brief Release the digest of the data written to the flash
+ */
+static void mender_client_flash_verify_release(void);
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+mender_err_t
+mender_client_flash_open(char *name, size_t size) {
+
+    assert(NULL != name);
+    mender_err_t ret;
+
+    /* Open the flash handle */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+    mender_client_flash_statistics_reset();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_FLASH_OPEN);
+    ret = mender_flash_open(name, size, &mender_client_flash_handle);
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_FLASH_OPEN);
+
+    return ret;
+}
+
+mender_err_t
+mender_client_flash_resume(char *name, size_t size, size_t *index) {
+
+    assert(NULL != name);
+    assert(NULL != index);
+    mender_err_t ret;
+
+    /* Resume the flash handle */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+    mender_client_flash_statistics_reset();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_FLASH_OPEN);
+    ret = mender_flash_resume(name, size, index, &mender_client_flash_handle);
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_FLASH_OPEN);
+
+    return ret;
+}
+
+mender_err_t
+mender_client_flash_write(void *data, size_t index, size_t length) {
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER
+    mender_err_t ret;
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Compute the digest of the data written */
+    if (MENDER_OK != mender_client_flash_verify_update(data, index, length)) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER
+    /* Allocate the flash write buffer if it has not been done yet */
+    if (NULL == mender_client_flash_write_buffer.data) {
+        if (NULL == (mender_client_flash_write_buffer.data = (uint8_t *)mender_malloc(CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        mender_client_flash_write_buffer.index  = index;
+        mender_client_flash_write_buffer.length = 0;
+    }
+
+    /* Data of a previous image not written are discarded when a new image begins */
+    if (0 == index) {
+        mender_client_flash_write_buffer.index  = 0;
+        mender_client_flash_write_buffer.length = 0;
+    }
+
+    /* Data must follow the data already gathered */
+    if (mender_client_flash_write_buffer.index + mender_client_flash_write_buffer.length != index) {
+        mender_log_error("Unable to write data to flash, data are not contiguous");
+        return MENDER_FAIL;
+    }
+
+    while (length > 0) {
+
+        /* Write whole chunks directly when the buffer is empty, otherwise complete the buffer */
+        size_t chunk_length;
+        if ((0 == mender_client_flash_write_buffer.length) && (length >= CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE)) {
+            chunk_length = length - (length % CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE);
+            if (MENDER_OK != (ret = mender_client_flash_write_data(data, index, chunk_length))) {
+                return ret;
+            }
+            mender_client_flash_write_buffer.index += chunk_length;
+        } else {
+            chunk_length = CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE - mender_client_flash_write_buffer.length;
+            if (chunk_length > length) {
+                chunk_length = length;
+            }
+            memcpy(&mender_client_flash_write_buffer.data[mender_client_flash_write_buffer.length], data, chunk_length);
+            mender_client_flash_write_buffer.length += chunk_length;
+            if (CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE == mender_client_flash_write_buffer.length) {
+                if (MENDER_OK
+                    != (ret = mender_client_flash_write_data(
+                            mender_client_flash_write_buffer.data, mender_client_flash_write_buffer.index, CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE))) {
+                    return ret;
+                }
+                mender_client_flash_write_buffer.index += CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER_SIZE;
+                mender_client_flash_write_buffer.length = 0;
+            }
+        }
+        data = (uint8_t *)data + chunk_length;
+        index += chunk_length;
+        length -= chunk_length;
+    }
+
+    return MENDER_OK;
+#else
+    /* Write data */
+    return mender_client_flash_write_data(data, index, length);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER */
+}
+
+mender_err_t
+mender_client_flash_read_back(void *data, size_t index, size_t length) {
+
+    mender_err_t ret;
+
+    /* Read back the data already written */
+    if (MENDER_OK != (ret = mender_flash_read(mender_client_flash_handle, data, index, length))) {
+        return ret;
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Compute the digest of the data written */
+    if (MENDER_OK != (ret = mender_client_flash_verify_update(data, index, length))) {
+        return ret;
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_client_flash_close(void) {
+
+#if defined(CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER) || defined(CONFIG_MENDER_CLIENT_FLASH_VERIFY)
+    mender_err_t ret = MENDER_OK;
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER || CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER
+    /* Write the data remaining in the flash write buffer and release it */
+    if (NULL != mender_client_flash_write_buffer.data) {
+        if (mender_client_flash_write_buffer.length > 0) {
+            ret = mender_client_flash_write_data(
+                mender_client_flash_write_buffer.data, mender_client_flash_write_buffer.index, mender_client_flash_write_buffer.length);
+        }
+        mender_free(mender_client_flash_write_buffer.data);
+        mender_client_flash_write_buffer.data = NULL;
+    }
+    if (MENDER_OK != ret) {
+        return ret;
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Close the flash handle and verify the image */
+    if (MENDER_OK != (ret = mender_client_flash_close_handle())) {
+        mender_client_flash_verify_release();
+        return ret;
+    }
+    return mender_client_flash_verify_check();
+#else
+    /* Close the flash handle */
+    return mender_client_flash_close_handle();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+}
+
+void
+mender_client_flash_abort_deployment(void) {
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER
+    /* Release the flash write buffer */
+    if (NULL != mender_client_flash_write_buffer.data) {
+        mender_free(mender_client_flash_write_buffer.data);
+        mender_client_flash_write_buffer.data = NULL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_WRITE_BUFFER */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Release the digest of the data written */
+    mender_client_flash_verify_release();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+    /* Abort the deployment */
+    mender_flash_abort_deployment(mender_client_flash_handle);
+}
+
+mender_err_t
+mender_client_flash_set_pending_image(void) {
+
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_FLASH_SET_PENDING);
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+    uint64_t     start_us = mender_scheduler_get_uptime_us();
+    mender_err_t ret      = mender_flash_set_pending_image(mender_client_flash_handle);
+    mender_client_flash_statistics_record(MENDER_CLIENT_FLASH_OPERATION_SET_PENDING_IMAGE, start_us, 0, ret);
+#else
+    mender_err_t ret = mender_flash_set_pending_image(mender_client_flash_handle);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_FLASH_SET_PENDING);
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_flash_write_data(void *data, size_t index, size_t length) {
+
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_FLASH_WRITE);
+#if defined(CONFIG_MENDER_CLIENT_FLASH_STATISTICS) || defined(CONFIG_MENDER_CLIENT_METRICS)
+    uint64_t     start_us = mender_scheduler_get_uptime_us();
+    mender_err_t ret      = mender_flash_write(mender_client_flash_handle, data, index, length);
+    MENDER_METRICS_ADD(MENDER_METRICS_FLASH_WRITE_DURATION, (uint32_t)(mender_scheduler_get_uptime_us() - start_us));
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+    mender_client_flash_statistics_record(MENDER_CLIENT_FLASH_OPERATION_WRITE, start_us, length, ret);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+#else
+    mender_err_t ret = mender_flash_write(mender_client_flash_handle, data, index, length);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS || CONFIG_MENDER_CLIENT_METRICS */
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_FLASH_WRITE);
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+    /* Record the length of the data written, it is saved with the next install checkpoint */
+    if (MENDER_OK == ret) {
+        mender_client_install_checkpoint_update(index + length);
+    }
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_flash_close_handle(void) {
+
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_FLASH_CLOSE);
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+    uint64_t     start_us = mender_scheduler_get_uptime_us();
+    mender_err_t ret      = mender_flash_close(mender_client_flash_handle);
+    mender_client_flash_statistics_record(MENDER_CLIENT_FLASH_OPERATION_CLOSE, start_us, 0, ret);
+#else
+    mender_err_t ret = mender_flash_close(mender_client_flash_handle);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_FLASH_CLOSE);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+
+static mender_err_t
+mender_client_flash_verify_update(void *data, size_t index, size_t length) {
+
+    /* Restart the digest when a new image begins */
+    if (0 == index) {
+        mender_client_flash_verify_release();
+        if (MENDER_OK != mender_tls_sha256_begin(&mender_client_flash_verify.sha256)) {
+            mender_log_error("Unable to begin computation of the digest of the image");
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Data must follow the data already written */
+    if ((NULL == mender_client_flash_verify.sha256) || (mender_client_flash_verify.length != index)) {
+        mender_log_error("Unable to compute the digest of the image, data are not contiguous");
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != mender_tls_sha256_update(mender_client_flash_verify.sha256, data, length)) {
+        mender_log_error("Unable to compute the digest of the image");
+        return MENDER_FAIL;
+    }
+    mender_client_flash_verify.length += length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_flash_verify_check(void) {
+
+    uint8_t      expected[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    uint8_t      digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    void        *sha256 = NULL;
+    uint8_t     *buffer = NULL;
+    size_t       index  = 0;
+    size_t       length;
+    mender_err_t ret;
+
+    /* Nothing to verify */
+    if (NULL == mender_client_flash_verify.sha256) {
+        return MENDER_OK;
+    }
+
+    /* Retrieve the digest of the data written */
+    ret                               = mender_tls_sha256_end(mender_client_flash_verify.sha256, expected);
+    mender_client_flash_verify.sha256 = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to compute the digest of the image");
+        goto END;
+    }
+
+    /* Read back the image by chunks and compute its digest */
+    if (NULL == (buffer = (uint8_t *)mender_malloc(CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&sha256))) {
+        mender_log_error("Unable to begin computation of the digest of the image");
+        goto END;
+    }
+    while (index < mender_client_flash_verify.length) {
+        length = mender_client_flash_verify.length - index;
+        if (length > CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE) {
+            length = CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE;
+        }
+        if (MENDER_OK != (ret = mender_flash_read(mender_client_flash_handle, buffer, index, length))) {
+            if (MENDER_NOT_IMPLEMENTED == ret) {
+                mender_log_warning("Unable to read back the image, verification skipped");
+                ret = MENDER_OK;
+            } else {
+                mender_log_error("Unable to read back the image");
+            }
+            goto END;
+        }
+        if (MENDER_OK != (ret = mender_tls_sha256_update(sha256, buffer, length))) {
+            mender_log_error("Unable to compute the digest of the image");
+            goto END;
+        }
+        index += length;
+    }
+    ret    = mender_tls_sha256_end(sha256, digest);
+    sha256 = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to compute the digest of the image");
+        goto END;
+    }
+
+    /* Compare the digests */
+    if (0 != memcmp(expected, digest, MENDER_TLS_SHA256_DIGEST_LENGTH)) {
+        mender_log_error("Image read back from the flash doesn't match the data written");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_log_info("Image read back from the flash has been verified");
+
+END:
+
+    /* Release memory */
+    if (NULL != sha256) {
+        mender_tls_sha256_end(sha256, NULL);
+    }
+    mender_free(buffer);
+
+    return ret;
+}
+
+static void
+mender_client_flash_verify_release(void) {
+
+    /* Release the digest of the data written */
+    if (NULL != mender_client_flash_verify.sha256) {
+        mender_tls_sha256_end(mender_client_flash_verify.sha256, NULL);
+        mender_client_flash_verify.sha256 = NULL;
+    }
+    mender_client_flash_verify.length = 0;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
@@ -0,0 +1,290 @@
+/**
+ * @file      mender-client-install-checkpoint.c
+ * @brief     Mender MCU client install checkpoint, the progress of the image written is saved so that the installation is resumed after a reset
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
+#include "mender-api.h"
+#include "mender-artifact.h"
+#include "mender-client-flash.h"
+#include "mender-client-flash-pipeline.h"
+#include "mender-client-install-checkpoint.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+#include "mender-storage.h"
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+/**
+ * @brief Default minimum interval between two install checkpoints (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT_PERIOD
+#define CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT_PERIOD (30)
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT_PERIOD */
+
+/**
+ * @brief Install checkpoint, the progress of the image written to the flash is saved periodically so that the deployment is resumed after a reset
+ */
+static struct {
+    char    *id;      /**< ID of the deployment, NULL if there is no checkpoint */
+    char    *file;    /**< Name of the file in the artifact, path of the TAR files included */
+    size_t   offset;  /**< Offset of the data of the file in the artifact (bytes) */
+    size_t   size;    /**< Size of the file (bytes) */
+    size_t   written; /**< Length of the data of the file written to the flash (bytes), accessed atomically because it is set by the flash pipeline task */
+    uint64_t time;    /**< Uptime of the last checkpoint (microseconds) */
+    bool     saved;   /**< A checkpoint is saved in the storage */
+} mender_client_install_checkpoint = { .id = NULL, .file = NULL, .offset = 0, .size = 0, .written = 0, .time = 0, .saved = false };
+
+void
+mender_client_install_checkpoint_load(void) {
+
+    char  *checkpoint      = NULL;
+    cJSON *json_checkpoint = NULL;
+
+    /* Retrieve the install checkpoint if it is found (following a reset during an installation) */
+    if ((MENDER_OK != mender_storage_get_install_checkpoint(&checkpoint)) || (NULL == checkpoint)) {
+        return;
+    }
+    mender_client_install_checkpoint.saved = true;
+
+    /* Parse the install checkpoint */
+    if (NULL == (json_checkpoint = cJSON_Parse(checkpoint))) {
+        goto FAIL;
+    }
+    cJSON *json_id      = cJSON_GetObjectItemCaseSensitive(json_checkpoint, "id");
+    cJSON *json_file    = cJSON_GetObjectItemCaseSensitive(json_checkpoint, "file");
+    cJSON *json_offset  = cJSON_GetObjectItemCaseSensitive(json_checkpoint, "offset");
+    cJSON *json_size    = cJSON_GetObjectItemCaseSensitive(json_checkpoint, "size");
+    cJSON *json_written = cJSON_GetObjectItemCaseSensitive(json_checkpoint, "written");
+    if ((true != cJSON_IsString(json_id)) || (true != cJSON_IsString(json_file)) || (true != cJSON_IsNumber(json_offset))
+        || (true != cJSON_IsNumber(json_size)) || (true != cJSON_IsNumber(json_written))) {
+        goto FAIL;
+    }
+    if ((NULL == (mender_client_install_checkpoint.id = mender_strdup(cJSON_GetStringValue(json_id))))
+        || (NULL == (mender_client_install_checkpoint.file = mender_strdup(cJSON_GetStringValue(json_file))))) {
+        goto FAIL;
+    }
+    mender_client_install_checkpoint.offset  = (size_t)cJSON_GetNumberValue(json_offset);
+    mender_client_install_checkpoint.size    = (size_t)cJSON_GetNumberValue(json_size);
+    mender_client_install_checkpoint.written = (size_t)cJSON_GetNumberValue(json_written);
+    if ((0 == mender_client_install_checkpoint.offset) || (0 == mender_client_install_checkpoint.size)
+        || (NULL == strstr(mender_client_install_checkpoint.file, ".tar/"))) {
+        goto FAIL;
+    }
+    mender_log_info("Install checkpoint of the deployment with id '%s' found, %zu bytes of '%s' have been written",
+                    mender_client_install_checkpoint.id,
+                    mender_client_install_checkpoint.written,
+                    mender_client_install_checkpoint.file);
+    goto END;
+
+FAIL:
+
+    /* Delete the install checkpoint, the deployment is downloaded again from the beginning */
+    mender_log_error("Unable to parse install checkpoint");
+    mender_client_install_checkpoint_release();
+
+END:
+
+    /* Release memory */
+    cJSON_Delete(json_checkpoint);
+    mender_free(checkpoint);
+}
+
+void
+mender_client_install_checkpoint_begin(char *id, size_t size) {
+
+    assert(NULL != id);
+    char  *file;
+    size_t offset;
+
+    /* Release the install checkpoint of the previous file */
+    mender_client_install_checkpoint_release();
+
+    /* The installation can be resumed only if the position of the data of the file in the artifact is known */
+    if (MENDER_OK != mender_api_get_artifact_file_position(&file, &offset)) {
+        mender_log_info("The file is compressed, the installation can't be resumed after a reset");
+        return;
+    }
+    if ((NULL == (mender_client_install_checkpoint.id = mender_strdup(id))) || (NULL == (mender_client_install_checkpoint.file = mender_strdup(file)))) {
+        mender_log_error("Unable to allocate memory");
+        mender_client_install_checkpoint_release();
+        return;
+    }
+    mender_client_install_checkpoint.offset  = offset;
+    mender_client_install_checkpoint.size    = size;
+    mender_client_install_checkpoint.written = 0;
+    mender_client_install_checkpoint.time    = mender_scheduler_get_uptime_us();
+}
+
+void
+mender_client_install_checkpoint_update(size_t written) {
+
+    /* Record the length of the data written */
+    __atomic_store_n(&mender_client_install_checkpoint.written, written, __ATOMIC_RELAXED);
+}
+
+void
+mender_client_install_checkpoint_save(void) {
+
+    cJSON   *json_checkpoint = NULL;
+    char    *checkpoint      = NULL;
+    uint64_t now             = mender_scheduler_get_uptime_us();
+
+    /* Check if the installation can be resumed and if the period is elapsed */
+    if ((NULL == mender_client_install_checkpoint.file)
+        || (now - mender_client_install_checkpoint.time < (uint64_t)CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT_PERIOD * 1000000)) {
+        return;
+    }
+    mender_client_install_checkpoint.time = now;
+
+    /* Format the install checkpoint, the data written by the flash pipeline task are counted once they have been written */
+    if (NULL == (json_checkpoint = cJSON_CreateObject())) {
+        goto FAIL;
+    }
+    cJSON_AddStringToObject(json_checkpoint, "id", mender_client_install_checkpoint.id);
+    cJSON_AddStringToObject(json_checkpoint, "file", mender_client_install_checkpoint.file);
+    cJSON_AddNumberToObject(json_checkpoint, "offset", (double)mender_client_install_checkpoint.offset);
+    cJSON_AddNumberToObject(json_checkpoint, "size", (double)mender_client_install_checkpoint.size);
+    cJSON_AddNumberToObject(json_checkpoint, "written", (double)__atomic_load_n(&mender_client_install_checkpoint.written, __ATOMIC_RELAXED));
+    if (NULL == (checkpoint = cJSON_PrintUnformatted(json_checkpoint))) {
+        goto FAIL;
+    }
+
+    /* Save the install checkpoint, the previous one is kept if it fails */
+    if (MENDER_OK != mender_storage_set_install_checkpoint(checkpoint)) {
+        goto FAIL;
+    }
+    mender_client_install_checkpoint.saved = true;
+    goto END;
+
+FAIL:
+
+    /* The installation continues, it is resumed from the previous checkpoint after a reset */
+    mender_log_warning("Unable to save install checkpoint");
+
+END:
+
+    /* Release memory */
+    cJSON_Delete(json_checkpoint);
+    mender_free(checkpoint);
+}
+
+mender_err_t
+mender_client_install_checkpoint_resume(char *id, char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != id);
+    assert(NULL != uri);
+    assert(NULL != callback);
+    char        *filename;
+    size_t       index;
+    mender_err_t ret;
+
+    /* Check if there is an install checkpoint of the deployment */
+    if ((NULL == mender_client_install_checkpoint.id) || (strcmp(id, mender_client_install_checkpoint.id))) {
+        return MENDER_NOT_FOUND;
+    }
+
+    /* The last data of the file are always written again so that the file is completed with the download */
+    filename = strstr(mender_client_install_checkpoint.file, ".tar") + strlen(".tar") + 1;
+    index    = (mender_client_install_checkpoint.written < mender_client_install_checkpoint.size) ? mender_client_install_checkpoint.written
+                                                                                                 : (mender_client_install_checkpoint.size - 1);
+
+    /* Resume the flash handle, the index is moved back to the data known to be written */
+    ret = mender_client_flash_resume(filename, mender_client_install_checkpoint.size, &index);
+    if (MENDER_NOT_IMPLEMENTED == ret) {
+        mender_log_info("Resuming the installation is not supported, the artifact is downloaded again");
+        goto RELEASE;
+    } else if (MENDER_OK != ret) {
+        mender_log_error("Unable to resume flash handle");
+        goto RELEASE;
+    }
+
+    /* The download is seeked by blocks of the TAR */
+    index -= index % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+    if (0 == index) {
+        mender_log_info("No data of the image to be resumed, the artifact is downloaded again");
+        ret = MENDER_FAIL;
+        goto ABORT;
+    }
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+    /* Start the flash pipeline */
+    if (MENDER_OK != (ret = mender_client_flash_pipeline_start())) {
+        mender_log_error("Unable to start flash pipeline");
+        goto ABORT;
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+    /* Seek the download of the artifact, the checksum of the file is computed with the data read back */
+    mender_log_info("Resuming installation of '%s' at index %zu", filename, index);
+    if (MENDER_OK
+        != (ret = mender_api_seek_artifact_download(
+                uri, callback, mender_client_install_checkpoint.file, mender_client_install_checkpoint.offset, index, &mender_client_flash_read_back))) {
+        mender_log_error("Unable to resume installation, the artifact is downloaded again");
+        goto ABORT;
+    }
+    mender_client_install_checkpoint.written = index;
+    mender_client_install_checkpoint.time    = mender_scheduler_get_uptime_us();
+
+    return MENDER_OK;
+
+ABORT:
+
+    /* Abort the deployment, the image is written again */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+    mender_client_flash_pipeline_stop();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+    mender_client_flash_abort_deployment();
+
+RELEASE:
+
+    /* Release the install checkpoint */
+    mender_client_install_checkpoint_release();
+
+    return ret;
+}
+
+void
+mender_client_install_checkpoint_check(char *id) {
+
+    /* Release the install checkpoint of a previous deployment */
+    if ((NULL != mender_client_install_checkpoint.id) && ((NULL == id) || (strcmp(id, mender_client_install_checkpoint.id)))) {
+        mender_client_install_checkpoint_release();
+    }
+}
+
+void
+mender_client_install_checkpoint_release(void) {
+
+    /* Delete the install checkpoint from the storage */
+    if (true == mender_client_install_checkpoint.saved) {
+        mender_storage_delete_install_checkpoint();
+        mender_client_install_checkpoint.saved = false;
+    }
+
+    /* Release memory */
+    mender_free(mender_client_install_checkpoint.id);
+    mender_client_install_checkpoint.id = NULL;
+    mender_free(mender_client_install_checkpoint.file);
+    mender_client_install_checkpoint.file = NULL;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
@@ -0,0 +1,375 @@
+/**
+ * @file      mender-client-payload-workers.c
+ * @brief     Mender MCU client payload workers, the payloads of different artifact types are handled concurrently by dedicated tasks
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
+#include "mender-client-payload-workers.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+
+#ifdef CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS
+
+/**
+ * @brief Default number of payload workers, the payloads of the other artifact types are handled directly
+ */
+#ifndef CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_COUNT
+#define CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_COUNT (2)
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_COUNT */
+
+/**
+ * @brief Default payload worker buffer count
+ */
+#ifndef CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT
+#define CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT (2)
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT */
+
+/**
+ * @brief Default payload worker buffer size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_SIZE */
+
+/**
+ * @brief Default payload worker task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_STACK_SIZE
+#define CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_STACK_SIZE (4)
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_STACK_SIZE */
+
+/**
+ * @brief Default payload worker task priority
+ */
+#ifndef CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_PRIORITY
+#define CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_PRIORITY */
+
+/**
+ * @brief Maximum length of the names of the files of the payloads, including the terminating null character, which is the length of the TAR name field
+ */
+#define MENDER_CLIENT_PAYLOAD_WORKER_FILENAME_LENGTH (101)
+
+/**
+ * @brief Payload worker buffer
+ */
+typedef struct {
+    char        *id;                                                     /**< ID of the deployment */
+    char        *artifact_name;                                          /**< Artifact name of the deployment */
+    cJSON       *meta_data;                                              /**< Copy of the meta-data of the payload */
+    cJSON       *release;                                                /**< Copy of the previous meta-data to be released, NULL if none */
+    char         filename[MENDER_CLIENT_PAYLOAD_WORKER_FILENAME_LENGTH]; /**< Name of the file, empty at the beginning of the payload */
+    size_t       size;                                                   /**< Size of the file */
+    void        *data;                                                   /**< Data of the file */
+    size_t       index;                                                  /**< Index of the data */
+    size_t       length;                                                 /**< Length of the data */
+    bool         terminate;                                              /**< Flag used to ask the worker task to terminate */
+    mender_err_t ret;                                                    /**< Result of the artifact type callbacks */
+} mender_client_payload_worker_buffer_t;
+
+/**
+ * @brief Payload worker, the data of the payloads of an artifact type are copied to free buffers and handled by a dedicated task which gives the buffers back
+ */
+typedef struct {
+    mender_client_artifact_type_t        *artifact_type; /**< Artifact type handled by the worker, NULL if not started */
+    void                                 *task;          /**< Worker task handle */
+    void                                 *free_queue;    /**< Queue of the free buffers */
+    void                                 *submit_queue;  /**< Queue of the buffers to be handled */
+    cJSON                                *meta_data;     /**< Copy of the meta-data of the last payload submitted, NULL if none */
+    bool                                  copied;        /**< The meta-data of the payload currently downloaded have been copied */
+    mender_err_t                          ret;           /**< Result of the artifact type callbacks */
+    mender_client_payload_worker_buffer_t buffers[CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT]; /**< Buffers */
+} mender_client_payload_worker_t;
+
+/**
+ * @brief Payload workers, the payloads of different artifact types are handled concurrently
+ */
+static mender_client_payload_worker_t mender_client_payload_workers[CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_COUNT];
+
+/**
+ * @brief Payload worker task function, invoke the artifact type callback with the buffers until it is asked to terminate
+ * @param arg Payload worker
+ */
+static void mender_client_payload_worker_task(void *arg);
+
+/**
+ * @brief Release the queues and the buffers of a payload worker
+ * @param worker Payload worker
+ */
+static void mender_client_payload_worker_release(mender_client_payload_worker_t *worker);
+
+void *
+mender_client_payload_worker_get(mender_client_artifact_type_t *artifact_type) {
+
+    assert(NULL != artifact_type);
+    mender_client_payload_worker_t *worker = NULL;
+
+    /* Look for the worker handling the artifact type, or for a worker which is not started */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_COUNT; index++) {
+        if (artifact_type == mender_client_payload_workers[index].artifact_type) {
+            mender_client_payload_workers[index].copied = false;
+            return &mender_client_payload_workers[index];
+        }
+        if ((NULL == worker) && (NULL == mender_client_payload_workers[index].artifact_type)) {
+            worker = &mender_client_payload_workers[index];
+        }
+    }
+    if (NULL == worker) {
+        mender_log_debug("No payload worker available, artifact type '%s' is handled directly", artifact_type->type);
+        return NULL;
+    }
+
+    /* Create queues */
+    if (MENDER_OK
+        != mender_scheduler_queue_create(
+            CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT, sizeof(mender_client_payload_worker_buffer_t *), &worker->free_queue)) {
+        mender_log_error("Unable to create free buffers queue");
+        goto FAIL;
+    }
+    if (MENDER_OK
+        != mender_scheduler_queue_create(
+            CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT, sizeof(mender_client_payload_worker_buffer_t *), &worker->submit_queue)) {
+        mender_log_error("Unable to create submitted buffers queue");
+        goto FAIL;
+    }
+
+    /* Allocate buffers */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT; index++) {
+        mender_client_payload_worker_buffer_t *buffer = &worker->buffers[index];
+        if (NULL == (buffer->data = mender_malloc(CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_SIZE))) {
+            mender_log_error("Unable to allocate memory");
+            goto FAIL;
+        }
+        buffer->ret = MENDER_OK;
+        if (MENDER_OK != mender_scheduler_queue_send(worker->free_queue, &buffer, -1)) {
+            mender_log_error("Unable to give buffer");
+            goto FAIL;
+        }
+    }
+
+    /* Create worker task */
+    mender_scheduler_task_params_t task_params = { .function   = mender_client_payload_worker_task,
+                                                   .arg        = (void *)worker,
+                                                   .name       = "mender_client_payload_worker",
+                                                   .stack_size = CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_STACK_SIZE,
+                                                   .priority   = CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_TASK_PRIORITY };
+    worker->ret                                = MENDER_OK;
+    worker->meta_data                          = NULL;
+    worker->copied                             = false;
+    if (MENDER_OK != mender_scheduler_task_create(&task_params, &worker->task)) {
+        mender_log_error("Unable to create payload worker task");
+        goto FAIL;
+    }
+    worker->artifact_type = artifact_type;
+
+    return worker;
+
+FAIL:
+
+    /* Release memory, the payload is handled directly */
+    mender_client_payload_worker_release(worker);
+
+    return NULL;
+}
+
+mender_err_t
+mender_client_payload_worker_submit(
+    void *worker, char *id, char *artifact_name, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    assert(NULL != worker);
+    mender_client_payload_worker_t        *payload_worker = (mender_client_payload_worker_t *)worker;
+    mender_err_t                           ret;
+    mender_client_payload_worker_buffer_t *buffer;
+    cJSON                                 *release = NULL;
+
+    /* Check the length of the file name, it is copied to the buffers */
+    if ((NULL != filename) && (strlen(filename) >= MENDER_CLIENT_PAYLOAD_WORKER_FILENAME_LENGTH)) {
+        mender_log_error("Unable to handle file '%s', its name is too long", filename);
+        return MENDER_FAIL;
+    }
+
+    /* Copy the meta-data once per payload because the artifact context may be released before the worker handles the data */
+    if (false == payload_worker->copied) {
+        cJSON *copy = NULL;
+        if ((NULL != meta_data) && (NULL == (copy = cJSON_Duplicate(meta_data, true)))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        release                   = payload_worker->meta_data;
+        payload_worker->meta_data = copy;
+        payload_worker->copied    = true;
+    }
+
+    /* Copy data to the buffers, the data are split if they are larger than the buffers, a buffer is submitted at the beginning of the payload */
+    do {
+
+        /* Take a free buffer */
+        if (MENDER_OK != (ret = mender_scheduler_queue_receive(payload_worker->free_queue, &buffer, -1))) {
+            mender_log_error("Unable to take buffer");
+            return ret;
+        }
+
+        /* Check the result of the previous callbacks, the worker does not use the meta-data anymore in that case */
+        if (MENDER_OK != buffer->ret) {
+            ret = buffer->ret;
+            mender_scheduler_queue_send(payload_worker->free_queue, &buffer, -1);
+            cJSON_Delete(release);
+            return ret;
+        }
+
+        /* Copy data and submit the buffer to the worker task, the copy of the meta-data of the previous payload is released by the worker */
+        buffer->id            = id;
+        buffer->artifact_name = artifact_name;
+        buffer->meta_data     = payload_worker->meta_data;
+        buffer->release       = release;
+        buffer->size          = size;
+        buffer->index         = index;
+        buffer->length        = (length < CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_SIZE) ? length : CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_SIZE;
+        buffer->terminate     = false;
+        snprintf(buffer->filename, sizeof(buffer->filename), "%s", (NULL != filename) ? filename : "");
+        if (buffer->length > 0) {
+            memcpy(buffer->data, data, buffer->length);
+            data = (uint8_t *)data + buffer->length;
+        }
+        index += buffer->length;
+        length -= buffer->length;
+        release = NULL;
+        if (MENDER_OK != (ret = mender_scheduler_queue_send(payload_worker->submit_queue, &buffer, -1))) {
+            mender_log_error("Unable to submit buffer");
+            return ret;
+        }
+    } while (length > 0);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_client_payload_workers_stop(void) {
+
+    mender_err_t                           ret = MENDER_OK;
+    mender_client_payload_worker_buffer_t *buffer;
+
+    /* Stop the workers which are started */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_COUNT; index++) {
+        mender_client_payload_worker_t *worker = &mender_client_payload_workers[index];
+        if (NULL == worker->artifact_type) {
+            continue;
+        }
+
+        /* Submit a terminating buffer, this ask the worker task to terminate once the previous buffers have been handled */
+        if ((MENDER_OK != mender_scheduler_queue_receive(worker->free_queue, &buffer, -1))) {
+            mender_log_error("Unable to take buffer");
+            ret = MENDER_FAIL;
+            continue;
+        }
+        buffer->release   = worker->meta_data;
+        buffer->terminate = true;
+        worker->meta_data = NULL;
+        if (MENDER_OK != mender_scheduler_queue_send(worker->submit_queue, &buffer, -1)) {
+            mender_log_error("Unable to submit buffer");
+            ret = MENDER_FAIL;
+            continue;
+        }
+
+        /* Wait for the end of the worker task */
+        if (MENDER_OK != mender_scheduler_task_join(worker->task)) {
+            mender_log_error("Unable to join payload worker task");
+            ret = MENDER_FAIL;
+            continue;
+        }
+        if ((MENDER_OK == ret) && (MENDER_OK != worker->ret)) {
+            mender_log_error("An error occurred while processing data of the artifact '%s'", worker->artifact_type->type);
+            ret = worker->ret;
+        }
+
+        /* Release memory */
+        mender_client_payload_worker_release(worker);
+    }
+
+    return ret;
+}
+
+static void
+mender_client_payload_worker_task(void *arg) {
+
+    assert(NULL != arg);
+    mender_client_payload_worker_t        *worker = (mender_client_payload_worker_t *)arg;
+    mender_err_t                           ret    = MENDER_OK;
+    mender_client_payload_worker_buffer_t *buffer;
+
+    /* Handle the buffers until a terminating buffer is received, the buffers are given back with the result of the callbacks */
+    while (MENDER_OK == mender_scheduler_queue_receive(worker->submit_queue, &buffer, -1)) {
+        if (NULL != buffer->release) {
+            cJSON_Delete(buffer->release);
+            buffer->release = NULL;
+        }
+        if (true == buffer->terminate) {
+            break;
+        }
+        if (MENDER_OK == ret) {
+            if (MENDER_OK
+                != (ret = mender_client_invoke_artifact_type(worker->artifact_type,
+                                                             buffer->id,
+                                                             buffer->artifact_name,
+                                                             buffer->meta_data,
+                                                             ('\0' != buffer->filename[0]) ? buffer->filename : NULL,
+                                                             buffer->size,
+                                                             (buffer->length > 0) ? buffer->data : NULL,
+                                                             buffer->index,
+                                                             buffer->length))) {
+                mender_log_error("An error occurred while processing data of the artifact '%s'", worker->artifact_type->type);
+            }
+        }
+        buffer->ret = ret;
+        mender_scheduler_queue_send(worker->free_queue, &buffer, -1);
+    }
+
+    /* Save the result of the callbacks */
+    worker->ret = ret;
+}
+
+static void
+mender_client_payload_worker_release(mender_client_payload_worker_t *worker) {
+
+    assert(NULL != worker);
+
+    /* Release queues */
+    if (NULL != worker->free_queue) {
+        mender_scheduler_queue_delete(worker->free_queue);
+        worker->free_queue = NULL;
+    }
+    if (NULL != worker->submit_queue) {
+        mender_scheduler_queue_delete(worker->submit_queue);
+        worker->submit_queue = NULL;
+    }
+
+    /* Release buffers */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_PAYLOAD_WORKER_BUFFER_COUNT; index++) {
+        if (NULL != worker->buffers[index].data) {
+            mender_free(worker->buffers[index].data);
+            worker->buffers[index].data = NULL;
+        }
+    }
+    worker->task          = NULL;
+    worker->artifact_type = NULL;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS */
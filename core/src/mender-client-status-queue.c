@@ -0,0 +1,348 @@
+/**
+ * @file      mender-client-status-queue.c
+ * @brief     Mender MCU client deployment status queue, the statuses are published asynchronously and again after a restart if publishing fails
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
+#include "mender-api.h"
+#include "mender-client.h"
+#include "mender-client-status-queue.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+#include "mender-storage.h"
+
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+
+/**
+ * @brief Default length of the deployment status queue, the oldest status is dropped when the queue is full
+ */
+#ifndef CONFIG_MENDER_CLIENT_STATUS_QUEUE_LENGTH
+#define CONFIG_MENDER_CLIENT_STATUS_QUEUE_LENGTH (4)
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE_LENGTH */
+
+/**
+ * @brief Default delay before publishing again the deployment statuses when publishing fails (seconds), it is doubled on consecutive failures
+ */
+#ifndef CONFIG_MENDER_CLIENT_STATUS_RETRY_INTERVAL
+#define CONFIG_MENDER_CLIENT_STATUS_RETRY_INTERVAL (10)
+#endif /* CONFIG_MENDER_CLIENT_STATUS_RETRY_INTERVAL */
+
+/**
+ * @brief Default maximum poll interval reached by the backoff when the polls fail (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL
+#define CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL (14400)
+#endif /* CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL */
+
+/**
+ * @brief Deployment status waiting to be published
+ */
+typedef struct {
+    char                      *id;     /**< ID of the deployment */
+    mender_deployment_status_t status; /**< Deployment status, a later status of the same deployment supersedes it */
+    bool stored; /**< The deployment data are stored until the status is published so that it is published again after a restart */
+} mender_client_status_t;
+
+/**
+ * @brief Deployment status queue, the statuses are published in order by the status work and before the requests of the update work
+ */
+static struct {
+    mender_client_status_t items[CONFIG_MENDER_CLIENT_STATUS_QUEUE_LENGTH]; /**< Statuses waiting to be published, the oldest first */
+    size_t                 count;                                           /**< Number of statuses waiting to be published */
+    uint32_t               failures;                                        /**< Number of consecutive failures of the status work */
+    void                  *mutex;                                           /**< Mutex used to protect access to the statuses */
+    void                  *publish_mutex;                                   /**< Mutex used to publish the statuses in order */
+    void                  *work;                                            /**< Status work handle */
+} mender_client_status_queue;
+
+/**
+ * @brief Delete the deployment data stored if they belong to a deployment
+ * @param id ID of the deployment
+ */
+static void mender_client_status_queue_delete_deployment_data(char *id);
+
+/**
+ * @brief Mender client status work function, the statuses are published again with a backoff if publishing fails
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_status_work_function(void);
+
+mender_err_t
+mender_client_status_queue_init(void) {
+
+    mender_err_t ret;
+
+    /* Create deployment status queue mutexes */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_status_queue.mutex))) {
+        mender_log_error("Unable to create deployment status queue mutex");
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_status_queue.publish_mutex))) {
+        mender_log_error("Unable to create deployment status queue mutex");
+        return ret;
+    }
+
+    /* Create mender client status work, it is executed when statuses are queued, the high priority permits to publish them during the deployment */
+    mender_scheduler_work_params_t status_work_params;
+    status_work_params.function = mender_client_status_work_function;
+    status_work_params.period   = 0;
+    status_work_params.name     = "mender_client_status";
+    status_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    status_work_params.slack    = 0;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&status_work_params, &mender_client_status_queue.work))) {
+        mender_log_error("Unable to create status work");
+        return ret;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_client_status_queue_activate(void) {
+
+    /* Activate status work */
+    return mender_scheduler_work_activate(mender_client_status_queue.work);
+}
+
+void
+mender_client_status_queue_deactivate(void) {
+
+    /* Deactivate status work */
+    mender_scheduler_work_deactivate(mender_client_status_queue.work);
+}
+
+mender_err_t
+mender_client_status_queue_push(char *id, mender_deployment_status_t deployment_status) {
+
+    assert(NULL != id);
+    mender_err_t ret;
+    char        *value;
+
+    /* Take mutex used to protect access to the statuses */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_status_queue.mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Replace the status of the deployment if one is waiting, the intermediate statuses are not published */
+    for (size_t index = 0; index < mender_client_status_queue.count; index++) {
+        if (!strcmp(mender_client_status_queue.items[index].id, id)) {
+            mender_client_status_queue.items[index].status = deployment_status;
+            goto END;
+        }
+    }
+
+    /* Drop the oldest status if the queue is full */
+    if (CONFIG_MENDER_CLIENT_STATUS_QUEUE_LENGTH == mender_client_status_queue.count) {
+        mender_log_warning("Deployment status queue is full, dropping status of deployment '%s'", mender_client_status_queue.items[0].id);
+        mender_free(mender_client_status_queue.items[0].id);
+        mender_client_status_queue.count--;
+        memmove(&mender_client_status_queue.items[0], &mender_client_status_queue.items[1], mender_client_status_queue.count * sizeof(mender_client_status_t));
+    }
+
+    /* Add the status at the end of the queue */
+    if (NULL == (value = mender_strdup(id))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_client_status_queue.items[mender_client_status_queue.count].id     = value;
+    mender_client_status_queue.items[mender_client_status_queue.count].status = deployment_status;
+    mender_client_status_queue.items[mender_client_status_queue.count].stored = false;
+    mender_client_status_queue.count++;
+
+END:
+
+    /* Release mutex used to protect access to the statuses */
+    mender_scheduler_mutex_give(mender_client_status_queue.mutex);
+
+    /* Publish the status asynchronously */
+    if (MENDER_OK == ret) {
+        mender_scheduler_work_execute(mender_client_status_queue.work);
+    }
+
+    return ret;
+}
+
+void
+mender_client_status_queue_store(char *id) {
+
+    assert(NULL != id);
+    bool stored = false;
+
+    /* Keep the deployment data if the status of the deployment is waiting to be published */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_client_status_queue.mutex, -1)) {
+        for (size_t index = 0; index < mender_client_status_queue.count; index++) {
+            if (!strcmp(mender_client_status_queue.items[index].id, id)) {
+                mender_client_status_queue.items[index].stored = true;
+                stored                                         = true;
+            }
+        }
+        mender_scheduler_mutex_give(mender_client_status_queue.mutex);
+    }
+
+    /* Delete the deployment data otherwise, the status has already been published */
+    if (false == stored) {
+        mender_storage_delete_deployment_data();
+    }
+}
+
+mender_err_t
+mender_client_status_queue_flush(void) {
+
+    mender_err_t               ret;
+    char                      *id;
+    mender_deployment_status_t deployment_status;
+    bool                       stored;
+
+    /* Take mutex used to publish the statuses in order */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_status_queue.publish_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Publish the statuses, the queue is not locked while publishing so that statuses can be queued meanwhile */
+    while (MENDER_OK == (ret = mender_scheduler_mutex_take(mender_client_status_queue.mutex, -1))) {
+        if (0 == mender_client_status_queue.count) {
+            mender_scheduler_mutex_give(mender_client_status_queue.mutex);
+            break;
+        }
+        id                = mender_strdup(mender_client_status_queue.items[0].id);
+        deployment_status = mender_client_status_queue.items[0].status;
+        mender_scheduler_mutex_give(mender_client_status_queue.mutex);
+        if (NULL == id) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            break;
+        }
+
+        /* Publish the status, it is dropped if the deployment does not exist anymore */
+        if ((MENDER_OK != (ret = mender_api_publish_deployment_status(id, deployment_status))) && (MENDER_NOT_FOUND != ret)) {
+            mender_log_error("Unable to publish status of deployment '%s', it will be published again later", id);
+            mender_free(id);
+            break;
+        }
+
+        /* Remove the status unless it has been superseded or dropped meanwhile */
+        stored = false;
+        if (MENDER_OK == (ret = mender_scheduler_mutex_take(mender_client_status_queue.mutex, -1))) {
+            if ((mender_client_status_queue.count > 0) && (!strcmp(mender_client_status_queue.items[0].id, id))
+                && (deployment_status == mender_client_status_queue.items[0].status)) {
+                stored = mender_client_status_queue.items[0].stored;
+                mender_free(mender_client_status_queue.items[0].id);
+                mender_client_status_queue.count--;
+                memmove(&mender_client_status_queue.items[0],
+                        &mender_client_status_queue.items[1],
+                        mender_client_status_queue.count * sizeof(mender_client_status_t));
+            }
+            mender_scheduler_mutex_give(mender_client_status_queue.mutex);
+        }
+
+        /* Delete the deployment data kept until the status is published */
+        if (true == stored) {
+            mender_client_status_queue_delete_deployment_data(id);
+        }
+        mender_free(id);
+    }
+
+    /* Release mutex used to publish the statuses in order */
+    mender_scheduler_mutex_give(mender_client_status_queue.publish_mutex);
+
+    return ret;
+}
+
+void
+mender_client_status_queue_exit(void) {
+
+    /* Delete status work */
+    mender_scheduler_work_delete(mender_client_status_queue.work);
+    mender_client_status_queue.work = NULL;
+
+    /* Release memory */
+    for (size_t index = 0; index < mender_client_status_queue.count; index++) {
+        mender_free(mender_client_status_queue.items[index].id);
+    }
+    mender_client_status_queue.count    = 0;
+    mender_client_status_queue.failures = 0;
+    mender_scheduler_mutex_delete(mender_client_status_queue.mutex);
+    mender_client_status_queue.mutex = NULL;
+    mender_scheduler_mutex_delete(mender_client_status_queue.publish_mutex);
+    mender_client_status_queue.publish_mutex = NULL;
+}
+
+static void
+mender_client_status_queue_delete_deployment_data(char *id) {
+
+    assert(NULL != id);
+    char  *deployment_data = NULL;
+    cJSON *json_deployment_data;
+
+    /* Check the deployment data stored belong to the deployment, a new deployment may have been stored meanwhile */
+    if ((MENDER_OK != mender_storage_get_deployment_data(&deployment_data)) || (NULL == deployment_data)) {
+        return;
+    }
+    if (NULL != (json_deployment_data = cJSON_Parse(deployment_data))) {
+        cJSON *json_id = cJSON_GetObjectItemCaseSensitive(json_deployment_data, "id");
+        if ((NULL != json_id) && (cJSON_IsString(json_id)) && (!strcmp(cJSON_GetStringValue(json_id), id))) {
+            mender_storage_delete_deployment_data();
+        }
+        cJSON_Delete(json_deployment_data);
+    }
+    mender_free(deployment_data);
+}
+
+static mender_err_t
+mender_client_status_work_function(void) {
+
+    mender_err_t ret;
+    uint32_t     delay;
+
+    /* Publish the statuses waiting in the queue */
+    if (MENDER_OK != (ret = mender_client_network_connect())) {
+        goto END;
+    }
+    ret = mender_client_status_queue_flush();
+    mender_client_network_release();
+
+END:
+
+    /* Publish the statuses again later if publishing fails, with an exponential backoff, the delay requested by the server is honored */
+    if (MENDER_OK != ret) {
+        delay = CONFIG_MENDER_CLIENT_STATUS_RETRY_INTERVAL;
+        for (uint32_t index = 0; (index < mender_client_status_queue.failures) && (delay < CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL); index++) {
+            delay *= 2;
+        }
+        if (delay > CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL) {
+            delay = CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL;
+        }
+        if (mender_api_get_retry_after() > delay) {
+            delay = mender_api_get_retry_after();
+        }
+        mender_client_status_queue.failures++;
+        mender_scheduler_work_execute_after(mender_client_status_queue.work, delay * 1000);
+    } else {
+        mender_client_status_queue.failures = 0;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
@@ -17,13 +17,31 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+
 #include "mender-api.h"
+#include "mender-artifact.h"
 #include "mender-client.h"
+#include "mender-client-artifact-type.h"
+#include "mender-client-flash.h"
+#include "mender-client-flash-pipeline.h"
+#include "mender-client-flash-statistics.h"
+#include "mender-client-install-checkpoint.h"
+#include "mender-client-payload-workers.h"
+#include "mender-client-status-queue.h"
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+#include "mender-delta.h"
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
 #include "mender-flash.h"
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-scheduler.h"
 #include "mender-storage.h"
 #include "mender-tls.h"
+#include "mender-trace.h"
 
 /**
  * @brief Default host
@@ -39,6 +57,20 @@
 #define CONFIG_MENDER_SERVER_TENANT_TOKEN NULL
 #endif /* CONFIG_MENDER_SERVER_TENANT_TOKEN */
 
+/**
+ * @brief Default artifact mirror
+ */
+#ifndef CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR
+#define CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR NULL
+#endif /* CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR */
+
+/**
+ * @brief Default artifact verification key
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_VERIFY_KEY
+#define CONFIG_MENDER_ARTIFACT_VERIFY_KEY NULL
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_KEY */
+
 /**
  * @brief Default authentication poll interval (seconds)
  */
@@ -53,6 +85,183 @@
 #define CONFIG_MENDER_CLIENT_UPDATE_POLL_INTERVAL (1800)
 #endif /* CONFIG_MENDER_CLIENT_UPDATE_POLL_INTERVAL */
 
+/**
+ * @brief Default poll jitter (percentage of the poll interval)
+ */
+#ifndef CONFIG_MENDER_CLIENT_POLL_JITTER
+#define CONFIG_MENDER_CLIENT_POLL_JITTER (10)
+#endif /* CONFIG_MENDER_CLIENT_POLL_JITTER */
+
+/**
+ * @brief Default maximum poll interval reached by the backoff when the polls fail (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL
+#define CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL (14400)
+#endif /* CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL */
+
+/**
+ * @brief Default delay the network is kept after the last user has released it, a new user cancels the release (seconds), 0 to release it immediately
+ */
+#ifndef CONFIG_MENDER_CLIENT_NETWORK_LINGER
+#define CONFIG_MENDER_CLIENT_NETWORK_LINGER (0)
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+
+/**
+ * @brief Default update poll interval following the end of a deployment (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_DEPLOYMENT_POLL_INTERVAL
+#define CONFIG_MENDER_CLIENT_DEPLOYMENT_POLL_INTERVAL (120)
+#endif /* CONFIG_MENDER_CLIENT_DEPLOYMENT_POLL_INTERVAL */
+
+/**
+ * @brief Default update poll interval while the download of the artifact is deferred by the application (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_INTERVAL
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_INTERVAL (300)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_INTERVAL */
+
+/**
+ * @brief Default maximum delay of the download of the artifact deferred by the application (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_MAX_DELAY
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_MAX_DELAY (86400)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_MAX_DELAY */
+
+/**
+ * @brief Default update poll interval while the installation of the artifact downloaded is deferred by the application (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_INTERVAL
+#define CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_INTERVAL (300)
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_INTERVAL */
+
+/**
+ * @brief Default maximum delay of the installation of the artifact downloaded deferred by the application (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_MAX_DELAY
+#define CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_MAX_DELAY (604800)
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_MAX_DELAY */
+
+/**
+ * @brief Default maximum rate of the download of the artifacts (bytes per second), 0 if unlimited
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_RATE_LIMIT
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_RATE_LIMIT (0)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_RATE_LIMIT */
+
+/**
+ * @brief Default duration after which the connection of a paused download is closed (seconds), 0 to keep it open
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_PAUSE_TIMEOUT
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_PAUSE_TIMEOUT (30)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PAUSE_TIMEOUT */
+
+/**
+ * @brief Default interval between two reports of the download progress (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL (5)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL */
+
+/**
+ * @brief Default step of the download progress reported before the interval is elapsed (percentage of the artifact)
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP (10)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP */
+
+/**
+ * @brief Default processing time of the download after which the processor is yielded to the other tasks (milliseconds), 0 to disable
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET (0)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET */
+
+/**
+ * @brief Default delay of the download when the processor is yielded (milliseconds), 0 to only let the tasks of the same priority run
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_YIELD_DELAY
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_YIELD_DELAY (1)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_YIELD_DELAY */
+
+#ifdef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK
+
+/**
+ * @brief Default authentication keys generation task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_STACK_SIZE
+#define CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_STACK_SIZE (8)
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_STACK_SIZE */
+
+/**
+ * @brief Default authentication keys generation task priority
+ */
+#ifndef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_PRIORITY
+#define CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_PRIORITY (1)
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_PRIORITY */
+
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK */
+
+#ifdef CONFIG_MENDER_CLIENT_PRECONNECT
+
+/**
+ * @brief Default connection to the artifact server task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_CLIENT_PRECONNECT_TASK_STACK_SIZE
+#define CONFIG_MENDER_CLIENT_PRECONNECT_TASK_STACK_SIZE (8)
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT_TASK_STACK_SIZE */
+
+/**
+ * @brief Default connection to the artifact server task priority
+ */
+#ifndef CONFIG_MENDER_CLIENT_PRECONNECT_TASK_PRIORITY
+#define CONFIG_MENDER_CLIENT_PRECONNECT_TASK_PRIORITY (1)
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT_TASK_PRIORITY */
+
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT */
+
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+
+/**
+ * @brief Default interval of the checks of the abort of the deployment while the artifact is downloaded (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_ABORT_CHECK_INTERVAL
+#define CONFIG_MENDER_CLIENT_ABORT_CHECK_INTERVAL (60)
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK_INTERVAL */
+
+/**
+ * @brief Default check of the abort of the deployment task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_STACK_SIZE
+#define CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_STACK_SIZE (8)
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_STACK_SIZE */
+
+/**
+ * @brief Default check of the abort of the deployment task priority
+ */
+#ifndef CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_PRIORITY
+#define CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_PRIORITY (1)
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_PRIORITY */
+
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+
+#ifdef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+
+/**
+ * @brief Default number of artifact types of the static pool, including "rootfs-image" and "rootfs-image-delta"
+ */
+#ifndef CONFIG_MENDER_CLIENT_STATIC_ARTIFACT_TYPE_COUNT
+#define CONFIG_MENDER_CLIENT_STATIC_ARTIFACT_TYPE_COUNT (4)
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ARTIFACT_TYPE_COUNT */
+
+/**
+ * @brief Default number of add-ons of the static pool
+ */
+#ifndef CONFIG_MENDER_CLIENT_STATIC_ADD_ON_COUNT
+#define CONFIG_MENDER_CLIENT_STATIC_ADD_ON_COUNT (3)
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ADD_ON_COUNT */
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
+
 /**
  * @brief Mender client configuration
  */
@@ -83,22 +292,48 @@ static mender_client_state_t mender_client_state = MENDER_CLIENT_STATE_INITIALIZ
 static uint8_t mender_client_network_count = 0;
 static void   *mender_client_network_mutex = NULL;
 
+/**
+ * @brief Network connection status, the network may still be connected while the counter is null during the linger delay
+ */
+static bool mender_client_network_connected = false;
+
+#ifdef CONFIG_MENDER_CLIENT_METRICS
+
+/**
+ * @brief Uptime at which the network access has been obtained (microseconds), used to account the time the radio is on
+ */
+static uint64_t mender_client_network_connected_at = 0;
+
+#endif /* CONFIG_MENDER_CLIENT_METRICS */
+
+#if (0 < CONFIG_MENDER_CLIENT_NETWORK_LINGER)
+
+/**
+ * @brief Uptime at which the network has been released by the last user (microseconds) and work releasing it after the linger delay
+ */
+static uint64_t mender_client_network_released_at   = 0;
+static void    *mender_client_network_linger_handle = NULL;
+
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+
 /**
  * @brief Deployment data (ID, artifact name and payload types), used to report deployment status after rebooting
  */
 static cJSON *mender_client_deployment_data = NULL;
 
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+
 /**
- * @brief Mender client artifact type
+ * @brief Check of the abort of the deployment by the server while the artifact is downloaded
  */
-typedef struct {
-    char *type; /**< Artifact type */
-    mender_err_t (*callback)(
-        char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t); /**< Callback to be invoked to handle the artifact type */
-    bool  needs_restart;                                                          /**< Indicate the artifact type needs a restart to be applied on the system */
-    char *artifact_name; /**< Artifact name (optional, NULL otherwise), set to validate module update after restarting */
-} mender_client_artifact_type_t;
-
+static struct {
+    void *task;    /**< Task publishing periodically the downloading status, NULL if it is not running */
+    void *queue;   /**< Queue used to ask the task to terminate */
+    char *id;      /**< ID of the deployment */
+    bool  aborted; /**< Flag indicating the deployment has been aborted by the server, accessed atomically */
+} mender_client_abort_check = { 0 };
+
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
 /**
  * @brief Mender client artifact types list and mutex
  */
@@ -106,22 +341,92 @@ static mender_client_artifact_type_t **mender_client_artifact_types_list  = NULL
 static size_t                          mender_client_artifact_types_count = 0;
 static void                           *mender_client_artifact_types_mutex = NULL;
 
+#ifdef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+
+/**
+ * @brief Static pool of artifact types
+ */
+static mender_client_artifact_type_t mender_client_artifact_types_pool[CONFIG_MENDER_CLIENT_STATIC_ARTIFACT_TYPE_COUNT];
+
+/**
+ * @brief Static storage of the artifact types list
+ */
+static mender_client_artifact_type_t *mender_client_artifact_types_static_list[CONFIG_MENDER_CLIENT_STATIC_ARTIFACT_TYPE_COUNT];
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
+
+/**
+ * @brief Flag to indicate the artifact types and add-ons registries are sealed, they are immutable while the client is activated and read without lock
+ * @note The flag is set while holding the mutexes of the registries and accessed atomically, the register functions check it once the mutex is taken
+ */
+static bool mender_client_registries_sealed = false;
+
+/**
+ * @brief Meta-data keys needed to handle the artifact type "rootfs-image", meta-data are not used
+ */
+static char *mender_client_rootfs_image_meta_data_keys[] = { NULL };
+
+/**
+ * @brief Mender client add-on
+ */
+typedef struct {
+    mender_addon_instance_t         *instance;         /**< Add-on instance */
+    int32_t                          check_in_period;  /**< Period of the check-in work of the add-on (seconds), negative or null value if none */
+    int32_t                          check_in_delay;   /**< Delay before the next execution of the check-in work of the add-on (seconds) */
+    mender_client_addon_activation_t activation;       /**< Activation policy */
+    uint32_t                         activation_delay; /**< Delay of the activation after the authentication (seconds), used with the delayed policy */
+    uint64_t                         activation_time;  /**< Uptime of the delayed activation (microseconds), 0 if the client has not been authenticated yet */
+    bool                             requested;        /**< Activation has been requested with mender_client_activate_addon */
+    bool                             activated;        /**< Add-on is activated */
+} mender_client_addon_t;
+
 /**
  * @brief Mender client add-ons list and mutex
  */
-static mender_addon_instance_t **mender_client_addons_list  = NULL;
-static size_t                    mender_client_addons_count = 0;
-static void                     *mender_client_addons_mutex = NULL;
+static mender_client_addon_t *mender_client_addons_list  = NULL;
+static size_t                 mender_client_addons_count = 0;
+static void                  *mender_client_addons_mutex = NULL;
+
+/**
+ * @brief Mender client add-ons activation work handle, the work activates the add-ons with the delayed activation policy
+ */
+static void *mender_client_addons_activation_handle = NULL;
+
+#ifdef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+
+/**
+ * @brief Static storage of the add-ons list
+ */
+static mender_client_addon_t mender_client_addons_static_list[CONFIG_MENDER_CLIENT_STATIC_ADD_ON_COUNT];
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
 
 /**
  * @brief Mender client work handle
  */
 static void *mender_client_work_handle = NULL;
 
+#ifdef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK
+
+/**
+ * @brief Authentication keys generation, the keys are retrieved or generated by a dedicated task so that the work queue is not blocked
+ */
+static struct {
+    void         *task; /**< Authentication keys generation task handle, NULL if not started */
+    volatile bool done; /**< The authentication keys generation task has finished */
+    mender_err_t  ret;  /**< Result of the authentication keys generation */
+} mender_client_keys_generation = { .task = NULL, .done = false, .ret = MENDER_OK };
+
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK */
+
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+
 /**
- * @brief Flash handle used to store temporary reference to write rootfs-image data
+ * @brief Patch handle used to apply rootfs-image-delta data to the running image
  */
-static void *mender_client_flash_handle = NULL;
+static void *mender_client_delta_handle = NULL;
+
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
 
 /**
  * @brief Flag to indicate if the deployment needs to set pending image status
@@ -133,6 +438,89 @@ static bool mender_client_deployment_needs_set_pending_image = false;
  */
 static bool mender_client_deployment_needs_restart = false;
 
+/**
+ * @brief Payload currently downloaded, its artifact type handler, ID and artifact name are resolved once at the beginning of the payload
+ */
+static struct {
+    char                          *type;          /**< Type of the payload, NULL if not resolved */
+    mender_client_artifact_type_t *artifact_type; /**< Artifact type handling the payload */
+    char                          *id;            /**< ID of the deployment */
+    char                          *artifact_name; /**< Artifact name of the deployment */
+#ifdef CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS
+    void                          *worker;        /**< Payload worker handling the payload, NULL if it is handled directly */
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS */
+} mender_client_download_payload;
+
+/**
+ * @brief Download progress, the reports are rate-limited by time and percentage
+ */
+static struct {
+    uint64_t time;        /**< Uptime of the last report (microseconds) */
+    size_t   offset;      /**< Length received at the last report (bytes) */
+    uint64_t next_time;   /**< Uptime after which the progress is reported again (microseconds) */
+    size_t   next_offset; /**< Length received after which the progress is reported again before the next time (bytes) */
+} mender_client_download_progress;
+
+#if CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0
+
+/**
+ * @brief Uptime of the last time the download yielded the processor (microseconds)
+ */
+static uint64_t mender_client_download_yield_time = 0;
+
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0 */
+
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+
+/**
+ * @brief Staging area to which the artifact of the deployment is downloaded, it is kept if the download is interrupted so that it can be resumed
+ */
+static struct {
+    void  *handle; /**< Staging handle, NULL if the staging area is not open */
+    size_t length; /**< Length of the artifact already staged (bytes) */
+} mender_client_staging;
+
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
+
+/**
+ * @brief Flag to indicate a deployment has finished, the next check for deployment is performed sooner
+ */
+static bool mender_client_deployment_finished = false;
+
+/**
+ * @brief Deferral of the download of the artifact by the application, the next check for deployment is performed sooner
+ */
+static struct {
+    char    *id;       /**< ID of the deployment deferred, NULL if none */
+    uint64_t time;     /**< Uptime of the first deferral of the deployment (microseconds) */
+    bool     deferred; /**< Flag to indicate the download has been deferred at the last check for deployment */
+} mender_client_download_deferral;
+
+/**
+ * @brief Deferral of the installation of the artifact downloaded by the application, the next check for deployment is performed sooner
+ */
+static struct {
+    bool     pending;  /**< Flag to indicate the artifact is downloaded and waiting for the installation to be allowed */
+    uint64_t time;     /**< Uptime of the end of the download (microseconds) */
+    bool     deferred; /**< Flag to indicate the installation has been deferred at the last check for deployment */
+} mender_client_install_deferral;
+
+/**
+ * @brief Flag to indicate the execution of the client work has been requested, the work is executed again shortly if the request is received while executing
+ * @note Accessed atomically because it is set by the application and the add-ons, the client work consumes it with an exchange so that no request is lost
+ */
+static bool mender_client_work_requested = false;
+
+/**
+ * @brief Number of consecutive failures of the client work, used to back off the next executions
+ */
+static uint32_t mender_client_work_failures = 0;
+
+/**
+ * @brief State of the pseudo-random generator used to add jitter to the work period, seeded with the identity so that the devices are not synchronized
+ */
+static uint32_t mender_client_work_jitter = 0;
+
 /**
  * @brief Mender client work function
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -145,18 +533,153 @@ static mender_err_t mender_client_work_function(void);
  */
 static mender_err_t mender_client_initialization_work_function(void);
 
+#ifdef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK
+
+/**
+ * @brief Authentication keys generation task function, the client work is executed when the keys are ready
+ * @param arg Not used
+ */
+static void mender_client_keys_generation_task(void *arg);
+
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK */
+
+#ifdef CONFIG_MENDER_CLIENT_PRECONNECT
+
+/**
+ * @brief Connection to the artifact server task function, the connection is kept alive to be reused by the download
+ * @param arg URI of the artifact
+ */
+static void mender_client_preconnect_task(void *arg);
+
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT */
+
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+
+/**
+ * @brief Start the check of the abort of the deployment, the download is performed without the check if it fails
+ * @param id ID of the deployment, it must remain valid until the check is stopped
+ */
+static void mender_client_abort_check_start(char *id);
+
+/**
+ * @brief Stop the check of the abort of the deployment
+ * @return true if the deployment has been aborted by the server, false otherwise
+ */
+static bool mender_client_abort_check_stop(void);
+
+/**
+ * @brief Check of the abort of the deployment task function, the downloading status is published periodically, the server rejects it once aborted
+ * @param arg Not used
+ */
+static void mender_client_abort_check_task(void *arg);
+
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+
+#ifdef CONFIG_MENDER_CLIENT_LOCAL_CONFIRMATION
+
+/**
+ * @brief Mender client confirmation work function, the pending image is confirmed locally once the self-tests of the application pass
+ * @note The status of the deployment is queued, it is published once authenticated with the server, and the device restarts if the self-tests fail
+ * @return MENDER_DONE if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_confirmation_work_function(void);
+
+#endif /* CONFIG_MENDER_CLIENT_LOCAL_CONFIRMATION */
+
 /**
  * @brief Mender client authentication work function
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_client_authentication_work_function(void);
 
+/**
+ * @brief Retrieve the status of the deployment pending after a restart, the artifact running is checked against the pending one
+ * @param id ID of the deployment, it belongs to the deployment data
+ * @param deployment_status Deployment status, success if the artifact running is the pending one, failure otherwise
+ * @return MENDER_OK if the function succeeds, error code if the deployment data are invalid
+ */
+static mender_err_t mender_client_pending_deployment_status(char **id, mender_deployment_status_t *deployment_status);
+
 /**
  * @brief Mender client update work function
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_client_update_work_function(void);
 
+/**
+ * @brief Ask the application if the artifact of the deployment can be downloaded now, the download proceeds anyway after the maximum delay
+ * @param id ID of the deployment
+ * @return true if the download is deferred, false otherwise
+ */
+static bool mender_client_download_deferred(char *id);
+
+/**
+ * @brief Ask the application if the artifact downloaded can be installed now, the installation proceeds anyway after the maximum delay
+ * @note The pending image is set and the device is restarted only once the installation is allowed, the artifact downloaded is kept meanwhile
+ * @return true if the installation is deferred, false otherwise
+ */
+static bool mender_client_install_deferred(void);
+
+#ifdef CONFIG_MENDER_CLIENT_DEVICE_PROVIDES
+
+/**
+ * @brief Build the attributes of the device sent when checking for deployments
+ * @param device_provides Attributes given in the configuration and versions of the registered artifact types, to be released by the caller
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_device_provides_build(mender_keystore_t **device_provides);
+
+#endif /* CONFIG_MENDER_CLIENT_DEVICE_PROVIDES */
+
+/**
+ * @brief Release network access, the connections kept alive with the server are closed
+ * @note The network management mutex must be taken
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_network_disconnect(void);
+
+#if (0 < CONFIG_MENDER_CLIENT_NETWORK_LINGER)
+
+/**
+ * @brief Mender client network linger work function, the network is released if it has not been used again during the linger delay
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_network_linger_work_function(void);
+
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+
+/**
+ * @brief Mender client check-in work function, the periodic works of the add-ons are performed while the network is already available for the update work
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_check_in_work_function(void);
+
+/**
+ * @brief Mender client add-ons activation work function, the add-ons with the delayed activation policy are activated when their delay is elapsed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_addons_activation_work_function(void);
+
+/**
+ * @brief Seal or unseal the artifact types and add-ons registries, the flag is set while holding the mutexes of the registries so that no registration is in progress
+ * @param sealed true to seal the registries, false to unseal them
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_seal_registries(bool sealed);
+
+/**
+ * @brief Activate the add-ons not activated yet on an event of the client, the add-ons requested with mender_client_activate_addon are activated on any event
+ * @param event Activation policy of the add-ons activated, the immediate activation policy is the authentication of the client which starts the delays
+ */
+static void mender_client_activate_addons(mender_client_addon_activation_t event);
+
+/**
+ * @brief Set the period of the client work depending of the result of the last execution, a random jitter is added
+ * @param result Result of the last execution of the work
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_set_work_period(mender_err_t result);
+
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the artifact
  * @param id ID of the deployment
@@ -174,30 +697,185 @@ static mender_err_t mender_client_download_artifact_callback(
     char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
 
 /**
- * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "rootfs-image"
- * @param id ID of the deployment
- * @param artifact name Artifact name
+ * @brief Resolve the artifact type handler, the ID and the artifact name of the payload currently downloaded
  * @param type Type from header-info payloads
- * @param meta_data Meta-data from header tarball
- * @param filename Artifact filename
- * @param size Artifact file size
- * @param data Artifact data
- * @param index Artifact data index
- * @param length Artifact data length
  * @return MENDER_OK if the function succeeds, error code if an error occurred
  */
-static mender_err_t mender_client_download_artifact_flash_callback(
-    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+static mender_err_t mender_client_download_artifact_resolve(char *type);
 
 /**
- * @brief Publish deployment status of the device to the mender-server and invoke deployment status callback
- * @param id ID of the deployment
- * @param deployment_status Deployment status
+ * @brief Add an artifact type to the registry
+ * @param type Artifact type
+ * @param callback Artifact type callback receiving contiguous data, NULL if the data are received as segments
+ * @param segments_callback Artifact type callback receiving a list of segments, NULL if the data are received contiguous
+ * @param needs_restart Flag to indicate if the artifact type requires the device to restart after downloading
+ * @param artifact_name Artifact name (optional, NULL otherwise), set to validate module update after restarting
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_client_publish_deployment_status(char *id, mender_deployment_status_t deployment_status);
+static mender_err_t mender_client_add_artifact_type(char *type,
+                                                    mender_err_t (*callback)(char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t),
+                                                    mender_err_t (*segments_callback)(
+                                                        char *, char *, char *, cJSON *, char *, size_t, mender_client_segment_t *, size_t, size_t),
+                                                    bool  needs_restart,
+                                                    char *artifact_name);
 
-char *
+/**
+ * @brief Function invoked when artifact data are processed to report the download progress to the application
+ * @param offset Length of the artifact received (bytes)
+ * @param size Total length of the artifact (bytes), 0 if unknown
+ */
+static void mender_client_download_artifact_progress(size_t offset, size_t size);
+
+#if CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0
+
+/**
+ * @brief Yield the processor to the other tasks if the download has been running for longer than its budget
+ * @note The application is notified so that it can feed the watchdog
+ */
+static void mender_client_download_artifact_yield(void);
+
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0 */
+
+/**
+ * @brief Download the artifact of the deployment, from the artifact mirror first if one is configured and then from the server if the mirror fails
+ * @param uri URI of the deployment
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_download_artifact(char *uri);
+
+/**
+ * @brief Get the key of the artifact of a deployment, which is the last segment of the path of the deployment URI
+ * @param uri URI of the deployment
+ * @return Key of the artifact if the function succeeds, NULL otherwise, it must be released by the caller
+ */
+static char *mender_client_get_artifact_key(char *uri);
+
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+
+/**
+ * @brief Download the artifact of the deployment to the staging area, then process it from the staging area once the connection is released
+ * @param uri URI of the deployment
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_download_artifact_staged(char *uri);
+
+/**
+ * @brief Callback function invoked to store the data of the artifact to the staging area
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_staging_write_callback(void *data, size_t index, size_t length);
+
+/**
+ * @brief Callback function invoked to read back the data of the artifact from the staging area
+ * @param data Buffer to store the data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_staging_read_callback(void *data, size_t index, size_t length);
+
+/**
+ * @brief Release the staging area, nothing is done if it is not open
+ */
+static void mender_client_staging_release(void);
+
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
+
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
+
+/**
+ * @brief Callback function to be invoked to check the payloads of the artifact before downloading it
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename, NULL when the payload is checked before its first file
+ * @param size Artifact file size
+ * @return MENDER_OK if the artifact can be handled, error code otherwise
+ */
+static mender_err_t mender_client_check_artifact_callback(char *type, cJSON *meta_data, char *filename, size_t size);
+
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+
+/**
+ * @brief Function invoked while parsing the artifact to check if a meta-data value is needed to handle the artifact type
+ * @param type Type from header-info payloads
+ * @param key Key of the meta-data value
+ * @return true if the meta-data value is needed, false otherwise
+ */
+static bool mender_client_artifact_meta_data_filter(char *type, char *key);
+
+/**
+ * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "rootfs-image"
+ * @param id ID of the deployment
+ * @param artifact name Artifact name
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code if an error occurred
+ */
+static mender_err_t mender_client_download_artifact_flash_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+
+/**
+ * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "rootfs-image-delta"
+ * @param id ID of the deployment
+ * @param artifact name Artifact name
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code if an error occurred
+ */
+static mender_err_t mender_client_download_artifact_delta_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+/**
+ * @brief Function invoked by the patch to read the running image
+ * @param data Buffer to store the data
+ * @param index Index of the data
+ * @param length Length of the data
+ * @param params Not used
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_delta_read(void *data, size_t index, size_t length, void *params);
+
+/**
+ * @brief Function invoked by the patch to write the patched image to the flash
+ * @param data Data
+ * @param index Data index
+ * @param length Data length
+ * @param params Not used
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_delta_write(void *data, size_t index, size_t length, void *params);
+
+/**
+ * @brief Release the patch handle, nothing is done if no patch is being applied
+ */
+static void mender_client_delta_release(void);
+
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
+
+/**
+ * @brief Publish deployment status of the device to the mender-server and invoke deployment status callback
+ * @param id ID of the deployment
+ * @param deployment_status Deployment status
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_publish_deployment_status(char *id, mender_deployment_status_t deployment_status);
+
+char *
 mender_client_version(void) {
 
     /* Return version as string */
@@ -215,11 +893,36 @@ mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *ca
     assert(NULL != callbacks->restart);
     mender_err_t ret;
 
-    /* Save configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_client_config.identity, config->identity))) {
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+    /* Account the memory allocated by cJSON */
+    if (MENDER_OK != (ret = mender_utils_heap_init())) {
+        mender_log_error("Unable to initialize heap statistics");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+
+    /* Save configuration, the key-stores are packed because their items are not set */
+    if (MENDER_OK != (ret = mender_utils_keystore_pack(&mender_client_config.identity, config->identity))) {
         mender_log_error("Unable to copy identity");
         goto END;
     }
+    if (NULL != config->device_provides) {
+        if (MENDER_OK != (ret = mender_utils_keystore_pack(&mender_client_config.device_provides, config->device_provides))) {
+            mender_log_error("Unable to copy device provides");
+            goto END;
+        }
+    }
+
+    /* Seed the jitter of the work period with the identity (FNV-1a), which is unique for each device */
+    mender_client_work_jitter = 2166136261U;
+    for (size_t index = 0; NULL != mender_client_config.identity[index].name; index++) {
+        for (char *value = mender_client_config.identity[index].value; (NULL != value) && ('\0' != *value); value++) {
+            mender_client_work_jitter = (mender_client_work_jitter ^ (uint8_t)*value) * 16777619U;
+        }
+    }
+    if (0 == mender_client_work_jitter) {
+        mender_client_work_jitter = 1;
+    }
     mender_client_config.artifact_name = config->artifact_name;
     mender_client_config.device_type   = config->device_type;
     if ((NULL != config->host) && (strlen(config->host) > 0)) {
@@ -256,6 +959,32 @@ mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *ca
         mender_client_config.update_poll_interval = CONFIG_MENDER_CLIENT_UPDATE_POLL_INTERVAL;
     }
     mender_client_config.recommissioning = config->recommissioning;
+    if ((NULL != config->artifact_verify_key) && (strlen(config->artifact_verify_key) > 0)) {
+        mender_client_config.artifact_verify_key = config->artifact_verify_key;
+    } else {
+        mender_client_config.artifact_verify_key = CONFIG_MENDER_ARTIFACT_VERIFY_KEY;
+    }
+    if ((NULL != mender_client_config.artifact_verify_key) && (0 == strlen(mender_client_config.artifact_verify_key))) {
+        mender_client_config.artifact_verify_key = NULL;
+    }
+    if ((NULL != config->artifact_mirror) && (strlen(config->artifact_mirror) > 0)) {
+        mender_client_config.artifact_mirror = config->artifact_mirror;
+    } else {
+        mender_client_config.artifact_mirror = CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR;
+    }
+    if ((NULL != mender_client_config.artifact_mirror) && (0 == strlen(mender_client_config.artifact_mirror))) {
+        mender_client_config.artifact_mirror = NULL;
+    }
+    if ((NULL != mender_client_config.artifact_mirror) && ('/' == mender_client_config.artifact_mirror[strlen(mender_client_config.artifact_mirror) - 1])) {
+        mender_log_error("Invalid artifact mirror configuration, trailing '/' is not allowed");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    if (0 != config->download_rate_limit) {
+        mender_client_config.download_rate_limit = config->download_rate_limit;
+    } else {
+        mender_client_config.download_rate_limit = CONFIG_MENDER_CLIENT_DOWNLOAD_RATE_LIMIT;
+    }
 
     /* Save callbacks */
     memcpy(&mender_client_callbacks, callbacks, sizeof(mender_client_callbacks_t));
@@ -269,6 +998,12 @@ mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *ca
         mender_log_error("Unable to initialize log");
         goto END;
     }
+#ifdef CONFIG_MENDER_TRACE
+    if (MENDER_OK != (ret = mender_trace_init())) {
+        mender_log_error("Unable to initialize trace");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_TRACE */
     if (MENDER_OK != (ret = mender_storage_init())) {
         mender_log_error("Unable to initialize storage");
         goto END;
@@ -278,11 +1013,16 @@ mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *ca
         goto END;
     }
     mender_api_config_t mender_api_config = {
-        .identity      = mender_client_config.identity,
-        .artifact_name = mender_client_config.artifact_name,
-        .device_type   = mender_client_config.device_type,
-        .host          = mender_client_config.host,
-        .tenant_token  = mender_client_config.tenant_token,
+        .identity                        = mender_client_config.identity,
+        .artifact_name                   = mender_client_config.artifact_name,
+        .device_type                     = mender_client_config.device_type,
+        .host                            = mender_client_config.host,
+        .tenant_token                    = mender_client_config.tenant_token,
+        .artifact_verify_key             = mender_client_config.artifact_verify_key,
+        .artifact_meta_data_filter       = &mender_client_artifact_meta_data_filter,
+        .artifact_download_progress      = &mender_client_download_artifact_progress,
+        .artifact_download_rate_limit    = mender_client_config.download_rate_limit,
+        .artifact_download_pause_timeout = CONFIG_MENDER_CLIENT_DOWNLOAD_PAUSE_TIMEOUT,
     };
     if (MENDER_OK != (ret = mender_api_init(&mender_api_config))) {
         mender_log_error("Unable to initialize API");
@@ -313,17 +1053,82 @@ mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *ca
         mender_log_error("Unable to register 'rootfs-image' artifact type");
         goto END;
     }
+    if (MENDER_OK != (ret = mender_client_set_artifact_type_meta_data_keys("rootfs-image", mender_client_rootfs_image_meta_data_keys))) {
+        mender_log_error("Unable to set 'rootfs-image' artifact type meta-data keys");
+        goto END;
+    }
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+
+    /* Register rootfs-image-delta artifact type */
+    if (MENDER_OK
+        != (ret = mender_client_register_artifact_type("rootfs-image-delta", &mender_client_download_artifact_delta_callback, true, config->artifact_name))) {
+        mender_log_error("Unable to register 'rootfs-image-delta' artifact type");
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_client_set_artifact_type_meta_data_keys("rootfs-image-delta", mender_client_rootfs_image_meta_data_keys))) {
+        mender_log_error("Unable to set 'rootfs-image-delta' artifact type meta-data keys");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
 
     /* Create mender client work */
     mender_scheduler_work_params_t update_work_params;
     update_work_params.function = mender_client_work_function;
     update_work_params.period   = mender_client_config.authentication_poll_interval;
     update_work_params.name     = "mender_client_update";
+    update_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_DEFAULT;
+    update_work_params.slack    = CONFIG_MENDER_CLIENT_WORK_SLACK;
     if (MENDER_OK != (ret = mender_scheduler_work_create(&update_work_params, &mender_client_work_handle))) {
         mender_log_error("Unable to create update work");
         goto END;
     }
 
+    /* Create mender client add-ons activation work, it is executed once the delay of the next delayed activation is elapsed */
+    mender_scheduler_work_params_t addons_activation_work_params;
+    addons_activation_work_params.function = mender_client_addons_activation_work_function;
+    addons_activation_work_params.period   = 0;
+    addons_activation_work_params.name     = "mender_client_addons_activation";
+    addons_activation_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    addons_activation_work_params.slack    = 0;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&addons_activation_work_params, &mender_client_addons_activation_handle))) {
+        mender_log_error("Unable to create add-ons activation work");
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_addons_activation_handle))) {
+        mender_log_error("Unable to activate add-ons activation work");
+        goto END;
+    }
+
+#if (0 < CONFIG_MENDER_CLIENT_NETWORK_LINGER)
+
+    /* Create mender client network linger work, it is executed once the linger delay is elapsed */
+    mender_scheduler_work_params_t linger_work_params;
+    linger_work_params.function = mender_client_network_linger_work_function;
+    linger_work_params.period   = 0;
+    linger_work_params.name     = "mender_client_network_linger";
+    linger_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    linger_work_params.slack    = 0;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&linger_work_params, &mender_client_network_linger_handle))) {
+        mender_log_error("Unable to create network linger work");
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_network_linger_handle))) {
+        mender_log_error("Unable to activate network linger work");
+        goto END;
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+
+    /* Initialize deployment status queue */
+    if (MENDER_OK != (ret = mender_client_status_queue_init())) {
+        mender_log_error("Unable to initialize deployment status queue");
+        goto END;
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
+
 END:
 
     return ret;
@@ -349,9 +1154,37 @@ mender_client_register_artifact_type(char *type,
                                      bool  needs_restart,
                                      char *artifact_name) {
 
+    assert(NULL != type);
+    assert(NULL != callback);
+
+    return mender_client_add_artifact_type(type, callback, NULL, needs_restart, artifact_name);
+}
+
+mender_err_t
+mender_client_register_artifact_type_segments(char *type,
+                                              mender_err_t (*callback)(
+                                                  char *, char *, char *, cJSON *, char *, size_t, mender_client_segment_t *, size_t, size_t),
+                                              bool  needs_restart,
+                                              char *artifact_name) {
+
+    assert(NULL != type);
+    assert(NULL != callback);
+
+    return mender_client_add_artifact_type(type, NULL, callback, needs_restart, artifact_name);
+}
+
+static mender_err_t
+mender_client_add_artifact_type(char *type,
+                                mender_err_t (*callback)(char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t),
+                                mender_err_t (*segments_callback)(char *, char *, char *, cJSON *, char *, size_t, mender_client_segment_t *, size_t, size_t),
+                                bool  needs_restart,
+                                char *artifact_name) {
+
     assert(NULL != type);
     mender_client_artifact_type_t  *artifact_type;
+#ifndef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
     mender_client_artifact_type_t **tmp;
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
     mender_err_t                    ret;
 
     /* Take mutex used to protect access to the artifact types management list */
@@ -360,27 +1193,49 @@ mender_client_register_artifact_type(char *type,
         return ret;
     }
 
+    /* Registries are immutable while the client is activated */
+    if (true == __atomic_load_n(&mender_client_registries_sealed, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Unable to register artifact type '%s', the client is activated", type);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
     /* Create mender artifact type */
-    if (NULL == (artifact_type = (mender_client_artifact_type_t *)malloc(sizeof(mender_client_artifact_type_t)))) {
+#ifdef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+    if (mender_client_artifact_types_count >= CONFIG_MENDER_CLIENT_STATIC_ARTIFACT_TYPE_COUNT) {
+        mender_log_error("Unable to register artifact type '%s', the static pool is exhausted", type);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    artifact_type = &mender_client_artifact_types_pool[mender_client_artifact_types_count];
+#else
+    if (NULL == (artifact_type = (mender_client_artifact_type_t *)mender_malloc(sizeof(mender_client_artifact_type_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    artifact_type->type          = type;
-    artifact_type->callback      = callback;
-    artifact_type->needs_restart = needs_restart;
-    artifact_type->artifact_name = artifact_name;
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
+    artifact_type->type              = type;
+    artifact_type->callback          = callback;
+    artifact_type->segments_callback = segments_callback;
+    artifact_type->needs_restart     = needs_restart;
+    artifact_type->artifact_name     = artifact_name;
+    artifact_type->meta_data_keys    = NULL;
 
     /* Add mender artifact type to the list */
+#ifdef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+    mender_client_artifact_types_list = mender_client_artifact_types_static_list;
+#else
     if (NULL
-        == (tmp = (mender_client_artifact_type_t **)realloc(mender_client_artifact_types_list,
-                                                            (mender_client_artifact_types_count + 1) * sizeof(mender_client_artifact_type_t *)))) {
+        == (tmp = (mender_client_artifact_type_t **)mender_realloc(mender_client_artifact_types_list,
+                                                                   (mender_client_artifact_types_count + 1) * sizeof(mender_client_artifact_type_t *)))) {
         mender_log_error("Unable to allocate memory");
-        free(artifact_type);
+        mender_free(artifact_type);
         ret = MENDER_FAIL;
         goto END;
     }
-    mender_client_artifact_types_list                                     = tmp;
+    mender_client_artifact_types_list = tmp;
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
     mender_client_artifact_types_list[mender_client_artifact_types_count] = artifact_type;
     mender_client_artifact_types_count++;
 
@@ -392,12 +1247,54 @@ END:
     return ret;
 }
 
+mender_err_t
+mender_client_set_artifact_type_meta_data_keys(char *type, char **meta_data_keys) {
+
+    assert(NULL != type);
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the artifact types management list */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Registries are immutable while the client is activated */
+    if (true == __atomic_load_n(&mender_client_registries_sealed, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Unable to set meta-data keys of artifact type '%s', the client is activated", type);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Set meta-data keys of the artifact type */
+    ret = MENDER_NOT_FOUND;
+    for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
+        if (!strcmp(type, mender_client_artifact_types_list[artifact_type_index]->type)) {
+            mender_client_artifact_types_list[artifact_type_index]->meta_data_keys = meta_data_keys;
+            ret                                                                    = MENDER_OK;
+            break;
+        }
+    }
+    if (MENDER_OK != ret) {
+        mender_log_error("Artifact type '%s' is not registered", type);
+    }
+
+END:
+
+    /* Release mutex used to protect access to the artifact types management list */
+    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+
+    return ret;
+}
+
 mender_err_t
 mender_client_register_addon(mender_addon_instance_t *addon, void *config, void *callbacks) {
 
     assert(NULL != addon);
-    mender_addon_instance_t **tmp;
-    mender_err_t              ret;
+#ifndef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+    mender_client_addon_t *tmp;
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
+    mender_err_t           ret;
 
     /* Take mutex used to protect access to the add-ons management list */
     if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
@@ -405,6 +1302,13 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
         return ret;
     }
 
+    /* Registries are immutable while the client is activated */
+    if (true == __atomic_load_n(&mender_client_registries_sealed, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Unable to register add-on, the client is activated");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
     /* Initialization of the add-on */
     if (NULL != addon->init) {
         if (MENDER_OK != (ret = addon->init(config, callbacks))) {
@@ -414,6 +1318,7 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
     }
 
     /* Activate add-on if authentication is already done */
+    bool activated = false;
     if (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) {
         if (NULL != addon->activate) {
             if (MENDER_OK != (ret = addon->activate())) {
@@ -424,10 +1329,22 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
                 goto END;
             }
         }
+        activated = true;
     }
 
     /* Add add-on to the list */
-    if (NULL == (tmp = (mender_addon_instance_t **)realloc(mender_client_addons_list, (mender_client_addons_count + 1) * sizeof(mender_addon_instance_t *)))) {
+#ifdef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+    if (mender_client_addons_count >= CONFIG_MENDER_CLIENT_STATIC_ADD_ON_COUNT) {
+        mender_log_error("Unable to register add-on, the static pool is exhausted");
+        if (NULL != addon->exit) {
+            addon->exit();
+        }
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_client_addons_list = mender_client_addons_static_list;
+#else
+    if (NULL == (tmp = (mender_client_addon_t *)mender_realloc(mender_client_addons_list, (mender_client_addons_count + 1) * sizeof(mender_client_addon_t)))) {
         mender_log_error("Unable to allocate memory");
         if (NULL != addon->exit) {
             addon->exit();
@@ -435,8 +1352,19 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
         ret = MENDER_FAIL;
         goto END;
     }
-    mender_client_addons_list                             = tmp;
-    mender_client_addons_list[mender_client_addons_count] = addon;
+    mender_client_addons_list = tmp;
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
+    mender_client_addons_list[mender_client_addons_count].instance        = addon;
+    mender_client_addons_list[mender_client_addons_count].check_in_period = 0;
+    mender_client_addons_list[mender_client_addons_count].check_in_delay  = 0;
+    if ((NULL != addon->check_in) && (NULL != addon->get_check_in_period)) {
+        mender_client_addons_list[mender_client_addons_count].check_in_period = addon->get_check_in_period();
+    }
+    mender_client_addons_list[mender_client_addons_count].activation       = MENDER_CLIENT_ADDON_ACTIVATION_IMMEDIATE;
+    mender_client_addons_list[mender_client_addons_count].activation_delay = 0;
+    mender_client_addons_list[mender_client_addons_count].activation_time  = 0;
+    mender_client_addons_list[mender_client_addons_count].requested        = false;
+    mender_client_addons_list[mender_client_addons_count].activated        = activated;
     mender_client_addons_count++;
 
 END:
@@ -448,24 +1376,50 @@ END:
 }
 
 mender_err_t
-mender_client_activate(void) {
+mender_client_set_addon_activation(mender_addon_instance_t *addon, mender_client_addon_activation_t activation, uint32_t delay) {
 
+    assert(NULL != addon);
     mender_err_t ret;
 
-    /* Activate update work */
-    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_work_handle))) {
-        mender_log_error("Unable to activate update work");
+    /* Take mutex used to protect access to the add-ons management list */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Registries are immutable while the client is activated */
+    if (true == __atomic_load_n(&mender_client_registries_sealed, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Unable to set activation policy of add-on, the client is activated");
+        ret = MENDER_FAIL;
         goto END;
     }
 
+    /* Set activation policy of the add-on */
+    ret = MENDER_NOT_FOUND;
+    for (size_t index = 0; index < mender_client_addons_count; index++) {
+        if (addon == mender_client_addons_list[index].instance) {
+            mender_client_addons_list[index].activation       = activation;
+            mender_client_addons_list[index].activation_delay = delay;
+            ret                                               = MENDER_OK;
+            break;
+        }
+    }
+    if (MENDER_OK != ret) {
+        mender_log_error("Add-on is not registered");
+    }
+
 END:
 
+    /* Release mutex used to protect access to the add-ons management list */
+    mender_scheduler_mutex_give(mender_client_addons_mutex);
+
     return ret;
 }
 
 mender_err_t
-mender_client_deactivate(void) {
+mender_client_activate_addon(mender_addon_instance_t *addon) {
 
+    assert(NULL != addon);
     mender_err_t ret;
 
     /* Take mutex used to protect access to the add-ons management list */
@@ -474,53 +1428,168 @@ mender_client_deactivate(void) {
         return ret;
     }
 
-    /* Deactivate add-ons */
-    if (NULL != mender_client_addons_list) {
-        for (size_t index = 0; index < mender_client_addons_count; index++) {
-            if (NULL != mender_client_addons_list[index]->deactivate) {
-                mender_client_addons_list[index]->deactivate();
+    /* Activate the add-on if authentication is already done, it is activated on the next event of the client otherwise */
+    ret = MENDER_NOT_FOUND;
+    for (size_t index = 0; index < mender_client_addons_count; index++) {
+        mender_client_addon_t *item = &mender_client_addons_list[index];
+        if (addon != item->instance) {
+            continue;
+        }
+        item->requested = true;
+        ret             = MENDER_OK;
+        if ((MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) && (false == item->activated)) {
+            if ((NULL != addon->activate) && (MENDER_OK != (ret = addon->activate()))) {
+                mender_log_error("Unable to activate add-on");
+                break;
             }
+            item->activated = true;
         }
+        break;
+    }
+    if (MENDER_NOT_FOUND == ret) {
+        mender_log_error("Add-on is not registered");
     }
 
     /* Release mutex used to protect access to the add-ons management list */
     mender_scheduler_mutex_give(mender_client_addons_mutex);
 
-    /* Deactivate mender client work */
-    mender_scheduler_work_deactivate(mender_client_work_handle);
-
     return ret;
 }
 
 mender_err_t
-mender_client_execute(void) {
+mender_client_activate(void) {
 
     mender_err_t ret;
 
-    /* Trigger execution of the work */
-    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_work_handle))) {
-        mender_log_error("Unable to trigger update work");
+    /* Seal the registries before the works read them */
+    if (MENDER_OK != (ret = mender_client_seal_registries(true))) {
+        mender_log_error("Unable to seal registries");
+        return ret;
+    }
+
+    /* Activate update work */
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_work_handle))) {
+        mender_log_error("Unable to activate update work");
+        mender_client_seal_registries(false);
+        goto END;
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+
+    /* Activate status work */
+    if (MENDER_OK != (ret = mender_client_status_queue_activate())) {
+        mender_log_error("Unable to activate status work");
+        mender_scheduler_work_deactivate(mender_client_work_handle);
+        mender_client_seal_registries(false);
         goto END;
     }
 
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
+
 END:
 
     return ret;
 }
 
 mender_err_t
-mender_client_network_connect(void) {
+mender_client_deactivate(void) {
 
     mender_err_t ret;
 
-    /* Take mutex used to protect access to the network management counter */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_network_mutex, -1))) {
+    /* Take mutex used to protect access to the add-ons management list */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
-    /* Check the network management counter value */
-    if (0 == mender_client_network_count) {
+    /* Deactivate add-ons, the delays of the activations start again at the next authentication */
+    if (NULL != mender_client_addons_list) {
+        for (size_t index = 0; index < mender_client_addons_count; index++) {
+            if ((true == mender_client_addons_list[index].activated) && (NULL != mender_client_addons_list[index].instance->deactivate)) {
+                mender_client_addons_list[index].instance->deactivate();
+            }
+            mender_client_addons_list[index].activated       = false;
+            mender_client_addons_list[index].activation_time = 0;
+        }
+    }
+
+    /* Release mutex used to protect access to the add-ons management list */
+    mender_scheduler_mutex_give(mender_client_addons_mutex);
+
+    /* Deactivate mender client work */
+    mender_scheduler_work_deactivate(mender_client_work_handle);
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+    mender_client_status_queue_deactivate();
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
+
+    /* Release network access now if it is lingering */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_client_network_mutex, -1)) {
+        if ((0 == mender_client_network_count) && (true == mender_client_network_connected)) {
+            mender_client_network_disconnect();
+        }
+        mender_scheduler_mutex_give(mender_client_network_mutex);
+    }
+
+    /* Unseal the registries, the works do not read them anymore */
+    mender_client_seal_registries(false);
+
+    return ret;
+}
+
+mender_err_t
+mender_client_execute(void) {
+
+    mender_err_t ret;
+
+    /* Trigger execution of the work, the request is remembered in case the work is already executing */
+    __atomic_store_n(&mender_client_work_requested, true, __ATOMIC_RELEASE);
+    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_work_handle))) {
+        mender_log_error("Unable to trigger update work");
+        goto END;
+    }
+
+END:
+
+    return ret;
+}
+
+void
+mender_client_set_download_rate_limit(uint32_t rate) {
+
+    /* Set the rate, it applies to the download in progress */
+    mender_client_config.download_rate_limit = rate;
+    mender_api_set_artifact_download_rate_limit(rate);
+}
+
+void
+mender_client_pause_download(void) {
+
+    /* Pause the download, it applies to the download in progress and to the next ones until it is resumed */
+    mender_api_pause_artifact_download();
+}
+
+void
+mender_client_resume_download(void) {
+
+    /* Resume the download, the work is executed as soon as possible if the connection has been closed during the pause */
+    if (true == mender_api_resume_artifact_download()) {
+        mender_client_execute();
+    }
+}
+
+mender_err_t
+mender_client_network_connect(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the network management counter */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_network_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Check the network connection status, it is still connected if it was released during the linger delay */
+    if (false == mender_client_network_connected) {
 
         /* Request network access */
         if (NULL != mender_client_callbacks.network_connect) {
@@ -529,6 +1598,11 @@ mender_client_network_connect(void) {
                 goto END;
             }
         }
+        mender_client_network_connected = true;
+#ifdef CONFIG_MENDER_CLIENT_METRICS
+        mender_client_network_connected_at = mender_scheduler_get_uptime_us();
+        MENDER_METRICS_ADD(MENDER_METRICS_NETWORK_CONNECTIONS, 1);
+#endif /* CONFIG_MENDER_CLIENT_METRICS */
     }
 
     /* Increment network management counter */
@@ -558,17 +1632,70 @@ mender_client_network_release(void) {
 
     /* Check the network management counter value */
     if (0 == mender_client_network_count) {
-
+#if (0 < CONFIG_MENDER_CLIENT_NETWORK_LINGER)
+        /* Release network access after the linger delay, the works executed back to back share the connection */
+        mender_client_network_released_at = mender_scheduler_get_uptime_us();
+        if (MENDER_OK != mender_scheduler_work_execute_after(mender_client_network_linger_handle, CONFIG_MENDER_CLIENT_NETWORK_LINGER * 1000)) {
+            mender_log_error("Unable to trigger network linger work");
+            ret = mender_client_network_disconnect();
+        }
+#else
         /* Release network access */
-        if (NULL != mender_client_callbacks.network_release) {
-            if (MENDER_OK != (ret = mender_client_callbacks.network_release())) {
-                mender_log_error("Unable to release network");
-                goto END;
-            }
+        ret = mender_client_network_disconnect();
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+    }
+
+    /* Release mutex used to protect access to the network management counter */
+    mender_scheduler_mutex_give(mender_client_network_mutex);
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_network_disconnect(void) {
+
+    mender_err_t ret = MENDER_OK;
+
+    /* Close the connections kept alive with the server */
+    mender_http_close_connections();
+
+    /* Release network access */
+    if (NULL != mender_client_callbacks.network_release) {
+        if (MENDER_OK != (ret = mender_client_callbacks.network_release())) {
+            mender_log_error("Unable to release network");
         }
     }
+    mender_client_network_connected = false;
+#ifdef CONFIG_MENDER_CLIENT_METRICS
+    MENDER_METRICS_ADD(MENDER_METRICS_NETWORK_DURATION, (uint32_t)((mender_scheduler_get_uptime_us() - mender_client_network_connected_at) / 1000));
+#endif /* CONFIG_MENDER_CLIENT_METRICS */
 
-END:
+    return ret;
+}
+
+#if (0 < CONFIG_MENDER_CLIENT_NETWORK_LINGER)
+
+static mender_err_t
+mender_client_network_linger_work_function(void) {
+
+    mender_err_t ret;
+    uint64_t     deadline;
+
+    /* Take mutex used to protect access to the network management counter */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_network_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Release network access if it has not been used again, the delay restarts when it is released again meanwhile */
+    if ((0 == mender_client_network_count) && (true == mender_client_network_connected)) {
+        deadline = mender_client_network_released_at + (uint64_t)CONFIG_MENDER_CLIENT_NETWORK_LINGER * 1000000;
+        if (mender_scheduler_get_uptime_us() < deadline) {
+            ret = mender_scheduler_work_execute_at(mender_client_network_linger_handle, deadline);
+        } else {
+            ret = mender_client_network_disconnect();
+        }
+    }
 
     /* Release mutex used to protect access to the network management counter */
     mender_scheduler_mutex_give(mender_client_network_mutex);
@@ -576,6 +1703,8 @@ END:
     return ret;
 }
 
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+
 mender_err_t
 mender_client_exit(void) {
 
@@ -590,8 +1719,8 @@ mender_client_exit(void) {
     /* Release add-ons */
     if (NULL != mender_client_addons_list) {
         for (size_t index = 0; index < mender_client_addons_count; index++) {
-            if (NULL != mender_client_addons_list[index]->exit) {
-                mender_client_addons_list[index]->exit();
+            if (NULL != mender_client_addons_list[index].instance->exit) {
+                mender_client_addons_list[index].instance->exit();
             }
         }
     }
@@ -599,27 +1728,63 @@ mender_client_exit(void) {
     /* Release mutex used to protect access to the add-ons management list */
     mender_scheduler_mutex_give(mender_client_addons_mutex);
 
+#ifdef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK
+    /* Wait for the end of the authentication keys generation */
+    if (NULL != mender_client_keys_generation.task) {
+        mender_scheduler_task_join(mender_client_keys_generation.task);
+        mender_client_keys_generation.task = NULL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK */
+
     /* Delete mender client work */
     mender_scheduler_work_delete(mender_client_work_handle);
     mender_client_work_handle = NULL;
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+    mender_client_status_queue_exit();
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
+#if (0 < CONFIG_MENDER_CLIENT_NETWORK_LINGER)
+    mender_scheduler_work_deactivate(mender_client_network_linger_handle);
+    mender_scheduler_work_delete(mender_client_network_linger_handle);
+    mender_client_network_linger_handle = NULL;
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER */
+    mender_scheduler_work_deactivate(mender_client_addons_activation_handle);
+    mender_scheduler_work_delete(mender_client_addons_activation_handle);
+    mender_client_addons_activation_handle = NULL;
 
     /* Release all modules */
     mender_api_exit();
     mender_tls_exit();
     mender_storage_exit();
+#ifdef CONFIG_MENDER_TRACE
+    mender_trace_exit();
+#endif /* CONFIG_MENDER_TRACE */
     mender_log_exit();
     mender_scheduler_exit();
 
     /* Release memory */
     mender_utils_keystore_delete(mender_client_config.identity);
     mender_client_config.identity                     = NULL;
+    mender_utils_keystore_delete(mender_client_config.device_provides);
+    mender_client_config.device_provides              = NULL;
     mender_client_config.artifact_name                = NULL;
     mender_client_config.device_type                  = NULL;
     mender_client_config.host                         = NULL;
     mender_client_config.tenant_token                 = NULL;
     mender_client_config.authentication_poll_interval = 0;
     mender_client_config.update_poll_interval         = 0;
+    mender_client_config.artifact_verify_key          = NULL;
+    mender_client_config.artifact_mirror              = NULL;
     mender_client_network_count                       = 0;
+    mender_client_network_connected                   = false;
+    mender_client_deployment_finished                 = false;
+    mender_client_work_failures                       = 0;
+    mender_client_work_jitter                         = 0;
+    __atomic_store_n(&mender_client_work_requested, false, __ATOMIC_RELEASE);
+    if (NULL != mender_client_download_deferral.id) {
+        mender_free(mender_client_download_deferral.id);
+    }
+    memset(&mender_client_download_deferral, 0, sizeof(mender_client_download_deferral));
+    memset(&mender_client_install_deferral, 0, sizeof(mender_client_install_deferral));
     mender_scheduler_mutex_give(mender_client_network_mutex);
     mender_scheduler_mutex_delete(mender_client_network_mutex);
     mender_client_network_mutex = NULL;
@@ -627,11 +1792,16 @@ mender_client_exit(void) {
         cJSON_Delete(mender_client_deployment_data);
         mender_client_deployment_data = NULL;
     }
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+    mender_client_staging_release();
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
     if (NULL != mender_client_artifact_types_list) {
+#ifndef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
         for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
-            free(mender_client_artifact_types_list[artifact_type_index]);
+            mender_free(mender_client_artifact_types_list[artifact_type_index]);
         }
-        free(mender_client_artifact_types_list);
+        mender_free(mender_client_artifact_types_list);
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
         mender_client_artifact_types_list = NULL;
     }
     mender_client_artifact_types_count = 0;
@@ -639,7 +1809,9 @@ mender_client_exit(void) {
     mender_scheduler_mutex_delete(mender_client_artifact_types_mutex);
     mender_client_artifact_types_mutex = NULL;
     if (NULL != mender_client_addons_list) {
-        free(mender_client_addons_list);
+#ifndef CONFIG_MENDER_CLIENT_STATIC_ALLOCATION
+        mender_free(mender_client_addons_list);
+#endif /* CONFIG_MENDER_CLIENT_STATIC_ALLOCATION */
         mender_client_addons_list = NULL;
     }
     mender_client_addons_count = 0;
@@ -655,12 +1827,21 @@ mender_client_work_function(void) {
 
     mender_err_t ret = MENDER_OK;
 
+    /* Execution requests received from now are handled by the next execution */
+    __atomic_store_n(&mender_client_work_requested, false, __ATOMIC_RELEASE);
+
     /* Work depending of the client state */
     if (MENDER_CLIENT_STATE_INITIALIZATION == mender_client_state) {
         /* Perform initialization of the client */
         if (MENDER_DONE != (ret = mender_client_initialization_work_function())) {
             goto END;
         }
+#ifdef CONFIG_MENDER_CLIENT_LOCAL_CONFIRMATION
+        /* Confirm the pending image without waiting for the server, the rollback depends on the health of the device */
+        if (MENDER_DONE != (ret = mender_client_confirmation_work_function())) {
+            goto END;
+        }
+#endif /* CONFIG_MENDER_CLIENT_LOCAL_CONFIRMATION */
         /* Update client state */
         mender_client_state = MENDER_CLIENT_STATE_AUTHENTICATION;
     }
@@ -674,11 +1855,6 @@ mender_client_work_function(void) {
         if (MENDER_DONE != (ret = mender_client_authentication_work_function())) {
             goto RELEASE;
         }
-        /* Update work period */
-        if (MENDER_OK != (ret = mender_scheduler_work_set_period(mender_client_work_handle, mender_client_config.update_poll_interval))) {
-            mender_log_error("Unable to set work period");
-            goto RELEASE;
-        }
         /* Update client state */
         mender_client_state = MENDER_CLIENT_STATE_AUTHENTICATED;
     }
@@ -686,6 +1862,10 @@ mender_client_work_function(void) {
     if (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) {
         /* Perform updates */
         ret = mender_client_update_work_function();
+        /* Activate the add-ons waiting for the first check for deployment */
+        mender_client_activate_addons(MENDER_CLIENT_ADDON_ACTIVATION_AFTER_UPDATE_CHECK);
+        /* Perform periodic works of the add-ons, the network is still available */
+        mender_client_check_in_work_function();
     }
 
 RELEASE:
@@ -695,6 +1875,11 @@ RELEASE:
 
 END:
 
+    /* Update work period */
+    if (MENDER_OK != mender_client_set_work_period(ret)) {
+        mender_log_error("Unable to set work period");
+    }
+
     return ret;
 }
 
@@ -704,11 +1889,44 @@ mender_client_initialization_work_function(void) {
     char        *deployment_data = NULL;
     mender_err_t ret;
 
+#ifdef CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE
+    /* Delete the authentication token saved with the previous authentication keys */
+    if (true == mender_client_config.recommissioning) {
+        mender_storage_delete_authentication_token();
+    }
+#endif /* CONFIG_MENDER_CLIENT_AUTHENTICATION_TOKEN_STORAGE */
+
+#ifdef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK
+    /* Retrieve or generate authentication keys in the background, the initialization is pending until the keys are ready */
+    if (NULL == mender_client_keys_generation.task) {
+        mender_scheduler_task_params_t task_params = { .function   = mender_client_keys_generation_task,
+                                                       .arg        = NULL,
+                                                       .name       = "mender_client_keys_generation",
+                                                       .stack_size = CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_STACK_SIZE,
+                                                       .priority   = CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK_PRIORITY };
+        mender_client_keys_generation.done         = false;
+        if (MENDER_OK != (ret = mender_scheduler_task_create(&task_params, &mender_client_keys_generation.task))) {
+            mender_log_error("Unable to create authentication keys generation task");
+            goto END;
+        }
+        return MENDER_OK;
+    }
+    if (false == mender_client_keys_generation.done) {
+        return MENDER_OK;
+    }
+    mender_scheduler_task_join(mender_client_keys_generation.task);
+    mender_client_keys_generation.task = NULL;
+    if (MENDER_OK != (ret = mender_client_keys_generation.ret)) {
+        mender_log_error("Unable to retrieve or generate authentication keys");
+        goto END;
+    }
+#else
     /* Retrieve or generate authentication keys */
     if (MENDER_OK != (ret = mender_tls_init_authentication_keys(mender_client_config.recommissioning))) {
         mender_log_error("Unable to retrieve or generate authentication keys");
         goto END;
     }
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK */
 
     /* Retrieve deployment data if it is found (following an update) */
     if (MENDER_OK != (ret = mender_storage_get_deployment_data(&deployment_data))) {
@@ -720,13 +1938,18 @@ mender_client_initialization_work_function(void) {
     if (NULL != deployment_data) {
         if (NULL == (mender_client_deployment_data = cJSON_Parse(deployment_data))) {
             mender_log_error("Unable to parse deployment data");
-            free(deployment_data);
+            mender_free(deployment_data);
             ret = MENDER_FAIL;
             goto REBOOT;
         }
-        free(deployment_data);
+        mender_free(deployment_data);
     }
 
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+    /* Retrieve the install checkpoint if an installation has been interrupted by a reset */
+    mender_client_install_checkpoint_load();
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
     return MENDER_DONE;
 
 END:
@@ -746,6 +1969,102 @@ REBOOT:
     return ret;
 }
 
+#ifdef CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK
+
+static void
+mender_client_keys_generation_task(void *arg) {
+
+    (void)arg;
+
+    /* Retrieve or generate authentication keys */
+    mender_client_keys_generation.ret  = mender_tls_init_authentication_keys(mender_client_config.recommissioning);
+    mender_client_keys_generation.done = true;
+
+    /* Trigger execution of the client work to continue the initialization */
+    mender_client_execute();
+}
+
+#endif /* CONFIG_MENDER_CLIENT_KEYS_GENERATION_TASK */
+
+#ifdef CONFIG_MENDER_CLIENT_PRECONNECT
+
+static void
+mender_client_preconnect_task(void *arg) {
+
+    assert(NULL != arg);
+
+    /* Connect to the server of the artifact, the download is not affected if it fails */
+    mender_http_preconnect((char *)arg);
+}
+
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT */
+
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+
+static void
+mender_client_abort_check_start(char *id) {
+
+    assert(NULL != id);
+
+    /* Create the queue used to ask the task to terminate and start the task */
+    __atomic_store_n(&mender_client_abort_check.aborted, false, __ATOMIC_RELEASE);
+    mender_client_abort_check.id = id;
+    if (MENDER_OK != mender_scheduler_queue_create(1, sizeof(bool), &mender_client_abort_check.queue)) {
+        mender_log_warning("Unable to create queue, the abort of the deployment is not checked");
+        mender_client_abort_check.queue = NULL;
+        return;
+    }
+    mender_scheduler_task_params_t task_params = { .function   = mender_client_abort_check_task,
+                                                   .arg        = NULL,
+                                                   .name       = "mender_client_abort_check",
+                                                   .stack_size = CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_STACK_SIZE,
+                                                   .priority   = CONFIG_MENDER_CLIENT_ABORT_CHECK_TASK_PRIORITY };
+    if (MENDER_OK != mender_scheduler_task_create(&task_params, &mender_client_abort_check.task)) {
+        mender_log_warning("Unable to create task, the abort of the deployment is not checked");
+        mender_client_abort_check.task = NULL;
+        mender_scheduler_queue_delete(mender_client_abort_check.queue);
+        mender_client_abort_check.queue = NULL;
+    }
+}
+
+static bool
+mender_client_abort_check_stop(void) {
+
+    bool stop = true;
+
+    /* Ask the task to terminate and wait for it, the request is kept in the queue if the task has already terminated */
+    if (NULL != mender_client_abort_check.task) {
+        mender_scheduler_queue_send(mender_client_abort_check.queue, &stop, -1);
+        mender_scheduler_task_join(mender_client_abort_check.task);
+        mender_client_abort_check.task = NULL;
+    }
+    if (NULL != mender_client_abort_check.queue) {
+        mender_scheduler_queue_delete(mender_client_abort_check.queue);
+        mender_client_abort_check.queue = NULL;
+    }
+    mender_client_abort_check.id = NULL;
+
+    return __atomic_load_n(&mender_client_abort_check.aborted, __ATOMIC_ACQUIRE);
+}
+
+static void
+mender_client_abort_check_task(void *arg) {
+
+    (void)arg;
+    bool stop;
+
+    /* Publish the downloading status at each interval until the download ends, the server rejects it if the deployment has been aborted */
+    while (MENDER_OK != mender_scheduler_queue_receive(mender_client_abort_check.queue, &stop, CONFIG_MENDER_CLIENT_ABORT_CHECK_INTERVAL * 1000)) {
+        if (MENDER_NOT_FOUND == mender_api_publish_deployment_status(mender_client_abort_check.id, MENDER_DEPLOYMENT_STATUS_DOWNLOADING)) {
+            mender_log_warning("Deployment has been aborted by the server");
+            __atomic_store_n(&mender_client_abort_check.aborted, true, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+
 static mender_err_t
 mender_client_authentication_work_function(void) {
 
@@ -786,69 +2105,22 @@ mender_client_authentication_work_function(void) {
     /* Check if deployment is pending */
     if (NULL != mender_client_deployment_data) {
 
-        /* Retrieve deployment data */
-        cJSON *json_id = NULL;
-        if (NULL == (json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id"))) {
-            mender_log_error("Unable to get ID from the deployment data");
-            goto RELEASE;
-        }
-        char *id;
-        if (NULL == (id = cJSON_GetStringValue(json_id))) {
-            mender_log_error("Unable to get ID from the deployment data");
-            goto RELEASE;
-        }
-        cJSON *json_artifact_name = NULL;
-        if (NULL == (json_artifact_name = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "artifact_name"))) {
-            mender_log_error("Unable to get artifact name from the deployment data");
-            goto RELEASE;
-        }
-        char *artifact_name;
-        if (NULL == (artifact_name = cJSON_GetStringValue(json_artifact_name))) {
-            mender_log_error("Unable to get artifact name from the deployment data");
-            goto RELEASE;
-        }
-        cJSON *json_types = NULL;
-        if (NULL == (json_types = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "types"))) {
-            mender_log_error("Unable to get types from the deployment data");
-            goto RELEASE;
-        }
-
-        /* Take mutex used to protect access to the artifact types management list */
-        if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
-            mender_log_error("Unable to take mutex");
+        /* Retrieve deployment status */
+        char                      *id;
+        mender_deployment_status_t deployment_status;
+        if (MENDER_OK != mender_client_pending_deployment_status(&id, &deployment_status)) {
             goto RELEASE;
         }
 
-        /* Check if artifact running is the pending one */
-        bool   success   = true;
-        cJSON *json_type = NULL;
-        cJSON_ArrayForEach(json_type, json_types) {
-            if (NULL != mender_client_artifact_types_list) {
-                for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
-                    if (!strcmp(mender_client_artifact_types_list[artifact_type_index]->type, cJSON_GetStringValue(json_type))) {
-                        if (NULL != mender_client_artifact_types_list[artifact_type_index]->artifact_name) {
-                            if (strcmp(mender_client_artifact_types_list[artifact_type_index]->artifact_name, artifact_name)) {
-                                /* Deployment status failure */
-                                success = false;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        /* Release mutex used to protect access to the artifact types management list */
-        mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
-
         /* Publish deployment status */
-        if (true == success) {
-            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_SUCCESS);
-        } else {
-            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        }
+        mender_client_publish_deployment_status(id, deployment_status);
 
-        /* Delete pending deployment */
+        /* Delete pending deployment, it is kept until the status is published if it is queued */
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+        mender_client_status_queue_store(id);
+#else
         mender_storage_delete_deployment_data();
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
     }
 
 RELEASE:
@@ -859,23 +2131,115 @@ RELEASE:
         mender_client_deployment_data = NULL;
     }
 
-    /* Take mutex used to protect access to the add-ons management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
-        mender_log_error("Unable to take mutex");
-        return ret;
+    /* Activate add-ons depending of their activation policy */
+    mender_client_activate_addons(MENDER_CLIENT_ADDON_ACTIVATION_IMMEDIATE);
+
+    return MENDER_DONE;
+
+REBOOT:
+
+    /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
+    if (NULL != mender_client_callbacks.restart) {
+        mender_client_callbacks.restart();
     }
 
-    /* Activate add-ons */
-    if (NULL != mender_client_addons_list) {
-        for (size_t index = 0; index < mender_client_addons_count; index++) {
-            if (NULL != mender_client_addons_list[index]->activate) {
-                mender_client_addons_list[index]->activate();
+    return ret;
+}
+
+static mender_err_t
+mender_client_pending_deployment_status(char **id, mender_deployment_status_t *deployment_status) {
+
+    assert(NULL != id);
+    assert(NULL != deployment_status);
+
+    /* Retrieve deployment data */
+    cJSON *json_id = NULL;
+    if (NULL == (json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id"))) {
+        mender_log_error("Unable to get ID from the deployment data");
+        return MENDER_FAIL;
+    }
+    if (NULL == (*id = cJSON_GetStringValue(json_id))) {
+        mender_log_error("Unable to get ID from the deployment data");
+        return MENDER_FAIL;
+    }
+    cJSON *json_artifact_name = NULL;
+    if (NULL == (json_artifact_name = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "artifact_name"))) {
+        mender_log_error("Unable to get artifact name from the deployment data");
+        return MENDER_FAIL;
+    }
+    char *artifact_name;
+    if (NULL == (artifact_name = cJSON_GetStringValue(json_artifact_name))) {
+        mender_log_error("Unable to get artifact name from the deployment data");
+        return MENDER_FAIL;
+    }
+    cJSON *json_types = NULL;
+    if (NULL == (json_types = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "types"))) {
+        mender_log_error("Unable to get types from the deployment data");
+        return MENDER_FAIL;
+    }
+
+    /* Check if artifact running is the pending one, the artifact types registry is sealed */
+    *deployment_status = MENDER_DEPLOYMENT_STATUS_SUCCESS;
+    cJSON *json_type   = NULL;
+    cJSON_ArrayForEach(json_type, json_types) {
+        if (NULL != mender_client_artifact_types_list) {
+            for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
+                if (!strcmp(mender_client_artifact_types_list[artifact_type_index]->type, cJSON_GetStringValue(json_type))) {
+                    if (NULL != mender_client_artifact_types_list[artifact_type_index]->artifact_name) {
+                        if (strcmp(mender_client_artifact_types_list[artifact_type_index]->artifact_name, artifact_name)) {
+                            /* Deployment status failure */
+                            *deployment_status = MENDER_DEPLOYMENT_STATUS_FAILURE;
+                        }
+                    }
+                }
             }
         }
     }
 
-    /* Release mutex used to protect access to the add-ons management list */
-    mender_scheduler_mutex_give(mender_client_addons_mutex);
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_LOCAL_CONFIRMATION
+
+static mender_err_t
+mender_client_confirmation_work_function(void) {
+
+    mender_err_t               ret;
+    char                      *id;
+    mender_deployment_status_t deployment_status;
+
+    /* Check if deployment is pending, the image is confirmed once authenticated if the application has no self-tests */
+    if ((NULL == mender_client_deployment_data) || (NULL == mender_client_callbacks.self_test)) {
+        return MENDER_DONE;
+    }
+
+    /* Retrieve deployment status */
+    if (MENDER_OK != mender_client_pending_deployment_status(&id, &deployment_status)) {
+        goto RELEASE;
+    }
+
+    /* Confirm the image if the self-tests pass, the device restarts otherwise so that it rolls back to the previous image */
+    if (MENDER_DEPLOYMENT_STATUS_SUCCESS == deployment_status) {
+        if (MENDER_OK != (ret = mender_client_callbacks.self_test())) {
+            mender_log_error("Self-tests of the application failed, rebooting");
+            goto REBOOT;
+        }
+        if (MENDER_OK != (ret = mender_flash_confirm_image())) {
+            mender_log_error("Unable to confirm the image, rebooting");
+            goto REBOOT;
+        }
+        mender_log_info("Image of deployment '%s' has been confirmed locally", id);
+    }
+
+    /* Queue deployment status, the deployment data are kept until it is published once authenticated */
+    mender_client_publish_deployment_status(id, deployment_status);
+    mender_client_status_queue_store(id);
+
+RELEASE:
+
+    /* Release memory, the deployment is not pending anymore for the authentication work */
+    cJSON_Delete(mender_client_deployment_data);
+    mender_client_deployment_data = NULL;
 
     return MENDER_DONE;
 
@@ -889,6 +2253,8 @@ REBOOT:
     return ret;
 }
 
+#endif /* CONFIG_MENDER_CLIENT_LOCAL_CONFIRMATION */
+
 static mender_err_t
 mender_client_update_work_function(void) {
 
@@ -899,41 +2265,196 @@ mender_client_update_work_function(void) {
     char *artifact_name   = NULL;
     char *uri             = NULL;
     char *deployment_data = NULL;
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+    /* Publish the deployment statuses waiting in the queue while the network is available */
+    mender_client_status_queue_flush();
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
     mender_log_info("Checking for deployment...");
-    if (MENDER_OK != (ret = mender_api_check_for_deployment(&id, &artifact_name, &uri))) {
+    mender_keystore_t *device_provides = NULL;
+#ifdef CONFIG_MENDER_CLIENT_DEVICE_PROVIDES
+    /* The server selects only the artifacts compatible with the attributes of the device */
+    if (MENDER_OK != (ret = mender_client_device_provides_build(&device_provides))) {
+        mender_log_error("Unable to build device provides");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_CLIENT_DEVICE_PROVIDES */
+    ret = mender_api_check_for_deployment(device_provides, &id, &artifact_name, &uri);
+    mender_utils_keystore_delete(device_provides);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to check for deployment");
         goto END;
     }
 
+    /* Check if the interrupted download of a previous deployment can be resumed, it is cancelled otherwise */
+    /* The interrupted download is kept in RAM and lost on reset, see CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT to resume after a reset */
+    bool resume = false;
+    if (NULL != mender_client_deployment_data) {
+        cJSON *json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id");
+        if ((NULL != id) && (NULL != json_id) && (!strcmp(id, cJSON_GetStringValue(json_id)))
+            && ((0 != mender_api_get_artifact_download_offset()) || (true == mender_client_install_deferral.pending))) {
+            resume = true;
+        } else {
+            mender_log_info("Cancelling interrupted download of the previous deployment");
+            mender_client_install_deferral.pending = false;
+            mender_api_cancel_artifact_download();
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+            mender_client_staging_release();
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+            mender_client_flash_pipeline_stop();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+            mender_client_delta_release();
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
+            if (true == mender_client_deployment_needs_set_pending_image) {
+                mender_client_flash_abort_deployment();
+            }
+            cJSON_Delete(mender_client_deployment_data);
+            mender_client_deployment_data = NULL;
+        }
+    }
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+    /* Delete the install checkpoint of a previous deployment, its installation is not resumed */
+    mender_client_install_checkpoint_check(id);
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
     /* Check if deployment is available */
     if ((NULL == id) || (NULL == artifact_name) || (NULL == uri)) {
         mender_log_info("No deployment available");
         goto END;
     }
 
-    /* Reset flags */
-    mender_client_deployment_needs_set_pending_image = false;
-    mender_client_deployment_needs_restart           = false;
+    /* Check if the artifact is already installed, the deployment is reported immediately without downloading the artifact again */
+    if ((false == resume) && (NULL != mender_client_config.artifact_name) && (!strcmp(artifact_name, mender_client_config.artifact_name))) {
+        mender_log_info("Artifact '%s' is already installed", artifact_name);
+        mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED);
+        goto END;
+    }
 
-    /* Create deployment data */
-    if (NULL == (mender_client_deployment_data = cJSON_CreateObject())) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    /* Check if the application defers the download, for example when the link quality is poor, the interrupted download is kept */
+    if ((false == mender_client_install_deferral.pending) && (true == mender_client_download_deferred(id))) {
         goto END;
     }
-    cJSON_AddStringToObject(mender_client_deployment_data, "id", id);
-    cJSON_AddStringToObject(mender_client_deployment_data, "artifact_name", artifact_name);
-    cJSON_AddArrayToObject(mender_client_deployment_data, "types");
 
-    /* Download deployment artifact */
-    mender_log_info("Downloading deployment artifact with id '%s', artifact name '%s' and uri '%s'", id, artifact_name, uri);
-    mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_DOWNLOADING);
-    if (MENDER_OK != (ret = mender_api_download_artifact(uri, mender_client_download_artifact_callback))) {
-        mender_log_error("Unable to download artifact");
-        mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        if (true == mender_client_deployment_needs_set_pending_image) {
-            mender_flash_abort_deployment(mender_client_flash_handle);
+    if (false == resume) {
+
+        /* Reset flags */
+        mender_client_deployment_needs_set_pending_image = false;
+        mender_client_deployment_needs_restart           = false;
+
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+        /* Capture the logs of the deployment, they are published if it fails */
+        if (MENDER_OK != mender_log_capture_begin()) {
+            mender_log_warning("Unable to capture the logs of the deployment");
+        }
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
+        /* Create deployment data */
+        if (NULL == (mender_client_deployment_data = cJSON_CreateObject())) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        cJSON_AddStringToObject(mender_client_deployment_data, "id", id);
+        cJSON_AddStringToObject(mender_client_deployment_data, "artifact_name", artifact_name);
+        cJSON_AddArrayToObject(mender_client_deployment_data, "types");
+
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
+        /* Check deployment artifact before downloading it */
+        mender_log_info("Checking deployment artifact with id '%s', artifact name '%s' and uri '%s'", id, artifact_name, uri);
+        if (MENDER_OK != (ret = mender_api_check_artifact(uri, mender_client_check_artifact_callback))) {
+            mender_log_error("Unable to check artifact, deployment is rejected");
+            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+            goto END;
+        }
+
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+#ifdef CONFIG_MENDER_CLIENT_PRECONNECT
+        /* Connect to the server of the artifact while the deployment status is published, the artifact is downloaded with a new connection otherwise */
+        void                          *preconnect_task = NULL;
+        mender_scheduler_task_params_t task_params     = { .function   = mender_client_preconnect_task,
+                                                           .arg        = uri,
+                                                           .name       = "mender_client_preconnect",
+                                                           .stack_size = CONFIG_MENDER_CLIENT_PRECONNECT_TASK_STACK_SIZE,
+                                                           .priority   = CONFIG_MENDER_CLIENT_PRECONNECT_TASK_PRIORITY };
+        if (MENDER_OK != mender_scheduler_task_create(&task_params, &preconnect_task)) {
+            mender_log_warning("Unable to create connection to the artifact server task");
+        }
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT */
+        /* Publish deployment status downloading */
+        mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_DOWNLOADING);
+#ifdef CONFIG_MENDER_CLIENT_PRECONNECT
+        /* Wait for the connection to the server of the artifact */
+        if (NULL != preconnect_task) {
+            mender_scheduler_task_join(preconnect_task);
+        }
+#endif /* CONFIG_MENDER_CLIENT_PRECONNECT */
+    }
+
+    /* The artifact is not downloaded again if it has been downloaded and its installation has been deferred */
+    if (false == mender_client_install_deferral.pending) {
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+        /* Resume the installation interrupted by a reset from the install checkpoint, the download then continues from the data which have not been written */
+        if (false == resume) {
+            mender_client_deployment_needs_set_pending_image
+                = (MENDER_OK == mender_client_install_checkpoint_resume(id, uri, &mender_client_download_artifact_callback));
+        }
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+        /* Download deployment artifact, the flash handle and the artifact context are kept in RAM if the download is interrupted so that it can be resumed */
+        mender_log_info("Downloading deployment artifact with id '%s', artifact name '%s' and uri '%s'", id, artifact_name, uri);
+        memset(&mender_client_download_payload, 0, sizeof(mender_client_download_payload));
+        mender_client_download_progress.time        = mender_scheduler_get_uptime_us();
+        mender_client_download_progress.offset      = mender_api_get_artifact_download_offset();
+        mender_client_download_progress.next_time   = mender_client_download_progress.time;
+        mender_client_download_progress.next_offset = mender_client_download_progress.offset;
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+        /* Check periodically if the deployment is aborted by the server while the artifact is downloaded */
+        mender_client_abort_check_start(id);
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+        ret = mender_client_download_artifact(uri);
+#ifdef CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS
+        /* Wait for the payload workers to handle the data received, the download can not be resumed if a worker failed */
+        mender_err_t workers_ret = mender_client_payload_workers_stop();
+        if (MENDER_OK != workers_ret) {
+            mender_api_cancel_artifact_download();
+            ret = workers_ret;
         }
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS */
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+        /* The download of a deployment aborted by the server is not resumed, the flash is released now */
+        if ((true == mender_client_abort_check_stop()) && (MENDER_OK != ret)) {
+            mender_api_cancel_artifact_download();
+        }
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+        if (MENDER_OK != ret) {
+            if (0 != mender_api_get_artifact_download_offset()) {
+                mender_log_warning("Download of the artifact has been interrupted, it will be resumed at the next deployment check");
+                goto END;
+            }
+            mender_log_error("Unable to download artifact");
+            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+            mender_client_flash_pipeline_stop();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+            mender_client_delta_release();
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+            mender_client_install_checkpoint_release();
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+            if (true == mender_client_deployment_needs_set_pending_image) {
+                mender_client_flash_abort_deployment();
+            }
+            goto END;
+        }
+    }
+
+    /* Check if the application defers the installation to a maintenance window, the artifact downloaded is kept meanwhile */
+    if (true == mender_client_install_deferred()) {
+        ret = MENDER_OK;
         goto END;
     }
 
@@ -941,11 +2462,14 @@ mender_client_update_work_function(void) {
     mender_log_info("Download done, installing artifact");
     mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_INSTALLING);
     if (true == mender_client_deployment_needs_set_pending_image) {
-        if (MENDER_OK != (ret = mender_flash_set_pending_image(mender_client_flash_handle))) {
+        if (MENDER_OK != (ret = mender_client_flash_set_pending_image())) {
             mender_log_error("Unable to set boot partition");
             mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
             goto END;
         }
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+        mender_client_flash_statistics_log();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
     }
 
     /* Check if the system must restart following downloading the deployment */
@@ -971,16 +2495,16 @@ mender_client_update_work_function(void) {
 
     /* Release memory */
     if (NULL != id) {
-        free(id);
+        mender_free(id);
     }
     if (NULL != artifact_name) {
-        free(artifact_name);
+        mender_free(artifact_name);
     }
     if (NULL != uri) {
-        free(uri);
+        mender_free(uri);
     }
     if (NULL != deployment_data) {
-        free(deployment_data);
+        mender_free(deployment_data);
     }
     if (NULL != mender_client_deployment_data) {
         cJSON_Delete(mender_client_deployment_data);
@@ -989,6 +2513,10 @@ mender_client_update_work_function(void) {
 
     /* Check if the system must restart following downloading the deployment */
     if (true == mender_client_deployment_needs_restart) {
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+        /* Publish the deployment statuses waiting in the queue before restarting */
+        mender_client_status_queue_flush();
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
         /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
         if (NULL != mender_client_callbacks.restart) {
             mender_client_callbacks.restart();
@@ -1001,18 +2529,18 @@ END:
 
     /* Release memory */
     if (NULL != id) {
-        free(id);
+        mender_free(id);
     }
     if (NULL != artifact_name) {
-        free(artifact_name);
+        mender_free(artifact_name);
     }
     if (NULL != uri) {
-        free(uri);
+        mender_free(uri);
     }
     if (NULL != deployment_data) {
-        free(deployment_data);
+        mender_free(deployment_data);
     }
-    if (NULL != mender_client_deployment_data) {
+    if ((NULL != mender_client_deployment_data) && (0 == mender_api_get_artifact_download_offset()) && (false == mender_client_install_deferral.pending)) {
         cJSON_Delete(mender_client_deployment_data);
         mender_client_deployment_data = NULL;
     }
@@ -1020,97 +2548,681 @@ END:
     return ret;
 }
 
-static mender_err_t
-mender_client_download_artifact_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+static bool
+mender_client_download_deferred(char *id) {
 
-    assert(NULL != type);
-    cJSON       *json_types;
-    mender_err_t ret;
+    assert(NULL != id);
 
-    /* Take mutex used to protect access to the artifact types management list */
+    /* Check if the application is asked */
+    if (NULL == mender_client_callbacks.download_allowed) {
+        return false;
+    }
+
+    /* The maximum delay is counted from the first deferral of the deployment */
+    uint64_t now = mender_scheduler_get_uptime_us();
+    if ((NULL == mender_client_download_deferral.id) || (strcmp(id, mender_client_download_deferral.id))) {
+        if (NULL != mender_client_download_deferral.id) {
+            mender_free(mender_client_download_deferral.id);
+        }
+        if (NULL == (mender_client_download_deferral.id = mender_strdup(id))) {
+            mender_log_error("Unable to allocate memory");
+            return false;
+        }
+        mender_client_download_deferral.time = now;
+    }
+
+    /* Ask the application, the total length of the artifact is only known if the download is resumed */
+    if (MENDER_OK != mender_client_callbacks.download_allowed(mender_api_get_artifact_download_size())) {
+        if (now - mender_client_download_deferral.time < (uint64_t)CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_MAX_DELAY * 1000000) {
+            mender_log_info("Download of the deployment artifact deferred by the application");
+            mender_client_download_deferral.deferred = true;
+            return true;
+        }
+        mender_log_warning("Maximum deferral delay of the deployment elapsed, downloading the artifact");
+    }
+
+    /* The download proceeds */
+    mender_free(mender_client_download_deferral.id);
+    mender_client_download_deferral.id = NULL;
+
+    return false;
+}
+
+static bool
+mender_client_install_deferred(void) {
+
+    /* Check if the application is asked */
+    if (NULL == mender_client_callbacks.install_allowed) {
+        return false;
+    }
+
+    /* The maximum delay is counted from the end of the download */
+    uint64_t now = mender_scheduler_get_uptime_us();
+    if (false == mender_client_install_deferral.pending) {
+        mender_client_install_deferral.pending = true;
+        mender_client_install_deferral.time    = now;
+    }
+
+    /* Ask the application, the device is restarted by the installation if the artifact requires it */
+    if (MENDER_OK != mender_client_callbacks.install_allowed(mender_client_deployment_needs_restart)) {
+        if (now - mender_client_install_deferral.time < (uint64_t)CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_MAX_DELAY * 1000000) {
+            mender_log_info("Installation of the deployment artifact deferred by the application");
+            mender_client_install_deferral.deferred = true;
+            return true;
+        }
+        mender_log_warning("Maximum deferral delay of the installation elapsed, installing the artifact");
+    }
+
+    /* The installation proceeds */
+    mender_client_install_deferral.pending = false;
+
+    return false;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_DEVICE_PROVIDES
+
+static mender_err_t
+mender_client_device_provides_build(mender_keystore_t **device_provides) {
+
+    assert(NULL != device_provides);
+    mender_err_t ret;
+    char        *name = NULL;
+
+    /* Copy the attributes given in the configuration */
+    if (MENDER_OK != (ret = mender_utils_keystore_copy(device_provides, mender_client_config.device_provides))) {
+        mender_log_error("Unable to copy device provides");
+        return ret;
+    }
+    size_t length = mender_utils_keystore_length(*device_provides);
+
+    /* Take mender_client_artifact_types_mutex */
     if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
         mender_log_error("Unable to take mutex");
+        goto FAIL;
+    }
+
+    /* Add the versions of the artifact types which artifact name is known, the attributes given in the configuration take precedence */
+    mender_keystore_t *tmp;
+    if (NULL
+        == (tmp = (mender_keystore_t *)mender_realloc(*device_provides, (length + mender_client_artifact_types_count + 1) * sizeof(mender_keystore_item_t)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto RELEASE;
+    }
+    *device_provides = tmp;
+    memset(&tmp[length], 0, (mender_client_artifact_types_count + 1) * sizeof(mender_keystore_item_t));
+    for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
+        mender_client_artifact_type_t *artifact_type = mender_client_artifact_types_list[artifact_type_index];
+        if (NULL == artifact_type->artifact_name) {
+            continue;
+        }
+        /* The rootfs-image variants, such as the delta updates, install the same image */
+        if (!strcmp(artifact_type->type, "rootfs-image")) {
+            name = mender_strdup("rootfs-image.version");
+        } else if (!strncmp(artifact_type->type, "rootfs-image", strlen("rootfs-image"))) {
+            continue;
+        } else {
+            size_t str_length = strlen("rootfs-image.%s.version") - strlen("%s") + strlen(artifact_type->type) + 1;
+            if (NULL != (name = (char *)mender_malloc(str_length))) {
+                snprintf(name, str_length, "rootfs-image.%s.version", artifact_type->type);
+            }
+        }
+        if (NULL == name) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto RELEASE;
+        }
+        if (-1 == mender_utils_keystore_get_item_index(*device_provides, name)) {
+            if (MENDER_OK != (ret = mender_utils_keystore_set_item(*device_provides, length, name, artifact_type->artifact_name))) {
+                mender_log_error("Unable to allocate memory");
+                goto RELEASE;
+            }
+            length++;
+        }
+        mender_free(name);
+        name = NULL;
+    }
+
+RELEASE:
+
+    /* Release mender_client_artifact_types_mutex */
+    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != name) {
+        mender_free(name);
+    }
+    if (MENDER_OK != ret) {
+        mender_utils_keystore_delete(*device_provides);
+        *device_provides = NULL;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_DEVICE_PROVIDES */
+
+static mender_err_t
+mender_client_check_in_work_function(void) {
+
+    /* Perform the check-in works of the add-ons which are due, the delays are counted in update poll intervals so that the works are lined up */
+    /* The add-ons registry is sealed, it is read without lock */
+    for (size_t index = 0; index < mender_client_addons_count; index++) {
+        mender_client_addon_t *addon = &mender_client_addons_list[index];
+        if (addon->check_in_period <= 0) {
+            continue;
+        }
+        if (addon->check_in_delay <= 0) {
+            if (MENDER_OK != addon->instance->check_in()) {
+                mender_log_error("Unable to perform check-in work of the add-on");
+            }
+            addon->check_in_delay = addon->check_in_period;
+        }
+        /* The works are performed at each check-in if the update work is not periodic */
+        addon->check_in_delay -= (mender_client_config.update_poll_interval > 0) ? mender_client_config.update_poll_interval : addon->check_in_period;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_addons_activation_work_function(void) {
+
+    /* Activate the add-ons which delay is elapsed */
+    mender_client_activate_addons(MENDER_CLIENT_ADDON_ACTIVATION_DELAYED);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_seal_registries(bool sealed) {
+
+    mender_err_t ret;
+
+    /* Take mutexes used to protect access to the registries, in the order of the registration of the artifact types by the add-ons */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        mender_scheduler_mutex_give(mender_client_addons_mutex);
+        return ret;
+    }
+
+    /* Set the flag, the registries read by the works without lock are then published */
+    __atomic_store_n(&mender_client_registries_sealed, sealed, __ATOMIC_RELEASE);
+
+    /* Release mutexes used to protect access to the registries */
+    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+    mender_scheduler_mutex_give(mender_client_addons_mutex);
+
+    return MENDER_OK;
+}
+
+static void
+mender_client_activate_addons(mender_client_addon_activation_t event) {
+
+    uint64_t now  = mender_scheduler_get_uptime_us();
+    uint64_t next = 0;
+
+    /* Take mutex used to protect access to the add-ons management list */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_client_addons_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return;
+    }
+
+    /* Activate the add-ons which activation policy matches the event, the delays of the delayed activations start at the authentication */
+    for (size_t index = 0; index < mender_client_addons_count; index++) {
+        mender_client_addon_t *addon    = &mender_client_addons_list[index];
+        bool                   activate = (true == addon->requested) || (event == addon->activation);
+        if (true == addon->activated) {
+            continue;
+        }
+        if ((MENDER_CLIENT_ADDON_ACTIVATION_DELAYED == addon->activation) && (false == addon->requested)) {
+            if ((MENDER_CLIENT_ADDON_ACTIVATION_IMMEDIATE == event) && (0 == addon->activation_time)) {
+                addon->activation_time = now + (uint64_t)addon->activation_delay * 1000000;
+            }
+            activate = (0 != addon->activation_time) && (addon->activation_time <= now);
+            if ((false == activate) && (0 != addon->activation_time) && ((0 == next) || (addon->activation_time < next))) {
+                next = addon->activation_time;
+            }
+        }
+        if (false == activate) {
+            continue;
+        }
+        if ((NULL != addon->instance->activate) && (MENDER_OK != addon->instance->activate())) {
+            mender_log_error("Unable to activate add-on");
+            continue;
+        }
+        addon->activated = true;
+    }
+
+    /* Release mutex used to protect access to the add-ons management list */
+    mender_scheduler_mutex_give(mender_client_addons_mutex);
+
+    /* Execute the activation work when the next delay is elapsed */
+    if (0 != next) {
+        if (MENDER_OK != mender_scheduler_work_execute_at(mender_client_addons_activation_handle, next)) {
+            mender_log_error("Unable to execute add-ons activation work");
+        }
+    }
+}
+
+static mender_err_t
+mender_client_set_work_period(mender_err_t result) {
+
+    int32_t  interval;
+    uint32_t period;
+    uint32_t jitter;
+
+    /* Execute the work again shortly if it has been requested while executing, the backoff applies if the execution has failed */
+    if ((MENDER_OK == result) || (MENDER_DONE == result)) {
+        if (true == __atomic_exchange_n(&mender_client_work_requested, false, __ATOMIC_ACQ_REL)) {
+            return mender_scheduler_work_set_period(mender_client_work_handle, 1);
+        }
+    }
+
+    /* Retrieve the poll interval depending of the client state, periodic execution may be disabled */
+    interval = (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) ? mender_client_config.update_poll_interval
+                                                                           : mender_client_config.authentication_poll_interval;
+    if (interval <= 0) {
+        return mender_scheduler_work_set_period(mender_client_work_handle, 0);
+    }
+    period = (uint32_t)interval;
+
+    if ((MENDER_OK != result) && (MENDER_DONE != result)) {
+        /* Back off exponentially on consecutive failures, the delay requested by the server is honored */
+        for (uint32_t index = 0; (index < mender_client_work_failures) && (period < CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL); index++) {
+            period *= 2;
+        }
+        if ((period > CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL) && ((uint32_t)interval < CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL)) {
+            period = CONFIG_MENDER_CLIENT_POLL_BACKOFF_MAX_INTERVAL;
+        }
+        if (mender_api_get_retry_after() > period) {
+            period = mender_api_get_retry_after();
+        }
+        mender_client_work_failures++;
+    } else {
+        /* Check for a new deployment sooner when a deployment has finished */
+        mender_client_work_failures = 0;
+        if ((MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) && (true == mender_client_deployment_finished)) {
+            if (CONFIG_MENDER_CLIENT_DEPLOYMENT_POLL_INTERVAL < period) {
+                period = CONFIG_MENDER_CLIENT_DEPLOYMENT_POLL_INTERVAL;
+            }
+            mender_client_deployment_finished = false;
+        }
+        /* Ask the application again sooner when the download has been deferred */
+        if ((MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) && (true == mender_client_download_deferral.deferred)) {
+            if (CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_INTERVAL < period) {
+                period = CONFIG_MENDER_CLIENT_DOWNLOAD_DEFERRAL_INTERVAL;
+            }
+            mender_client_download_deferral.deferred = false;
+        }
+        /* Ask the application again sooner when the installation has been deferred */
+        if ((MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) && (true == mender_client_install_deferral.deferred)) {
+            if (CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_INTERVAL < period) {
+                period = CONFIG_MENDER_CLIENT_INSTALL_DEFERRAL_INTERVAL;
+            }
+            mender_client_install_deferral.deferred = false;
+        }
+    }
+
+    /* Add a random jitter (xorshift32) so that the devices started together do not poll the server at the same time */
+    jitter = (uint32_t)(((uint64_t)period * CONFIG_MENDER_CLIENT_POLL_JITTER) / 100);
+    if (0 != jitter) {
+        mender_client_work_jitter ^= mender_client_work_jitter << 13;
+        mender_client_work_jitter ^= mender_client_work_jitter >> 17;
+        mender_client_work_jitter ^= mender_client_work_jitter << 5;
+        period = period - jitter + (mender_client_work_jitter % (2 * jitter + 1));
+    }
+
+    return mender_scheduler_work_set_period(mender_client_work_handle, (0 != period) ? period : 1);
+}
+
+static mender_err_t
+mender_client_download_artifact(char *uri) {
+
+    assert(NULL != uri);
+    mender_err_t ret;
+    size_t       offset;
+    char        *key;
+
+    /* Download the artifact from the mirror, the server is used if the mirror fails before data have been delivered to the artifact types */
+    if (NULL != mender_client_config.artifact_mirror) {
+        if (NULL == (key = mender_client_get_artifact_key(uri))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        size_t str_length = strlen(mender_client_config.artifact_mirror) + strlen(key) + 2;
+        char  *mirror_uri = (char *)mender_malloc(str_length);
+        if (NULL == mirror_uri) {
+            mender_log_error("Unable to allocate memory");
+            mender_free(key);
+            return MENDER_FAIL;
+        }
+        snprintf(mirror_uri, str_length, "%s/%s", mender_client_config.artifact_mirror, key);
+        mender_free(key);
+        mender_log_info("Downloading artifact from mirror '%s'", mirror_uri);
+        offset = mender_api_get_artifact_download_offset();
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+        ret = mender_client_download_artifact_staged(mirror_uri);
+#else
+        ret = mender_api_download_artifact(mirror_uri, mender_client_download_artifact_callback);
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
+        mender_free(mirror_uri);
+        if ((MENDER_OK == ret) || (offset != mender_api_get_artifact_download_offset()) || (NULL != mender_client_download_payload.type)) {
+            return ret;
+        }
+        mender_log_warning("Unable to download artifact from mirror, downloading it from the server");
+    }
+
+    /* Download the artifact from the server */
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+    ret = mender_client_download_artifact_staged(uri);
+#else
+    ret = mender_api_download_artifact(uri, mender_client_download_artifact_callback);
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
+
+    return ret;
+}
+
+static char *
+mender_client_get_artifact_key(char *uri) {
+
+    assert(NULL != uri);
+    char *begin = uri;
+    char *end;
+
+    /* Skip the scheme and the host, and keep the last segment of the path without the query, which holds the signature of the URI */
+    if (NULL != strstr(begin, "://")) {
+        begin = strstr(begin, "://") + strlen("://");
+    }
+    end = begin + strcspn(begin, "?#");
+    for (char *c = begin; c < end; c++) {
+        if ('/' == *c) {
+            begin = c + 1;
+        }
+    }
+
+    return mender_strndup(begin, (size_t)(end - begin));
+}
+
+static mender_err_t
+mender_client_download_artifact_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    assert(NULL != type);
+    mender_err_t ret;
+
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+    /* Stop the download if the deployment has been aborted by the server */
+    if (true == __atomic_load_n(&mender_client_abort_check.aborted, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Deployment has been aborted by the server, stopping the download");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+
+#if CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0
+    /* Bound the latency of the other tasks, the data may be received and written back to back without blocking */
+    mender_client_download_artifact_yield();
+
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0 */
+    /* Resolve the payload at its beginning, or if the download has been resumed in the middle of it */
+    if ((NULL == filename) || (type != mender_client_download_payload.type)) {
+        if (MENDER_OK != (ret = mender_client_download_artifact_resolve(type))) {
+            return ret;
+        }
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS
+    /* Submit data to the payload worker handling the artifact type */
+    if (NULL != mender_client_download_payload.worker) {
+        return mender_client_payload_worker_submit(mender_client_download_payload.worker,
+                                                   mender_client_download_payload.id,
+                                                   mender_client_download_payload.artifact_name,
+                                                   meta_data,
+                                                   filename,
+                                                   size,
+                                                   data,
+                                                   index,
+                                                   length);
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS */
+    /* Invoke artifact type callback */
+    if (MENDER_OK
+        != (ret = mender_client_invoke_artifact_type(mender_client_download_payload.artifact_type,
+                                                     mender_client_download_payload.id,
+                                                     mender_client_download_payload.artifact_name,
+                                                     meta_data,
+                                                     filename,
+                                                     size,
+                                                     data,
+                                                     index,
+                                                     length))) {
+        mender_log_error("An error occurred while processing data of the artifact '%s'", type);
         return ret;
     }
 
-    /* Treatment depending of the type */
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_client_invoke_artifact_type(mender_client_artifact_type_t *artifact_type,
+                                   char                          *id,
+                                   char                          *artifact_name,
+                                   cJSON                         *meta_data,
+                                   char                          *filename,
+                                   size_t                         size,
+                                   void                          *data,
+                                   size_t                         index,
+                                   size_t                         length) {
+
+    assert(NULL != artifact_type);
+
+    /* Contiguous data */
+    if (NULL != artifact_type->callback) {
+        return artifact_type->callback(id, artifact_name, artifact_type->type, meta_data, filename, size, data, index, length);
+    }
+
+    /* The parser delivers the largest contiguous data available without copying them, the list is empty at the beginning of the payload */
+    mender_client_segment_t segment = { .data = data, .length = length };
+    return artifact_type->segments_callback(id, artifact_name, artifact_type->type, meta_data, filename, size, &segment, (NULL != data) ? 1 : 0, index);
+}
+
+static void
+mender_client_download_artifact_progress(size_t offset, size_t size) {
+
+    /* Check if the progress is reported to the application */
+    if (NULL == mender_client_callbacks.download_progress) {
+        return;
+    }
+
+    /* Report the progress if the step or the interval is reached, and at the end of the download */
+    uint64_t now = mender_scheduler_get_uptime_us();
+    if ((offset < mender_client_download_progress.next_offset) && (now < mender_client_download_progress.next_time) && ((0 == size) || (offset < size))) {
+        return;
+    }
+    uint32_t throughput = 0;
+    if (now > mender_client_download_progress.time) {
+        throughput = (uint32_t)(((uint64_t)(offset - mender_client_download_progress.offset) * 1000000) / (now - mender_client_download_progress.time));
+    }
+    mender_client_callbacks.download_progress(offset, size, throughput);
+
+    /* Compute the next report, it is only done after the interval if the total length is unknown */
+    mender_client_download_progress.time        = now;
+    mender_client_download_progress.offset      = offset;
+    mender_client_download_progress.next_time   = now + (uint64_t)CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL * 1000000;
+    mender_client_download_progress.next_offset = (0 != size) ? (offset + (size / 100) * CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP) : SIZE_MAX;
+}
+
+#if CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0
+
+static void
+mender_client_download_artifact_yield(void) {
+
+    /* Check if the budget is elapsed, the time spent blocked on the network is included */
+    uint64_t now = mender_scheduler_get_uptime_us();
+    if (now - mender_client_download_yield_time < (uint64_t)CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET * 1000) {
+        return;
+    }
+
+    /* Notify the application and let the other tasks run */
+    if (NULL != mender_client_callbacks.download_yield) {
+        mender_client_callbacks.download_yield();
+    }
+    mender_scheduler_yield(CONFIG_MENDER_CLIENT_DOWNLOAD_YIELD_DELAY);
+    mender_client_download_yield_time = mender_scheduler_get_uptime_us();
+}
+
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_CPU_BUDGET > 0 */
+
+static mender_err_t
+mender_client_download_artifact_resolve(char *type) {
+
+    assert(NULL != type);
+    cJSON *json_types;
+
+    /* The payload is not resolved until the end of the function */
+    mender_client_download_payload.type = NULL;
+
+    /* Retrieve ID and artifact name */
+    cJSON *json_id = NULL;
+    if (NULL == (json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id"))) {
+        mender_log_error("Unable to get ID from the deployment data");
+        return MENDER_FAIL;
+    }
+    if (NULL == (mender_client_download_payload.id = cJSON_GetStringValue(json_id))) {
+        mender_log_error("Unable to get ID from the deployment data");
+        return MENDER_FAIL;
+    }
+    cJSON *json_artifact_name = NULL;
+    if (NULL == (json_artifact_name = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "artifact_name"))) {
+        mender_log_error("Unable to get artifact name from the deployment data");
+        return MENDER_FAIL;
+    }
+    if (NULL == (mender_client_download_payload.artifact_name = cJSON_GetStringValue(json_artifact_name))) {
+        mender_log_error("Unable to get artifact name from the deployment data");
+        return MENDER_FAIL;
+    }
+
+    /* Look for the artifact type, the artifact types registry is sealed */
+    mender_client_download_payload.artifact_type = NULL;
     if (NULL != mender_client_artifact_types_list) {
         for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
-
-            /* Check artifact type */
             if (!strcmp(type, mender_client_artifact_types_list[artifact_type_index]->type)) {
+                mender_client_download_payload.artifact_type = mender_client_artifact_types_list[artifact_type_index];
+                break;
+            }
+        }
+    }
 
-                /* Retrieve ID and artifact name */
-                cJSON *json_id = NULL;
-                if (NULL == (json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id"))) {
-                    mender_log_error("Unable to get ID from the deployment data");
-                    goto END;
-                }
-                char *id;
-                if (NULL == (id = cJSON_GetStringValue(json_id))) {
-                    mender_log_error("Unable to get ID from the deployment data");
-                    goto END;
-                }
-                cJSON *json_artifact_name = NULL;
-                if (NULL == (json_artifact_name = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "artifact_name"))) {
-                    mender_log_error("Unable to get artifact name from the deployment data");
-                    goto END;
-                }
-                char *artifact_name;
-                if (NULL == (artifact_name = cJSON_GetStringValue(json_artifact_name))) {
-                    mender_log_error("Unable to get artifact name from the deployment data");
-                    goto END;
-                }
+    /* Content is not supported by the mender-mcu-client */
+    if (NULL == mender_client_download_payload.artifact_type) {
+        mender_log_error("Unable to handle artifact type '%s'", type);
+        return MENDER_FAIL;
+    }
 
-                /* Invoke artifact type callback */
-                if (MENDER_OK
-                    != (ret = mender_client_artifact_types_list[artifact_type_index]->callback(
-                            id, artifact_name, type, meta_data, filename, size, data, index, length))) {
-                    mender_log_error("An error occurred while processing data of the artifact '%s'", type);
-                    goto END;
-                }
+    /* Add type to the deployment data */
+    if (NULL == (json_types = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "types"))) {
+        mender_log_error("Unable to add type to the deployment data");
+        return MENDER_FAIL;
+    }
+    bool   found     = false;
+    cJSON *json_type = NULL;
+    cJSON_ArrayForEach(json_type, json_types) {
+        if (!strcmp(type, cJSON_GetStringValue(json_type))) {
+            found = true;
+        }
+    }
+    if (false == found) {
+        cJSON_AddItemToArray(json_types, cJSON_CreateString(type));
+    }
 
-                /* Treatments related to the artifact type (once) */
-                if (0 == index) {
+    /* Set flags */
+    if (true == mender_client_download_payload.artifact_type->needs_restart) {
+        mender_client_deployment_needs_restart = true;
+    }
 
-                    /* Add type to the deployment data */
-                    if (NULL == (json_types = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "types"))) {
-                        mender_log_error("Unable to add type to the deployment data");
-                        ret = MENDER_FAIL;
-                        goto END;
-                    }
-                    bool   found     = false;
-                    cJSON *json_type = NULL;
-                    cJSON_ArrayForEach(json_type, json_types) {
-                        if (!strcmp(type, cJSON_GetStringValue(json_type))) {
-                            found = true;
-                        }
-                    }
-                    if (false == found) {
-                        cJSON_AddItemToArray(json_types, cJSON_CreateString(type));
-                    }
+#ifdef CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS
+    /* Select the payload worker handling the artifact type, the meta-data are copied with the first data submitted */
+    mender_client_download_payload.worker = mender_client_payload_worker_get(mender_client_download_payload.artifact_type);
 
-                    /* Set flags */
-                    if (true == mender_client_artifact_types_list[artifact_type_index]->needs_restart) {
-                        mender_client_deployment_needs_restart = true;
-                    }
-                }
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS */
 
-                goto END;
-            }
+    /* The payload is resolved */
+    mender_client_download_payload.type = type;
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
+
+static mender_err_t
+mender_client_check_artifact_callback(char *type, cJSON *meta_data, char *filename, size_t size) {
+
+    assert(NULL != type);
+    (void)meta_data;
+    mender_err_t ret;
+    bool         found = false;
+    bool         flash = false;
+    size_t       capacity;
+
+    /* Check if the artifact type is supported and if it is written to the flash, the artifact types registry is sealed */
+    for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
+        if (!strcmp(type, mender_client_artifact_types_list[artifact_type_index]->type)) {
+            found = true;
+            flash = (&mender_client_download_artifact_flash_callback == mender_client_artifact_types_list[artifact_type_index]->callback);
+            break;
         }
     }
 
     /* Content is not supported by the mender-mcu-client */
-    mender_log_error("Unable to handle artifact type '%s'", type);
-    ret = MENDER_FAIL;
+    if (false == found) {
+        mender_log_error("Unable to handle artifact type '%s'", type);
+        return MENDER_FAIL;
+    }
 
-END:
+    /* Check the size of the image against the capacity of the update partition, if it is known */
+    if ((NULL != filename) && (true == flash)) {
+        if (MENDER_OK == (ret = mender_flash_get_capacity(&capacity))) {
+            if (size > capacity) {
+                mender_log_error("Artifact '%s' with size %d exceeds the capacity of the update partition %d", filename, size, capacity);
+                return MENDER_FAIL;
+            }
+        } else if (MENDER_NOT_IMPLEMENTED != ret) {
+            mender_log_error("Unable to get the capacity of the update partition");
+            return ret;
+        }
+    }
 
-    /* Release mutex used to protect access to the artifact types management list */
-    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+    return MENDER_OK;
+}
 
-    return ret;
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+
+static bool
+mender_client_artifact_meta_data_filter(char *type, char *key) {
+
+    assert(NULL != type);
+    assert(NULL != key);
+    bool needed = false;
+
+    /* Check if the key is needed to handle the artifact type, meta-data of unsupported artifact types are not needed, the artifact types registry is sealed */
+    for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
+        if (!strcmp(type, mender_client_artifact_types_list[artifact_type_index]->type)) {
+            char **meta_data_keys = mender_client_artifact_types_list[artifact_type_index]->meta_data_keys;
+            needed                = (NULL == meta_data_keys);
+            for (size_t index = 0; (false == needed) && (NULL != meta_data_keys[index]); index++) {
+                needed = !strcmp(key, meta_data_keys[index]);
+            }
+            break;
+        }
+    }
+
+    return needed;
 }
 
 static mender_err_t
@@ -1130,26 +3242,61 @@ mender_client_download_artifact_flash_callback(
         if (0 == index) {
 
             /* Open the flash handle */
-            if (MENDER_OK != (ret = mender_flash_open(filename, size, &mender_client_flash_handle))) {
+            if (MENDER_OK != (ret = mender_client_flash_open(filename, size))) {
                 mender_log_error("Unable to open flash handle");
                 goto END;
             }
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+            /* Start the flash pipeline */
+            if (MENDER_OK != (ret = mender_client_flash_pipeline_start())) {
+                mender_log_error("Unable to start flash pipeline");
+                goto END;
+            }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+            /* Begin the install checkpoints of the file */
+            mender_client_install_checkpoint_begin(id, size);
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
         }
 
         /* Write data */
-        if (MENDER_OK != (ret = mender_flash_write(mender_client_flash_handle, data, index, length))) {
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+        if (MENDER_OK != (ret = mender_client_flash_pipeline_write(data, index, length))) {
+#else
+        if (MENDER_OK != (ret = mender_client_flash_write(data, index, length))) {
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
             mender_log_error("Unable to write data to flash");
             goto END;
         }
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+        /* Save the progress of the image periodically */
+        mender_client_install_checkpoint_save();
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
 
         /* Check if the flash handle must be closed */
         if (index + length >= size) {
 
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+            /* Wait for the data to be written */
+            if (MENDER_OK != (ret = mender_client_flash_pipeline_stop())) {
+                mender_log_error("Unable to write data to flash");
+                goto END;
+            }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
             /* Close the flash handle */
-            if (MENDER_OK != (ret = mender_flash_close(mender_client_flash_handle))) {
+            if (MENDER_OK != (ret = mender_client_flash_close())) {
                 mender_log_error("Unable to close flash handle");
                 goto END;
             }
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+            /* The image is complete, it is not resumed anymore */
+            mender_client_install_checkpoint_release();
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
         }
     }
 
@@ -1158,6 +3305,13 @@ mender_client_download_artifact_flash_callback(
 
 END:
 
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+    /* Stop the flash pipeline on error */
+    if (MENDER_OK != ret) {
+        mender_client_flash_pipeline_stop();
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
     return ret;
 }
 
@@ -1167,8 +3321,33 @@ mender_client_publish_deployment_status(char *id, mender_deployment_status_t dep
     assert(NULL != id);
     mender_err_t ret;
 
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+    /* Publish the logs captured before the failure status, the deployment is still in progress for the server then */
+    if (MENDER_DEPLOYMENT_STATUS_FAILURE == deployment_status) {
+        mender_log_capture_stop();
+        if (MENDER_OK != mender_api_publish_deployment_logs(id)) {
+            mender_log_warning("Unable to publish the logs of the deployment");
+        }
+    }
+    /* Release the logs captured when the deployment has finished or the device is restarting, they are lost when the device restarts */
+    if ((MENDER_DEPLOYMENT_STATUS_SUCCESS == deployment_status) || (MENDER_DEPLOYMENT_STATUS_FAILURE == deployment_status)
+        || (MENDER_DEPLOYMENT_STATUS_REBOOTING == deployment_status) || (MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED == deployment_status)) {
+        mender_log_capture_release();
+    }
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+    /* Queue status, it is published asynchronously */
+    ret = mender_client_status_queue_push(id, deployment_status);
+#else
     /* Publish status to the mender server */
     ret = mender_api_publish_deployment_status(id, deployment_status);
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
+
+    /* The next check for deployment is performed sooner when the deployment has finished */
+    if ((MENDER_DEPLOYMENT_STATUS_SUCCESS == deployment_status) || (MENDER_DEPLOYMENT_STATUS_FAILURE == deployment_status)) {
+        mender_client_deployment_finished = true;
+    }
 
     /* Invoke deployment status callback if defined */
     if (NULL != mender_client_callbacks.deployment_status) {
@@ -1177,3 +3356,206 @@ mender_client_publish_deployment_status(char *id, mender_deployment_status_t dep
 
     return ret;
 }
+
+#ifdef CONFIG_MENDER_CLIENT_STAGING
+
+static mender_err_t
+mender_client_download_artifact_staged(char *uri) {
+
+    assert(NULL != uri);
+    mender_err_t ret;
+
+    /* Open the staging area, it is kept if the interrupted download is resumed */
+    if ((NULL == mender_client_staging.handle) || (0 == mender_api_get_artifact_download_offset())) {
+        mender_client_staging_release();
+        char *key = mender_client_get_artifact_key(uri);
+        if (NULL == key) {
+            mender_log_error("Unable to allocate memory");
+            mender_api_cancel_artifact_download();
+            return MENDER_FAIL;
+        }
+        ret = mender_flash_open_staging(key, &mender_client_staging.handle);
+        mender_free(key);
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to open staging area");
+            mender_client_staging.handle = NULL;
+            mender_api_cancel_artifact_download();
+            return ret;
+        }
+        mender_client_staging.length = 0;
+    }
+
+    /* Download the artifact to the staging area at the speed of the network */
+    if (MENDER_OK != (ret = mender_api_stage_artifact(uri, &mender_client_staging_write_callback))) {
+        if (0 == mender_api_get_artifact_download_offset()) {
+            mender_client_staging_release();
+        }
+        return ret;
+    }
+
+    /* Process the artifact from the staging area, the connection has been released */
+    mender_log_info("Artifact of %zu bytes staged, processing it", mender_client_staging.length);
+    if (MENDER_OK != (ret = mender_flash_close_staging(mender_client_staging.handle))) {
+        mender_log_error("Unable to close staging area");
+        goto END;
+    }
+    if (MENDER_OK
+        != (ret = mender_api_process_staged_artifact(
+                mender_client_staging.length, &mender_client_staging_read_callback, &mender_client_download_artifact_callback))) {
+        mender_log_error("Unable to process staged artifact");
+        goto END;
+    }
+
+END:
+
+    /* Release the staging area */
+    mender_client_staging_release();
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_staging_write_callback(void *data, size_t index, size_t length) {
+
+    mender_err_t ret;
+
+#ifdef CONFIG_MENDER_CLIENT_ABORT_CHECK
+    /* Stop the download if the deployment has been aborted by the server */
+    if (true == __atomic_load_n(&mender_client_abort_check.aborted, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Deployment has been aborted by the server, stopping the download");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_ABORT_CHECK */
+
+    /* Write data to the staging area */
+    if (MENDER_OK != (ret = mender_flash_write_staging(mender_client_staging.handle, data, index, length))) {
+        mender_log_error("Unable to write data to the staging area");
+        return ret;
+    }
+    mender_client_staging.length = index + length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_staging_read_callback(void *data, size_t index, size_t length) {
+
+    /* Read data from the staging area */
+    return mender_flash_read_staging(mender_client_staging.handle, data, index, length);
+}
+
+static void
+mender_client_staging_release(void) {
+
+    /* Release the staging area */
+    if (NULL != mender_client_staging.handle) {
+        mender_flash_release_staging(mender_client_staging.handle);
+        mender_client_staging.handle = NULL;
+    }
+    mender_client_staging.length = 0;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_STAGING */
+
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+
+static mender_err_t
+mender_client_download_artifact_delta_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    (void)id;
+    (void)artifact_name;
+    (void)type;
+    (void)meta_data;
+    mender_err_t ret = MENDER_OK;
+
+    /* Check if the filename is provided */
+    if (NULL != filename) {
+
+        /* Check if the flash handle and the patch handle must be opened */
+        if (0 == index) {
+
+            /* Release the previous patch if any */
+            mender_client_delta_release();
+
+            /* Open the flash handle */
+            if (MENDER_OK != (ret = mender_client_flash_open(filename, size))) {
+                mender_log_error("Unable to open flash handle");
+                goto END;
+            }
+
+            /* Begin application of the patch to the running image */
+            if (MENDER_OK
+                != (ret = mender_delta_begin(&mender_client_delta_read, &mender_client_delta_write, NULL, &mender_client_delta_handle))) {
+                mender_log_error("Unable to begin application of the patch");
+                goto END;
+            }
+        }
+
+        /* Apply data, the patched image is written to the flash */
+        if (MENDER_OK != (ret = mender_delta_process(mender_client_delta_handle, data, length))) {
+            mender_log_error("Unable to apply the patch");
+            goto END;
+        }
+
+        /* Check if the patch and the flash handle must be closed */
+        if (index + length >= size) {
+
+            /* Check the patched image is complete */
+            ret                        = mender_delta_end(mender_client_delta_handle);
+            mender_client_delta_handle = NULL;
+            if (MENDER_OK != ret) {
+                mender_log_error("Unable to apply the patch, the patched image is not complete");
+                goto END;
+            }
+
+            /* Close the flash handle */
+            if (MENDER_OK != (ret = mender_client_flash_close())) {
+                mender_log_error("Unable to close flash handle");
+                goto END;
+            }
+        }
+    }
+
+    /* Set flags */
+    mender_client_deployment_needs_set_pending_image = true;
+
+END:
+
+    /* Release the patch on error */
+    if (MENDER_OK != ret) {
+        mender_client_delta_release();
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_delta_read(void *data, size_t index, size_t length, void *params) {
+
+    (void)params;
+
+    /* Read the running image */
+    return mender_flash_read_running_image(data, index, length);
+}
+
+static mender_err_t
+mender_client_delta_write(void *data, size_t index, size_t length, void *params) {
+
+    (void)params;
+
+    /* Write the patched image */
+    return mender_client_flash_write(data, index, length);
+}
+
+static void
+mender_client_delta_release(void) {
+
+    /* Release the patch handle */
+    if (NULL != mender_client_delta_handle) {
+        mender_delta_end(mender_client_delta_handle);
+        mender_client_delta_handle = NULL;
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
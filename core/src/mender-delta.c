@@ -0,0 +1,271 @@
+/**
+ * @file      mender-delta.c
+ * @brief     Mender delta patch interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_ARTIFACT
+
+#include "mender-delta.h"
+#include "mender-log.h"
+
+/**
+ * @brief Magic of the patch header
+ */
+#define MENDER_DELTA_MAGIC "ENDSLEY/BSDIFF43"
+
+/**
+ * @brief Length of the patch header and of the control blocks
+ */
+#define MENDER_DELTA_BLOCK_LENGTH (24)
+
+/**
+ * @brief Patch states
+ */
+typedef enum {
+    MENDER_DELTA_STATE_HEADER,  /**< Waiting for the header */
+    MENDER_DELTA_STATE_CONTROL, /**< Waiting for a control block */
+    MENDER_DELTA_STATE_DIFF,    /**< Parsing a diff block, the data are added to the base image */
+    MENDER_DELTA_STATE_EXTRA,   /**< Parsing an extra block, the data are copied */
+    MENDER_DELTA_STATE_END      /**< The patched image is complete */
+} mender_delta_state_t;
+
+/**
+ * @brief Patch handle
+ */
+typedef struct {
+    mender_err_t (*read)(void *, size_t, size_t, void *);         /**< Function invoked to read the base image */
+    mender_err_t (*write)(void *, size_t, size_t, void *);        /**< Function invoked to write the patched image */
+    void                *params;                                  /**< Parameters of the functions */
+    mender_delta_state_t state;                                   /**< Current state */
+    uint8_t              block[MENDER_DELTA_BLOCK_LENGTH];        /**< Header or control block being received */
+    size_t               block_length;                            /**< Length of the block received */
+    size_t               new_size;                                /**< Size of the patched image */
+    size_t               new_position;                            /**< Position in the patched image */
+    size_t               old_position;                            /**< Position in the base image */
+    size_t               remaining;                               /**< Length remaining in the current diff or extra block */
+    size_t               extra_length;                            /**< Length of the next extra block */
+    int64_t              seek;                                    /**< Offset applied to the position in the base image after the extra block */
+    uint8_t              buffer[CONFIG_MENDER_DELTA_BUFFER_SIZE]; /**< Buffer used to read the base image */
+} mender_delta_handle_t;
+
+/**
+ * @brief Decode a signed 64 bits integer of the patch
+ * @param data Data, 8 bytes in little endian with the sign in the most significant bit
+ * @return Value
+ */
+static int64_t mender_delta_decode_int64(uint8_t *data);
+
+/**
+ * @brief Parse the header or the control block received
+ * @param handle Patch handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_delta_parse_block(mender_delta_handle_t *handle);
+
+/**
+ * @brief Move to the next block if the current diff or extra block is complete
+ * @param handle Patch handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_delta_next_block(mender_delta_handle_t *handle);
+
+mender_err_t
+mender_delta_begin(mender_err_t (*read)(void *, size_t, size_t, void *), mender_err_t (*write)(void *, size_t, size_t, void *), void *params, void **handle) {
+
+    assert(NULL != read);
+    assert(NULL != write);
+    assert(NULL != handle);
+
+    /* Allocate memory to store the patch handle */
+    if (NULL == (*handle = mender_calloc(1, sizeof(mender_delta_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    ((mender_delta_handle_t *)*handle)->read   = read;
+    ((mender_delta_handle_t *)*handle)->write  = write;
+    ((mender_delta_handle_t *)*handle)->params = params;
+    ((mender_delta_handle_t *)*handle)->state  = MENDER_DELTA_STATE_HEADER;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_delta_process(void *handle, void *data, size_t length) {
+
+    assert(NULL != handle);
+    assert((NULL != data) || (0 == length));
+    mender_delta_handle_t *delta = (mender_delta_handle_t *)handle;
+    mender_err_t           ret;
+    size_t                 chunk;
+
+    /* Treatment of the data depending of the current state */
+    while (0 != length) {
+        switch (delta->state) {
+            case MENDER_DELTA_STATE_HEADER:
+            case MENDER_DELTA_STATE_CONTROL:
+                /* Copy the data to the block */
+                chunk = (MENDER_DELTA_BLOCK_LENGTH - delta->block_length < length) ? (MENDER_DELTA_BLOCK_LENGTH - delta->block_length) : length;
+                memcpy(&delta->block[delta->block_length], data, chunk);
+                delta->block_length += chunk;
+                if (MENDER_DELTA_BLOCK_LENGTH == delta->block_length) {
+                    if (MENDER_OK != (ret = mender_delta_parse_block(delta))) {
+                        return ret;
+                    }
+                }
+                break;
+            case MENDER_DELTA_STATE_DIFF:
+                /* Add the data to the base image */
+                chunk = (delta->remaining < length) ? delta->remaining : length;
+                chunk = (chunk < CONFIG_MENDER_DELTA_BUFFER_SIZE) ? chunk : CONFIG_MENDER_DELTA_BUFFER_SIZE;
+                if (MENDER_OK != (ret = delta->read(delta->buffer, delta->old_position, chunk, delta->params))) {
+                    mender_log_error("Unable to read the base image");
+                    return ret;
+                }
+                for (size_t index = 0; index < chunk; index++) {
+                    delta->buffer[index] += ((uint8_t *)data)[index];
+                }
+                if (MENDER_OK != (ret = delta->write(delta->buffer, delta->new_position, chunk, delta->params))) {
+                    mender_log_error("Unable to write the patched image");
+                    return ret;
+                }
+                delta->old_position += chunk;
+                delta->new_position += chunk;
+                delta->remaining -= chunk;
+                if (MENDER_OK != (ret = mender_delta_next_block(delta))) {
+                    return ret;
+                }
+                break;
+            case MENDER_DELTA_STATE_EXTRA:
+                /* Copy the data to the patched image */
+                chunk = (delta->remaining < length) ? delta->remaining : length;
+                if (MENDER_OK != (ret = delta->write(data, delta->new_position, chunk, delta->params))) {
+                    mender_log_error("Unable to write the patched image");
+                    return ret;
+                }
+                delta->new_position += chunk;
+                delta->remaining -= chunk;
+                if (MENDER_OK != (ret = mender_delta_next_block(delta))) {
+                    return ret;
+                }
+                break;
+            default:
+                /* The patched image is already complete */
+                mender_log_error("Invalid patch, unexpected data after the end of the patched image");
+                return MENDER_FAIL;
+        }
+        data = (uint8_t *)data + chunk;
+        length -= chunk;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_delta_end(void *handle) {
+
+    mender_err_t ret = MENDER_OK;
+
+    /* Check the patched image is complete */
+    if (NULL != handle) {
+        if (MENDER_DELTA_STATE_END != ((mender_delta_handle_t *)handle)->state) {
+            mender_log_error("Invalid patch, the patched image is not complete");
+            ret = MENDER_FAIL;
+        }
+        mender_free(handle);
+    }
+
+    return ret;
+}
+
+static int64_t
+mender_delta_decode_int64(uint8_t *data) {
+
+    assert(NULL != data);
+    int64_t value = data[7] & 0x7F;
+
+    /* Decode the magnitude then apply the sign */
+    for (int index = 6; index >= 0; index--) {
+        value = (value << 8) | data[index];
+    }
+
+    return (0 != (data[7] & 0x80)) ? -value : value;
+}
+
+static mender_err_t
+mender_delta_parse_block(mender_delta_handle_t *handle) {
+
+    assert(NULL != handle);
+    int64_t value;
+
+    /* Parse the block depending of the current state */
+    handle->block_length = 0;
+    if (MENDER_DELTA_STATE_HEADER == handle->state) {
+        /* Check the magic and retrieve the size of the patched image */
+        if (0 != memcmp(handle->block, MENDER_DELTA_MAGIC, strlen(MENDER_DELTA_MAGIC))) {
+            mender_log_error("Invalid patch, unsupported format");
+            return MENDER_FAIL;
+        }
+        if ((value = mender_delta_decode_int64(&handle->block[16])) < 0) {
+            mender_log_error("Invalid patch, invalid size of the patched image");
+            return MENDER_FAIL;
+        }
+        handle->new_size = (size_t)value;
+        handle->state    = (0 == handle->new_size) ? MENDER_DELTA_STATE_END : MENDER_DELTA_STATE_CONTROL;
+        return MENDER_OK;
+    }
+
+    /* Retrieve the lengths of the diff and extra blocks and the offset applied to the position in the base image, the blocks must fit in the patched image */
+    int64_t diff_length  = mender_delta_decode_int64(&handle->block[0]);
+    int64_t extra_length = mender_delta_decode_int64(&handle->block[8]);
+    handle->seek         = mender_delta_decode_int64(&handle->block[16]);
+    if ((diff_length < 0) || (extra_length < 0) || ((uint64_t)diff_length + (uint64_t)extra_length > handle->new_size - handle->new_position)) {
+        mender_log_error("Invalid patch, invalid control block");
+        return MENDER_FAIL;
+    }
+    handle->remaining    = (size_t)diff_length;
+    handle->extra_length = (size_t)extra_length;
+    handle->state        = MENDER_DELTA_STATE_DIFF;
+
+    return mender_delta_next_block(handle);
+}
+
+static mender_err_t
+mender_delta_next_block(mender_delta_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Move to the extra block when the diff block is complete */
+    if ((MENDER_DELTA_STATE_DIFF == handle->state) && (0 == handle->remaining)) {
+        handle->remaining = handle->extra_length;
+        handle->state     = MENDER_DELTA_STATE_EXTRA;
+    }
+
+    /* Move to the next control block when the extra block is complete, the position in the base image must remain valid */
+    if ((MENDER_DELTA_STATE_EXTRA == handle->state) && (0 == handle->remaining)) {
+        if ((handle->seek < 0) && ((uint64_t)(-handle->seek) > handle->old_position)) {
+            mender_log_error("Invalid patch, invalid position in the base image");
+            return MENDER_FAIL;
+        }
+        handle->old_position = (size_t)((int64_t)handle->old_position + handle->seek);
+        handle->state        = (handle->new_position == handle->new_size) ? MENDER_DELTA_STATE_END : MENDER_DELTA_STATE_CONTROL;
+    }
+
+    return MENDER_OK;
+}
@@ -0,0 +1,360 @@
+/**
+ * @file      mender-file.c
+ * @brief     Mender file artifact type implementation, the files of the payload are installed in a directory of a filesystem
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE
+
+#include "mender-file.h"
+#include "mender-log.h"
+
+#ifdef CONFIG_MENDER_FILE
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Suffix of the temporary files
+ */
+#define MENDER_FILE_TEMPORARY_SUFFIX ".tmp"
+
+/**
+ * @brief File being installed
+ */
+static struct {
+    char    *path;      /**< Path of the installed file, NULL if no file is being installed */
+    char    *temporary; /**< Path of the temporary file */
+    int      fd;        /**< Temporary file descriptor, -1 if not opened */
+    int      installed; /**< Installed file descriptor, -1 if the content is not compared to the installed file */
+    uint8_t *buffer;    /**< Buffer used to write the temporary file and to read the installed file */
+    size_t   length;    /**< Length of the data in the buffer */
+    size_t   index;     /**< Index of the next data expected */
+} mender_file = { .path = NULL, .temporary = NULL, .fd = -1, .installed = -1, .buffer = NULL, .length = 0, .index = 0 };
+
+/**
+ * @brief Begin the installation of a file
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_file_begin(cJSON *meta_data, char *filename, size_t size);
+
+/**
+ * @brief Compare data with the installed file, the comparison is stopped and the temporary file is written from then if they differ
+ * @param data Data
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_file_compare(void *data, size_t length);
+
+/**
+ * @brief Write data to the temporary file, the data are gathered in the buffer so that the file is written by blocks
+ * @param data Data
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_file_write(void *data, size_t length);
+
+/**
+ * @brief Write the data gathered in the buffer to the temporary file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_file_flush(void);
+
+/**
+ * @brief End the installation of a file, the temporary file is synchronized and renamed over the installed file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_file_end(void);
+
+/**
+ * @brief Release the file being installed, the temporary file is removed if it still exists
+ */
+static void mender_file_release(void);
+
+mender_err_t
+mender_file_artifact_type_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    (void)id;
+    (void)artifact_name;
+    (void)type;
+    mender_err_t ret;
+
+    /* Beginning of the payload, a file which has not been completed is dropped */
+    if (NULL == filename) {
+        mender_file_release();
+        return MENDER_OK;
+    }
+
+    /* Beginning of a file */
+    if (0 == index) {
+        mender_file_release();
+        if (MENDER_OK != (ret = mender_file_begin(meta_data, filename, size))) {
+            goto FAIL;
+        }
+    }
+
+    /* Check the data are following the ones already received, the file is lost otherwise */
+    if ((NULL == mender_file.path) || (index != mender_file.index)) {
+        mender_log_error("Unexpected data of the file '%s' at index %zu", filename, index);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Compare or write the data */
+    if (-1 != mender_file.installed) {
+        ret = mender_file_compare(data, length);
+    } else {
+        ret = mender_file_write(data, length);
+    }
+    if (MENDER_OK != ret) {
+        goto FAIL;
+    }
+    mender_file.index += length;
+
+    /* End of the file */
+    if (mender_file.index >= size) {
+        if (MENDER_OK != (ret = mender_file_end())) {
+            goto FAIL;
+        }
+        mender_file_release();
+    }
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release the file being installed */
+    mender_file_release();
+
+    return ret;
+}
+
+static mender_err_t
+mender_file_begin(cJSON *meta_data, char *filename, size_t size) {
+
+    assert(NULL != filename);
+    char *directory = CONFIG_MENDER_FILE_DIRECTORY;
+
+    /* The files must be installed in the directory */
+    if (('\0' == *filename) || (NULL != strchr(filename, '/')) || (!strcmp(filename, ".")) || (!strcmp(filename, ".."))) {
+        mender_log_error("Invalid file name '%s'", filename);
+        return MENDER_FAIL;
+    }
+
+    /* Retrieve the directory from the meta-data */
+    cJSON *json_dest_dir = cJSON_GetObjectItemCaseSensitive(meta_data, "dest_dir");
+    if (cJSON_IsString(json_dest_dir)) {
+        directory = cJSON_GetStringValue(json_dest_dir);
+    }
+
+    /* Compute the paths */
+    size_t str_length = strlen(directory) + strlen("/") + strlen(filename) + 1;
+    if ((NULL == (mender_file.path = (char *)mender_malloc(str_length)))
+        || (NULL == (mender_file.temporary = (char *)mender_malloc(str_length + strlen(MENDER_FILE_TEMPORARY_SUFFIX))))
+        || (NULL == (mender_file.buffer = (uint8_t *)mender_malloc(CONFIG_MENDER_FILE_BUFFER_SIZE)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    snprintf(mender_file.path, str_length, "%s/%s", directory, filename);
+    snprintf(mender_file.temporary, str_length + strlen(MENDER_FILE_TEMPORARY_SUFFIX), "%s%s", mender_file.path, MENDER_FILE_TEMPORARY_SUFFIX);
+    mender_file.length = 0;
+    mender_file.index  = 0;
+
+#ifdef CONFIG_MENDER_FILE_SKIP_UNCHANGED
+    /* Compare the content with the installed file if it has the same size, nothing is written if it is identical */
+    struct stat st;
+    if ((0 == stat(mender_file.path, &st)) && ((size_t)st.st_size == size)) {
+        if (-1 != (mender_file.installed = open(mender_file.path, O_RDONLY))) {
+            return MENDER_OK;
+        }
+    }
+
+#else
+    (void)size;
+
+#endif /* CONFIG_MENDER_FILE_SKIP_UNCHANGED */
+    /* Open the temporary file */
+    if (-1 == (mender_file.fd = open(mender_file.temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644))) {
+        mender_log_error("Unable to open file '%s'", mender_file.temporary);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_file_compare(void *data, size_t length) {
+
+    assert(NULL != data);
+    size_t offset = 0;
+    size_t remaining;
+
+    /* Compare the data with the installed file by blocks */
+    while (offset < length) {
+        size_t block = ((length - offset) < CONFIG_MENDER_FILE_BUFFER_SIZE) ? (length - offset) : CONFIG_MENDER_FILE_BUFFER_SIZE;
+        if (((ssize_t)block != read(mender_file.installed, mender_file.buffer, block))
+            || (0 != memcmp(mender_file.buffer, (uint8_t *)data + offset, block))) {
+            break;
+        }
+        offset += block;
+    }
+    if (offset == length) {
+        return MENDER_OK;
+    }
+
+    /* The content differs, the temporary file is written with the part of the installed file already compared */
+    if (-1 == (mender_file.fd = open(mender_file.temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644))) {
+        mender_log_error("Unable to open file '%s'", mender_file.temporary);
+        return MENDER_FAIL;
+    }
+    if (0 != lseek(mender_file.installed, 0, SEEK_SET)) {
+        mender_log_error("Unable to read file '%s'", mender_file.path);
+        return MENDER_FAIL;
+    }
+    remaining = mender_file.index;
+    while (0 < remaining) {
+        size_t block = (remaining < CONFIG_MENDER_FILE_BUFFER_SIZE) ? remaining : CONFIG_MENDER_FILE_BUFFER_SIZE;
+        if ((ssize_t)block != read(mender_file.installed, mender_file.buffer, block)) {
+            mender_log_error("Unable to read file '%s'", mender_file.path);
+            return MENDER_FAIL;
+        }
+        mender_file.length = block;
+        if (MENDER_OK != mender_file_flush()) {
+            return MENDER_FAIL;
+        }
+        remaining -= block;
+    }
+    close(mender_file.installed);
+    mender_file.installed = -1;
+
+    return mender_file_write(data, length);
+}
+
+static mender_err_t
+mender_file_write(void *data, size_t length) {
+
+    assert(NULL != data);
+    mender_err_t ret;
+
+    /* Gather the data in the buffer, it is written once full */
+    while (0 < length) {
+        size_t block = ((CONFIG_MENDER_FILE_BUFFER_SIZE - mender_file.length) < length) ? (CONFIG_MENDER_FILE_BUFFER_SIZE - mender_file.length) : length;
+        memcpy(&mender_file.buffer[mender_file.length], data, block);
+        mender_file.length += block;
+        data                = (uint8_t *)data + block;
+        length             -= block;
+        if (CONFIG_MENDER_FILE_BUFFER_SIZE == mender_file.length) {
+            if (MENDER_OK != (ret = mender_file_flush())) {
+                return ret;
+            }
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_file_flush(void) {
+
+    size_t  offset = 0;
+    ssize_t count;
+
+    /* Write the buffer, the writes may be partial */
+    while (offset < mender_file.length) {
+        if ((count = write(mender_file.fd, &mender_file.buffer[offset], mender_file.length - offset)) <= 0) {
+            mender_log_error("Unable to write file '%s'", mender_file.temporary);
+            return MENDER_FAIL;
+        }
+        offset += (size_t)count;
+    }
+    mender_file.length = 0;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_file_end(void) {
+
+    mender_err_t ret;
+
+    /* Nothing is written if the content is identical to the installed file */
+    if (-1 != mender_file.installed) {
+        mender_log_info("File '%s' is unchanged", mender_file.path);
+        return MENDER_OK;
+    }
+
+    /* Write the remaining data and synchronize the temporary file, this is done once for the file */
+    if (MENDER_OK != (ret = mender_file_flush())) {
+        return ret;
+    }
+    if (0 != fsync(mender_file.fd)) {
+        mender_log_error("Unable to synchronize file '%s'", mender_file.temporary);
+        return MENDER_FAIL;
+    }
+    close(mender_file.fd);
+    mender_file.fd = -1;
+
+    /* Rename the temporary file over the installed file, the installed file is removed first on filesystems which do not replace it (FAT) */
+    if (0 != rename(mender_file.temporary, mender_file.path)) {
+        unlink(mender_file.path);
+        if (0 != rename(mender_file.temporary, mender_file.path)) {
+            mender_log_error("Unable to rename file '%s'", mender_file.temporary);
+            return MENDER_FAIL;
+        }
+    }
+    mender_log_info("File '%s' installed", mender_file.path);
+
+    return MENDER_OK;
+}
+
+static void
+mender_file_release(void) {
+
+    /* Close the files and remove the temporary file */
+    if (-1 != mender_file.installed) {
+        close(mender_file.installed);
+        mender_file.installed = -1;
+    }
+    if (-1 != mender_file.fd) {
+        close(mender_file.fd);
+        mender_file.fd = -1;
+    }
+    if (NULL != mender_file.temporary) {
+        unlink(mender_file.temporary);
+        mender_free(mender_file.temporary);
+        mender_file.temporary = NULL;
+    }
+    if (NULL != mender_file.path) {
+        mender_free(mender_file.path);
+        mender_file.path = NULL;
+    }
+    if (NULL != mender_file.buffer) {
+        mender_free(mender_file.buffer);
+        mender_file.buffer = NULL;
+    }
+    mender_file.length = 0;
+    mender_file.index  = 0;
+}
+
+#endif /* CONFIG_MENDER_FILE */
@@ -0,0 +1,177 @@
+/**
+ * @file      mender-http-gzip.c
+ * @brief     Mender HTTP request body gzip compression interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
+#include "mender-http-gzip.h"
+#include "mender-log.h"
+#ifdef CONFIG_MENDER_HTTP_GZIP
+#include <zlib.h>
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+
+/**
+ * @brief Default gzip window size (base two logarithm of the window size in bytes)
+ * @note The bodies are small JSON documents, a small window compresses them almost as well as the default one
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS
+#define CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS (10)
+#endif /* CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS */
+
+/**
+ * @brief Default gzip memory level, from 1 (minimum memory) to 9 (maximum speed)
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_MEM_LEVEL
+#define CONFIG_MENDER_HTTP_GZIP_MEM_LEVEL (2)
+#endif /* CONFIG_MENDER_HTTP_GZIP_MEM_LEVEL */
+
+/**
+ * @brief Length of the buffer receiving the compressed data before they are written
+ */
+#define MENDER_HTTP_GZIP_BUFFER_LENGTH (256)
+
+/**
+ * @brief Compression context
+ */
+typedef struct {
+    z_stream stream;                                 /**< zlib stream */
+    mender_err_t (*write)(void *, size_t, void *);   /**< Write function of the compressed data */
+    void    *ctx;                                    /**< Context of the write function */
+    uint8_t  buffer[MENDER_HTTP_GZIP_BUFFER_LENGTH]; /**< Buffer receiving the compressed data */
+} mender_http_gzip_context_t;
+
+/**
+ * @brief Compress data and write the compressed data once the buffer is full
+ * @param context Compression context
+ * @param flush Z_NO_FLUSH to compress the input data, Z_FINISH to complete the stream
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_gzip_deflate(mender_http_gzip_context_t *context, int flush);
+
+/**
+ * @brief Write function used to compress the body
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Compression context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_gzip_write(void *data, size_t length, void *ctx);
+
+mender_err_t
+mender_http_gzip_body_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+    assert(NULL != params);
+    mender_http_body_t         *body = (mender_http_body_t *)params;
+    mender_http_gzip_context_t *context;
+    mender_err_t                ret;
+
+    /* Create the compression context */
+    if (NULL == (context = (mender_http_gzip_context_t *)mender_malloc(sizeof(mender_http_gzip_context_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(context, 0, sizeof(mender_http_gzip_context_t));
+    context->write = write;
+    context->ctx   = ctx;
+
+    /* Adding 16 to the window bits permits to write gzip header and trailer */
+    if (Z_OK
+        != deflateInit2(&context->stream,
+                        Z_DEFAULT_COMPRESSION,
+                        Z_DEFLATED,
+                        CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS + 16,
+                        CONFIG_MENDER_HTTP_GZIP_MEM_LEVEL,
+                        Z_DEFAULT_STRATEGY)) {
+        mender_log_error("Unable to initialize gzip encoder");
+        mender_free(context);
+        return MENDER_FAIL;
+    }
+    context->stream.next_out  = (Bytef *)context->buffer;
+    context->stream.avail_out = (uInt)sizeof(context->buffer);
+
+    /* Compress the body while it is written, then complete the stream */
+    if (MENDER_OK != (ret = body->callback(&mender_http_gzip_write, context, body->params))) {
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_http_gzip_deflate(context, Z_FINISH))) {
+        goto END;
+    }
+
+    /* Write the remaining compressed data */
+    if (context->stream.avail_out < sizeof(context->buffer)) {
+        ret = write(context->buffer, sizeof(context->buffer) - context->stream.avail_out, ctx);
+    }
+
+END:
+
+    /* Release memory */
+    deflateEnd(&context->stream);
+    mender_free(context);
+
+    return ret;
+}
+
+static mender_err_t
+mender_http_gzip_deflate(mender_http_gzip_context_t *context, int flush) {
+
+    assert(NULL != context);
+    mender_err_t ret;
+    int          result;
+
+    /* Compress the input data, the buffer is written each time it is full */
+    do {
+        result = deflate(&context->stream, flush);
+        if ((Z_OK != result) && (Z_STREAM_END != result) && (Z_BUF_ERROR != result)) {
+            mender_log_error("Unable to compress data");
+            return MENDER_FAIL;
+        }
+        if (0 == context->stream.avail_out) {
+            if (MENDER_OK != (ret = context->write(context->buffer, sizeof(context->buffer), context->ctx))) {
+                return ret;
+            }
+            context->stream.next_out  = (Bytef *)context->buffer;
+            context->stream.avail_out = (uInt)sizeof(context->buffer);
+        }
+    } while (((Z_FINISH == flush) && (Z_STREAM_END != result)) || (0 != context->stream.avail_in));
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_http_gzip_write(void *data, size_t length, void *ctx) {
+
+    assert(NULL != ctx);
+    mender_http_gzip_context_t *context = (mender_http_gzip_context_t *)ctx;
+
+    /* Compress the data */
+    if (0 == length) {
+        return MENDER_OK;
+    }
+    context->stream.next_in  = (Bytef *)data;
+    context->stream.avail_in = (uInt)length;
+
+    return mender_http_gzip_deflate(context, Z_NO_FLUSH);
+}
+
+#endif /* CONFIG_MENDER_HTTP_GZIP */
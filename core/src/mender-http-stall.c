@@ -0,0 +1,59 @@
+/**
+ * @file      mender-http-stall.c
+ * @brief     Mender HTTP stall detection implementation, the transfers fail when the throughput is below a floor
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-http-stall.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+
+void
+mender_http_stall_init(mender_http_stall_t *stall) {
+
+    assert(NULL != stall);
+
+    /* Begin the first window */
+    stall->start  = mender_scheduler_get_uptime_us();
+    stall->length = 0;
+}
+
+mender_err_t
+mender_http_stall_check(mender_http_stall_t *stall, size_t length) {
+
+    assert(NULL != stall);
+    size_t   limit = CONFIG_MENDER_HTTP_LOW_SPEED_LIMIT;
+    uint64_t now;
+
+    /* Nothing to do if the throughput floor is disabled */
+    if (0 == limit) {
+        return MENDER_OK;
+    }
+
+    /* Check the throughput once the window has elapsed, the next window begins then */
+    stall->length += length;
+    now = mender_scheduler_get_uptime_us();
+    if (now - stall->start >= (uint64_t)CONFIG_MENDER_HTTP_LOW_SPEED_TIME * 1000000) {
+        if (stall->length < limit) {
+            mender_log_error("Transfer stalled, %zu bytes received in %u seconds", stall->length, (unsigned int)((now - stall->start) / 1000000));
+            return MENDER_FAIL;
+        }
+        stall->start  = now;
+        stall->length = 0;
+    }
+
+    return MENDER_OK;
+}
@@ -0,0 +1,658 @@
+/**
+ * @file      mender-json.c
+ * @brief     Mender streaming JSON reader interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_JSON
+
+#include "mender-json.h"
+#include "mender-log.h"
+
+/**
+ * @brief Length of the escape sequence following the backslash, the longest is an unicode escape sequence "uXXXX"
+ */
+#define MENDER_JSON_ESCAPE_LENGTH (5)
+
+/**
+ * @brief Key-store read from a JSON document, the lengths are computed by the first pass and the items are added by the second
+ */
+typedef struct {
+    mender_json_reader_t      *reader;         /**< JSON reader */
+    mender_keystore_builder_t *builder;        /**< Key-store builder, NULL during the first pass */
+    size_t                     length;         /**< Number of items */
+    size_t                     strings_length; /**< Length of the names and values of the items */
+} mender_json_keystore_t;
+
+/**
+ * @brief Parse a character of the JSON document
+ * @param reader JSON reader
+ * @param c Character
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_parse(mender_json_reader_t *reader, char c);
+
+/**
+ * @brief Parse a character of an escape sequence of a string
+ * @param reader JSON reader
+ * @param c Character
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_parse_escape(mender_json_reader_t *reader, char c);
+
+/**
+ * @brief End parsing of a string, the string is either a key or a value
+ * @param reader JSON reader
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_end_string(mender_json_reader_t *reader);
+
+/**
+ * @brief End parsing of a number, true, false or null
+ * @param reader JSON reader
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_end_literal(mender_json_reader_t *reader);
+
+/**
+ * @brief End parsing of a value, the next state depends of the current container
+ * @param reader JSON reader
+ */
+static void mender_json_reader_end_value(mender_json_reader_t *reader);
+
+/**
+ * @brief Begin parsing of a container, the path of the container is saved
+ * @param reader JSON reader
+ * @param type Type of the container, '{' or '['
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_push(mender_json_reader_t *reader, char type);
+
+/**
+ * @brief End parsing of a container, the path of the container is restored
+ * @param reader JSON reader
+ * @param type Type of the container, '}' or ']'
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_pop(mender_json_reader_t *reader, char type);
+
+/**
+ * @brief Set the path of the current element of the array
+ * @param reader JSON reader
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_set_index(mender_json_reader_t *reader);
+
+/**
+ * @brief Check if a character is a white space of the JSON document
+ * @param c Character
+ * @return true if the character is a white space, false otherwise
+ */
+static bool mender_json_reader_is_white_space(char c);
+
+/**
+ * @brief Append an unicode code point encoded in UTF-8 to the current token
+ * @param reader JSON reader
+ * @param code_point Unicode code point
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_append_utf8(mender_json_reader_t *reader, uint32_t code_point);
+
+/**
+ * @brief Append data to a buffer of the reader, the buffer is grown if required and is always null terminated
+ * @param data Buffer data
+ * @param size Buffer size
+ * @param length Length of the string in the buffer
+ * @param str Data to append
+ * @param str_length Length of the data to append
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_reader_append(char **data, size_t *size, size_t *length, char *str, size_t str_length);
+
+/**
+ * @brief Callback used to read the items of a key-store, only the string values of the root object are kept like mender_utils_keystore_from_json does
+ * @param path Path of the value
+ * @param depth Depth of the value
+ * @param type Type of the value
+ * @param value Value
+ * @param params Key-store read (mender_json_keystore_t)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_read_keystore_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params);
+
+/**
+ * @brief Parse a JSON document entirely
+ * @param reader JSON reader
+ * @param data Data of the document
+ * @param length Length of the data
+ * @param callback Callback invoked for each scalar value
+ * @param params Parameters of the callback
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_read(
+    mender_json_reader_t *reader, char *data, size_t length, mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *), void *params);
+
+mender_err_t
+mender_json_reader_init(mender_json_reader_t *reader, mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *), void *params) {
+
+    assert(NULL != reader);
+    assert(NULL != callback);
+
+    /* Initialize reader */
+    memset(reader, 0, sizeof(mender_json_reader_t));
+    reader->callback = callback;
+    reader->params   = params;
+    reader->state    = MENDER_JSON_STATE_VALUE;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_json_reader_process(mender_json_reader_t *reader, void *data, size_t length) {
+
+    assert(NULL != reader);
+    assert((NULL != data) || (0 == length));
+    mender_err_t ret;
+
+    /* Initialize path to the root of the document with the first data, nothing is allocated if the response has no content */
+    if ((NULL == reader->path.data) && (0 != length)) {
+        if (MENDER_OK != (ret = mender_json_reader_append(&reader->path.data, &reader->path.size, &reader->path.length, "", 0))) {
+            return ret;
+        }
+    }
+
+    /* Parse data */
+    for (size_t index = 0; index < length; index++) {
+        if (MENDER_OK != (ret = mender_json_reader_parse(reader, ((char *)data)[index]))) {
+            return ret;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_json_reader_end(mender_json_reader_t *reader) {
+
+    assert(NULL != reader);
+    mender_err_t ret = MENDER_OK;
+
+    /* A number may terminate the document */
+    if (MENDER_JSON_STATE_LITERAL == reader->state) {
+        ret = mender_json_reader_end_literal(reader);
+    }
+
+    /* Check the end of the document has been reached */
+    if ((MENDER_OK == ret) && (MENDER_JSON_STATE_END != reader->state)) {
+        mender_log_error("Invalid JSON document");
+        ret = MENDER_FAIL;
+    }
+
+    /* Release memory */
+    mender_json_reader_release(reader);
+
+    return ret;
+}
+
+void
+mender_json_reader_release(mender_json_reader_t *reader) {
+
+    /* Release memory */
+    if (NULL != reader) {
+        if (NULL != reader->path.data) {
+            mender_free(reader->path.data);
+        }
+        if (NULL != reader->token.data) {
+            mender_free(reader->token.data);
+        }
+        memset(reader, 0, sizeof(mender_json_reader_t));
+    }
+}
+
+mender_err_t
+mender_json_read_keystore(char *data, size_t length, mender_keystore_t **keystore) {
+
+    assert(NULL != keystore);
+    mender_json_reader_t      reader;
+    mender_keystore_builder_t builder;
+    mender_json_keystore_t    ctx = { .reader = &reader, .builder = NULL, .length = 0, .strings_length = 0 };
+    mender_err_t              ret;
+
+    /* Compute the lengths of the key-store */
+    *keystore = NULL;
+    if (MENDER_OK != (ret = mender_json_read(&reader, data, length, &mender_json_read_keystore_value, &ctx))) {
+        return ret;
+    }
+
+    /* Fill the key-store, the items and the strings are allocated at once */
+    if (MENDER_OK != (ret = mender_utils_keystore_builder_begin(&builder, ctx.length, ctx.strings_length))) {
+        return ret;
+    }
+    ctx.builder = &builder;
+    ret         = mender_json_read(&reader, data, length, &mender_json_read_keystore_value, &ctx);
+    *keystore   = mender_utils_keystore_builder_end(&builder);
+    if (MENDER_OK != ret) {
+        mender_utils_keystore_delete(*keystore);
+        *keystore = NULL;
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_json_reader_parse(mender_json_reader_t *reader, char c) {
+
+    assert(NULL != reader);
+    mender_err_t ret;
+
+    /* Treatment depending of the state */
+    switch (reader->state) {
+        case MENDER_JSON_STATE_VALUE:
+        case MENDER_JSON_STATE_FIRST_VALUE:
+            if (true == mender_json_reader_is_white_space(c)) {
+                /* Ignore white spaces */
+                return MENDER_OK;
+            } else if ((MENDER_JSON_STATE_FIRST_VALUE == reader->state) && (']' == c)) {
+                return mender_json_reader_pop(reader, c);
+            } else if ('{' == c) {
+                reader->state = MENDER_JSON_STATE_FIRST_KEY;
+                return mender_json_reader_push(reader, c);
+            } else if ('[' == c) {
+                reader->state = MENDER_JSON_STATE_FIRST_VALUE;
+                if (MENDER_OK != (ret = mender_json_reader_push(reader, c))) {
+                    return ret;
+                }
+                return mender_json_reader_set_index(reader);
+            } else if ('"' == c) {
+                reader->key          = false;
+                reader->token.length = 0;
+                reader->state        = MENDER_JSON_STATE_STRING;
+                return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, "", 0);
+            } else if (('\0' != c) && (NULL != strchr("-0123456789tfn", c))) {
+                reader->token.length = 0;
+                reader->state        = MENDER_JSON_STATE_LITERAL;
+                return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, &c, 1);
+            }
+            break;
+        case MENDER_JSON_STATE_FIRST_KEY:
+        case MENDER_JSON_STATE_KEY:
+            if (true == mender_json_reader_is_white_space(c)) {
+                /* Ignore white spaces */
+                return MENDER_OK;
+            } else if ((MENDER_JSON_STATE_FIRST_KEY == reader->state) && ('}' == c)) {
+                return mender_json_reader_pop(reader, c);
+            } else if ('"' == c) {
+                reader->key          = true;
+                reader->token.length = 0;
+                reader->state        = MENDER_JSON_STATE_STRING;
+                return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, "", 0);
+            }
+            break;
+        case MENDER_JSON_STATE_COLON:
+            if (true == mender_json_reader_is_white_space(c)) {
+                /* Ignore white spaces */
+                return MENDER_OK;
+            } else if (':' == c) {
+                reader->state = MENDER_JSON_STATE_VALUE;
+                return MENDER_OK;
+            }
+            break;
+        case MENDER_JSON_STATE_STRING:
+            if (0 != reader->escape) {
+                return mender_json_reader_parse_escape(reader, c);
+            } else if ('\\' == c) {
+                reader->escape = MENDER_JSON_ESCAPE_LENGTH;
+                return MENDER_OK;
+            } else if (0 != reader->surrogate) {
+                /* High surrogate must be followed by a low surrogate */
+                break;
+            } else if ('"' == c) {
+                return mender_json_reader_end_string(reader);
+            } else if ((uint8_t)c >= 0x20) {
+                return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, &c, 1);
+            }
+            break;
+        case MENDER_JSON_STATE_LITERAL:
+            if (('\0' != c) && (NULL != strchr("0123456789+-.eEtruefalsn", c))) {
+                return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, &c, 1);
+            }
+            /* End of the literal, the character is then parsed in the new state */
+            if (MENDER_OK != (ret = mender_json_reader_end_literal(reader))) {
+                return ret;
+            }
+            return mender_json_reader_parse(reader, c);
+        case MENDER_JSON_STATE_NEXT:
+            if (true == mender_json_reader_is_white_space(c)) {
+                /* Ignore white spaces */
+                return MENDER_OK;
+            } else if (',' == c) {
+                if ('{' == reader->stack[reader->depth - 1].type) {
+                    reader->state = MENDER_JSON_STATE_KEY;
+                    return MENDER_OK;
+                }
+                reader->stack[reader->depth - 1].index++;
+                reader->state = MENDER_JSON_STATE_VALUE;
+                return mender_json_reader_set_index(reader);
+            } else if (('}' == c) || (']' == c)) {
+                return mender_json_reader_pop(reader, c);
+            }
+            break;
+        case MENDER_JSON_STATE_END:
+            if (true == mender_json_reader_is_white_space(c)) {
+                /* Ignore white spaces */
+                return MENDER_OK;
+            }
+            break;
+        default:
+            /* Should not occur */
+            break;
+    }
+
+    /* Unexpected character */
+    mender_log_error("Invalid JSON document");
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_json_reader_parse_escape(mender_json_reader_t *reader, char c) {
+
+    assert(NULL != reader);
+    mender_err_t ret;
+
+    /* Character following the backslash */
+    if (MENDER_JSON_ESCAPE_LENGTH == reader->escape) {
+        char *escape = strchr("\"\"\\\\//b\bf\fn\nr\rt\t", c);
+        if ('u' == c) {
+            reader->escape  = MENDER_JSON_ESCAPE_LENGTH - 1;
+            reader->unicode = 0;
+            return MENDER_OK;
+        } else if ((0 != reader->surrogate) || ('\0' == c) || (NULL == escape) || (0 != (escape - "\"\"\\\\//b\bf\fn\nr\rt\t") % 2)) {
+            mender_log_error("Invalid JSON document");
+            return MENDER_FAIL;
+        }
+        reader->escape = 0;
+        return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, escape + 1, 1);
+    }
+
+    /* Hexadecimal digits of the unicode escape sequence */
+    if ((c >= '0') && (c <= '9')) {
+        reader->unicode = (reader->unicode << 4) | (uint32_t)(c - '0');
+    } else if ((c >= 'a') && (c <= 'f')) {
+        reader->unicode = (reader->unicode << 4) | (uint32_t)(c - 'a' + 10);
+    } else if ((c >= 'A') && (c <= 'F')) {
+        reader->unicode = (reader->unicode << 4) | (uint32_t)(c - 'A' + 10);
+    } else {
+        mender_log_error("Invalid JSON document");
+        return MENDER_FAIL;
+    }
+    if (0 != --reader->escape) {
+        return MENDER_OK;
+    }
+
+    /* Surrogate pairs are combined to a single code point */
+    if ((reader->unicode >= 0xD800) && (reader->unicode < 0xDC00) && (0 == reader->surrogate)) {
+        reader->surrogate = reader->unicode;
+        return MENDER_OK;
+    } else if ((reader->unicode >= 0xDC00) && (reader->unicode < 0xE000) && (0 != reader->surrogate)) {
+        ret               = mender_json_reader_append_utf8(reader, 0x10000 + ((reader->surrogate - 0xD800) << 10) + (reader->unicode - 0xDC00));
+        reader->surrogate = 0;
+        return ret;
+    } else if ((reader->unicode >= 0xD800) && (reader->unicode < 0xE000)) {
+        mender_log_error("Invalid JSON document");
+        return MENDER_FAIL;
+    }
+
+    return mender_json_reader_append_utf8(reader, reader->unicode);
+}
+
+static mender_err_t
+mender_json_reader_end_string(mender_json_reader_t *reader) {
+
+    assert(NULL != reader);
+    mender_err_t ret;
+
+    /* Check if the string is a key */
+    if (true == reader->key) {
+
+        /* Compute the path of the value, the keys are separated with '.' */
+        reader->path.length = reader->stack[reader->depth - 1].path_length;
+        if ((0 != reader->path.length) && (MENDER_OK != (ret = mender_json_reader_append(&reader->path.data, &reader->path.size, &reader->path.length, ".", 1)))) {
+            return ret;
+        }
+        if (MENDER_OK != (ret = mender_json_reader_append(&reader->path.data, &reader->path.size, &reader->path.length, reader->token.data, reader->token.length))) {
+            return ret;
+        }
+        reader->state = MENDER_JSON_STATE_COLON;
+
+        return MENDER_OK;
+    }
+
+    /* Invoke callback */
+    if (MENDER_OK != (ret = reader->callback(reader->path.data, reader->depth, MENDER_JSON_TYPE_STRING, reader->token.data, reader->params))) {
+        return ret;
+    }
+    mender_json_reader_end_value(reader);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_json_reader_end_literal(mender_json_reader_t *reader) {
+
+    assert(NULL != reader);
+    mender_json_type_t type;
+    mender_err_t       ret;
+
+    /* Retrieve type of the literal */
+    if (!strcmp(reader->token.data, "true")) {
+        type = MENDER_JSON_TYPE_TRUE;
+    } else if (!strcmp(reader->token.data, "false")) {
+        type = MENDER_JSON_TYPE_FALSE;
+    } else if (!strcmp(reader->token.data, "null")) {
+        type = MENDER_JSON_TYPE_NULL;
+    } else {
+        char *end = NULL;
+        strtod(reader->token.data, &end);
+        if ((!strchr("-0123456789", reader->token.data[0])) || (NULL == end) || ('\0' != *end)) {
+            mender_log_error("Invalid JSON document");
+            return MENDER_FAIL;
+        }
+        type = MENDER_JSON_TYPE_NUMBER;
+    }
+
+    /* Invoke callback */
+    if (MENDER_OK != (ret = reader->callback(reader->path.data, reader->depth, type, reader->token.data, reader->params))) {
+        return ret;
+    }
+    mender_json_reader_end_value(reader);
+
+    return MENDER_OK;
+}
+
+static void
+mender_json_reader_end_value(mender_json_reader_t *reader) {
+
+    assert(NULL != reader);
+
+    /* The document ends with the root value */
+    reader->state = (0 == reader->depth) ? MENDER_JSON_STATE_END : MENDER_JSON_STATE_NEXT;
+}
+
+static mender_err_t
+mender_json_reader_push(mender_json_reader_t *reader, char type) {
+
+    assert(NULL != reader);
+
+    /* Check depth of the document */
+    if (CONFIG_MENDER_JSON_MAX_DEPTH == reader->depth) {
+        mender_log_error("JSON document is too deep");
+        return MENDER_FAIL;
+    }
+
+    /* Save the container */
+    reader->stack[reader->depth].type        = type;
+    reader->stack[reader->depth].path_length = reader->path.length;
+    reader->stack[reader->depth].index       = 0;
+    reader->depth++;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_json_reader_pop(mender_json_reader_t *reader, char type) {
+
+    assert(NULL != reader);
+
+    /* Check the type of the container */
+    if ((0 == reader->depth) || ((('}' == type) ? '{' : '[') != reader->stack[reader->depth - 1].type)) {
+        mender_log_error("Invalid JSON document");
+        return MENDER_FAIL;
+    }
+
+    /* Restore the path of the container */
+    reader->depth--;
+    reader->path.length                    = reader->stack[reader->depth].path_length;
+    reader->path.data[reader->path.length] = '\0';
+    mender_json_reader_end_value(reader);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_json_reader_set_index(mender_json_reader_t *reader) {
+
+    assert(NULL != reader);
+    char index[sizeof("[4294967295]")];
+
+    /* Compute the path of the element */
+    reader->path.length = reader->stack[reader->depth - 1].path_length;
+    snprintf(index, sizeof(index), "[%u]", (unsigned int)reader->stack[reader->depth - 1].index);
+
+    return mender_json_reader_append(&reader->path.data, &reader->path.size, &reader->path.length, index, strlen(index));
+}
+
+static bool
+mender_json_reader_is_white_space(char c) {
+    return (' ' == c) || ('\t' == c) || ('\r' == c) || ('\n' == c);
+}
+
+static mender_err_t
+mender_json_reader_append_utf8(mender_json_reader_t *reader, uint32_t code_point) {
+
+    assert(NULL != reader);
+    char   utf8[4];
+    size_t length;
+
+    /* Encode code point */
+    if (code_point < 0x80) {
+        utf8[0] = (char)code_point;
+        length  = 1;
+    } else if (code_point < 0x800) {
+        utf8[0] = (char)(0xC0 | (code_point >> 6));
+        utf8[1] = (char)(0x80 | (code_point & 0x3F));
+        length  = 2;
+    } else if (code_point < 0x10000) {
+        utf8[0] = (char)(0xE0 | (code_point >> 12));
+        utf8[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (code_point & 0x3F));
+        length  = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (code_point >> 18));
+        utf8[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (code_point & 0x3F));
+        length  = 4;
+    }
+
+    return mender_json_reader_append(&reader->token.data, &reader->token.size, &reader->token.length, utf8, length);
+}
+
+static mender_err_t
+mender_json_reader_append(char **data, size_t *size, size_t *length, char *str, size_t str_length) {
+
+    assert(NULL != data);
+    assert(NULL != size);
+    assert(NULL != length);
+    assert(NULL != str);
+    char *tmp;
+
+    /* Grow the buffer if required, the size is doubled to limit the number of allocations */
+    if (*length + str_length + 1 > *size) {
+        size_t new_size = (0 != *size) ? (2 * *size) : 32;
+        while (*length + str_length + 1 > new_size) {
+            new_size *= 2;
+        }
+        if (NULL == (tmp = (char *)mender_realloc(*data, new_size))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        *data = tmp;
+        *size = new_size;
+    }
+
+    /* Append data */
+    memcpy(*data + *length, str, str_length);
+    *length += str_length;
+    (*data)[*length] = '\0';
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_json_read_keystore_value(char *path, size_t depth, mender_json_type_t type, char *value, void *params) {
+
+    assert(NULL != path);
+    assert(NULL != value);
+    assert(NULL != params);
+    mender_json_keystore_t *ctx = (mender_json_keystore_t *)params;
+
+    /* Only the string values of the root object are items, the path is the name of the item then */
+    if ((1 != depth) || ('{' != ctx->reader->stack[0].type) || (MENDER_JSON_TYPE_STRING != type)) {
+        return MENDER_OK;
+    }
+
+    /* Count the item during the first pass, add it during the second */
+    if (NULL == ctx->builder) {
+        ctx->length++;
+        ctx->strings_length += strlen(path) + 1 + strlen(value) + 1;
+        return MENDER_OK;
+    }
+
+    return mender_utils_keystore_builder_add(ctx->builder, path, value);
+}
+
+static mender_err_t
+mender_json_read(
+    mender_json_reader_t *reader, char *data, size_t length, mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *), void *params) {
+
+    assert(NULL != reader);
+    mender_err_t ret;
+
+    /* Parse the document */
+    if (MENDER_OK != (ret = mender_json_reader_init(reader, callback, params))) {
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_json_reader_process(reader, data, length))) {
+        mender_json_reader_release(reader);
+        return ret;
+    }
+
+    return mender_json_reader_end(reader);
+}
@@ -0,0 +1,327 @@
+/**
+ * @file      mender-log-capture.c
+ * @brief     Mender log capture implementation, the logs of the deployment are kept in a RAM buffer to be uploaded to the server
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-log.h"
+#include "mender-scheduler.h"
+
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+
+/**
+ * @brief Maximum length of a message captured, the longer messages are truncated
+ */
+#define MENDER_LOG_CAPTURE_MESSAGE_LENGTH (128)
+
+/**
+ * @brief Length of the header of a record, uptime (seconds, 4 bytes), level (1 byte) and length of the message (1 byte)
+ */
+#define MENDER_LOG_CAPTURE_HEADER_LENGTH (6)
+
+/**
+ * @brief Captured logs, the records are written at the head and the oldest ones are dropped at the tail
+ * @note The functions of this file must not log, the messages would be captured recursively
+ */
+static struct {
+    uint8_t *buffer;  /**< Ring buffer, NULL if the capture is released */
+    size_t   head;    /**< Offset at which the next record is written */
+    size_t   tail;    /**< Offset of the oldest record */
+    size_t   used;    /**< Number of bytes used in the ring buffer */
+    bool     running; /**< Capture running flag, accessed atomically */
+    bool     lock;    /**< Lock of the ring buffer, accessed atomically */
+} mender_log_capture = { 0 };
+
+/**
+ * @brief Take the lock of the ring buffer, waiting for it to be released
+ */
+static void mender_log_capture_lock(void);
+
+/**
+ * @brief Release the lock of the ring buffer
+ */
+static void mender_log_capture_unlock(void);
+
+/**
+ * @brief Copy data to the head of the ring buffer
+ * @param data Data
+ * @param length Length of the data
+ */
+static void mender_log_capture_copy_in(void *data, size_t length);
+
+/**
+ * @brief Copy data from the ring buffer
+ * @param offset Offset in the ring buffer
+ * @param data Data
+ * @param length Length of the data
+ * @return Offset following the data copied
+ */
+static size_t mender_log_capture_copy_out(size_t offset, void *data, size_t length);
+
+/**
+ * @brief Function used to format an uptime as a RFC3339 timestamp, the uptime is counted from the epoch
+ * @param uptime Uptime (seconds)
+ * @param timestamp Timestamp
+ * @param length Length of the timestamp
+ */
+static void mender_log_capture_format_timestamp(uint32_t uptime, char *timestamp, size_t length);
+
+mender_err_t
+mender_log_capture_begin(void) {
+
+    mender_err_t ret = MENDER_OK;
+
+    /* Allocate the ring buffer if it is not already */
+    mender_log_capture_lock();
+    if (NULL == mender_log_capture.buffer) {
+        if (NULL == (mender_log_capture.buffer = (uint8_t *)mender_malloc(CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH))) {
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        mender_log_capture.head = 0;
+        mender_log_capture.tail = 0;
+        mender_log_capture.used = 0;
+    }
+    __atomic_store_n(&mender_log_capture.running, true, __ATOMIC_RELEASE);
+
+END:
+
+    mender_log_capture_unlock();
+
+    return ret;
+}
+
+void
+mender_log_capture_print(uint8_t level, char *format, ...) {
+
+    assert(NULL != format);
+    char     message[MENDER_LOG_CAPTURE_MESSAGE_LENGTH];
+    uint8_t  header[MENDER_LOG_CAPTURE_HEADER_LENGTH];
+    uint8_t  length;
+    uint32_t uptime;
+    va_list  args;
+    int      count;
+
+    /* Nothing to do if the capture is not running, this is the common case */
+    if (true != __atomic_load_n(&mender_log_capture.running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    /* Format the message */
+    va_start(args, format);
+    count = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (count < 0) {
+        return;
+    }
+    length = (uint8_t)(((size_t)count < sizeof(message)) ? (size_t)count : (sizeof(message) - 1));
+
+    /* The message is dropped if the ring buffer is being accessed, the logs must never wait */
+    if (true == __atomic_test_and_set(&mender_log_capture.lock, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    if (NULL == mender_log_capture.buffer) {
+        goto END;
+    }
+
+    /* Drop the oldest records until the new one fits */
+    while (CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH - mender_log_capture.used < (size_t)(MENDER_LOG_CAPTURE_HEADER_LENGTH + length)) {
+        if (0 == mender_log_capture.used) {
+            goto END;
+        }
+        mender_log_capture_copy_out(mender_log_capture.tail, header, sizeof(header));
+        mender_log_capture.tail = (mender_log_capture.tail + MENDER_LOG_CAPTURE_HEADER_LENGTH + header[5]) % CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH;
+        mender_log_capture.used -= MENDER_LOG_CAPTURE_HEADER_LENGTH + header[5];
+    }
+
+    /* Write the record */
+    uptime = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
+    memcpy(header, &uptime, sizeof(uptime));
+    header[4] = level;
+    header[5] = length;
+    mender_log_capture_copy_in(header, sizeof(header));
+    mender_log_capture_copy_in(message, length);
+
+END:
+
+    mender_log_capture_unlock();
+}
+
+void
+mender_log_capture_stop(void) {
+
+    /* Stop the capture, the messages being captured are still written */
+    __atomic_store_n(&mender_log_capture.running, false, __ATOMIC_RELEASE);
+}
+
+mender_err_t
+mender_log_capture_write_json(mender_err_t (*write)(void *, size_t, void *), void *ctx) {
+
+    assert(NULL != write);
+    mender_err_t ret = MENDER_OK;
+    char         message[MENDER_LOG_CAPTURE_MESSAGE_LENGTH];
+    uint8_t      header[MENDER_LOG_CAPTURE_HEADER_LENGTH];
+    char         timestamp[sizeof("1970-01-01T00:00:00Z")];
+    char        *level;
+    size_t       offset;
+    size_t       used;
+    uint32_t     uptime;
+
+    /* Write the records from the oldest one, the lock is kept so that the buffer is not released meanwhile */
+    mender_log_capture_lock();
+    if (MENDER_OK != (ret = write("{\"messages\":[", strlen("{\"messages\":["), ctx))) {
+        goto END;
+    }
+    offset = mender_log_capture.tail;
+    used   = (NULL != mender_log_capture.buffer) ? mender_log_capture.used : 0;
+    while (0 < used) {
+        offset = mender_log_capture_copy_out(offset, header, sizeof(header));
+        offset = mender_log_capture_copy_out(offset, message, header[5]);
+        message[header[5]] = '\0';
+        used -= MENDER_LOG_CAPTURE_HEADER_LENGTH + header[5];
+        memcpy(&uptime, header, sizeof(uptime));
+        mender_log_capture_format_timestamp(uptime, timestamp, sizeof(timestamp));
+        switch (header[4]) {
+            case MENDER_LOG_LEVEL_ERR:
+                level = "error";
+                break;
+            case MENDER_LOG_LEVEL_WRN:
+                level = "warning";
+                break;
+            case MENDER_LOG_LEVEL_INF:
+                level = "info";
+                break;
+            default:
+                level = "debug";
+                break;
+        }
+        if (MENDER_OK != (ret = write("{\"timestamp\":\"", strlen("{\"timestamp\":\""), ctx))) {
+            goto END;
+        }
+        if (MENDER_OK != (ret = write(timestamp, strlen(timestamp), ctx))) {
+            goto END;
+        }
+        if (MENDER_OK != (ret = write("\",\"level\":\"", strlen("\",\"level\":\""), ctx))) {
+            goto END;
+        }
+        if (MENDER_OK != (ret = write(level, strlen(level), ctx))) {
+            goto END;
+        }
+        if (MENDER_OK != (ret = write("\",\"message\":", strlen("\",\"message\":"), ctx))) {
+            goto END;
+        }
+        if (MENDER_OK != (ret = mender_utils_json_write_string(write, ctx, message))) {
+            goto END;
+        }
+        if (MENDER_OK != (ret = write((0 < used) ? "}," : "}", (0 < used) ? 2 : 1, ctx))) {
+            goto END;
+        }
+    }
+    ret = write("]}", strlen("]}"), ctx);
+
+END:
+
+    mender_log_capture_unlock();
+
+    return ret;
+}
+
+void
+mender_log_capture_release(void) {
+
+    /* Stop the capture and release the ring buffer */
+    __atomic_store_n(&mender_log_capture.running, false, __ATOMIC_RELEASE);
+    mender_log_capture_lock();
+    mender_free(mender_log_capture.buffer);
+    mender_log_capture.buffer = NULL;
+    mender_log_capture_unlock();
+}
+
+static void
+mender_log_capture_lock(void) {
+
+    /* Wait for the lock, it is only kept for a short time by the messages being captured */
+    while (true == __atomic_test_and_set(&mender_log_capture.lock, __ATOMIC_ACQUIRE)) {
+        mender_scheduler_yield(0);
+    }
+}
+
+static void
+mender_log_capture_unlock(void) {
+
+    __atomic_clear(&mender_log_capture.lock, __ATOMIC_RELEASE);
+}
+
+static void
+mender_log_capture_copy_in(void *data, size_t length) {
+
+    size_t first = CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH - mender_log_capture.head;
+
+    /* Copy the data, wrapping around the end of the ring buffer */
+    if (length < first) {
+        first = length;
+    }
+    memcpy(&mender_log_capture.buffer[mender_log_capture.head], data, first);
+    memcpy(mender_log_capture.buffer, (uint8_t *)data + first, length - first);
+    mender_log_capture.head = (mender_log_capture.head + length) % CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH;
+    mender_log_capture.used += length;
+}
+
+static size_t
+mender_log_capture_copy_out(size_t offset, void *data, size_t length) {
+
+    size_t first = CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH - offset;
+
+    /* Copy the data, wrapping around the end of the ring buffer */
+    if (length < first) {
+        first = length;
+    }
+    memcpy(data, &mender_log_capture.buffer[offset], first);
+    memcpy((uint8_t *)data + first, mender_log_capture.buffer, length - first);
+
+    return (offset + length) % CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH;
+}
+
+static void
+mender_log_capture_format_timestamp(uint32_t uptime, char *timestamp, size_t length) {
+
+    assert(NULL != timestamp);
+    uint32_t days    = uptime / 86400;
+    uint32_t seconds = uptime % 86400;
+
+    /* Convert the number of days to a civil date, see http://howardhinnant.github.io/date_algorithms.html */
+    uint32_t z     = days + 719468;
+    uint32_t era   = z / 146097;
+    uint32_t doe   = z - era * 146097;
+    uint32_t yoe   = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy   = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp    = (5 * doy + 2) / 153;
+    uint32_t day   = doy - (153 * mp + 2) / 5 + 1;
+    uint32_t month = (mp < 10) ? (mp + 3) : (mp - 9);
+    uint32_t year  = yoe + era * 400 + ((month <= 2) ? 1 : 0);
+
+    snprintf(timestamp,
+             length,
+             "%04u-%02u-%02uT%02u:%02u:%02uZ",
+             (unsigned int)year,
+             (unsigned int)month,
+             (unsigned int)day,
+             (unsigned int)(seconds / 3600),
+             (unsigned int)((seconds / 60) % 60),
+             (unsigned int)(seconds % 60));
+}
+
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
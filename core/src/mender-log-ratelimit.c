@@ -0,0 +1,71 @@
+/**
+ * @file      mender-log-ratelimit.c
+ * @brief     Mender log rate limiting implementation
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-log.h"
+#include "mender-scheduler.h"
+
+#if (0 < CONFIG_MENDER_LOG_RATELIMIT_INTERVAL)
+
+bool
+mender_log_ratelimit(mender_log_ratelimit_t *ratelimit, uint8_t level, const char *filename, int line) {
+
+    assert(NULL != ratelimit);
+    uint32_t now = (uint32_t)(mender_scheduler_get_uptime_us() / 1000000);
+    uint32_t burst;
+
+    /* Retrieve the number of messages printed during the interval, 0 if they are not limited */
+    switch (level) {
+        case MENDER_LOG_LEVEL_ERR:
+            burst = CONFIG_MENDER_LOG_RATELIMIT_BURST_ERR;
+            break;
+        case MENDER_LOG_LEVEL_WRN:
+            burst = CONFIG_MENDER_LOG_RATELIMIT_BURST_WRN;
+            break;
+        case MENDER_LOG_LEVEL_INF:
+            burst = CONFIG_MENDER_LOG_RATELIMIT_BURST_INF;
+            break;
+        default:
+            burst = CONFIG_MENDER_LOG_RATELIMIT_BURST_DBG;
+            break;
+    }
+    if (0 == burst) {
+        return true;
+    }
+
+    /* Start a new interval, the messages suppressed during the previous one are reported before the message is printed */
+    if ((0 == ratelimit->count) || (now - ratelimit->start >= CONFIG_MENDER_LOG_RATELIMIT_INTERVAL)) {
+        if (0 < ratelimit->suppressed) {
+            mender_log_print(level, filename, NULL, line, "Previous message repeated %u times", (unsigned int)ratelimit->suppressed);
+        }
+        ratelimit->start      = now;
+        ratelimit->count      = 0;
+        ratelimit->suppressed = 0;
+    }
+
+    /* Suppress the message if the burst is reached */
+    if (ratelimit->count >= burst) {
+        ratelimit->suppressed++;
+        return false;
+    }
+    ratelimit->count++;
+
+    return true;
+}
+
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_INTERVAL */
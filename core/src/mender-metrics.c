@@ -0,0 +1,81 @@
+/**
+ * @file      mender-metrics.c
+ * @brief     Mender metrics interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-metrics.h"
+
+#ifdef CONFIG_MENDER_CLIENT_METRICS
+
+/**
+ * @brief Values of the metrics, they are updated atomically by the works of the client and of the add-ons
+ */
+static uint32_t mender_metrics_values[MENDER_METRICS_COUNT];
+
+void
+mender_metrics_add(mender_metrics_t metric, uint32_t value) {
+
+    assert(metric < MENDER_METRICS_COUNT);
+
+    /* Increment the counter */
+    __atomic_add_fetch(&mender_metrics_values[metric], value, __ATOMIC_RELAXED);
+}
+
+void
+mender_metrics_set(mender_metrics_t metric, uint32_t value) {
+
+    assert(metric < MENDER_METRICS_COUNT);
+
+    /* Set the gauge */
+    __atomic_store_n(&mender_metrics_values[metric], value, __ATOMIC_RELAXED);
+}
+
+uint32_t
+mender_metrics_get(mender_metrics_t metric) {
+
+    assert(metric < MENDER_METRICS_COUNT);
+
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+    /* The heap peak is read from the heap statistics */
+    if (MENDER_METRICS_HEAP_PEAK == metric) {
+        mender_utils_heap_statistics_t statistics;
+        if (MENDER_OK == mender_utils_get_heap_statistics(MENDER_UTILS_HEAP_SUBSYSTEM_ALL, &statistics)) {
+            return (uint32_t)statistics.peak;
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+
+    return __atomic_load_n(&mender_metrics_values[metric], __ATOMIC_RELAXED);
+}
+
+char *
+mender_metrics_to_string(mender_metrics_t metric) {
+
+    /* Definition of metric strings */
+    const char *desc[] = { "bytes_downloaded",    "download_duration", "download_retries",      "authentication_attempts", "connect_duration",
+                           "flash_write_duration", "heap_peak",         "websocket_connections", "scheduler_overruns",      "network_connections",
+                           "network_duration" };
+
+    /* Return metric as string */
+    if (metric < MENDER_METRICS_COUNT) {
+        return (char *)desc[metric];
+    }
+
+    return NULL;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_METRICS */
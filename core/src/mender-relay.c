@@ -0,0 +1,341 @@
+/**
+ * @file      mender-relay.c
+ * @brief     Mender relay artifact type implementation, the payloads are relayed to a co-processor with a windowed acknowledgement protocol
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-client.h"
+#include "mender-log.h"
+#include "mender-relay.h"
+
+#ifdef CONFIG_MENDER_RELAY
+
+/**
+ * @brief Number of blocks allocated, the window and the block being filled
+ */
+#define MENDER_RELAY_SLOTS (CONFIG_MENDER_RELAY_WINDOW + 1)
+
+/**
+ * @brief Relay artifact type, the blocks sent are kept until they are acknowledged so that they can be sent again
+ */
+typedef struct {
+    char                     *type;                        /**< Artifact type, NULL if the relay is not registered */
+    mender_relay_transport_t *transport;                   /**< Transport to the co-processor */
+    uint8_t                  *blocks;                      /**< Blocks, NULL if no file is being transferred */
+    size_t                    lengths[MENDER_RELAY_SLOTS]; /**< Lengths of the blocks */
+    uint32_t                  base;                        /**< Sequence number of the oldest block not acknowledged */
+    uint32_t                  next;                        /**< Sequence number of the block being filled */
+    size_t                    index;                       /**< Index of the next data expected in the file */
+} mender_relay_t;
+
+/**
+ * @brief Relay artifact types
+ */
+static mender_relay_t mender_relays[CONFIG_MENDER_RELAY_COUNT];
+
+/**
+ * @brief Relay artifact type callback
+ * @param id ID of the deployment
+ * @param artifact name Artifact name
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code if an error occurred
+ */
+static mender_err_t mender_relay_artifact_type_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+/**
+ * @brief Begin the transfer of a file
+ * @param relay Relay
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_relay_begin(mender_relay_t *relay, char *filename, size_t size);
+
+/**
+ * @brief Send the block being filled, waiting for the acknowledgements if the window is full
+ * @param relay Relay
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_relay_send(mender_relay_t *relay);
+
+/**
+ * @brief Wait for an acknowledgement, the blocks not acknowledged are sent again on timeout
+ * @param relay Relay
+ * @param retries Number of times the blocks have been sent again since the last acknowledgement, updated
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_relay_wait(mender_relay_t *relay, uint32_t *retries);
+
+/**
+ * @brief End the transfer of a file once all the blocks are acknowledged
+ * @param relay Relay
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_relay_end(mender_relay_t *relay);
+
+/**
+ * @brief Release the transfer of a file, it is aborted if it has not been completed
+ * @param relay Relay
+ */
+static void mender_relay_release(mender_relay_t *relay);
+
+mender_err_t
+mender_relay_register(char *type, mender_relay_transport_t *transport, bool needs_restart) {
+
+    assert(NULL != type);
+    assert(NULL != transport);
+    assert(NULL != transport->send);
+    assert(NULL != transport->receive);
+    mender_err_t ret;
+
+    /* Add the relay to the first free entry */
+    for (size_t index = 0; index < CONFIG_MENDER_RELAY_COUNT; index++) {
+        if (NULL == mender_relays[index].type) {
+            if (MENDER_OK != (ret = mender_client_register_artifact_type(type, &mender_relay_artifact_type_callback, needs_restart, NULL))) {
+                return ret;
+            }
+            mender_relays[index].type      = type;
+            mender_relays[index].transport = transport;
+            return MENDER_OK;
+        }
+    }
+    mender_log_error("Unable to register relay artifact type '%s', too many relays", type);
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_relay_artifact_type_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    assert(NULL != type);
+    (void)id;
+    (void)artifact_name;
+    (void)meta_data;
+    mender_relay_t *relay = NULL;
+    mender_err_t    ret;
+
+    /* Retrieve the relay of the artifact type */
+    for (size_t i = 0; i < CONFIG_MENDER_RELAY_COUNT; i++) {
+        if ((NULL != mender_relays[i].type) && (!strcmp(mender_relays[i].type, type))) {
+            relay = &mender_relays[i];
+            break;
+        }
+    }
+    if (NULL == relay) {
+        mender_log_error("Unable to find relay of artifact type '%s'", type);
+        return MENDER_FAIL;
+    }
+
+    /* Beginning of the payload, a file which has not been completed is aborted */
+    if (NULL == filename) {
+        mender_relay_release(relay);
+        return MENDER_OK;
+    }
+
+    /* Beginning of a file */
+    if (0 == index) {
+        mender_relay_release(relay);
+        if (MENDER_OK != (ret = mender_relay_begin(relay, filename, size))) {
+            goto FAIL;
+        }
+    }
+
+    /* Check the data are following the ones already received */
+    if ((NULL == relay->blocks) || (index != relay->index)) {
+        mender_log_error("Unexpected data of the file '%s' at index %zu", filename, index);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Fill the blocks and send them once full, the last block of the file is sent once complete */
+    while (0 < length) {
+        size_t *block_length = &relay->lengths[relay->next % MENDER_RELAY_SLOTS];
+        size_t  chunk        = ((CONFIG_MENDER_RELAY_BLOCK_SIZE - *block_length) < length) ? (CONFIG_MENDER_RELAY_BLOCK_SIZE - *block_length) : length;
+        memcpy(&relay->blocks[(relay->next % MENDER_RELAY_SLOTS) * CONFIG_MENDER_RELAY_BLOCK_SIZE + *block_length], data, chunk);
+        *block_length += chunk;
+        relay->index  += chunk;
+        data           = (uint8_t *)data + chunk;
+        length        -= chunk;
+        if ((CONFIG_MENDER_RELAY_BLOCK_SIZE == *block_length) || (relay->index >= size)) {
+            if (MENDER_OK != (ret = mender_relay_send(relay))) {
+                goto FAIL;
+            }
+        }
+    }
+
+    /* End of the file */
+    if (relay->index >= size) {
+        if (MENDER_OK != (ret = mender_relay_end(relay))) {
+            goto FAIL;
+        }
+    }
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Abort the transfer */
+    mender_relay_release(relay);
+
+    return ret;
+}
+
+static mender_err_t
+mender_relay_begin(mender_relay_t *relay, char *filename, size_t size) {
+
+    assert(NULL != relay);
+    mender_err_t ret;
+
+    /* Allocate the blocks */
+    if (NULL == (relay->blocks = (uint8_t *)mender_malloc(MENDER_RELAY_SLOTS * CONFIG_MENDER_RELAY_BLOCK_SIZE))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(relay->lengths, 0, sizeof(relay->lengths));
+    relay->base  = 0;
+    relay->next  = 0;
+    relay->index = 0;
+
+    /* Begin the transfer, the co-processor prepares its flash */
+    if (NULL != relay->transport->begin) {
+        if (MENDER_OK != (ret = relay->transport->begin(filename, size, relay->transport->params))) {
+            mender_log_error("Unable to begin the transfer of the file '%s'", filename);
+            return ret;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_relay_send(mender_relay_t *relay) {
+
+    assert(NULL != relay);
+    mender_err_t ret;
+    uint32_t     retries = 0;
+    size_t       slot    = relay->next % MENDER_RELAY_SLOTS;
+
+    /* Wait for the oldest block to be acknowledged if the window is full */
+    while (relay->next - relay->base >= CONFIG_MENDER_RELAY_WINDOW) {
+        if (MENDER_OK != (ret = mender_relay_wait(relay, &retries))) {
+            return ret;
+        }
+    }
+
+    /* Send the block, the next one is filled while it is programmed by the co-processor */
+    if (MENDER_OK
+        != (ret = relay->transport->send(relay->next, &relay->blocks[slot * CONFIG_MENDER_RELAY_BLOCK_SIZE], relay->lengths[slot], relay->transport->params))) {
+        mender_log_error("Unable to send block %u", (unsigned int)relay->next);
+        return ret;
+    }
+    relay->next++;
+    relay->lengths[relay->next % MENDER_RELAY_SLOTS] = 0;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_relay_wait(mender_relay_t *relay, uint32_t *retries) {
+
+    assert(NULL != relay);
+    assert(NULL != retries);
+    mender_err_t ret;
+    uint32_t     sequence;
+
+    /* Receive an acknowledgement, the blocks before the sequence number received are programmed */
+    if (MENDER_OK == (ret = relay->transport->receive(&sequence, CONFIG_MENDER_RELAY_ACK_TIMEOUT, relay->transport->params))) {
+        if ((sequence - relay->base) <= (relay->next - relay->base)) {
+            if (sequence != relay->base) {
+                *retries = 0;
+            }
+            relay->base = sequence;
+        }
+        return MENDER_OK;
+    }
+    if (MENDER_NOT_FOUND != ret) {
+        mender_log_error("Unable to receive acknowledgement");
+        return ret;
+    }
+
+    /* Send the blocks not acknowledged again on timeout, the co-processor drops the blocks out of sequence */
+    if (++(*retries) > CONFIG_MENDER_RELAY_RETRIES) {
+        mender_log_error("Block %u has not been acknowledged", (unsigned int)relay->base);
+        return MENDER_FAIL;
+    }
+    mender_log_warning("Block %u has not been acknowledged, sending %u blocks again", (unsigned int)relay->base, (unsigned int)(relay->next - relay->base));
+    for (uint32_t block = relay->base; block != relay->next; block++) {
+        size_t slot = block % MENDER_RELAY_SLOTS;
+        if (MENDER_OK
+            != (ret = relay->transport->send(block, &relay->blocks[slot * CONFIG_MENDER_RELAY_BLOCK_SIZE], relay->lengths[slot], relay->transport->params))) {
+            mender_log_error("Unable to send block %u", (unsigned int)block);
+            return ret;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_relay_end(mender_relay_t *relay) {
+
+    assert(NULL != relay);
+    mender_err_t ret;
+    uint32_t     retries = 0;
+
+    /* Wait for all the blocks to be acknowledged */
+    while (relay->base != relay->next) {
+        if (MENDER_OK != (ret = mender_relay_wait(relay, &retries))) {
+            return ret;
+        }
+    }
+
+    /* End the transfer, the co-processor validates the file */
+    if (NULL != relay->transport->end) {
+        if (MENDER_OK != (ret = relay->transport->end(relay->transport->params))) {
+            mender_log_error("Unable to end the transfer of the file");
+            return ret;
+        }
+    }
+    mender_free(relay->blocks);
+    relay->blocks = NULL;
+
+    return MENDER_OK;
+}
+
+static void
+mender_relay_release(mender_relay_t *relay) {
+
+    assert(NULL != relay);
+
+    /* Abort the transfer if it has not been completed */
+    if (NULL != relay->blocks) {
+        if (NULL != relay->transport->abort) {
+            relay->transport->abort(relay->transport->params);
+        }
+        mender_free(relay->blocks);
+        relay->blocks = NULL;
+    }
+}
+
+#endif /* CONFIG_MENDER_RELAY */
@@ -0,0 +1,470 @@
+/**
+ * @file      mender-storage-cache.c
+ * @brief     Mender storage cache interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE
+
+#include "mender-log.h"
+#include "mender-scheduler.h"
+#include "mender-storage-cache.h"
+
+/**
+ * @brief State of the items in the cache
+ */
+typedef enum {
+    MENDER_STORAGE_CACHE_STATE_UNKNOWN = 0, /**< Item not loaded from the storage */
+    MENDER_STORAGE_CACHE_STATE_ABSENT,      /**< Item not available */
+    MENDER_STORAGE_CACHE_STATE_PRESENT      /**< Item available */
+} mender_storage_cache_state_t;
+
+/**
+ * @brief Item of the cache
+ */
+typedef struct {
+    mender_storage_cache_state_t state;  /**< State of the item */
+    void                        *data;   /**< Data of the item, with a NUL terminator not counted in the length, NULL if not present */
+    size_t                       length; /**< Length of the item */
+    bool                         dirty;  /**< Item set or deleted and not written yet */
+    struct {
+        mender_storage_cache_state_t state;  /**< State of the item in the storage */
+        size_t                       length; /**< Length of the item in the storage */
+        uint32_t                     hash;   /**< Hash of the item in the storage (FNV-1a) */
+    } stored;                                /**< Item in the storage, known once it has been read or written and kept when the item is released */
+} mender_storage_cache_entry_t;
+
+/**
+ * @brief Operations of the storage backend
+ */
+static const mender_storage_cache_ops_t *mender_storage_cache_ops = NULL;
+
+/**
+ * @brief Items of the cache
+ */
+static mender_storage_cache_entry_t mender_storage_cache_entries[MENDER_STORAGE_ITEM_COUNT];
+
+/**
+ * @brief Depth of the transactions in progress, 0 if there is no transaction
+ */
+static uint32_t mender_storage_cache_depth = 0;
+
+/**
+ * @brief Mutex used to protect access to the cache
+ */
+static void *mender_storage_cache_mutex = NULL;
+
+/**
+ * @brief Update an item of the cache
+ * @param item Item
+ * @param data Data of the item, NULL if deleted
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_cache_update(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Write the items set and deleted and commit them
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_cache_flush(void);
+
+/**
+ * @brief Check if an item of the storage is identical to the data, the items are compared only if their hashes match
+ * @param item Item
+ * @param data Data of the item, NULL if deleted
+ * @param length Length of the item
+ * @return true if the item is identical, false otherwise
+ */
+static bool mender_storage_cache_is_stored(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Save the item in the storage so that the identical writes are skipped even if the item is not kept in RAM
+ * @param entry Item of the cache
+ * @param data Data of the item, NULL if absent
+ * @param length Length of the item
+ */
+static void mender_storage_cache_set_stored(mender_storage_cache_entry_t *entry, void *data, size_t length);
+
+/**
+ * @brief Compute the hash of data (FNV-1a)
+ * @param data Data
+ * @param length Length of the data
+ * @return Hash
+ */
+static uint32_t mender_storage_cache_hash(void *data, size_t length);
+
+/**
+ * @brief Release an item of the cache, it is loaded again from the storage when it is read
+ * @param entry Item of the cache
+ */
+static void mender_storage_cache_release(mender_storage_cache_entry_t *entry);
+
+mender_err_t
+mender_storage_cache_init(const mender_storage_cache_ops_t *ops) {
+
+    assert(NULL != ops);
+    assert(NULL != ops->read);
+    assert(NULL != ops->write);
+    assert(NULL != ops->erase);
+    mender_err_t ret;
+
+    /* Create cache mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_storage_cache_mutex))) {
+        mender_log_error("Unable to create storage cache mutex");
+        return ret;
+    }
+
+    /* Save operations, the items are loaded when they are read for the first time */
+    mender_storage_cache_ops = ops;
+    memset(mender_storage_cache_entries, 0, sizeof(mender_storage_cache_entries));
+    mender_storage_cache_depth = 0;
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_cache_get(mender_storage_item_t item, void **data, size_t *length) {
+
+    assert(item < MENDER_STORAGE_ITEM_COUNT);
+    assert(NULL != data);
+    assert(NULL != length);
+    mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[item];
+    mender_err_t                  ret;
+
+    *data   = NULL;
+    *length = 0;
+
+    /* Take mutex used to protect access to the cache */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_storage_cache_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Load the item from the storage if it is not known yet */
+    if (MENDER_STORAGE_CACHE_STATE_UNKNOWN == entry->state) {
+        if (MENDER_OK == (ret = mender_storage_cache_ops->read(item, &entry->data, &entry->length))) {
+            entry->state = MENDER_STORAGE_CACHE_STATE_PRESENT;
+        } else if (MENDER_NOT_FOUND == ret) {
+            entry->state = MENDER_STORAGE_CACHE_STATE_ABSENT;
+        } else {
+            goto END;
+        }
+        mender_storage_cache_set_stored(entry, entry->data, entry->length);
+#ifndef CONFIG_MENDER_STORAGE_CACHE
+        /* The item is not kept in RAM, it is given to the caller */
+        if (MENDER_STORAGE_CACHE_STATE_PRESENT == entry->state) {
+            *data       = entry->data;
+            *length     = entry->length;
+            entry->data = NULL;
+        }
+        mender_storage_cache_release(entry);
+        goto END;
+#endif /* CONFIG_MENDER_STORAGE_CACHE */
+    }
+
+    /* Copy the item */
+    if (MENDER_STORAGE_CACHE_STATE_ABSENT == entry->state) {
+        ret = MENDER_NOT_FOUND;
+        goto END;
+    }
+    if (NULL == (*data = mender_malloc(entry->length + 1))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    memcpy(*data, entry->data, entry->length + 1);
+    *length = entry->length;
+    ret     = MENDER_OK;
+
+END:
+
+    /* Release mutex used to protect access to the cache */
+    mender_scheduler_mutex_give(mender_storage_cache_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_cache_set(mender_storage_item_t item, void *data, size_t length) {
+
+    assert(item < MENDER_STORAGE_ITEM_COUNT);
+    assert(NULL != data);
+
+    return mender_storage_cache_update(item, data, length);
+}
+
+mender_err_t
+mender_storage_cache_delete(mender_storage_item_t item) {
+
+    assert(item < MENDER_STORAGE_ITEM_COUNT);
+
+    return mender_storage_cache_update(item, NULL, 0);
+}
+
+mender_err_t
+mender_storage_cache_begin(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the cache */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_storage_cache_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Begin the transaction */
+    mender_storage_cache_depth++;
+
+    /* Release mutex used to protect access to the cache */
+    mender_scheduler_mutex_give(mender_storage_cache_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_cache_commit(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the cache */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_storage_cache_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Write the items when the outermost transaction is committed */
+    assert(0 < mender_storage_cache_depth);
+    if (0 == --mender_storage_cache_depth) {
+        ret = mender_storage_cache_flush();
+    }
+
+    /* Release mutex used to protect access to the cache */
+    mender_scheduler_mutex_give(mender_storage_cache_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_cache_exit(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the cache */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_storage_cache_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Write the pending items */
+    if (0 != mender_storage_cache_depth) {
+        mender_log_warning("Storage transaction not committed");
+        mender_storage_cache_depth = 0;
+    }
+    ret = mender_storage_cache_flush();
+
+    /* Release memory */
+    for (size_t index = 0; index < MENDER_STORAGE_ITEM_COUNT; index++) {
+        mender_storage_cache_release(&mender_storage_cache_entries[index]);
+    }
+    mender_storage_cache_ops = NULL;
+    mender_scheduler_mutex_give(mender_storage_cache_mutex);
+    mender_scheduler_mutex_delete(mender_storage_cache_mutex);
+    mender_storage_cache_mutex = NULL;
+
+    return ret;
+}
+
+static mender_err_t
+mender_storage_cache_update(mender_storage_item_t item, void *data, size_t length) {
+
+    mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[item];
+    void                         *copy  = NULL;
+    mender_err_t                  ret;
+
+    /* Copy the item, a NUL terminator is added so that it can be given as a string */
+    if (NULL != data) {
+        if (NULL == (copy = mender_malloc(length + 1))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        memcpy(copy, data, length);
+        ((char *)copy)[length] = '\0';
+    }
+
+    /* Take mutex used to protect access to the cache */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_storage_cache_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        mender_free(copy);
+        return ret;
+    }
+
+    /* Nothing is written if the item is not modified, it is compared to the storage if it is not kept in RAM */
+    if ((NULL == data) ? (MENDER_STORAGE_CACHE_STATE_ABSENT == entry->state)
+                       : ((MENDER_STORAGE_CACHE_STATE_PRESENT == entry->state) && (length == entry->length) && (0 == memcmp(entry->data, data, length)))) {
+        mender_free(copy);
+        goto END;
+    }
+    if ((MENDER_STORAGE_CACHE_STATE_UNKNOWN == entry->state) && (true == mender_storage_cache_is_stored(item, data, length))) {
+        mender_free(copy);
+        goto END;
+    }
+
+    /* Update the item */
+    mender_free(entry->data);
+    entry->data   = copy;
+    entry->length = length;
+    entry->state  = (NULL != data) ? MENDER_STORAGE_CACHE_STATE_PRESENT : MENDER_STORAGE_CACHE_STATE_ABSENT;
+    entry->dirty  = true;
+
+    /* Write the item immediately if there is no transaction */
+    if (0 == mender_storage_cache_depth) {
+        ret = mender_storage_cache_flush();
+    }
+
+END:
+
+    /* Release mutex used to protect access to the cache */
+    mender_scheduler_mutex_give(mender_storage_cache_mutex);
+
+    return ret;
+}
+
+static mender_err_t
+mender_storage_cache_flush(void) {
+
+    mender_err_t ret     = MENDER_OK;
+    bool         written = false;
+
+    /* Write the items, the items which can not be written are loaded again from the storage when they are read */
+    for (size_t index = 0; index < MENDER_STORAGE_ITEM_COUNT; index++) {
+        mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[index];
+        mender_err_t                  result;
+        if (true == entry->dirty) {
+            if (MENDER_STORAGE_CACHE_STATE_PRESENT == entry->state) {
+                result = mender_storage_cache_ops->write((mender_storage_item_t)index, entry->data, entry->length);
+            } else if (MENDER_NOT_FOUND == (result = mender_storage_cache_ops->erase((mender_storage_item_t)index))) {
+                result = MENDER_OK;
+            }
+            entry->dirty = false;
+            written      = true;
+            if (MENDER_OK != result) {
+                mender_log_error("Unable to write storage item %u", (unsigned int)index);
+                mender_storage_cache_release(entry);
+                entry->stored.state = MENDER_STORAGE_CACHE_STATE_UNKNOWN;
+                ret                 = result;
+            } else {
+                mender_storage_cache_set_stored(entry, entry->data, entry->length);
+            }
+        }
+#ifndef CONFIG_MENDER_STORAGE_CACHE
+        /* The items are not kept in RAM once they are written */
+        mender_storage_cache_release(entry);
+#endif /* CONFIG_MENDER_STORAGE_CACHE */
+    }
+
+    /* Commit the items at once */
+    if ((true == written) && (NULL != mender_storage_cache_ops->commit)) {
+        mender_err_t result;
+        if (MENDER_OK != (result = mender_storage_cache_ops->commit())) {
+            mender_log_error("Unable to commit storage items");
+            for (size_t index = 0; index < MENDER_STORAGE_ITEM_COUNT; index++) {
+                mender_storage_cache_entries[index].stored.state = MENDER_STORAGE_CACHE_STATE_UNKNOWN;
+            }
+            ret = result;
+        }
+    }
+
+    return ret;
+}
+
+static bool
+mender_storage_cache_is_stored(mender_storage_item_t item, void *data, size_t length) {
+
+    mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[item];
+    void                         *stored_data;
+    size_t                        stored_length;
+    bool                          identical;
+
+    /* Compare the state, the length and the hash of the item, the item is not loaded if they differ */
+    if (MENDER_STORAGE_CACHE_STATE_UNKNOWN == entry->stored.state) {
+        return false;
+    }
+    if (NULL == data) {
+        return (MENDER_STORAGE_CACHE_STATE_ABSENT == entry->stored.state);
+    }
+    if ((MENDER_STORAGE_CACHE_STATE_PRESENT != entry->stored.state) || (length != entry->stored.length)
+        || (mender_storage_cache_hash(data, length) != entry->stored.hash)) {
+        return false;
+    }
+
+    /* Compare the item read from the storage, reading is cheaper than writing the flash and a collision of the hashes must not skip a write */
+    if (MENDER_OK != mender_storage_cache_ops->read(item, &stored_data, &stored_length)) {
+        return false;
+    }
+    identical = (length == stored_length) && (0 == memcmp(stored_data, data, length));
+    mender_free(stored_data);
+
+    return identical;
+}
+
+static void
+mender_storage_cache_set_stored(mender_storage_cache_entry_t *entry, void *data, size_t length) {
+
+    assert(NULL != entry);
+
+    /* Save the state, the length and the hash of the item */
+    if (NULL != data) {
+        entry->stored.state  = MENDER_STORAGE_CACHE_STATE_PRESENT;
+        entry->stored.length = length;
+        entry->stored.hash   = mender_storage_cache_hash(data, length);
+    } else {
+        entry->stored.state  = MENDER_STORAGE_CACHE_STATE_ABSENT;
+        entry->stored.length = 0;
+        entry->stored.hash   = 0;
+    }
+}
+
+static uint32_t
+mender_storage_cache_hash(void *data, size_t length) {
+
+    uint32_t hash = 2166136261U;
+
+    /* Compute FNV-1a hash of the data */
+    for (size_t index = 0; index < length; index++) {
+        hash = (hash ^ ((uint8_t *)data)[index]) * 16777619U;
+    }
+
+    return hash;
+}
+
+static void
+mender_storage_cache_release(mender_storage_cache_entry_t *entry) {
+
+    assert(NULL != entry);
+
+    /* Release memory */
+    if (NULL != entry->data) {
+        mender_free(entry->data);
+        entry->data = NULL;
+    }
+    entry->length = 0;
+    entry->state  = MENDER_STORAGE_CACHE_STATE_UNKNOWN;
+    entry->dirty  = false;
+}
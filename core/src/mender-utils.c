@@ -19,6 +19,136 @@
 
 #include "mender-log.h"
 
+/**
+ * @brief Alignment of the allocations in the arenas
+ */
+#define MENDER_UTILS_ARENA_ALIGNMENT (_Alignof(max_align_t))
+
+/**
+ * @brief Function used to round a size to the alignment of the allocations in the arenas
+ */
+#define MENDER_UTILS_ARENA_ALIGN(size) (((size) + MENDER_UTILS_ARENA_ALIGNMENT - 1) & ~(MENDER_UTILS_ARENA_ALIGNMENT - 1))
+
+/**
+ * @brief Block of an arena, the allocations follow the header
+ */
+struct mender_utils_arena_block_s {
+    struct mender_utils_arena_block_s *next; /**< Next block, allocated before this one */
+    size_t                             size; /**< Size available for the allocations */
+    size_t                             used; /**< Size used by the allocations */
+};
+
+/**
+ * @brief Magic number of the packed key-stores
+ */
+#define MENDER_UTILS_KEYSTORE_PACKED_MAGIC ((uintptr_t)0x6d6b7370)
+
+/**
+ * @brief Header of a packed key-store, followed by the items and the strings, the value of the last item references the header
+ */
+typedef struct {
+    size_t    size;  /**< Size of the packed key-store, including the header */
+    uintptr_t magic; /**< Magic number of the packed key-stores */
+} mender_utils_keystore_packed_t;
+
+/**
+ * @brief Retrieve the header of a packed key-store
+ * @param keystore Key-store
+ * @return Header of the packed key-store, NULL if the key-store is not packed
+ */
+static mender_utils_keystore_packed_t *mender_utils_keystore_packed(mender_keystore_t *keystore);
+
+/**
+ * @brief Compute the hash of the name of a key-store item (FNV-1a)
+ * @param name Name of the item
+ * @return Hash of the name
+ */
+static uint32_t mender_utils_keystore_hash(const char *name);
+
+/**
+ * @brief Memory allocator, the allocator of the C library by default
+ */
+static mender_allocator_t mender_utils_allocator = { .malloc_fn = malloc, .realloc_fn = realloc, .free_fn = free };
+
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+
+/**
+ * @brief The functions are defined below, the memory allocated by the utility functions is accounted to the client
+ */
+#undef mender_malloc
+#undef mender_calloc
+#undef mender_realloc
+#undef mender_strdup
+#undef mender_strndup
+
+/**
+ * @brief Header of the memory allocated, it precedes the memory returned and preserves its alignment
+ */
+typedef union {
+    struct {
+        size_t                        size;      /**< Size allocated */
+        mender_utils_heap_subsystem_t subsystem; /**< Subsystem the allocation is accounted to */
+    } info;
+    max_align_t align; /**< Alignment of the memory returned */
+} mender_utils_heap_header_t;
+
+/**
+ * @brief Heap statistics of the subsystems, updated atomically because the memory is allocated concurrently and before the scheduler is initialized
+ */
+static mender_utils_heap_statistics_t mender_utils_heap_statistics[MENDER_UTILS_HEAP_SUBSYSTEM_ALL + 1];
+
+/**
+ * @brief Account an allocation or a release to a subsystem and to all the subsystems together
+ * @param subsystem Subsystem
+ * @param size Size allocated, or released if it is negative
+ */
+static void mender_utils_heap_account(mender_utils_heap_subsystem_t subsystem, ssize_t size);
+
+/**
+ * @brief Allocate memory accounted to cJSON, installed as cJSON hook
+ * @param size Size to allocate
+ * @return Memory allocated, NULL if an error occurred
+ */
+static void *mender_utils_heap_json_malloc(size_t size);
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+
+/**
+ * @brief Memory pressure callback
+ */
+typedef struct {
+    void (*callback)(mender_utils_memory_pressure_t, void *); /**< Callback invoked with the new memory pressure level */
+    void   *params;                                            /**< Parameters passed to the callback */
+    uint8_t priority;                                          /**< Priority of the callback, the lowest priority first */
+} mender_utils_memory_pressure_callback_t;
+
+/**
+ * @brief Memory pressure manager, the level is updated atomically because the memory is allocated and released concurrently
+ */
+static struct {
+    mender_utils_memory_pressure_callback_t callbacks[CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_CALLBACKS_COUNT]; /**< Callbacks sorted by priority */
+    size_t                                  count;                                                          /**< Number of callbacks */
+    mender_utils_memory_pressure_t          level;                                                          /**< Memory pressure level */
+    mender_utils_memory_pressure_t          notified; /**< Memory pressure level the callbacks have been invoked with */
+    bool                                    running;  /**< The callbacks are being invoked, the level changes meanwhile are notified after */
+} mender_utils_memory_pressure;
+
+/**
+ * @brief Change the memory pressure level and invoke the callbacks if it is raised, or lowered, to the new level
+ * @param level New memory pressure level
+ * @param raise Raise the level if it is lower than the new level, lower it if it is higher otherwise
+ */
+static void mender_utils_memory_pressure_set(mender_utils_memory_pressure_t level, bool raise);
+
+/**
+ * @brief Invoke the callbacks until they have been invoked with the current memory pressure level, only one context invokes them at a time
+ */
+static void mender_utils_memory_pressure_notify(void);
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+
 char *
 mender_utils_http_status_to_string(int status) {
 
@@ -162,7 +292,7 @@ mender_keystore_t *
 mender_utils_keystore_new(size_t length) {
 
     /* Allocate memory */
-    mender_keystore_t *keystore = (mender_keystore_t *)malloc((length + 1) * sizeof(mender_keystore_item_t));
+    mender_keystore_t *keystore = (mender_keystore_t *)mender_malloc((length + 1) * sizeof(mender_keystore_item_t));
     if (NULL == keystore) {
         mender_log_error("Unable to allocate memory");
         return NULL;
@@ -199,6 +329,115 @@ END:
     return ret;
 }
 
+mender_err_t
+mender_utils_keystore_pack(mender_keystore_t **dst_keystore, mender_keystore_t *src_keystore) {
+
+    assert(NULL != dst_keystore);
+    mender_utils_keystore_packed_t *src_packed;
+    mender_utils_keystore_packed_t *dst_packed;
+    mender_keystore_builder_t       builder;
+    mender_err_t                    ret;
+
+    /* Copy the packed key-store at once, the pointers are moved to the copy */
+    *dst_keystore = NULL;
+    if (NULL != (src_packed = mender_utils_keystore_packed(src_keystore))) {
+        if (NULL == (dst_packed = (mender_utils_keystore_packed_t *)mender_malloc(src_packed->size))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        memcpy(dst_packed, src_packed, src_packed->size);
+        *dst_keystore = (mender_keystore_t *)(dst_packed + 1);
+        size_t index  = 0;
+        for (; NULL != (*dst_keystore)[index].name; index++) {
+            (*dst_keystore)[index].name  = (char *)dst_packed + ((*dst_keystore)[index].name - (char *)src_packed);
+            (*dst_keystore)[index].value = (char *)dst_packed + ((*dst_keystore)[index].value - (char *)src_packed);
+        }
+        (*dst_keystore)[index].value = (char *)dst_packed;
+        return MENDER_OK;
+    }
+
+    /* Pack the key-store */
+    size_t length         = mender_utils_keystore_length(src_keystore);
+    size_t strings_length = 0;
+    for (size_t index = 0; index < length; index++) {
+        strings_length += strlen(src_keystore[index].name) + 1 + strlen(src_keystore[index].value) + 1;
+    }
+    if (MENDER_OK != (ret = mender_utils_keystore_builder_begin(&builder, length, strings_length))) {
+        return ret;
+    }
+    for (size_t index = 0; index < length; index++) {
+        mender_utils_keystore_builder_add(&builder, src_keystore[index].name, src_keystore[index].value);
+    }
+    *dst_keystore = mender_utils_keystore_builder_end(&builder);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_keystore_builder_begin(mender_keystore_builder_t *builder, size_t length, size_t strings_length) {
+
+    assert(NULL != builder);
+    mender_utils_keystore_packed_t *packed;
+    size_t                          size = sizeof(mender_utils_keystore_packed_t) + (length + 1) * sizeof(mender_keystore_item_t) + strings_length;
+
+    /* Allocate the header, the items and the strings at once */
+    if (NULL == (packed = (mender_utils_keystore_packed_t *)mender_malloc(size))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    packed->size  = size;
+    packed->magic = MENDER_UTILS_KEYSTORE_PACKED_MAGIC;
+
+    /* The key-store is empty, the last item references the header so that the key-store is released at once */
+    builder->keystore = (mender_keystore_t *)(packed + 1);
+    builder->size     = length;
+    builder->length   = 0;
+    builder->strings  = (char *)&builder->keystore[length + 1];
+    builder->end      = builder->strings + strings_length;
+    memset(builder->keystore, 0, (length + 1) * sizeof(mender_keystore_item_t));
+    builder->keystore[0].value = (char *)packed;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_keystore_builder_add(mender_keystore_builder_t *builder, const char *name, const char *value) {
+
+    assert(NULL != builder);
+    assert(NULL != builder->keystore);
+    assert(NULL != name);
+    assert(NULL != value);
+    size_t name_length  = strlen(name) + 1;
+    size_t value_length = strlen(value) + 1;
+
+    /* Check the item fits in the key-store */
+    if ((builder->length >= builder->size) || ((size_t)(builder->end - builder->strings) < name_length + value_length)) {
+        mender_log_error("Unable to add item to the key-store, it is full");
+        return MENDER_FAIL;
+    }
+
+    /* Copy name and value, the last item is moved after the new one */
+    builder->keystore[builder->length + 1].value = builder->keystore[builder->length].value;
+    builder->keystore[builder->length].name      = memcpy(builder->strings, name, name_length);
+    builder->keystore[builder->length].value     = memcpy(builder->strings + name_length, value, value_length);
+    builder->strings += name_length + value_length;
+    builder->length++;
+
+    return MENDER_OK;
+}
+
+mender_keystore_t *
+mender_utils_keystore_builder_end(mender_keystore_builder_t *builder) {
+
+    assert(NULL != builder);
+    mender_keystore_t *keystore = builder->keystore;
+
+    /* The key-store is complete, the builder can't be used anymore */
+    builder->keystore = NULL;
+
+    return keystore;
+}
+
 mender_err_t
 mender_utils_keystore_from_json(mender_keystore_t **keystore, cJSON *object) {
 
@@ -212,32 +451,28 @@ mender_utils_keystore_from_json(mender_keystore_t **keystore, cJSON *object) {
     }
     *keystore = NULL;
 
-    /* Set key-store */
+    /* Set key-store, the items and the strings are allocated at once */
     if (NULL != object) {
-        size_t length       = 0;
-        cJSON *current_item = object->child;
+        size_t length         = 0;
+        size_t strings_length = 0;
+        cJSON *current_item   = object->child;
         while (NULL != current_item) {
             if ((NULL != current_item->string) && (NULL != current_item->valuestring)) {
                 length++;
+                strings_length += strlen(current_item->string) + 1 + strlen(current_item->valuestring) + 1;
             }
             current_item = current_item->next;
         }
-        if (NULL != (*keystore = mender_utils_keystore_new(length))) {
-            size_t index = 0;
+        mender_keystore_builder_t builder;
+        if (MENDER_OK == (ret = mender_utils_keystore_builder_begin(&builder, length, strings_length))) {
             current_item = object->child;
             while (NULL != current_item) {
                 if ((NULL != current_item->string) && (NULL != current_item->valuestring)) {
-                    if (MENDER_OK != (ret = mender_utils_keystore_set_item(*keystore, index, current_item->string, current_item->valuestring))) {
-                        mender_log_error("Unable to allocate memory");
-                        return ret;
-                    }
-                    index++;
+                    mender_utils_keystore_builder_add(&builder, current_item->string, current_item->valuestring);
                 }
                 current_item = current_item->next;
             }
-        } else {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
+            *keystore = mender_utils_keystore_builder_end(&builder);
         }
     }
 
@@ -266,30 +501,166 @@ mender_utils_keystore_to_json(mender_keystore_t *keystore, cJSON **object) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_utils_keystore_write_json(mender_keystore_t *keystore, mender_err_t (*write)(void *, size_t, void *), void *ctx) {
+
+    assert(NULL != write);
+    mender_err_t ret;
+
+    /* Write the members of the object */
+    if (MENDER_OK != (ret = write("{", 1, ctx))) {
+        return ret;
+    }
+    if (NULL != keystore) {
+        size_t index = 0;
+        while ((NULL != keystore[index].name) && (NULL != keystore[index].value)) {
+            if ((0 != index) && (MENDER_OK != (ret = write(",", 1, ctx)))) {
+                return ret;
+            }
+            if (MENDER_OK != (ret = mender_utils_json_write_string(write, ctx, keystore[index].name))) {
+                return ret;
+            }
+            if (MENDER_OK != (ret = write(":", 1, ctx))) {
+                return ret;
+            }
+            if (MENDER_OK != (ret = mender_utils_json_write_string(write, ctx, keystore[index].value))) {
+                return ret;
+            }
+            index++;
+        }
+    }
+
+    return write("}", 1, ctx);
+}
+
+mender_err_t
+mender_utils_keystore_to_json_string(mender_keystore_t *keystore, char **json) {
+
+    assert(NULL != json);
+    mender_err_t          ret;
+    mender_utils_buffer_t buffer = { .data = NULL, .size = 0, .length = 0 };
+
+    /* Compute the length of the string */
+    if (MENDER_OK != (ret = mender_utils_keystore_write_json(keystore, &mender_utils_buffer_write, &buffer))) {
+        return ret;
+    }
+
+    /* Allocate the string and write it */
+    if (NULL == (buffer.data = (char *)mender_malloc(buffer.length + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    buffer.size   = buffer.length + 1;
+    buffer.length = 0;
+    if (MENDER_OK != (ret = mender_utils_keystore_write_json(keystore, &mender_utils_buffer_write, &buffer))) {
+        mender_free(buffer.data);
+        return ret;
+    }
+    *json = buffer.data;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_json_write_string(mender_err_t (*write)(void *, size_t, void *), void *ctx, const char *str) {
+
+    assert(NULL != write);
+    assert(NULL != str);
+    mender_err_t ret;
+    char         escape[7];
+    size_t       length;
+
+    /* Write the string, the characters which do not need to be escaped are written at once */
+    if (MENDER_OK != (ret = write("\"", 1, ctx))) {
+        return ret;
+    }
+    while ('\0' != *str) {
+        length = 0;
+        while (('\0' != str[length]) && ('"' != str[length]) && ('\\' != str[length]) && ((unsigned char)str[length] >= 0x20)) {
+            length++;
+        }
+        if (0 != length) {
+            if (MENDER_OK != (ret = write((void *)str, length, ctx))) {
+                return ret;
+            }
+            str += length;
+            continue;
+        }
+        switch (*str) {
+            case '"':
+            case '\\':
+                snprintf(escape, sizeof(escape), "\\%c", *str);
+                break;
+            case '\b':
+                snprintf(escape, sizeof(escape), "\\b");
+                break;
+            case '\f':
+                snprintf(escape, sizeof(escape), "\\f");
+                break;
+            case '\n':
+                snprintf(escape, sizeof(escape), "\\n");
+                break;
+            case '\r':
+                snprintf(escape, sizeof(escape), "\\r");
+                break;
+            case '\t':
+                snprintf(escape, sizeof(escape), "\\t");
+                break;
+            default:
+                snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)*str);
+                break;
+        }
+        if (MENDER_OK != (ret = write(escape, strlen(escape), ctx))) {
+            return ret;
+        }
+        str++;
+    }
+
+    return write("\"", 1, ctx);
+}
+
+mender_err_t
+mender_utils_buffer_write(void *data, size_t length, void *ctx) {
+
+    assert(NULL != ctx);
+    mender_utils_buffer_t *buffer = (mender_utils_buffer_t *)ctx;
+
+    /* Copy the data which fit in the buffer, the whole length is counted */
+    if ((NULL != buffer->data) && (buffer->length < buffer->size)) {
+        size_t available = buffer->size - buffer->length - 1;
+        memcpy(buffer->data + buffer->length, data, (length < available) ? length : available);
+        buffer->data[buffer->length + ((length < available) ? length : available)] = '\0';
+    }
+    buffer->length += length;
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_utils_keystore_set_item(mender_keystore_t *keystore, size_t index, char *name, char *value) {
 
     assert(NULL != keystore);
+    assert(NULL == mender_utils_keystore_packed(keystore));
 
     /* Release memory */
     if (NULL != keystore[index].name) {
-        free(keystore[index].name);
+        mender_free(keystore[index].name);
         keystore[index].name = NULL;
     }
     if (NULL != keystore[index].value) {
-        free(keystore[index].value);
+        mender_free(keystore[index].value);
         keystore[index].value = NULL;
     }
 
     /* Copy name and value */
     if (NULL != name) {
-        if (NULL == (keystore[index].name = strdup(name))) {
+        if (NULL == (keystore[index].name = mender_strdup(name))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
     }
     if (NULL != value) {
-        if (NULL == (keystore[index].value = strdup(value))) {
+        if (NULL == (keystore[index].value = mender_strdup(value))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
@@ -336,20 +707,652 @@ mender_utils_keystore_length(mender_keystore_t *keystore) {
 mender_err_t
 mender_utils_keystore_delete(mender_keystore_t *keystore) {
 
-    /* Release memory */
-    if (NULL != keystore) {
+    mender_utils_keystore_packed_t *packed;
+
+    /* Release memory, the packed key-stores are allocated at once */
+    if (NULL != (packed = mender_utils_keystore_packed(keystore))) {
+        mender_free(packed);
+    } else if (NULL != keystore) {
         size_t index = 0;
         while ((NULL != keystore[index].name) || (NULL != keystore[index].value)) {
             if (NULL != keystore[index].name) {
-                free(keystore[index].name);
+                mender_free(keystore[index].name);
             }
             if (NULL != keystore[index].value) {
-                free(keystore[index].value);
+                mender_free(keystore[index].value);
             }
             index++;
         }
-        free(keystore);
+        mender_free(keystore);
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_keystore_index_build(mender_keystore_t *keystore, mender_keystore_index_t *index) {
+
+    assert(NULL != index);
+    size_t   length = mender_utils_keystore_length(keystore);
+    size_t   size   = 1;
+    uint32_t bucket;
+
+    /* Release previous index */
+    mender_utils_keystore_index_release(index);
+
+    /* Allocate the buckets, the table is kept at most half full so that the probes are short */
+    while (size < 2 * length) {
+        size *= 2;
+    }
+    if (NULL == (index->buckets = (uint32_t *)mender_calloc(size, sizeof(uint32_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    index->size   = size;
+    index->length = length;
+
+    /* Insert the items with linear probing, the first item is kept if the names are duplicated like with mender_utils_keystore_get_item_index */
+    for (size_t item = 0; item < length; item++) {
+        bucket = mender_utils_keystore_hash(keystore[item].name) & (size - 1);
+        while ((0 != index->buckets[bucket]) && (0 != strcmp(keystore[index->buckets[bucket] - 1].name, keystore[item].name))) {
+            bucket = (bucket + 1) & (size - 1);
+        }
+        if (0 == index->buckets[bucket]) {
+            index->buckets[bucket] = (uint32_t)item + 1;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+int
+mender_utils_keystore_index_lookup(mender_keystore_t *keystore, mender_keystore_index_t *index, char *name) {
+
+    assert(NULL != index);
+    uint32_t bucket;
+
+    /* Fall back to a linear search if the index is not built */
+    if (NULL == index->buckets) {
+        return mender_utils_keystore_get_item_index(keystore, name);
+    }
+    if ((NULL == keystore) || (NULL == name)) {
+        return -1;
+    }
+
+    /* Probe the buckets until the item or an empty bucket is found */
+    bucket = mender_utils_keystore_hash(name) & (index->size - 1);
+    while (0 != index->buckets[bucket]) {
+        if (0 == strcmp(keystore[index->buckets[bucket] - 1].name, name)) {
+            return (int)index->buckets[bucket] - 1;
+        }
+        bucket = (bucket + 1) & (index->size - 1);
+    }
+
+    /* Index not found */
+    return -1;
+}
+
+void
+mender_utils_keystore_index_release(mender_keystore_index_t *index) {
+
+    assert(NULL != index);
+
+    /* Release memory */
+    if (NULL != index->buckets) {
+        mender_free(index->buckets);
+        index->buckets = NULL;
+    }
+    index->size   = 0;
+    index->length = 0;
+}
+
+static mender_utils_keystore_packed_t *
+mender_utils_keystore_packed(mender_keystore_t *keystore) {
+
+    mender_utils_keystore_packed_t *packed;
+    size_t                          index = 0;
+
+    /* The value of the last item of a packed key-store references the header preceding the items */
+    if (NULL == keystore) {
+        return NULL;
+    }
+    while (NULL != keystore[index].name) {
+        index++;
+    }
+    packed = (mender_utils_keystore_packed_t *)((char *)keystore - sizeof(mender_utils_keystore_packed_t));
+    if (((char *)packed != keystore[index].value) || (MENDER_UTILS_KEYSTORE_PACKED_MAGIC != packed->magic)) {
+        return NULL;
+    }
+
+    return packed;
+}
+
+static uint32_t
+mender_utils_keystore_hash(const char *name) {
+
+    uint32_t hash = 2166136261U;
+
+    /* Compute FNV-1a hash of the name */
+    for (; '\0' != *name; name++) {
+        hash = (hash ^ (uint8_t)*name) * 16777619U;
+    }
+
+    return hash;
+}
+
+mender_err_t
+mender_utils_set_allocator(mender_allocator_t *allocator) {
+
+    /* Check the allocator */
+    if ((NULL != allocator) && ((NULL == allocator->malloc_fn) || (NULL == allocator->realloc_fn) || (NULL == allocator->free_fn))) {
+        mender_log_error("Invalid allocator");
+        return MENDER_FAIL;
+    }
+
+    /* Save the allocator */
+    if (NULL != allocator) {
+        memcpy(&mender_utils_allocator, allocator, sizeof(mender_allocator_t));
+    } else {
+        mender_utils_allocator.malloc_fn  = malloc;
+        mender_utils_allocator.realloc_fn = realloc;
+        mender_utils_allocator.free_fn    = free;
+    }
+
+    /* Configure cJSON to use the allocator */
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+    return mender_utils_heap_init();
+#else
+    cJSON_Hooks hooks = { .malloc_fn = mender_utils_allocator.malloc_fn, .free_fn = mender_utils_allocator.free_fn };
+    cJSON_InitHooks(&hooks);
+
+    return MENDER_OK;
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+}
+
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+
+mender_err_t
+mender_utils_heap_init(void) {
+
+    /* Configure cJSON to use the allocator, the memory it allocates has a header so it must be released with mender_free */
+    cJSON_Hooks hooks = { .malloc_fn = mender_utils_heap_json_malloc, .free_fn = mender_free };
+    cJSON_InitHooks(&hooks);
+
+    return MENDER_OK;
+}
+
+void *
+mender_malloc(size_t size) {
+
+    return mender_utils_heap_malloc(MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT, size);
+}
+
+void *
+mender_calloc(size_t count, size_t size) {
+
+    return mender_utils_heap_calloc(MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT, count, size);
+}
+
+void *
+mender_realloc(void *ptr, size_t size) {
+
+    return mender_utils_heap_realloc(MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT, ptr, size);
+}
+
+void
+mender_free(void *ptr) {
+
+    mender_utils_heap_header_t *header;
+
+    /* Account the release to the subsystem that has allocated the memory */
+    if (NULL != ptr) {
+        header = (mender_utils_heap_header_t *)ptr - 1;
+        mender_utils_heap_account(header->info.subsystem, -(ssize_t)header->info.size);
+        mender_utils_allocator.free_fn(header);
+    }
+}
+
+char *
+mender_strdup(const char *str) {
+
+    assert(NULL != str);
+
+    return mender_utils_heap_strndup(MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT, str, strlen(str));
+}
+
+char *
+mender_strndup(const char *str, size_t length) {
+
+    return mender_utils_heap_strndup(MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT, str, length);
+}
+
+void *
+mender_utils_heap_malloc(mender_utils_heap_subsystem_t subsystem, size_t size) {
+
+    assert(subsystem < MENDER_UTILS_HEAP_SUBSYSTEM_ALL);
+    mender_utils_heap_header_t *header;
+
+    /* Allocate the memory and its header */
+    if (size > SIZE_MAX - sizeof(mender_utils_heap_header_t)) {
+        __atomic_add_fetch(&mender_utils_heap_statistics[subsystem].failures, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mender_utils_heap_statistics[MENDER_UTILS_HEAP_SUBSYSTEM_ALL].failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    header = mender_utils_allocator.malloc_fn(sizeof(mender_utils_heap_header_t) + size);
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+    /* Invoke the memory pressure callbacks so that they release memory and try again */
+    if (NULL == header) {
+        mender_utils_memory_pressure_set(MENDER_UTILS_MEMORY_PRESSURE_CRITICAL, true);
+        header = mender_utils_allocator.malloc_fn(sizeof(mender_utils_heap_header_t) + size);
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+    if (NULL == header) {
+        __atomic_add_fetch(&mender_utils_heap_statistics[subsystem].failures, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mender_utils_heap_statistics[MENDER_UTILS_HEAP_SUBSYSTEM_ALL].failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    header->info.size      = size;
+    header->info.subsystem = subsystem;
+    mender_utils_heap_account(subsystem, (ssize_t)size);
+
+    return header + 1;
+}
+
+void *
+mender_utils_heap_calloc(mender_utils_heap_subsystem_t subsystem, size_t count, size_t size) {
+
+    void *ptr;
+
+    /* Check the size does not overflow */
+    if ((0 != count) && (size > SIZE_MAX / count)) {
+        return NULL;
+    }
+
+    /* Allocate memory and initialize it to zero */
+    if (NULL != (ptr = mender_utils_heap_malloc(subsystem, count * size))) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void *
+mender_utils_heap_realloc(mender_utils_heap_subsystem_t subsystem, void *ptr, size_t size) {
+
+    mender_utils_heap_header_t *header;
+    mender_utils_heap_header_t *resized;
+    size_t                      previous;
+
+    /* Allocate memory if there is nothing to resize */
+    if (NULL == ptr) {
+        return mender_utils_heap_malloc(subsystem, size);
+    }
+
+    /* Resize the memory and its header, it remains accounted to its subsystem */
+    header    = (mender_utils_heap_header_t *)ptr - 1;
+    previous  = header->info.size;
+    subsystem = header->info.subsystem;
+    if (size > SIZE_MAX - sizeof(mender_utils_heap_header_t)) {
+        __atomic_add_fetch(&mender_utils_heap_statistics[subsystem].failures, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mender_utils_heap_statistics[MENDER_UTILS_HEAP_SUBSYSTEM_ALL].failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    resized = mender_utils_allocator.realloc_fn(header, sizeof(mender_utils_heap_header_t) + size);
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+    /* Invoke the memory pressure callbacks so that they release memory and try again, the memory to resize is not released meanwhile */
+    if (NULL == resized) {
+        mender_utils_memory_pressure_set(MENDER_UTILS_MEMORY_PRESSURE_CRITICAL, true);
+        resized = mender_utils_allocator.realloc_fn(header, sizeof(mender_utils_heap_header_t) + size);
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+    if (NULL == resized) {
+        __atomic_add_fetch(&mender_utils_heap_statistics[subsystem].failures, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mender_utils_heap_statistics[MENDER_UTILS_HEAP_SUBSYSTEM_ALL].failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    header            = resized;
+    header->info.size = size;
+    mender_utils_heap_account(subsystem, -(ssize_t)previous);
+    mender_utils_heap_account(subsystem, (ssize_t)size);
+
+    return header + 1;
+}
+
+char *
+mender_utils_heap_strndup(mender_utils_heap_subsystem_t subsystem, const char *str, size_t length) {
+
+    assert(NULL != str);
+    char *tmp;
+
+    /* Duplicate the string, at most length characters */
+    length = strnlen(str, length);
+    if (NULL != (tmp = (char *)mender_utils_heap_malloc(subsystem, length + 1))) {
+        memcpy(tmp, str, length);
+        tmp[length] = '\0';
+    }
+
+    return tmp;
+}
+
+mender_err_t
+mender_utils_get_heap_statistics(mender_utils_heap_subsystem_t subsystem, mender_utils_heap_statistics_t *statistics) {
+
+    assert(NULL != statistics);
+
+    /* Check the subsystem */
+    if (subsystem > MENDER_UTILS_HEAP_SUBSYSTEM_ALL) {
+        mender_log_error("Invalid subsystem");
+        return MENDER_FAIL;
+    }
+
+    /* Copy the statistics, the fields are read atomically one by one */
+    statistics->current     = __atomic_load_n(&mender_utils_heap_statistics[subsystem].current, __ATOMIC_RELAXED);
+    statistics->peak        = __atomic_load_n(&mender_utils_heap_statistics[subsystem].peak, __ATOMIC_RELAXED);
+    statistics->count       = __atomic_load_n(&mender_utils_heap_statistics[subsystem].count, __ATOMIC_RELAXED);
+    statistics->allocations = __atomic_load_n(&mender_utils_heap_statistics[subsystem].allocations, __ATOMIC_RELAXED);
+    statistics->failures    = __atomic_load_n(&mender_utils_heap_statistics[subsystem].failures, __ATOMIC_RELAXED);
+
+    return MENDER_OK;
+}
+
+char *
+mender_utils_heap_subsystem_to_string(mender_utils_heap_subsystem_t subsystem) {
+
+    /* Definition of subsystem strings */
+    const char *desc[]
+        = { "client", "api", "artifact", "json", "http", "tls", "storage", "flash", "scheduler", "troubleshoot", "inventory", "configure", "all" };
+
+    /* Return subsystem as string */
+    if (subsystem <= MENDER_UTILS_HEAP_SUBSYSTEM_ALL) {
+        return (char *)desc[subsystem];
+    }
+
+    return NULL;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+
+mender_err_t
+mender_utils_memory_pressure_register(void (*callback)(mender_utils_memory_pressure_t, void *), void *params, uint8_t priority) {
+
+    assert(NULL != callback);
+    size_t index;
+
+    /* Check if there is a free entry */
+    if (CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_CALLBACKS_COUNT == mender_utils_memory_pressure.count) {
+        mender_log_error("Unable to register memory pressure callback, too many callbacks");
+        return MENDER_FAIL;
     }
 
+    /* Insert the callback after the callbacks of the same priority */
+    for (index = mender_utils_memory_pressure.count; (index > 0) && (mender_utils_memory_pressure.callbacks[index - 1].priority > priority); index--) {
+        mender_utils_memory_pressure.callbacks[index] = mender_utils_memory_pressure.callbacks[index - 1];
+    }
+    mender_utils_memory_pressure.callbacks[index].callback = callback;
+    mender_utils_memory_pressure.callbacks[index].params   = params;
+    mender_utils_memory_pressure.callbacks[index].priority = priority;
+    mender_utils_memory_pressure.count++;
+
     return MENDER_OK;
 }
+
+void
+mender_utils_memory_pressure_unregister(void (*callback)(mender_utils_memory_pressure_t, void *), void *params) {
+
+    /* Remove the callback */
+    for (size_t index = 0; index < mender_utils_memory_pressure.count; index++) {
+        if ((callback == mender_utils_memory_pressure.callbacks[index].callback) && (params == mender_utils_memory_pressure.callbacks[index].params)) {
+            mender_utils_memory_pressure.count--;
+            memmove(&mender_utils_memory_pressure.callbacks[index],
+                    &mender_utils_memory_pressure.callbacks[index + 1],
+                    (mender_utils_memory_pressure.count - index) * sizeof(mender_utils_memory_pressure_callback_t));
+            return;
+        }
+    }
+}
+
+mender_utils_memory_pressure_t
+mender_utils_memory_pressure_get(void) {
+
+    return __atomic_load_n(&mender_utils_memory_pressure.level, __ATOMIC_RELAXED);
+}
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+
+static void
+mender_utils_heap_account(mender_utils_heap_subsystem_t subsystem, ssize_t size) {
+
+    mender_utils_heap_subsystem_t subsystems[] = { subsystem, MENDER_UTILS_HEAP_SUBSYSTEM_ALL };
+
+    /* Update the statistics of the subsystem and of all the subsystems together */
+    for (size_t index = 0; index < sizeof(subsystems) / sizeof(subsystems[0]); index++) {
+        mender_utils_heap_statistics_t *statistics = &mender_utils_heap_statistics[subsystems[index]];
+        if (size >= 0) {
+            size_t current = __atomic_add_fetch(&statistics->current, (size_t)size, __ATOMIC_RELAXED);
+            size_t peak    = __atomic_load_n(&statistics->peak, __ATOMIC_RELAXED);
+            while ((current > peak) && (!__atomic_compare_exchange_n(&statistics->peak, &peak, current, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+                /* The peak has been updated concurrently, try again */
+            }
+            __atomic_add_fetch(&statistics->count, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&statistics->allocations, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_sub_fetch(&statistics->current, (size_t)(-size), __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&statistics->count, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+    /* Update the memory pressure level depending on the memory allocated by all the subsystems, the watermarks provide an hysteresis */
+    size_t current = __atomic_load_n(&mender_utils_heap_statistics[MENDER_UTILS_HEAP_SUBSYSTEM_ALL].current, __ATOMIC_RELAXED);
+    if (size >= 0) {
+        if (current > CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_HIGH_WATERMARK) {
+            mender_utils_memory_pressure_set(MENDER_UTILS_MEMORY_PRESSURE_HIGH, true);
+        }
+    } else {
+        mender_utils_memory_pressure_set(
+            (current < CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_LOW_WATERMARK) ? MENDER_UTILS_MEMORY_PRESSURE_NONE : MENDER_UTILS_MEMORY_PRESSURE_HIGH, false);
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+}
+
+static void *
+mender_utils_heap_json_malloc(size_t size) {
+
+    return mender_utils_heap_malloc(MENDER_UTILS_HEAP_SUBSYSTEM_JSON, size);
+}
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+
+static void
+mender_utils_memory_pressure_set(mender_utils_memory_pressure_t level, bool raise) {
+
+    mender_utils_memory_pressure_t current = __atomic_load_n(&mender_utils_memory_pressure.level, __ATOMIC_RELAXED);
+
+    /* Change the level, it may have been changed concurrently */
+    do {
+        if (((true == raise) && (current >= level)) || ((false == raise) && (current <= level))) {
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&mender_utils_memory_pressure.level, &current, level, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    /* Invoke the callbacks */
+    mender_utils_memory_pressure_notify();
+}
+
+static void
+mender_utils_memory_pressure_notify(void) {
+
+    mender_utils_memory_pressure_t level;
+    bool                           running;
+
+    /* Invoke the callbacks again if the level has changed after they have been invoked by another context */
+    do {
+        running = false;
+        if (!__atomic_compare_exchange_n(&mender_utils_memory_pressure.running, &running, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        while ((level = __atomic_load_n(&mender_utils_memory_pressure.level, __ATOMIC_ACQUIRE))
+               != __atomic_load_n(&mender_utils_memory_pressure.notified, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&mender_utils_memory_pressure.notified, level, __ATOMIC_RELAXED);
+            for (size_t index = 0; index < mender_utils_memory_pressure.count; index++) {
+                mender_utils_memory_pressure.callbacks[index].callback(level, mender_utils_memory_pressure.callbacks[index].params);
+            }
+        }
+        __atomic_store_n(&mender_utils_memory_pressure.running, false, __ATOMIC_RELEASE);
+    } while (__atomic_load_n(&mender_utils_memory_pressure.level, __ATOMIC_ACQUIRE)
+             != __atomic_load_n(&mender_utils_memory_pressure.notified, __ATOMIC_RELAXED));
+}
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+
+#else
+
+void *
+mender_malloc(size_t size) {
+
+    return mender_utils_allocator.malloc_fn(size);
+}
+
+void *
+mender_calloc(size_t count, size_t size) {
+
+    void *ptr;
+
+    /* Check the size does not overflow */
+    if ((0 != count) && (size > SIZE_MAX / count)) {
+        return NULL;
+    }
+
+    /* Allocate memory and initialize it to zero */
+    if (NULL != (ptr = mender_utils_allocator.malloc_fn(count * size))) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void *
+mender_realloc(void *ptr, size_t size) {
+
+    return mender_utils_allocator.realloc_fn(ptr, size);
+}
+
+void
+mender_free(void *ptr) {
+
+    if (NULL != ptr) {
+        mender_utils_allocator.free_fn(ptr);
+    }
+}
+
+char *
+mender_strdup(const char *str) {
+
+    assert(NULL != str);
+
+    return mender_strndup(str, strlen(str));
+}
+
+char *
+mender_strndup(const char *str, size_t length) {
+
+    assert(NULL != str);
+    char *tmp;
+
+    /* Duplicate the string, at most length characters */
+    length = strnlen(str, length);
+    if (NULL != (tmp = (char *)mender_utils_allocator.malloc_fn(length + 1))) {
+        memcpy(tmp, str, length);
+        tmp[length] = '\0';
+    }
+
+    return tmp;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+
+void *
+mender_utils_arena_alloc(mender_utils_arena_t *arena, size_t size) {
+
+    assert(NULL != arena);
+    mender_utils_arena_block_t *block;
+    size_t                      header = MENDER_UTILS_ARENA_ALIGN(sizeof(mender_utils_arena_block_t));
+
+    /* Bump the allocation in the current block if it fits */
+    size = MENDER_UTILS_ARENA_ALIGN(size);
+    if ((NULL != arena->blocks) && (arena->blocks->size - arena->blocks->used >= size)) {
+        block = arena->blocks;
+    } else {
+        /* Allocate a new block, larger allocations get a dedicated block */
+        size_t block_size = (size > arena->block_size) ? size : MENDER_UTILS_ARENA_ALIGN(arena->block_size);
+        if (NULL == (block = (mender_utils_arena_block_t *)mender_malloc(header + block_size))) {
+            return NULL;
+        }
+        block->size   = block_size;
+        block->used   = 0;
+        block->next   = arena->blocks;
+        arena->blocks = block;
+    }
+    arena->last = (uint8_t *)block + header + block->used;
+    block->used += size;
+
+    return arena->last;
+}
+
+void *
+mender_utils_arena_realloc(mender_utils_arena_t *arena, void *ptr, size_t old_size, size_t size) {
+
+    assert(NULL != arena);
+    void  *tmp;
+    size_t header = MENDER_UTILS_ARENA_ALIGN(sizeof(mender_utils_arena_block_t));
+
+    /* Allocate memory if there is nothing to resize */
+    if (NULL == ptr) {
+        return mender_utils_arena_alloc(arena, size);
+    }
+
+    /* Resize the last allocation in place if the current block permits it */
+    if ((ptr == arena->last) && (NULL != arena->blocks)) {
+        size_t offset = (size_t)((uint8_t *)ptr - ((uint8_t *)arena->blocks + header));
+        if (MENDER_UTILS_ARENA_ALIGN(size) <= arena->blocks->size - offset) {
+            arena->blocks->used = offset + MENDER_UTILS_ARENA_ALIGN(size);
+            return ptr;
+        }
+    }
+
+    /* Allocate new memory and copy the data otherwise, the previous memory is released with the arena */
+    if (NULL != (tmp = mender_utils_arena_alloc(arena, size))) {
+        memcpy(tmp, ptr, (old_size < size) ? old_size : size);
+    }
+
+    return tmp;
+}
+
+char *
+mender_utils_arena_strdup(mender_utils_arena_t *arena, const char *str) {
+
+    assert(NULL != arena);
+    assert(NULL != str);
+    char *tmp;
+
+    /* Duplicate the string in the arena */
+    if (NULL != (tmp = (char *)mender_utils_arena_alloc(arena, strlen(str) + 1))) {
+        strcpy(tmp, str);
+    }
+
+    return tmp;
+}
+
+void
+mender_utils_arena_release(mender_utils_arena_t *arena) {
+
+    assert(NULL != arena);
+    mender_utils_arena_block_t *block;
+
+    /* Release all the blocks at once */
+    while (NULL != (block = arena->blocks)) {
+        arena->blocks = block->next;
+        mender_free(block);
+    }
+    arena->last = NULL;
+}
@@ -34,6 +34,8 @@ typedef struct {
     mender_err_t (*activate)(void);       /**< Invoked to activate the add-on */
     mender_err_t (*deactivate)(void);     /**< Invoked to deactivate the add-on */
     mender_err_t (*exit)(void);           /**< Invoked to cleanup the add-on */
+    mender_err_t (*check_in)(void);       /**< Invoked to perform the periodic work of the add-on during the check-in of the client (optional) */
+    int32_t (*get_check_in_period)(void); /**< Invoked to retrieve the period of the check-in work (seconds), negative or null value permits to disable it */
 } mender_addon_instance_t;
 
 #ifdef __cplusplus
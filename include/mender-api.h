@@ -25,19 +25,38 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include "mender-http.h"
+#include "mender-json.h"
 #include "mender-utils.h"
 
 /**
  * @brief Mender API configuration
  */
 typedef struct {
-    mender_keystore_t *identity;      /**< Identity of the device */
-    char              *artifact_name; /**< Artifact name */
-    char              *device_type;   /**< Device type */
-    char              *host;          /**< URL of the mender server */
-    char              *tenant_token;  /**< Tenant token used to authenticate on the mender server (optional) */
+    mender_keystore_t *identity;            /**< Identity of the device */
+    char              *artifact_name;       /**< Artifact name */
+    char              *device_type;         /**< Device type */
+    char              *host;                /**< URL of the mender server */
+    char              *tenant_token;        /**< Tenant token used to authenticate on the mender server (optional) */
+    char              *artifact_verify_key; /**< Public key used to verify the signature of the artifacts (PEM format, optional) */
+    bool (*artifact_meta_data_filter)(char *, char *); /**< Function used to check if a meta-data value of the artifacts is needed (optional) */
+    void (*artifact_download_progress)(size_t, size_t); /**< Function invoked when artifact data are processed with the processed and total lengths */
+    uint32_t artifact_download_rate_limit;              /**< Maximum rate of the artifact downloads (bytes per second), 0 if unlimited */
+    uint32_t artifact_download_pause_timeout;           /**< Duration after which the connection of a paused download is closed (seconds), 0 to keep it open */
 } mender_api_config_t;
 
+/**
+ * @brief Text response of the HTTP requests, to be used with mender_api_http_text_callback
+ */
+typedef struct {
+    char                 *data;        /**< Response, NULL terminated, NULL if no data has been received */
+    size_t                length;      /**< Length of the response */
+    size_t                size;        /**< Size of the buffer allocated to store the response */
+    uint32_t              retry_after; /**< Delay requested by the server with the Retry-After header (seconds), 0 if none */
+    mender_utils_arena_t *arena;       /**< Arena used to allocate the buffer of the response, which is then released with the arena, NULL if none */
+    mender_json_reader_t *json;        /**< JSON reader parsing the response as it is received if the status is 200, it is not stored then, NULL if none */
+    int                  *status;      /**< Status of the response, set before the data are received, required with the JSON reader */
+} mender_api_response_t;
+
 /**
  * @brief Initialization of the API
  * @param config Mender API configuration
@@ -59,23 +78,42 @@ char *mender_api_get_authentication_token(void);
 
 /**
  * @brief Check for deployments for the device from the mender-server
+ * @param device_provides Attributes of the device used by the mender-server to select a compatible artifact, NULL to use the artifact name and device type only
  * @param id ID of the deployment, if one is pending
  * @param artifact_name Artifact name of the deployment, if one is pending
  * @param uri URI of the deployment, if one is pending
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_api_check_for_deployment(char **id, char **artifact_name, char **uri);
+mender_err_t mender_api_check_for_deployment(mender_keystore_t *device_provides, char **id, char **artifact_name, char **uri);
+
+/**
+ * @brief Get the delay requested by the server when the last authentication or check for deployments has been rejected with status 429 or 503
+ * @return Delay requested by the server (seconds), 0 if none
+ */
+uint32_t mender_api_get_retry_after(void);
 
 /**
  * @brief Publish deployment status of the device to the mender-server
  * @param id ID of the deployment received from mender_api_check_for_deployment function
  * @param deployment_status Deployment status
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the deployment does not exist anymore or has been aborted, error code otherwise
  */
 mender_err_t mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status);
 
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+
+/**
+ * @brief Publish the logs captured during the deployment to the mender-server
+ * @param id ID of the deployment received from mender_api_check_for_deployment function
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_publish_deployment_logs(char *id);
+
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
 /**
- * @brief Download artifact from the mender-server
+ * @brief Download artifact from the mender-server, the download is resumed if it has been interrupted
+ * @note The interrupted download is kept in RAM only, it is lost on reset; resuming after a reset relies on CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
  * @param uri URI of the deployment received from mender_api_check_for_deployment function
  * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -83,24 +121,111 @@ mender_err_t mender_api_publish_deployment_status(char *id, mender_deployment_st
 mender_err_t mender_api_download_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
 
 /**
- * @brief HTTP callback used to handle text content
- * @param event HTTP client event
- * @param data Data received
- * @param data_length Data length
- * @param params Callback parameters
+ * @brief Get the length of the artifact already processed if the download has been interrupted since the last reset
+ * @return Length of the artifact already processed (bytes), 0 if the download can not be resumed
+ */
+size_t mender_api_get_artifact_download_offset(void);
+
+/**
+ * @brief Get the total length of the artifact if the download has been interrupted
+ * @return Total length of the artifact (bytes), 0 if unknown or if the download can not be resumed
+ */
+size_t mender_api_get_artifact_download_size(void);
+
+/**
+ * @brief Cancel the interrupted download of the artifact, the next download starts from the beginning
+ */
+void mender_api_cancel_artifact_download(void);
+
+/**
+ * @brief Set the maximum rate of the artifact downloads, the reception of the data is paced with a token bucket
+ * @param rate Maximum rate (bytes per second), 0 if unlimited
+ */
+void mender_api_set_artifact_download_rate_limit(uint32_t rate);
+
+/**
+ * @brief Pause the artifact download, the data are not read anymore until the download is resumed
+ * @note The connection is closed if the pause lasts longer than the pause timeout, the download is then resumed from the data already processed
+ */
+void mender_api_pause_artifact_download(void);
+
+/**
+ * @brief Resume the artifact download paused
+ * @return true if the connection has been closed during the pause, the download must be performed again to be resumed
+ */
+bool mender_api_resume_artifact_download(void);
+
+/**
+ * @brief Download artifact from the mender-server without parsing it, the download is resumed if it has been interrupted
+ * @param uri URI of the deployment received from mender_api_check_for_deployment function
+ * @param callback Callback function to be invoked to store the data of the artifact with their index and length
  * @return MENDER_OK if the function succeeds, error code otherwise
+ * @note The artifact is then processed with mender_api_process_staged_artifact once the connection is released
  */
-mender_err_t mender_api_http_text_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+mender_err_t mender_api_stage_artifact(char *uri, mender_err_t (*callback)(void *, size_t, size_t));
+
+/**
+ * @brief Process an artifact previously downloaded with mender_api_stage_artifact
+ * @param size Size of the artifact
+ * @param read Function invoked to read back the data of the artifact with their index and length
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_process_staged_artifact(size_t                 size,
+                                                mender_err_t (*read)(void *, size_t, size_t),
+                                                mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+
+#ifdef CONFIG_MENDER_ARTIFACT_PREFLIGHT
+
+/**
+ * @brief Check artifact from the mender-server before downloading it, only the leading part of the artifact is downloaded
+ * @param uri URI of the deployment received from mender_api_check_for_deployment function
+ * @param callback Callback function invoked with the type and the meta-data of the payload, then with the name and the size of its first file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_check_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t));
+
+#endif /* CONFIG_MENDER_ARTIFACT_PREFLIGHT */
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+/**
+ * @brief Get the position in the artifact of the data of the file being downloaded, so that the download can be resumed from it after a reset
+ * @param name Name of the file, path of the TAR files included, valid until the data of the file have been processed
+ * @param offset Offset of the data of the file in the artifact (bytes)
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if no file is being downloaded or if the file is compressed
+ */
+mender_err_t mender_api_get_artifact_file_position(char **name, size_t *offset);
 
 /**
- * @brief HTTP callback used to handle artifact content
+ * @brief Seek the download of the artifact to the data of a file partly written before a reset, the download is then resumed with mender_api_download_artifact
+ * @note The leading part of the artifact is downloaded to parse the headers again, the data already written are read back to compute the checksum of the file
+ * @param uri URI of the deployment received from mender_api_check_for_deployment function
+ * @param callback Callback function invoked at the beginning of the payloads, the data of the files preceding the file are not expected
+ * @param name Name of the file, path of the TAR files included
+ * @param offset Offset of the data of the file in the artifact (bytes)
+ * @param index Length of the data of the file already written (bytes), multiple of the TAR block size
+ * @param read Function invoked to read back the data already written with their index and length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_seek_artifact_download(char *uri,
+                                               mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t),
+                                               char  *name,
+                                               size_t offset,
+                                               size_t index,
+                                               mender_err_t (*read)(void *, size_t, size_t));
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+/**
+ * @brief HTTP callback used to handle text content, the buffer of the response is allocated once if the content length is known and grows geometrically otherwise
  * @param event HTTP client event
  * @param data Data received
  * @param data_length Data length
- * @param params Callback parameters
+ * @param params Callback parameters, the response of type mender_api_response_t
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_api_http_artifact_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+mender_err_t mender_api_http_text_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
 
 /**
  * @brief Print response error
@@ -0,0 +1,76 @@
+/**
+ * @file      mender-artifact-decompress.h
+ * @brief     Mender artifact decompression interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_ARTIFACT_DECOMPRESS_H__
+#define __MENDER_ARTIFACT_DECOMPRESS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Compression types of the artifact members
+ */
+typedef enum {
+    MENDER_ARTIFACT_COMPRESSION_NONE = 0, /**< No compression */
+    MENDER_ARTIFACT_COMPRESSION_GZIP,     /**< gzip compression (".gz" extension) */
+    MENDER_ARTIFACT_COMPRESSION_XZ,       /**< xz compression (".xz" extension) */
+    MENDER_ARTIFACT_COMPRESSION_ZSTD      /**< zstd compression (".zst" extension) */
+} mender_artifact_compression_t;
+
+/**
+ * @brief Retrieve compression type of an artifact member from its name
+ * @param filename Name of the artifact member
+ * @return Compression type, MENDER_ARTIFACT_COMPRESSION_NONE if the extension is not known
+ */
+mender_artifact_compression_t mender_artifact_decompress_get_type(char *filename);
+
+/**
+ * @brief Begin decompression of a stream
+ * @param type Compression type
+ * @param handle Decompression handle
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the compression type is not supported, error code otherwise
+ */
+mender_err_t mender_artifact_decompress_begin(mender_artifact_compression_t type, void **handle);
+
+/**
+ * @brief Decompress data of the stream
+ * @param handle Decompression handle
+ * @param input_data Input data
+ * @param input_length Length of the input data, updated to the length of the input data consumed
+ * @param output_data Output data
+ * @param output_length Length of the output buffer, updated to the length of the output data produced
+ * @return MENDER_DONE if the end of the stream has been reached, MENDER_OK if more data are expected, error code if an error occurred
+ */
+mender_err_t mender_artifact_decompress_process(void *handle, void *input_data, size_t *input_length, void *output_data, size_t *output_length);
+
+/**
+ * @brief End decompression of a stream and release the handle
+ * @param handle Decompression handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_artifact_decompress_end(void *handle);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_ARTIFACT_DECOMPRESS_H__ */
@@ -24,8 +24,22 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include "mender-json.h"
+#include "mender-tls.h"
 #include "mender-utils.h"
 
+/**
+ * @brief Default maximum length of the name of the files of the artifact, path of the TAR files included
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_FILE_NAME_LENGTH
+#define CONFIG_MENDER_ARTIFACT_FILE_NAME_LENGTH (256)
+#endif /* CONFIG_MENDER_ARTIFACT_FILE_NAME_LENGTH */
+
+/**
+ * @brief TAR block size
+ */
+#define MENDER_ARTIFACT_STREAM_BLOCK_SIZE (512)
+
 /**
  * @brief Artifact state machine used to process input data stream
  */
@@ -39,27 +53,85 @@ typedef enum {
  */
 typedef struct {
     char  *type;      /**< Type of the payload */
-    cJSON *meta_data; /**< Meta-data from the header tarball, NULL if no meta-data */
+    cJSON *meta_data; /**< Meta-data from the header tarball, only the top-level values selected by the meta-data filter, NULL if no meta-data */
 } mender_artifact_payload_t;
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+
+/**
+ * @brief Artifact checksums
+ */
+typedef struct {
+    char   *filename;                                  /**< Name of the file in the manifest */
+    uint8_t checksum[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< Expected SHA-256 checksum of the file */
+    bool    verified;                                  /**< The checksum of the file has been verified */
+} mender_artifact_checksum_t;
+
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+
 /**
  * @brief Artifact context
  */
 typedef struct {
     mender_artifact_stream_state_t stream_state; /**< Stream state of the artifact processing */
     struct {
-        void  *data;   /**< Data received, concatenated chunk by chunk */
-        size_t length; /**< Length of the data received */
-    } input;           /**< Input data of the artifact */
+        uint8_t *data;     /**< Ring buffer used to store data received, allocated once when the context is created */
+        size_t   size;     /**< Size of the ring buffer (bytes), multiple of the TAR block size */
+        size_t   index;    /**< Read index of the data in the ring buffer (bytes) */
+        size_t   length;   /**< Length of the data available in the ring buffer (bytes) */
+        size_t   received; /**< Length of the data of the artifact stream consumed (bytes) */
+    } input;               /**< Input data of the artifact */
+    struct {
+        void    *handle;         /**< Decompression handle of the member currently decompressed, NULL if not decompressing */
+        size_t   length;         /**< Remaining length of the compressed data of the member (bytes) */
+        size_t   padding;        /**< Remaining length of the padding at the end of the member (bytes) */
+        bool     done;           /**< End of the compressed stream has been reached */
+        bool     output_pending; /**< The decompressor may have more output data to produce */
+        bool     compressed;     /**< The member currently parsed is compressed, set until the end of the decompressed TAR file */
+        uint8_t *pending;        /**< Data of the member moved out of the input ring buffer when the decompression begins */
+        size_t   pending_length; /**< Length of the data moved out of the input ring buffer (bytes) */
+    } decompress;                /**< Decompression of the compressed members of the artifact */
     struct {
         size_t                     size;   /**< Number of payloads in the artifact */
         mender_artifact_payload_t *values; /**< Values of payloads in the artifact */
     } payloads;                            /**< Payloads of the artifact */
+    mender_json_reader_t *json;                             /**< JSON reader of the file currently parsed, NULL if not parsing a JSON file */
+    bool (*meta_data_filter)(char *, char *);               /**< Function invoked with the payload type and the key to check if a meta-data value is kept, all are kept if NULL */
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+    struct {
+        size_t                      size;                                    /**< Number of checksums in the manifest */
+        mender_artifact_checksum_t *values;                                  /**< Values of checksums in the manifest */
+        uint8_t                     version[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< Checksum of the version file, verified when the manifest is parsed */
+        void                       *header_sha256;                            /**< SHA-256 context of the header tarball, NULL if not computing */
+        size_t                      header_length;                            /**< Remaining length of the header tarball to be hashed (bytes) */
+        char                       *header_filename;                          /**< Name of the header tarball in the manifest */
+        bool                        manifest;                                 /**< The manifest has been read, it can not be read again */
+    } checksums;                                                              /**< Checksums of the artifact */
+#endif                                                                        /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    struct {
+        char   *key;                                      /**< Public key used to verify the signature (PEM format), NULL to accept unsigned artifacts */
+        uint8_t manifest[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< Checksum of the manifest file */
+        bool    verified;                                 /**< Signature of the manifest has been verified */
+        bool    read;                                     /**< Signature of the manifest has been read, it can not be read again */
+    } signature;                                          /**< Signature of the artifact */
+#endif                                                    /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
     struct {
-        char  *name;  /**< Name of the file currently parsed */
-        size_t size;  /**< Size of the file currently parsed (bytes) */
-        size_t index; /**< Index of the data in the file currently parsed (bytes), incremented block by block */
-    } file;           /**< Information about the file currently parsed */
+        char   name[CONFIG_MENDER_ARTIFACT_FILE_NAME_LENGTH]; /**< Name of the file currently parsed, path of the TAR files included, empty at the root */
+        size_t size;                                         /**< Size of the file currently parsed (bytes) */
+        size_t index;                                        /**< Index of the data in the file currently parsed (bytes), incremented block by block */
+        size_t offset;                                       /**< Offset of the data of the file currently parsed in the artifact stream (bytes), 0 if compressed */
+        struct {
+            uint64_t size;     /**< Size of the next member (bytes) */
+            bool     has_size; /**< The size of the next member is given */
+            bool     has_name; /**< The name of the next member is given, it has already been appended to the name of the file */
+            bool     root;     /**< The next member is at the root of the artifact */
+        } extended;            /**< Attributes of the next member given by an extended header */
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS
+        void                       *sha256;   /**< SHA-256 context of the file currently parsed, NULL if not computing */
+        mender_artifact_checksum_t *checksum; /**< Expected checksum of the file currently parsed */
+#endif                                        /* CONFIG_MENDER_ARTIFACT_VERIFY_CHECKSUMS */
+    } file;                                   /**< Information about the file currently parsed */
 } mender_artifact_ctx_t;
 
 /**
@@ -81,6 +153,24 @@ mender_err_t mender_artifact_process_data(mender_artifact_ctx_t *ctx,
                                           size_t                 input_length,
                                           mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
 
+/**
+ * @brief Function used to skip data at the beginning of the payload file currently parsed, they have been delivered before the stream was interrupted
+ * @note The data are still used to compute the checksum of the file, the length must be a multiple of the TAR block size and the end of the file is never skipped
+ * @param ctx Artifact context
+ * @param data Data skipped, read back from where they have been delivered
+ * @param length Length of the data skipped
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_artifact_skip_data(mender_artifact_ctx_t *ctx, void *data, size_t length);
+
+/**
+ * @brief Function used to check the artifact stream is complete, invoked once all the data have been processed
+ * @note The parser must be between two files at the root of the artifact, and the checksums of all the data files of the manifest must have been verified
+ * @param ctx Artifact context
+ * @return MENDER_OK if the artifact is complete, error code otherwise
+ */
+mender_err_t mender_artifact_check_complete(mender_artifact_ctx_t *ctx);
+
 /**
  * @brief Function used to release artifact context
  * @param ctx Artifact context
@@ -0,0 +1,70 @@
+/**
+ * @file      mender-client-artifact-type.h
+ * @brief     Mender MCU client artifact types, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_ARTIFACT_TYPE_H__
+#define __MENDER_CLIENT_ARTIFACT_TYPE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-client.h"
+
+/**
+ * @brief Mender client artifact type
+ */
+typedef struct {
+    char *type; /**< Artifact type */
+    mender_err_t (*callback)(
+        char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t); /**< Callback to be invoked to handle the artifact type */
+    mender_err_t (*segments_callback)(
+        char *, char *, char *, cJSON *, char *, size_t, mender_client_segment_t *, size_t, size_t); /**< Callback receiving segments, NULL if not used */
+    bool  needs_restart;                                                          /**< Indicate the artifact type needs a restart to be applied on the system */
+    char  *artifact_name;  /**< Artifact name (optional, NULL otherwise), set to validate module update after restarting */
+    char **meta_data_keys; /**< Meta-data keys needed to handle the artifact type, NULL terminated list (optional, NULL to retrieve all meta-data values) */
+} mender_client_artifact_type_t;
+
+/**
+ * @brief Invoke the callback of an artifact type, the data are given as a single segment to the artifact types receiving segments
+ * @param artifact_type Artifact type
+ * @param id ID of the deployment
+ * @param artifact_name Artifact name
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename, NULL at the beginning of the payload
+ * @param size Artifact file size
+ * @param data Artifact data, NULL if none
+ * @param index Index of the data in the artifact file
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_invoke_artifact_type(mender_client_artifact_type_t *artifact_type,
+                                                char                          *id,
+                                                char                          *artifact_name,
+                                                cJSON                         *meta_data,
+                                                char                          *filename,
+                                                size_t                         size,
+                                                void                          *data,
+                                                size_t                         index,
+                                                size_t                         length);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_ARTIFACT_TYPE_H__ */
@@ -0,0 +1,58 @@
+/**
+ * @file      mender-client-flash-pipeline.h
+ * @brief     Mender MCU client flash pipeline, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_FLASH_PIPELINE_H__
+#define __MENDER_CLIENT_FLASH_PIPELINE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+/**
+ * @brief Start the flash pipeline, the flash handle must be opened
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_flash_pipeline_start(void);
+
+/**
+ * @brief Copy data to the flash pipeline, the function blocks while all the buffers are waiting to be written
+ * @param data Data
+ * @param index Data index
+ * @param length Data length
+ * @return MENDER_OK if the function succeeds, error code if an error occurred or if a previous flash write failed
+ */
+mender_err_t mender_client_flash_pipeline_write(void *data, size_t index, size_t length);
+
+/**
+ * @brief Wait for the data of the flash pipeline to be written and stop it, nothing is done if the flash pipeline is not started
+ * @return MENDER_OK if all the data have been written, error code otherwise
+ */
+mender_err_t mender_client_flash_pipeline_stop(void);
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_FLASH_PIPELINE_H__ */
@@ -0,0 +1,66 @@
+/**
+ * @file      mender-client-flash-statistics.h
+ * @brief     Mender MCU client flash statistics, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_FLASH_STATISTICS_H__
+#define __MENDER_CLIENT_FLASH_STATISTICS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+
+/**
+ * @brief Flash operations measured
+ */
+typedef enum {
+    MENDER_CLIENT_FLASH_OPERATION_WRITE,             /**< Write */
+    MENDER_CLIENT_FLASH_OPERATION_CLOSE,             /**< Close */
+    MENDER_CLIENT_FLASH_OPERATION_SET_PENDING_IMAGE, /**< Set the pending image */
+    MENDER_CLIENT_FLASH_OPERATION_COUNT              /**< Number of flash operations */
+} mender_client_flash_operation_t;
+
+/**
+ * @brief Reset the flash statistics, called when the flash handle is opened for a new image
+ */
+void mender_client_flash_statistics_reset(void);
+
+/**
+ * @brief Record a call to the flash API in the flash statistics
+ * @param operation Flash operation
+ * @param start_us Uptime when the call started (microseconds)
+ * @param bytes Number of bytes written by the call
+ * @param ret Result of the call
+ */
+void mender_client_flash_statistics_record(mender_client_flash_operation_t operation, uint64_t start_us, size_t bytes, mender_err_t ret);
+
+/**
+ * @brief Log the flash statistics
+ */
+void mender_client_flash_statistics_log(void);
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_FLASH_STATISTICS_H__ */
@@ -0,0 +1,85 @@
+/**
+ * @file      mender-client-flash.h
+ * @brief     Mender MCU client flash handle, write buffer and verification, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_FLASH_H__
+#define __MENDER_CLIENT_FLASH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Open the flash handle used to write the image, the flash statistics are reset if they are enabled
+ * @param name Name of the image
+ * @param size Size of the image
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_flash_open(char *name, size_t size);
+
+/**
+ * @brief Resume the flash handle used to write the image interrupted by a reset, the flash statistics are reset if they are enabled
+ * @param name Name of the image
+ * @param size Size of the image
+ * @param index Index of the data to be written, updated to the index of the data known to be written
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if resuming is not supported, error code otherwise
+ */
+mender_err_t mender_client_flash_resume(char *name, size_t size, size_t *index);
+
+/**
+ * @brief Write data to the flash, the data are gathered in the flash write buffer if it is enabled
+ * @param data Data
+ * @param index Data index
+ * @param length Data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_flash_write(void *data, size_t index, size_t length);
+
+/**
+ * @brief Read back data of the image already written, the digest of the data written is updated if the flash verification is enabled
+ * @param data Buffer to store the data
+ * @param index Data index
+ * @param length Data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_flash_read_back(void *data, size_t index, size_t length);
+
+/**
+ * @brief Write the data remaining in the flash write buffer and close the flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_flash_close(void);
+
+/**
+ * @brief Release the data remaining in the flash write buffer and abort the deployment
+ */
+void mender_client_flash_abort_deployment(void);
+
+/**
+ * @brief Set the image of the flash handle pending, the call is measured if the flash statistics are enabled
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_flash_set_pending_image(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_FLASH_H__ */
@@ -0,0 +1,82 @@
+/**
+ * @file      mender-client-install-checkpoint.h
+ * @brief     Mender MCU client install checkpoint, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_INSTALL_CHECKPOINT_H__
+#define __MENDER_CLIENT_INSTALL_CHECKPOINT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+/**
+ * @brief Load the install checkpoint saved before a reset, it is deleted if it is invalid
+ */
+void mender_client_install_checkpoint_load(void);
+
+/**
+ * @brief Begin the install checkpoints of a file, called when the flash handle is opened
+ * @param id ID of the deployment
+ * @param size Size of the file
+ */
+void mender_client_install_checkpoint_begin(char *id, size_t size);
+
+/**
+ * @brief Record the length of the data of the file written to the flash, it is saved with the next install checkpoint
+ * @note The function is called by the flash pipeline task, the length is accessed atomically
+ * @param written Length of the data of the file written (bytes)
+ */
+void mender_client_install_checkpoint_update(size_t written);
+
+/**
+ * @brief Save the install checkpoint if the period is elapsed since the last one, the installation continues if it fails
+ */
+void mender_client_install_checkpoint_save(void);
+
+/**
+ * @brief Resume the installation of the deployment from the install checkpoint, the artifact is downloaded from the beginning if it fails
+ * @note The flash handle is resumed and the download of the artifact is seeked to the data which have not been written
+ * @param id ID of the deployment
+ * @param uri URI of the artifact
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_OK if the installation has been resumed, error code otherwise
+ */
+mender_err_t mender_client_install_checkpoint_resume(char *id, char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+
+/**
+ * @brief Release the install checkpoint if it belongs to another deployment, its installation is not resumed
+ * @param id ID of the deployment, NULL if there is no deployment
+ */
+void mender_client_install_checkpoint_check(char *id);
+
+/**
+ * @brief Release the install checkpoint, it is deleted from the storage
+ */
+void mender_client_install_checkpoint_release(void);
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_INSTALL_CHECKPOINT_H__ */
@@ -0,0 +1,67 @@
+/**
+ * @file      mender-client-payload-workers.h
+ * @brief     Mender MCU client payload workers, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_PAYLOAD_WORKERS_H__
+#define __MENDER_CLIENT_PAYLOAD_WORKERS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-client-artifact-type.h"
+
+#ifdef CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS
+
+/**
+ * @brief Get the payload worker handling an artifact type at the beginning of a payload, the worker is started if it is not running
+ * @note The meta-data of the payload are copied with the first data submitted
+ * @param artifact_type Artifact type
+ * @return Payload worker, NULL if no worker is available and the payload must be handled directly
+ */
+void *mender_client_payload_worker_get(mender_client_artifact_type_t *artifact_type);
+
+/**
+ * @brief Copy data of the payload currently downloaded to a payload worker, the function blocks while all the buffers are waiting to be handled
+ * @param worker Payload worker
+ * @param id ID of the deployment, it must remain valid until the payload workers are stopped
+ * @param artifact_name Artifact name, it must remain valid until the payload workers are stopped
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename, NULL at the beginning of the payload
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code if an error occurred or if a previous callback of the worker failed
+ */
+mender_err_t mender_client_payload_worker_submit(
+    void *worker, char *id, char *artifact_name, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+/**
+ * @brief Wait for the data of the payload workers to be handled and stop them, nothing is done for the workers which are not started
+ * @return MENDER_OK if all the data have been handled, error code of the first worker which failed otherwise
+ */
+mender_err_t mender_client_payload_workers_stop(void);
+
+#endif /* CONFIG_MENDER_CLIENT_PAYLOAD_WORKERS */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_PAYLOAD_WORKERS_H__ */
@@ -0,0 +1,79 @@
+/**
+ * @file      mender-client-status-queue.h
+ * @brief     Mender MCU client deployment status queue, internal interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_CLIENT_STATUS_QUEUE_H__
+#define __MENDER_CLIENT_STATUS_QUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_CLIENT_STATUS_QUEUE
+
+/**
+ * @brief Initialize the deployment status queue, the status work is created
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_status_queue_init(void);
+
+/**
+ * @brief Activate the status work
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_status_queue_activate(void);
+
+/**
+ * @brief Deactivate the status work
+ */
+void mender_client_status_queue_deactivate(void);
+
+/**
+ * @brief Queue a deployment status, it replaces the status of the same deployment waiting to be published
+ * @param id ID of the deployment
+ * @param deployment_status Deployment status
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_status_queue_push(char *id, mender_deployment_status_t deployment_status);
+
+/**
+ * @brief Keep the deployment data stored until the status of the deployment waiting to be published is published, they are deleted now otherwise
+ * @param id ID of the deployment
+ */
+void mender_client_status_queue_store(char *id);
+
+/**
+ * @brief Publish the deployment statuses waiting in the queue, in order, until publishing fails
+ * @return MENDER_OK if all the statuses have been published, error code otherwise
+ */
+mender_err_t mender_client_status_queue_flush(void);
+
+/**
+ * @brief Release the deployment status queue, the status work is deleted and the statuses waiting are dropped
+ */
+void mender_client_status_queue_exit(void);
+
+#endif /* CONFIG_MENDER_CLIENT_STATUS_QUEUE */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_CLIENT_STATUS_QUEUE_H__ */
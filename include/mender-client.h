@@ -27,6 +27,21 @@ extern "C" {
 #include "mender-addon.h"
 #include "mender-utils.h"
 
+/**
+ * @brief Default slack of the periodic works of the client and the add-ons (percentage of the period)
+ */
+#ifndef CONFIG_MENDER_CLIENT_WORK_SLACK
+#define CONFIG_MENDER_CLIENT_WORK_SLACK (0)
+#endif /* CONFIG_MENDER_CLIENT_WORK_SLACK */
+
+/**
+ * @brief Segment of the data of a payload
+ */
+typedef struct {
+    void  *data;   /**< Data of the segment */
+    size_t length; /**< Length of the segment (bytes) */
+} mender_client_segment_t;
+
 /**
  * @brief Mender client configuration
  */
@@ -39,6 +54,10 @@ typedef struct {
     int32_t            authentication_poll_interval; /**< Authentication poll interval, default is 60 seconds, -1 permits to disable periodic execution */
     int32_t            update_poll_interval;         /**< Update poll interval, default is 1800 seconds, -1 permits to disable periodic execution */
     bool               recommissioning;              /**< Used to force creation of new authentication keys */
+    char              *artifact_verify_key;          /**< Public key used to verify the signature of the artifacts (PEM format, optional) */
+    char              *artifact_mirror;              /**< URL of a local mirror of the artifacts, the server is used if it fails (optional) */
+    mender_keystore_t *device_provides;              /**< Attributes of the device sent when checking for deployments (optional) */
+    uint32_t           download_rate_limit;          /**< Maximum rate of the download of the artifacts (bytes per second), default is unlimited */
 } mender_client_config_t;
 
 /**
@@ -51,8 +70,39 @@ typedef struct {
     mender_err_t (*authentication_failure)(void);                          /**< Invoked when authentication with the mender server failed */
     mender_err_t (*deployment_status)(mender_deployment_status_t, char *); /**< Invoked on transition changes to inform of the new deployment status */
     mender_err_t (*restart)(void);                                         /**< Invoked to restart the device */
+    mender_err_t (*download_progress)(size_t, size_t, uint32_t);           /**< Invoked while downloading, with received and total lengths and throughput */
+    mender_err_t (*download_allowed)(size_t);                              /**< Invoked before downloading with the artifact length, MENDER_OK to proceed */
+    mender_err_t (*download_yield)(void);                                  /**< Invoked when the download yields the processor, to feed the watchdog */
+    mender_err_t (*install_allowed)(bool);                                 /**< Invoked once downloaded with the restart flag, MENDER_OK to install now */
+    mender_err_t (*self_test)(void);                                       /**< Invoked after restarting with a pending image, MENDER_OK to confirm it */
 } mender_client_callbacks_t;
 
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+
+/**
+ * @brief Mender client flash operation statistics, latencies are given in microseconds with the resolution of the scheduler uptime
+ */
+typedef struct {
+    uint32_t calls;    /**< Number of calls */
+    uint64_t bytes;    /**< Number of bytes written, 0 if the operation does not write data */
+    uint32_t failures; /**< Number of calls that failed */
+    uint32_t min_us;   /**< Minimum latency */
+    uint32_t avg_us;   /**< Average latency */
+    uint32_t max_us;   /**< Maximum latency */
+    uint32_t p99_us;   /**< 99th percentile latency, upper bound of the histogram bucket reached */
+} mender_client_flash_operation_statistics_t;
+
+/**
+ * @brief Mender client flash statistics, reset when the flash is opened for a new image
+ */
+typedef struct {
+    mender_client_flash_operation_statistics_t write;             /**< Statistics of the writes */
+    mender_client_flash_operation_statistics_t close;             /**< Statistics of the closes */
+    mender_client_flash_operation_statistics_t set_pending_image; /**< Statistics of the calls to set the pending image */
+} mender_client_flash_statistics_t;
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+
 /**
  * @brief Return mender client version
  * @return Mender client version as string
@@ -81,6 +131,7 @@ char *mender_client_get_device_type(void);
 
 /**
  * @brief Register artifact type
+ * @note The artifact types registry is immutable while the client is activated, the function fails in that case
  * @param type Artifact type
  * @param callback Artifact type callback
  * @param needs_restart Flag to indicate if the artifact type requires the device to restart after downloading
@@ -92,8 +143,43 @@ mender_err_t mender_client_register_artifact_type(char *type,
                                                   bool  needs_restart,
                                                   char *artifact_name);
 
+/**
+ * @brief Register artifact type which callback receives the data as a list of segments, for flash drivers accepting scatter lists
+ * @note The artifact types registry is immutable while the client is activated, the function fails in that case
+ * @param type Artifact type
+ * @param callback Artifact type callback, invoked with the segments, the number of segments (0 at the beginning of the payload) and the index of the data
+ * @param needs_restart Flag to indicate if the artifact type requires the device to restart after downloading
+ * @param artifact_name Artifact name (optional, NULL otherwise), set to validate module update after restarting
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_register_artifact_type_segments(
+    char *type,
+    mender_err_t (*callback)(char *, char *, char *, cJSON *, char *, size_t, mender_client_segment_t *, size_t, size_t),
+    bool  needs_restart,
+    char *artifact_name);
+
+/**
+ * @brief Set the meta-data keys needed to handle an artifact type, other meta-data values are not retrieved from the artifact to limit memory usage
+ * @note The artifact types registry is immutable while the client is activated, the function fails in that case
+ * @param type Artifact type, already registered
+ * @param meta_data_keys NULL terminated list of the meta-data keys, must remain valid while the artifact type is registered, NULL to retrieve all meta-data values (default)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_set_artifact_type_meta_data_keys(char *type, char **meta_data_keys);
+
+/**
+ * @brief Add-on activation policies
+ */
+typedef enum {
+    MENDER_CLIENT_ADDON_ACTIVATION_IMMEDIATE = 0,      /**< Activated once the client is authenticated (default) */
+    MENDER_CLIENT_ADDON_ACTIVATION_DELAYED,            /**< Activated once a delay is elapsed after the authentication of the client */
+    MENDER_CLIENT_ADDON_ACTIVATION_AFTER_UPDATE_CHECK, /**< Activated after the first check for deployment */
+    MENDER_CLIENT_ADDON_ACTIVATION_ON_DEMAND           /**< Activated when it is requested with mender_client_activate_addon */
+} mender_client_addon_activation_t;
+
 /**
  * @brief Register add-on
+ * @note The add-ons registry is immutable while the client is activated, the function fails in that case
  * @param addon Add-on
  * @param config Add-on configuration
  * @param callbacks Add-on callbacks
@@ -102,7 +188,24 @@ mender_err_t mender_client_register_artifact_type(char *type,
 mender_err_t mender_client_register_addon(mender_addon_instance_t *addon, void *config, void *callbacks);
 
 /**
- * @brief Activate mender client
+ * @brief Set the activation policy of an add-on, the add-on is activated once the client is authenticated by default
+ * @note The add-ons registry is immutable while the client is activated, the function fails in that case
+ * @param addon Add-on, already registered
+ * @param activation Activation policy
+ * @param delay Delay of the activation after the authentication (seconds), used with the delayed activation policy
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_set_addon_activation(mender_addon_instance_t *addon, mender_client_addon_activation_t activation, uint32_t delay);
+
+/**
+ * @brief Request the activation of an add-on, whatever its activation policy, the add-on is activated once the client is authenticated if it is not yet
+ * @param addon Add-on, already registered
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_activate_addon(mender_addon_instance_t *addon);
+
+/**
+ * @brief Activate mender client, the artifact types and add-ons registries are immutable until the client is deactivated
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_client_activate(void);
@@ -117,11 +220,29 @@ mender_err_t mender_client_deactivate(void);
 /**
  * @brief Function used to trigger execution of the authentication and update work
  * @note Calling this function is optional when the periodic execution of the work is configured
- * @note It only permits to execute the work as soon as possible to synchronize updates
+ * @note It only permits to execute the work as soon as possible to synchronize updates, the work is executed again once finished if it is already executing
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_client_execute(void);
 
+/**
+ * @brief Set the maximum rate of the download of the artifacts, it applies to the download in progress
+ * @param rate Maximum rate (bytes per second), 0 if unlimited
+ */
+void mender_client_set_download_rate_limit(uint32_t rate);
+
+/**
+ * @brief Pause the download of the artifacts, for example when the application needs the network exclusively for a while
+ * @note The data are not read anymore so that the state of the download is kept, the connection is closed if the pause lasts longer than the pause timeout
+ * @note The download is resumed from the data already processed if the connection has been closed
+ */
+void mender_client_pause_download(void);
+
+/**
+ * @brief Resume the download of the artifacts paused
+ */
+void mender_client_resume_download(void);
+
 /**
  * @brief Function to be called from add-ons to request network access
  * @return MENDER_OK if network is connected following the request, error code otherwise
@@ -134,6 +255,18 @@ mender_err_t mender_client_network_connect(void);
  */
 mender_err_t mender_client_network_release(void);
 
+#ifdef CONFIG_MENDER_CLIENT_FLASH_STATISTICS
+
+/**
+ * @brief Retrieve the statistics of the flash operations of the current or last deployment
+ * @note The statistics can be retrieved from the deployment status callback, they are complete once the status is installing
+ * @param statistics Flash statistics
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_get_flash_statistics(mender_client_flash_statistics_t *statistics);
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_STATISTICS */
+
 /**
  * @brief Release mender client
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -41,13 +41,23 @@ typedef struct {
     int32_t refresh_interval; /**< Configure refresh interval, default is 28800 seconds, -1 permits to disable periodic execution */
 } mender_configure_config_t;
 
+/**
+ * @brief Mender configure diff, key/value pairs tables ending with a NULL/NULL element
+ */
+typedef struct {
+    mender_keystore_t *added;   /**< Items added to the configuration */
+    mender_keystore_t *changed; /**< Items which value has changed, with the new value */
+    mender_keystore_t *removed; /**< Items removed from the configuration, with the previous value */
+} mender_configure_diff_t;
+
 /**
  * @brief Mender configure callbacks
  */
 typedef struct {
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
-    mender_err_t (*config_updated)(mender_keystore_t *); /**< Invoked when configuration is updated */
-#endif                                                   /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+    mender_err_t (*config_updated)(mender_keystore_t *);       /**< Invoked when configuration is updated */
+    mender_err_t (*config_changed)(mender_configure_diff_t *); /**< Invoked with the items added, changed and removed when configuration differs */
+#endif                                                         /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 } mender_configure_callbacks_t;
 
 /**
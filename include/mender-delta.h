@@ -0,0 +1,71 @@
+/**
+ * @file      mender-delta.h
+ * @brief     Mender delta patch interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_DELTA_H__
+#define __MENDER_DELTA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Default size of the buffer used to read the base image (bytes)
+ */
+#ifndef CONFIG_MENDER_DELTA_BUFFER_SIZE
+#define CONFIG_MENDER_DELTA_BUFFER_SIZE (512)
+#endif /* CONFIG_MENDER_DELTA_BUFFER_SIZE */
+
+/**
+ * @brief Begin application of a patch
+ * @note The patch uses the layout of the bsdiff 4.3 format by Matthew Endsley, the "ENDSLEY/BSDIFF43" header and the size of the patched image followed by
+ * the control, diff and extra blocks, without bzip2 compression because the artifact member is compressed
+ * @param read Function invoked to read the base image with the data buffer, the index and the length of the data, and the parameters
+ * @param write Function invoked to write the patched image with the data, the index and the length of the data, and the parameters
+ * @param params Parameters of the functions
+ * @param handle Patch handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_delta_begin(mender_err_t (*read)(void *, size_t, size_t, void *),
+                                mender_err_t (*write)(void *, size_t, size_t, void *),
+                                void        *params,
+                                void       **handle);
+
+/**
+ * @brief Apply data of the patch, the patched image is written as the data are received
+ * @param handle Patch handle
+ * @param data Data of the patch
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_delta_process(void *handle, void *data, size_t length);
+
+/**
+ * @brief End application of a patch and release the handle
+ * @param handle Patch handle
+ * @return MENDER_OK if the patched image is complete, error code otherwise
+ */
+mender_err_t mender_delta_end(void *handle);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_DELTA_H__ */
@@ -0,0 +1,74 @@
+/**
+ * @file      mender-file.h
+ * @brief     Mender file artifact type interface, the files of the payload are installed in a directory of a filesystem
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_FILE_H__
+#define __MENDER_FILE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_FILE
+
+/**
+ * @brief Default directory in which the files are installed, used if the payload meta-data do not provide "dest_dir"
+ */
+#ifndef CONFIG_MENDER_FILE_DIRECTORY
+#define CONFIG_MENDER_FILE_DIRECTORY "/lfs"
+#endif /* CONFIG_MENDER_FILE_DIRECTORY */
+
+/**
+ * @brief Default size of the buffer used to write the files (bytes), the files are written by blocks of this size
+ */
+#ifndef CONFIG_MENDER_FILE_BUFFER_SIZE
+#define CONFIG_MENDER_FILE_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_FILE_BUFFER_SIZE */
+
+/**
+ * @brief Meta-data keys used by the file artifact type, to be given to mender_client_set_artifact_type_meta_data_keys
+ */
+#define MENDER_FILE_META_DATA_KEYS { "dest_dir", NULL }
+
+/**
+ * @brief File artifact type callback, to be registered with mender_client_register_artifact_type without restart
+ * @note Each file is written to a temporary file which is synchronized once complete and renamed atomically over the installed file
+ * @note The installed file is kept if CONFIG_MENDER_FILE_SKIP_UNCHANGED is defined and if its content is identical, nothing is written then
+ * @param id ID of the deployment
+ * @param artifact_name Artifact name
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball, "dest_dir" is the directory in which the files are installed
+ * @param filename Artifact filename, NULL at the beginning of the payload
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_file_artifact_type_callback(
+    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+#endif /* CONFIG_MENDER_FILE */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_FILE_H__ */
@@ -26,6 +26,22 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Get capacity of the flash area to which the artifact is written
+ * @param capacity Capacity of the flash area (bytes)
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the capacity is not known, error code otherwise
+ */
+mender_err_t mender_flash_get_capacity(size_t *capacity);
+
+/**
+ * @brief Read the running image, used as the base image of the delta updates
+ * @param data Buffer to store the data
+ * @param index Index of the data to be read
+ * @param length Length of the data to be read
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the running image can't be read, error code otherwise
+ */
+mender_err_t mender_flash_read_running_image(void *data, size_t index, size_t length);
+
 /**
  * @brief Open flash device
  * @param name Name of the artifact
@@ -35,6 +51,16 @@ extern "C" {
  */
 mender_err_t mender_flash_open(char *name, size_t size, void **handle);
 
+/**
+ * @brief Open flash device to resume a deployment interrupted by a reset, the data already written are kept
+ * @param name Name of the artifact
+ * @param size Size of the artifact
+ * @param index Index up to which the data have been written, updated with the index from which the data must be written again
+ * @param handle Handle of the deployment to be used with mender flash functions
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the deployment can't be resumed, error code otherwise
+ */
+mender_err_t mender_flash_resume(char *name, size_t size, size_t *index, void **handle);
+
 /**
  * @brief Write deployment data
  * @param handle Handle from mender_flash_open
@@ -52,6 +78,16 @@ mender_err_t mender_flash_write(void *handle, void *data, size_t index, size_t l
  */
 mender_err_t mender_flash_close(void *handle);
 
+/**
+ * @brief Read back deployment data, used to verify the image once the flash device is closed
+ * @param handle Handle from mender_flash_open
+ * @param data Buffer to store the data
+ * @param index Index of the data to be read
+ * @param length Length of the data to be read
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the data can't be read back, error code otherwise
+ */
+mender_err_t mender_flash_read(void *handle, void *data, size_t index, size_t length);
+
 /**
  * @brief Set new boot partition to be used at the next boot
  * @param handle Handle from mender_flash_open
@@ -78,6 +114,48 @@ mender_err_t mender_flash_confirm_image(void);
  */
 bool mender_flash_is_image_confirmed(void);
 
+/**
+ * @brief Open the staging area to which the artifacts are downloaded before being installed, its previous contents are discarded
+ * @param name Name of the artifact, used as key by the platforms which keep the artifacts staged
+ * @param handle Handle of the staging area to be used with mender flash staging functions
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if there is no staging area, error code otherwise
+ */
+mender_err_t mender_flash_open_staging(char *name, void **handle);
+
+/**
+ * @brief Write data to the staging area, the data are written sequentially
+ * @param handle Handle from mender_flash_open_staging
+ * @param data Data to be written
+ * @param index Index of the data to be written
+ * @param length Length of the data to be written
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_flash_write_staging(void *handle, void *data, size_t index, size_t length);
+
+/**
+ * @brief Write the remaining data to the staging area, the handle remains valid to read back the data
+ * @param handle Handle from mender_flash_open_staging
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_flash_close_staging(void *handle);
+
+/**
+ * @brief Read back data from the staging area once it is closed
+ * @param handle Handle from mender_flash_open_staging
+ * @param data Buffer to store the data
+ * @param index Index of the data to be read
+ * @param length Length of the data to be read
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_flash_read_staging(void *handle, void *data, size_t index, size_t length);
+
+/**
+ * @brief Release the staging area, its contents are not used anymore
+ * @param handle Handle from mender_flash_open_staging
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_flash_release_staging(void *handle);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
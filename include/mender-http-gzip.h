@@ -0,0 +1,54 @@
+/**
+ * @file      mender-http-gzip.h
+ * @brief     Mender HTTP request body gzip compression interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_HTTP_GZIP_H__
+#define __MENDER_HTTP_GZIP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-http.h"
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+
+/**
+ * @brief Default minimum length of the request bodies compressed with gzip (bytes), the smaller bodies are sent uncompressed
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_THRESHOLD
+#define CONFIG_MENDER_HTTP_GZIP_THRESHOLD (512)
+#endif /* CONFIG_MENDER_HTTP_GZIP_THRESHOLD */
+
+/**
+ * @brief Body callback compressing with gzip the body given as parameter, the compressed body is written in pieces with the write function given
+ * @note The body is compressed each time the callback is invoked, the compression is deterministic so that the same body is written each time
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Body to be compressed (mender_http_body_t)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_gzip_body_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_HTTP_GZIP_H__ */
@@ -0,0 +1,70 @@
+/**
+ * @file      mender-http-stall.h
+ * @brief     Mender HTTP stall detection interface, the transfers fail when the throughput is below a floor
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_HTTP_STALL_H__
+#define __MENDER_HTTP_STALL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-http.h"
+
+/**
+ * @brief Default minimum number of bytes received during each window of the transfers, 0 to disable the throughput floor
+ */
+#ifndef CONFIG_MENDER_HTTP_LOW_SPEED_LIMIT
+#define CONFIG_MENDER_HTTP_LOW_SPEED_LIMIT (0)
+#endif /* CONFIG_MENDER_HTTP_LOW_SPEED_LIMIT */
+
+/**
+ * @brief Default duration of the windows of the throughput floor (seconds)
+ */
+#ifndef CONFIG_MENDER_HTTP_LOW_SPEED_TIME
+#define CONFIG_MENDER_HTTP_LOW_SPEED_TIME (30)
+#endif /* CONFIG_MENDER_HTTP_LOW_SPEED_TIME */
+
+/**
+ * @brief Stall detection of a transfer
+ */
+typedef struct {
+    uint64_t start;  /**< Beginning of the current window (microseconds) */
+    size_t   length; /**< Number of bytes received during the current window */
+} mender_http_stall_t;
+
+/**
+ * @brief Begin the stall detection of a transfer, the first window begins now
+ * @param stall Stall detection
+ */
+void mender_http_stall_init(mender_http_stall_t *stall);
+
+/**
+ * @brief Account data received and check the throughput floor once the window has elapsed
+ * @note The time the data are waited for is detected by the inactivity timeout of the platform, the floor is checked when data are received
+ * @param stall Stall detection
+ * @param length Length of the data received
+ * @return MENDER_OK if the throughput is above the floor, MENDER_FAIL if the transfer is stalled
+ */
+mender_err_t mender_http_stall_check(mender_http_stall_t *stall, size_t length);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_HTTP_STALL_H__ */
@@ -26,6 +26,27 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Default receive buffer length of the API requests
+ */
+#ifndef CONFIG_MENDER_HTTP_RECV_BUF_LENGTH
+#define CONFIG_MENDER_HTTP_RECV_BUF_LENGTH (512)
+#endif /* CONFIG_MENDER_HTTP_RECV_BUF_LENGTH */
+
+/**
+ * @brief Default receive buffer length of the artifact downloads
+ */
+#ifndef CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH
+#define CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH (4096)
+#endif /* CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH */
+
+/**
+ * @brief Default inactivity timeout of the HTTP requests, the request fails if no data is received meanwhile (seconds)
+ */
+#ifndef CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT
+#define CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT (30)
+#endif /* CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT */
+
 /**
  * @brief Mender HTTP configuration
  */
@@ -47,12 +68,30 @@ typedef enum {
  * @brief HTTP client events
  */
 typedef enum {
-    MENDER_HTTP_EVENT_CONNECTED,     /**< Connected to the server */
-    MENDER_HTTP_EVENT_DATA_RECEIVED, /**< Data received from the server */
-    MENDER_HTTP_EVENT_DISCONNECTED,  /**< Disconnected from the server */
-    MENDER_HTTP_EVENT_ERROR          /**< An error occurred */
+    MENDER_HTTP_EVENT_CONNECTED,        /**< Connected to the server */
+    MENDER_HTTP_EVENT_HEADERS_RECEIVED, /**< Headers received before the data, data is the headers of the response (mender_http_headers_t), data length is the content length or 0 */
+    MENDER_HTTP_EVENT_DATA_RECEIVED,    /**< Data received from the server */
+    MENDER_HTTP_EVENT_DISCONNECTED,     /**< Disconnected from the server */
+    MENDER_HTTP_EVENT_ERROR             /**< An error occurred */
 } mender_http_client_event_t;
 
+/**
+ * @brief HTTP response headers, given to the callback with the headers received event
+ */
+typedef struct {
+    char    *etag;        /**< ETag header value, NULL if not received */
+    uint32_t retry_after; /**< Retry-After header value (seconds), 0 if not received or if it is not a number of seconds */
+} mender_http_headers_t;
+
+/**
+ * @brief HTTP request body, written in pieces by a callback so that the body is never stored entirely
+ * @note The callback is invoked several times to compute the length of the body and to send it, it must write the same body each time
+ */
+typedef struct {
+    mender_err_t (*callback)(mender_err_t (*)(void *, size_t, void *), void *, void *); /**< Callback writing the body with the write function given */
+    void *params;                                                                       /**< Parameters passed to the callback, NULL if not used */
+} mender_http_body_t;
+
 /**
  * @brief Initialize mender http
  * @param config Mender HTTP configuration
@@ -61,15 +100,17 @@ typedef enum {
 mender_err_t mender_http_init(mender_http_config_t *config);
 
 /**
- * @brief Perform HTTP request
+ * @brief Perform HTTP request, the connection is kept alive to be reused by the next requests to the same host and port
  * @param jwt Token, NULL if not authenticated yet
  * @param path Path of the request
  * @param method Method
  * @param payload Payload, NULL if empty
  * @param signature Signature of the payload, NULL if it is not required
- * @param callback Callback invoked on HTTP events
+ * @param range Range of the content requested (for example "bytes=0-1023"), NULL to request the whole content
+ * @param recv_buf_length Length of the receive buffer, which is the maximum length of the data given to the callback at once
+ * @param callback Callback invoked on HTTP events, it may return MENDER_DONE on data received to stop reading the response without error
  * @param params Parameters passed to the callback, NULL if not used
- * @param status Status code
+ * @param status Status code, set before the callback is invoked with the data received
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_http_perform(char                *jwt,
@@ -77,10 +118,52 @@ mender_err_t mender_http_perform(char                *jwt,
                                  mender_http_method_t method,
                                  char                *payload,
                                  char                *signature,
+                                 char                *range,
+                                 size_t               recv_buf_length,
                                  mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
                                  void *params,
                                  int  *status);
 
+/**
+ * @brief Perform HTTP request with a body written in pieces, the length of the body is computed before it is sent
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param body Body, NULL if empty
+ * @param signature Signature of the body, NULL if it is not required
+ * @param range Range of the content requested (for example "bytes=0-1023"), NULL to request the whole content
+ * @param etag Entity tag of the content already received, sent in the If-None-Match header so that the server responds 304 if unchanged, NULL if not used
+ * @param recv_buf_length Length of the receive buffer, which is the maximum length of the data given to the callback at once
+ * @param callback Callback invoked on HTTP events, it may return MENDER_DONE on data received to stop reading the response without error
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code, set before the callback is invoked with the data received
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_perform_body(char                *jwt,
+                                      char                *path,
+                                      mender_http_method_t method,
+                                      mender_http_body_t  *body,
+                                      char                *signature,
+                                      char                *range,
+                                      char                *etag,
+                                      size_t               recv_buf_length,
+                                      mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                      void *params,
+                                      int  *status);
+
+/**
+ * @brief Connect to the server of a request in advance, the connection is kept alive to be reused by the next requests to the same host and port
+ * @param path Path of the request
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_preconnect(char *path);
+
+/**
+ * @brief Close the connections kept alive with the servers, invoked when the network is released
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_close_connections(void);
+
 /**
  * @brief Release mender http
  * @return MENDER_OK if the function succeeds, error code otherwise
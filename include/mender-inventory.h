@@ -38,7 +38,9 @@ extern const mender_addon_instance_t mender_inventory_addon_instance;
  * @brief Mender inventory configuration
  */
 typedef struct {
-    int32_t refresh_interval; /**< Inventory refresh interval, default is 28800 seconds, -1 permits to disable periodic execution */
+    int32_t  refresh_interval; /**< Inventory refresh interval, default is 28800 seconds, -1 permits to disable periodic execution */
+    char   **urgent_items;     /**< Names of the urgent items published shortly after they change, ends with a NULL element, NULL if not defined */
+    uint32_t urgent_delay;     /**< Delay used to publish the urgent items so that a burst of changes produces a single request, default is 2000 milliseconds */
 } mender_inventory_config_t;
 
 /**
@@ -80,10 +82,21 @@ mender_err_t mender_inventory_set(mender_keystore_t *inventory);
  * @brief Set mender inventory item
  * @param name Name of the item
  * @param value Value of the item
+ * @note The items changed are published after the urgent delay if the item is urgent
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_inventory_set_item(char *name, char *value);
 
+/**
+ * @brief Register a provider of inventory item, called to get the value of the item only when the inventory is published and the value has expired
+ * @param name Name of the item
+ * @param provider Provider callback writing the value of the item in the buffer of the size given, called with the inventory locked so that it must not use the inventory API
+ * @param ttl Time during which the value is kept before it is read again from the provider (seconds), 0 to read it at each publication
+ * @note The value of the items provided is published in addition to the inventory, it is not returned by mender_inventory_get
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_inventory_register_provider(char *name, mender_err_t (*provider)(char *name, char *value, size_t size), uint32_t ttl);
+
 /**
  * @brief Function used to trigger execution of the inventory work
  * @note Calling this function is optional when the periodic execution of the work is configured
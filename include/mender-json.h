@@ -0,0 +1,132 @@
+/**
+ * @file      mender-json.h
+ * @brief     Mender streaming JSON reader interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_JSON_H__
+#define __MENDER_JSON_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Maximum nesting depth of the JSON documents
+ */
+#ifndef CONFIG_MENDER_JSON_MAX_DEPTH
+#define CONFIG_MENDER_JSON_MAX_DEPTH (8)
+#endif /* CONFIG_MENDER_JSON_MAX_DEPTH */
+
+/**
+ * @brief JSON value types
+ */
+typedef enum {
+    MENDER_JSON_TYPE_STRING, /**< String */
+    MENDER_JSON_TYPE_NUMBER, /**< Number */
+    MENDER_JSON_TYPE_TRUE,   /**< Boolean true */
+    MENDER_JSON_TYPE_FALSE,  /**< Boolean false */
+    MENDER_JSON_TYPE_NULL    /**< Null */
+} mender_json_type_t;
+
+/**
+ * @brief JSON reader states
+ */
+typedef enum {
+    MENDER_JSON_STATE_VALUE,       /**< Waiting for a value */
+    MENDER_JSON_STATE_FIRST_VALUE, /**< Waiting for the first value of an array or the end of the array */
+    MENDER_JSON_STATE_FIRST_KEY,   /**< Waiting for the first key of an object or the end of the object */
+    MENDER_JSON_STATE_KEY,         /**< Waiting for a key */
+    MENDER_JSON_STATE_COLON,       /**< Waiting for the colon after a key */
+    MENDER_JSON_STATE_STRING,      /**< Parsing a string */
+    MENDER_JSON_STATE_LITERAL,     /**< Parsing a number, true, false or null */
+    MENDER_JSON_STATE_NEXT,        /**< Waiting for a comma or the end of the current container */
+    MENDER_JSON_STATE_END          /**< End of the document has been reached */
+} mender_json_state_t;
+
+/**
+ * @brief JSON reader
+ * @note The reader parses the document as it is received and invokes the callback for each scalar value, the document is never stored entirely
+ */
+typedef struct {
+    mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *); /**< Callback invoked for each scalar value */
+    void               *params;                                                   /**< Parameters of the callback */
+    mender_json_state_t state;                                                    /**< Current state of the reader */
+    struct {
+        char   type;        /**< Type of the container, '{' or '[' */
+        size_t path_length; /**< Length of the path of the container */
+        size_t index;       /**< Index of the current element if the container is an array */
+    } stack[CONFIG_MENDER_JSON_MAX_DEPTH]; /**< Containers being parsed */
+    size_t depth;                          /**< Number of containers being parsed */
+    struct {
+        char  *data;   /**< Buffer */
+        size_t size;   /**< Size of the buffer */
+        size_t length; /**< Length of the string in the buffer */
+    } path, token;     /**< Path of the current value (for example "payloads[0].type") and current token */
+    bool     key;       /**< The current string is a key */
+    uint8_t  escape;    /**< Number of characters remaining in the current escape sequence */
+    uint32_t unicode;   /**< Code point of the current unicode escape sequence */
+    uint32_t surrogate; /**< High surrogate of the previous unicode escape sequence, 0 if none */
+} mender_json_reader_t;
+
+/**
+ * @brief Initialize JSON reader
+ * @param reader JSON reader
+ * @param callback Callback invoked for each scalar value with the path, the depth, the type and the value of the data, and the parameters
+ * @param params Parameters of the callback
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_json_reader_init(mender_json_reader_t *reader, mender_err_t (*callback)(char *, size_t, mender_json_type_t, char *, void *), void *params);
+
+/**
+ * @brief Parse data of the JSON document
+ * @param reader JSON reader
+ * @param data Data of the document
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_json_reader_process(mender_json_reader_t *reader, void *data, size_t length);
+
+/**
+ * @brief Check the JSON document is complete and release the JSON reader
+ * @param reader JSON reader
+ * @return MENDER_OK if the document is complete and valid, error code otherwise
+ */
+mender_err_t mender_json_reader_end(mender_json_reader_t *reader);
+
+/**
+ * @brief Release JSON reader
+ * @param reader JSON reader
+ */
+void mender_json_reader_release(mender_json_reader_t *reader);
+
+/**
+ * @brief Read a key-store from a JSON document, the string values of the root object are the items of the key-store
+ * @note The document is parsed twice to compute the lengths of the packed key-store and then to fill it, no cJSON tree is built
+ * @param data Data of the document
+ * @param length Length of the data
+ * @param keystore Packed key-store, to be released with mender_utils_keystore_delete
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_json_read_keystore(char *data, size_t length, mender_keystore_t **keystore);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_JSON_H__ */
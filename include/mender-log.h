@@ -42,6 +42,49 @@ extern "C" {
 #define CONFIG_MENDER_LOG_LEVEL MENDER_LOG_LEVEL_INF
 #endif /* CONFIG_MENDER_LOG_LEVEL */
 
+/**
+ * @brief Default interval of the rate limiting of the messages logged by each call site (seconds), 0 to disable rate limiting
+ */
+#ifndef CONFIG_MENDER_LOG_RATELIMIT_INTERVAL
+#define CONFIG_MENDER_LOG_RATELIMIT_INTERVAL (0)
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_INTERVAL */
+
+/**
+ * @brief Default maximum number of messages logged by each call site during the rate limiting interval, 0 to not limit them
+ */
+#ifndef CONFIG_MENDER_LOG_RATELIMIT_BURST_ERR
+#define CONFIG_MENDER_LOG_RATELIMIT_BURST_ERR (5)
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_BURST_ERR */
+#ifndef CONFIG_MENDER_LOG_RATELIMIT_BURST_WRN
+#define CONFIG_MENDER_LOG_RATELIMIT_BURST_WRN (5)
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_BURST_WRN */
+#ifndef CONFIG_MENDER_LOG_RATELIMIT_BURST_INF
+#define CONFIG_MENDER_LOG_RATELIMIT_BURST_INF (10)
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_BURST_INF */
+#ifndef CONFIG_MENDER_LOG_RATELIMIT_BURST_DBG
+#define CONFIG_MENDER_LOG_RATELIMIT_BURST_DBG (0)
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_BURST_DBG */
+
+/**
+ * @brief Filename given to the logs, the base name is used when it is available so that the paths are not kept in flash
+ */
+#ifdef __FILE_NAME__
+#define MENDER_LOG_FILENAME __FILE_NAME__
+#else
+#define MENDER_LOG_FILENAME __FILE__
+#endif /* __FILE_NAME__ */
+
+/**
+ * @brief Give the logs directly to the Zephyr logging subsystem at the call sites, this is only defined for the sources of the library
+ * @note The format strings are then handled by Zephyr, this permits deferred and dictionary logging
+ */
+#ifdef MENDER_LOG_DIRECT
+#include <zephyr/logging/log.h>
+#ifndef MENDER_LOG_MODULE_REGISTER
+LOG_MODULE_DECLARE(mender, CONFIG_MENDER_LOG_LEVEL);
+#endif /* MENDER_LOG_MODULE_REGISTER */
+#endif /* MENDER_LOG_DIRECT */
+
 /**
  * @brief Initialize mender log
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -52,7 +95,7 @@ mender_err_t mender_log_init(void);
  * @brief Print log
  * @param level Log level
  * @param filename Filename
- * @param function Function name
+ * @param function Function name, NULL because the function names are not kept in flash
  * @param line Line
  * @param format Log format
  * @param ... Arguments
@@ -60,47 +103,194 @@ mender_err_t mender_log_init(void);
  */
 mender_err_t mender_log_print(uint8_t level, const char *filename, const char *function, int line, char *format, ...);
 
+#if (0 < CONFIG_MENDER_LOG_RATELIMIT_INTERVAL)
+
+/**
+ * @brief Rate limiting state of a call site
+ */
+typedef struct {
+    uint32_t start;      /**< Uptime when the interval has started (seconds) */
+    uint32_t count;      /**< Number of messages printed during the interval */
+    uint32_t suppressed; /**< Number of messages suppressed since the interval has started */
+} mender_log_ratelimit_t;
+
+/**
+ * @brief Check if a message of a call site can be printed, the number of messages suppressed is reported when the next interval starts
+ * @note The state is not protected, the limits are approximated if the call site is used by several threads at the same time
+ * @param ratelimit Rate limiting state of the call site
+ * @param level Log level
+ * @param filename Filename
+ * @param line Line
+ * @return true if the message can be printed, false if it is suppressed
+ */
+bool mender_log_ratelimit(mender_log_ratelimit_t *ratelimit, uint8_t level, const char *filename, int line);
+
+/**
+ * @brief Print a message if the rate limiting of the call site permits it
+ * @param level Log level
+ * @param print Call printing the message
+ */
+#define MENDER_LOG_RATELIMIT(level, print)                                                                    \
+    ({                                                                                                        \
+        static mender_log_ratelimit_t mender_log_ratelimit_site;                                              \
+        if (true == mender_log_ratelimit(&mender_log_ratelimit_site, level, MENDER_LOG_FILENAME, __LINE__)) { \
+            print;                                                                                            \
+        }                                                                                                     \
+    })
+
+#else
+
+/**
+ * @brief Print a message, rate limiting is disabled
+ * @param level Log level
+ * @param print Call printing the message
+ */
+#define MENDER_LOG_RATELIMIT(level, print) ({ print; })
+
+#endif /* CONFIG_MENDER_LOG_RATELIMIT_INTERVAL */
+
+#ifdef CONFIG_MENDER_LOG_CAPTURE
+
+/**
+ * @brief Default length of the buffer capturing the logs (bytes), the oldest logs are dropped when it is full
+ */
+#ifndef CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH
+#define CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH (4096)
+#endif /* CONFIG_MENDER_LOG_CAPTURE_BUFFER_LENGTH */
+
+/**
+ * @brief Begin the capture of the logs in a RAM buffer, the logs already captured are kept if the capture has been stopped without being released
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_log_capture_begin(void);
+
+/**
+ * @brief Capture a log, invoked by the log macros, nothing is done if the capture is not running
+ * @param level Log level
+ * @param format Log format
+ * @param ... Arguments
+ */
+void mender_log_capture_print(uint8_t level, char *format, ...);
+
+/**
+ * @brief Stop the capture of the logs, the logs captured are kept until the capture is released
+ */
+void mender_log_capture_stop(void);
+
+/**
+ * @brief Write the logs captured in JSON format, as expected by the deployment logs API ({"messages":[...]})
+ * @note The capture must be stopped, the timestamps are given from the uptime because the device may not know the time
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_log_capture_write_json(mender_err_t (*write)(void *, size_t, void *), void *ctx);
+
+/**
+ * @brief Stop the capture of the logs and release the logs captured
+ */
+void mender_log_capture_release(void);
+
+/**
+ * @brief Print a message and capture it
+ * @param level Log level
+ * @param print Call printing the message
+ * @param ... Arguments of the message
+ */
+#define MENDER_LOG_CAPTURE(level, print, ...)           \
+    ({                                                  \
+        print;                                          \
+        mender_log_capture_print((level), __VA_ARGS__); \
+    })
+
+#else
+
+/**
+ * @brief Print a message, the capture is disabled
+ * @param level Log level
+ * @param print Call printing the message
+ * @param ... Arguments of the message
+ */
+#define MENDER_LOG_CAPTURE(level, print, ...) print
+
+#endif /* CONFIG_MENDER_LOG_CAPTURE */
+
 /**
  * @brief Print error log
+ * @note The calls are removed at compile time if the log level is lower
  * @param ... Arguments
  * @return Error code
  */
 #if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_ERR
-#define mender_log_error(...) ({ mender_log_print(MENDER_LOG_LEVEL_ERR, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#ifdef MENDER_LOG_DIRECT
+#define mender_log_error(...) \
+    MENDER_LOG_RATELIMIT(MENDER_LOG_LEVEL_ERR, MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_ERR, LOG_ERR(__VA_ARGS__), __VA_ARGS__))
+#else
+#define mender_log_error(...) \
+    MENDER_LOG_RATELIMIT(     \
+        MENDER_LOG_LEVEL_ERR, \
+        MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_ERR, mender_log_print(MENDER_LOG_LEVEL_ERR, MENDER_LOG_FILENAME, NULL, __LINE__, __VA_ARGS__), __VA_ARGS__))
+#endif /* MENDER_LOG_DIRECT */
 #else
 #define mender_log_error(...)
 #endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_ERR */
 
 /**
  * @brief Print warning log
+ * @note The calls are removed at compile time if the log level is lower
  * @param ... Arguments
  * @return Error code
  */
 #if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_WRN
-#define mender_log_warning(...) ({ mender_log_print(MENDER_LOG_LEVEL_WRN, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#ifdef MENDER_LOG_DIRECT
+#define mender_log_warning(...) \
+    MENDER_LOG_RATELIMIT(MENDER_LOG_LEVEL_WRN, MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_WRN, LOG_WRN(__VA_ARGS__), __VA_ARGS__))
+#else
+#define mender_log_warning(...) \
+    MENDER_LOG_RATELIMIT(       \
+        MENDER_LOG_LEVEL_WRN,   \
+        MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_WRN, mender_log_print(MENDER_LOG_LEVEL_WRN, MENDER_LOG_FILENAME, NULL, __LINE__, __VA_ARGS__), __VA_ARGS__))
+#endif /* MENDER_LOG_DIRECT */
 #else
 #define mender_log_warning(...)
 #endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_WRN */
 
 /**
  * @brief Print info log
+ * @note The calls are removed at compile time if the log level is lower
  * @param ... Arguments
  * @return Error code
  */
 #if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_INF
-#define mender_log_info(...) ({ mender_log_print(MENDER_LOG_LEVEL_INF, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#ifdef MENDER_LOG_DIRECT
+#define mender_log_info(...) \
+    MENDER_LOG_RATELIMIT(MENDER_LOG_LEVEL_INF, MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_INF, LOG_INF(__VA_ARGS__), __VA_ARGS__))
+#else
+#define mender_log_info(...)  \
+    MENDER_LOG_RATELIMIT(     \
+        MENDER_LOG_LEVEL_INF, \
+        MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_INF, mender_log_print(MENDER_LOG_LEVEL_INF, MENDER_LOG_FILENAME, NULL, __LINE__, __VA_ARGS__), __VA_ARGS__))
+#endif /* MENDER_LOG_DIRECT */
 #else
 #define mender_log_info(...)
 #endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_INF */
 
 /**
  * @brief Print debug log
- * @param error_code Error code
+ * @note The calls are removed at compile time if the log level is lower
  * @param ... Arguments
  * @return Error code
  */
 #if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_DBG
-#define mender_log_debug(...) ({ mender_log_print(MENDER_LOG_LEVEL_DBG, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#ifdef MENDER_LOG_DIRECT
+#define mender_log_debug(...) \
+    MENDER_LOG_RATELIMIT(MENDER_LOG_LEVEL_DBG, MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_DBG, LOG_DBG(__VA_ARGS__), __VA_ARGS__))
+#else
+#define mender_log_debug(...) \
+    MENDER_LOG_RATELIMIT(     \
+        MENDER_LOG_LEVEL_DBG, \
+        MENDER_LOG_CAPTURE(MENDER_LOG_LEVEL_DBG, mender_log_print(MENDER_LOG_LEVEL_DBG, MENDER_LOG_FILENAME, NULL, __LINE__, __VA_ARGS__), __VA_ARGS__))
+#endif /* MENDER_LOG_DIRECT */
 #else
 #define mender_log_debug(...)
 #endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_DBG */
@@ -0,0 +1,94 @@
+/**
+ * @file      mender-metrics.h
+ * @brief     Mender metrics interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_METRICS_H__
+#define __MENDER_METRICS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Metrics, the counters accumulate since the start of the application and the gauges hold the latest value
+ */
+typedef enum {
+    MENDER_METRICS_BYTES_DOWNLOADED = 0,    /**< Counter of the artifact data received (bytes) */
+    MENDER_METRICS_DOWNLOAD_DURATION,       /**< Gauge of the duration of the latest artifact download (milliseconds) */
+    MENDER_METRICS_DOWNLOAD_RETRIES,        /**< Counter of the artifact downloads resumed */
+    MENDER_METRICS_AUTHENTICATION_ATTEMPTS, /**< Counter of the authentication requests */
+    MENDER_METRICS_CONNECT_DURATION,        /**< Gauge of the duration of the latest connection, name resolution and TLS handshake included (milliseconds) */
+    MENDER_METRICS_FLASH_WRITE_DURATION,    /**< Counter of the time spent writing the flash (microseconds), it wraps around after about 71 minutes */
+    MENDER_METRICS_HEAP_PEAK,               /**< Gauge of the heap peak (bytes), only available with the heap statistics */
+    MENDER_METRICS_WEBSOCKET_CONNECTIONS,   /**< Counter of the troubleshoot connections established */
+    MENDER_METRICS_SCHEDULER_OVERRUNS,      /**< Counter of the work executions skipped because the work was pending or executing */
+    MENDER_METRICS_NETWORK_CONNECTIONS,     /**< Counter of the network accesses requested with the network_connect callback */
+    MENDER_METRICS_NETWORK_DURATION,        /**< Counter of the time the network access is kept (milliseconds), linger delay included, it wraps around after about 49 days */
+    MENDER_METRICS_COUNT                    /**< Number of metrics, not a metric */
+} mender_metrics_t;
+
+#ifdef CONFIG_MENDER_CLIENT_METRICS
+
+/**
+ * @brief Add a value to a counter
+ * @param metric Metric
+ * @param value Value added
+ */
+void mender_metrics_add(mender_metrics_t metric, uint32_t value);
+
+/**
+ * @brief Set the value of a gauge
+ * @param metric Metric
+ * @param value Value
+ */
+void mender_metrics_set(mender_metrics_t metric, uint32_t value);
+
+/**
+ * @brief Get the value of a metric
+ * @param metric Metric
+ * @return Value of the metric
+ */
+uint32_t mender_metrics_get(mender_metrics_t metric);
+
+/**
+ * @brief Function used to print metric as string
+ * @param metric Metric
+ * @return Metric as string, NULL if it is not found
+ */
+char *mender_metrics_to_string(mender_metrics_t metric);
+
+/**
+ * @brief Metrics macros, the metrics are compiled out if CONFIG_MENDER_CLIENT_METRICS is not defined
+ */
+#define MENDER_METRICS_ADD(metric, value) mender_metrics_add((metric), (value))
+#define MENDER_METRICS_SET(metric, value) mender_metrics_set((metric), (value))
+
+#else
+
+#define MENDER_METRICS_ADD(metric, value)
+#define MENDER_METRICS_SET(metric, value)
+
+#endif /* CONFIG_MENDER_CLIENT_METRICS */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_METRICS_H__ */
@@ -0,0 +1,96 @@
+/**
+ * @file      mender-relay.h
+ * @brief     Mender relay artifact type interface, the payloads are relayed to a co-processor with a windowed acknowledgement protocol
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_RELAY_H__
+#define __MENDER_RELAY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_RELAY
+
+/**
+ * @brief Default maximum number of relay artifact types
+ */
+#ifndef CONFIG_MENDER_RELAY_COUNT
+#define CONFIG_MENDER_RELAY_COUNT (2)
+#endif /* CONFIG_MENDER_RELAY_COUNT */
+
+/**
+ * @brief Default size of the blocks sent to the co-processor (bytes)
+ */
+#ifndef CONFIG_MENDER_RELAY_BLOCK_SIZE
+#define CONFIG_MENDER_RELAY_BLOCK_SIZE (256)
+#endif /* CONFIG_MENDER_RELAY_BLOCK_SIZE */
+
+/**
+ * @brief Default number of blocks sent to the co-processor without being acknowledged
+ */
+#ifndef CONFIG_MENDER_RELAY_WINDOW
+#define CONFIG_MENDER_RELAY_WINDOW (4)
+#endif /* CONFIG_MENDER_RELAY_WINDOW */
+
+/**
+ * @brief Default delay after which the blocks not acknowledged are sent again (milliseconds)
+ */
+#ifndef CONFIG_MENDER_RELAY_ACK_TIMEOUT
+#define CONFIG_MENDER_RELAY_ACK_TIMEOUT (500)
+#endif /* CONFIG_MENDER_RELAY_ACK_TIMEOUT */
+
+/**
+ * @brief Default number of times the blocks are sent again before the transfer fails
+ */
+#ifndef CONFIG_MENDER_RELAY_RETRIES
+#define CONFIG_MENDER_RELAY_RETRIES (5)
+#endif /* CONFIG_MENDER_RELAY_RETRIES */
+
+/**
+ * @brief Transport to the co-processor, on UART or SPI for example
+ * @note The blocks are numbered from 0 for each file, the co-processor acknowledges them cumulatively once programmed and drops the blocks out of sequence
+ */
+typedef struct {
+    mender_err_t (*begin)(char *, size_t, void *);          /**< Begin the transfer of a file with its name and size, the flash is prepared (optional) */
+    mender_err_t (*send)(uint32_t, void *, size_t, void *); /**< Send a block with its sequence number, without waiting for the acknowledgement */
+    mender_err_t (*receive)(uint32_t *, uint32_t, void *);  /**< Receive the sequence number of the next block expected, MENDER_NOT_FOUND on timeout */
+    mender_err_t (*end)(void *);                            /**< End the transfer once all the blocks are acknowledged, the file is checked (optional) */
+    void (*abort)(void *);                                  /**< Abort the transfer of a file which has not been completed (optional) */
+    void *params;                                           /**< Parameters passed to the functions, NULL if not used */
+} mender_relay_transport_t;
+
+/**
+ * @brief Register a relay artifact type, the files of the payloads are sent by blocks to the co-processor using the transport
+ * @note The blocks are sent while the previous ones are programmed by the co-processor, up to CONFIG_MENDER_RELAY_WINDOW blocks are waiting to be acknowledged
+ * @note The payload workers permit to overlap the transfer with the reception of the artifact
+ * @param type Artifact type
+ * @param transport Transport to the co-processor, must remain valid while the artifact type is registered
+ * @param needs_restart Flag to indicate if the artifact type requires the device to restart after downloading
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_relay_register(char *type, mender_relay_transport_t *transport, bool needs_restart);
+
+#endif /* CONFIG_MENDER_RELAY */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_RELAY_H__ */
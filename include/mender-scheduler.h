@@ -26,15 +26,62 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Work priority, the high priority works are executed by a dedicated work queue if it is enabled, by the default work queue otherwise
+ */
+typedef enum {
+    MENDER_SCHEDULER_WORK_PRIORITY_DEFAULT = 0, /**< Default priority, used by the works that can last long (deployments) */
+    MENDER_SCHEDULER_WORK_PRIORITY_HIGH,        /**< High priority, used by the works that must not be delayed by the deployments (add-ons) */
+} mender_scheduler_work_priority_t;
+
 /**
  * @brief Work parameters
  */
 typedef struct {
-    mender_err_t (*function)(void); /**< Work function */
-    int32_t period;                 /**< Work period (seconds), negative or null value permits to disable periodic execution */
-    char   *name;                   /**< Work name */
+    mender_err_t (*function)(void);            /**< Work function */
+    int32_t                          period;   /**< Work period (seconds), negative or null value permits to disable periodic execution */
+    char                            *name;     /**< Work name */
+    mender_scheduler_work_priority_t priority; /**< Work priority */
+    uint32_t                         slack;    /**< Work slack (percentage of the period) tolerated to execute the work earlier, null value to disable */
 } mender_scheduler_work_params_t;
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Number of buckets of the run time histogram of the works
+ */
+#define MENDER_SCHEDULER_WORK_STATISTICS_BUCKET_COUNT (16)
+
+/**
+ * @brief Work statistics, durations are given in microseconds with the resolution of the scheduler uptime
+ * @note Bucket n of the run time histogram counts the run times from 2^(n-1) to 2^n milliseconds, the first bucket counts the run times less than 1 millisecond
+ * @note The last bucket of the run time histogram also counts the longer run times
+ */
+typedef struct {
+    uint32_t executions;                                                        /**< Number of executions of the work function */
+    uint32_t overruns;                                                          /**< Number of executions skipped, the work was pending or executing */
+    uint32_t losses;                                                            /**< Number of executions lost because the work queue was full */
+    uint32_t run_time_histogram[MENDER_SCHEDULER_WORK_STATISTICS_BUCKET_COUNT]; /**< Run time histogram */
+    uint64_t run_time_total_us;                                                 /**< Total run time, used to compute the average run time */
+    uint32_t run_time_max_us;                                                   /**< Maximum run time */
+    uint64_t latency_total_us;                                                  /**< Total start latency, used to compute the average start latency */
+    uint32_t latency_max_us;                                                    /**< Maximum start latency, delay between submission and execution */
+    uint32_t queue_high_water_mark;                                             /**< Maximum number of works pending in the work queue on submission */
+} mender_scheduler_work_stats_t;
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+/**
+ * @brief Task parameters
+ */
+typedef struct {
+    void (*function)(void *); /**< Task function, the task ends when the function returns */
+    void    *arg;             /**< Argument of the task function */
+    char    *name;            /**< Task name */
+    uint32_t stack_size;      /**< Task stack size (kB) */
+    int32_t  priority;        /**< Task priority */
+} mender_scheduler_task_params_t;
+
 /**
  * @brief Initialization of the scheduler
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -43,6 +90,7 @@ mender_err_t mender_scheduler_init(void);
 
 /**
  * @brief Function used to register a new work
+ * @note With the static allocation of the scheduler the work name is not copied, it must remain valid until the work is deleted
  * @param work_params Work parameters
  * @param handle Work handle if the function succeeds, NULL otherwise
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -71,6 +119,25 @@ mender_err_t mender_scheduler_work_set_period(void *handle, uint32_t period);
  */
 mender_err_t mender_scheduler_work_execute(void *handle);
 
+/**
+ * @brief Function used to trigger execution of the work after a delay
+ * @note If a delayed execution of the work is already scheduled the nearest one is kept
+ * @note The execution is skipped if the work is pending or executing when the delay expires
+ * @param handle Work handle
+ * @param delay_ms Delay (milliseconds), the work is executed now if it is null
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_work_execute_after(void *handle, uint32_t delay_ms);
+
+/**
+ * @brief Function used to trigger execution of the work at a deadline
+ * @note The delayed executions are coalesced like with mender_scheduler_work_execute_after
+ * @param handle Work handle
+ * @param uptime_us Deadline given as an uptime returned by mender_scheduler_get_uptime_us (microseconds), the work is executed now if it is reached
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_work_execute_at(void *handle, uint64_t uptime_us);
+
 /**
  * @brief Function used to deactivate a work
  * @param handle Work handle
@@ -85,6 +152,18 @@ mender_err_t mender_scheduler_work_deactivate(void *handle);
  */
 mender_err_t mender_scheduler_work_delete(void *handle);
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Function used to get the statistics of a work, they are cumulated since the work has been created
+ * @param handle Work handle
+ * @param stats Work statistics
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_work_get_stats(void *handle, mender_scheduler_work_stats_t *stats);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
 /**
  * @brief Function used to create a mutex
  * @param handle Mutex handle if the function succeeds, NULL otherwise
@@ -114,6 +193,75 @@ mender_err_t mender_scheduler_mutex_give(void *handle);
  */
 mender_err_t mender_scheduler_mutex_delete(void *handle);
 
+/**
+ * @brief Function used to create a task, the task is executed concurrently with the works
+ * @note With the static allocation of the scheduler the task name is not copied, it must remain valid until the task is joined
+ * @param task_params Task parameters
+ * @param handle Task handle if the function succeeds, NULL otherwise
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle);
+
+/**
+ * @brief Function used to wait for the end of a task and delete it
+ * @param handle Task handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_task_join(void *handle);
+
+/**
+ * @brief Function used to create a queue
+ * @param length Maximum number of items in the queue
+ * @param item_size Size of the items
+ * @param handle Queue handle if the function succeeds, NULL otherwise
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_create(size_t length, size_t item_size, void **handle);
+
+/**
+ * @brief Function used to send an item to a queue, the item is copied
+ * @param handle Queue handle
+ * @param item Item
+ * @param delay_ms Delay to wait for free space in the queue, -1 to block indefinitely (without a timeout)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms);
+
+/**
+ * @brief Function used to receive an item from a queue
+ * @param handle Queue handle
+ * @param item Item, copied from the queue
+ * @param delay_ms Delay to wait for an item in the queue, -1 to block indefinitely (without a timeout)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms);
+
+/**
+ * @brief Function used to delete a queue
+ * @param handle Queue handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_delete(void *handle);
+
+/**
+ * @brief Function used to notify the scheduler the device is awake (for example the radio is on)
+ * @note The works which periodic execution is due within their slack are executed now to save wake-ups of the device
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_notify_wakeup(void);
+
+/**
+ * @brief Function used to get the time elapsed since the system started, the resolution depends on the platform
+ * @return Uptime (microseconds)
+ */
+uint64_t mender_scheduler_get_uptime_us(void);
+
+/**
+ * @brief Function used to let the other tasks run, the calling task is suspended during the delay so that the tasks of lower priority can run too
+ * @param delay_ms Delay (milliseconds), the tasks of the same priority only can run if it is null
+ */
+void mender_scheduler_yield(uint32_t delay_ms);
+
 /**
  * @brief Release mender scheduler
  * @return MENDER_OK if the function succeeds, error code otherwise
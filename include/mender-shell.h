@@ -28,33 +28,38 @@ extern "C" {
 
 /**
  * @brief Open a new shell
+ * @note The shell is shared by the sessions opened at the same time, its output is printed to all of them
+ * @param session Session
  * @param terminal_width Terminal width
  * @param terminal_height Terminal height
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_shell_open(uint16_t terminal_width, uint16_t terminal_height);
+mender_err_t mender_shell_open(void *session, uint16_t terminal_width, uint16_t terminal_height);
 
 /**
  * @brief Resize the shell
+ * @param session Session
  * @param terminal_width Terminal width
  * @param terminal_height Terminal height
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_shell_resize(uint16_t terminal_width, uint16_t terminal_height);
+mender_err_t mender_shell_resize(void *session, uint16_t terminal_width, uint16_t terminal_height);
 
 /**
  * @brief Write data to the shell
+ * @param session Session
  * @param data Data to write
  * @param length Length of the data
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_shell_write(void *data, size_t length);
+mender_err_t mender_shell_write(void *session, void *data, size_t length);
 
 /**
- * @brief Close shell
+ * @brief Close shell, it is stopped once all the sessions are closed
+ * @param session Session
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_shell_close(void);
+mender_err_t mender_shell_close(void *session);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,107 @@
+/**
+ * @file      mender-storage-cache.h
+ * @brief     Mender storage cache interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_STORAGE_CACHE_H__
+#define __MENDER_STORAGE_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Items of the storage
+ */
+typedef enum {
+    MENDER_STORAGE_ITEM_PRIVATE_KEY = 0,      /**< Private key */
+    MENDER_STORAGE_ITEM_PUBLIC_KEY,           /**< Public key */
+    MENDER_STORAGE_ITEM_DEPLOYMENT_DATA,      /**< Deployment data */
+    MENDER_STORAGE_ITEM_DEVICE_CONFIG,        /**< Device configuration */
+    MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, /**< Authentication token */
+    MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT,   /**< Install checkpoint */
+    MENDER_STORAGE_ITEM_COUNT                 /**< Number of items, not an item */
+} mender_storage_item_t;
+
+/**
+ * @brief Operations of the storage backend used by the cache
+ */
+typedef struct {
+    mender_err_t (*read)(mender_storage_item_t, void **, size_t *); /**< Read an item allocated with a NUL terminator, MENDER_NOT_FOUND if not available */
+    mender_err_t (*write)(mender_storage_item_t, void *, size_t);   /**< Write an item */
+    mender_err_t (*erase)(mender_storage_item_t);                   /**< Erase an item, MENDER_NOT_FOUND if not available */
+    mender_err_t (*commit)(void);                                   /**< Commit the items written and erased, NULL if not required */
+} mender_storage_cache_ops_t;
+
+/**
+ * @brief Initialize mender storage cache
+ * @param ops Operations of the storage backend, must remain valid until the cache is released
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_init(const mender_storage_cache_ops_t *ops);
+
+/**
+ * @brief Get an item, it is served from RAM once it has been loaded
+ * @param item Item
+ * @param data Copy of the item with a NUL terminator not counted in the length, to be released by the caller, NULL if not found
+ * @param length Length of the item, 0 if not found
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+mender_err_t mender_storage_cache_get(mender_storage_item_t item, void **data, size_t *length);
+
+/**
+ * @brief Set an item, it is written when the transaction is committed or immediately if there is no transaction
+ * @param item Item
+ * @param data Data of the item
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_set(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Delete an item, it is erased when the transaction is committed or immediately if there is no transaction
+ * @param item Item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_delete(mender_storage_item_t item);
+
+/**
+ * @brief Begin a transaction, the items set and deleted are kept in RAM until the transaction is committed
+ * @note Transactions can be nested, the items are written when the outermost transaction is committed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_begin(void);
+
+/**
+ * @brief Commit a transaction, the items set and deleted are written at once with a single commit of the backend
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_commit(void);
+
+/**
+ * @brief Release mender storage cache, the pending items are written
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_exit(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_STORAGE_CACHE_H__ */
@@ -32,6 +32,19 @@ extern "C" {
  */
 mender_err_t mender_storage_init(void);
 
+/**
+ * @brief Begin a storage transaction, the items set and deleted are written at once when the transaction is committed
+ * @note Transactions can be nested, the items are written when the outermost transaction is committed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_begin(void);
+
+/**
+ * @brief Commit a storage transaction
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_commit(void);
+
 /**
  * @brief Set authentication keys
  * @param private_key Private key to store
@@ -81,6 +94,50 @@ mender_err_t mender_storage_get_deployment_data(char **deployment_data);
  */
 mender_err_t mender_storage_delete_deployment_data(void);
 
+/**
+ * @brief Set authentication token
+ * @param token Authentication token to store
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_set_authentication_token(char *token);
+
+/**
+ * @brief Get authentication token
+ * @param token Authentication token from storage, NULL if not found
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_get_authentication_token(char **token);
+
+/**
+ * @brief Delete authentication token
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_delete_authentication_token(void);
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+/**
+ * @brief Set install checkpoint
+ * @param checkpoint Install checkpoint to store
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_set_install_checkpoint(char *checkpoint);
+
+/**
+ * @brief Get install checkpoint
+ * @param checkpoint Install checkpoint from storage, NULL if not found
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_get_install_checkpoint(char **checkpoint);
+
+/**
+ * @brief Delete install checkpoint
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_delete_install_checkpoint(void);
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
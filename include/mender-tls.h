@@ -26,6 +26,11 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief SHA-256 digest length (bytes)
+ */
+#define MENDER_TLS_SHA256_DIGEST_LENGTH (32)
+
 /**
  * @brief Initialize mender TLS
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -43,6 +48,7 @@ mender_err_t mender_tls_init_authentication_keys(bool recommissioning);
  * @brief Get public key (PEM format suitable to be integrated in mender authentication request)
  * @param public_key Public key, NULL if an error occurred
  * @return MENDER_OK if the function succeeds, error code otherwise
+ * @note The public key is owned by the TLS module, it must not be released and it is valid until the authentication keys are initialized again
  */
 mender_err_t mender_tls_get_public_key_pem(char **public_key);
 
@@ -55,6 +61,40 @@ mender_err_t mender_tls_get_public_key_pem(char **public_key);
  */
 mender_err_t mender_tls_sign_payload(char *payload, char **signature, size_t *signature_length);
 
+/**
+ * @brief Begin computation of a SHA-256 digest
+ * @param handle SHA-256 context handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_tls_sha256_begin(void **handle);
+
+/**
+ * @brief Update SHA-256 digest with new data
+ * @param handle SHA-256 context handle
+ * @param data Data
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_tls_sha256_update(void *handle, void *data, size_t length);
+
+/**
+ * @brief End computation of a SHA-256 digest and release the context
+ * @param handle SHA-256 context handle
+ * @param digest Digest of the data (MENDER_TLS_SHA256_DIGEST_LENGTH bytes), NULL to only release the context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_tls_sha256_end(void *handle, uint8_t *digest);
+
+/**
+ * @brief Verify signature of a SHA-256 digest
+ * @param public_key Public key used to verify the signature (PEM format)
+ * @param digest Digest (MENDER_TLS_SHA256_DIGEST_LENGTH bytes)
+ * @param signature Signature (base64 encoded)
+ * @param signature_length Length of the signature
+ * @return MENDER_OK if the signature is valid, error code otherwise
+ */
+mender_err_t mender_tls_verify_signature(char *public_key, uint8_t *digest, char *signature, size_t signature_length);
+
 /**
  * @brief Release mender TLS
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -0,0 +1,95 @@
+/**
+ * @file      mender-trace.h
+ * @brief     Mender trace interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_TRACE_H__
+#define __MENDER_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Traced operations
+ */
+typedef enum {
+    MENDER_TRACE_EVENT_HTTP_PERFORM = 0,      /**< HTTP request, from the connection to the end of the response */
+    MENDER_TRACE_EVENT_NET_CONNECT,           /**< Name resolution, connection and TLS handshake */
+    MENDER_TRACE_EVENT_ARTIFACT_PROCESS_DATA, /**< Parsing of a chunk of the artifact, artifact type callbacks included */
+    MENDER_TRACE_EVENT_FLASH_OPEN,            /**< Opening of the flash handle, erasing the update partition if required */
+    MENDER_TRACE_EVENT_FLASH_WRITE,           /**< Programming of a chunk of the update */
+    MENDER_TRACE_EVENT_FLASH_CLOSE,           /**< Closing of the flash handle */
+    MENDER_TRACE_EVENT_FLASH_SET_PENDING,     /**< Setting of the image to boot */
+    MENDER_TRACE_EVENT_TLS_SIGN_PAYLOAD,      /**< Signature of the authentication request */
+    MENDER_TRACE_EVENT_SCHEDULER_WORK,        /**< Execution of a work of the scheduler */
+    MENDER_TRACE_EVENT_COUNT                  /**< Number of events, not an event */
+} mender_trace_event_t;
+
+/**
+ * @brief Names of the traced operations, given in the order of the events
+ */
+#define MENDER_TRACE_EVENT_NAMES                                                           \
+    { "http_perform", "net_connect", "artifact_process_data", "flash_open", "flash_write", \
+      "flash_close", "flash_set_pending", "tls_sign_payload", "scheduler_work" }
+
+#ifdef CONFIG_MENDER_TRACE
+
+/**
+ * @brief Initialize mender trace
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_trace_init(void);
+
+/**
+ * @brief Record the beginning of an operation
+ * @param event Traced operation
+ */
+void mender_trace_begin(mender_trace_event_t event);
+
+/**
+ * @brief Record the end of an operation
+ * @param event Traced operation
+ */
+void mender_trace_end(mender_trace_event_t event);
+
+/**
+ * @brief Release mender trace
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_trace_exit(void);
+
+/**
+ * @brief Trace macros, the hooks are compiled out if CONFIG_MENDER_TRACE is not defined
+ */
+#define MENDER_TRACE_BEGIN(event) mender_trace_begin(event)
+#define MENDER_TRACE_END(event)   mender_trace_end(event)
+
+#else
+
+#define MENDER_TRACE_BEGIN(event)
+#define MENDER_TRACE_END(event)
+
+#endif /* CONFIG_MENDER_TRACE */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_TRACE_H__ */
@@ -76,6 +76,13 @@ mender_err_t mender_troubleshoot_init(void *config, void *callbacks);
  */
 mender_err_t mender_troubleshoot_activate(void);
 
+/**
+ * @brief Connect the device to the server now, the reconnect backoff is reset
+ * @note This function is intended to be called on a push trigger once the connection has been closed because it was idle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_troubleshoot_connect(void);
+
 /**
  * @brief Deactivate mender troubleshoot add-on
  * @note This function disconnects the device of the server
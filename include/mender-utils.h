@@ -27,6 +27,7 @@ extern "C" {
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -69,6 +70,140 @@ typedef struct {
  */
 typedef mender_keystore_item_t mender_keystore_t;
 
+/**
+ * @brief Buffer written with mender_utils_buffer_write, the length is computed even if the data do not fit
+ */
+typedef struct {
+    char  *data;   /**< Buffer, NULL terminated if there is room, NULL to compute the length only */
+    size_t size;   /**< Size of the buffer */
+    size_t length; /**< Length of the data written, it may exceed the size of the buffer */
+} mender_utils_buffer_t;
+
+/**
+ * @brief Key-store index, hash table of the names of the items with the length of the key-store cached
+ * @note The index must be built again when items are added, removed or renamed, the values can be changed freely
+ */
+typedef struct {
+    size_t    length;  /**< Length of the key-store */
+    size_t    size;    /**< Number of buckets, a power of two */
+    uint32_t *buckets; /**< Index of the items plus one, 0 if the bucket is empty */
+} mender_keystore_index_t;
+
+/**
+ * @brief Key-store builder, the items and the strings of the packed key-store are allocated at once
+ */
+typedef struct {
+    mender_keystore_t *keystore; /**< Packed key-store being built */
+    size_t             size;     /**< Number of items of the key-store */
+    size_t             length;   /**< Number of items added */
+    char              *strings;  /**< Next free byte of the strings */
+    char              *end;      /**< End of the strings */
+} mender_keystore_builder_t;
+
+/**
+ * @brief Memory allocator, used by the client, the add-ons and cJSON
+ */
+typedef struct {
+    void *(*malloc_fn)(size_t size);             /**< Allocate memory */
+    void *(*realloc_fn)(void *ptr, size_t size); /**< Resize memory previously allocated */
+    void (*free_fn)(void *ptr);                  /**< Release memory */
+} mender_allocator_t;
+
+/**
+ * @brief Block of an arena
+ */
+typedef struct mender_utils_arena_block_s mender_utils_arena_block_t;
+
+/**
+ * @brief Arena, the temporary allocations of a request are bumped in blocks released all at once
+ */
+typedef struct {
+    mender_utils_arena_block_t *blocks;     /**< Blocks of the arena, the current one first */
+    size_t                      block_size; /**< Size of the blocks, larger allocations get a dedicated block */
+    void                       *last;       /**< Last allocation, it can be resized in place */
+} mender_utils_arena_t;
+
+/**
+ * @brief Initializer of an arena
+ * @param size Size of the blocks
+ */
+#define MENDER_UTILS_ARENA_INIT(size) { .blocks = NULL, .block_size = (size), .last = NULL }
+
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+
+/**
+ * @brief Subsystems the memory allocations are accounted to
+ */
+typedef enum {
+    MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT,       /**< Client and utility functions */
+    MENDER_UTILS_HEAP_SUBSYSTEM_API,          /**< Mender server API */
+    MENDER_UTILS_HEAP_SUBSYSTEM_ARTIFACT,     /**< Artifact parser, decompression and delta */
+    MENDER_UTILS_HEAP_SUBSYSTEM_JSON,         /**< cJSON and streaming JSON reader */
+    MENDER_UTILS_HEAP_SUBSYSTEM_HTTP,         /**< HTTP, websocket and network */
+    MENDER_UTILS_HEAP_SUBSYSTEM_TLS,          /**< TLS */
+    MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE,      /**< Storage */
+    MENDER_UTILS_HEAP_SUBSYSTEM_FLASH,        /**< Flash */
+    MENDER_UTILS_HEAP_SUBSYSTEM_SCHEDULER,    /**< Scheduler */
+    MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT, /**< Troubleshoot add-on and shell */
+    MENDER_UTILS_HEAP_SUBSYSTEM_INVENTORY,    /**< Inventory add-on */
+    MENDER_UTILS_HEAP_SUBSYSTEM_CONFIGURE,    /**< Configure add-on */
+    MENDER_UTILS_HEAP_SUBSYSTEM_ALL           /**< All the subsystems together */
+} mender_utils_heap_subsystem_t;
+
+/**
+ * @brief Heap statistics of a subsystem, since the start of the application
+ */
+typedef struct {
+    size_t   current;     /**< Bytes currently allocated */
+    size_t   peak;        /**< Maximum of the bytes allocated at the same time */
+    uint32_t count;       /**< Number of allocations currently alive */
+    uint32_t allocations; /**< Number of allocations performed */
+    uint32_t failures;    /**< Number of allocations that failed */
+} mender_utils_heap_statistics_t;
+
+/**
+ * @brief Default subsystem the memory allocations are accounted to, the files define it before including the headers
+ */
+#ifndef MENDER_UTILS_HEAP_SUBSYSTEM
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_CLIENT
+#endif /* MENDER_UTILS_HEAP_SUBSYSTEM */
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+
+/**
+ * @brief Default memory allocated by all the subsystems above which the memory is under pressure (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_HIGH_WATERMARK
+#define CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_HIGH_WATERMARK (49152)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_HIGH_WATERMARK */
+
+/**
+ * @brief Default memory allocated by all the subsystems below which the memory is not under pressure anymore (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_LOW_WATERMARK
+#define CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_LOW_WATERMARK (40960)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_LOW_WATERMARK */
+
+/**
+ * @brief Default maximum number of memory pressure callbacks
+ */
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_CALLBACKS_COUNT
+#define CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_CALLBACKS_COUNT (8)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE_CALLBACKS_COUNT */
+
+/**
+ * @brief Memory pressure levels
+ */
+typedef enum {
+    MENDER_UTILS_MEMORY_PRESSURE_NONE,    /**< The memory allocated is below the low watermark, or between the watermarks after a pressure */
+    MENDER_UTILS_MEMORY_PRESSURE_HIGH,    /**< The memory allocated is above the high watermark */
+    MENDER_UTILS_MEMORY_PRESSURE_CRITICAL /**< An allocation has failed, it is tried again once the callbacks have run, until memory is released */
+} mender_utils_memory_pressure_t;
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+
 /**
  * @brief Function used to print HTTP status as string
  * @param status HTTP status code
@@ -122,9 +257,43 @@ mender_keystore_t *mender_utils_keystore_new(size_t length);
  */
 mender_err_t mender_utils_keystore_copy(mender_keystore_t **dst_keystore, mender_keystore_t *src_keystore);
 
+/**
+ * @brief Function used to copy key-store to a packed key-store, the items and the strings are allocated at once
+ * @note The items of a packed key-store can't be set, a packed key-store is copied with a single allocation and released with a single free
+ * @param dst_keystore Destination packed key-store to create
+ * @param src_keystore Source key-store to copy, packed or not
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_keystore_pack(mender_keystore_t **dst_keystore, mender_keystore_t *src_keystore);
+
+/**
+ * @brief Function used to begin a packed key-store
+ * @param builder Key-store builder
+ * @param length Number of items of the key-store
+ * @param strings_length Length of the names and values of the items, including their NULL terminators
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_keystore_builder_begin(mender_keystore_builder_t *builder, size_t length, size_t strings_length);
+
+/**
+ * @brief Function used to add an item to a packed key-store
+ * @param builder Key-store builder
+ * @param name Name of the item
+ * @param value Value of the item
+ * @return MENDER_OK if the function succeeds, error code if the item does not fit in the lengths given to mender_utils_keystore_builder_begin
+ */
+mender_err_t mender_utils_keystore_builder_add(mender_keystore_builder_t *builder, const char *name, const char *value);
+
+/**
+ * @brief Function used to end a packed key-store
+ * @param builder Key-store builder
+ * @return Packed key-store, to be released with mender_utils_keystore_delete
+ */
+mender_keystore_t *mender_utils_keystore_builder_end(mender_keystore_builder_t *builder);
+
 /**
  * @brief Function used to set key-store from JSON string
- * @param keystore Key-store
+ * @param keystore Key-store, packed
  * @param object JSON object
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
@@ -138,9 +307,44 @@ mender_err_t mender_utils_keystore_from_json(mender_keystore_t **keystore, cJSON
  */
 mender_err_t mender_utils_keystore_to_json(mender_keystore_t *keystore, cJSON **object);
 
+/**
+ * @brief Function used to write key-store as JSON object, without building a cJSON tree
+ * @param keystore Key-store, NULL to write an empty object
+ * @param write Write function, invoked with pieces of the JSON object
+ * @param ctx Context of the write function
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_keystore_write_json(mender_keystore_t *keystore, mender_err_t (*write)(void *, size_t, void *), void *ctx);
+
+/**
+ * @brief Function used to format key-store to JSON string, the string is allocated at once with the exact length
+ * @param keystore Key-store, NULL to format an empty object
+ * @param json JSON string, to be released with mender_free
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_keystore_to_json_string(mender_keystore_t *keystore, char **json);
+
+/**
+ * @brief Function used to write a string in JSON format, the special characters are escaped like cJSON does
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param str String
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_json_write_string(mender_err_t (*write)(void *, size_t, void *), void *ctx, const char *str);
+
+/**
+ * @brief Write function appending data to a buffer, to be used with the JSON write functions
+ * @param data Data to write
+ * @param length Length of the data
+ * @param ctx Buffer (mender_utils_buffer_t)
+ * @return MENDER_OK, the data which do not fit are counted only
+ */
+mender_err_t mender_utils_buffer_write(void *data, size_t length, void *ctx);
+
 /**
  * @brief Function used to set key-store item name and value
- * @param keystore Key-store to be updated
+ * @param keystore Key-store to be updated, not packed
  * @param index Index of the item in the key-store
  * @param name Name of the item
  * @param value Value of the item
@@ -170,6 +374,212 @@ size_t mender_utils_keystore_length(mender_keystore_t *keystore);
  */
 mender_err_t mender_utils_keystore_delete(mender_keystore_t *keystore);
 
+/**
+ * @brief Function used to build the index of a key-store
+ * @param keystore Key-store
+ * @param index Key-store index, the previous index is released
+ * @return MENDER_OK if the function succeeds, error code otherwise, the index is empty then and the lookups fall back to a linear search
+ */
+mender_err_t mender_utils_keystore_index_build(mender_keystore_t *keystore, mender_keystore_index_t *index);
+
+/**
+ * @brief Function used to get index of item in key-store with the key-store index
+ * @param keystore Key-store
+ * @param index Key-store index
+ * @param name Name of the item
+ * @return Index of the item found in the key-store, -1 otherwise
+ */
+int mender_utils_keystore_index_lookup(mender_keystore_t *keystore, mender_keystore_index_t *index, char *name);
+
+/**
+ * @brief Function used to release the index of a key-store
+ * @param index Key-store index
+ */
+void mender_utils_keystore_index_release(mender_keystore_index_t *index);
+
+/**
+ * @brief Function used to set the memory allocator, cJSON is configured to use it too
+ * @note It must be called before initializing the client, the memory allocated before is released with the previous allocator
+ * @param allocator Memory allocator, NULL to use the allocator of the C library
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_set_allocator(mender_allocator_t *allocator);
+
+/**
+ * @brief Function used to allocate memory with the memory allocator
+ * @param size Size to allocate
+ * @return Memory allocated, NULL if an error occurred
+ */
+void *mender_malloc(size_t size);
+
+/**
+ * @brief Function used to allocate memory initialized to zero with the memory allocator
+ * @param count Number of elements
+ * @param size Size of the elements
+ * @return Memory allocated, NULL if an error occurred
+ */
+void *mender_calloc(size_t count, size_t size);
+
+/**
+ * @brief Function used to resize memory allocated with the memory allocator
+ * @param ptr Memory to resize, NULL to allocate
+ * @param size New size
+ * @return Memory resized, NULL if an error occurred, the memory is not released then
+ */
+void *mender_realloc(void *ptr, size_t size);
+
+/**
+ * @brief Function used to release memory allocated with the memory allocator
+ * @param ptr Memory to release
+ */
+void mender_free(void *ptr);
+
+/**
+ * @brief Function used to duplicate a string with the memory allocator
+ * @param str String to duplicate
+ * @return String duplicated, NULL if an error occurred
+ */
+char *mender_strdup(const char *str);
+
+/**
+ * @brief Function used to duplicate the beginning of a string with the memory allocator
+ * @param str String to duplicate
+ * @param length Maximum length to duplicate
+ * @return String duplicated, NULL if an error occurred
+ */
+char *mender_strndup(const char *str, size_t length);
+
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+
+/**
+ * @brief Function used to account the memory allocated by cJSON to the JSON subsystem, it is called when the client is initialized
+ * @note The cJSON items allocated before must not be released after
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_heap_init(void);
+
+/**
+ * @brief Function used to allocate memory accounted to a subsystem with the memory allocator
+ * @param subsystem Subsystem
+ * @param size Size to allocate
+ * @return Memory allocated, NULL if an error occurred
+ */
+void *mender_utils_heap_malloc(mender_utils_heap_subsystem_t subsystem, size_t size);
+
+/**
+ * @brief Function used to allocate memory initialized to zero accounted to a subsystem with the memory allocator
+ * @param subsystem Subsystem
+ * @param count Number of elements
+ * @param size Size of the elements
+ * @return Memory allocated, NULL if an error occurred
+ */
+void *mender_utils_heap_calloc(mender_utils_heap_subsystem_t subsystem, size_t count, size_t size);
+
+/**
+ * @brief Function used to resize memory accounted to a subsystem with the memory allocator
+ * @param subsystem Subsystem, used if the memory is allocated
+ * @param ptr Memory to resize, it remains accounted to its subsystem, NULL to allocate
+ * @param size New size
+ * @return Memory resized, NULL if an error occurred, the memory is not released then
+ */
+void *mender_utils_heap_realloc(mender_utils_heap_subsystem_t subsystem, void *ptr, size_t size);
+
+/**
+ * @brief Function used to duplicate a string accounted to a subsystem with the memory allocator
+ * @param subsystem Subsystem
+ * @param str String to duplicate
+ * @param length Maximum length to duplicate
+ * @return String duplicated, NULL if an error occurred
+ */
+char *mender_utils_heap_strndup(mender_utils_heap_subsystem_t subsystem, const char *str, size_t length);
+
+/**
+ * @brief Function used to retrieve the heap statistics of a subsystem
+ * @param subsystem Subsystem, MENDER_UTILS_HEAP_SUBSYSTEM_ALL for all the subsystems together
+ * @param statistics Heap statistics
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_get_heap_statistics(mender_utils_heap_subsystem_t subsystem, mender_utils_heap_statistics_t *statistics);
+
+/**
+ * @brief Function used to print subsystem as string
+ * @param subsystem Subsystem
+ * @return Subsystem as string, NULL if it is not found
+ */
+char *mender_utils_heap_subsystem_to_string(mender_utils_heap_subsystem_t subsystem);
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_PRESSURE
+
+/**
+ * @brief Function used to register a memory pressure callback, the callbacks are invoked by priority order when the memory pressure level changes
+ * @note The callbacks are invoked in the context of the allocation or of the release changing the level, they must not block
+ * @note The callbacks should release caches or set flags so that the subsystem degrades gracefully, pausing sessions or deferring publications
+ * @note It must be called at initialization, before the memory pressure level can change
+ * @param callback Callback invoked with the new memory pressure level and the parameters
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param priority Priority of the callback, the lowest priority first
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_memory_pressure_register(void (*callback)(mender_utils_memory_pressure_t, void *), void *params, uint8_t priority);
+
+/**
+ * @brief Function used to unregister a memory pressure callback
+ * @param callback Callback to unregister
+ * @param params Parameters passed to the callback
+ */
+void mender_utils_memory_pressure_unregister(void (*callback)(mender_utils_memory_pressure_t, void *), void *params);
+
+/**
+ * @brief Function used to get the memory pressure level, the subsystems can check it before allocating large buffers
+ * @return Memory pressure level
+ */
+mender_utils_memory_pressure_t mender_utils_memory_pressure_get(void);
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_PRESSURE */
+
+/**
+ * @brief The memory allocations are accounted to the subsystem of the file
+ */
+#define mender_malloc(size)         mender_utils_heap_malloc(MENDER_UTILS_HEAP_SUBSYSTEM, (size))
+#define mender_calloc(count, size)  mender_utils_heap_calloc(MENDER_UTILS_HEAP_SUBSYSTEM, (count), (size))
+#define mender_realloc(ptr, size)   mender_utils_heap_realloc(MENDER_UTILS_HEAP_SUBSYSTEM, (ptr), (size))
+#define mender_strdup(str)          mender_utils_heap_strndup(MENDER_UTILS_HEAP_SUBSYSTEM, (str), SIZE_MAX)
+#define mender_strndup(str, length) mender_utils_heap_strndup(MENDER_UTILS_HEAP_SUBSYSTEM, (str), (length))
+
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+
+/**
+ * @brief Function used to allocate memory from an arena
+ * @param arena Arena
+ * @param size Size to allocate
+ * @return Memory allocated, NULL if an error occurred, it is released with the arena
+ */
+void *mender_utils_arena_alloc(mender_utils_arena_t *arena, size_t size);
+
+/**
+ * @brief Function used to resize memory allocated from an arena, the last allocation is resized in place when the block permits it
+ * @param arena Arena
+ * @param ptr Memory to resize, NULL to allocate
+ * @param old_size Size of the memory to resize
+ * @param size New size
+ * @return Memory resized, NULL if an error occurred
+ */
+void *mender_utils_arena_realloc(mender_utils_arena_t *arena, void *ptr, size_t old_size, size_t size);
+
+/**
+ * @brief Function used to duplicate a string in an arena
+ * @param arena Arena
+ * @param str String to duplicate
+ * @return String duplicated, NULL if an error occurred
+ */
+char *mender_utils_arena_strdup(mender_utils_arena_t *arena, const char *str);
+
+/**
+ * @brief Function used to release all the memory allocated from an arena, the arena can be used again
+ * @param arena Arena
+ */
+void mender_utils_arena_release(mender_utils_arena_t *arena);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
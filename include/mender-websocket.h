@@ -39,6 +39,7 @@ typedef struct {
 typedef enum {
     MENDER_WEBSOCKET_EVENT_CONNECTED,     /**< Connected to the server */
     MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, /**< Data received from the server */
+    MENDER_WEBSOCKET_EVENT_HEARTBEAT,     /**< Ping or pong received from the server, the connection is alive */
     MENDER_WEBSOCKET_EVENT_DISCONNECTED,  /**< Disconnected from the server */
     MENDER_WEBSOCKET_EVENT_ERROR          /**< An error occurred */
 } mender_websocket_client_event_t;
@@ -51,6 +52,8 @@ mender_err_t mender_websocket_init(mender_websocket_config_t *config);
 
 /**
  * @brief Perform HTTP request and upgrade connection to websocket
+ * @note No websocket extension is negotiated, the frames are sent and received with the RSV bits cleared because the curl, ESP-IDF and Zephyr clients
+ * do not permit to set them or report them, so permessage-deflate is not supported
  * @param jwt Token, NULL if not authenticated yet
  * @param path Path of the request
  * @param callback Callback invoked on websocket events
@@ -70,6 +73,13 @@ mender_err_t mender_websocket_connect(
  */
 mender_err_t mender_websocket_send(void *handle, void *payload, size_t length);
 
+/**
+ * @brief Send a ping over websocket connection, the pong is reported with the heartbeat event
+ * @param handle Websocket connection handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_websocket_ping(void *handle);
+
 /**
  * @brief Close the websocket connection
  * @param handle Websocket connection handle
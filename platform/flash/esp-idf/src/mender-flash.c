@@ -17,9 +17,53 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_FLASH
+
 #include <esp_ota_ops.h>
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
 #include "mender-flash.h"
 #include "mender-log.h"
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+#include "mender-scheduler.h"
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+/**
+ * @brief Background erase task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE
+#define CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE (2)
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE */
+
+/**
+ * @brief Background erase task priority
+ */
+#ifndef CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY
+#define CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY */
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+/**
+ * @brief Size of the chunks read to compare the sectors with the existing contents
+ */
+#define MENDER_FLASH_COMPARE_SIZE (64)
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+/**
+ * @brief Label of the data partition used as staging area
+ */
+#define MENDER_FLASH_STAGING_PARTITION_LABEL "mender_staging"
 
 /**
  * @brief Flash handle
@@ -27,8 +71,107 @@
 typedef struct {
     const esp_partition_t *partition;  /**< Update partition to which the firmware is flashed */
     esp_ota_handle_t       ota_handle; /**< OTA handle used to flash the firmware */
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+    struct {
+        void                 *task;  /**< Background erase task handle */
+        size_t                size;  /**< Size of the range to be erased */
+        volatile size_t       front; /**< Length of the range already erased */
+        volatile bool         done;  /**< The background erase task has ended */
+        volatile bool         abort; /**< Request the background erase task to stop */
+        volatile mender_err_t ret;   /**< Result of the background erase */
+    } erase;                         /**< Background erase of the update partition */
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    struct {
+        uint8_t *data;    /**< Data of the sector */
+        size_t   offset;  /**< Offset of the sector in the update partition */
+        size_t   length;  /**< Length of the data of the sector */
+        size_t   count;   /**< Number of sectors received */
+        size_t   skipped; /**< Number of unchanged sectors which have not been programmed */
+    } sector;             /**< Sector being received */
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
 } mender_flash_handle_t;
 
+/**
+ * @brief Staging handle
+ */
+typedef struct {
+    const esp_partition_t *partition; /**< Staging partition */
+    size_t                 erased;    /**< Length of the staging partition already erased */
+} mender_flash_staging_handle_t;
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+/**
+ * @brief Background erase task function, erase the update partition sector by sector ahead of the writes
+ * @param arg Flash handle
+ */
+static void mender_flash_erase_task(void *arg);
+
+/**
+ * @brief Wait until the background erase has reached the end of the data to be written
+ * @param handle Flash handle
+ * @param end End of the data to be written
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_wait(mender_flash_handle_t *handle, size_t end);
+
+/**
+ * @brief Stop the background erase task and wait for its end
+ * @param handle Flash handle
+ * @return MENDER_OK if the background erase succeeded, error code otherwise
+ */
+static mender_err_t mender_flash_erase_join(mender_flash_handle_t *handle);
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+/**
+ * @brief Program the sector being received, the sector is skipped if it is identical to the existing contents of the update partition
+ * @param handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_sector_flush(mender_flash_handle_t *handle);
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+mender_err_t
+mender_flash_get_capacity(size_t *capacity) {
+
+    assert(NULL != capacity);
+    const esp_partition_t *partition;
+
+    /* Retrieve the size of the next update partition */
+    if (NULL == (partition = esp_ota_get_next_update_partition(NULL))) {
+        mender_log_error("Unable to find next update partition");
+        return MENDER_FAIL;
+    }
+    *capacity = partition->size;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    const esp_partition_t *partition;
+    esp_err_t              err;
+
+    /* Read the running image from the running partition */
+    if (NULL == (partition = esp_ota_get_running_partition())) {
+        mender_log_error("Unable to find running partition");
+        return MENDER_FAIL;
+    }
+    if (ESP_OK != (err = esp_partition_read(partition, index, data, length))) {
+        mender_log_error("esp_partition_read failed (%d)", err);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
 
@@ -40,7 +183,7 @@ mender_flash_open(char *name, size_t size, void **handle) {
     mender_log_info("Start flashing artifact '%s' with size %d", name, size);
 
     /* Allocate memory to store the flash handle */
-    if (NULL == (*handle = malloc(sizeof(mender_flash_handle_t)))) {
+    if (NULL == (*handle = mender_malloc(sizeof(mender_flash_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -64,14 +207,73 @@ mender_flash_open(char *name, size_t size, void **handle) {
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+    /* Start erasing the update partition while the data are received, the writes are not erasing the sectors anymore */
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)(*handle);
+    size_t                 sector_size  = flash_handle->partition->erase_size;
+    flash_handle->erase.size            = ((size + sector_size - 1) / sector_size) * sector_size;
+    if (flash_handle->erase.size > flash_handle->partition->size) {
+        flash_handle->erase.size = flash_handle->partition->size;
+    }
+    flash_handle->erase.front                  = 0;
+    flash_handle->erase.done                   = false;
+    flash_handle->erase.abort                  = false;
+    flash_handle->erase.ret                    = MENDER_OK;
+    mender_scheduler_task_params_t task_params = { .function   = mender_flash_erase_task,
+                                                   .arg        = flash_handle,
+                                                   .name       = "mender_flash_erase",
+                                                   .stack_size = CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE,
+                                                   .priority   = CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY };
+    if (MENDER_OK != mender_scheduler_task_create(&task_params, &flash_handle->erase.task)) {
+        mender_log_error("Unable to create background erase task");
+        esp_ota_abort(flash_handle->ota_handle);
+        return MENDER_FAIL;
+    }
+
+#elif defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+
+    /* Allocate memory to store the sector being received */
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)(*handle);
+    if (NULL == (flash_handle->sector.data = (uint8_t *)mender_malloc(flash_handle->partition->erase_size))) {
+        mender_log_error("Unable to allocate memory");
+        esp_ota_abort(flash_handle->ota_handle);
+        return MENDER_FAIL;
+    }
+    flash_handle->sector.offset  = 0;
+    flash_handle->sector.length  = 0;
+    flash_handle->sector.count   = 0;
+    flash_handle->sector.skipped = 0;
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
     return MENDER_OK;
 }
 
+mender_err_t
+mender_flash_resume(char *name, size_t size, size_t *index, void **handle) {
+
+    (void)name;
+    (void)size;
+    (void)index;
+    (void)handle;
+
+    /* The OTA is always started from the beginning of the update partition, the sectors already written are erased again */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 mender_err_t
 mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 
+#if defined(CONFIG_MENDER_FLASH_BACKGROUND_ERASE)
+    esp_err_t err;
+#elif defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    size_t                 sector_length;
+#else
     (void)index;
     esp_err_t err;
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
 
     /* Check flash handle */
     if (NULL == handle) {
@@ -79,12 +281,50 @@ mender_flash_write(void *handle, void *data, size_t index, size_t length) {
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+    /* Wait for the sectors to be erased and write data received to the update partition */
+    if (MENDER_OK != mender_flash_erase_wait((mender_flash_handle_t *)handle, index + length)) {
+        return MENDER_FAIL;
+    }
+    if (ESP_OK != (err = esp_ota_write_with_offset(((mender_flash_handle_t *)handle)->ota_handle, data, length, index))) {
+        mender_log_error("esp_ota_write_with_offset failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+#elif defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+
+    /* Gather data received in the sector buffer, the sectors are programmed when they are complete */
+    if (index != flash_handle->sector.offset + flash_handle->sector.length) {
+        mender_log_error("Invalid data index");
+        return MENDER_FAIL;
+    }
+    while (length > 0) {
+        sector_length = flash_handle->partition->erase_size - flash_handle->sector.length;
+        if (sector_length > length) {
+            sector_length = length;
+        }
+        memcpy(&flash_handle->sector.data[flash_handle->sector.length], data, sector_length);
+        flash_handle->sector.length += sector_length;
+        data                         = (uint8_t *)data + sector_length;
+        length                      -= sector_length;
+        if (flash_handle->sector.length == flash_handle->partition->erase_size) {
+            if (MENDER_OK != mender_flash_sector_flush(flash_handle)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+#else
+
     /* Write data received to the update partition */
     if (ESP_OK != (err = esp_ota_write(((mender_flash_handle_t *)handle)->ota_handle, data, length))) {
         mender_log_error("esp_ota_write failed (%s)", esp_err_to_name(err));
         return MENDER_FAIL;
     }
 
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
     return MENDER_OK;
 }
 
@@ -94,11 +334,20 @@ mender_flash_abort_deployment(void *handle) {
     /* Check flash handle */
     if (NULL != handle) {
 
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+        /* Stop background erase */
+        ((mender_flash_handle_t *)handle)->erase.abort = true;
+        mender_flash_erase_join((mender_flash_handle_t *)handle);
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+        mender_free(((mender_flash_handle_t *)handle)->sector.data);
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
         /* Abort current deployment */
         esp_ota_abort(((mender_flash_handle_t *)handle)->ota_handle);
 
         /* Release memory */
-        free(handle);
+        mender_free(handle);
     }
 
     return MENDER_OK;
@@ -115,6 +364,24 @@ mender_flash_close(void *handle) {
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+    /* Wait for the end of the background erase */
+    if (MENDER_OK != mender_flash_erase_join((mender_flash_handle_t *)handle)) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Program the last sector */
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    if ((flash_handle->sector.length > 0) && (MENDER_OK != mender_flash_sector_flush(flash_handle))) {
+        return MENDER_FAIL;
+    }
+    mender_log_info("%d unchanged sectors of %d have not been programmed", flash_handle->sector.skipped, flash_handle->sector.count);
+    mender_free(flash_handle->sector.data);
+    flash_handle->sector.data = NULL;
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
     /* Ending current deployment */
     if (ESP_OK != (err = esp_ota_end(((mender_flash_handle_t *)handle)->ota_handle))) {
         if (ESP_ERR_OTA_VALIDATE_FAILED == err) {
@@ -128,6 +395,27 @@ mender_flash_close(void *handle) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    esp_err_t err;
+
+    /* Check flash handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the update partition */
+    if (ESP_OK != (err = esp_partition_read(((mender_flash_handle_t *)handle)->partition, index, data, length))) {
+        mender_log_error("esp_partition_read failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_flash_set_pending_image(void *handle) {
 
@@ -143,7 +431,7 @@ mender_flash_set_pending_image(void *handle) {
         }
 
         /* Release memory */
-        free(handle);
+        mender_free(handle);
     }
 
     return MENDER_OK;
@@ -181,3 +469,216 @@ mender_flash_is_image_confirmed(void) {
     /* Check if the image is still pending */
     return (ESP_OTA_IMG_VALID == img_state);
 }
+
+mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    (void)name;
+    assert(NULL != handle);
+    const esp_partition_t         *partition;
+    mender_flash_staging_handle_t *staging_handle;
+
+    /* Retrieve the staging partition */
+    if (NULL == (partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, MENDER_FLASH_STAGING_PARTITION_LABEL))) {
+        mender_log_error("Unable to find staging partition");
+        return MENDER_NOT_IMPLEMENTED;
+    }
+
+    /* Allocate memory to store the staging handle, the partition is erased as the data are written */
+    if (NULL == (staging_handle = (mender_flash_staging_handle_t *)mender_malloc(sizeof(mender_flash_staging_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    staging_handle->partition = partition;
+    staging_handle->erased    = 0;
+    *handle                   = staging_handle;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    mender_flash_staging_handle_t *staging_handle = (mender_flash_staging_handle_t *)handle;
+    esp_err_t                      err;
+
+    /* Check staging handle */
+    if (NULL == staging_handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+    if (index + length > staging_handle->partition->size) {
+        mender_log_error("Data exceed the size of the staging partition");
+        return MENDER_FAIL;
+    }
+
+    /* Erase ahead of the data to be written */
+    while (staging_handle->erased < index + length) {
+        if (ESP_OK != (err = esp_partition_erase_range(staging_handle->partition, staging_handle->erased, staging_handle->partition->erase_size))) {
+            mender_log_error("esp_partition_erase_range failed (%s)", esp_err_to_name(err));
+            return MENDER_FAIL;
+        }
+        staging_handle->erased += staging_handle->partition->erase_size;
+    }
+
+    /* Write data to the staging partition */
+    if (ESP_OK != (err = esp_partition_write(staging_handle->partition, index, data, length))) {
+        mender_log_error("esp_partition_write failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    /* Check staging handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Nothing to do, the data are written directly to the staging partition */
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    esp_err_t err;
+
+    /* Check staging handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the staging partition */
+    if (ESP_OK != (err = esp_partition_read(((mender_flash_staging_handle_t *)handle)->partition, index, data, length))) {
+        mender_log_error("esp_partition_read failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    /* Release memory */
+    mender_free(handle);
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+static void
+mender_flash_erase_task(void *arg) {
+
+    assert(NULL != arg);
+    mender_flash_handle_t *handle = (mender_flash_handle_t *)arg;
+    esp_err_t              err;
+
+    /* Erase the update partition sector by sector, the writes are waiting for the erase front */
+    while ((false == handle->erase.abort) && (handle->erase.front < handle->erase.size)) {
+        if (ESP_OK != (err = esp_partition_erase_range(handle->partition, handle->erase.front, handle->partition->erase_size))) {
+            mender_log_error("esp_partition_erase_range failed (%s)", esp_err_to_name(err));
+            handle->erase.ret = MENDER_FAIL;
+            break;
+        }
+        handle->erase.front += handle->partition->erase_size;
+    }
+    handle->erase.done = true;
+}
+
+static mender_err_t
+mender_flash_erase_wait(mender_flash_handle_t *handle, size_t end) {
+
+    assert(NULL != handle);
+
+    /* Wait until the erase front has passed the end of the data */
+    while (handle->erase.front < end) {
+        if ((true == handle->erase.done) && (handle->erase.front < end)) {
+            if (MENDER_OK == handle->erase.ret) {
+                mender_log_error("Data exceed the size of the artifact");
+            }
+            return MENDER_FAIL;
+        }
+        vTaskDelay(1);
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_erase_join(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Wait for the end of the background erase task */
+    if (NULL != handle->erase.task) {
+        mender_scheduler_task_join(handle->erase.task);
+        handle->erase.task = NULL;
+    }
+
+    return handle->erase.ret;
+}
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+static mender_err_t
+mender_flash_sector_flush(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+    uint8_t   buffer[MENDER_FLASH_COMPARE_SIZE];
+    size_t    index = 0;
+    size_t    length;
+    esp_err_t err;
+
+    /* Compare the sector with the existing contents, the first sector is always programmed so that the OTA handle is not empty */
+    if (handle->sector.offset > 0) {
+        while (index < handle->sector.length) {
+            length = handle->sector.length - index;
+            if (length > sizeof(buffer)) {
+                length = sizeof(buffer);
+            }
+            if (ESP_OK != (err = esp_partition_read(handle->partition, handle->sector.offset + index, buffer, length))) {
+                mender_log_error("esp_partition_read failed (%s)", esp_err_to_name(err));
+                return MENDER_FAIL;
+            }
+            if (0 != memcmp(buffer, &handle->sector.data[index], length)) {
+                break;
+            }
+            index += length;
+        }
+    }
+
+    /* Erase and program the sector if it has changed */
+    if ((0 == handle->sector.offset) || (index < handle->sector.length)) {
+        if (ESP_OK != (err = esp_partition_erase_range(handle->partition, handle->sector.offset, handle->partition->erase_size))) {
+            mender_log_error("esp_partition_erase_range failed (%s)", esp_err_to_name(err));
+            return MENDER_FAIL;
+        }
+        if (ESP_OK != (err = esp_ota_write_with_offset(handle->ota_handle, handle->sector.data, handle->sector.length, handle->sector.offset))) {
+            mender_log_error("esp_ota_write_with_offset failed (%s)", esp_err_to_name(err));
+            return MENDER_FAIL;
+        }
+    } else {
+        handle->sector.skipped++;
+    }
+    handle->sector.count++;
+
+    /* Move to the next sector */
+    handle->sector.offset += handle->partition->erase_size;
+    handle->sector.length  = 0;
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
@@ -19,6 +19,26 @@
 
 #include "mender-flash.h"
 
+__attribute__((weak)) mender_err_t
+mender_flash_get_capacity(size_t *capacity) {
+
+    (void)capacity;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
 
@@ -30,6 +50,18 @@ mender_flash_open(char *name, size_t size, void **handle) {
     return MENDER_OK;
 }
 
+__attribute__((weak)) mender_err_t
+mender_flash_resume(char *name, size_t size, size_t *index, void **handle) {
+
+    (void)name;
+    (void)size;
+    (void)index;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 
@@ -51,6 +83,18 @@ mender_flash_close(void *handle) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_flash_set_pending_image(void *handle) {
 
@@ -82,3 +126,55 @@ mender_flash_is_image_confirmed(void) {
     /* Nothing to do */
     return false;
 }
+
+__attribute__((weak)) mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    (void)name;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
@@ -17,7 +17,14 @@
  * limitations under the License.
  */
 
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_FLASH
+
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include "mender-flash.h"
 #include "mender-log.h"
@@ -29,56 +36,206 @@
 #define CONFIG_MENDER_FLASH_PATH ""
 #endif /* CONFIG_MENDER_FLASH_PATH */
 
+/**
+ * @brief Default size of the write buffer, the data are written to the update file by blocks of this size (bytes)
+ */
+#ifndef CONFIG_MENDER_FLASH_BUFFER_SIZE
+#define CONFIG_MENDER_FLASH_BUFFER_SIZE (1024 * 1024)
+#endif /* CONFIG_MENDER_FLASH_BUFFER_SIZE */
+
+/**
+ * @brief Default alignment of the write buffer and of the writes (bytes), it must be a multiple of the logical block size when direct I/O is used
+ */
+#ifndef CONFIG_MENDER_FLASH_ALIGNMENT
+#define CONFIG_MENDER_FLASH_ALIGNMENT (4096)
+#endif /* CONFIG_MENDER_FLASH_ALIGNMENT */
+
 /**
  * @brief Deployment files
  */
 #define MENDER_FLASH_REQUEST_UPGRADE CONFIG_MENDER_FLASH_PATH "request_upgrade"
+#define MENDER_FLASH_STAGING         CONFIG_MENDER_FLASH_PATH "staging"
+
+/**
+ * @brief Suffix of the artifacts which are not completely staged in the cache directory
+ */
+#define MENDER_FLASH_STAGING_PARTIAL_SUFFIX ".part"
+
+/**
+ * @brief Staging handle
+ */
+typedef struct {
+    int   fd;     /**< Staging file descriptor */
+    char *path;   /**< Path of the staging file */
+    bool  cached; /**< The artifact is completely staged and it is kept in the cache directory */
+} mender_flash_staging_handle_t;
+
+/**
+ * @brief Flash handle
+ */
+typedef struct {
+    int fd; /**< Update file descriptor, -1 when the file is closed */
+    struct {
+        uint8_t *data;   /**< Data of the buffer, aligned on CONFIG_MENDER_FLASH_ALIGNMENT */
+        size_t   offset; /**< Offset of the buffer in the update file */
+        size_t   length; /**< Length of the data in the buffer */
+    } buffer;            /**< Write buffer */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    uint8_t *existing; /**< Existing contents of the update file, aligned on CONFIG_MENDER_FLASH_ALIGNMENT */
+#endif                 /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+} mender_flash_handle_t;
+
+/**
+ * @brief Allocate the flash handle and open the update file
+ * @param name Name of the artifact
+ * @param size Size of the artifact
+ * @param flags Flags used to open the update file
+ * @param handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_create(char *name, size_t size, int flags, mender_flash_handle_t **handle);
+
+/**
+ * @brief Write the data of the buffer to the update file
+ * @param handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_buffer_flush(mender_flash_handle_t *handle);
+
+/**
+ * @brief Close the update file and release the flash handle
+ * @param handle Flash handle
+ */
+static void mender_flash_release(mender_flash_handle_t *handle);
+
+mender_err_t
+mender_flash_get_capacity(size_t *capacity) {
+
+    (void)capacity;
+
+    /* The capacity of the file system is not checked */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* The running image is not available on the file system */
+    return MENDER_NOT_IMPLEMENTED;
+}
 
 mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
 
     assert(NULL != name);
     assert(NULL != handle);
-    char *path = NULL;
+    int flags;
 
     /* Print current file name and size */
     mender_log_info("Start flashing artifact '%s' with size %d", name, size);
 
-    /* Compute path */
-    size_t str_length = strlen(CONFIG_MENDER_FLASH_PATH) + strlen(name) + 1;
-    if (NULL == (path = (char *)malloc(str_length))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
+    /* Begin deployment, the existing contents are kept if the unchanged data are not written again */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    flags = O_RDWR | O_CREAT;
+#else
+    flags = O_WRONLY | O_CREAT | O_TRUNC;
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+    return mender_flash_create(name, size, flags, (mender_flash_handle_t **)handle);
+}
+
+mender_err_t
+mender_flash_resume(char *name, size_t size, size_t *index, void **handle) {
+
+    assert(NULL != name);
+    assert(NULL != index);
+    assert(NULL != handle);
+    mender_err_t ret;
+
+    /* The data are written to the update file by blocks of the size of the write buffer, the block being gathered is lost on reset */
+    *index = (*index / CONFIG_MENDER_FLASH_BUFFER_SIZE) * CONFIG_MENDER_FLASH_BUFFER_SIZE;
+
+    /* Print current file name, size and index */
+    mender_log_info("Resume flashing artifact '%s' with size %zu at index %zu", name, size, *index);
+
+    /* Continue deployment, the existing contents are kept and read back */
+    if (MENDER_OK != (ret = mender_flash_create(name, size, O_RDWR | O_CREAT, (mender_flash_handle_t **)handle))) {
+        return ret;
     }
-    snprintf(path, str_length, "%s%s", CONFIG_MENDER_FLASH_PATH, name);
+    ((mender_flash_handle_t *)(*handle))->buffer.offset = *index;
 
-    /* Begin deployment with sequential writes */
-    if (NULL == (*handle = fopen(path, "wb"))) {
-        mender_log_error("fopen failed (%d)", errno);
-        free(path);
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_write(void *handle, void *data, size_t index, size_t length) {
+
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    size_t                 buffer_length;
+
+    /* Check flash handle */
+    if (NULL == flash_handle) {
+        mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
-    /* Release memory */
-    free(path);
+    /* Flush the buffer if the data are not contiguous */
+    if (index != flash_handle->buffer.offset + flash_handle->buffer.length) {
+        if (MENDER_OK != mender_flash_buffer_flush(flash_handle)) {
+            return MENDER_FAIL;
+        }
+        flash_handle->buffer.offset = index;
+    }
+
+    /* Gather data received in the write buffer, the buffer is written to the update file when it is full */
+    while (length > 0) {
+        buffer_length = CONFIG_MENDER_FLASH_BUFFER_SIZE - flash_handle->buffer.length;
+        if (buffer_length > length) {
+            buffer_length = length;
+        }
+        memcpy(&flash_handle->buffer.data[flash_handle->buffer.length], data, buffer_length);
+        flash_handle->buffer.length += buffer_length;
+        data                         = (uint8_t *)data + buffer_length;
+        length                      -= buffer_length;
+        if (CONFIG_MENDER_FLASH_BUFFER_SIZE == flash_handle->buffer.length) {
+            if (MENDER_OK != mender_flash_buffer_flush(flash_handle)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
 
     return MENDER_OK;
 }
 
 mender_err_t
-mender_flash_write(void *handle, void *data, size_t index, size_t length) {
+mender_flash_close(void *handle) {
 
-    (void)index;
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    off_t                  end;
 
     /* Check flash handle */
-    if (NULL == handle) {
+    if (NULL == flash_handle) {
         mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
-    /* Write data received to the update file */
-    if (fwrite(data, sizeof(unsigned char), length, handle) != length) {
-        mender_log_error("fwrite failed (%d)", length);
+    /* Write the remaining data, remove the padding and the existing contents beyond the end of the artifact */
+    end = (off_t)(flash_handle->buffer.offset + flash_handle->buffer.length);
+    if (MENDER_OK != mender_flash_buffer_flush(flash_handle)) {
+        return MENDER_FAIL;
+    }
+    if (0 != ftruncate(flash_handle->fd, end)) {
+        mender_log_error("ftruncate failed (%d)", errno);
+        return MENDER_FAIL;
+    }
+
+    /* Make sure the data are on the storage before the upgrade is requested, the update file remains open to read back the data */
+    if (0 != fdatasync(flash_handle->fd)) {
+        mender_log_error("fdatasync failed (%d)", errno);
         return MENDER_FAIL;
     }
 
@@ -86,16 +243,38 @@ mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 }
 
 mender_err_t
-mender_flash_close(void *handle) {
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    size_t                 offset;
+    size_t                 chunk;
+    size_t                 aligned_length;
+    ssize_t                result;
 
     /* Check flash handle */
-    if (NULL == handle) {
+    if ((NULL == flash_handle) || (-1 == flash_handle->fd)) {
         mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
-    /* Close update file */
-    fclose(handle);
+    /* Read data from the update file by aligned blocks, the write buffer is available once the update file is closed */
+    while (length > 0) {
+        offset = index % CONFIG_MENDER_FLASH_ALIGNMENT;
+        chunk  = CONFIG_MENDER_FLASH_BUFFER_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        aligned_length = ((offset + chunk + CONFIG_MENDER_FLASH_ALIGNMENT - 1) / CONFIG_MENDER_FLASH_ALIGNMENT) * CONFIG_MENDER_FLASH_ALIGNMENT;
+        if ((result = pread(flash_handle->fd, flash_handle->buffer.data, aligned_length, (off_t)(index - offset))) < (ssize_t)(offset + chunk)) {
+            mender_log_error("pread failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        memcpy(data, &flash_handle->buffer.data[offset], chunk);
+        data    = (uint8_t *)data + chunk;
+        index  += chunk;
+        length -= chunk;
+    }
 
     return MENDER_OK;
 }
@@ -116,6 +295,9 @@ mender_flash_set_pending_image(void *handle) {
         } else {
             fclose(file);
         }
+
+        /* Release memory */
+        mender_flash_release((mender_flash_handle_t *)handle);
     }
 
     return ret;
@@ -128,7 +310,7 @@ mender_flash_abort_deployment(void *handle) {
     if (NULL != handle) {
 
         /* Release memory */
-        fclose(handle);
+        mender_flash_release((mender_flash_handle_t *)handle);
     }
 
     return MENDER_OK;
@@ -159,3 +341,287 @@ mender_flash_is_image_confirmed(void) {
     /* Check if the image it still pending */
     return (0 != access(MENDER_FLASH_REQUEST_UPGRADE, F_OK));
 }
+
+mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    assert(NULL != name);
+    assert(NULL != handle);
+    mender_flash_staging_handle_t *staging_handle;
+
+    /* Allocate memory to store the staging handle */
+    if (NULL == (staging_handle = (mender_flash_staging_handle_t *)mender_malloc(sizeof(mender_flash_staging_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Compute path, the artifacts are kept in the cache directory with their name so that they can be served to the other devices */
+#ifdef CONFIG_MENDER_FLASH_STAGING_CACHE
+    size_t str_length = strlen(CONFIG_MENDER_FLASH_PATH) + strlen(name) + strlen(MENDER_FLASH_STAGING_PARTIAL_SUFFIX) + 1;
+    if (NULL == (staging_handle->path = (char *)mender_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        mender_free(staging_handle);
+        return MENDER_FAIL;
+    }
+    snprintf(staging_handle->path, str_length, "%s%s%s", CONFIG_MENDER_FLASH_PATH, name, MENDER_FLASH_STAGING_PARTIAL_SUFFIX);
+#else
+    if (NULL == (staging_handle->path = mender_strdup(MENDER_FLASH_STAGING))) {
+        mender_log_error("Unable to allocate memory");
+        mender_free(staging_handle);
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_STAGING_CACHE */
+
+    /* Create staging file, the previous contents are discarded */
+    staging_handle->cached = false;
+    if (-1 == (staging_handle->fd = open(staging_handle->path, O_RDWR | O_CREAT | O_TRUNC, 0644))) {
+        mender_log_error("open failed (%d)", errno);
+        mender_free(staging_handle->path);
+        mender_free(staging_handle);
+        return MENDER_FAIL;
+    }
+    *handle = staging_handle;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    ssize_t result;
+
+    /* Check staging handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Write data to the staging file */
+    while (length > 0) {
+        if ((result = pwrite(((mender_flash_staging_handle_t *)handle)->fd, data, length, (off_t)index)) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            mender_log_error("pwrite failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        data    = (uint8_t *)data + result;
+        index  += (size_t)result;
+        length -= (size_t)result;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    /* Check staging handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_STAGING_CACHE
+    /* Make sure the artifact is on the storage and give it its name so that it is served to the other devices, the file remains open to read back the data */
+    mender_flash_staging_handle_t *staging_handle = (mender_flash_staging_handle_t *)handle;
+    if (0 != fdatasync(staging_handle->fd)) {
+        mender_log_error("fdatasync failed (%d)", errno);
+        return MENDER_FAIL;
+    }
+    char *path = mender_strdup(staging_handle->path);
+    if (NULL == path) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    path[strlen(path) - strlen(MENDER_FLASH_STAGING_PARTIAL_SUFFIX)] = '\0';
+    if (0 != rename(staging_handle->path, path)) {
+        mender_log_error("rename failed (%d)", errno);
+        mender_free(path);
+        return MENDER_FAIL;
+    }
+    mender_free(staging_handle->path);
+    staging_handle->path   = path;
+    staging_handle->cached = true;
+#endif /* CONFIG_MENDER_FLASH_STAGING_CACHE */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    ssize_t result;
+
+    /* Check staging handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the staging file */
+    while (length > 0) {
+        if ((result = pread(((mender_flash_staging_handle_t *)handle)->fd, data, length, (off_t)index)) <= 0) {
+            if ((result < 0) && (EINTR == errno)) {
+                continue;
+            }
+            mender_log_error("pread failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        data    = (uint8_t *)data + result;
+        index  += (size_t)result;
+        length -= (size_t)result;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    /* Check staging handle */
+    if (NULL != handle) {
+
+        /* Close staging file, it is removed unless the artifacts are kept in the cache directory once they are completely staged */
+        mender_flash_staging_handle_t *staging_handle = (mender_flash_staging_handle_t *)handle;
+        close(staging_handle->fd);
+        if (false == staging_handle->cached) {
+            unlink(staging_handle->path);
+        }
+
+        /* Release memory */
+        mender_free(staging_handle->path);
+        mender_free(staging_handle);
+    }
+
+    return MENDER_OK;
+}
+
+
+static mender_err_t
+mender_flash_create(char *name, size_t size, int flags, mender_flash_handle_t **handle) {
+
+    assert(NULL != name);
+    assert(NULL != handle);
+    mender_flash_handle_t *flash_handle;
+    char                  *path = NULL;
+    int                    result;
+
+    /* Allocate memory to store the flash handle and the write buffer */
+    if (NULL == (flash_handle = (mender_flash_handle_t *)mender_calloc(1, sizeof(mender_flash_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    flash_handle->fd = -1;
+    if (0 != posix_memalign((void **)&flash_handle->buffer.data, CONFIG_MENDER_FLASH_ALIGNMENT, CONFIG_MENDER_FLASH_BUFFER_SIZE)) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    if (0 != posix_memalign((void **)&flash_handle->existing, CONFIG_MENDER_FLASH_ALIGNMENT, CONFIG_MENDER_FLASH_BUFFER_SIZE)) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+    /* Compute path */
+    size_t str_length = strlen(CONFIG_MENDER_FLASH_PATH) + strlen(name) + 1;
+    if (NULL == (path = (char *)mender_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    snprintf(path, str_length, "%s%s", CONFIG_MENDER_FLASH_PATH, name);
+
+    /* Open the update file */
+#ifdef CONFIG_MENDER_FLASH_DIRECT_IO
+    flags |= O_DIRECT;
+#endif /* CONFIG_MENDER_FLASH_DIRECT_IO */
+    if (-1 == (flash_handle->fd = open(path, flags, 0644))) {
+        mender_log_error("open failed (%d)", errno);
+        goto FAIL;
+    }
+
+    /* Preallocate the update file, the deployment fails immediately if the file system is full */
+    if ((size > 0) && (0 != (result = posix_fallocate(flash_handle->fd, 0, (off_t)size)))) {
+        mender_log_error("posix_fallocate failed (%d)", result);
+        goto FAIL;
+    }
+
+    /* Release memory */
+    mender_free(path);
+    *handle = flash_handle;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_free(path);
+    mender_flash_release(flash_handle);
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_flash_buffer_flush(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+    size_t  length = handle->buffer.length;
+    size_t  index  = 0;
+    ssize_t result;
+
+    /* Nothing to write */
+    if (0 == handle->buffer.length) {
+        return MENDER_OK;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_DIRECT_IO
+    /* Pad the last block, the padding is removed when the update file is closed */
+    length = ((handle->buffer.length + CONFIG_MENDER_FLASH_ALIGNMENT - 1) / CONFIG_MENDER_FLASH_ALIGNMENT) * CONFIG_MENDER_FLASH_ALIGNMENT;
+    memset(&handle->buffer.data[handle->buffer.length], 0, length - handle->buffer.length);
+#endif /* CONFIG_MENDER_FLASH_DIRECT_IO */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Skip the data if they are identical to the existing contents */
+    if ((pread(handle->fd, handle->existing, length, (off_t)handle->buffer.offset) == (ssize_t)length)
+        && (0 == memcmp(handle->existing, handle->buffer.data, handle->buffer.length))) {
+        index = length;
+    }
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+    /* Write data to the update file */
+    while (index < length) {
+        if ((result = pwrite(handle->fd, &handle->buffer.data[index], length - index, (off_t)(handle->buffer.offset + index))) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            mender_log_error("pwrite failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        index += (size_t)result;
+    }
+
+    /* Move to the next block */
+    handle->buffer.offset += handle->buffer.length;
+    handle->buffer.length  = 0;
+
+    return MENDER_OK;
+}
+
+static void
+mender_flash_release(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Close update file and release memory */
+    if (-1 != handle->fd) {
+        close(handle->fd);
+    }
+    mender_free(handle->buffer.data);
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    mender_free(handle->existing);
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+    mender_free(handle);
+}
@@ -0,0 +1,536 @@
+/**
+ * @file      mender-flash.c
+ * @brief     Mender flash interface for Zephyr platform, the update partition is located in an external SPI/QSPI NOR flash
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_FLASH
+
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/reboot.h>
+#include "mender-flash.h"
+#include "mender-log.h"
+
+/**
+ * @brief Default size of the program buffer (bytes), the data are programmed to the external flash by chunks of this size
+ */
+#ifndef CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE
+#define CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE */
+
+/**
+ * @brief Default alignment of the program buffer (bytes)
+ */
+#ifndef CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_ALIGNMENT
+#define CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_ALIGNMENT (32)
+#endif /* CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_ALIGNMENT */
+
+/**
+ * @brief Default size of the erase operations (bytes), the external flash is erased by blocks of this size ahead of the program operations
+ */
+#ifndef CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE
+#define CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE (65536)
+#endif /* CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE */
+
+/**
+ * @brief Flash handle
+ */
+typedef struct {
+    const struct flash_area *flash_area; /**< Update partition in the external flash */
+    size_t                   offset;     /**< Offset of the program buffer in the update partition */
+    size_t                   length;     /**< Length of the data in the program buffer */
+    size_t                   erased;     /**< Length of the update partition already erased */
+} mender_flash_handle_t;
+
+/**
+ * @brief Program buffer, statically allocated and aligned so that it can be used by the DMA of the SPI/QSPI controllers
+ */
+static uint8_t mender_flash_buffer[CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE] __attribute__((aligned(CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_ALIGNMENT)));
+
+/**
+ * @brief Erase the update partition up to the end given, by blocks of CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE
+ * @param handle Flash handle
+ * @param end End of the range which must be erased
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase(mender_flash_handle_t *handle, size_t end);
+
+/**
+ * @brief Program the data of the program buffer to the update partition, the last chunk is padded to the write block size
+ * @param handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_program(mender_flash_handle_t *handle);
+
+/**
+ * @brief Close the update partition and release the flash handle
+ * @param handle Flash handle
+ */
+static void mender_flash_release(mender_flash_handle_t *handle);
+
+mender_err_t
+mender_flash_get_capacity(size_t *capacity) {
+
+    assert(NULL != capacity);
+    const struct flash_area *flash_area;
+    int                      result;
+
+    /* Retrieve the size of the update partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    *capacity = flash_area->fa_size;
+    flash_area_close(flash_area);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    const struct flash_area *flash_area;
+    int                      result;
+
+    /* Read the running image from the primary partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot0_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    if ((result = flash_area_read(flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        flash_area_close(flash_area);
+        return MENDER_FAIL;
+    }
+    flash_area_close(flash_area);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_open(char *name, size_t size, void **handle) {
+
+    assert(NULL != name);
+    assert(NULL != handle);
+    mender_flash_handle_t *flash_handle;
+    int                    result;
+
+    /* Print current file name and size */
+    mender_log_info("Start flashing artifact '%s' with size %d", name, size);
+
+    /* Allocate memory to store the flash handle */
+    if (NULL == (flash_handle = (mender_flash_handle_t *)mender_malloc(sizeof(mender_flash_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    flash_handle->offset = 0;
+    flash_handle->length = 0;
+    flash_handle->erased = 0;
+
+    /* Open the update partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &flash_handle->flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        mender_free(flash_handle);
+        return MENDER_FAIL;
+    }
+    if (size > flash_handle->flash_area->fa_size) {
+        mender_log_error("Artifact exceeds the size of the update partition");
+        mender_flash_release(flash_handle);
+        return MENDER_FAIL;
+    }
+    *handle = flash_handle;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_resume(char *name, size_t size, size_t *index, void **handle) {
+
+    assert(NULL != name);
+    assert(NULL != index);
+    assert(NULL != handle);
+    mender_err_t ret;
+
+    /* The data are programmed by chunks of the size of the program buffer, the chunk being gathered is lost on reset */
+    *index = (*index / CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE) * CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE;
+
+    /* The erase blocks are aligned on the beginning of the update partition, the block of the index is erased and programmed again */
+    *index = (*index / CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE) * CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE;
+
+    /* Open the update partition */
+    if (MENDER_OK != (ret = mender_flash_open(name, size, handle))) {
+        return ret;
+    }
+    mender_log_info("Resume flashing artifact '%s' at index %zu", name, *index);
+    ((mender_flash_handle_t *)(*handle))->offset = *index;
+    ((mender_flash_handle_t *)(*handle))->erased = *index;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_write(void *handle, void *data, size_t index, size_t length) {
+
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    size_t                 buffer_length;
+
+    /* Check flash handle */
+    if (NULL == flash_handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Data must follow the data already received */
+    if (index != flash_handle->offset + flash_handle->length) {
+        mender_log_error("Invalid data index");
+        return MENDER_FAIL;
+    }
+    if (index + length > flash_handle->flash_area->fa_size) {
+        mender_log_error("Data exceed the size of the update partition");
+        return MENDER_FAIL;
+    }
+
+    /* Gather data received in the program buffer, the buffer is programmed when it is full */
+    while (length > 0) {
+        buffer_length = CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE - flash_handle->length;
+        if (buffer_length > length) {
+            buffer_length = length;
+        }
+        memcpy(&mender_flash_buffer[flash_handle->length], data, buffer_length);
+        flash_handle->length += buffer_length;
+        data                  = (uint8_t *)data + buffer_length;
+        length               -= buffer_length;
+        if (CONFIG_MENDER_FLASH_EXTERNAL_BUFFER_SIZE == flash_handle->length) {
+            if (MENDER_OK != mender_flash_program(flash_handle)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_close(void *handle) {
+
+    mender_flash_handle_t  *flash_handle = (mender_flash_handle_t *)handle;
+    struct flash_pages_info info;
+    int                     result;
+
+    /* Check flash handle */
+    if (NULL == flash_handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Program the remaining data */
+    if ((flash_handle->length > 0) && (MENDER_OK != mender_flash_program(flash_handle))) {
+        return MENDER_FAIL;
+    }
+
+    /* Erase the last page of the update partition, it holds the trailer used to request the upgrade */
+    if ((result = flash_get_page_info_by_offs(
+             FIXED_PARTITION_DEVICE(slot1_partition), flash_handle->flash_area->fa_off + (off_t)flash_handle->flash_area->fa_size - 1, &info))
+        < 0) {
+        mender_log_error("flash_get_page_info_by_offs failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    if (flash_handle->erased <= flash_handle->flash_area->fa_size - info.size) {
+        if ((result = flash_area_erase(flash_handle->flash_area, (off_t)(flash_handle->flash_area->fa_size - info.size), info.size)) < 0) {
+            mender_log_error("flash_area_erase failed (%d)", result);
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    int result;
+
+    /* Check flash handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the update partition */
+    if ((result = flash_area_read(((mender_flash_handle_t *)handle)->flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_set_pending_image(void *handle) {
+
+    int result;
+
+    /* Check flash handle */
+    if (NULL != handle) {
+
+        /* Request the bootloader to swap the images */
+        if ((result = boot_request_upgrade(BOOT_UPGRADE_TEST)) < 0) {
+            mender_log_error("boot_request_upgrade failed (%d)", result);
+            return MENDER_FAIL;
+        }
+
+        /* Release memory */
+        mender_flash_release((mender_flash_handle_t *)handle);
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_abort_deployment(void *handle) {
+
+    /* Check flash handle */
+    if (NULL != handle) {
+
+        /* Release memory */
+        mender_flash_release((mender_flash_handle_t *)handle);
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_confirm_image(void) {
+
+    int          result;
+    mender_err_t ret = MENDER_OK;
+
+    /* Validate the image if it is still pending */
+    if (false == mender_flash_is_image_confirmed()) {
+        if ((result = boot_write_img_confirmed()) < 0) {
+            mender_log_error("Unable to mark application valid, application will rollback (%d)", result);
+            ret = MENDER_FAIL;
+        } else {
+            mender_log_info("Application has been mark valid and rollback canceled");
+        }
+    }
+
+    return ret;
+}
+
+bool
+mender_flash_is_image_confirmed(void) {
+
+    /* Check if the image it still pending */
+    return boot_is_img_confirmed();
+}
+
+#if FIXED_PARTITION_EXISTS(mender_staging_partition)
+
+mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    (void)name;
+    assert(NULL != handle);
+    mender_flash_handle_t *flash_handle;
+    int                    result;
+
+    /* Allocate memory to store the staging handle, the staging partition is programmed like the update partition */
+    if (NULL == (flash_handle = (mender_flash_handle_t *)mender_malloc(sizeof(mender_flash_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    flash_handle->offset = 0;
+    flash_handle->length = 0;
+    flash_handle->erased = 0;
+
+    /* Open the staging partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(mender_staging_partition), &flash_handle->flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        mender_free(flash_handle);
+        return MENDER_FAIL;
+    }
+    *handle = flash_handle;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    /* Gather data received in the program buffer, which is not used by the update partition while the artifact is staged */
+    return mender_flash_write(handle, data, index, length);
+}
+
+mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+
+    /* Check staging handle */
+    if (NULL == flash_handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Program the remaining data */
+    if ((flash_handle->length > 0) && (MENDER_OK != mender_flash_program(flash_handle))) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    /* Read data from the staging partition */
+    return mender_flash_read(handle, data, index, length);
+}
+
+mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    /* Check staging handle */
+    if (NULL != handle) {
+
+        /* Close the staging partition and release memory */
+        mender_flash_release((mender_flash_handle_t *)handle);
+    }
+
+    return MENDER_OK;
+}
+
+#else
+
+mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    (void)name;
+    (void)handle;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    (void)handle;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    (void)handle;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+#endif /* FIXED_PARTITION_EXISTS(mender_staging_partition) */
+
+static mender_err_t
+mender_flash_erase(mender_flash_handle_t *handle, size_t end) {
+
+    assert(NULL != handle);
+    size_t length;
+    int    result;
+
+    /* Erase by large blocks, the block erase commands of the NOR flash are much faster than the sector erase commands */
+    while (handle->erased < end) {
+        length = handle->flash_area->fa_size - handle->erased;
+        if (length > CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE) {
+            length = CONFIG_MENDER_FLASH_EXTERNAL_ERASE_SIZE;
+        }
+        if ((result = flash_area_erase(handle->flash_area, (off_t)handle->erased, length)) < 0) {
+            mender_log_error("flash_area_erase failed (%d)", result);
+            return MENDER_FAIL;
+        }
+        handle->erased += length;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_program(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+    size_t align  = flash_area_align(handle->flash_area);
+    size_t length = ((handle->length + align - 1) / align) * align;
+    int    result;
+
+    /* Erase ahead of the data to be programmed */
+    if (MENDER_OK != mender_flash_erase(handle, handle->offset + length)) {
+        return MENDER_FAIL;
+    }
+
+    /* Program the buffer at once, the driver splits it in page program operations */
+    memset(&mender_flash_buffer[handle->length], flash_area_erased_val(handle->flash_area), length - handle->length);
+    if ((result = flash_area_write(handle->flash_area, (off_t)handle->offset, mender_flash_buffer, length)) < 0) {
+        mender_log_error("flash_area_write failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    handle->offset += handle->length;
+    handle->length  = 0;
+
+    return MENDER_OK;
+}
+
+static void
+mender_flash_release(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Close the update partition and release memory */
+    flash_area_close(handle->flash_area);
+    mender_free(handle);
+}
@@ -17,11 +17,205 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_FLASH
+
 #include <zephyr/dfu/flash_img.h>
 #include <zephyr/dfu/mcuboot.h>
+#include <zephyr/drivers/flash.h>
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+#include <zephyr/kernel.h>
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+#include <zephyr/storage/flash_map.h>
 #include <zephyr/sys/reboot.h>
 #include "mender-flash.h"
 #include "mender-log.h"
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+#include "mender-scheduler.h"
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+/**
+ * @brief Background erase task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE
+#define CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE (2)
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE */
+
+/**
+ * @brief Background erase task priority
+ */
+#ifndef CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY
+#define CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY */
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+/**
+ * @brief Size of the chunks read to compare the pages with the existing contents
+ */
+#define MENDER_FLASH_COMPARE_SIZE (64)
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+/**
+ * @brief Flash handle
+ */
+typedef struct {
+    struct flash_img_context flash_img; /**< Flash image context used to flash the firmware */
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+    struct {
+        const struct flash_area *flash_area; /**< Update partition */
+        void                    *task;       /**< Background erase task handle */
+        volatile size_t          front;      /**< Length of the partition already erased */
+        volatile bool            done;       /**< The background erase task has ended */
+        volatile bool            abort;      /**< Request the background erase task to stop */
+        volatile mender_err_t    ret;        /**< Result of the background erase */
+    } erase;                                 /**< Background erase of the update partition */
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    struct {
+        const struct flash_area *flash_area; /**< Update partition */
+        uint8_t                 *data;       /**< Data of the page */
+        size_t                   allocated;  /**< Size of the memory allocated to store the data of the page */
+        size_t                   size;       /**< Size of the page */
+        size_t                   offset;     /**< Offset of the page in the update partition */
+        size_t                   length;     /**< Length of the data of the page */
+        size_t                   count;      /**< Number of pages received */
+        size_t                   skipped;    /**< Number of unchanged pages which have not been programmed */
+    } page;                                  /**< Page being received */
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+} mender_flash_handle_t;
+
+#if FIXED_PARTITION_EXISTS(mender_staging_partition)
+
+/**
+ * @brief Length of the blocks programmed to the staging partition, it must be a multiple of the write block size (bytes)
+ */
+#define MENDER_FLASH_STAGING_BLOCK_SIZE (256)
+
+/**
+ * @brief Staging handle
+ */
+typedef struct {
+    const struct flash_area *flash_area;                             /**< Staging partition */
+    size_t                   offset;                                 /**< Offset of the block in the staging partition */
+    size_t                   length;                                 /**< Length of the data in the block */
+    size_t                   erased;                                 /**< Length of the staging partition already erased */
+    uint8_t                  block[MENDER_FLASH_STAGING_BLOCK_SIZE]; /**< Block being received */
+} mender_flash_staging_handle_t;
+
+/**
+ * @brief Program the block received to the staging partition, the pages are erased ahead and the last block is padded to the write block size
+ * @param handle Staging handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_staging_program(mender_flash_staging_handle_t *handle);
+
+#endif /* FIXED_PARTITION_EXISTS(mender_staging_partition) */
+
+/**
+ * @brief Begin the deployment at the index given, the update partition is erased and programmed from the index
+ * @param handle Flash handle
+ * @param size Size of the artifact
+ * @param index Index of the beginning of the data to be written, aligned on a page
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_begin(mender_flash_handle_t *handle, size_t size, size_t index);
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+/**
+ * @brief Background erase task function, erase the update partition page by page ahead of the writes
+ * @param arg Flash handle
+ */
+static void mender_flash_erase_task(void *arg);
+
+/**
+ * @brief Wait until the background erase has reached the end of the data to be written
+ * @param handle Flash handle
+ * @param end End of the data to be written
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_wait(mender_flash_handle_t *handle, size_t end);
+
+/**
+ * @brief Stop the background erase task and wait for its end
+ * @param handle Flash handle
+ * @return MENDER_OK if the background erase succeeded, error code otherwise
+ */
+static mender_err_t mender_flash_erase_join(mender_flash_handle_t *handle);
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+/**
+ * @brief Retrieve the size of the page at the current offset and allocate memory to store its data
+ * @param handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_page_begin(mender_flash_handle_t *handle);
+
+/**
+ * @brief Program the page being received, the page is skipped if it is identical to the existing contents of the update partition
+ * @param handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_page_flush(mender_flash_handle_t *handle);
+
+/**
+ * @brief Release the page being received
+ * @param handle Flash handle
+ */
+static void mender_flash_page_release(mender_flash_handle_t *handle);
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+mender_err_t
+mender_flash_get_capacity(size_t *capacity) {
+
+    assert(NULL != capacity);
+    const struct flash_area *flash_area;
+    int                      result;
+
+    /* Retrieve the size of the update partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    *capacity = flash_area->fa_size;
+    flash_area_close(flash_area);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    const struct flash_area *flash_area;
+    int                      result;
+
+    /* Read the running image from the primary partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot0_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    if ((result = flash_area_read(flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        flash_area_close(flash_area);
+        return MENDER_FAIL;
+    }
+    flash_area_close(flash_area);
+
+    return MENDER_OK;
+}
 
 mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
@@ -34,16 +228,76 @@ mender_flash_open(char *name, size_t size, void **handle) {
     mender_log_info("Start flashing artifact '%s' with size %d", name, size);
 
     /* Allocate memory to store the flash handle */
-    if (NULL == (*handle = malloc(sizeof(struct flash_img_context)))) {
+    if (NULL == (*handle = mender_malloc(sizeof(mender_flash_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
 
     /* Begin deployment with sequential writes */
-    if ((result = flash_img_init((struct flash_img_context *)*handle)) < 0) {
+    if ((result = flash_img_init(&((mender_flash_handle_t *)(*handle))->flash_img)) < 0) {
+        mender_log_error("flash_img_init failed (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    return mender_flash_begin((mender_flash_handle_t *)(*handle), size, 0);
+}
+
+mender_err_t
+mender_flash_resume(char *name, size_t size, size_t *index, void **handle) {
+
+    assert(NULL != name);
+    assert(NULL != index);
+    assert(NULL != handle);
+    mender_flash_handle_t   *flash_handle;
+    const struct flash_area *flash_area;
+    struct flash_pages_info  info;
+    int                      result;
+
+    /* Allocate memory to store the flash handle */
+    if (NULL == (flash_handle = (mender_flash_handle_t *)mender_malloc(sizeof(mender_flash_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Continue deployment with sequential writes */
+    if ((result = flash_img_init(&flash_handle->flash_img)) < 0) {
         mender_log_error("flash_img_init failed (%d)", result);
+        mender_free(flash_handle);
         return MENDER_FAIL;
     }
+#ifndef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* The data gathered in the buffer of the flash image context are lost on reset */
+    *index = (*index > flash_handle->flash_img.stream.buf_len) ? (*index - flash_handle->flash_img.stream.buf_len) : 0;
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+    /* The pages before the one of the index have been completely programmed, the page of the index is erased and programmed again */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        mender_free(flash_handle);
+        return MENDER_FAIL;
+    }
+    if ((*index >= flash_area->fa_size)
+        || ((result = flash_get_page_info_by_offs(FIXED_PARTITION_DEVICE(slot1_partition), flash_area->fa_off + (off_t)*index, &info)) < 0)) {
+        mender_log_error("Unable to retrieve the page at index %zu", *index);
+        flash_area_close(flash_area);
+        mender_free(flash_handle);
+        return MENDER_FAIL;
+    }
+    *index = (size_t)(info.start_offset - flash_area->fa_off);
+    flash_area_close(flash_area);
+
+    /* Print current file name, size and index */
+    mender_log_info("Resume flashing artifact '%s' with size %zu at index %zu", name, size, *index);
+
+#ifndef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Move the flash image context to the index, the same way the stream flash progress is restored */
+    flash_handle->flash_img.stream.bytes_written = *index;
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+    if (MENDER_OK != mender_flash_begin(flash_handle, size, *index)) {
+        mender_free(flash_handle);
+        return MENDER_FAIL;
+    }
+    *handle = flash_handle;
 
     return MENDER_OK;
 }
@@ -51,8 +305,15 @@ mender_flash_open(char *name, size_t size, void **handle) {
 mender_err_t
 mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    size_t                 page_length;
+#else
+#ifndef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
     (void)index;
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
     int result;
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
 
     /* Check flash handle */
     if (NULL == handle) {
@@ -60,12 +321,50 @@ mender_flash_write(void *handle, void *data, size_t index, size_t length) {
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+    /* Gather data received in the page buffer, the pages are programmed when they are complete */
+    if (index != flash_handle->page.offset + flash_handle->page.length) {
+        mender_log_error("Invalid data index");
+        return MENDER_FAIL;
+    }
+    while (length > 0) {
+        if (0 == flash_handle->page.size) {
+            mender_log_error("Data exceed the size of the update partition");
+            return MENDER_FAIL;
+        }
+        page_length = flash_handle->page.size - flash_handle->page.length;
+        if (page_length > length) {
+            page_length = length;
+        }
+        memcpy(&flash_handle->page.data[flash_handle->page.length], data, page_length);
+        flash_handle->page.length += page_length;
+        data                       = (uint8_t *)data + page_length;
+        length                    -= page_length;
+        if (flash_handle->page.length == flash_handle->page.size) {
+            if ((MENDER_OK != mender_flash_page_flush(flash_handle)) || (MENDER_OK != mender_flash_page_begin(flash_handle))) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+#else
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+    /* Wait for the pages to be erased, the buffered data are never written beyond the end of the data received */
+    if (MENDER_OK != mender_flash_erase_wait((mender_flash_handle_t *)handle, index + length)) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
     /* Write data received to the update partition */
-    if ((result = flash_img_buffered_write((struct flash_img_context *)handle, (const uint8_t *)data, length, false)) < 0) {
+    if ((result = flash_img_buffered_write(&((mender_flash_handle_t *)handle)->flash_img, (const uint8_t *)data, length, false)) < 0) {
         mender_log_error("flash_img_buffered_write failed (%d)", result);
         return MENDER_FAIL;
     }
 
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
     return MENDER_OK;
 }
 
@@ -80,8 +379,24 @@ mender_flash_close(void *handle) {
         return MENDER_FAIL;
     }
 
-    /* Flush data received to the update partition */
-    if ((result = flash_img_buffered_write((struct flash_img_context *)handle, NULL, 0, true)) < 0) {
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+    /* Wait for the end of the background erase, the trailer must be erased before the upgrade is requested */
+    if (MENDER_OK != mender_flash_erase_join((mender_flash_handle_t *)handle)) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Program the last page */
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    if ((flash_handle->page.length > 0) && (MENDER_OK != mender_flash_page_flush(flash_handle))) {
+        return MENDER_FAIL;
+    }
+    mender_log_info("%d unchanged pages of %d have not been programmed", flash_handle->page.skipped, flash_handle->page.count);
+    mender_flash_page_release(flash_handle);
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+    /* Flush data received to the update partition and erase the trailer */
+    if ((result = flash_img_buffered_write(&((mender_flash_handle_t *)handle)->flash_img, NULL, 0, true)) < 0) {
         mender_log_error("flash_img_buffered_write failed (%d)", result);
         return MENDER_FAIL;
     }
@@ -89,6 +404,34 @@ mender_flash_close(void *handle) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    const struct flash_area *flash_area;
+    int                      result;
+
+    /* Check flash handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the update partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    if ((result = flash_area_read(flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        flash_area_close(flash_area);
+        return MENDER_FAIL;
+    }
+    flash_area_close(flash_area);
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_flash_set_pending_image(void *handle) {
 
@@ -104,7 +447,7 @@ mender_flash_set_pending_image(void *handle) {
         }
 
         /* Release memory */
-        free(handle);
+        mender_free(handle);
     }
 
     return MENDER_OK;
@@ -116,8 +459,17 @@ mender_flash_abort_deployment(void *handle) {
     /* Check flash handle */
     if (NULL != handle) {
 
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+        /* Stop background erase */
+        ((mender_flash_handle_t *)handle)->erase.abort = true;
+        mender_flash_erase_join((mender_flash_handle_t *)handle);
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+        mender_flash_page_release((mender_flash_handle_t *)handle);
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
         /* Release memory */
-        free(handle);
+        mender_free(handle);
     }
 
     return MENDER_OK;
@@ -148,3 +500,466 @@ mender_flash_is_image_confirmed(void) {
     /* Check if the image it still pending */
     return boot_is_img_confirmed();
 }
+
+#if FIXED_PARTITION_EXISTS(mender_staging_partition)
+
+mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    (void)name;
+    assert(NULL != handle);
+    mender_flash_staging_handle_t *staging_handle;
+    int                            result;
+
+    /* Allocate memory to store the staging handle */
+    if (NULL == (staging_handle = (mender_flash_staging_handle_t *)mender_malloc(sizeof(mender_flash_staging_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    staging_handle->offset = 0;
+    staging_handle->length = 0;
+    staging_handle->erased = 0;
+
+    /* Open the staging partition, it is erased as the data are written */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(mender_staging_partition), &staging_handle->flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        mender_free(staging_handle);
+        return MENDER_FAIL;
+    }
+    *handle = staging_handle;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    mender_flash_staging_handle_t *staging_handle = (mender_flash_staging_handle_t *)handle;
+    size_t                         block_length;
+
+    /* Check staging handle */
+    if (NULL == staging_handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Data must follow the data already received */
+    if (index != staging_handle->offset + staging_handle->length) {
+        mender_log_error("Invalid data index");
+        return MENDER_FAIL;
+    }
+    if (index + length > staging_handle->flash_area->fa_size) {
+        mender_log_error("Data exceed the size of the staging partition");
+        return MENDER_FAIL;
+    }
+
+    /* Gather data received in the block, the block is programmed when it is full */
+    while (length > 0) {
+        block_length = MENDER_FLASH_STAGING_BLOCK_SIZE - staging_handle->length;
+        if (block_length > length) {
+            block_length = length;
+        }
+        memcpy(&staging_handle->block[staging_handle->length], data, block_length);
+        staging_handle->length += block_length;
+        data                    = (uint8_t *)data + block_length;
+        length                 -= block_length;
+        if (MENDER_FLASH_STAGING_BLOCK_SIZE == staging_handle->length) {
+            if (MENDER_OK != mender_flash_staging_program(staging_handle)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    mender_flash_staging_handle_t *staging_handle = (mender_flash_staging_handle_t *)handle;
+
+    /* Check staging handle */
+    if (NULL == staging_handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Program the remaining data */
+    if ((staging_handle->length > 0) && (MENDER_OK != mender_flash_staging_program(staging_handle))) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    int result;
+
+    /* Check staging handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid staging handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the staging partition */
+    if ((result = flash_area_read(((mender_flash_staging_handle_t *)handle)->flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    /* Check staging handle */
+    if (NULL != handle) {
+
+        /* Close the staging partition and release memory */
+        flash_area_close(((mender_flash_staging_handle_t *)handle)->flash_area);
+        mender_free(handle);
+    }
+
+    return MENDER_OK;
+}
+
+#else
+
+mender_err_t
+mender_flash_open_staging(char *name, void **handle) {
+
+    (void)name;
+    (void)handle;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_write_staging(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_close_staging(void *handle) {
+
+    (void)handle;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_read_staging(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_release_staging(void *handle) {
+
+    (void)handle;
+
+    /* No staging partition is defined in the device tree */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+#endif /* FIXED_PARTITION_EXISTS(mender_staging_partition) */
+
+static mender_err_t
+mender_flash_begin(mender_flash_handle_t *handle, size_t size, size_t index) {
+
+    assert(NULL != handle);
+#if defined(CONFIG_MENDER_FLASH_BACKGROUND_ERASE) || defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+    int result;
+#else
+    (void)size;
+    (void)index;
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE || CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+    /* Start erasing the update partition from the index while the data are received, including the trailer used to request the upgrade */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &handle->erase.flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    if (size > handle->erase.flash_area->fa_size) {
+        mender_log_error("Artifact exceeds the size of the update partition");
+        flash_area_close(handle->erase.flash_area);
+        return MENDER_FAIL;
+    }
+    handle->erase.front                  = index;
+    handle->erase.done                   = false;
+    handle->erase.abort                  = false;
+    handle->erase.ret                    = MENDER_OK;
+    mender_scheduler_task_params_t task_params = { .function   = mender_flash_erase_task,
+                                                   .arg        = handle,
+                                                   .name       = "mender_flash_erase",
+                                                   .stack_size = CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_STACK_SIZE,
+                                                   .priority   = CONFIG_MENDER_FLASH_BACKGROUND_ERASE_TASK_PRIORITY };
+    if (MENDER_OK != mender_scheduler_task_create(&task_params, &handle->erase.task)) {
+        mender_log_error("Unable to create background erase task");
+        flash_area_close(handle->erase.flash_area);
+        return MENDER_FAIL;
+    }
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+    /* Open the update partition to compare the pages received with the existing contents, the trailer is still erased by the flash image context */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &handle->page.flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        goto FAIL;
+    }
+    handle->page.data      = NULL;
+    handle->page.allocated = 0;
+    handle->page.offset    = index;
+    handle->page.count     = 0;
+    handle->page.skipped   = 0;
+    if (MENDER_OK != mender_flash_page_begin(handle)) {
+        mender_flash_page_release(handle);
+        goto FAIL;
+    }
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+    return MENDER_OK;
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+FAIL:
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+    /* Stop the background erase task so that the handle can be released by the caller */
+    handle->erase.abort = true;
+    mender_flash_erase_join(handle);
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+    return MENDER_FAIL;
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+}
+
+#ifdef CONFIG_MENDER_FLASH_BACKGROUND_ERASE
+
+static void
+mender_flash_erase_task(void *arg) {
+
+    assert(NULL != arg);
+    mender_flash_handle_t  *handle = (mender_flash_handle_t *)arg;
+    struct flash_pages_info info;
+    int                     result;
+
+    /* Erase the update partition page by page, the writes are waiting for the erase front */
+    while ((false == handle->erase.abort) && (handle->erase.front < handle->erase.flash_area->fa_size)) {
+        if ((result = flash_get_page_info_by_offs(
+                 FIXED_PARTITION_DEVICE(slot1_partition), handle->erase.flash_area->fa_off + (off_t)handle->erase.front, &info))
+            < 0) {
+            mender_log_error("flash_get_page_info_by_offs failed (%d)", result);
+            handle->erase.ret = MENDER_FAIL;
+            break;
+        }
+        if ((result = flash_area_erase(handle->erase.flash_area, (off_t)handle->erase.front, info.size)) < 0) {
+            mender_log_error("flash_area_erase failed (%d)", result);
+            handle->erase.ret = MENDER_FAIL;
+            break;
+        }
+        handle->erase.front += info.size;
+    }
+    handle->erase.done = true;
+}
+
+static mender_err_t
+mender_flash_erase_wait(mender_flash_handle_t *handle, size_t end) {
+
+    assert(NULL != handle);
+
+    /* Wait until the erase front has passed the end of the data */
+    while (handle->erase.front < end) {
+        if ((true == handle->erase.done) && (handle->erase.front < end)) {
+            if (MENDER_OK == handle->erase.ret) {
+                mender_log_error("Data exceed the size of the update partition");
+            }
+            return MENDER_FAIL;
+        }
+        k_msleep(1);
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_erase_join(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Wait for the end of the background erase task */
+    if (NULL != handle->erase.task) {
+        mender_scheduler_task_join(handle->erase.task);
+        handle->erase.task = NULL;
+        flash_area_close(handle->erase.flash_area);
+    }
+
+    return handle->erase.ret;
+}
+
+#endif /* CONFIG_MENDER_FLASH_BACKGROUND_ERASE */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+static mender_err_t
+mender_flash_page_begin(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+    struct flash_pages_info info;
+    uint8_t                *tmp;
+    int                     result;
+
+    /* Retrieve the size of the page */
+    handle->page.length = 0;
+    if (handle->page.offset >= handle->page.flash_area->fa_size) {
+        handle->page.size = 0;
+        return MENDER_OK;
+    }
+    if ((result = flash_get_page_info_by_offs(FIXED_PARTITION_DEVICE(slot1_partition), handle->page.flash_area->fa_off + (off_t)handle->page.offset, &info))
+        < 0) {
+        mender_log_error("flash_get_page_info_by_offs failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    handle->page.size = info.size;
+
+    /* Allocate memory to store the data of the page, the pages may have different sizes */
+    if (handle->page.size > handle->page.allocated) {
+        if (NULL == (tmp = (uint8_t *)mender_realloc(handle->page.data, handle->page.size))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        handle->page.data      = tmp;
+        handle->page.allocated = handle->page.size;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_page_flush(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+    uint8_t buffer[MENDER_FLASH_COMPARE_SIZE];
+    size_t  index = 0;
+    size_t  length;
+    size_t  align;
+    int     result;
+
+    /* Compare the page with the existing contents */
+    while (index < handle->page.length) {
+        length = handle->page.length - index;
+        if (length > sizeof(buffer)) {
+            length = sizeof(buffer);
+        }
+        if ((result = flash_area_read(handle->page.flash_area, (off_t)(handle->page.offset + index), buffer, length)) < 0) {
+            mender_log_error("flash_area_read failed (%d)", result);
+            return MENDER_FAIL;
+        }
+        if (0 != memcmp(buffer, &handle->page.data[index], length)) {
+            break;
+        }
+        index += length;
+    }
+
+    /* Erase and program the page if it has changed, the last page is padded to the write block size */
+    if (index < handle->page.length) {
+        if ((result = flash_area_erase(handle->page.flash_area, (off_t)handle->page.offset, handle->page.size)) < 0) {
+            mender_log_error("flash_area_erase failed (%d)", result);
+            return MENDER_FAIL;
+        }
+        align  = flash_area_align(handle->page.flash_area);
+        length = ((handle->page.length + align - 1) / align) * align;
+        memset(&handle->page.data[handle->page.length], flash_area_erased_val(handle->page.flash_area), length - handle->page.length);
+        if ((result = flash_area_write(handle->page.flash_area, (off_t)handle->page.offset, handle->page.data, length)) < 0) {
+            mender_log_error("flash_area_write failed (%d)", result);
+            return MENDER_FAIL;
+        }
+    } else {
+        handle->page.skipped++;
+    }
+    handle->page.count++;
+
+    /* Move to the next page */
+    handle->page.offset += handle->page.size;
+
+    return MENDER_OK;
+}
+
+static void
+mender_flash_page_release(mender_flash_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Release memory and close the update partition */
+    if (NULL != handle->page.flash_area) {
+        flash_area_close(handle->page.flash_area);
+        handle->page.flash_area = NULL;
+    }
+    mender_free(handle->page.data);
+    handle->page.data = NULL;
+}
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+#if FIXED_PARTITION_EXISTS(mender_staging_partition)
+
+static mender_err_t
+mender_flash_staging_program(mender_flash_staging_handle_t *handle) {
+
+    assert(NULL != handle);
+    size_t                  align  = flash_area_align(handle->flash_area);
+    size_t                  length = ((handle->length + align - 1) / align) * align;
+    struct flash_pages_info info;
+    int                     result;
+
+    /* Erase the pages ahead of the data to be programmed */
+    while (handle->erased < handle->offset + length) {
+        if ((result = flash_get_page_info_by_offs(
+                 FIXED_PARTITION_DEVICE(mender_staging_partition), handle->flash_area->fa_off + (off_t)handle->erased, &info))
+            < 0) {
+            mender_log_error("flash_get_page_info_by_offs failed (%d)", result);
+            return MENDER_FAIL;
+        }
+        if ((result = flash_area_erase(handle->flash_area, (off_t)handle->erased, info.size)) < 0) {
+            mender_log_error("flash_area_erase failed (%d)", result);
+            return MENDER_FAIL;
+        }
+        handle->erased += info.size;
+    }
+
+    /* Program the block */
+    memset(&handle->block[handle->length], flash_area_erased_val(handle->flash_area), length - handle->length);
+    if ((result = flash_area_write(handle->flash_area, (off_t)handle->offset, handle->block, length)) < 0) {
+        mender_log_error("flash_area_write failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    handle->offset += handle->length;
+    handle->length  = 0;
+
+    return MENDER_OK;
+}
+
+#endif /* FIXED_PARTITION_EXISTS(mender_staging_partition) */
@@ -20,10 +20,135 @@
 #include <esp_log.h>
 #include "mender-log.h"
 
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Default number of log records kept until they are printed by the drain task
+ */
+#ifndef CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH
+#define CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH (32)
+#endif /* CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH */
+
+/**
+ * @brief Default drain task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_LOG_DEFERRED_TASK_STACK_SIZE
+#define CONFIG_MENDER_LOG_DEFERRED_TASK_STACK_SIZE (3)
+#endif /* CONFIG_MENDER_LOG_DEFERRED_TASK_STACK_SIZE */
+
+/**
+ * @brief Default drain task priority, it is low so that the logs do not delay the other tasks
+ */
+#ifndef CONFIG_MENDER_LOG_DEFERRED_TASK_PRIORITY
+#define CONFIG_MENDER_LOG_DEFERRED_TASK_PRIORITY (1)
+#endif /* CONFIG_MENDER_LOG_DEFERRED_TASK_PRIORITY */
+
+/**
+ * @brief Log record
+ */
+typedef struct {
+    atomic_size_t sequence; /**< Sequence number synchronizing the tasks writing the record and the drain task */
+    uint8_t       level;    /**< Log level */
+    const char   *filename; /**< Filename, it is a string literal */
+    int           line;     /**< Line */
+    char          log[256]; /**< Formatted message */
+} mender_log_record_t;
+
+/**
+ * @brief Log records, this is a bounded lock-free queue written by all the tasks and read by the drain task
+ */
+static mender_log_record_t mender_log_records[CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH];
+
+/**
+ * @brief Position of the next record written
+ */
+static atomic_size_t mender_log_head;
+
+/**
+ * @brief Position of the next record printed, only used by the drain task
+ */
+static size_t mender_log_tail = 0;
+
+/**
+ * @brief Number of logs dropped because the queue was full since the latest report
+ */
+static atomic_uint mender_log_dropped;
+
+/**
+ * @brief Drain task running, the logs are printed immediately otherwise
+ */
+static atomic_bool mender_log_running;
+
+/**
+ * @brief Drain task handle, it is notified when records are available
+ */
+static TaskHandle_t mender_log_task_handle = NULL;
+
+/**
+ * @brief Semaphore given by the drain task when it exits
+ */
+static SemaphoreHandle_t mender_log_task_exited = NULL;
+
+/**
+ * @brief Drain task function
+ * @param arg Not used
+ */
+static void mender_log_task(void *arg);
+
+/**
+ * @brief Function used to print the records available and to report the logs dropped
+ */
+static void mender_log_drain(void);
+
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+
+/**
+ * @brief Function used to write a log to the output
+ * @param level Log level
+ * @param filename Filename
+ * @param line Line
+ * @param log Formatted message
+ */
+static void mender_log_write(uint8_t level, const char *filename, int line, const char *log);
+
 mender_err_t
 mender_log_init(void) {
 
-    /* Nothing to do */
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+
+    /* Initialize the queue, each record is free for the position it is written at */
+    for (size_t index = 0; index < CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH; index++) {
+        atomic_init(&mender_log_records[index].sequence, index);
+    }
+    atomic_init(&mender_log_head, 0);
+    mender_log_tail = 0;
+    atomic_init(&mender_log_dropped, 0);
+
+    /* Create drain task, the logs are printed by this task once it is running */
+    if (NULL == (mender_log_task_exited = xSemaphoreCreateBinary())) {
+        return MENDER_FAIL;
+    }
+    atomic_store(&mender_log_running, true);
+    if (pdPASS
+        != xTaskCreate(mender_log_task,
+                       "mender_log",
+                       (configSTACK_DEPTH_TYPE)(CONFIG_MENDER_LOG_DEFERRED_TASK_STACK_SIZE * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
+                       NULL,
+                       CONFIG_MENDER_LOG_DEFERRED_TASK_PRIORITY,
+                       &mender_log_task_handle)) {
+        atomic_store(&mender_log_running, false);
+        vSemaphoreDelete(mender_log_task_exited);
+        mender_log_task_exited = NULL;
+        return MENDER_FAIL;
+    }
+
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+
     return MENDER_OK;
 }
 
@@ -33,12 +158,125 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     (void)function;
     char log[256] = { 0 };
 
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+
+    /* Write the log to the queue if the drain task is running */
+    if (true == atomic_load(&mender_log_running)) {
+
+        /* Reserve a record, the log is dropped if the queue is full */
+        mender_log_record_t *record;
+        size_t               position = atomic_load_explicit(&mender_log_head, memory_order_relaxed);
+        for (;;) {
+            record        = &mender_log_records[position % CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH];
+            intptr_t diff = (intptr_t)atomic_load_explicit(&record->sequence, memory_order_acquire) - (intptr_t)position;
+            if (0 == diff) {
+                if (atomic_compare_exchange_weak_explicit(&mender_log_head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                atomic_fetch_add(&mender_log_dropped, 1);
+                return MENDER_FAIL;
+            } else {
+                position = atomic_load_explicit(&mender_log_head, memory_order_relaxed);
+            }
+        }
+
+        /* Format message in the record and give it to the drain task */
+        record->level    = level;
+        record->filename = filename;
+        record->line     = line;
+        va_list args;
+        va_start(args, format);
+        vsnprintf(record->log, sizeof(record->log), format, args);
+        va_end(args);
+        atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+        xTaskNotifyGive(mender_log_task_handle);
+
+        return MENDER_OK;
+    }
+
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+
     /* Format message */
     va_list args;
     va_start(args, format);
     vsnprintf(log, sizeof(log), format, args);
     va_end(args);
 
+    /* Print message */
+    mender_log_write(level, filename, line, log);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_log_exit(void) {
+
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+
+    /* Stop drain task, the records pending are printed before it exits */
+    if (true == atomic_exchange(&mender_log_running, false)) {
+        xTaskNotifyGive(mender_log_task_handle);
+        xSemaphoreTake(mender_log_task_exited, portMAX_DELAY);
+        vSemaphoreDelete(mender_log_task_exited);
+        mender_log_task_exited = NULL;
+        mender_log_task_handle = NULL;
+    }
+
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+
+static void
+mender_log_task(void *arg) {
+
+    (void)arg;
+
+    /* Print the records when they are available */
+    while (true == atomic_load(&mender_log_running)) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        mender_log_drain();
+    }
+    mender_log_drain();
+
+    /* Signal the task has exited */
+    xSemaphoreGive(mender_log_task_exited);
+    vTaskDelete(NULL);
+}
+
+static void
+mender_log_drain(void) {
+
+    mender_log_record_t *record;
+    unsigned int         dropped;
+
+    /* Print the records in the order they have been reserved, the records not completely written yet are printed on the next wake up */
+    for (;;) {
+        record = &mender_log_records[mender_log_tail % CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != mender_log_tail + 1) {
+            break;
+        }
+        mender_log_write(record->level, record->filename, record->line, record->log);
+        atomic_store_explicit(&record->sequence, mender_log_tail + CONFIG_MENDER_LOG_DEFERRED_QUEUE_LENGTH, memory_order_release);
+        mender_log_tail++;
+    }
+
+    /* Report the logs dropped */
+    if (0 != (dropped = atomic_exchange(&mender_log_dropped, 0))) {
+        char log[64];
+        snprintf(log, sizeof(log), "%u log messages dropped", dropped);
+        mender_log_write(MENDER_LOG_LEVEL_WRN, MENDER_LOG_FILENAME, __LINE__, log);
+    }
+}
+
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+
+static void
+mender_log_write(uint8_t level, const char *filename, int line, const char *log) {
+
     /* Switch depending log level */
     switch (level) {
         case MENDER_LOG_LEVEL_ERR:
@@ -56,13 +294,4 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
         default:
             break;
     }
-
-    return MENDER_OK;
-}
-
-mender_err_t
-mender_log_exit(void) {
-
-    /* Nothing to do */
-    return MENDER_OK;
 }
@@ -20,6 +20,11 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(mender, CONFIG_MENDER_LOG_LEVEL);
 
+/**
+ * @brief The log module is registered by this file
+ */
+#define MENDER_LOG_MODULE_REGISTER
+
 #include "mender-log.h"
 
 mender_err_t
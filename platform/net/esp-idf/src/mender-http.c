@@ -17,11 +17,21 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
 #include <errno.h>
+#include <strings.h>
 #include <esp_http_client.h>
 #include <esp_crt_bundle.h>
 #include "mender-http.h"
+#include "mender-http-gzip.h"
+#include "mender-http-stall.h"
 #include "mender-log.h"
+#include "mender-scheduler.h"
+#include "mender-trace.h"
 #include "mender-utils.h"
 
 /**
@@ -30,15 +40,40 @@
 #define MENDER_HTTP_USER_AGENT "mender-mcu-client/" MENDER_CLIENT_VERSION " (mender-http) esp-idf/" IDF_VER
 
 /**
- * @brief Receive buffer length
+ * @brief Default maximum number of connections kept alive with the servers
+ */
+#ifndef CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS
+#define CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS (2)
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS */
+
+/**
+ * @brief Default size of the receive buffer of the clients, holding the headers of the responses (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_BUFFER_SIZE
+#define CONFIG_MENDER_HTTP_BUFFER_SIZE (512)
+#endif /* CONFIG_MENDER_HTTP_BUFFER_SIZE */
+
+/**
+ * @brief Default size of the transmit buffer of the clients, holding the request line and the headers of the requests (bytes)
  */
-#define MENDER_HTTP_RECV_BUF_LENGTH (512)
+#ifndef CONFIG_MENDER_HTTP_BUFFER_SIZE_TX
+#define CONFIG_MENDER_HTTP_BUFFER_SIZE_TX (2048)
+#endif /* CONFIG_MENDER_HTTP_BUFFER_SIZE_TX */
 
 /**
  * @brief Mender HTTP configuration
  */
 static mender_http_config_t mender_http_config;
 
+/**
+ * @brief Clients kept alive and mutex, the connection of a client is reused by the next requests to the same host and port
+ */
+static struct {
+    char                    *origin; /**< Scheme, host and port of the connection, NULL if the entry is not used */
+    esp_http_client_handle_t client; /**< Client */
+} mender_http_connections[CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS];
+static void *mender_http_connections_mutex = NULL;
+
 /**
  * @brief Convert mender HTTP method to ESP HTTP client method
  * @param method Mender HTTP method
@@ -46,6 +81,93 @@ static mender_http_config_t mender_http_config;
  */
 static esp_http_client_method_t mender_http_method_to_esp_http_client_method(mender_http_method_t method);
 
+/**
+ * @brief Set method and headers of the request, the headers of the previous request of the client are removed
+ * @param client Client
+ * @param method Method
+ * @param bearer Authorization header value, NULL if not authenticated yet
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param range Range of the content to retrieve, NULL to retrieve the whole content
+ * @param etag Entity tag of the content already received, NULL if not used
+ * @param body Body, NULL if empty
+ */
+static void mender_http_prepare_request(
+    esp_http_client_handle_t client, mender_http_method_t method, char *bearer, char *signature, char *range, char *etag, mender_http_body_t *body);
+
+/**
+ * @brief HTTP client event handler, used to retrieve the ETag and Retry-After headers
+ * @param event Event, the user data is the headers of the response to be set
+ * @return ESP_OK
+ */
+static esp_err_t mender_http_event_handler(esp_http_client_event_t *event);
+
+/**
+ * @brief Open HTTP client connection, write the body and fetch the headers of the response
+ * @param client Client
+ * @param body Body, NULL if empty
+ * @param body_length Length of the body
+ * @return ESP_OK if the function succeeds, error code otherwise
+ */
+static esp_err_t mender_http_send_request(esp_http_client_handle_t client, mender_http_body_t *body, size_t body_length);
+
+/**
+ * @brief HTTP callback used to discard the response of the request performed to connect to the server in advance
+ * @param event Event from HTTP client
+ * @param data Data received
+ * @param data_length Data length
+ * @param params Callback parameters
+ * @return MENDER_OK
+ */
+static mender_err_t mender_http_discard_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+
+/**
+ * @brief Body callback used to write a payload at once
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Payload
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_payload_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
+/**
+ * @brief Write function used to compute the length of the body
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Length of the body, incremented by the length of the data
+ * @return MENDER_OK
+ */
+static mender_err_t mender_http_body_length(void *data, size_t length, void *ctx);
+
+/**
+ * @brief Write function used to send the body with the client
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Client
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_body_send(void *data, size_t length, void *ctx);
+
+/**
+ * @brief Retrieve scheme, host and port of an URL
+ * @param url URL
+ * @return Scheme, host and port of the URL if the function succeeds, NULL otherwise
+ */
+static char *mender_http_get_origin(char *url);
+
+/**
+ * @brief Take a client kept alive with the server
+ * @param origin Scheme, host and port of the connection
+ * @return Client if one is kept alive with the server, NULL otherwise
+ */
+static esp_http_client_handle_t mender_http_connection_take(char *origin);
+
+/**
+ * @brief Give a client to be kept alive with the server, the client is released if it can not be kept
+ * @param origin Scheme, host and port of the connection, the memory is owned by the connections after the call
+ * @param client Client
+ */
+static void mender_http_connection_give(char *origin, esp_http_client_handle_t client);
+
 mender_err_t
 mender_http_init(mender_http_config_t *config) {
 
@@ -55,6 +177,12 @@ mender_http_init(mender_http_config_t *config) {
     /* Save configuration */
     memcpy(&mender_http_config, config, sizeof(mender_http_config_t));
 
+    /* Create connections mutex */
+    if (MENDER_OK != mender_scheduler_mutex_create(&mender_http_connections_mutex)) {
+        mender_log_error("Unable to create connections mutex");
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
 
@@ -64,23 +192,58 @@ mender_http_perform(char                *jwt,
                     mender_http_method_t method,
                     char                *payload,
                     char                *signature,
+                    char                *range,
+                    size_t               recv_buf_length,
                     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
                     void *params,
                     int  *status) {
 
+    mender_http_body_t body = { .callback = &mender_http_payload_callback, .params = payload };
+
+    /* Perform HTTP request with the payload written at once */
+    return mender_http_perform_body(jwt, path, method, (NULL != payload) ? &body : NULL, signature, range, NULL, recv_buf_length, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_body(char                *jwt,
+                         char                *path,
+                         mender_http_method_t method,
+                         mender_http_body_t  *body,
+                         char                *signature,
+                         char                *range,
+                         char                *etag,
+                         size_t               recv_buf_length,
+                         mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                         void *params,
+                         int  *status) {
+
     assert(NULL != path);
+    assert(0 != recv_buf_length);
     assert(NULL != callback);
     assert(NULL != status);
     esp_err_t                err;
-    mender_err_t             ret    = MENDER_OK;
-    esp_http_client_handle_t client = NULL;
-    char                    *url    = NULL;
-    char                    *bearer = NULL;
+    mender_http_stall_t      stall;
+    uint64_t                 inactivity;
+    mender_err_t             ret           = MENDER_OK;
+    esp_http_client_handle_t client        = NULL;
+    char                    *url              = NULL;
+    char                    *bearer           = NULL;
+    char                    *origin           = NULL;
+    char                    *data             = NULL;
+    bool                     keep_alive       = false;
+    size_t                   body_length      = 0;
+    mender_http_headers_t    response_headers = { .etag = NULL, .retry_after = 0 };
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    mender_http_body_t gzip_body;
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+    /* Trace the request */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_HTTP_PERFORM);
 
     /* Compute URL if required */
     if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
         size_t str_length = strlen(mender_http_config.host) + strlen(path) + 1;
-        if (NULL == (url = (char *)malloc(str_length))) {
+        if (NULL == (url = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -89,73 +252,116 @@ mender_http_perform(char                *jwt,
     }
 
     /* Configuration of the client */
-    esp_http_client_config_t config
-        = { .url = (NULL != url) ? url : path, .user_agent = MENDER_HTTP_USER_AGENT, .crt_bundle_attach = esp_crt_bundle_attach, .buffer_size_tx = 2048 };
-
-    /* Initialization of the client */
-    if (NULL == (client = esp_http_client_init(&config))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    esp_http_client_set_method(client, mender_http_method_to_esp_http_client_method(method));
+    esp_http_client_config_t config = { .url               = (NULL != url) ? url : path,
+                                        .user_agent        = MENDER_HTTP_USER_AGENT,
+                                        .crt_bundle_attach = esp_crt_bundle_attach,
+                                        .buffer_size       = CONFIG_MENDER_HTTP_BUFFER_SIZE,
+                                        .buffer_size_tx    = CONFIG_MENDER_HTTP_BUFFER_SIZE_TX,
+                                        .timeout_ms        = CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT * 1000,
+                                        .event_handler     = mender_http_event_handler,
+                                        .user_data         = &response_headers };
     if (NULL != jwt) {
         size_t str_length = strlen("Bearer ") + strlen(jwt) + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
         }
         snprintf(bearer, str_length, "Bearer %s", jwt);
-        esp_http_client_set_header(client, "Authorization", bearer);
     }
-    if (NULL != signature) {
-        esp_http_client_set_header(client, "X-MEN-Signature", signature);
+
+    /* Compute the length of the body, the body is written when the request is sent */
+    if (NULL != body) {
+        if (MENDER_OK != (ret = body->callback(&mender_http_body_length, &body_length, body->params))) {
+            mender_log_error("Unable to compute the length of the body");
+            goto END;
+        }
     }
-    if (NULL != payload) {
-        esp_http_client_set_header(client, "Content-Type", "application/json");
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    /* Compress the body with gzip if it is large enough, the signed bodies are sent as they have been signed */
+    if ((NULL != body) && (NULL == signature) && (body_length >= CONFIG_MENDER_HTTP_GZIP_THRESHOLD)) {
+        gzip_body.callback = &mender_http_gzip_body_callback;
+        gzip_body.params   = body;
+        body               = &gzip_body;
+        body_length        = 0;
+        if (MENDER_OK != (ret = body->callback(&mender_http_body_length, &body_length, body->params))) {
+            mender_log_error("Unable to compute the length of the compressed body");
+            goto END;
+        }
     }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
 
-    /* Open HTTP client connection */
-    if (ESP_OK != (err = esp_http_client_open(client, (NULL != payload) ? (int)strlen(payload) : 0))) {
-        mender_log_error("Unable to open HTTP client connection: %s", esp_err_to_name(err));
+    /* Initialization of the client, a client kept alive with the server is reused if available */
+    if (NULL == (origin = mender_http_get_origin((char *)config.url))) {
+        mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, params))) {
-        mender_log_error("An error occurred");
-        goto END;
+    if (NULL != (client = mender_http_connection_take(origin))) {
+        esp_http_client_set_url(client, config.url);
+        esp_http_client_set_user_data(client, &response_headers);
+        mender_http_prepare_request(client, method, bearer, signature, range, etag, body);
+        if (ESP_OK != mender_http_send_request(client, body, body_length)) {
+            /* The connection kept alive has been closed by the server, the request is sent again with a new client */
+            esp_http_client_cleanup(client);
+            client = NULL;
+        }
     }
-
-    /* Write data if payload is defined */
-    if (NULL != payload) {
-        if (esp_http_client_write(client, payload, (int)strlen(payload)) < 0) {
-            mender_log_error("Unable to write data");
+    if (NULL == client) {
+        if (NULL == (client = esp_http_client_init(&config))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        mender_http_prepare_request(client, method, bearer, signature, range, etag, body);
+        if (ESP_OK != (err = mender_http_send_request(client, body, body_length))) {
+            mender_log_error("Unable to perform HTTP request: %s", esp_err_to_name(err));
             ret = MENDER_FAIL;
             goto END;
         }
     }
+    if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, params))) {
+        mender_log_error("An error occurred");
+        goto END;
+    }
+    *status                = esp_http_client_get_status_code(client);
+    int64_t content_length = esp_http_client_get_content_length(client);
+    if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_HEADERS_RECEIVED, &response_headers, (content_length > 0) ? (size_t)content_length : 0, params))) {
+        mender_log_error("An error occurred");
+        goto END;
+    }
 
-    /* Fetch headers, this returns the content length */
-    if (esp_http_client_fetch_headers(client) < 0) {
-        mender_log_error("Unable to fetch headers");
+    /* Allocate receive buffer */
+    if (NULL == (data = (char *)mender_malloc(recv_buf_length))) {
+        mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
 
-    /* Read data until all have been received */
+    /* Read data until all have been received, the request fails if the transfer is stalled */
+    mender_http_stall_init(&stall);
+    inactivity = mender_scheduler_get_uptime_us();
     do {
 
-        char data[MENDER_HTTP_RECV_BUF_LENGTH];
-        int  read_length = esp_http_client_read(client, data, sizeof(data));
+        int read_length = esp_http_client_read(client, data, (int)recv_buf_length);
         if (read_length < 0) {
             mender_log_error("An error occured, unable to read data");
             callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
             ret = MENDER_FAIL;
             goto END;
         } else if (read_length > 0) {
+            inactivity = mender_scheduler_get_uptime_us();
+            if (MENDER_OK != (ret = mender_http_stall_check(&stall, (size_t)read_length))) {
+                callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                goto END;
+            }
             /* Transmit data received to the upper layer */
-            if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DATA_RECEIVED, data, (size_t)read_length, params))) {
+            if (MENDER_DONE == (ret = callback(MENDER_HTTP_EVENT_DATA_RECEIVED, data, (size_t)read_length, params))) {
+                /* Stop reading the response without error, the connection can not be kept alive */
+                ret = MENDER_OK;
+                break;
+            } else if (MENDER_OK != ret) {
                 mender_log_error("An error occurred, stop reading data");
                 goto END;
             }
@@ -166,36 +372,110 @@ mender_http_perform(char                *jwt,
                 ret = MENDER_FAIL;
                 goto END;
             }
+            /* The read has timed out, the request fails if no data has been received during the inactivity timeout */
+            if (mender_scheduler_get_uptime_us() - inactivity >= (uint64_t)CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT * 1000000) {
+                mender_log_error("An error occurred, no data received during %u seconds", (unsigned int)CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT);
+                callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                ret = MENDER_FAIL;
+                goto END;
+            }
         }
     } while (false == esp_http_client_is_complete_data_received(client));
 
+    /* Keep the client alive if the response has been received entirely */
+    keep_alive = esp_http_client_is_complete_data_received(client);
+
     /* Read HTTP status code */
     *status = esp_http_client_get_status_code(client);
     if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DISCONNECTED, NULL, 0, params))) {
         mender_log_error("An error occurred");
+        keep_alive = false;
         goto END;
     }
 
 END:
 
-    /* Release memory */
+    /* Keep the client alive or release it */
     if (NULL != client) {
-        esp_http_client_cleanup(client);
+        if (true == keep_alive) {
+            mender_http_connection_give(origin, client);
+            origin = NULL;
+        } else {
+            esp_http_client_cleanup(client);
+        }
+    }
+
+    /* Release memory */
+    if (NULL != response_headers.etag) {
+        mender_free(response_headers.etag);
+    }
+    if (NULL != data) {
+        mender_free(data);
+    }
+    if (NULL != origin) {
+        mender_free(origin);
     }
     if (NULL != bearer) {
-        free(bearer);
+        mender_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_free(url);
+    }
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_HTTP_PERFORM);
+
+    return ret;
+}
+
+mender_err_t
+mender_http_preconnect(char *path) {
+
+    assert(NULL != path);
+    mender_err_t ret;
+    int          status = 0;
+
+    /* The client only keeps alive the connections which performed a request, the first byte of the content is requested to connect to the server */
+    if (MENDER_OK
+        != (ret = mender_http_perform_body(
+                NULL, path, MENDER_HTTP_GET, NULL, NULL, "bytes=0-0", NULL, CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, &mender_http_discard_callback, NULL, &status))) {
+        mender_log_error("Unable to connect to the server");
     }
 
     return ret;
 }
 
+mender_err_t
+mender_http_close_connections(void) {
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return MENDER_FAIL;
+    }
+
+    /* Release all clients kept alive */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if (NULL != mender_http_connections[index].origin) {
+            esp_http_client_cleanup(mender_http_connections[index].client);
+            mender_free(mender_http_connections[index].origin);
+            mender_http_connections[index].origin = NULL;
+            mender_http_connections[index].client = NULL;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_http_exit(void) {
 
-    /* Nothing to do */
+    /* Release connections */
+    mender_http_close_connections();
+    mender_scheduler_mutex_delete(mender_http_connections_mutex);
+    mender_http_connections_mutex = NULL;
+
     return MENDER_OK;
 }
 
@@ -215,3 +495,243 @@ mender_http_method_to_esp_http_client_method(mender_http_method_t method) {
 
     return HTTP_METHOD_MAX;
 }
+
+static void
+mender_http_prepare_request(
+    esp_http_client_handle_t client, mender_http_method_t method, char *bearer, char *signature, char *range, char *etag, mender_http_body_t *body) {
+
+    assert(NULL != client);
+
+    /* Set method and headers, headers not used by the request are removed */
+    esp_http_client_set_method(client, mender_http_method_to_esp_http_client_method(method));
+    if (NULL != bearer) {
+        esp_http_client_set_header(client, "Authorization", bearer);
+    } else {
+        esp_http_client_delete_header(client, "Authorization");
+    }
+    if (NULL != signature) {
+        esp_http_client_set_header(client, "X-MEN-Signature", signature);
+    } else {
+        esp_http_client_delete_header(client, "X-MEN-Signature");
+    }
+    if (NULL != range) {
+        esp_http_client_set_header(client, "Range", range);
+    } else {
+        esp_http_client_delete_header(client, "Range");
+    }
+    if (NULL != etag) {
+        esp_http_client_set_header(client, "If-None-Match", etag);
+    } else {
+        esp_http_client_delete_header(client, "If-None-Match");
+    }
+    if (NULL != body) {
+        esp_http_client_set_header(client, "Content-Type", "application/json");
+    } else {
+        esp_http_client_delete_header(client, "Content-Type");
+    }
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    if ((NULL != body) && (&mender_http_gzip_body_callback == body->callback)) {
+        esp_http_client_set_header(client, "Content-Encoding", "gzip");
+    } else {
+        esp_http_client_delete_header(client, "Content-Encoding");
+    }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+}
+
+static esp_err_t
+mender_http_event_handler(esp_http_client_event_t *event) {
+
+    assert(NULL != event);
+
+    /* Check if a header is received */
+    if ((HTTP_EVENT_ON_HEADER != event->event_id) || (NULL == event->user_data)) {
+        return ESP_OK;
+    }
+    mender_http_headers_t *headers = (mender_http_headers_t *)event->user_data;
+
+    /* Save the value of the ETag header */
+    if (0 == strcasecmp(event->header_key, "ETag")) {
+        if (NULL != headers->etag) {
+            mender_free(headers->etag);
+        }
+        headers->etag = mender_strdup(event->header_value);
+    }
+
+    /* Save the value of the Retry-After header, the value is ignored if it is not a number of seconds (HTTP date) */
+    if (0 == strcasecmp(event->header_key, "Retry-After")) {
+        char         *end;
+        unsigned long retry_after = strtoul(event->header_value, &end, 10);
+        headers->retry_after      = ((end != event->header_value) && ('\0' == *end) && (retry_after <= UINT32_MAX)) ? (uint32_t)retry_after : 0;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t
+mender_http_send_request(esp_http_client_handle_t client, mender_http_body_t *body, size_t body_length) {
+
+    assert(NULL != client);
+    esp_err_t err;
+
+    /* Open HTTP client connection */
+    if (ESP_OK != (err = esp_http_client_open(client, (int)body_length))) {
+        return err;
+    }
+
+    /* Write data if body is defined */
+    if (NULL != body) {
+        if (MENDER_OK != body->callback(&mender_http_body_send, client, body->params)) {
+            return ESP_FAIL;
+        }
+    }
+
+    /* Fetch headers, this returns the content length */
+    if (esp_http_client_fetch_headers(client) < 0) {
+        return ESP_FAIL;
+    }
+
+    /* Check a response has been received */
+    if (0 == esp_http_client_get_status_code(client)) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static mender_err_t
+mender_http_discard_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+
+    (void)event;
+    (void)data;
+    (void)data_length;
+    (void)params;
+
+    /* Nothing to do, only the connection is used */
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_http_payload_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+    assert(NULL != params);
+
+    /* Write the payload at once */
+    return write(params, strlen((char *)params), ctx);
+}
+
+static mender_err_t
+mender_http_body_length(void *data, size_t length, void *ctx) {
+
+    (void)data;
+    assert(NULL != ctx);
+
+    /* Increment the length of the body */
+    *((size_t *)ctx) += length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_http_body_send(void *data, size_t length, void *ctx) {
+
+    assert(NULL != ctx);
+    esp_http_client_handle_t client = (esp_http_client_handle_t)ctx;
+    int                      written;
+
+    /* Write data until all have been written */
+    while (length > 0) {
+        if ((written = esp_http_client_write(client, (const char *)data, (int)length)) <= 0) {
+            return MENDER_FAIL;
+        }
+        data = (uint8_t *)data + written;
+        length -= (size_t)written;
+    }
+
+    return MENDER_OK;
+}
+
+static char *
+mender_http_get_origin(char *url) {
+
+    assert(NULL != url);
+    char *origin;
+
+    /* The origin ends at the beginning of the path of the URL */
+    char *host = strstr(url, "://");
+    host       = (NULL != host) ? (host + strlen("://")) : url;
+    char *end  = strchr(host, '/');
+    if (NULL == (origin = mender_strndup(url, (NULL != end) ? (size_t)(end - url) : strlen(url)))) {
+        return NULL;
+    }
+
+    return origin;
+}
+
+static esp_http_client_handle_t
+mender_http_connection_take(char *origin) {
+
+    assert(NULL != origin);
+    esp_http_client_handle_t client = NULL;
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return NULL;
+    }
+
+    /* Search a client kept alive with the server */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if ((NULL != mender_http_connections[index].origin) && (!strcmp(origin, mender_http_connections[index].origin))) {
+            client = mender_http_connections[index].client;
+            mender_free(mender_http_connections[index].origin);
+            mender_http_connections[index].origin = NULL;
+            mender_http_connections[index].client = NULL;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    return client;
+}
+
+static void
+mender_http_connection_give(char *origin, esp_http_client_handle_t client) {
+
+    assert(NULL != origin);
+    assert(NULL != client);
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        esp_http_client_cleanup(client);
+        mender_free(origin);
+        return;
+    }
+
+    /* Store the client in a free entry, the client of the last entry is released if all the entries are used */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if ((NULL == mender_http_connections[index].origin) || (CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS == index + 1)) {
+            if (NULL != mender_http_connections[index].origin) {
+                esp_http_client_cleanup(mender_http_connections[index].client);
+                mender_free(mender_http_connections[index].origin);
+            }
+            mender_http_connections[index].origin = origin;
+            mender_http_connections[index].client = client;
+            origin                                = NULL;
+            client                                = NULL;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    /* Release the client if it has not been stored */
+    if (NULL != client) {
+        esp_http_client_cleanup(client);
+        mender_free(origin);
+    }
+}
@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
 #include <esp_event.h>
 #include <esp_websocket_client.h>
 #include <esp_crt_bundle.h>
@@ -131,7 +136,7 @@ mender_websocket_connect(
     char        *bearer = NULL;
 
     /* Allocate a new handle */
-    if (NULL == (*handle = malloc(sizeof(mender_websocket_handle_t)))) {
+    if (NULL == (*handle = mender_malloc(sizeof(mender_websocket_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -146,7 +151,7 @@ mender_websocket_connect(
     if ((false == mender_utils_strbeginwith(path, "ws://")) && (false == mender_utils_strbeginwith(path, "wss://"))) {
         if ((true == mender_utils_strbeginwith(path, "http://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "http://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("http://") + strlen("ws://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -154,7 +159,7 @@ mender_websocket_connect(
             snprintf(url, str_length, "ws://%s%s", mender_websocket_config.host + strlen("http://"), path);
         } else if ((true == mender_utils_strbeginwith(path, "https://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "https://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("https://") + strlen("wss://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -162,7 +167,7 @@ mender_websocket_connect(
             snprintf(url, str_length, "wss://%s%s", mender_websocket_config.host + strlen("https://"), path);
         } else {
             size_t str_length = strlen(mender_websocket_config.host) + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -190,7 +195,7 @@ mender_websocket_connect(
     }
     if (NULL != jwt) {
         size_t str_length = strlen("Authorization: Bearer ") + strlen(jwt) + strlen("\r\n") + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -229,7 +234,7 @@ FAIL:
         if (NULL != ((mender_websocket_handle_t *)*handle)->client) {
             esp_websocket_client_destroy(((mender_websocket_handle_t *)*handle)->client);
         }
-        free(*handle);
+        mender_free(*handle);
         *handle = NULL;
     }
 
@@ -237,10 +242,10 @@ END:
 
     /* Release memory */
     if (NULL != bearer) {
-        free(bearer);
+        mender_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_free(url);
     }
 
     return ret;
@@ -263,6 +268,22 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_websocket_ping(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Send ping */
+    if (0
+        > esp_websocket_client_send_with_opcode(
+            ((mender_websocket_handle_t *)handle)->client, WS_TRANSPORT_OPCODES_PING, NULL, 0, pdMS_TO_TICKS(CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT))) {
+        mender_log_error("Unable to send ping over websocket connection");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_websocket_disconnect(void *handle) {
 
@@ -278,9 +299,9 @@ mender_websocket_disconnect(void *handle) {
     /* Release memory */
     esp_websocket_client_destroy(((mender_websocket_handle_t *)handle)->client);
     if (NULL != ((mender_websocket_handle_t *)handle)->data) {
-        free(((mender_websocket_handle_t *)handle)->data);
+        mender_free(((mender_websocket_handle_t *)handle)->data);
     }
-    free(handle);
+    mender_free(handle);
 
     return MENDER_OK;
 }
@@ -322,11 +343,24 @@ mender_websocket_event_handler(void *handler_args, esp_event_base_t base, int32_
                                                       (const uint8_t *)data->data_ptr,
                                                       data->data_len,
                                                       pdMS_TO_TICKS(CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT));
+                handle->callback(MENDER_WEBSOCKET_EVENT_HEARTBEAT, NULL, 0, handle->params);
+
+            } else if (WS_TRANSPORT_OPCODES_PONG == data->op_code) {
+
+                /* Connection is alive */
+                handle->callback(MENDER_WEBSOCKET_EVENT_HEARTBEAT, NULL, 0, handle->params);
 
             } else if (WS_TRANSPORT_OPCODES_BINARY == data->op_code) {
 
-                /* Check if the whole packet is received once */
-                if ((NULL == handle->data) && (data->data_len >= data->payload_len)) {
+                /* Check if the whole packet is received once, it is given to the callback from the buffer of the client without copy */
+                if ((0 == data->payload_offset) && (data->data_len >= data->payload_len)) {
+
+                    /* Release the packet which has not been completed */
+                    if (NULL != handle->data) {
+                        mender_free(handle->data);
+                        handle->data     = NULL;
+                        handle->data_len = 0;
+                    }
 
                     /* Invoke callback */
                     if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, (void *)data->data_ptr, data->data_len, handle->params)) {
@@ -335,19 +369,28 @@ mender_websocket_event_handler(void *handler_args, esp_event_base_t base, int32_
 
                 } else {
 
-                    /* Concatenate data */
-                    void *tmp = realloc(handle->data, handle->data_len + data->data_len);
-                    if (NULL == tmp) {
-                        mender_log_error("Unable to allocate memory");
+                    /* Allocate the whole packet when its first fragment is received, the following ones are copied at their offset */
+                    if (0 == data->payload_offset) {
+                        if (NULL != handle->data) {
+                            mender_free(handle->data);
+                        }
+                        handle->data_len = 0;
+                        if (NULL == (handle->data = mender_malloc(data->payload_len))) {
+                            mender_log_error("Unable to allocate memory");
+                            break;
+                        }
+                    }
+                    if ((NULL == handle->data) || ((size_t)data->payload_offset != handle->data_len)
+                        || ((size_t)data->payload_offset + data->data_len > (size_t)data->payload_len)) {
+                        mender_log_error("Unexpected fragment received");
                         if (NULL != handle->data) {
-                            free(handle->data);
+                            mender_free(handle->data);
                             handle->data     = NULL;
                             handle->data_len = 0;
                         }
                         break;
                     }
-                    handle->data = tmp;
-                    memcpy(handle->data + handle->data_len, data->data_ptr, data->data_len);
+                    memcpy((uint8_t *)handle->data + handle->data_len, data->data_ptr, data->data_len);
                     handle->data_len += data->data_len;
 
                     /* Check if the whole packet has been received */
@@ -359,7 +402,7 @@ mender_websocket_event_handler(void *handler_args, esp_event_base_t base, int32_
                         }
 
                         /* Release memory */
-                        free(handle->data);
+                        mender_free(handle->data);
                         handle->data     = NULL;
                         handle->data_len = 0;
                     }
@@ -0,0 +1,56 @@
+/**
+ * @file      mender-net.h
+ * @brief     Mender network common file interface for curl platform
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_NET_H__
+#define __MENDER_NET_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <curl/curl.h>
+#include "mender-utils.h"
+
+/**
+ * @brief Set the DNS cache, the TLS sessions and the connections shared by the HTTP and WebSocket clients
+ * @note The host names resolved, the TLS sessions established and the connections kept alive by a client are reused by the others
+ * @param curl Client
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_set_share(CURL *curl);
+
+/**
+ * @brief Set the pinned public keys of the server, the chain of certificates is not verified when the public key of the server matches one of them
+ * @note The pinned public keys are disabled once the public key of the server does not match, the next connections verify the chain of certificates
+ * @param curl Client
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_set_pinned_public_key(CURL *curl);
+
+/**
+ * @brief Check the result of a transfer, the pinned public keys are disabled if the public key of the server does not match
+ * @param result Result of the transfer
+ */
+void mender_net_check_pinned_public_key(CURLcode result);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_NET_H__ */
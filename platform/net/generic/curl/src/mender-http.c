@@ -17,9 +17,20 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
+#include <strings.h>
 #include <curl/curl.h>
 #include "mender-http.h"
+#include "mender-http-gzip.h"
+#include "mender-http-stall.h"
 #include "mender-log.h"
+#include "mender-net.h"
+#include "mender-scheduler.h"
+#include "mender-trace.h"
 #include "mender-utils.h"
 
 /**
@@ -31,19 +42,164 @@
 #define MENDER_HTTP_USER_AGENT "mender-mcu-client (mender-http) curl/" LIBCURL_VERSION
 #endif /* MENDER_CLIENT_VERSION */
 
+/**
+ * @brief Default maximum number of connections kept alive with the servers
+ */
+#ifndef CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS
+#define CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS (2)
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS */
+
+/**
+ * @brief Default number of connections used to download an artifact, the ranges of the artifact are downloaded in parallel if it is greater than 1
+ */
+#ifndef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS
+#define CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS (1)
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS */
+
+/**
+ * @brief Default length of the ranges downloaded in parallel, each connection buffers at most one range
+ */
+#ifndef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH
+#define CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH (1024 * 1024)
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH */
+
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+
+/**
+ * @brief Maximum duration the thread driving the multiplexed transfers waits for activity before it releases the multi handle (milliseconds)
+ */
+#define MENDER_HTTP_MULTI_POLL_TIMEOUT (100)
+
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
 /**
  * @brief User data
  */
 typedef struct {
     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *); /**< Callback invoked on HTTP events */
-    void *params;                                                                 /**< Parameters passed to the callback, NULL if not used */
+    void                 *params;                                                 /**< Parameters passed to the callback, NULL if not used */
+    mender_err_t          ret;                                                    /**< Last callback return value on data received */
+    CURL                 *curl;                                                   /**< Client, used to read the status code before data are transmitted */
+    int                  *status;                                                 /**< Status code */
+    bool                  headers_received;                                       /**< Headers received event has been transmitted */
+    mender_http_headers_t headers;                                                /**< Headers of the response */
+    mender_http_stall_t   stall;                                                  /**< Stall detection of the transfer */
 } mender_http_curl_user_data_t;
 
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+
+/**
+ * @brief Multiplexed transfer, the transfers of all the requests are driven by the thread holding the multi handle
+ */
+typedef struct {
+    bool     done;   /**< Transfer is done */
+    CURLcode result; /**< Result of the transfer */
+} mender_http_multi_transfer_t;
+
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
+#if CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1
+
+/**
+ * @brief Range of a parallel download, the data received are buffered until all the previous ranges have been delivered
+ */
+typedef struct {
+    CURL               *curl;         /**< Client, NULL if the connection has not been used yet */
+    char               *buffer;       /**< Data received */
+    size_t              offset;       /**< Offset of the range in the content */
+    size_t              length;       /**< Length of the range, 0 if there is no range to download */
+    size_t              received;     /**< Length of the data received */
+    size_t              delivered;    /**< Length of the data delivered to the callback */
+    size_t              total;        /**< Total length of the content from the Content-Range header, 0 if not received or if it does not match the range */
+    bool                headers_done; /**< Headers of the response have been received */
+    bool                done;         /**< Transfer of the range is done */
+    mender_http_stall_t stall;        /**< Stall detection of the transfer of the range */
+} mender_http_range_t;
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1 */
+
 /**
  * @brief Mender HTTP configuration
  */
 static mender_http_config_t mender_http_config;
 
+/**
+ * @brief Clients kept alive and mutex, the connections of a client are reused by the next requests to the same host and port
+ */
+static struct {
+    char *origin; /**< Scheme, host and port of the connection, NULL if the entry is not used */
+    CURL *curl;   /**< Client */
+} mender_http_connections[CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS];
+static void *mender_http_connections_mutex = NULL;
+
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+
+/**
+ * @brief Multi handle and mutex, the requests to the mender server are multiplexed as HTTP/2 streams over the connections of the multi handle
+ */
+static CURLM *mender_http_multi       = NULL;
+static void  *mender_http_multi_mutex = NULL;
+
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
+/**
+ * @brief Retrieve scheme, host and port of an URL
+ * @param url URL
+ * @return Scheme, host and port of the URL if the function succeeds, NULL otherwise
+ */
+static char *mender_http_get_origin(char *url);
+
+/**
+ * @brief Take a client kept alive with the server
+ * @param origin Scheme, host and port of the connection
+ * @return Client if one is kept alive with the server, NULL otherwise
+ */
+static CURL *mender_http_connection_take(char *origin);
+
+/**
+ * @brief Give a client to be kept alive with the server, the client is released if it can not be kept
+ * @param origin Scheme, host and port of the connection, the memory is owned by the connections after the call
+ * @param curl Client
+ */
+static void mender_http_connection_give(char *origin, CURL *curl);
+
+/**
+ * @brief HTTP callback used to discard the response of the request performed to connect to the server in advance
+ * @param event Event from HTTP client
+ * @param data Data received
+ * @param data_length Data length
+ * @param params Callback parameters
+ * @return MENDER_OK
+ */
+static mender_err_t mender_http_discard_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
+
+/**
+ * @brief Body callback used to write a payload at once
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Payload
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_payload_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
+/**
+ * @brief Write function used to compute the length of the body
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Length of the body, incremented by the length of the data
+ * @return MENDER_OK
+ */
+static mender_err_t mender_http_body_length(void *data, size_t length, void *ctx);
+
+/**
+ * @brief Write function used to copy the body to a buffer
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Pointer to the end of the body in the buffer, incremented by the length of the data
+ * @return MENDER_OK
+ */
+static mender_err_t mender_http_body_copy(void *data, size_t length, void *ctx);
+
 /**
  * @brief HTTP PREREQ callback, used to inform the client is connected to the server
  * @param params User data
@@ -55,16 +211,93 @@ static mender_http_config_t mender_http_config;
  */
 static int mender_http_prereq_callback(void *params, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port, int conn_local_port);
 
+/**
+ * @brief HTTP header callback, used to retrieve the ETag and Retry-After headers
+ * @param buffer Header line from the server, not NULL terminated
+ * @param size Size of the data
+ * @param nitems Number of element
+ * @param params User data
+ * @return Real size of data
+ */
+static size_t mender_http_header_callback(char *buffer, size_t size, size_t nitems, void *params);
+
 /**
  * @brief HTTP write callback, used to retrieve data from the server
  * @param data Data from the server
  * @param size Size of the data
  * @param nmemb Number of element
  * @param params User data
- * @return Real size of data if the function succeeds, -1 otherwise
+ * @return Real size of data if the function succeeds, -1 otherwise or if the callback stops reading the response
  */
 static size_t mender_http_write_callback(char *data, size_t size, size_t nmemb, void *params);
 
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+
+/**
+ * @brief Perform a transfer with the multi handle, the thread holding the multi handle drives the transfers of the other requests too
+ * @note The callbacks of a request may be invoked from the thread of another request, the request is waiting for the multi handle meanwhile
+ * @param curl Client
+ * @return Result of the transfer
+ */
+static CURLcode mender_http_multi_perform(CURL *curl);
+
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
+#if CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1
+
+/**
+ * @brief Download a content with several connections, the ranges are downloaded in parallel and delivered in order to the callback
+ * @param url URL of the content
+ * @param offset Offset of the content requested
+ * @param partial Partial content is requested, the status given is 206 if it is set, 200 otherwise
+ * @param recv_buf_length Length of the receive buffer, which is the maximum length of the data given to the callback at once
+ * @param callback Callback invoked on HTTP events, it may return MENDER_DONE on data received to stop reading the response without error
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code, set before the callback is invoked with the data received
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the server does not support ranges, error code otherwise
+ */
+static mender_err_t mender_http_perform_ranges(char *url,
+                                               size_t offset,
+                                               bool   partial,
+                                               size_t recv_buf_length,
+                                               mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                               void *params,
+                                               int  *status);
+
+/**
+ * @brief Request a range of a parallel download, the client and the buffer of the range are created on the first request
+ * @param multi Multi handle performing the transfers
+ * @param range Range
+ * @param url URL of the content
+ * @param offset Offset of the range in the content
+ * @param length Length of the range
+ * @param recv_buf_length Length of the receive buffer
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_range_request(CURLM *multi, mender_http_range_t *range, char *url, size_t offset, size_t length, size_t recv_buf_length);
+
+/**
+ * @brief HTTP header callback of a range, used to retrieve the total length of the content
+ * @param buffer Header line from the server, not NULL terminated
+ * @param size Size of the data
+ * @param nitems Number of element
+ * @param params Range
+ * @return Real size of data
+ */
+static size_t mender_http_range_header_callback(char *buffer, size_t size, size_t nitems, void *params);
+
+/**
+ * @brief HTTP write callback of a range, used to buffer the data received
+ * @param data Data from the server
+ * @param size Size of the data
+ * @param nmemb Number of element
+ * @param params Range
+ * @return Real size of data if the function succeeds, 0 if the response is not the range requested
+ */
+static size_t mender_http_range_write_callback(char *data, size_t size, size_t nmemb, void *params);
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1 */
+
 mender_err_t
 mender_http_init(mender_http_config_t *config) {
 
@@ -77,6 +310,25 @@ mender_http_init(mender_http_config_t *config) {
     /* Initialization of curl */
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
+    /* Create connections mutex */
+    if (MENDER_OK != mender_scheduler_mutex_create(&mender_http_connections_mutex)) {
+        mender_log_error("Unable to create connections mutex");
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+    /* Create multi handle and mutex, a new request waits for the connection being established to multiplex its stream */
+    if (NULL == (mender_http_multi = curl_multi_init())) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    curl_multi_setopt(mender_http_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    if (MENDER_OK != mender_scheduler_mutex_create(&mender_http_multi_mutex)) {
+        mender_log_error("Unable to create multi mutex");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
     return MENDER_OK;
 }
 
@@ -86,25 +338,79 @@ mender_http_perform(char                *jwt,
                     mender_http_method_t method,
                     char                *payload,
                     char                *signature,
+                    char                *range,
+                    size_t               recv_buf_length,
                     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
                     void *params,
                     int  *status) {
 
+    mender_http_body_t body = { .callback = &mender_http_payload_callback, .params = payload };
+
+    /* Perform HTTP request with the payload written at once */
+    return mender_http_perform_body(jwt, path, method, (NULL != payload) ? &body : NULL, signature, range, NULL, recv_buf_length, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_body(char                *jwt,
+                         char                *path,
+                         mender_http_method_t method,
+                         mender_http_body_t  *body,
+                         char                *signature,
+                         char                *range,
+                         char                *etag,
+                         size_t               recv_buf_length,
+                         mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                         void *params,
+                         int  *status) {
+
     assert(NULL != path);
     assert(NULL != callback);
     assert(NULL != status);
-    CURLcode           err;
-    mender_err_t       ret             = MENDER_OK;
-    CURL              *curl            = NULL;
-    char              *url             = NULL;
-    char              *bearer          = NULL;
-    char              *x_men_signature = NULL;
-    struct curl_slist *headers         = NULL;
+    CURLcode                     err;
+    mender_err_t                 ret                  = MENDER_OK;
+    CURL                        *curl                 = NULL;
+    char                        *url                  = NULL;
+    char                        *bearer               = NULL;
+    char                        *x_men_signature      = NULL;
+    char                        *range_header         = NULL;
+    char                        *if_none_match_header = NULL;
+    char                        *origin               = NULL;
+    char                        *payload              = NULL;
+    size_t                       body_length          = 0;
+    bool                         keep_alive           = false;
+    struct curl_slist           *headers              = NULL;
+    mender_http_curl_user_data_t user_data            = { .callback         = callback,
+                                                          .params           = params,
+                                                          .ret              = MENDER_OK,
+                                                          .curl             = NULL,
+                                                          .status           = status,
+                                                          .headers_received = false,
+                                                          .headers          = { .etag = NULL, .retry_after = 0 } };
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    mender_http_body_t gzip_body;
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+    /* Trace the request */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_HTTP_PERFORM);
+
+#if CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1
+    /* Download artifacts with several connections, the whole content or its end is requested, a single connection is used if ranges are not supported */
+    if ((NULL == jwt) && (MENDER_HTTP_GET == method) && (NULL == body) && (NULL == signature) && (NULL == etag)
+        && ((true == mender_utils_strbeginwith(path, "http://")) || (true == mender_utils_strbeginwith(path, "https://")))
+        && ((NULL == range) || ((true == mender_utils_strbeginwith(range, "bytes=")) && ('-' == range[strlen(range) - 1])))) {
+        size_t offset = (NULL != range) ? (size_t)strtoul(range + strlen("bytes="), NULL, 10) : 0;
+        if (MENDER_NOT_IMPLEMENTED != (ret = mender_http_perform_ranges(path, offset, (NULL != range), recv_buf_length, callback, params, status))) {
+            goto END;
+        }
+        mender_log_warning("Ranges are not supported by the server, downloading with a single connection");
+        ret = MENDER_OK;
+    }
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1 */
 
     /* Compute URL if required */
     if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
         size_t str_length = strlen(mender_http_config.host) + strlen(path) + 1;
-        if (NULL == (url = (char *)malloc(str_length))) {
+        if (NULL == (url = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -112,8 +418,15 @@ mender_http_perform(char                *jwt,
         snprintf(url, str_length, "%s%s", mender_http_config.host, path);
     }
 
-    /* Initialization of the client */
-    if (NULL == (curl = curl_easy_init())) {
+    /* Initialization of the client, a client kept alive with the server is reused if available */
+    if (NULL == (origin = mender_http_get_origin((NULL != url) ? url : path))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    if (NULL != (curl = mender_http_connection_take(origin))) {
+        curl_easy_reset(curl);
+    } else if (NULL == (curl = curl_easy_init())) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -135,7 +448,40 @@ mender_http_perform(char                *jwt,
         ret = MENDER_FAIL;
         goto END;
     }
-    mender_http_curl_user_data_t user_data = { .callback = callback, .params = params };
+    if (MENDER_OK != (ret = mender_net_set_share(curl))) {
+        mender_log_error("Unable to set share");
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_net_set_pinned_public_key(curl))) {
+        mender_log_error("Unable to set pinned public key");
+        goto END;
+    }
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+    if (NULL != url) {
+        if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS))) {
+            mender_log_error("Unable to set HTTP/2: %s", curl_easy_strerror(err));
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L))) {
+            mender_log_error("Unable to set HTTP pipe wait: %s", curl_easy_strerror(err));
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long)recv_buf_length))) {
+        mender_log_error("Unable to set HTTP receive buffer size: %s", curl_easy_strerror(err));
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    if ((CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L)))
+        || (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT)))) {
+        mender_log_error("Unable to set HTTP inactivity timeout: %s", curl_easy_strerror(err));
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    user_data.curl = curl;
     if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_PREREQFUNCTION, &mender_http_prereq_callback))) {
         mender_log_error("Unable to set HTTP PREREQ function: %s", curl_easy_strerror(err));
         ret = MENDER_FAIL;
@@ -146,6 +492,16 @@ mender_http_perform(char                *jwt,
         ret = MENDER_FAIL;
         goto END;
     }
+    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &mender_http_header_callback))) {
+        mender_log_error("Unable to set HTTP header function: %s", curl_easy_strerror(err));
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_HEADERDATA, &user_data))) {
+        mender_log_error("Unable to set HTTP header data: %s", curl_easy_strerror(err));
+        ret = MENDER_FAIL;
+        goto END;
+    }
     if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &mender_http_write_callback))) {
         mender_log_error("Unable to set HTTP write function: %s", curl_easy_strerror(err));
         ret = MENDER_FAIL;
@@ -158,7 +514,7 @@ mender_http_perform(char                *jwt,
     }
     if (NULL != jwt) {
         size_t str_length = strlen("Authorization: Bearer ") + strlen(jwt) + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -168,7 +524,7 @@ mender_http_perform(char                *jwt,
     }
     if (NULL != signature) {
         size_t str_length = strlen("X-MEN-Signature: ") + strlen(signature) + 1;
-        if (NULL == (x_men_signature = (char *)malloc(str_length))) {
+        if (NULL == (x_men_signature = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -176,23 +532,78 @@ mender_http_perform(char                *jwt,
         snprintf(x_men_signature, str_length, "X-MEN-Signature: %s", signature);
         headers = curl_slist_append(headers, x_men_signature);
     }
-    if (NULL != payload) {
-        headers = curl_slist_append(headers, "Content-Type: application/json");
+    if (NULL != range) {
+        size_t str_length = strlen("Range: ") + strlen(range) + 1;
+        if (NULL == (range_header = (char *)mender_malloc(str_length))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        snprintf(range_header, str_length, "Range: %s", range);
+        headers = curl_slist_append(headers, range_header);
     }
-    if (NULL != headers) {
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    if (NULL != etag) {
+        size_t str_length = strlen("If-None-Match: ") + strlen(etag) + 1;
+        if (NULL == (if_none_match_header = (char *)mender_malloc(str_length))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        snprintf(if_none_match_header, str_length, "If-None-Match: %s", etag);
+        headers = curl_slist_append(headers, if_none_match_header);
     }
 
-    /* Write data if payload is defined */
-    if (NULL != payload) {
+    /* Write data if body is defined, the body is written to a buffer because it is read by the client */
+    if (NULL != body) {
+        if (MENDER_OK != (ret = body->callback(&mender_http_body_length, &body_length, body->params))) {
+            mender_log_error("Unable to compute the length of the body");
+            goto END;
+        }
+#ifdef CONFIG_MENDER_HTTP_GZIP
+        /* Compress the body with gzip if it is large enough, the signed bodies are sent as they have been signed */
+        if ((NULL == signature) && (body_length >= CONFIG_MENDER_HTTP_GZIP_THRESHOLD)) {
+            gzip_body.callback = &mender_http_gzip_body_callback;
+            gzip_body.params   = body;
+            body               = &gzip_body;
+            body_length        = 0;
+            if (MENDER_OK != (ret = body->callback(&mender_http_body_length, &body_length, body->params))) {
+                mender_log_error("Unable to compute the length of the compressed body");
+                goto END;
+            }
+            headers = curl_slist_append(headers, "Content-Encoding: gzip");
+        }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+        if (NULL == (payload = (char *)mender_malloc(body_length + 1))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        char *end = payload;
+        if (MENDER_OK != (ret = body->callback(&mender_http_body_copy, &end, body->params))) {
+            mender_log_error("Unable to write the body");
+            goto END;
+        }
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body_length);
         curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
         if (MENDER_HTTP_PUT == method) {
             curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
         }
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+    }
+    if (NULL != headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     }
 
-    /* Perform request */
-    if (CURLE_OK != (err = curl_easy_perform(curl))) {
+    /* Perform request, the transfer is aborted with a write error if the callback stops reading the response */
+    mender_http_stall_init(&user_data.stall);
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+    /* The requests to the mender server are multiplexed, the artifacts are downloaded with their own connections */
+    err = (NULL != url) ? mender_http_multi_perform(curl) : curl_easy_perform(curl);
+#else
+    err = curl_easy_perform(curl);
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+    mender_net_check_pinned_public_key(err);
+    if ((CURLE_OK != err) && ((CURLE_WRITE_ERROR != err) || (MENDER_DONE != user_data.ret))) {
         mender_log_error("Unable to perform HTTP request: %s", curl_easy_strerror(err));
         callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
         ret = MENDER_FAIL;
@@ -207,42 +618,177 @@ mender_http_perform(char                *jwt,
         goto END;
     }
     *status = (int)response_code;
+
+    /* Transmit the headers to the upper layer if the response has no data */
+    if ((CURLE_OK == err) && (false == user_data.headers_received)) {
+        user_data.headers_received = true;
+        if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_HEADERS_RECEIVED, &user_data.headers, 0, params))) {
+            mender_log_error("An error occurred");
+            goto END;
+        }
+    }
     if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DISCONNECTED, NULL, 0, params))) {
         mender_log_error("An error occurred");
         goto END;
     }
 
+    /* Keep the client alive if the request has been performed entirely */
+    keep_alive = (CURLE_OK == err);
+
 END:
 
-    /* Release memory */
+    /* Keep the client alive or release it */
     if (NULL != curl) {
-        curl_easy_cleanup(curl);
+        if (true == keep_alive) {
+            mender_http_connection_give(origin, curl);
+            origin = NULL;
+        } else {
+            curl_easy_cleanup(curl);
+        }
+    }
+
+    /* Release memory */
+    if (NULL != payload) {
+        mender_free(payload);
+    }
+    if (NULL != origin) {
+        mender_free(origin);
     }
     if (NULL != headers) {
         curl_slist_free_all(headers);
     }
+    if (NULL != if_none_match_header) {
+        mender_free(if_none_match_header);
+    }
+    if (NULL != range_header) {
+        mender_free(range_header);
+    }
+    if (NULL != user_data.headers.etag) {
+        mender_free(user_data.headers.etag);
+    }
     if (NULL != x_men_signature) {
-        free(x_men_signature);
+        mender_free(x_men_signature);
     }
     if (NULL != bearer) {
-        free(bearer);
+        mender_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_free(url);
     }
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_HTTP_PERFORM);
 
     return ret;
 }
 
+mender_err_t
+mender_http_preconnect(char *path) {
+
+    assert(NULL != path);
+    mender_err_t ret;
+    int          status = 0;
+
+    /* The client only keeps alive the connections which performed a request, the first byte of the content is requested to connect to the server */
+    if (MENDER_OK
+        != (ret = mender_http_perform_body(
+                NULL, path, MENDER_HTTP_GET, NULL, NULL, "bytes=0-0", NULL, CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, &mender_http_discard_callback, NULL, &status))) {
+        mender_log_error("Unable to connect to the server");
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_http_close_connections(void) {
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return MENDER_FAIL;
+    }
+
+    /* Release all clients kept alive */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if (NULL != mender_http_connections[index].origin) {
+            curl_easy_cleanup(mender_http_connections[index].curl);
+            mender_free(mender_http_connections[index].origin);
+            mender_http_connections[index].origin = NULL;
+            mender_http_connections[index].curl   = NULL;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_http_exit(void) {
 
+    /* Release connections */
+    mender_http_close_connections();
+    mender_scheduler_mutex_delete(mender_http_connections_mutex);
+    mender_http_connections_mutex = NULL;
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+    curl_multi_cleanup(mender_http_multi);
+    mender_http_multi = NULL;
+    mender_scheduler_mutex_delete(mender_http_multi_mutex);
+    mender_http_multi_mutex = NULL;
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
     /* Cleaning */
     curl_global_cleanup();
 
     return MENDER_OK;
 }
 
+static mender_err_t
+mender_http_discard_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+
+    (void)event;
+    (void)data;
+    (void)data_length;
+    (void)params;
+
+    /* Nothing to do, only the connection is used */
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_http_payload_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+    assert(NULL != params);
+
+    /* Write the payload at once */
+    return write(params, strlen((char *)params), ctx);
+}
+
+static mender_err_t
+mender_http_body_length(void *data, size_t length, void *ctx) {
+
+    (void)data;
+    assert(NULL != ctx);
+
+    /* Increment the length of the body */
+    *((size_t *)ctx) += length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_http_body_copy(void *data, size_t length, void *ctx) {
+
+    assert(NULL != ctx);
+    char **end = (char **)ctx;
+
+    /* Copy data at the end of the body */
+    memcpy(*end, data, length);
+    *end += length;
+
+    return MENDER_OK;
+}
+
 static int
 mender_http_prereq_callback(void *params, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port, int conn_local_port) {
 
@@ -262,6 +808,56 @@ mender_http_prereq_callback(void *params, char *conn_primary_ip, char *conn_loca
     return CURL_PREREQFUNC_OK;
 }
 
+static size_t
+mender_http_header_callback(char *buffer, size_t size, size_t nitems, void *params) {
+
+    assert(NULL != buffer);
+    assert(NULL != params);
+    mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
+    size_t                        realsize  = size * nitems;
+
+    /* The headers of a previous response, for example "100 Continue", are discarded */
+    if ((realsize >= strlen("HTTP/")) && (0 == strncmp(buffer, "HTTP/", strlen("HTTP/")))) {
+        if (NULL != user_data->headers.etag) {
+            mender_free(user_data->headers.etag);
+            user_data->headers.etag = NULL;
+        }
+        user_data->headers.retry_after = 0;
+    }
+
+    /* Save the value of the ETag header without the spaces and the line ending */
+    if ((realsize > strlen("ETag:")) && (0 == strncasecmp(buffer, "ETag:", strlen("ETag:")))) {
+        char  *value  = buffer + strlen("ETag:");
+        size_t length = realsize - strlen("ETag:");
+        while ((length > 0) && ((' ' == *value) || ('\t' == *value))) {
+            value++;
+            length--;
+        }
+        while ((length > 0) && (('\r' == value[length - 1]) || ('\n' == value[length - 1]) || (' ' == value[length - 1]))) {
+            length--;
+        }
+        if (NULL != user_data->headers.etag) {
+            mender_free(user_data->headers.etag);
+        }
+        user_data->headers.etag = mender_strndup(value, length);
+    }
+
+    /* Save the value of the Retry-After header, the value is ignored if it is not a number of seconds (HTTP date) */
+    if ((realsize > strlen("Retry-After:")) && (0 == strncasecmp(buffer, "Retry-After:", strlen("Retry-After:")))) {
+        char         *end;
+        unsigned long retry_after = strtoul(buffer + strlen("Retry-After:"), &end, 10);
+        while ((end < buffer + realsize) && ((' ' == *end) || ('\t' == *end))) {
+            end++;
+        }
+        user_data->headers.retry_after
+            = ((end != buffer + strlen("Retry-After:")) && (end < buffer + realsize) && (('\r' == *end) || ('\n' == *end)) && (retry_after <= UINT32_MAX))
+                  ? (uint32_t)retry_after
+                  : 0;
+    }
+
+    return realsize;
+}
+
 static size_t
 mender_http_write_callback(char *data, size_t size, size_t nmemb, void *params) {
 
@@ -269,13 +865,496 @@ mender_http_write_callback(char *data, size_t size, size_t nmemb, void *params)
     mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
     size_t                        realsize  = size * nmemb;
 
+    /* Read HTTP status code */
+    long response_code;
+    if (CURLE_OK == curl_easy_getinfo(user_data->curl, CURLINFO_RESPONSE_CODE, &response_code)) {
+        *user_data->status = (int)response_code;
+    }
+
+    /* Transmit content length to the upper layer before the first data */
+    if (false == user_data->headers_received) {
+        user_data->headers_received = true;
+        curl_off_t content_length;
+        if ((CURLE_OK != curl_easy_getinfo(user_data->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length)) || (content_length < 0)) {
+            content_length = 0;
+        }
+        if (MENDER_OK
+            != (user_data->ret = user_data->callback(MENDER_HTTP_EVENT_HEADERS_RECEIVED, &user_data->headers, (size_t)content_length, user_data->params))) {
+            mender_log_error("An error occurred, stop reading data");
+            return -1;
+        }
+    }
+
+    /* Check the throughput, the transfer is aborted if it is stalled */
+    if (MENDER_OK != (user_data->ret = mender_http_stall_check(&user_data->stall, realsize))) {
+        return 0;
+    }
+
     /* Transmit data received to the upper layer */
     if (realsize > 0) {
-        if (MENDER_OK != user_data->callback(MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)data, realsize, user_data->params)) {
-            mender_log_error("An error occurred, stop reading data");
+        if (MENDER_OK != (user_data->ret = user_data->callback(MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)data, realsize, user_data->params))) {
+            if (MENDER_DONE != user_data->ret) {
+                mender_log_error("An error occurred, stop reading data");
+            }
             return -1;
         }
     }
 
     return realsize;
 }
+
+#ifdef CONFIG_MENDER_HTTP_MULTIPLEXING
+
+static CURLcode
+mender_http_multi_perform(CURL *curl) {
+
+    assert(NULL != curl);
+    mender_http_multi_transfer_t transfer = { .done = false, .result = CURLE_OK };
+    CURLMcode                    err;
+
+    /* Take the multi handle, the thread driving the transfers is woken up so that it releases it */
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+    curl_multi_wakeup(mender_http_multi);
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_multi_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return CURLE_FAILED_INIT;
+    }
+    if (CURLM_OK != (err = curl_multi_add_handle(mender_http_multi, curl))) {
+        mender_log_error("Unable to add HTTP request: %s", curl_multi_strerror(err));
+        mender_scheduler_mutex_give(mender_http_multi_mutex);
+        return CURLE_FAILED_INIT;
+    }
+
+    /* Perform the transfers until this one is done, the transfer may be done by another thread while this one waits for the multi handle */
+    while (false == transfer.done) {
+        int running;
+        if (CURLM_OK != (err = curl_multi_perform(mender_http_multi, &running))) {
+            mender_log_error("Unable to perform HTTP request: %s", curl_multi_strerror(err));
+            transfer.result = CURLE_FAILED_INIT;
+            break;
+        }
+
+        /* Check the transfers done, the result is given to the request owning the transfer */
+        CURLMsg *msg;
+        int      pending;
+        while (NULL != (msg = curl_multi_info_read(mender_http_multi, &pending))) {
+            mender_http_multi_transfer_t *done = NULL;
+            if ((CURLMSG_DONE == msg->msg) && (CURLE_OK == curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&done)) && (NULL != done)) {
+                done->result = msg->data.result;
+                done->done   = true;
+            }
+        }
+
+        /* Wait for activity on the connections, the multi handle is released meanwhile so that the other requests are added */
+        if ((false == transfer.done) && (0 != running)) {
+            curl_multi_poll(mender_http_multi, NULL, 0, MENDER_HTTP_MULTI_POLL_TIMEOUT, NULL);
+            mender_scheduler_mutex_give(mender_http_multi_mutex);
+            mender_scheduler_yield(0);
+            if (MENDER_OK != mender_scheduler_mutex_take(mender_http_multi_mutex, -1)) {
+                mender_log_error("Unable to take mutex");
+                return CURLE_FAILED_INIT;
+            }
+        }
+    }
+
+    /* Release the multi handle */
+    curl_multi_remove_handle(mender_http_multi, curl);
+    mender_scheduler_mutex_give(mender_http_multi_mutex);
+
+    return transfer.result;
+}
+
+#endif /* CONFIG_MENDER_HTTP_MULTIPLEXING */
+
+#if CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1
+
+static mender_err_t
+mender_http_perform_ranges(char *url,
+                           size_t offset,
+                           bool   partial,
+                           size_t recv_buf_length,
+                           mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                           void *params,
+                           int  *status) {
+
+    assert(NULL != url);
+    assert(NULL != callback);
+    assert(NULL != status);
+    CURLMcode             err;
+    mender_err_t          ret     = MENDER_OK;
+    CURLM                *multi   = NULL;
+    size_t                head    = 0;
+    size_t                next    = 0;
+    size_t                total   = 0;
+    bool                  done    = false;
+    int                   running = 0;
+    mender_http_headers_t headers = { .etag = NULL, .retry_after = 0 };
+    mender_http_range_t   ranges[CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS];
+
+    memset(ranges, 0, sizeof(ranges));
+
+    /* Initialization of the transfers, each range has its own connection so that multiplexing is disabled */
+    if (NULL == (multi = curl_multi_init())) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_NOTHING);
+
+    /* Request the first range, the other ranges are requested when the total length of the content is known */
+    if (MENDER_OK != (ret = mender_http_range_request(multi, &ranges[0], url, offset, CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH, recv_buf_length))) {
+        mender_log_error("Unable to request range");
+        goto END;
+    }
+
+    /* Perform the transfers until all the ranges are delivered */
+    while (false == done) {
+        if (CURLM_OK != (err = curl_multi_perform(multi, &running))) {
+            mender_log_error("Unable to perform HTTP request: %s", curl_multi_strerror(err));
+            callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+            ret = MENDER_FAIL;
+            goto END;
+        }
+
+        /* Check the response to the first range, the other ranges are requested if the server supports ranges */
+        if ((0 == total) && (true == ranges[0].headers_done)) {
+            long response_code;
+            if ((CURLE_OK != curl_easy_getinfo(ranges[0].curl, CURLINFO_RESPONSE_CODE, &response_code)) || (206 != response_code)
+                || (ranges[0].total <= offset)) {
+                ret = MENDER_NOT_IMPLEMENTED;
+                goto END;
+            }
+            total            = ranges[0].total;
+            ranges[0].length = (total - offset < ranges[0].length) ? (total - offset) : ranges[0].length;
+            next             = offset + ranges[0].length;
+            for (size_t index = 1; (index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS) && (next < total); index++) {
+                size_t length
+                    = (total - next < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH) ? (total - next) : CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH;
+                if (MENDER_OK != (ret = mender_http_range_request(multi, &ranges[index], url, next, length, recv_buf_length))) {
+                    mender_log_error("Unable to request range");
+                    callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                    goto END;
+                }
+                next += length;
+            }
+
+            /* Transmit the status and the length of the content to the upper layer as if a single request was performed */
+            *status = (true == partial) ? 206 : 200;
+            if ((MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, params)))
+                || (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_HEADERS_RECEIVED, &headers, total - offset, params)))) {
+                mender_log_error("An error occurred");
+                goto END;
+            }
+        }
+
+        /* Check the transfers done, a range which is not received entirely fails the download, which can be resumed from the data delivered */
+        CURLMsg *msg;
+        int      pending;
+        while (NULL != (msg = curl_multi_info_read(multi, &pending))) {
+            if (CURLMSG_DONE != msg->msg) {
+                continue;
+            }
+            CURL    *curl   = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            curl_multi_remove_handle(multi, curl);
+            mender_net_check_pinned_public_key(result);
+            for (size_t index = 0; index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS; index++) {
+                if (curl != ranges[index].curl) {
+                    continue;
+                }
+                ranges[index].done = true;
+                if ((0 == total) && (CURLE_OK != result) && (false == ranges[index].headers_done)) {
+                    mender_log_error("Unable to perform HTTP request: %s", curl_easy_strerror(result));
+                    callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                    ret = MENDER_FAIL;
+                    goto END;
+                } else if (0 == total) {
+                    ret = MENDER_NOT_IMPLEMENTED;
+                    goto END;
+                }
+                if ((CURLE_OK != result) || (ranges[index].received != ranges[index].length) || (ranges[index].total != total)) {
+                    mender_log_error("Unable to download range at offset %zu: %s", ranges[index].offset, curl_easy_strerror(result));
+                    callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                    ret = MENDER_FAIL;
+                    goto END;
+                }
+            }
+        }
+
+        /* Deliver the data in order, the connection of a range delivered entirely is used to request the next range */
+        while ((0 != total) && (false == done)) {
+            mender_http_range_t *range = &ranges[head];
+            while (range->delivered < range->received) {
+                size_t length = (range->received - range->delivered < recv_buf_length) ? (range->received - range->delivered) : recv_buf_length;
+                if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DATA_RECEIVED, range->buffer + range->delivered, length, params))) {
+                    if (MENDER_DONE != ret) {
+                        mender_log_error("Unable to perform HTTP request: An error occurred, stop reading data");
+                        callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                        ret = MENDER_FAIL;
+                        goto END;
+                    }
+                    ret = MENDER_OK;
+                    done = true;
+                    break;
+                }
+                range->delivered += length;
+            }
+            if ((true == done) || (false == range->done) || (range->delivered != range->length)) {
+                break;
+            }
+            range->length = 0;
+            if (next < total) {
+                size_t length
+                    = (total - next < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH) ? (total - next) : CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH;
+                if (MENDER_OK != (ret = mender_http_range_request(multi, range, url, next, length, recv_buf_length))) {
+                    mender_log_error("Unable to request range");
+                    callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+                    goto END;
+                }
+                next += length;
+            }
+            head = (head + 1) % CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS;
+            done = (0 == ranges[head].length);
+        }
+
+        /* Wait for activity on the connections */
+        if ((false == done) && (0 != running)) {
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+    }
+
+    /* Inform the upper layer that the download is done */
+    if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DISCONNECTED, NULL, 0, params))) {
+        mender_log_error("An error occurred");
+        goto END;
+    }
+
+END:
+
+    /* Release the clients and the buffers */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS; index++) {
+        if (NULL != ranges[index].curl) {
+            if (NULL != multi) {
+                curl_multi_remove_handle(multi, ranges[index].curl);
+            }
+            curl_easy_cleanup(ranges[index].curl);
+        }
+        if (NULL != ranges[index].buffer) {
+            mender_free(ranges[index].buffer);
+        }
+    }
+    if (NULL != multi) {
+        curl_multi_cleanup(multi);
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_http_range_request(CURLM *multi, mender_http_range_t *range, char *url, size_t offset, size_t length, size_t recv_buf_length) {
+
+    assert(NULL != multi);
+    assert(NULL != range);
+    assert(NULL != url);
+    CURLcode err;
+    char     value[48];
+
+    /* Create the client and the buffer on the first request */
+    if (NULL == range->curl) {
+        if ((NULL == (range->buffer = (char *)mender_malloc(CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_LENGTH)))
+            || (NULL == (range->curl = curl_easy_init()))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        if ((CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_URL, url)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_USERAGENT, MENDER_HTTP_USER_AGENT)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_BUFFERSIZE, (long)recv_buf_length)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_LOW_SPEED_LIMIT, 1L)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_LOW_SPEED_TIME, (long)CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_HEADERFUNCTION, &mender_http_range_header_callback)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_HEADERDATA, range)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_WRITEFUNCTION, &mender_http_range_write_callback)))
+            || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_WRITEDATA, range)))) {
+            mender_log_error("Unable to configure HTTP client: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
+        if (MENDER_OK != mender_net_set_share(range->curl)) {
+            mender_log_error("Unable to set share");
+            return MENDER_FAIL;
+        }
+    }
+    if (MENDER_OK != mender_net_set_pinned_public_key(range->curl)) {
+        mender_log_error("Unable to set pinned public key");
+        return MENDER_FAIL;
+    }
+
+    /* Request the range, the connection is reused if it is still alive */
+    range->offset       = offset;
+    range->length       = length;
+    range->received     = 0;
+    range->delivered    = 0;
+    range->total        = 0;
+    range->headers_done = false;
+    range->done         = false;
+    mender_http_stall_init(&range->stall);
+    snprintf(value, sizeof(value), "%zu-%zu", offset, offset + length - 1);
+    if (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_RANGE, value))) {
+        mender_log_error("Unable to set HTTP range: %s", curl_easy_strerror(err));
+        return MENDER_FAIL;
+    }
+    if (CURLM_OK != curl_multi_add_handle(multi, range->curl)) {
+        mender_log_error("Unable to add HTTP client");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static size_t
+mender_http_range_header_callback(char *buffer, size_t size, size_t nitems, void *params) {
+
+    assert(NULL != buffer);
+    assert(NULL != params);
+    mender_http_range_t *range    = (mender_http_range_t *)params;
+    size_t               realsize = size * nitems;
+
+    /* The headers of a previous response are discarded */
+    if ((realsize >= strlen("HTTP/")) && (0 == strncmp(buffer, "HTTP/", strlen("HTTP/")))) {
+        range->total        = 0;
+        range->headers_done = false;
+    }
+
+    /* Save the total length of the content if the Content-Range header matches the range, for example "Content-Range: bytes 0-1023/4096" */
+    if ((realsize > strlen("Content-Range:")) && (0 == strncasecmp(buffer, "Content-Range:", strlen("Content-Range:")))) {
+        char *value = buffer + strlen("Content-Range:");
+        while ((value < buffer + realsize) && ((' ' == *value) || ('\t' == *value))) {
+            value++;
+        }
+        char *slash = memchr(buffer, '/', realsize);
+        if ((value + strlen("bytes ") < buffer + realsize) && (0 == strncasecmp(value, "bytes ", strlen("bytes "))) && (NULL != slash)
+            && (range->offset == (size_t)strtoul(value + strlen("bytes "), NULL, 10))) {
+            range->total = (size_t)strtoul(slash + 1, NULL, 10);
+        }
+    }
+
+    /* The headers end with an empty line */
+    if ((realsize <= 2) && (realsize > 0) && (('\r' == buffer[0]) || ('\n' == buffer[0]))) {
+        range->headers_done = true;
+    }
+
+    return realsize;
+}
+
+static size_t
+mender_http_range_write_callback(char *data, size_t size, size_t nmemb, void *params) {
+
+    assert(NULL != params);
+    mender_http_range_t *range    = (mender_http_range_t *)params;
+    size_t               realsize = size * nmemb;
+
+    /* Only the range requested is accepted, the transfer is aborted otherwise */
+    long response_code;
+    if ((CURLE_OK != curl_easy_getinfo(range->curl, CURLINFO_RESPONSE_CODE, &response_code)) || (206 != response_code) || (0 == range->total)
+        || (range->received + realsize > range->length)) {
+        return 0;
+    }
+
+    /* Check the throughput, the transfer is aborted if it is stalled */
+    if (MENDER_OK != mender_http_stall_check(&range->stall, realsize)) {
+        return 0;
+    }
+
+    /* Buffer the data until the previous ranges are delivered */
+    memcpy(range->buffer + range->received, data, realsize);
+    range->received += realsize;
+
+    return realsize;
+}
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS > 1 */
+
+static char *
+mender_http_get_origin(char *url) {
+
+    assert(NULL != url);
+    char *origin;
+
+    /* The origin ends at the beginning of the path of the URL */
+    char *host = strstr(url, "://");
+    host       = (NULL != host) ? (host + strlen("://")) : url;
+    char *end  = strchr(host, '/');
+    if (NULL == (origin = mender_strndup(url, (NULL != end) ? (size_t)(end - url) : strlen(url)))) {
+        return NULL;
+    }
+
+    return origin;
+}
+
+static CURL *
+mender_http_connection_take(char *origin) {
+
+    assert(NULL != origin);
+    CURL *curl = NULL;
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return NULL;
+    }
+
+    /* Search a client kept alive with the server */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if ((NULL != mender_http_connections[index].origin) && (!strcmp(origin, mender_http_connections[index].origin))) {
+            curl = mender_http_connections[index].curl;
+            mender_free(mender_http_connections[index].origin);
+            mender_http_connections[index].origin = NULL;
+            mender_http_connections[index].curl   = NULL;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    return curl;
+}
+
+static void
+mender_http_connection_give(char *origin, CURL *curl) {
+
+    assert(NULL != origin);
+    assert(NULL != curl);
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        curl_easy_cleanup(curl);
+        mender_free(origin);
+        return;
+    }
+
+    /* Store the client in a free entry, the client of the last entry is released if all the entries are used */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if ((NULL == mender_http_connections[index].origin) || (CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS == index + 1)) {
+            if (NULL != mender_http_connections[index].origin) {
+                curl_easy_cleanup(mender_http_connections[index].curl);
+                mender_free(mender_http_connections[index].origin);
+            }
+            mender_http_connections[index].origin = origin;
+            mender_http_connections[index].curl   = curl;
+            origin                                = NULL;
+            curl                                  = NULL;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    /* Release the client if it has not been stored */
+    if (NULL != curl) {
+        curl_easy_cleanup(curl);
+        mender_free(origin);
+    }
+}
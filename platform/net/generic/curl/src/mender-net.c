@@ -0,0 +1,186 @@
+/**
+ * @file      mender-net.c
+ * @brief     Mender network common file for curl platform
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include "mender-log.h"
+#include "mender-net.h"
+
+/**
+ * @brief Default lifetime of the addresses in the DNS cache (seconds)
+ */
+#ifndef CONFIG_MENDER_NET_DNS_CACHE_TTL
+#define CONFIG_MENDER_NET_DNS_CACHE_TTL (300)
+#endif /* CONFIG_MENDER_NET_DNS_CACHE_TTL */
+
+/**
+ * @brief DNS cache, TLS sessions and connections shared by the clients, and mutexes of each shared data
+ */
+static CURLSH         *mender_net_share = NULL;
+static pthread_mutex_t mender_net_share_mutexes[CURL_LOCK_DATA_LAST];
+static pthread_once_t  mender_net_share_once = PTHREAD_ONCE_INIT;
+
+#ifdef CONFIG_MENDER_NET_PINNED_PUBLIC_KEY
+
+/**
+ * @brief Flag set when the public key of the server does not match the pinned public keys, the chain of certificates is verified
+ */
+static bool mender_net_pinned_public_key_disabled = false;
+
+#endif /* CONFIG_MENDER_NET_PINNED_PUBLIC_KEY */
+
+/**
+ * @brief Create the share object holding the DNS cache, the TLS sessions and the connections
+ */
+static void mender_net_share_init(void);
+
+/**
+ * @brief Share lock callback, used to protect access to the DNS cache
+ * @param curl Client
+ * @param data Data to lock
+ * @param access Access mode
+ * @param params User data
+ */
+static void mender_net_share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *params);
+
+/**
+ * @brief Share unlock callback
+ * @param curl Client
+ * @param data Data to unlock
+ * @param params User data
+ */
+static void mender_net_share_unlock(CURL *curl, curl_lock_data data, void *params);
+
+mender_err_t
+mender_net_set_share(CURL *curl) {
+
+    assert(NULL != curl);
+    CURLcode err;
+
+    /* Create the share object on the first call */
+    pthread_once(&mender_net_share_once, &mender_net_share_init);
+    if (NULL == mender_net_share) {
+        mender_log_error("Unable to create share");
+        return MENDER_FAIL;
+    }
+
+    /* Set the share object and the lifetime of the addresses in the DNS cache */
+    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_SHARE, mender_net_share))) {
+        mender_log_error("Unable to set share: %s", curl_easy_strerror(err));
+        return MENDER_FAIL;
+    }
+    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)CONFIG_MENDER_NET_DNS_CACHE_TTL))) {
+        mender_log_error("Unable to set DNS cache timeout: %s", curl_easy_strerror(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_net_set_pinned_public_key(CURL *curl) {
+
+    assert(NULL != curl);
+
+#ifdef CONFIG_MENDER_NET_PINNED_PUBLIC_KEY
+    CURLcode err;
+
+    /* The public key of the server is checked without verifying the chain of certificates until it does not match */
+    if (false == __atomic_load_n(&mender_net_pinned_public_key_disabled, __ATOMIC_RELAXED)) {
+        if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_PINNEDPUBLICKEY, CONFIG_MENDER_NET_PINNED_PUBLIC_KEY))) {
+            mender_log_error("Unable to set pinned public key: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
+        if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L))) {
+            mender_log_error("Unable to disable verification of the certificates: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
+    } else {
+        if ((CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_PINNEDPUBLICKEY, NULL)))
+            || (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L)))) {
+            mender_log_error("Unable to enable verification of the certificates: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
+    }
+#endif /* CONFIG_MENDER_NET_PINNED_PUBLIC_KEY */
+
+    return MENDER_OK;
+}
+
+void
+mender_net_check_pinned_public_key(CURLcode result) {
+
+#ifdef CONFIG_MENDER_NET_PINNED_PUBLIC_KEY
+    /* Fall back to the verification of the chain of certificates, the server key has been renewed for example */
+    if ((CURLE_SSL_PINNEDPUBKEYNOTMATCH == result) && (false == __atomic_exchange_n(&mender_net_pinned_public_key_disabled, true, __ATOMIC_RELAXED))) {
+        mender_log_warning("Public key of the server does not match the pinned public keys, the chain of certificates is now verified");
+    }
+#else
+    (void)result;
+#endif /* CONFIG_MENDER_NET_PINNED_PUBLIC_KEY */
+}
+
+static void
+mender_net_share_init(void) {
+
+    CURLSH *share;
+
+    /* Initialize the mutexes, each shared data has its own lock because libcurl may lock several of them at once */
+    for (size_t index = 0; index < CURL_LOCK_DATA_LAST; index++) {
+        pthread_mutex_init(&mender_net_share_mutexes[index], NULL);
+    }
+
+    /* Create the share object, the DNS cache is required, the TLS sessions and the connections are shared if the TLS backend and libcurl support it */
+    if (NULL == (share = curl_share_init())) {
+        return;
+    }
+    if ((CURLSHE_OK != curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &mender_net_share_lock))
+        || (CURLSHE_OK != curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &mender_net_share_unlock))
+        || (CURLSHE_OK != curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS))) {
+        curl_share_cleanup(share);
+        return;
+    }
+    if (CURLSHE_OK != curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION)) {
+        mender_log_warning("Unable to share TLS sessions, the TLS sessions are not resumed between the clients");
+    }
+    if (CURLSHE_OK != curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT)) {
+        mender_log_warning("Unable to share connections, the connections are not reused between the clients");
+    }
+    mender_net_share = share;
+}
+
+static void
+mender_net_share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *params) {
+
+    (void)curl;
+    (void)access;
+    (void)params;
+
+    /* Take mutex used to protect access to the shared data */
+    pthread_mutex_lock(&mender_net_share_mutexes[(data < CURL_LOCK_DATA_LAST) ? data : CURL_LOCK_DATA_SHARE]);
+}
+
+static void
+mender_net_share_unlock(CURL *curl, curl_lock_data data, void *params) {
+
+    (void)curl;
+    (void)params;
+
+    /* Release mutex used to protect access to the shared data */
+    pthread_mutex_unlock(&mender_net_share_mutexes[(data < CURL_LOCK_DATA_LAST) ? data : CURL_LOCK_DATA_SHARE]);
+}
@@ -17,9 +17,16 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
 #include <curl/curl.h>
+#include <poll.h>
 #include <pthread.h>
 #include "mender-log.h"
+#include "mender-net.h"
 #include "mender-utils.h"
 #include "mender-websocket.h"
 
@@ -37,6 +44,20 @@
 #define CONFIG_MENDER_WEBSOCKET_THREAD_PRIORITY (0)
 #endif /* CONFIG_MENDER_WEBSOCKET_THREAD_PRIORITY */
 
+/**
+ * @brief Websocket send timeout (ms), maximum time waiting for the socket to be writable when the event loop is used
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_SEND_TIMEOUT
+#define CONFIG_MENDER_WEBSOCKET_SEND_TIMEOUT (5000)
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_TIMEOUT */
+
+/**
+ * @brief Websocket event loop poll interval (ms), the event loop is woken up when a connection is added or removed
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_POLL_INTERVAL
+#define CONFIG_MENDER_WEBSOCKET_POLL_INTERVAL (1000)
+#endif /* CONFIG_MENDER_WEBSOCKET_POLL_INTERVAL */
+
 /**
  * @brief Websocket buffer size (kB)
  */
@@ -44,6 +65,13 @@
 #define CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE (64)
 #endif /* CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE */
 
+/**
+ * @brief Websocket maximum message size (kB), larger messages are discarded
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX
+#define CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX (1024)
+#endif /* CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX */
+
 /**
  * @brief WebSocket User-Agent
  */
@@ -56,13 +84,23 @@
 /**
  * @brief Websocket handle
  */
-typedef struct {
+typedef struct mender_websocket_handle_s {
     CURL              *client;        /**< Websocket client handle */
-    void              *data;          /**< Websocket data received from the server */
+    void              *data;          /**< Websocket data received from the server, the buffer is reused for all the fragmented messages */
     size_t             data_len;      /**< Websocket data length received from the server */
+    size_t             data_size;     /**< Websocket data buffer size, grown up to the maximum message size */
+    bool               discard;       /**< Flag used to indicate the message being received is discarded */
     struct curl_slist *headers;       /**< Websocket client headers */
-    pthread_t          thread_handle; /**< Websocket thread handle */
-    bool               abort;         /**< Flag used to indicate connection should be terminated */
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+    curl_socket_t                     socket;   /**< Websocket socket, CURL_SOCKET_BAD until the connection is established */
+    bool                              added;    /**< Flag used to indicate the client is performed by the multi handle of the event loop */
+    bool                              closed;   /**< Flag used to indicate the connection is closed */
+    bool                              released; /**< Flag used to indicate the event loop has released the handle */
+    struct mender_websocket_handle_s *next;     /**< Next websocket handle served by the event loop */
+#else
+    pthread_t thread_handle; /**< Websocket thread handle */
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+    bool abort; /**< Flag used to indicate connection should be terminated */
     mender_err_t (*callback)(mender_websocket_client_event_t,
                              void *,
                              size_t,
@@ -75,6 +113,23 @@ typedef struct {
  */
 static mender_websocket_config_t mender_websocket_config;
 
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+/**
+ * @brief Websocket event loop, all the connections are served by a single I/O thread
+ */
+static struct {
+    CURLM                     *multi;         /**< Multi handle performing the connections being established */
+    mender_websocket_handle_t *handles;       /**< List of the websocket handles served by the event loop */
+    pthread_mutex_t            mutex;         /**< Mutex used to protect access to the handles, recursive so that the callbacks can send data */
+    pthread_cond_t             cond;          /**< Condition used to inform a handle has been released */
+    pthread_t                  thread_handle; /**< Event loop thread handle */
+    void                      *buffer;        /**< Reception buffer shared by all the connections */
+    bool                       exit;          /**< Flag used to indicate the event loop should be terminated */
+} mender_websocket_loop;
+
+#else
+
 /**
  * @brief Websocket PREREQ callback, used to inform the client is connected to the server
  * @param params User data
@@ -96,6 +151,64 @@ static int mender_websocket_prereq_callback(void *params, char *conn_primary_ip,
  */
 static size_t mender_websocket_write_callback(char *data, size_t size, size_t nmemb, void *params);
 
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+
+/**
+ * @brief Treatment of the data received from the server, the fragmented messages are reassembled before invoking the callback
+ * @param handle Websocket handle
+ * @param frame Meta data of the frame being received
+ * @param data Data received
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise meaning the reception of data should be stopped
+ */
+static mender_err_t mender_websocket_dispatch(mender_websocket_handle_t *handle, const struct curl_ws_frame *frame, void *data, size_t length);
+
+/**
+ * @brief Grow the buffer used to reassemble the fragmented messages so that the message being received fits
+ * @param handle Websocket handle
+ * @param length Length of the message being received
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_websocket_grow(mender_websocket_handle_t *handle, size_t length);
+
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+/**
+ * @brief Send a frame over the websocket connection, waiting for the socket to be writable if required
+ * @param handle Websocket handle
+ * @param payload Payload to send
+ * @param length Length of the payload
+ * @param flags Frame flags
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_websocket_send_frame(mender_websocket_handle_t *handle, void *payload, size_t length, unsigned int flags);
+
+/**
+ * @brief Close the connection and invoke the disconnected callback, the handle is kept until it is disconnected
+ * @param handle Websocket handle
+ */
+static void mender_websocket_loop_close(mender_websocket_handle_t *handle);
+
+/**
+ * @brief Treatment of the connections which are established or failed
+ */
+static void mender_websocket_loop_connected(void);
+
+/**
+ * @brief Reception of all the data available on the connection
+ * @param handle Websocket handle
+ */
+static void mender_websocket_loop_receive(mender_websocket_handle_t *handle);
+
+/**
+ * @brief Event loop thread used to perform connection and reception of data of all the websocket connections
+ * @param arg Not used
+ * @return Not used
+ */
+static void *mender_websocket_loop_thread(void *arg);
+
+#else
+
 /**
  * @brief Thread used to perform connection and reception of data
  * @param arg Websocket handle
@@ -103,6 +216,8 @@ static size_t mender_websocket_write_callback(char *data, size_t size, size_t nm
  */
 static void *mender_websocket_thread(void *arg);
 
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+
 mender_err_t
 mender_websocket_init(mender_websocket_config_t *config) {
 
@@ -115,7 +230,84 @@ mender_websocket_init(mender_websocket_config_t *config) {
     /* Initialization of curl */
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+    mender_err_t        ret = MENDER_OK;
+    int                 err_pthread;
+    pthread_mutexattr_t pthread_mutexattr;
+    pthread_attr_t      pthread_attr;
+
+    /* Check if the event loop is already started */
+    if (NULL != mender_websocket_loop.multi) {
+        return MENDER_OK;
+    }
+    memset(&mender_websocket_loop, 0, sizeof(mender_websocket_loop));
+
+    /* Create the multi handle and the reception buffer shared by all the connections */
+    if (NULL == (mender_websocket_loop.multi = curl_multi_init())) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (NULL == (mender_websocket_loop.buffer = mender_malloc(CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Create the mutex and the condition */
+    pthread_mutexattr_init(&pthread_mutexattr);
+    pthread_mutexattr_settype(&pthread_mutexattr, PTHREAD_MUTEX_RECURSIVE);
+    err_pthread = pthread_mutex_init(&mender_websocket_loop.mutex, &pthread_mutexattr);
+    pthread_mutexattr_destroy(&pthread_mutexattr);
+    if (0 != err_pthread) {
+        mender_log_error("Unable to initialize websocket event loop mutex (ret=%d)", err_pthread);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    pthread_cond_init(&mender_websocket_loop.cond, NULL);
+
+    /* Create and start event loop thread */
+    if (0 != (err_pthread = pthread_attr_init(&pthread_attr))) {
+        mender_log_error("Unable to initialize websocket thread attributes (ret=%d)", err_pthread);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (0
+        != (err_pthread = pthread_attr_setstacksize(
+                &pthread_attr, ((CONFIG_MENDER_WEBSOCKET_THREAD_STACK_SIZE > 16) ? CONFIG_MENDER_WEBSOCKET_THREAD_STACK_SIZE : 16) * 1024))) {
+        mender_log_error("Unable to set websocket thread stack size (ret=%d)", err_pthread);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (0 != (err_pthread = pthread_create(&mender_websocket_loop.thread_handle, &pthread_attr, mender_websocket_loop_thread, NULL))) {
+        mender_log_error("Unable to create websocket thread (ret=%d)", err_pthread);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (0 != (err_pthread = pthread_setschedprio(mender_websocket_loop.thread_handle, CONFIG_MENDER_WEBSOCKET_THREAD_PRIORITY))) {
+        mender_log_warning("Unable to set websocket thread priority (ret=%d)", err_pthread);
+    }
+
     return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    curl_multi_cleanup(mender_websocket_loop.multi);
+    mender_websocket_loop.multi = NULL;
+    if (NULL != mender_websocket_loop.buffer) {
+        mender_free(mender_websocket_loop.buffer);
+        mender_websocket_loop.buffer = NULL;
+    }
+
+    return ret;
+
+#else
+
+    return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
 }
 
 mender_err_t
@@ -125,14 +317,16 @@ mender_websocket_connect(
     assert(NULL != path);
     assert(NULL != callback);
     assert(NULL != handle);
-    CURLcode     err_curl;
-    int          err_pthread;
+    CURLcode err_curl;
+#ifndef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+    int err_pthread;
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
     mender_err_t ret    = MENDER_OK;
     char        *url    = NULL;
     char        *bearer = NULL;
 
     /* Allocate a new handle */
-    if (NULL == (*handle = malloc(sizeof(mender_websocket_handle_t)))) {
+    if (NULL == (*handle = mender_malloc(sizeof(mender_websocket_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -147,7 +341,7 @@ mender_websocket_connect(
     if ((false == mender_utils_strbeginwith(path, "ws://")) && (false == mender_utils_strbeginwith(path, "wss://"))) {
         if ((true == mender_utils_strbeginwith(path, "http://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "http://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("http://") + strlen("ws://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -155,7 +349,7 @@ mender_websocket_connect(
             snprintf(url, str_length, "ws://%s%s", mender_websocket_config.host + strlen("http://"), path);
         } else if ((true == mender_utils_strbeginwith(path, "https://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "https://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("https://") + strlen("wss://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -163,7 +357,7 @@ mender_websocket_connect(
             snprintf(url, str_length, "wss://%s%s", mender_websocket_config.host + strlen("https://"), path);
         } else {
             size_t str_length = strlen(mender_websocket_config.host) + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -188,21 +382,19 @@ mender_websocket_connect(
     if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_USERAGENT, MENDER_WEBSOCKET_USER_AGENT))) {
         mender_log_error("Unable to set HTTP User-Agent: %s", curl_easy_strerror(err_curl));
         ret = MENDER_FAIL;
-        goto END;
+        goto FAIL;
     }
     if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2))) {
         mender_log_error("Unable to set TLSv1.2: %s", curl_easy_strerror(err_curl));
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_PREREQFUNCTION, &mender_websocket_prereq_callback))) {
-        mender_log_error("Unable to set websocket PREREQ function: %s", curl_easy_strerror(err_curl));
-        ret = MENDER_FAIL;
+    if (MENDER_OK != (ret = mender_net_set_share(((mender_websocket_handle_t *)*handle)->client))) {
+        mender_log_error("Unable to set share");
         goto FAIL;
     }
-    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_PREREQDATA, *handle))) {
-        mender_log_error("Unable to set websocket PREREQ data: %s", curl_easy_strerror(err_curl));
-        ret = MENDER_FAIL;
+    if (MENDER_OK != (ret = mender_net_set_pinned_public_key(((mender_websocket_handle_t *)*handle)->client))) {
+        mender_log_error("Unable to set pinned public key");
         goto FAIL;
     }
     if (CURLE_OK
@@ -211,6 +403,28 @@ mender_websocket_connect(
         ret = MENDER_FAIL;
         goto FAIL;
     }
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_CONNECT_ONLY, 2L))) {
+        mender_log_error("Unable to set websocket connect only: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_PRIVATE, *handle))) {
+        mender_log_error("Unable to set websocket private data: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+#else
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_PREREQFUNCTION, &mender_websocket_prereq_callback))) {
+        mender_log_error("Unable to set websocket PREREQ function: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_PREREQDATA, *handle))) {
+        mender_log_error("Unable to set websocket PREREQ data: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
     if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_WRITEFUNCTION, &mender_websocket_write_callback))) {
         mender_log_error("Unable to set websocket write function: %s", curl_easy_strerror(err_curl));
         ret = MENDER_FAIL;
@@ -221,9 +435,10 @@ mender_websocket_connect(
         ret = MENDER_FAIL;
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
     if (NULL != jwt) {
         size_t str_length = strlen("Authorization: Bearer ") + strlen(jwt) + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -241,6 +456,18 @@ mender_websocket_connect(
         }
     }
 
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+    /* Add the handle to the event loop, the connection is performed by the event loop thread */
+    ((mender_websocket_handle_t *)*handle)->socket = CURL_SOCKET_BAD;
+    pthread_mutex_lock(&mender_websocket_loop.mutex);
+    ((mender_websocket_handle_t *)*handle)->next = mender_websocket_loop.handles;
+    mender_websocket_loop.handles                = *handle;
+    pthread_mutex_unlock(&mender_websocket_loop.mutex);
+    curl_multi_wakeup(mender_websocket_loop.multi);
+
+#else
+
     /* Create and start websocket thread */
     pthread_attr_t pthread_attr;
     if (0 != (err_pthread = pthread_attr_init(&pthread_attr))) {
@@ -266,6 +493,8 @@ mender_websocket_connect(
         goto FAIL;
     }
 
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+
     goto END;
 
 FAIL:
@@ -273,8 +502,8 @@ FAIL:
     /* Release memory */
     if (NULL != *handle) {
         curl_easy_cleanup(((mender_websocket_handle_t *)*handle)->client);
-        curl_slist_free_all(((mender_websocket_handle_t *)handle)->headers);
-        free(*handle);
+        curl_slist_free_all(((mender_websocket_handle_t *)*handle)->headers);
+        mender_free(*handle);
         *handle = NULL;
     }
 
@@ -282,10 +511,10 @@ END:
 
     /* Release memory */
     if (NULL != bearer) {
-        free(bearer);
+        mender_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_free(url);
     }
 
     return ret;
@@ -296,6 +525,14 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
 
     assert(NULL != handle);
     assert(NULL != payload);
+
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+    /* Send binary payload */
+    return mender_websocket_send_frame((mender_websocket_handle_t *)handle, payload, length, CURLWS_BINARY);
+
+#else
+
     CURLcode err;
     size_t   sent = 0;
 
@@ -306,12 +543,61 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     }
 
     return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+}
+
+mender_err_t
+mender_websocket_ping(void *handle) {
+
+    assert(NULL != handle);
+
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+    /* Send ping */
+    return mender_websocket_send_frame((mender_websocket_handle_t *)handle, "", 0, CURLWS_PING);
+
+#else
+
+    CURLcode err;
+    size_t   sent = 0;
+
+    /* Send ping */
+    if (CURLE_OK != (err = curl_ws_send(((mender_websocket_handle_t *)handle)->client, "", 0, &sent, 0, CURLWS_PING))) {
+        mender_log_error("Unable to send ping over websocket connection: %s", curl_easy_strerror(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
 }
 
 mender_err_t
 mender_websocket_disconnect(void *handle) {
 
     assert(NULL != handle);
+
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+    /* Close websocket connection, the connection is released by the event loop thread */
+    pthread_mutex_lock(&mender_websocket_loop.mutex);
+    if ((CURL_SOCKET_BAD != ((mender_websocket_handle_t *)handle)->socket) && (false == ((mender_websocket_handle_t *)handle)->closed)) {
+        if (MENDER_OK != mender_websocket_send_frame((mender_websocket_handle_t *)handle, NULL, 0, CURLWS_CLOSE)) {
+            mender_log_error("Unable to send close payload");
+        }
+    }
+    ((mender_websocket_handle_t *)handle)->abort = true;
+    curl_multi_wakeup(mender_websocket_loop.multi);
+
+    /* Wait the handle is released by the event loop thread */
+    while (false == ((mender_websocket_handle_t *)handle)->released) {
+        pthread_cond_wait(&mender_websocket_loop.cond, &mender_websocket_loop.mutex);
+    }
+    pthread_mutex_unlock(&mender_websocket_loop.mutex);
+
+#else
+
     CURLcode err;
     size_t   sent = 0;
 
@@ -325,13 +611,15 @@ mender_websocket_disconnect(void *handle) {
     /* Wait end of execution of the websocket thread */
     pthread_join(((mender_websocket_handle_t *)handle)->thread_handle, NULL);
 
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+
     /* Release memory */
     curl_easy_cleanup(((mender_websocket_handle_t *)handle)->client);
     curl_slist_free_all(((mender_websocket_handle_t *)handle)->headers);
     if (NULL != ((mender_websocket_handle_t *)handle)->data) {
-        free(((mender_websocket_handle_t *)handle)->data);
+        mender_free(((mender_websocket_handle_t *)handle)->data);
     }
-    free(handle);
+    mender_free(handle);
 
     return MENDER_OK;
 }
@@ -339,12 +627,35 @@ mender_websocket_disconnect(void *handle) {
 mender_err_t
 mender_websocket_exit(void) {
 
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+    /* Stop the event loop thread, all the connections should be disconnected */
+    if (NULL != mender_websocket_loop.multi) {
+        pthread_mutex_lock(&mender_websocket_loop.mutex);
+        mender_websocket_loop.exit = true;
+        pthread_mutex_unlock(&mender_websocket_loop.mutex);
+        curl_multi_wakeup(mender_websocket_loop.multi);
+        pthread_join(mender_websocket_loop.thread_handle, NULL);
+
+        /* Release memory */
+        curl_multi_cleanup(mender_websocket_loop.multi);
+        mender_websocket_loop.multi = NULL;
+        mender_free(mender_websocket_loop.buffer);
+        mender_websocket_loop.buffer = NULL;
+        pthread_cond_destroy(&mender_websocket_loop.cond);
+        pthread_mutex_destroy(&mender_websocket_loop.mutex);
+    }
+
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+
     /* Cleaning */
     curl_global_cleanup();
 
     return MENDER_OK;
 }
 
+#ifndef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
 static int
 mender_websocket_prereq_callback(void *params, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port, int conn_local_port) {
 
@@ -371,57 +682,347 @@ mender_websocket_write_callback(char *data, size_t size, size_t nmemb, void *par
     mender_websocket_handle_t *handle   = (mender_websocket_handle_t *)params;
     size_t                     realsize = size * nmemb;
 
-    /* Get meta data */
-    const struct curl_ws_frame *frame = curl_ws_meta(handle->client);
+    /* Get meta data and treat the data received */
+    if (MENDER_OK != mender_websocket_dispatch(handle, curl_ws_meta(handle->client), data, realsize)) {
+        return 0;
+    }
+
+    return realsize;
+}
+
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
+
+static mender_err_t
+mender_websocket_dispatch(mender_websocket_handle_t *handle, const struct curl_ws_frame *frame, void *data, size_t length) {
+
+    assert(NULL != handle);
+
+    /* Report the pings and the pongs, curl answers the pings of the server */
+    if ((NULL != frame) && (0 != (frame->flags & (CURLWS_PING | CURLWS_PONG)))) {
+        if (0 == frame->bytesleft) {
+            handle->callback(MENDER_WEBSOCKET_EVENT_HEARTBEAT, NULL, 0, handle->params);
+        }
+        return MENDER_OK;
+    }
 
     /* Check size received */
-    if ((realsize > 0) && (NULL != frame)) {
+    if ((length > 0) && (NULL != frame)) {
 
         /* Check if the whole packet is received once */
-        if ((NULL == handle->data) && (0 == frame->bytesleft)) {
+        if ((0 == handle->data_len) && (false == handle->discard) && (0 == frame->bytesleft)) {
 
             /* Invoke callback */
-            if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, data, realsize, handle->params)) {
+            if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, data, length, handle->params)) {
                 mender_log_error("An error occurred");
             }
 
+        } else if (true == handle->discard) {
+
+            /* Discard the data until the end of the message */
+            handle->discard = (0 != frame->bytesleft);
+
         } else {
 
-            /* Concatenate data */
-            void *tmp = realloc(handle->data, handle->data_len + realsize);
-            if (NULL == tmp) {
-                mender_log_error("Unable to allocate memory");
-                if (NULL != handle->data) {
-                    free(handle->data);
-                    handle->data     = NULL;
-                    handle->data_len = 0;
-                }
-                return 0;
+            /* Grow the buffer to the size of the whole message if it does not fit, it is reused for the next messages */
+            if ((handle->data_len + length > handle->data_size)
+                && (MENDER_OK != mender_websocket_grow(handle, handle->data_len + length + (size_t)frame->bytesleft))) {
+                handle->data_len = 0;
+                handle->discard  = (0 != frame->bytesleft);
+                return MENDER_OK;
             }
-            handle->data = tmp;
-            memcpy(handle->data + handle->data_len, data, realsize);
-            handle->data_len += realsize;
+
+            /* Concatenate data */
+            memcpy((uint8_t *)handle->data + handle->data_len, data, length);
+            handle->data_len += length;
 
             /* Check if the whole packet has been received */
-            if ((NULL != handle->data) && (0 == frame->bytesleft)) {
+            if (0 == frame->bytesleft) {
+
+                /* The buffer is reused for the next message */
+                size_t message_length = handle->data_len;
+                handle->data_len      = 0;
 
                 /* Invoke callback */
-                if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, handle->data, handle->data_len, handle->params)) {
+                if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, handle->data, message_length, handle->params)) {
                     mender_log_error("An error occurred, stop reading data");
-                    return 0;
+                    return MENDER_FAIL;
                 }
+            }
+        }
+    }
 
-                /* Release memory */
-                free(handle->data);
-                handle->data     = NULL;
-                handle->data_len = 0;
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_websocket_grow(mender_websocket_handle_t *handle, size_t length) {
+
+    assert(NULL != handle);
+    void *tmp;
+
+    /* Check the size of the message, the buffer is not grown beyond the maximum message size */
+    if (length > CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX * 1024) {
+        mender_log_error("Message is too large, it is discarded");
+        return MENDER_FAIL;
+    }
+
+    /* Grow the buffer to the size of the whole message so that it is reallocated at most once per message */
+    if (NULL == (tmp = mender_realloc(handle->data, length))) {
+        mender_log_error("Unable to allocate memory, the message is discarded");
+        return MENDER_FAIL;
+    }
+    handle->data      = tmp;
+    handle->data_size = length;
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_WEBSOCKET_EVENT_LOOP
+
+static mender_err_t
+mender_websocket_send_frame(mender_websocket_handle_t *handle, void *payload, size_t length, unsigned int flags) {
+
+    assert(NULL != handle);
+    mender_err_t  ret    = MENDER_OK;
+    size_t        offset = 0;
+    size_t        sent;
+    CURLcode      err;
+    struct pollfd pollfd;
+
+    /* Check if the connection is established, the client is performed by the event loop thread until then */
+    pthread_mutex_lock(&mender_websocket_loop.mutex);
+    if ((CURL_SOCKET_BAD == handle->socket) || (true == handle->closed)) {
+        mender_log_error("Websocket connection is not established");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Send the frame, the remaining payload is given again until the whole frame is sent */
+    do {
+        sent = 0;
+        if (CURLE_AGAIN == (err = curl_ws_send(handle->client, (uint8_t *)payload + offset, length - offset, &sent, 0, flags))) {
+
+            /* Wait for the socket to be writable, the same payload is given again */
+            pollfd.fd      = handle->socket;
+            pollfd.events  = POLLOUT;
+            pollfd.revents = 0;
+            if (poll(&pollfd, 1, CONFIG_MENDER_WEBSOCKET_SEND_TIMEOUT) <= 0) {
+                mender_log_error("Unable to send data over websocket connection: timeout");
+                ret = MENDER_FAIL;
+                goto END;
             }
+            continue;
         }
+        if (CURLE_OK != err) {
+            mender_log_error("Unable to send data over websocket connection: %s", curl_easy_strerror(err));
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        offset += sent;
+    } while (offset < length);
+
+END:
+
+    pthread_mutex_unlock(&mender_websocket_loop.mutex);
+
+    return ret;
+}
+
+static void
+mender_websocket_loop_close(mender_websocket_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Invoke disconnected callback once */
+    if (false == handle->closed) {
+        handle->closed = true;
+        handle->callback(MENDER_WEBSOCKET_EVENT_DISCONNECTED, NULL, 0, handle->params);
     }
+}
 
-    return realsize;
+static void
+mender_websocket_loop_connected(void) {
+
+    CURLMsg                   *msg;
+    int                        queued;
+    CURLcode                   result;
+    mender_websocket_handle_t *handle;
+
+    /* Check the connections which are completed */
+    while (NULL != (msg = curl_multi_info_read(mender_websocket_loop.multi, &queued))) {
+        if (CURLMSG_DONE != msg->msg) {
+            continue;
+        }
+        result = msg->data.result;
+        if ((CURLE_OK != curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&handle)) || (NULL == handle)) {
+            continue;
+        }
+
+        /* The connection is established, the client is removed from the multi handle and is then used to send and receive frames */
+        curl_multi_remove_handle(mender_websocket_loop.multi, handle->client);
+        handle->added = false;
+        mender_net_check_pinned_public_key(result);
+        if (CURLE_OK != result) {
+            mender_log_error("Unable to perform websocket request: %s", curl_easy_strerror(result));
+            mender_websocket_loop_close(handle);
+            continue;
+        }
+        if ((CURLE_OK != curl_easy_getinfo(handle->client, CURLINFO_ACTIVESOCKET, &handle->socket)) || (CURL_SOCKET_BAD == handle->socket)) {
+            mender_log_error("Unable to retrieve websocket socket");
+            handle->socket = CURL_SOCKET_BAD;
+            mender_websocket_loop_close(handle);
+            continue;
+        }
+
+        /* Invoke connected callback */
+        if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_CONNECTED, NULL, 0, handle->params)) {
+            mender_log_error("An error occurred");
+            mender_websocket_loop_close(handle);
+        }
+    }
+}
+
+static void
+mender_websocket_loop_receive(mender_websocket_handle_t *handle) {
+
+    assert(NULL != handle);
+    CURLcode              err;
+    size_t                received;
+    struct curl_ws_frame *frame;
+
+    /* Read until no more data is available, curl answers the pings of the server */
+    while ((false == handle->abort) && (false == handle->closed)) {
+        received = 0;
+        frame    = NULL;
+        err      = curl_ws_recv(handle->client, mender_websocket_loop.buffer, CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024, &received, &frame);
+        if (CURLE_AGAIN == err) {
+            break;
+        }
+        if (CURLE_OK != err) {
+            mender_log_error("Unable to receive data over websocket connection: %s", curl_easy_strerror(err));
+            mender_websocket_loop_close(handle);
+            break;
+        }
+        if ((NULL != frame) && (0 != (frame->flags & CURLWS_CLOSE))) {
+            mender_log_error("Connection has been closed");
+            mender_websocket_loop_close(handle);
+            break;
+        }
+        if (MENDER_OK != mender_websocket_dispatch(handle, frame, mender_websocket_loop.buffer, received)) {
+            mender_websocket_loop_close(handle);
+            break;
+        }
+    }
 }
 
+__attribute__((noreturn)) static void *
+mender_websocket_loop_thread(void *arg) {
+
+    (void)arg;
+    mender_websocket_handle_t **next;
+    mender_websocket_handle_t  *handle;
+    struct curl_waitfd         *fds     = NULL;
+    mender_websocket_handle_t **polled  = NULL;
+    size_t                      size    = 0;
+    size_t                      count   = 0;
+    int                         running = 0;
+    CURLMcode                   err;
+
+    pthread_mutex_lock(&mender_websocket_loop.mutex);
+    while (false == mender_websocket_loop.exit) {
+
+        /* Release the handles being disconnected and add the new ones to the multi handle */
+        next = &mender_websocket_loop.handles;
+        while (NULL != (handle = *next)) {
+            if (true == handle->abort) {
+                if (true == handle->added) {
+                    curl_multi_remove_handle(mender_websocket_loop.multi, handle->client);
+                    handle->added = false;
+                }
+                mender_websocket_loop_close(handle);
+                *next            = handle->next;
+                handle->released = true;
+                pthread_cond_broadcast(&mender_websocket_loop.cond);
+                continue;
+            }
+            if ((CURL_SOCKET_BAD == handle->socket) && (false == handle->added) && (false == handle->closed)) {
+                if (CURLM_OK != (err = curl_multi_add_handle(mender_websocket_loop.multi, handle->client))) {
+                    mender_log_error("Unable to add websocket client to the event loop: %s", curl_multi_strerror(err));
+                    mender_websocket_loop_close(handle);
+                } else {
+                    handle->added = true;
+                }
+            }
+            next = &handle->next;
+        }
+
+        /* Perform the connections being established */
+        curl_multi_perform(mender_websocket_loop.multi, &running);
+        mender_websocket_loop_connected();
+
+        /* Prepare the sockets of the established connections, the arrays are grown to the number of connections */
+        for (handle = mender_websocket_loop.handles, count = 0; NULL != handle; handle = handle->next) {
+            if ((CURL_SOCKET_BAD != handle->socket) && (false == handle->closed)) {
+                count++;
+            }
+        }
+        if (count > size) {
+            struct curl_waitfd         *tmp_fds;
+            mender_websocket_handle_t **tmp_polled;
+            if (NULL != (tmp_fds = mender_realloc(fds, count * sizeof(struct curl_waitfd)))) {
+                fds = tmp_fds;
+            }
+            if (NULL != (tmp_polled = mender_realloc(polled, count * sizeof(mender_websocket_handle_t *)))) {
+                polled = tmp_polled;
+            }
+            if ((NULL == tmp_fds) || (NULL == tmp_polled)) {
+                mender_log_error("Unable to allocate memory");
+                count = size;
+            } else {
+                size = count;
+            }
+        }
+        count = 0;
+        for (handle = mender_websocket_loop.handles; (NULL != handle) && (count < size); handle = handle->next) {
+            if ((CURL_SOCKET_BAD != handle->socket) && (false == handle->closed)) {
+                fds[count].fd      = handle->socket;
+                fds[count].events  = CURL_WAIT_POLLIN;
+                fds[count].revents = 0;
+                polled[count]      = handle;
+                count++;
+            }
+        }
+
+        /* Wait for activity on the sockets, the handles are released only by this thread so they are still valid after the wait */
+        pthread_mutex_unlock(&mender_websocket_loop.mutex);
+        if (CURLM_OK != (err = curl_multi_poll(mender_websocket_loop.multi, fds, (unsigned int)count, CONFIG_MENDER_WEBSOCKET_POLL_INTERVAL, NULL))) {
+            mender_log_error("Unable to poll websocket connections: %s", curl_multi_strerror(err));
+        }
+        pthread_mutex_lock(&mender_websocket_loop.mutex);
+
+        /* Receive data from the connections */
+        for (size_t index = 0; index < count; index++) {
+            if (0 != fds[index].revents) {
+                mender_websocket_loop_receive(polled[index]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&mender_websocket_loop.mutex);
+
+    /* Release memory */
+    if (NULL != fds) {
+        mender_free(fds);
+    }
+    if (NULL != polled) {
+        mender_free(polled);
+    }
+
+    /* Terminate event loop thread */
+    pthread_exit(NULL);
+}
+
+#else
+
 __attribute__((noreturn)) static void *
 mender_websocket_thread(void *arg) {
 
@@ -432,6 +1033,7 @@ mender_websocket_thread(void *arg) {
     /* Perform reception of data from the websocket connection */
     while (false == handle->abort) {
         err = curl_easy_perform(handle->client);
+        mender_net_check_pinned_public_key(err);
         if (CURLE_OK != err) {
             if (CURLE_HTTP_RETURNED_ERROR == err) {
                 mender_log_error("Connection has been closed");
@@ -449,3 +1051,5 @@ END:
     /* Terminate work queue thread */
     pthread_exit(NULL);
 }
+
+#endif /* CONFIG_MENDER_WEBSOCKET_EVENT_LOOP */
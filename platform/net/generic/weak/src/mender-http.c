@@ -34,6 +34,8 @@ mender_http_perform(char                *jwt,
                     mender_http_method_t method,
                     char                *payload,
                     char                *signature,
+                    char                *range,
+                    size_t               recv_buf_length,
                     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
                     void *params,
                     int  *status) {
@@ -43,6 +45,8 @@ mender_http_perform(char                *jwt,
     (void)method;
     (void)payload;
     (void)signature;
+    (void)range;
+    (void)recv_buf_length;
     (void)callback;
     (void)params;
     (void)status;
@@ -51,6 +55,51 @@ mender_http_perform(char                *jwt,
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_http_perform_body(char                *jwt,
+                         char                *path,
+                         mender_http_method_t method,
+                         mender_http_body_t  *body,
+                         char                *signature,
+                         char                *range,
+                         char                *etag,
+                         size_t               recv_buf_length,
+                         mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                         void *params,
+                         int  *status) {
+
+    (void)jwt;
+    (void)path;
+    (void)method;
+    (void)body;
+    (void)signature;
+    (void)range;
+    (void)etag;
+    (void)recv_buf_length;
+    (void)callback;
+    (void)params;
+    (void)status;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_preconnect(char *path) {
+
+    (void)path;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_close_connections(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
+
 __attribute__((weak)) mender_err_t
 mender_http_exit(void) {
 
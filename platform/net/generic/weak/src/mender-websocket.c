@@ -53,6 +53,15 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_websocket_ping(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_websocket_disconnect(void *handle) {
 
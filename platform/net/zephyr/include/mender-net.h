@@ -26,6 +26,25 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Classes of the connections, the socket options are set according to the class
+ */
+typedef enum {
+    MENDER_NET_SOCKET_CLASS_API,         /**< Requests to the API */
+    MENDER_NET_SOCKET_CLASS_DOWNLOAD,    /**< Bulk download of the artifacts */
+    MENDER_NET_SOCKET_CLASS_INTERACTIVE, /**< Long-lived interactive WebSocket sessions */
+    MENDER_NET_SOCKET_CLASS_COUNT        /**< Number of classes */
+} mender_net_socket_class_t;
+
+/**
+ * @brief Socket options of a class of connections
+ */
+typedef struct {
+    int  rcvbuf;         /**< Receive buffer size (bytes), 0 to keep the current size */
+    bool nodelay;        /**< Flag used to disable the Nagle algorithm (TCP_NODELAY) */
+    int  keepalive_idle; /**< Idle time before the keepalive probes are sent (seconds), 0 to disable the keepalive */
+} mender_net_socket_options_t;
+
 /**
  * @brief Returns host name, port and URL from path
  * @param path Path
@@ -53,6 +72,48 @@ mender_err_t mender_net_connect(const char *host, const char *port, int *sock);
  */
 mender_err_t mender_net_disconnect(int sock);
 
+/**
+ * @brief Set the socket options of a class of connections at run time, the default options are set from the configuration
+ * @param socket_class Class of the connections
+ * @param options Socket options, applied to the next connections of the class
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_set_socket_options(mender_net_socket_class_t socket_class, mender_net_socket_options_t *options);
+
+/**
+ * @brief Apply the socket options of a class to a connection, the options not supported by the network stack are ignored with a warning
+ * @param sock Client socket
+ * @param socket_class Class of the connection
+ */
+void mender_net_apply_socket_options(int sock, mender_net_socket_class_t socket_class);
+
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+/**
+ * @brief Add a socket to the network reactor, a single thread polls all the sockets and invokes the callbacks when data is available
+ * @param sock Socket
+ * @param callback Callback invoked from the network reactor thread when data is available, the socket is removed if it fails
+ *                 NULL if the socket is read by its owner and is only registered to be cancelled
+ * @param params Callback parameters
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_reactor_add(int sock, mender_err_t (*callback)(int, void *), void *params);
+
+/**
+ * @brief Remove a socket from the network reactor, the callback is not invoked anymore once the function returns
+ * @param sock Socket
+ * @return MENDER_DONE if the socket has been cancelled, MENDER_OK otherwise
+ */
+mender_err_t mender_net_reactor_remove(int sock);
+
+/**
+ * @brief Cancel the HTTP requests in progress, their sockets are shut down so that the requests fail immediately
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_reactor_cancel(void);
+
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
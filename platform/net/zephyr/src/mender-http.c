@@ -17,11 +17,23 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
+#include <ctype.h>
 #include <version.h>
 #include <zephyr/net/http/client.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/util.h>
 #include "mender-http.h"
+#include "mender-http-gzip.h"
+#include "mender-http-stall.h"
 #include "mender-log.h"
 #include "mender-net.h"
+#include "mender-scheduler.h"
+#include "mender-trace.h"
 
 /**
  * @brief HTTP User-Agent
@@ -29,22 +41,46 @@
 #define MENDER_HTTP_USER_AGENT "mender-mcu-client/" MENDER_CLIENT_VERSION " (mender-http) zephyr/" KERNEL_VERSION_STRING
 
 /**
- * @brief Receive buffer length
+ * @brief Prefix of the Authorization header
  */
-#define MENDER_HTTP_RECV_BUF_LENGTH (512)
+#define MENDER_HTTP_AUTHORIZATION_PREFIX "Authorization: Bearer "
 
 /**
  * @brief Request timeout (milliseconds)
  */
 #define MENDER_HTTP_REQUEST_TIMEOUT (600000)
 
+/**
+ * @brief Default maximum number of connections kept alive with the servers
+ */
+#ifndef CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS
+#define CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS (2)
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS */
+
+/**
+ * @brief Maximum length of the ETag header value, longer values are ignored
+ */
+#define MENDER_HTTP_ETAG_MAX_LENGTH (128)
+
 /**
  * @brief Request context
  */
 typedef struct {
     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *); /**< Callback to be invoked when data are received */
-    void        *params;                                                          /**< Callback parameters */
-    mender_err_t ret;                                                             /**< Last callback return value */
+    void               *params;                                                   /**< Callback parameters */
+    mender_err_t        ret;                                                      /**< Last callback return value, MENDER_DONE if the callback stopped reading the response */
+    int                *status;                                                   /**< Status code */
+    bool                headers_received;                                         /**< Headers received event has been transmitted */
+    mender_http_body_t *body;                                                     /**< Body of the request, NULL if empty */
+    bool                header_value;                                             /**< The last header data received is a value */
+    size_t              header_field_length;                                      /**< Length of the current header field */
+    bool                header_etag;                                              /**< The current header field is ETag */
+    bool                header_retry_after;                                       /**< The current header field is Retry-After */
+    char                etag[MENDER_HTTP_ETAG_MAX_LENGTH + 1];                    /**< ETag header value */
+    size_t              etag_length;                                              /**< Length of the ETag header value, 0 if not received */
+    uint32_t            retry_after;                                              /**< Retry-After header value (seconds), 0 if not received */
+    int                 sock;                                                     /**< Client socket, shut down if the transfer is stalled */
+    mender_http_stall_t stall;                                                    /**< Stall detection of the transfer */
 } mender_http_request_context;
 
 /**
@@ -52,6 +88,29 @@ typedef struct {
  */
 static mender_http_config_t mender_http_config;
 
+/**
+ * @brief Connections kept alive and mutex, the connections are reused by the next requests to the same host and port
+ */
+static struct {
+    char *host; /**< Host of the connection, NULL if the entry is not used */
+    char *port; /**< Port of the connection */
+    int   sock; /**< Client socket */
+} mender_http_connections[CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS];
+static void *mender_http_connections_mutex = NULL;
+
+/**
+ * @brief User-Agent header, it is not allocated
+ */
+static char mender_http_user_agent[] = "User-Agent: " MENDER_HTTP_USER_AGENT "\r\n";
+
+/**
+ * @brief Buffers kept for the next requests, also protected by the connections mutex, the polls do not allocate them again
+ */
+static struct {
+    char    *authorization; /**< Authorization header, computed again only when the authentication token changes, NULL if not available */
+    uint8_t *recv_buf;      /**< Receive buffer of length CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, NULL if not available */
+} mender_http_buffers = { .authorization = NULL, .recv_buf = NULL };
+
 /**
  * @brief HTTP response callback, invoked to handle data received
  * @param response HTTP response structure
@@ -60,6 +119,66 @@ static mender_http_config_t mender_http_config;
  */
 static void mender_http_response_cb(struct http_response *response, enum http_final_call final_call, void *user_data);
 
+/**
+ * @brief HTTP parser callback, invoked when a header field is received, possibly in several parts
+ * @param parser HTTP parser, used to retrieve request context data
+ * @param at Data of the header field
+ * @param length Length of the data
+ * @return 0
+ */
+static int mender_http_header_field_cb(struct http_parser *parser, const char *at, size_t length);
+
+/**
+ * @brief HTTP parser callback, invoked when a header value is received, possibly in several parts
+ * @param parser HTTP parser, used to retrieve request context data
+ * @param at Data of the header value
+ * @param length Length of the data
+ * @return 0
+ */
+static int mender_http_header_value_cb(struct http_parser *parser, const char *at, size_t length);
+
+/**
+ * @brief HTTP parser callbacks, used to retrieve the ETag and Retry-After headers
+ */
+static const struct http_parser_settings mender_http_parser_settings
+    = { .on_header_field = mender_http_header_field_cb, .on_header_value = mender_http_header_value_cb };
+
+/**
+ * @brief HTTP payload callback, invoked to write the body of the request to the socket
+ * @param sock Client socket
+ * @param req HTTP request structure
+ * @param user_data User data, used to retrieve request context data
+ * @return Length of the body written if the function succeeds, -1 otherwise
+ */
+static int mender_http_payload_cb(int sock, struct http_request *req, void *user_data);
+
+/**
+ * @brief Body callback used to write a payload at once
+ * @param write Write function
+ * @param ctx Context of the write function
+ * @param params Payload
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_payload_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params);
+
+/**
+ * @brief Write function used to compute the length of the body
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Length of the body, incremented by the length of the data
+ * @return MENDER_OK
+ */
+static mender_err_t mender_http_body_length(void *data, size_t length, void *ctx);
+
+/**
+ * @brief Write function used to send the body to the socket
+ * @param data Data of the body
+ * @param length Length of the data
+ * @param ctx Client socket
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_body_send(void *data, size_t length, void *ctx);
+
 /**
  * @brief Convert mender HTTP method to Zephyr HTTP client method
  * @param method Mender HTTP method
@@ -67,6 +186,56 @@ static void mender_http_response_cb(struct http_response *response, enum http_fi
  */
 static enum http_method mender_http_method_to_zephyr_http_client_method(mender_http_method_t method);
 
+/**
+ * @brief Take a connection kept alive with the server
+ * @param host Host of the connection
+ * @param port Port of the connection
+ * @return Client socket if a connection is kept alive with the server, -1 otherwise
+ */
+static int mender_http_connection_take(char *host, char *port);
+
+/**
+ * @brief Give a connection to be kept alive with the server, the connection is closed if it can not be kept
+ * @param host Host of the connection, the memory is owned by the connections after the call
+ * @param port Port of the connection, the memory is owned by the connections after the call
+ * @param sock Client socket
+ */
+static void mender_http_connection_give(char *host, char *port, int sock);
+
+/**
+ * @brief Take the Authorization header of the authentication token, the header kept is taken if it matches the token, it is allocated otherwise
+ * @param jwt Token
+ * @return Authorization header if the function succeeds, NULL otherwise
+ */
+static char *mender_http_authorization_take(char *jwt);
+
+/**
+ * @brief Give the Authorization header back so that it is kept for the next requests, the older one is released
+ * @param authorization Authorization header, NULL if not used
+ */
+static void mender_http_authorization_give(char *authorization);
+
+/**
+ * @brief Take a receive buffer, the buffer kept is taken if the length is CONFIG_MENDER_HTTP_RECV_BUF_LENGTH, it is allocated otherwise
+ * @param length Length of the receive buffer
+ * @return Receive buffer if the function succeeds, NULL otherwise
+ */
+static uint8_t *mender_http_recv_buf_take(size_t length);
+
+/**
+ * @brief Give a receive buffer back so that it is kept for the next requests, it is released if it can not be kept
+ * @param recv_buf Receive buffer, NULL if not used
+ * @param length Length of the receive buffer
+ */
+static void mender_http_recv_buf_give(uint8_t *recv_buf, size_t length);
+
+/**
+ * @brief Set the inactivity timeout of a connection, the reads of the request fail if no data is received meanwhile
+ * @param sock Client socket
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_set_inactivity_timeout(int sock);
+
 mender_err_t
 mender_http_init(mender_http_config_t *config) {
 
@@ -76,6 +245,12 @@ mender_http_init(mender_http_config_t *config) {
     /* Save configuration */
     memcpy(&mender_http_config, config, sizeof(mender_http_config_t));
 
+    /* Create connections mutex */
+    if (MENDER_OK != mender_scheduler_mutex_create(&mender_http_connections_mutex)) {
+        mender_log_error("Unable to create connections mutex");
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
 
@@ -85,30 +260,73 @@ mender_http_perform(char                *jwt,
                     mender_http_method_t method,
                     char                *payload,
                     char                *signature,
+                    char                *range,
+                    size_t               recv_buf_length,
                     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
                     void *params,
                     int  *status) {
 
+    mender_http_body_t body = { .callback = &mender_http_payload_callback, .params = payload };
+
+    /* Perform HTTP request with the payload written at once */
+    return mender_http_perform_body(jwt, path, method, (NULL != payload) ? &body : NULL, signature, range, NULL, recv_buf_length, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_body(char                *jwt,
+                         char                *path,
+                         mender_http_method_t method,
+                         mender_http_body_t  *body,
+                         char                *signature,
+                         char                *range,
+                         char                *etag,
+                         size_t               recv_buf_length,
+                         mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                         void *params,
+                         int  *status) {
+
     assert(NULL != path);
+    assert(0 != recv_buf_length);
     assert(NULL != callback);
     assert(NULL != status);
     mender_err_t                ret;
     struct http_request         request;
     mender_http_request_context request_context;
-    char                       *header_fields[5] = { NULL, NULL, NULL, NULL, NULL };
+    char                       *header_fields[8] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
     size_t                      header_index     = 0;
     char                       *host             = NULL;
     char                       *port             = NULL;
     char                       *url              = NULL;
     int                         sock             = -1;
+    bool                        reused           = false;
+    char                       *authorization    = NULL;
+    size_t                      body_length      = 0;
+    mender_net_socket_class_t   socket_class;
+    int                         result;
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    mender_http_body_t gzip_body;
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+    /* Trace the request */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_HTTP_PERFORM);
 
     /* Initialize request */
     memset(&request, 0, sizeof(struct http_request));
 
     /* Initialize request context */
-    request_context.callback = callback;
-    request_context.params   = params;
-    request_context.ret      = MENDER_OK;
+    request_context.callback            = callback;
+    request_context.params              = params;
+    request_context.ret                 = MENDER_OK;
+    request_context.status              = status;
+    request_context.headers_received    = false;
+    request_context.body                = body;
+    request_context.header_value        = true;
+    request_context.header_field_length = 0;
+    request_context.header_etag         = false;
+    request_context.header_retry_after  = false;
+    request_context.etag_length         = 0;
+    request_context.retry_after         = 0;
+    request_context.sock                = -1;
 
     /* Retrieve host, port and url */
     if (MENDER_OK != (ret = mender_net_get_host_port_url(path, mender_http_config.host, &host, &port, &url))) {
@@ -116,41 +334,62 @@ mender_http_perform(char                *jwt,
         goto END;
     }
 
+    /* Compute the length of the body, the body is written to the socket when the request is performed */
+    if (NULL != body) {
+        if (MENDER_OK != (ret = body->callback(&mender_http_body_length, &body_length, body->params))) {
+            mender_log_error("Unable to compute the length of the body");
+            goto END;
+        }
+    }
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    /* Compress the body with gzip if it is large enough, the signed bodies are sent as they have been signed */
+    if ((NULL != body) && (NULL == signature) && (body_length >= CONFIG_MENDER_HTTP_GZIP_THRESHOLD)) {
+        gzip_body.callback   = &mender_http_gzip_body_callback;
+        gzip_body.params     = body;
+        body                 = &gzip_body;
+        body_length          = 0;
+        request_context.body = body;
+        if (MENDER_OK != (ret = body->callback(&mender_http_body_length, &body_length, body->params))) {
+            mender_log_error("Unable to compute the length of the compressed body");
+            goto END;
+        }
+    }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
     /* Configuration of the client */
     request.method      = mender_http_method_to_zephyr_http_client_method(method);
     request.url         = url;
     request.host        = host;
     request.protocol    = "HTTP/1.1";
-    request.payload     = payload;
-    request.payload_len = (NULL != payload) ? strlen(payload) : 0;
+    request.payload_cb  = (NULL != body) ? mender_http_payload_cb : NULL;
+    request.payload_len = body_length;
     request.response    = mender_http_response_cb;
-    if (NULL == (request.recv_buf = (uint8_t *)malloc(MENDER_HTTP_RECV_BUF_LENGTH))) {
+    request.http_cb     = &mender_http_parser_settings;
+    if (NULL == (request.recv_buf = mender_http_recv_buf_take(recv_buf_length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    request.recv_buf_len = MENDER_HTTP_RECV_BUF_LENGTH;
-    size_t str_length    = strlen("User-Agent: ") + strlen(MENDER_HTTP_USER_AGENT) + strlen("\r\n") + 1;
-    if (NULL == (header_fields[header_index] = malloc(str_length))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    snprintf(header_fields[header_index], str_length, "User-Agent: %s\r\n", MENDER_HTTP_USER_AGENT);
-    header_index++;
+    request.recv_buf_len = recv_buf_length;
+
+    /* The requests using the receive buffer of the downloads are bulk transfers of the artifacts */
+    socket_class = (recv_buf_length >= CONFIG_MENDER_HTTP_DOWNLOAD_RECV_BUF_LENGTH) ? MENDER_NET_SOCKET_CLASS_DOWNLOAD : MENDER_NET_SOCKET_CLASS_API;
+
+    /* Set the headers, the User-Agent and Authorization headers are not computed again for each request */
+    header_fields[header_index++] = mender_http_user_agent;
     if (NULL != jwt) {
-        str_length = strlen("Authorization: Bearer ") + strlen(jwt) + strlen("\r\n") + 1;
-        if (NULL == (header_fields[header_index] = (char *)malloc(str_length))) {
+        if (NULL == (authorization = mender_http_authorization_take(jwt))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
         }
-        snprintf(header_fields[header_index], str_length, "Authorization: Bearer %s\r\n", jwt);
-        header_index++;
+        header_fields[header_index++] = authorization;
     }
+    size_t str_length;
     if (NULL != signature) {
         str_length = strlen("X-MEN-Signature: ") + strlen(signature) + strlen("\r\n") + 1;
-        if (NULL == (header_fields[header_index] = (char *)malloc(str_length))) {
+        if (NULL == (header_fields[header_index] = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -158,34 +397,104 @@ mender_http_perform(char                *jwt,
         snprintf(header_fields[header_index], str_length, "X-MEN-Signature: %s\r\n", signature);
         header_index++;
     }
-    if (NULL != payload) {
-        if (NULL == (header_fields[header_index] = strdup("Content-Type: application/json\r\n"))) {
+    if (NULL != range) {
+        str_length = strlen("Range: ") + strlen(range) + strlen("\r\n") + 1;
+        if (NULL == (header_fields[header_index] = (char *)mender_malloc(str_length))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        snprintf(header_fields[header_index], str_length, "Range: %s\r\n", range);
+        header_index++;
+    }
+    if (NULL != etag) {
+        str_length = strlen("If-None-Match: ") + strlen(etag) + strlen("\r\n") + 1;
+        if (NULL == (header_fields[header_index] = (char *)mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
         }
+        snprintf(header_fields[header_index], str_length, "If-None-Match: %s\r\n", etag);
+        header_index++;
+    }
+    if (NULL != body) {
+        if (NULL == (header_fields[header_index] = mender_strdup("Content-Type: application/json\r\n"))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        header_index++;
+#ifdef CONFIG_MENDER_HTTP_GZIP
+        if (&mender_http_gzip_body_callback == body->callback) {
+            if (NULL == (header_fields[header_index] = mender_strdup("Content-Encoding: gzip\r\n"))) {
+                mender_log_error("Unable to allocate memory");
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            header_index++;
+        }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
     }
     request.header_fields = (0 != header_index) ? ((const char **)header_fields) : NULL;
 
-    /* Connect to the server */
-    if (MENDER_OK != (ret = mender_net_connect(host, port, &sock))) {
+    /* Connect to the server, a connection kept alive with the server is reused if available */
+    if (0 <= (sock = mender_http_connection_take(host, port))) {
+        reused = true;
+    } else if (MENDER_OK != (ret = mender_net_connect(host, port, &sock))) {
         mender_log_error("Unable to open HTTP client connection");
         goto END;
     }
+    if (MENDER_OK != (ret = mender_http_set_inactivity_timeout(sock))) {
+        goto END;
+    }
+    mender_net_apply_socket_options(sock, socket_class);
     if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, params))) {
         mender_log_error("An error occurred");
         goto END;
     }
-
-    /* Perform HTTP request */
-    if (http_client_req(sock, &request, MENDER_HTTP_REQUEST_TIMEOUT, (void *)&request_context) < 0) {
+#ifdef CONFIG_MENDER_NET_REACTOR
+    mender_net_reactor_add(sock, NULL, NULL);
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
+    /* Perform HTTP request, the request is performed again with a new connection if the connection kept alive has been closed by the server */
+    request_context.sock = sock;
+    mender_http_stall_init(&request_context.stall);
+    result               = http_client_req(sock, &request, MENDER_HTTP_REQUEST_TIMEOUT, (void *)&request_context);
+    if ((true == reused) && (0 == request.internal.response.http_status_code)) {
+#ifdef CONFIG_MENDER_NET_REACTOR
+        if (MENDER_DONE == mender_net_reactor_remove(sock)) {
+            mender_log_error("Request has been cancelled");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+#endif /* CONFIG_MENDER_NET_REACTOR */
+        mender_net_disconnect(sock);
+        sock = -1;
+        memset(&request.internal, 0, sizeof(request.internal));
+        if (MENDER_OK != (ret = mender_net_connect(host, port, &sock))) {
+            mender_log_error("Unable to open HTTP client connection");
+            goto END;
+        }
+        if (MENDER_OK != (ret = mender_http_set_inactivity_timeout(sock))) {
+            goto END;
+        }
+        mender_net_apply_socket_options(sock, socket_class);
+#ifdef CONFIG_MENDER_NET_REACTOR
+        mender_net_reactor_add(sock, NULL, NULL);
+#endif /* CONFIG_MENDER_NET_REACTOR */
+        request_context.sock = sock;
+        mender_http_stall_init(&request_context.stall);
+        result               = http_client_req(sock, &request, MENDER_HTTP_REQUEST_TIMEOUT, (void *)&request_context);
+    }
+    if (result < 0) {
         mender_log_error("Unable to write data");
         ret = MENDER_FAIL;
         goto END;
     }
 
-    /* Check if an error occured during the treatment of data */
-    if (MENDER_OK != (ret = request_context.ret)) {
+    /* Check if an error occured during the treatment of data, the remaining data are discarded if the callback stopped reading the response */
+    if ((MENDER_OK != request_context.ret) && (MENDER_DONE != request_context.ret)) {
+        ret = request_context.ret;
         goto END;
     }
 
@@ -205,35 +514,130 @@ mender_http_perform(char                *jwt,
 
 END:
 
-    /* Close connection */
-    mender_net_disconnect(sock);
+    /* Keep the connection alive if the response has been received entirely and the server allows it, close it otherwise */
+    if (0 <= sock) {
+#ifdef CONFIG_MENDER_NET_REACTOR
+        mender_net_reactor_remove(sock);
+#endif /* CONFIG_MENDER_NET_REACTOR */
+        if ((MENDER_OK == ret) && (true == request.internal.response.message_complete) && (0 != http_should_keep_alive(&request.internal.parser))) {
+            mender_http_connection_give(host, port, sock);
+            host = NULL;
+            port = NULL;
+        } else {
+            mender_net_disconnect(sock);
+        }
+    }
 
     /* Release memory */
     if (NULL != host) {
-        free(host);
+        mender_free(host);
     }
     if (NULL != port) {
-        free(port);
+        mender_free(port);
     }
     if (NULL != url) {
-        free(url);
-    }
-    if (NULL != request.recv_buf) {
-        free(request.recv_buf);
+        mender_free(url);
     }
+    mender_http_recv_buf_give(request.recv_buf, recv_buf_length);
     for (size_t index = 0; index < sizeof(header_fields) / sizeof(header_fields[0]); index++) {
-        if (NULL != header_fields[index]) {
-            free(header_fields[index]);
+        if ((NULL != header_fields[index]) && (mender_http_user_agent != header_fields[index]) && (authorization != header_fields[index])) {
+            mender_free(header_fields[index]);
         }
     }
+    mender_http_authorization_give(authorization);
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_HTTP_PERFORM);
+
+    return ret;
+}
+
+mender_err_t
+mender_http_preconnect(char *path) {
+
+    assert(NULL != path);
+    mender_err_t ret;
+    char        *host = NULL;
+    char        *port = NULL;
+    char        *url  = NULL;
+    int          sock;
+
+    /* Retrieve host and port of the server */
+    if (MENDER_OK != (ret = mender_net_get_host_port_url(path, mender_http_config.host, &host, &port, &url))) {
+        mender_log_error("Unable to retrieve host/port/url");
+        goto END;
+    }
+
+    /* Connect to the server if no connection is kept alive with it, name resolution and TLS handshake are done */
+    if (0 > (sock = mender_http_connection_take(host, port))) {
+        if (MENDER_OK != (ret = mender_net_connect(host, port, &sock))) {
+            mender_log_error("Unable to open HTTP client connection");
+            goto END;
+        }
+    }
+
+    /* Keep the connection alive */
+    mender_http_connection_give(host, port, sock);
+    host = NULL;
+    port = NULL;
+
+END:
+
+    /* Release memory */
+    if (NULL != host) {
+        mender_free(host);
+    }
+    if (NULL != port) {
+        mender_free(port);
+    }
+    if (NULL != url) {
+        mender_free(url);
+    }
 
     return ret;
 }
 
+mender_err_t
+mender_http_close_connections(void) {
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return MENDER_FAIL;
+    }
+
+    /* Close all connections kept alive */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if (NULL != mender_http_connections[index].host) {
+            mender_net_disconnect(mender_http_connections[index].sock);
+            mender_free(mender_http_connections[index].host);
+            mender_free(mender_http_connections[index].port);
+            mender_http_connections[index].host = NULL;
+            mender_http_connections[index].port = NULL;
+            mender_http_connections[index].sock = -1;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_http_exit(void) {
 
-    /* Nothing to do */
+    /* Release connections and buffers */
+    mender_http_close_connections();
+    if (NULL != mender_http_buffers.authorization) {
+        mender_free(mender_http_buffers.authorization);
+        mender_http_buffers.authorization = NULL;
+    }
+    if (NULL != mender_http_buffers.recv_buf) {
+        mender_free(mender_http_buffers.recv_buf);
+        mender_http_buffers.recv_buf = NULL;
+    }
+    mender_scheduler_mutex_delete(mender_http_connections_mutex);
+    mender_http_connections_mutex = NULL;
+
     return MENDER_OK;
 }
 
@@ -247,16 +651,175 @@ mender_http_response_cb(struct http_response *response, enum http_final_call fin
     /* Retrieve request context */
     mender_http_request_context *request_context = (mender_http_request_context *)user_data;
 
+    /* Read HTTP status code */
+    if (0 != response->http_status_code) {
+        *request_context->status = response->http_status_code;
+    }
+
+    /* Transmit headers and content length to the upper layer before the first data */
+    if ((0 != response->http_status_code) && (false == request_context->headers_received) && (MENDER_OK == request_context->ret)) {
+        request_context->headers_received = true;
+        mender_http_headers_t headers     = { .etag        = (0 != request_context->etag_length) ? request_context->etag : NULL,
+                                              .retry_after = request_context->retry_after };
+        if (MENDER_OK
+            != (request_context->ret = request_context->callback(MENDER_HTTP_EVENT_HEADERS_RECEIVED,
+                                                                 &headers,
+                                                                 (true == response->cl_present) ? response->content_length : 0,
+                                                                 request_context->params))) {
+            mender_log_error("An error occurred, stop reading data");
+        }
+    }
+
     /* Check if data is available */
     if ((true == response->body_found) && (NULL != response->body_frag_start) && (0 != response->body_frag_len) && (MENDER_OK == request_context->ret)) {
 
+        /* Check the throughput, the socket is shut down so that the request fails immediately if the transfer is stalled */
+        if (MENDER_OK != (request_context->ret = mender_http_stall_check(&request_context->stall, response->body_frag_len))) {
+            zsock_shutdown(request_context->sock, ZSOCK_SHUT_RDWR);
+            return;
+        }
+
         /* Transmit data received to the upper layer */
         if (MENDER_OK
             != (request_context->ret = request_context->callback(
                     MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)response->body_frag_start, response->body_frag_len, request_context->params))) {
-            mender_log_error("An error occurred, stop reading data");
+            if (MENDER_DONE != request_context->ret) {
+                mender_log_error("An error occurred, stop reading data");
+            }
+        }
+    }
+}
+
+static int
+mender_http_header_field_cb(struct http_parser *parser, const char *at, size_t length) {
+
+    assert(NULL != parser);
+    assert(NULL != at);
+
+    /* Retrieve request context */
+    struct http_request         *request         = CONTAINER_OF(parser, struct http_request, internal.parser);
+    mender_http_request_context *request_context = (mender_http_request_context *)request->internal.user_data;
+
+    /* A new header field begins after a header value */
+    if (true == request_context->header_value) {
+        request_context->header_value        = false;
+        request_context->header_field_length = 0;
+        request_context->header_etag         = true;
+        request_context->header_retry_after  = true;
+    }
+
+    /* Compare the header field to "ETag" and "Retry-After", case insensitive */
+    for (size_t index = 0; index < length; index++) {
+        if ((request_context->header_field_length >= strlen("etag"))
+            || (tolower((unsigned char)at[index]) != "etag"[request_context->header_field_length])) {
+            request_context->header_etag = false;
         }
+        if ((request_context->header_field_length >= strlen("retry-after"))
+            || (tolower((unsigned char)at[index]) != "retry-after"[request_context->header_field_length])) {
+            request_context->header_retry_after = false;
+        }
+        request_context->header_field_length++;
+    }
+
+    return 0;
+}
+
+static int
+mender_http_header_value_cb(struct http_parser *parser, const char *at, size_t length) {
+
+    assert(NULL != parser);
+    assert(NULL != at);
+
+    /* Retrieve request context */
+    struct http_request         *request         = CONTAINER_OF(parser, struct http_request, internal.parser);
+    mender_http_request_context *request_context = (mender_http_request_context *)request->internal.user_data;
+
+    /* Save the value of the ETag header, the value is ignored if it is too long */
+    request_context->header_value = true;
+    if ((true == request_context->header_etag) && (strlen("etag") == request_context->header_field_length)) {
+        if (request_context->etag_length + length <= MENDER_HTTP_ETAG_MAX_LENGTH) {
+            memcpy(&request_context->etag[request_context->etag_length], at, length);
+            request_context->etag_length += length;
+            request_context->etag[request_context->etag_length] = '\0';
+        } else {
+            request_context->header_etag = false;
+            request_context->etag_length = 0;
+        }
+    }
+
+    /* Save the value of the Retry-After header, the value is ignored if it is not a number of seconds (HTTP date) */
+    if ((true == request_context->header_retry_after) && (strlen("retry-after") == request_context->header_field_length)) {
+        for (size_t index = 0; index < length; index++) {
+            if ((at[index] >= '0') && (at[index] <= '9') && (request_context->retry_after < UINT32_MAX / 10)) {
+                request_context->retry_after = request_context->retry_after * 10 + (uint32_t)(at[index] - '0');
+            } else if (' ' != at[index]) {
+                request_context->header_retry_after = false;
+                request_context->retry_after        = 0;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int
+mender_http_payload_cb(int sock, struct http_request *req, void *user_data) {
+
+    assert(NULL != req);
+    assert(NULL != user_data);
+
+    /* Retrieve request context */
+    mender_http_request_context *request_context = (mender_http_request_context *)user_data;
+
+    /* Write the body to the socket */
+    if (MENDER_OK != request_context->body->callback(&mender_http_body_send, &sock, request_context->body->params)) {
+        mender_log_error("Unable to write the body");
+        return -1;
     }
+
+    return (int)req->payload_len;
+}
+
+static mender_err_t
+mender_http_payload_callback(mender_err_t (*write)(void *, size_t, void *), void *ctx, void *params) {
+
+    assert(NULL != write);
+    assert(NULL != params);
+
+    /* Write the payload at once */
+    return write(params, strlen((char *)params), ctx);
+}
+
+static mender_err_t
+mender_http_body_length(void *data, size_t length, void *ctx) {
+
+    (void)data;
+    assert(NULL != ctx);
+
+    /* Increment the length of the body */
+    *((size_t *)ctx) += length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_http_body_send(void *data, size_t length, void *ctx) {
+
+    assert(NULL != ctx);
+    int     sock = *((int *)ctx);
+    ssize_t sent;
+
+    /* Send data until all have been written */
+    while (length > 0) {
+        if ((sent = zsock_send(sock, data, length, 0)) < 0) {
+            return MENDER_FAIL;
+        }
+        data = (uint8_t *)data + sent;
+        length -= (size_t)sent;
+    }
+
+    return MENDER_OK;
 }
 
 static enum http_method
@@ -275,3 +838,184 @@ mender_http_method_to_zephyr_http_client_method(mender_http_method_t method) {
 
     return -1;
 }
+
+static int
+mender_http_connection_take(char *host, char *port) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+    int sock = -1;
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return -1;
+    }
+
+    /* Search a connection kept alive with the server */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if ((NULL != mender_http_connections[index].host) && (!strcmp(host, mender_http_connections[index].host))
+            && (!strcmp(port, mender_http_connections[index].port))) {
+            sock = mender_http_connections[index].sock;
+            mender_free(mender_http_connections[index].host);
+            mender_free(mender_http_connections[index].port);
+            mender_http_connections[index].host = NULL;
+            mender_http_connections[index].port = NULL;
+            mender_http_connections[index].sock = -1;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    return sock;
+}
+
+static void
+mender_http_connection_give(char *host, char *port, int sock) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+
+    /* Take mutex used to protect access to the connections */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        mender_net_disconnect(sock);
+        mender_free(host);
+        mender_free(port);
+        return;
+    }
+
+    /* Store the connection in a free entry, the connection of the last entry is closed if all the entries are used */
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS; index++) {
+        if ((NULL == mender_http_connections[index].host) || (CONFIG_MENDER_HTTP_KEEP_ALIVE_CONNECTIONS == index + 1)) {
+            if (NULL != mender_http_connections[index].host) {
+                mender_net_disconnect(mender_http_connections[index].sock);
+                mender_free(mender_http_connections[index].host);
+                mender_free(mender_http_connections[index].port);
+            }
+            mender_http_connections[index].host = host;
+            mender_http_connections[index].port = port;
+            mender_http_connections[index].sock = sock;
+            host                                = NULL;
+            port                                = NULL;
+            sock                                = -1;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the connections */
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+
+    /* Close the connection if it has not been stored */
+    if (0 <= sock) {
+        mender_net_disconnect(sock);
+        mender_free(host);
+        mender_free(port);
+    }
+}
+
+static char *
+mender_http_authorization_take(char *jwt) {
+
+    assert(NULL != jwt);
+    char  *authorization = NULL;
+    size_t jwt_length    = strlen(jwt);
+
+    /* Take the header kept if it matches the token, the header of an older token is released */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        if (NULL != mender_http_buffers.authorization) {
+            char *value = mender_http_buffers.authorization + strlen(MENDER_HTTP_AUTHORIZATION_PREFIX);
+            if ((!strncmp(value, jwt, jwt_length)) && (!strcmp(value + jwt_length, "\r\n"))) {
+                authorization = mender_http_buffers.authorization;
+            } else {
+                mender_free(mender_http_buffers.authorization);
+            }
+            mender_http_buffers.authorization = NULL;
+        }
+        mender_scheduler_mutex_give(mender_http_connections_mutex);
+    }
+    if (NULL != authorization) {
+        return authorization;
+    }
+
+    /* Compute the header */
+    size_t str_length = strlen(MENDER_HTTP_AUTHORIZATION_PREFIX) + jwt_length + strlen("\r\n") + 1;
+    if (NULL == (authorization = (char *)mender_malloc(str_length))) {
+        return NULL;
+    }
+    snprintf(authorization, str_length, MENDER_HTTP_AUTHORIZATION_PREFIX "%s\r\n", jwt);
+
+    return authorization;
+}
+
+static void
+mender_http_authorization_give(char *authorization) {
+
+    /* Keep the header, it replaces the older one which is released */
+    if (NULL == authorization) {
+        return;
+    }
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_http_connections_mutex, -1)) {
+        mender_free(authorization);
+        return;
+    }
+    if (NULL != mender_http_buffers.authorization) {
+        mender_free(mender_http_buffers.authorization);
+    }
+    mender_http_buffers.authorization = authorization;
+    mender_scheduler_mutex_give(mender_http_connections_mutex);
+}
+
+static uint8_t *
+mender_http_recv_buf_take(size_t length) {
+
+    uint8_t *recv_buf = NULL;
+
+    /* Take the buffer kept if the length matches */
+    if ((CONFIG_MENDER_HTTP_RECV_BUF_LENGTH == length) && (MENDER_OK == mender_scheduler_mutex_take(mender_http_connections_mutex, -1))) {
+        recv_buf                     = mender_http_buffers.recv_buf;
+        mender_http_buffers.recv_buf = NULL;
+        mender_scheduler_mutex_give(mender_http_connections_mutex);
+    }
+    if (NULL != recv_buf) {
+        return recv_buf;
+    }
+
+    return (uint8_t *)mender_malloc(length);
+}
+
+static void
+mender_http_recv_buf_give(uint8_t *recv_buf, size_t length) {
+
+    /* Keep the buffer if the length matches and no buffer is kept, it is released otherwise */
+    if (NULL == recv_buf) {
+        return;
+    }
+    if ((CONFIG_MENDER_HTTP_RECV_BUF_LENGTH == length) && (MENDER_OK == mender_scheduler_mutex_take(mender_http_connections_mutex, -1))) {
+        if (NULL == mender_http_buffers.recv_buf) {
+            mender_http_buffers.recv_buf = recv_buf;
+            recv_buf                     = NULL;
+        }
+        mender_scheduler_mutex_give(mender_http_connections_mutex);
+    }
+    if (NULL != recv_buf) {
+        mender_free(recv_buf);
+    }
+}
+
+static mender_err_t
+mender_http_set_inactivity_timeout(int sock) {
+
+    struct zsock_timeval timeout = { .tv_sec = CONFIG_MENDER_HTTP_INACTIVITY_TIMEOUT, .tv_usec = 0 };
+    int                  result;
+
+    /* The whole request has a timeout, the receive timeout of the socket detects a stalled transfer sooner */
+    if ((result = zsock_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))) < 0) {
+        mender_log_error("Unable to set inactivity timeout (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
@@ -17,13 +17,23 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
 #include <errno.h>
+#include <fcntl.h>
+#include <zephyr/kernel.h>
 #include <zephyr/net/socket.h>
 #ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
 #include <zephyr/net/tls_credentials.h>
 #endif /* CONFIG_NET_SOCKETS_SOCKOPT_TLS */
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-net.h"
+#include "mender-scheduler.h"
+#include "mender-trace.h"
 #include "mender-utils.h"
 
 /**
@@ -33,6 +43,259 @@
 #define CONFIG_MENDER_NET_TLS_PEER_VERIFY (2)
 #endif /* CONFIG_MENDER_NET_TLS_PEER_VERIFY */
 
+/**
+ * @brief Default maximum number of host names in the DNS cache
+ */
+#ifndef CONFIG_MENDER_NET_DNS_CACHE_SIZE
+#define CONFIG_MENDER_NET_DNS_CACHE_SIZE (2)
+#endif /* CONFIG_MENDER_NET_DNS_CACHE_SIZE */
+
+/**
+ * @brief Default lifetime of the addresses in the DNS cache (seconds)
+ */
+#ifndef CONFIG_MENDER_NET_DNS_CACHE_TTL
+#define CONFIG_MENDER_NET_DNS_CACHE_TTL (300)
+#endif /* CONFIG_MENDER_NET_DNS_CACHE_TTL */
+
+/**
+ * @brief Default maximum number of addresses of a host attempted to connect
+ */
+#ifndef CONFIG_MENDER_NET_CONNECT_ATTEMPTS
+#define CONFIG_MENDER_NET_CONNECT_ATTEMPTS (4)
+#endif /* CONFIG_MENDER_NET_CONNECT_ATTEMPTS */
+
+/**
+ * @brief Default delay before the next address is attempted while the previous attempts are still in progress (milliseconds)
+ */
+#ifndef CONFIG_MENDER_NET_CONNECT_ATTEMPT_DELAY
+#define CONFIG_MENDER_NET_CONNECT_ATTEMPT_DELAY (250)
+#endif /* CONFIG_MENDER_NET_CONNECT_ATTEMPT_DELAY */
+
+/**
+ * @brief Default connection timeout (milliseconds)
+ */
+#ifndef CONFIG_MENDER_NET_CONNECT_TIMEOUT
+#define CONFIG_MENDER_NET_CONNECT_TIMEOUT (10000)
+#endif /* CONFIG_MENDER_NET_CONNECT_TIMEOUT */
+
+/**
+ * @brief Default receive buffer size of the API connections (bytes), 0 to keep the default of the network stack
+ */
+#ifndef CONFIG_MENDER_NET_API_RCVBUF
+#define CONFIG_MENDER_NET_API_RCVBUF (0)
+#endif /* CONFIG_MENDER_NET_API_RCVBUF */
+
+/**
+ * @brief Default keepalive idle time of the API connections (seconds), 0 to disable the keepalive
+ */
+#ifndef CONFIG_MENDER_NET_API_KEEPALIVE_IDLE
+#define CONFIG_MENDER_NET_API_KEEPALIVE_IDLE (0)
+#endif /* CONFIG_MENDER_NET_API_KEEPALIVE_IDLE */
+
+/**
+ * @brief Default receive buffer size of the download connections (bytes), 0 to keep the default of the network stack
+ */
+#ifndef CONFIG_MENDER_NET_DOWNLOAD_RCVBUF
+#define CONFIG_MENDER_NET_DOWNLOAD_RCVBUF (0)
+#endif /* CONFIG_MENDER_NET_DOWNLOAD_RCVBUF */
+
+/**
+ * @brief Default keepalive idle time of the download connections (seconds), 0 to disable the keepalive
+ */
+#ifndef CONFIG_MENDER_NET_DOWNLOAD_KEEPALIVE_IDLE
+#define CONFIG_MENDER_NET_DOWNLOAD_KEEPALIVE_IDLE (0)
+#endif /* CONFIG_MENDER_NET_DOWNLOAD_KEEPALIVE_IDLE */
+
+/**
+ * @brief Default receive buffer size of the interactive connections (bytes), 0 to keep the default of the network stack
+ */
+#ifndef CONFIG_MENDER_NET_INTERACTIVE_RCVBUF
+#define CONFIG_MENDER_NET_INTERACTIVE_RCVBUF (0)
+#endif /* CONFIG_MENDER_NET_INTERACTIVE_RCVBUF */
+
+/**
+ * @brief Default keepalive idle time of the interactive connections (seconds), 0 to disable the keepalive
+ */
+#ifndef CONFIG_MENDER_NET_INTERACTIVE_KEEPALIVE_IDLE
+#define CONFIG_MENDER_NET_INTERACTIVE_KEEPALIVE_IDLE (0)
+#endif /* CONFIG_MENDER_NET_INTERACTIVE_KEEPALIVE_IDLE */
+
+#ifdef CONFIG_MENDER_NET_TLS_MAX_FRAGMENT_LENGTH
+
+/* The native TLS sockets negotiate the Maximum Fragment Length (RFC 6066) matching the record buffer size MBEDTLS_SSL_MAX_CONTENT_LEN */
+#ifndef CONFIG_MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+#error "Negotiation of the TLS Maximum Fragment Length requires CONFIG_MBEDTLS_SSL_MAX_FRAGMENT_LENGTH"
+#endif /* CONFIG_MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+#endif /* CONFIG_MENDER_NET_TLS_MAX_FRAGMENT_LENGTH */
+
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+/**
+ * @brief Default maximum number of sockets served by the network reactor
+ */
+#ifndef CONFIG_MENDER_NET_REACTOR_SOCKETS
+#define CONFIG_MENDER_NET_REACTOR_SOCKETS (4)
+#endif /* CONFIG_MENDER_NET_REACTOR_SOCKETS */
+
+/**
+ * @brief Default network reactor thread stack size (kB)
+ */
+#ifndef CONFIG_MENDER_NET_REACTOR_THREAD_STACK_SIZE
+#define CONFIG_MENDER_NET_REACTOR_THREAD_STACK_SIZE (4)
+#endif /* CONFIG_MENDER_NET_REACTOR_THREAD_STACK_SIZE */
+
+/**
+ * @brief Default network reactor thread priority
+ */
+#ifndef CONFIG_MENDER_NET_REACTOR_THREAD_PRIORITY
+#define CONFIG_MENDER_NET_REACTOR_THREAD_PRIORITY (5)
+#endif /* CONFIG_MENDER_NET_REACTOR_THREAD_PRIORITY */
+
+/**
+ * @brief Default network reactor poll interval (milliseconds), the sockets added are polled at the latest after this delay
+ */
+#ifndef CONFIG_MENDER_NET_REACTOR_POLL_INTERVAL
+#define CONFIG_MENDER_NET_REACTOR_POLL_INTERVAL (100)
+#endif /* CONFIG_MENDER_NET_REACTOR_POLL_INTERVAL */
+
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
+/**
+ * @brief DNS cache and mutex, the addresses are shared by the HTTP and WebSocket connections
+ */
+static struct {
+    char           *host;           /**< Host name, NULL if the entry is not used */
+    char           *port;           /**< Port */
+    struct sockaddr address;        /**< Address of the host */
+    socklen_t       address_length; /**< Length of the address */
+    int64_t         expiration;     /**< Uptime at which the address expires (milliseconds) */
+} mender_net_dns_cache[CONFIG_MENDER_NET_DNS_CACHE_SIZE];
+static K_MUTEX_DEFINE(mender_net_dns_cache_mutex);
+
+/**
+ * @brief Address family of the last successful connection, its addresses are attempted first
+ */
+static int mender_net_preferred_family = AF_INET6;
+
+/**
+ * @brief Socket options of the classes of connections and mutex
+ */
+static mender_net_socket_options_t mender_net_socket_options[MENDER_NET_SOCKET_CLASS_COUNT] = {
+    [MENDER_NET_SOCKET_CLASS_API]         = { .rcvbuf         = CONFIG_MENDER_NET_API_RCVBUF,
+                                              .nodelay        = IS_ENABLED(CONFIG_MENDER_NET_API_NODELAY),
+                                              .keepalive_idle = CONFIG_MENDER_NET_API_KEEPALIVE_IDLE },
+    [MENDER_NET_SOCKET_CLASS_DOWNLOAD]    = { .rcvbuf         = CONFIG_MENDER_NET_DOWNLOAD_RCVBUF,
+                                              .nodelay        = IS_ENABLED(CONFIG_MENDER_NET_DOWNLOAD_NODELAY),
+                                              .keepalive_idle = CONFIG_MENDER_NET_DOWNLOAD_KEEPALIVE_IDLE },
+    [MENDER_NET_SOCKET_CLASS_INTERACTIVE] = { .rcvbuf         = CONFIG_MENDER_NET_INTERACTIVE_RCVBUF,
+                                              .nodelay        = IS_ENABLED(CONFIG_MENDER_NET_INTERACTIVE_NODELAY),
+                                              .keepalive_idle = CONFIG_MENDER_NET_INTERACTIVE_KEEPALIVE_IDLE },
+};
+static K_MUTEX_DEFINE(mender_net_socket_options_mutex);
+
+/**
+ * @brief Address attempted to connect
+ */
+typedef struct {
+    struct sockaddr address;        /**< Address of the host */
+    socklen_t       address_length; /**< Length of the address */
+} mender_net_address_t;
+
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+/**
+ * @brief Sockets served by the network reactor and mutex, the mutex is held while the callbacks are invoked
+ */
+static struct {
+    int sock;                              /**< Socket, -1 if the entry is not used */
+    mender_err_t (*callback)(int, void *); /**< Callback invoked when data is available, NULL if the socket is only registered to be cancelled */
+    void *params;                          /**< Callback parameters */
+    bool  cancelled;                       /**< Flag used to indicate the socket has been shut down by mender_net_reactor_cancel */
+} mender_net_reactor_sockets[CONFIG_MENDER_NET_REACTOR_SOCKETS];
+static K_MUTEX_DEFINE(mender_net_reactor_mutex);
+
+/**
+ * @brief Network reactor thread handle and stack, the thread is started when the first socket is added
+ */
+static struct k_thread mender_net_reactor_thread_handle;
+static bool            mender_net_reactor_started = false;
+K_THREAD_STACK_DEFINE(mender_net_reactor_thread_stack, CONFIG_MENDER_NET_REACTOR_THREAD_STACK_SIZE * 1024);
+
+/**
+ * @brief Network reactor thread, polling all the sockets and invoking the callbacks when data is available
+ * @param p1 Not used
+ * @param p2 Not used
+ * @param p3 Not used
+ */
+static void mender_net_reactor_thread(void *p1, void *p2, void *p3);
+
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
+/**
+ * @brief Retrieve the address of a host from the DNS cache
+ * @param host Host
+ * @param port Port
+ * @param address Address of the host
+ * @param address_length Length of the address
+ * @return true if the address is in the cache and has not expired, false otherwise
+ */
+static bool mender_net_dns_cache_get(const char *host, const char *port, struct sockaddr *address, socklen_t *address_length);
+
+/**
+ * @brief Store the address of a host in the DNS cache, the oldest entry is replaced if the cache is full
+ * @param host Host
+ * @param port Port
+ * @param address Address of the host
+ * @param address_length Length of the address
+ */
+static void mender_net_dns_cache_set(const char *host, const char *port, struct sockaddr *address, socklen_t address_length);
+
+/**
+ * @brief Remove the address of a host from the DNS cache, invoked when the connection to the host fails
+ * @param host Host
+ * @param port Port
+ */
+static void mender_net_dns_cache_invalidate(const char *host, const char *port);
+
+/**
+ * @brief Sort the addresses resolved, the families are interleaved beginning with the preferred one (RFC 8305)
+ * @param addr Addresses resolved
+ * @param addresses Addresses sorted
+ * @param count Number of addresses sorted, up to CONFIG_MENDER_NET_CONNECT_ATTEMPTS
+ */
+static void mender_net_sort_addresses(struct zsock_addrinfo *addr, mender_net_address_t *addresses, size_t *count);
+
+/**
+ * @brief Create a socket and set its TLS options
+ * @param host Host
+ * @param family Address family
+ * @param sock Client socket
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_net_socket_create(const char *host, int family, int *sock);
+
+/**
+ * @brief Begin a non-blocking connection to an address
+ * @param host Host
+ * @param address Address of the host
+ * @param sock Client socket
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_net_connect_begin(const char *host, mender_net_address_t *address, int *sock);
+
+/**
+ * @brief Race the connections to the addresses, the next address is attempted after CONFIG_MENDER_NET_CONNECT_ATTEMPT_DELAY or as soon as the attempts in
+ * progress have failed, the first connection established is kept and the others are closed
+ * @param host Host
+ * @param addresses Addresses of the host
+ * @param count Number of addresses
+ * @param sock Client socket, in blocking mode
+ * @param winner Index of the address connected
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_net_connect_race(const char *host, mender_net_address_t *addresses, size_t count, int *sock, size_t *winner);
+
 mender_err_t
 mender_net_get_host_port_url(char *path, char *config_host, char **host, char **port, char **url) {
 
@@ -48,15 +311,20 @@ mender_net_get_host_port_url(char *path, char *config_host, char **host, char **
 
         /* Path contain the URL only, retrieve host and port from configuration */
         assert(NULL != url);
-        if (NULL == (*url = strdup(path))) {
+        if (NULL == (*url = mender_strdup(path))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
-        return mender_net_get_host_port_url(config_host, NULL, host, port, NULL);
+        if (MENDER_OK != mender_net_get_host_port_url(config_host, NULL, host, port, NULL)) {
+            mender_free(*url);
+            *url = NULL;
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
     }
 
     /* Create a working copy of the path */
-    if (NULL == (tmp = strdup(path))) {
+    if (NULL == (tmp = mender_strdup(path))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -66,33 +334,55 @@ mender_net_get_host_port_url(char *path, char *config_host, char **host, char **
     char *pch1     = strtok_r(NULL, "/", &saveptr);
 
     /* Check if the host contains port */
+    *host      = NULL;
+    *port      = NULL;
     char *pch2 = strchr(pch1, ':');
     if (NULL != pch2) {
         /* Port is specified */
-        if (NULL == (*host = malloc(pch2 - pch1 + 1))) {
-            mender_log_error("Unable to allocate memory");
-            free(tmp);
-            return MENDER_FAIL;
+        if (NULL == (*host = mender_malloc(pch2 - pch1 + 1))) {
+            goto FAIL;
         }
         strncpy(*host, pch1, pch2 - pch1);
-        *port = strdup(pch2 + 1);
+        (*host)[pch2 - pch1] = '\0';
+        if (NULL == (*port = mender_strdup(pch2 + 1))) {
+            goto FAIL;
+        }
     } else {
         /* Port is not specified */
-        *host = strdup(pch1);
+        if (NULL == (*host = mender_strdup(pch1))) {
+            goto FAIL;
+        }
         if ((true == mender_utils_strbeginwith(path, "http://")) || (true == mender_utils_strbeginwith(path, "ws://"))) {
-            *port = strdup("80");
-        } else if ((true == mender_utils_strbeginwith(path, "https://")) || (true == mender_utils_strbeginwith(path, "wss://"))) {
-            *port = strdup("443");
+            *port = mender_strdup("80");
+        } else {
+            *port = mender_strdup("443");
+        }
+        if (NULL == *port) {
+            goto FAIL;
         }
     }
     if (NULL != url) {
-        *url = strdup(path + strlen(protocol) + 2 + strlen(pch1));
+        if (NULL == (*url = mender_strdup(path + strlen(protocol) + 2 + strlen(pch1)))) {
+            goto FAIL;
+        }
     }
 
     /* Release memory */
-    free(tmp);
+    mender_free(tmp);
 
     return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_log_error("Unable to allocate memory");
+    mender_free(tmp);
+    mender_free(*host);
+    *host = NULL;
+    mender_free(*port);
+    *port = NULL;
+
+    return MENDER_FAIL;
 }
 
 mender_err_t
@@ -105,10 +395,21 @@ mender_net_connect(const char *host, const char *port, int *sock) {
     mender_err_t           ret = MENDER_OK;
     struct zsock_addrinfo  hints;
     struct zsock_addrinfo *addr = NULL;
+    mender_net_address_t   addresses[CONFIG_MENDER_NET_CONNECT_ATTEMPTS];
+    size_t                 count = 1;
+    size_t                 winner;
+
+    /* Trace the connection */
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_NET_CONNECT);
+#ifdef CONFIG_MENDER_CLIENT_METRICS
+    uint64_t start_us = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_CLIENT_METRICS */
 
     /* Set hints */
     memset(&hints, 0, sizeof(hints));
-    if (IS_ENABLED(CONFIG_NET_IPV6)) {
+    if (IS_ENABLED(CONFIG_NET_IPV6) && IS_ENABLED(CONFIG_NET_IPV4)) {
+        hints.ai_family = AF_UNSPEC;
+    } else if (IS_ENABLED(CONFIG_NET_IPV6)) {
         hints.ai_family = AF_INET6;
     } else if (IS_ENABLED(CONFIG_NET_IPV4)) {
         hints.ai_family = AF_INET;
@@ -116,22 +417,357 @@ mender_net_connect(const char *host, const char *port, int *sock) {
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_protocol = IPPROTO_TCP;
 
-    /* Perform DNS resolution of the host */
-    if (0 != (result = zsock_getaddrinfo(host, port, &hints, &addr))) {
-        mender_log_error("Unable to resolve host name '%s:%s', result = %d, errno = %d", host, port, result, errno);
-        ret = MENDER_FAIL;
+    /* Perform DNS resolution of the host if its address is not in the cache, all the addresses resolved are attempted */
+    if (false == mender_net_dns_cache_get(host, port, &addresses[0].address, &addresses[0].address_length)) {
+        if (0 != (result = zsock_getaddrinfo(host, port, &hints, &addr))) {
+            mender_log_error("Unable to resolve host name '%s:%s', result = %d, errno = %d", host, port, result, errno);
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        mender_net_sort_addresses(addr, addresses, &count);
+        if (0 == count) {
+            mender_log_error("Unable to resolve host name '%s:%s', no address found", host, port);
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+
+    /* Connect to the host, the address is removed from the cache on failure so that the host name is resolved again on the next connection */
+    if (MENDER_OK != (ret = mender_net_connect_race(host, addresses, count, sock, &winner))) {
+        mender_log_error("Unable to connect to the host '%s:%s'", host, port);
+        mender_net_dns_cache_invalidate(host, port);
         goto END;
     }
 
+    /* Store the address connected, its family is attempted first on the next resolutions */
+    if (NULL != addr) {
+        mender_net_dns_cache_set(host, port, &addresses[winner].address, addresses[winner].address_length);
+    }
+    __atomic_store_n(&mender_net_preferred_family, addresses[winner].address.sa_family, __ATOMIC_RELAXED);
+
+END:
+
+    /* Release memory */
+    if (NULL != addr) {
+        zsock_freeaddrinfo(addr);
+    }
+    if (MENDER_OK == ret) {
+        MENDER_METRICS_SET(MENDER_METRICS_CONNECT_DURATION, (uint32_t)((mender_scheduler_get_uptime_us() - start_us) / 1000));
+    }
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_NET_CONNECT);
+
+    return ret;
+}
+
+mender_err_t
+mender_net_disconnect(int sock) {
+
+    /* Close socket */
+    zsock_close(sock);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_net_set_socket_options(mender_net_socket_class_t socket_class, mender_net_socket_options_t *options) {
+
+    assert(NULL != options);
+
+    /* Check the class */
+    if (socket_class >= MENDER_NET_SOCKET_CLASS_COUNT) {
+        mender_log_error("Invalid socket class %d", socket_class);
+        return MENDER_FAIL;
+    }
+
+    /* Take mutex used to protect access to the socket options */
+    k_mutex_lock(&mender_net_socket_options_mutex, K_FOREVER);
+
+    /* Set the options */
+    memcpy(&mender_net_socket_options[socket_class], options, sizeof(mender_net_socket_options_t));
+
+    /* Release mutex used to protect access to the socket options */
+    k_mutex_unlock(&mender_net_socket_options_mutex);
+
+    return MENDER_OK;
+}
+
+void
+mender_net_apply_socket_options(int sock, mender_net_socket_class_t socket_class) {
+
+    assert(socket_class < MENDER_NET_SOCKET_CLASS_COUNT);
+    mender_net_socket_options_t options;
+    int                         value = 1;
+
+    /* Retrieve the options of the class */
+    k_mutex_lock(&mender_net_socket_options_mutex, K_FOREVER);
+    memcpy(&options, &mender_net_socket_options[socket_class], sizeof(mender_net_socket_options_t));
+    k_mutex_unlock(&mender_net_socket_options_mutex);
+
+    /* Set the receive buffer size, a larger buffer opens the receive window on the links with a high round-trip time */
+    if (0 < options.rcvbuf) {
+        if (zsock_setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf, sizeof(int)) < 0) {
+            mender_log_warning("Unable to set SO_RCVBUF option, errno = %d", errno);
+        }
+    }
+
+    /* Set TCP_NODELAY option, the small messages of the interactive sessions are sent immediately */
+    if (true == options.nodelay) {
+        if (zsock_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(int)) < 0) {
+            mender_log_warning("Unable to set TCP_NODELAY option, errno = %d", errno);
+        }
+    }
+
+    /* Set the keepalive options, the dead connections are detected while the long-lived sessions are idle */
+    if (0 < options.keepalive_idle) {
+        if (zsock_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &value, sizeof(int)) < 0) {
+            mender_log_warning("Unable to set SO_KEEPALIVE option, errno = %d", errno);
+        } else if (zsock_setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &options.keepalive_idle, sizeof(int)) < 0) {
+            mender_log_warning("Unable to set TCP_KEEPIDLE option, errno = %d", errno);
+        }
+    }
+}
+
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+mender_err_t
+mender_net_reactor_add(int sock, mender_err_t (*callback)(int, void *), void *params) {
+
+    mender_err_t ret = MENDER_FAIL;
+
+    /* Take mutex used to protect access to the sockets */
+    k_mutex_lock(&mender_net_reactor_mutex, K_FOREVER);
+
+    /* Start the network reactor thread on the first call */
+    if (false == mender_net_reactor_started) {
+        for (size_t index = 0; index < CONFIG_MENDER_NET_REACTOR_SOCKETS; index++) {
+            mender_net_reactor_sockets[index].sock = -1;
+        }
+        k_thread_create(&mender_net_reactor_thread_handle,
+                        mender_net_reactor_thread_stack,
+                        CONFIG_MENDER_NET_REACTOR_THREAD_STACK_SIZE * 1024,
+                        mender_net_reactor_thread,
+                        NULL,
+                        NULL,
+                        NULL,
+                        CONFIG_MENDER_NET_REACTOR_THREAD_PRIORITY,
+                        0,
+                        K_NO_WAIT);
+        k_thread_name_set(&mender_net_reactor_thread_handle, "mender_net_reactor");
+        mender_net_reactor_started = true;
+    }
+
+    /* Add the socket */
+    for (size_t index = 0; index < CONFIG_MENDER_NET_REACTOR_SOCKETS; index++) {
+        if (-1 == mender_net_reactor_sockets[index].sock) {
+            mender_net_reactor_sockets[index].sock      = sock;
+            mender_net_reactor_sockets[index].callback  = callback;
+            mender_net_reactor_sockets[index].params    = params;
+            mender_net_reactor_sockets[index].cancelled = false;
+            ret                                         = MENDER_OK;
+            break;
+        }
+    }
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to add socket to the network reactor, too many sockets");
+    }
+
+    /* Release mutex used to protect access to the sockets */
+    k_mutex_unlock(&mender_net_reactor_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_net_reactor_remove(int sock) {
+
+    mender_err_t ret = MENDER_OK;
+
+    /* Take mutex used to protect access to the sockets, the callback is not being invoked once it is taken */
+    k_mutex_lock(&mender_net_reactor_mutex, K_FOREVER);
+
+    /* Remove the socket */
+    for (size_t index = 0; index < CONFIG_MENDER_NET_REACTOR_SOCKETS; index++) {
+        if ((true == mender_net_reactor_started) && (sock == mender_net_reactor_sockets[index].sock)) {
+            ret                                    = (true == mender_net_reactor_sockets[index].cancelled) ? MENDER_DONE : MENDER_OK;
+            mender_net_reactor_sockets[index].sock = -1;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the sockets */
+    k_mutex_unlock(&mender_net_reactor_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_net_reactor_cancel(void) {
+
+    /* Take mutex used to protect access to the sockets */
+    k_mutex_lock(&mender_net_reactor_mutex, K_FOREVER);
+
+    /* Shut down the sockets of the requests in progress, the requests fail immediately */
+    for (size_t index = 0; index < CONFIG_MENDER_NET_REACTOR_SOCKETS; index++) {
+        if ((true == mender_net_reactor_started) && (-1 != mender_net_reactor_sockets[index].sock) && (NULL == mender_net_reactor_sockets[index].callback)) {
+            zsock_shutdown(mender_net_reactor_sockets[index].sock, ZSOCK_SHUT_RDWR);
+            mender_net_reactor_sockets[index].cancelled = true;
+        }
+    }
+
+    /* Release mutex used to protect access to the sockets */
+    k_mutex_unlock(&mender_net_reactor_mutex);
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
+static bool
+mender_net_dns_cache_get(const char *host, const char *port, struct sockaddr *address, socklen_t *address_length) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != address);
+    assert(NULL != address_length);
+    bool found = false;
+
+    /* Take mutex used to protect access to the DNS cache */
+    k_mutex_lock(&mender_net_dns_cache_mutex, K_FOREVER);
+
+    /* Search the host in the DNS cache, the expired address is not returned */
+    for (size_t index = 0; index < CONFIG_MENDER_NET_DNS_CACHE_SIZE; index++) {
+        if ((NULL != mender_net_dns_cache[index].host) && (!strcmp(host, mender_net_dns_cache[index].host))
+            && (!strcmp(port, mender_net_dns_cache[index].port))) {
+            if (k_uptime_get() < mender_net_dns_cache[index].expiration) {
+                memcpy(address, &mender_net_dns_cache[index].address, mender_net_dns_cache[index].address_length);
+                *address_length = mender_net_dns_cache[index].address_length;
+                found           = true;
+            }
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the DNS cache */
+    k_mutex_unlock(&mender_net_dns_cache_mutex);
+
+    return found;
+}
+
+static void
+mender_net_dns_cache_set(const char *host, const char *port, struct sockaddr *address, socklen_t address_length) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != address);
+    size_t selected = 0;
+
+    /* Take mutex used to protect access to the DNS cache */
+    k_mutex_lock(&mender_net_dns_cache_mutex, K_FOREVER);
+
+    /* Select the entry of the host if it is already in the cache, a free entry or the entry expiring first otherwise */
+    for (size_t index = 0; index < CONFIG_MENDER_NET_DNS_CACHE_SIZE; index++) {
+        if ((NULL != mender_net_dns_cache[index].host) && (!strcmp(host, mender_net_dns_cache[index].host))
+            && (!strcmp(port, mender_net_dns_cache[index].port))) {
+            selected = index;
+            break;
+        }
+        if ((NULL != mender_net_dns_cache[selected].host)
+            && ((NULL == mender_net_dns_cache[index].host) || (mender_net_dns_cache[index].expiration < mender_net_dns_cache[selected].expiration))) {
+            selected = index;
+        }
+    }
+
+    /* Store the address, it is not cached if the memory can not be allocated */
+    if (selected < CONFIG_MENDER_NET_DNS_CACHE_SIZE) {
+        char *host_copy = mender_strdup(host);
+        char *port_copy = mender_strdup(port);
+        if ((NULL != host_copy) && (NULL != port_copy)) {
+            if (NULL != mender_net_dns_cache[selected].host) {
+                mender_free(mender_net_dns_cache[selected].host);
+                mender_free(mender_net_dns_cache[selected].port);
+            }
+            mender_net_dns_cache[selected].host = host_copy;
+            mender_net_dns_cache[selected].port = port_copy;
+            memcpy(&mender_net_dns_cache[selected].address, address, address_length);
+            mender_net_dns_cache[selected].address_length = address_length;
+            mender_net_dns_cache[selected].expiration     = k_uptime_get() + (int64_t)CONFIG_MENDER_NET_DNS_CACHE_TTL * 1000;
+        } else {
+            mender_free(host_copy);
+            mender_free(port_copy);
+        }
+    }
+
+    /* Release mutex used to protect access to the DNS cache */
+    k_mutex_unlock(&mender_net_dns_cache_mutex);
+}
+
+static void
+mender_net_dns_cache_invalidate(const char *host, const char *port) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+
+    /* Take mutex used to protect access to the DNS cache */
+    k_mutex_lock(&mender_net_dns_cache_mutex, K_FOREVER);
+
+    /* Remove the host from the DNS cache */
+    for (size_t index = 0; index < CONFIG_MENDER_NET_DNS_CACHE_SIZE; index++) {
+        if ((NULL != mender_net_dns_cache[index].host) && (!strcmp(host, mender_net_dns_cache[index].host))
+            && (!strcmp(port, mender_net_dns_cache[index].port))) {
+            mender_free(mender_net_dns_cache[index].host);
+            mender_free(mender_net_dns_cache[index].port);
+            mender_net_dns_cache[index].host = NULL;
+            mender_net_dns_cache[index].port = NULL;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the DNS cache */
+    k_mutex_unlock(&mender_net_dns_cache_mutex);
+}
+
+static void
+mender_net_sort_addresses(struct zsock_addrinfo *addr, mender_net_address_t *addresses, size_t *count) {
+
+    assert(NULL != addresses);
+    assert(NULL != count);
+    int                    preferred   = __atomic_load_n(&mender_net_preferred_family, __ATOMIC_RELAXED);
+    int                    families[2] = { preferred, (AF_INET6 == preferred) ? AF_INET : AF_INET6 };
+    struct zsock_addrinfo *cursors[2]  = { addr, addr };
+    size_t                 turn        = 0;
+
+    /* Take alternately the next address of each family, the remaining addresses of a family are taken once the other has been exhausted */
+    *count = 0;
+    while ((*count < CONFIG_MENDER_NET_CONNECT_ATTEMPTS) && ((NULL != cursors[0]) || (NULL != cursors[1]))) {
+        while ((NULL != cursors[turn]) && (families[turn] != cursors[turn]->ai_family)) {
+            cursors[turn] = cursors[turn]->ai_next;
+        }
+        if (NULL != cursors[turn]) {
+            addresses[*count].address_length = MIN(cursors[turn]->ai_addrlen, sizeof(struct sockaddr));
+            memcpy(&addresses[*count].address, cursors[turn]->ai_addr, addresses[*count].address_length);
+            cursors[turn] = cursors[turn]->ai_next;
+            (*count)++;
+        }
+        turn = 1 - turn;
+    }
+}
+
+static mender_err_t
+mender_net_socket_create(const char *host, int family, int *sock) {
+
+    assert(NULL != host);
+    assert(NULL != sock);
+    int result;
+
     /* Create socket */
 #ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
-    if ((result = zsock_socket(addr->ai_family, SOCK_STREAM, IPPROTO_TLS_1_2)) < 0) {
+    if ((result = zsock_socket(family, SOCK_STREAM, IPPROTO_TLS_1_2)) < 0) {
 #else
-    if ((result = zsock_socket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+    (void)host;
+    if ((result = zsock_socket(family, SOCK_STREAM, IPPROTO_TCP)) < 0) {
 #endif /* CONFIG_NET_SOCKETS_SOCKOPT_TLS */
         mender_log_error("Unable to create socket, result = %d, errno= %d", result, errno);
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
     *sock = result;
 
@@ -145,8 +781,7 @@ mender_net_connect(const char *host, const char *port, int *sock) {
         mender_log_error("Unable to set TLS_SEC_TAG_LIST option, result = %d, errno = %d", result, errno);
         zsock_close(*sock);
         *sock = -1;
-        ret   = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
 
     /* Set TLS_HOSTNAME option */
@@ -154,8 +789,7 @@ mender_net_connect(const char *host, const char *port, int *sock) {
         mender_log_error("Unable to set TLS_HOSTNAME option, result = %d, errno = %d", result, errno);
         zsock_close(*sock);
         *sock = -1;
-        ret   = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
 
     /* Set TLS_PEER_VERIFY option */
@@ -164,36 +798,192 @@ mender_net_connect(const char *host, const char *port, int *sock) {
         mender_log_error("Unable to set TLS_PEER_VERIFY option, result = %d, errno = %d", result, errno);
         zsock_close(*sock);
         *sock = -1;
-        ret   = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_NET_TLS_SESSION_CACHE
+
+    /* Set TLS_SESSION_CACHE option, the session negotiated with the host is stored and offered again on the next connections to perform an abbreviated
+     * handshake, a full handshake is performed if the session is not accepted by the host */
+    int session_cache = TLS_SESSION_CACHE_ENABLED;
+    if ((result = zsock_setsockopt(*sock, SOL_TLS, TLS_SESSION_CACHE, &session_cache, sizeof(int))) < 0) {
+        mender_log_warning("Unable to set TLS_SESSION_CACHE option, result = %d, errno = %d", result, errno);
     }
 
+#endif /* CONFIG_MENDER_NET_TLS_SESSION_CACHE */
+
 #endif /* CONFIG_NET_SOCKETS_SOCKOPT_TLS */
 
-    /* Connect to the host */
-    if (0 != (result = zsock_connect(*sock, addr->ai_addr, addr->ai_addrlen))) {
-        mender_log_error("Unable to connect to the host '%s:%s', result = %d, errno = %d", host, port, result, errno);
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_net_connect_begin(const char *host, mender_net_address_t *address, int *sock) {
+
+    assert(NULL != address);
+    assert(NULL != sock);
+    int          result;
+    mender_err_t ret;
+
+    /* Create socket */
+    if (MENDER_OK != (ret = mender_net_socket_create(host, address->address.sa_family, sock))) {
+        return ret;
+    }
+
+    /* Begin the connection, the socket is polled until it is established */
+    if (((result = zsock_fcntl(*sock, F_GETFL, 0)) < 0) || (zsock_fcntl(*sock, F_SETFL, result | O_NONBLOCK) < 0)) {
+        mender_log_error("Unable to set non-blocking mode, errno = %d", errno);
         zsock_close(*sock);
         *sock = -1;
-        ret   = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
+    }
+    if ((0 != (result = zsock_connect(*sock, &address->address, address->address_length))) && (EINPROGRESS != errno)) {
+        mender_log_warning("Unable to connect to the address of family %d, result = %d, errno = %d", address->address.sa_family, result, errno);
+        zsock_close(*sock);
+        *sock = -1;
+        return MENDER_FAIL;
     }
 
-END:
+    return MENDER_OK;
+}
 
-    /* Release memory */
-    if (NULL != addr) {
-        zsock_freeaddrinfo(addr);
+static mender_err_t
+mender_net_connect_race(const char *host, mender_net_address_t *addresses, size_t count, int *sock, size_t *winner) {
+
+    assert(NULL != addresses);
+    assert(NULL != sock);
+    assert(NULL != winner);
+    struct zsock_pollfd fds[CONFIG_MENDER_NET_CONNECT_ATTEMPTS];
+    size_t              indexes[CONFIG_MENDER_NET_CONNECT_ATTEMPTS];
+    size_t              pending      = 0;
+    size_t              started      = 0;
+    int64_t             now          = k_uptime_get();
+    int64_t             deadline     = now + CONFIG_MENDER_NET_CONNECT_TIMEOUT;
+    int64_t             next_attempt = now;
+    int                 result;
+
+    *sock = -1;
+    while ((-1 == *sock) && (now < deadline)) {
+
+        /* Begin the next attempt once the delay has elapsed or as soon as the attempts in progress have failed */
+        if ((started < count) && ((now >= next_attempt) || (0 == pending))) {
+            if (MENDER_OK == mender_net_connect_begin(host, &addresses[started], &fds[pending].fd)) {
+                fds[pending].events = ZSOCK_POLLOUT;
+                indexes[pending]    = started;
+                pending++;
+            }
+            started++;
+            next_attempt = now + CONFIG_MENDER_NET_CONNECT_ATTEMPT_DELAY;
+            continue;
+        }
+        if (0 == pending) {
+            break;
+        }
+
+        /* Wait for the attempts in progress until the next attempt is due */
+        for (size_t index = 0; index < pending; index++) {
+            fds[index].revents = 0;
+        }
+        if ((result = zsock_poll(fds, pending, (int)(((started < count) ? MIN(next_attempt, deadline) : deadline) - now))) < 0) {
+            mender_log_error("Unable to poll sockets: errno=%d", errno);
+            break;
+        }
+
+        /* Check the attempts completed, the first connection established is kept and the failed attempts are closed */
+        for (size_t index = 0; index < pending;) {
+            if (0 == fds[index].revents) {
+                index++;
+                continue;
+            }
+            int       error  = 0;
+            socklen_t length = sizeof(error);
+            if ((-1 == *sock) && (0 == (fds[index].revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP)))
+                && (0 == zsock_getsockopt(fds[index].fd, SOL_SOCKET, SO_ERROR, &error, &length)) && (0 == error)) {
+                *sock   = fds[index].fd;
+                *winner = indexes[index];
+            } else {
+                zsock_close(fds[index].fd);
+            }
+            pending--;
+            fds[index]     = fds[pending];
+            indexes[index] = indexes[pending];
+        }
+        now = k_uptime_get();
     }
 
-    return ret;
+    /* Close the attempts still in progress */
+    for (size_t index = 0; index < pending; index++) {
+        zsock_close(fds[index].fd);
+    }
+    if (-1 == *sock) {
+        return MENDER_FAIL;
+    }
+
+    /* Restore the blocking mode of the connection established */
+    if (((result = zsock_fcntl(*sock, F_GETFL, 0)) < 0) || (zsock_fcntl(*sock, F_SETFL, result & ~O_NONBLOCK) < 0)) {
+        mender_log_error("Unable to set blocking mode, errno = %d", errno);
+        zsock_close(*sock);
+        *sock = -1;
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
 }
 
-mender_err_t
-mender_net_disconnect(int sock) {
+#ifdef CONFIG_MENDER_NET_REACTOR
 
-    /* Close socket */
-    zsock_close(sock);
+static void
+mender_net_reactor_thread(void *p1, void *p2, void *p3) {
 
-    return MENDER_OK;
+    (void)p1;
+    (void)p2;
+    (void)p3;
+    struct zsock_pollfd fds[CONFIG_MENDER_NET_REACTOR_SOCKETS];
+    size_t              indexes[CONFIG_MENDER_NET_REACTOR_SOCKETS];
+    size_t              count;
+    int                 result;
+
+    while (true) {
+
+        /* Prepare the sockets to be polled, the sockets only registered to be cancelled are read by their owner */
+        k_mutex_lock(&mender_net_reactor_mutex, K_FOREVER);
+        count = 0;
+        for (size_t index = 0; index < CONFIG_MENDER_NET_REACTOR_SOCKETS; index++) {
+            if ((-1 != mender_net_reactor_sockets[index].sock) && (NULL != mender_net_reactor_sockets[index].callback)) {
+                fds[count].fd      = mender_net_reactor_sockets[index].sock;
+                fds[count].events  = ZSOCK_POLLIN;
+                fds[count].revents = 0;
+                indexes[count]     = index;
+                count++;
+            }
+        }
+        k_mutex_unlock(&mender_net_reactor_mutex);
+
+        /* Wait for data, the sockets added meanwhile are polled at the next iteration */
+        if (0 == count) {
+            k_msleep(CONFIG_MENDER_NET_REACTOR_POLL_INTERVAL);
+            continue;
+        }
+        if ((result = zsock_poll(fds, count, CONFIG_MENDER_NET_REACTOR_POLL_INTERVAL)) <= 0) {
+            if (result < 0) {
+                mender_log_error("Unable to poll sockets: errno=%d", errno);
+                k_msleep(CONFIG_MENDER_NET_REACTOR_POLL_INTERVAL);
+            }
+            continue;
+        }
+
+        /* Invoke the callbacks of the sockets which are still registered, the socket is removed if the callback fails */
+        k_mutex_lock(&mender_net_reactor_mutex, K_FOREVER);
+        for (size_t index = 0; index < count; index++) {
+            if ((0 != fds[index].revents) && (fds[index].fd == mender_net_reactor_sockets[indexes[index]].sock)
+                && (NULL != mender_net_reactor_sockets[indexes[index]].callback)) {
+                if (MENDER_OK != mender_net_reactor_sockets[indexes[index]].callback(fds[index].fd, mender_net_reactor_sockets[indexes[index]].params)) {
+                    mender_net_reactor_sockets[indexes[index]].sock = -1;
+                }
+            }
+        }
+        k_mutex_unlock(&mender_net_reactor_mutex);
+    }
 }
+
+#endif /* CONFIG_MENDER_NET_REACTOR */
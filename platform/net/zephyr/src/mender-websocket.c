@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_HTTP
+
 #include <errno.h>
 #include <version.h>
 #include <zephyr/kernel.h>
@@ -53,6 +58,13 @@
 #define CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE (1)
 #endif /* CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE */
 
+/**
+ * @brief Websocket maximum message size (kB), larger messages are discarded
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX
+#define CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX (64)
+#endif /* CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX */
+
 /**
  * @brief Websocket connect timeout (milliseconds)
  */
@@ -83,10 +95,17 @@ typedef struct {
     char                   **headers;       /**< Headers */
     struct websocket_request request;       /**< Websocket request */
     int                      client;        /**< Websocket client handle */
-    uint8_t                 *data;          /**< Websocket data received from the server */
+    uint8_t                 *data;          /**< Websocket data received from the server, the buffer is reused for all the messages */
     size_t                   data_len;      /**< Websocket data length received from the server */
-    struct k_thread          thread_handle; /**< Websocket thread handle */
-    bool                     abort;         /**< Flag used to indicate connection should be terminated */
+    size_t                   data_size;     /**< Websocket data buffer size, grown up to the maximum message size */
+    bool                     discard;       /**< Flag used to indicate the message being received is discarded */
+    uint64_t                 remaining;     /**< Length of the message remaining to be received */
+#ifdef CONFIG_MENDER_NET_REACTOR
+    bool closed; /**< Flag used to indicate the disconnected callback has been invoked */
+#else
+    struct k_thread thread_handle; /**< Websocket thread handle */
+#endif /* CONFIG_MENDER_NET_REACTOR */
+    bool abort; /**< Flag used to indicate connection should be terminated */
     mender_err_t (*callback)(mender_websocket_client_event_t,
                              void *,
                              size_t,
@@ -99,6 +118,18 @@ typedef struct {
  */
 static mender_websocket_config_t mender_websocket_config;
 
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+/**
+ * @brief Network reactor callback used to perform reception of the data available
+ * @param sock Websocket client handle
+ * @param params Websocket handle
+ * @return MENDER_OK if the function succeeds, error code otherwise to stop polling the connection
+ */
+static mender_err_t mender_websocket_reactor_callback(int sock, void *params);
+
+#else
+
 /**
  * @brief Mender websocket thread stack
  */
@@ -112,6 +143,24 @@ K_THREAD_STACK_DEFINE(mender_websocket_thread_stack, CONFIG_MENDER_WEBSOCKET_THR
  */
 static void mender_websocket_thread(void *p1, void *p2, void *p3);
 
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
+/**
+ * @brief Perform reception of a websocket message or a part of it
+ * @param handle Websocket handle
+ * @param timeout Reception timeout (milliseconds)
+ * @return MENDER_OK if data has been received, MENDER_DONE if no data is available, MENDER_FAIL if the connection has been closed
+ */
+static mender_err_t mender_websocket_receive(mender_websocket_handle_t *handle, int32_t timeout);
+
+/**
+ * @brief Grow the buffer used to receive the messages so that the message being received fits
+ * @param handle Websocket handle
+ * @param remaining Length of the message remaining to be received
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_websocket_grow(mender_websocket_handle_t *handle, uint64_t remaining);
+
 mender_err_t
 mender_websocket_init(mender_websocket_config_t *config) {
 
@@ -134,7 +183,7 @@ mender_websocket_connect(
     size_t       header_index = 0;
 
     /* Allocate a new handle */
-    if (NULL == (*handle = malloc(sizeof(mender_websocket_handle_t)))) {
+    if (NULL == (*handle = mender_malloc(sizeof(mender_websocket_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -161,20 +210,27 @@ mender_websocket_connect(
     ((mender_websocket_handle_t *)*handle)->request.url  = ((mender_websocket_handle_t *)*handle)->url;
     ((mender_websocket_handle_t *)*handle)->request.host = ((mender_websocket_handle_t *)*handle)->host;
     /* We need to allocate bigger buffer for the websocket data we receive so that the websocket header fits into it */
-    if (NULL == (((mender_websocket_handle_t *)*handle)->request.tmp_buf = (uint8_t *)malloc((CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024) + 32))) {
+    if (NULL == (((mender_websocket_handle_t *)*handle)->request.tmp_buf = (uint8_t *)mender_malloc((CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024) + 32))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     ((mender_websocket_handle_t *)*handle)->request.tmp_buf_len = (CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024) + 32;
-    if (NULL == (((mender_websocket_handle_t *)*handle)->headers = malloc(3 * sizeof(char *)))) {
+    /* The buffer used to receive the messages is allocated once and reused, it is grown only when a larger message is received */
+    if (NULL == (((mender_websocket_handle_t *)*handle)->data = (uint8_t *)mender_malloc(CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    ((mender_websocket_handle_t *)*handle)->data_size = CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024;
+    if (NULL == (((mender_websocket_handle_t *)*handle)->headers = mender_malloc(3 * sizeof(char *)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(((mender_websocket_handle_t *)*handle)->headers, 0, 3 * sizeof(char *));
     size_t str_length = strlen("User-Agent: ") + strlen(MENDER_WEBSOCKET_USER_AGENT) + strlen("\r\n") + 1;
-    if (NULL == (((mender_websocket_handle_t *)*handle)->headers[header_index] = malloc(str_length))) {
+    if (NULL == (((mender_websocket_handle_t *)*handle)->headers[header_index] = mender_malloc(str_length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -183,7 +239,7 @@ mender_websocket_connect(
     header_index++;
     if (NULL != jwt) {
         str_length = strlen("Authorization: Bearer ") + strlen(jwt) + strlen("\r\n") + 1;
-        if (NULL == (((mender_websocket_handle_t *)*handle)->headers[header_index] = malloc(str_length))) {
+        if (NULL == (((mender_websocket_handle_t *)*handle)->headers[header_index] = mender_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -200,6 +256,7 @@ mender_websocket_connect(
         mender_log_error("Unable to open HTTP client connection");
         goto FAIL;
     }
+    mender_net_apply_socket_options(((mender_websocket_handle_t *)*handle)->sock, MENDER_NET_SOCKET_CLASS_INTERACTIVE);
 
     /* Upgrade to WebSocket connection */
     if ((((mender_websocket_handle_t *)*handle)->client = websocket_connect(
@@ -215,6 +272,17 @@ mender_websocket_connect(
         goto FAIL;
     }
 
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+    /* Add the connection to the network reactor which performs the reception of data */
+    if (MENDER_OK != (ret = mender_net_reactor_add(((mender_websocket_handle_t *)*handle)->client, &mender_websocket_reactor_callback, *handle))) {
+        mender_log_error("Unable to add websocket connection to the network reactor");
+        websocket_disconnect(((mender_websocket_handle_t *)*handle)->client);
+        goto FAIL;
+    }
+
+#else
+
     /* Create and start websocket thread */
     k_thread_create(&((mender_websocket_handle_t *)*handle)->thread_handle,
                     mender_websocket_thread_stack,
@@ -228,6 +296,8 @@ mender_websocket_connect(
                     K_NO_WAIT);
     k_thread_name_set(&((mender_websocket_handle_t *)*handle)->thread_handle, "mender_websocket");
 
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
     return ret;
 
 FAIL:
@@ -242,25 +312,28 @@ FAIL:
     /* Release memory */
     if (NULL != *handle) {
         if (NULL != ((mender_websocket_handle_t *)*handle)->host) {
-            free(((mender_websocket_handle_t *)*handle)->host);
+            mender_free(((mender_websocket_handle_t *)*handle)->host);
         }
         if (NULL != ((mender_websocket_handle_t *)*handle)->port) {
-            free(((mender_websocket_handle_t *)*handle)->port);
+            mender_free(((mender_websocket_handle_t *)*handle)->port);
         }
         if (NULL != ((mender_websocket_handle_t *)*handle)->url) {
-            free(((mender_websocket_handle_t *)*handle)->url);
+            mender_free(((mender_websocket_handle_t *)*handle)->url);
         }
         if (NULL != ((mender_websocket_handle_t *)*handle)->request.tmp_buf) {
-            free(((mender_websocket_handle_t *)*handle)->request.tmp_buf);
+            mender_free(((mender_websocket_handle_t *)*handle)->request.tmp_buf);
+        }
+        if (NULL != ((mender_websocket_handle_t *)*handle)->data) {
+            mender_free(((mender_websocket_handle_t *)*handle)->data);
         }
         if (NULL != ((mender_websocket_handle_t *)*handle)->headers) {
             header_index = 0;
             while (NULL != ((mender_websocket_handle_t *)*handle)->headers[header_index]) {
-                free(((mender_websocket_handle_t *)*handle)->headers[header_index]);
+                mender_free(((mender_websocket_handle_t *)*handle)->headers[header_index]);
                 header_index++;
             }
         }
-        free(*handle);
+        mender_free(*handle);
         *handle = NULL;
     }
 
@@ -290,6 +363,23 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_websocket_ping(void *handle) {
+
+    assert(NULL != handle);
+    int sent;
+
+    /* Send ping */
+    if (0
+        > (sent = websocket_send_msg(
+                ((mender_websocket_handle_t *)handle)->client, NULL, 0, WEBSOCKET_OPCODE_PING, true, true, CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT))) {
+        mender_log_error("Unable to send ping over websocket connection: %d", sent);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_websocket_disconnect(void *handle) {
 
@@ -297,35 +387,45 @@ mender_websocket_disconnect(void *handle) {
 
     /* Close websocket connection */
     ((mender_websocket_handle_t *)handle)->abort = true;
+#ifdef CONFIG_MENDER_NET_REACTOR
+    mender_net_reactor_remove(((mender_websocket_handle_t *)handle)->client);
+    websocket_disconnect(((mender_websocket_handle_t *)handle)->client);
+
+    /* Invoke disconnected callback if the connection has not been closed by the server */
+    if (false == ((mender_websocket_handle_t *)handle)->closed) {
+        ((mender_websocket_handle_t *)handle)->callback(MENDER_WEBSOCKET_EVENT_DISCONNECTED, NULL, 0, ((mender_websocket_handle_t *)handle)->params);
+    }
+#else
     websocket_disconnect(((mender_websocket_handle_t *)handle)->client);
 
     /* Wait end of execution of the websocket thread */
     k_thread_join(&((mender_websocket_handle_t *)handle)->thread_handle, K_FOREVER);
+#endif /* CONFIG_MENDER_NET_REACTOR */
 
     /* Release memory */
     if (NULL != ((mender_websocket_handle_t *)handle)->host) {
-        free(((mender_websocket_handle_t *)handle)->host);
+        mender_free(((mender_websocket_handle_t *)handle)->host);
     }
     if (NULL != ((mender_websocket_handle_t *)handle)->port) {
-        free(((mender_websocket_handle_t *)handle)->port);
+        mender_free(((mender_websocket_handle_t *)handle)->port);
     }
     if (NULL != ((mender_websocket_handle_t *)handle)->url) {
-        free(((mender_websocket_handle_t *)handle)->url);
+        mender_free(((mender_websocket_handle_t *)handle)->url);
     }
     if (NULL != ((mender_websocket_handle_t *)handle)->request.tmp_buf) {
-        free(((mender_websocket_handle_t *)handle)->request.tmp_buf);
+        mender_free(((mender_websocket_handle_t *)handle)->request.tmp_buf);
     }
     if (NULL != ((mender_websocket_handle_t *)handle)->headers) {
         size_t header_index = 0;
         while (NULL != ((mender_websocket_handle_t *)handle)->headers[header_index]) {
-            free(((mender_websocket_handle_t *)handle)->headers[header_index]);
+            mender_free(((mender_websocket_handle_t *)handle)->headers[header_index]);
             header_index++;
         }
     }
     if (NULL != ((mender_websocket_handle_t *)handle)->data) {
-        free(((mender_websocket_handle_t *)handle)->data);
+        mender_free(((mender_websocket_handle_t *)handle)->data);
     }
-    free(handle);
+    mender_free(handle);
 
     return MENDER_OK;
 }
@@ -337,6 +437,33 @@ mender_websocket_exit(void) {
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_NET_REACTOR
+
+static mender_err_t
+mender_websocket_reactor_callback(int sock, void *params) {
+
+    assert(NULL != params);
+    mender_websocket_handle_t *handle = (mender_websocket_handle_t *)params;
+    mender_err_t               ret;
+    (void)sock;
+
+    /* Perform reception of all the data available, the reactor thread is not blocked */
+    while ((false == handle->abort) && (MENDER_OK == (ret = mender_websocket_receive(handle, 0)))) {
+        /* Continue reading */
+    }
+    if (MENDER_FAIL != ret) {
+        return MENDER_OK;
+    }
+
+    /* Invoke disconnected callback, the connection is not polled anymore */
+    handle->closed = true;
+    handle->callback(MENDER_WEBSOCKET_EVENT_DISCONNECTED, NULL, 0, handle->params);
+
+    return MENDER_FAIL;
+}
+
+#else
+
 static void
 mender_websocket_thread(void *p1, void *p2, void *p3) {
 
@@ -344,88 +471,107 @@ mender_websocket_thread(void *p1, void *p2, void *p3) {
     mender_websocket_handle_t *handle = (mender_websocket_handle_t *)p1;
     (void)p2;
     (void)p3;
+
+    /* Perform reception of data from the websocket connection */
+    while ((false == handle->abort) && (MENDER_FAIL != mender_websocket_receive(handle, SYS_FOREVER_MS))) {
+        /* Continue reading */
+    }
+
+    /* Invoke disconnected callback */
+    handle->callback(MENDER_WEBSOCKET_EVENT_DISCONNECTED, NULL, 0, handle->params);
+}
+
+#endif /* CONFIG_MENDER_NET_REACTOR */
+
+static mender_err_t
+mender_websocket_receive(mender_websocket_handle_t *handle, int32_t timeout) {
+
+    assert(NULL != handle);
     uint8_t *payload;
     int      received;
     uint32_t message_type = 0;
     uint64_t remaining    = 0;
 
-    /* Allocate payload */
-    if (NULL == (payload = (uint8_t *)malloc(CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024))) {
-        mender_log_error("Unable to allocate memory");
-        goto END;
+    /* Grow the buffer if it is full, the data is received directly after the data of the message being reassembled */
+    if ((handle->data_len == handle->data_size) && (MENDER_OK != mender_websocket_grow(handle, handle->remaining))) {
+        handle->data_len = 0;
+        handle->discard  = true;
     }
+    payload = handle->data + handle->data_len;
 
-    /* Perform reception of data from the websocket connection */
-    while (false == handle->abort) {
+    received = websocket_recv_msg(handle->client, payload, handle->data_size - handle->data_len, &message_type, &remaining, timeout);
+    if (received < 0) {
+        if (-EAGAIN == received) {
+            return MENDER_DONE;
+        }
+        if (-ENOTCONN == received) {
+            mender_log_error("Connection has been closed");
+            return MENDER_FAIL;
+        }
+        mender_log_error("Unable to receive websocket message: errno=%d", errno);
+        return MENDER_DONE;
+    }
+    handle->remaining = remaining;
+    if (WEBSOCKET_FLAG_PING == (message_type & WEBSOCKET_FLAG_PING)) {
 
-        received = websocket_recv_msg(handle->client, payload, CONFIG_MENDER_WEBSOCKET_BUFFER_SIZE * 1024, &message_type, &remaining, SYS_FOREVER_MS);
-        if (received < 0) {
-            if (-ENOTCONN == received) {
-                mender_log_error("Connection has been closed");
-                goto END;
-            }
-            mender_log_error("Unable to receive websocket message: errno=%d", errno);
-
-        } else if (received > 0) {
-
-            /* Perform treatment depending of the opcode */
-            if (WEBSOCKET_FLAG_PING == (message_type & WEBSOCKET_FLAG_PING)) {
-
-                /* Send pong message with the same payload */
-                websocket_send_msg(handle->client, payload, received, WEBSOCKET_OPCODE_PONG, true, true, CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT);
-
-            } else if (WEBSOCKET_FLAG_BINARY == (message_type & WEBSOCKET_FLAG_BINARY)) {
-
-                /* Check if the whole packet is received once */
-                if ((NULL == handle->data) && (0 == remaining)) {
-
-                    /* Invoke callback */
-                    if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, payload, received, handle->params)) {
-                        mender_log_error("An error occurred");
-                    }
-
-                } else {
-
-                    /* Concatenate data */
-                    void *tmp = realloc(handle->data, handle->data_len + received);
-                    if (NULL == tmp) {
-                        mender_log_error("Unable to allocate memory");
-                        if (NULL != handle->data) {
-                            free(handle->data);
-                            handle->data     = NULL;
-                            handle->data_len = 0;
-                        }
-                        break;
-                    }
-                    handle->data = tmp;
-                    memcpy(handle->data + handle->data_len, payload, received);
-                    handle->data_len += received;
-
-                    /* Check if the whole packet has been received */
-                    if (0 == remaining) {
-
-                        /* Invoke callback */
-                        if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, handle->data, handle->data_len, handle->params)) {
-                            mender_log_error("An error occurred");
-                        }
-
-                        /* Release memory */
-                        free(handle->data);
-                        handle->data     = NULL;
-                        handle->data_len = 0;
-                    }
-                }
+        /* Send pong message with the same payload */
+        websocket_send_msg(handle->client, payload, received, WEBSOCKET_OPCODE_PONG, true, true, CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT);
+        handle->callback(MENDER_WEBSOCKET_EVENT_HEARTBEAT, NULL, 0, handle->params);
+
+    } else if (WEBSOCKET_FLAG_PONG == (message_type & WEBSOCKET_FLAG_PONG)) {
+
+        /* Connection is alive */
+        handle->callback(MENDER_WEBSOCKET_EVENT_HEARTBEAT, NULL, 0, handle->params);
+
+    } else if ((received > 0) && (WEBSOCKET_FLAG_BINARY == (message_type & WEBSOCKET_FLAG_BINARY))) {
+
+        /* Check if the message is discarded */
+        if (true == handle->discard) {
+            handle->discard = (0 != remaining);
+            return MENDER_OK;
+        }
+
+        /* Concatenate data, it has been received in place */
+        handle->data_len += received;
+
+        /* Check if the whole packet has been received */
+        if (0 == remaining) {
+
+            /* Invoke callback */
+            if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, handle->data, handle->data_len, handle->params)) {
+                mender_log_error("An error occurred");
             }
+
+            /* The buffer is reused for the next message */
+            handle->data_len = 0;
         }
     }
 
-END:
+    return MENDER_OK;
+}
 
-    /* Invoke disconnected callback */
-    handle->callback(MENDER_WEBSOCKET_EVENT_DISCONNECTED, NULL, 0, handle->params);
+static mender_err_t
+mender_websocket_grow(mender_websocket_handle_t *handle, uint64_t remaining) {
 
-    /* Release memory */
-    if (NULL != payload) {
-        free(payload);
+    assert(NULL != handle);
+    uint8_t *tmp;
+    size_t   size;
+
+    /* Check the size of the message, the buffer is not grown beyond the maximum message size */
+    if ((0 == remaining) || (handle->data_len >= CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX * 1024)
+        || (remaining > CONFIG_MENDER_WEBSOCKET_MESSAGE_SIZE_MAX * 1024 - handle->data_len)) {
+        mender_log_error("Message is too large, it is discarded");
+        return MENDER_FAIL;
     }
+
+    /* Grow the buffer to the size of the whole message so that it is reallocated at most once per message */
+    size = handle->data_len + (size_t)remaining;
+    if (NULL == (tmp = (uint8_t *)mender_realloc(handle->data, size))) {
+        mender_log_error("Unable to allocate memory, the message is discarded");
+        return MENDER_FAIL;
+    }
+    handle->data      = tmp;
+    handle->data_size = size;
+
+    return MENDER_OK;
 }
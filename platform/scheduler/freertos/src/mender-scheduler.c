@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_SCHEDULER
+
 #if __has_include("FreeRTOS.h")
 #include <FreeRTOS.h>
 #include <semphr.h>
@@ -29,7 +34,9 @@
 #include <freertos/timers.h>
 #endif /* __has_include("FreeRTOS.h") */
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-scheduler.h"
+#include "mender-trace.h"
 
 /**
  * @brief Default work queue stack size (kB)
@@ -52,16 +59,136 @@
 #define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH (10)
 #endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH */
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief Default high priority work queue stack size (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE (20)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE */
+
+/**
+ * @brief Default high priority work queue priority
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY (6)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY */
+
+/**
+ * @brief Default high priority work queue length
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH (10)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH */
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+#if (0 == configSUPPORT_STATIC_ALLOCATION)
+#error "Static allocation of the scheduler requires configSUPPORT_STATIC_ALLOCATION"
+#endif /* (0 == configSUPPORT_STATIC_ALLOCATION) */
+
+/**
+ * @brief Default number of works of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT */
+
+/**
+ * @brief Default number of mutexes of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT (12)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT */
+
+/**
+ * @brief Default number of tasks of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT (3)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT */
+
+/**
+ * @brief Default stack size of the tasks of the static pool (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE */
+
+/**
+ * @brief Length of the stack of the tasks of the static pool
+ */
+#define MENDER_SCHEDULER_STATIC_TASK_STACK_LENGTH (CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE * 1024 / sizeof(StackType_t))
+
+/**
+ * @brief Default number of queues of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT (2)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT */
+
+/**
+ * @brief Default storage size of the queues of the static pool (bytes)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE (64)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE */
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Work context
  */
 typedef struct {
-    mender_scheduler_work_params_t params;       /**< Work parameters */
-    SemaphoreHandle_t              sem_handle;   /**< Semaphore used to indicate work is pending or executing */
-    TimerHandle_t                  timer_handle; /**< Timer used to periodically execute work */
-    bool                           activated;    /**< Flag indicating the work is activated */
+    mender_scheduler_work_params_t params;             /**< Work parameters */
+    SemaphoreHandle_t              sem_handle;         /**< Semaphore used to indicate work is pending or executing */
+    TimerHandle_t                  timer_handle;       /**< Timer used to periodically execute work */
+    TimerHandle_t                  delay_timer_handle; /**< Timer used to execute work once after a delay */
+    QueueHandle_t                 *work_queue_handle;  /**< Work queue executing the work, chosen according to the work priority */
+    bool                           activated;          /**< Flag indicating the work is activated */
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    mender_scheduler_work_stats_t  stats;              /**< Work statistics */
+    uint64_t                       submission_time;    /**< Uptime of the last submission of the work (microseconds) */
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    void                          *next;               /**< Next work of the list of the works */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    StaticSemaphore_t              sem_buffer;         /**< Semaphore buffer */
+    StaticTimer_t                  timer_buffer;       /**< Timer buffer */
+    StaticTimer_t                  delay_timer_buffer; /**< Delay timer buffer */
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 } mender_scheduler_work_context_t;
 
+/**
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;                                           /**< Task parameters */
+    SemaphoreHandle_t              sem_handle;                                       /**< Semaphore used to indicate the end of the task */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    StaticSemaphore_t              sem_buffer;                                       /**< Semaphore buffer */
+    SemaphoreHandle_t              start_sem_handle;                                 /**< Semaphore used to start the task function */
+    StaticSemaphore_t              start_sem_buffer;                                 /**< Start semaphore buffer */
+    TaskHandle_t                   thread_handle;                                    /**< Thread handle, it is kept to execute the next tasks */
+    StaticTask_t                   thread_buffer;                                    /**< Thread buffer */
+    StackType_t                    stack[MENDER_SCHEDULER_STATIC_TASK_STACK_LENGTH]; /**< Thread stack */
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+} mender_scheduler_task_context_t;
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Queue buffer
+ */
+typedef struct {
+    StaticQueue_t buffer;                                             /**< Queue buffer, the queue handle points to it */
+    uint8_t       storage[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE]; /**< Storage of the items of the queue */
+} mender_scheduler_queue_buffer_t;
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Function used to handle work context timer when it expires
  * @param handle Timer handler
@@ -70,19 +197,211 @@ static void mender_scheduler_timer_callback(TimerHandle_t handle);
 
 /**
  * @brief Thread used to handle work queue
- * @param arg Not used
+ * @param arg Work queue handle
  */
 static void mender_scheduler_work_queue_thread(void *arg);
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Function used to record the statistics of an execution of a work
+ * @param work_context Work context
+ * @param start_time Uptime when the execution of the work function started (microseconds)
+ * @param stop_time Uptime when the execution of the work function stopped (microseconds)
+ */
+static void mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+/**
+ * @brief Function used to execute now the works which periodic execution is due within their slack, their timers are restarted
+ * @param work_context Work context which execution wakes up the device, NULL if none
+ */
+static void mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Thread entry point of the tasks
+ * @param arg Task context
+ */
+static void mender_scheduler_task_thread(void *arg);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Function used to allocate an item of a static pool
+ * @param pool Pool of items
+ * @param used Flags indicating the items of the pool which are used
+ * @param count Number of items of the pool
+ * @param size Size of the items (bytes)
+ * @return Item allocated if the function succeeds, NULL if the pool is exhausted
+ */
+static void *mender_scheduler_pool_alloc(void *pool, bool *used, size_t count, size_t size);
+
+/**
+ * @brief Function used to release an item of a static pool
+ * @param pool Pool of items
+ * @param used Flags indicating the items of the pool which are used
+ * @param size Size of the items (bytes)
+ * @param item Item to be released
+ */
+static void mender_scheduler_pool_free(void *pool, bool *used, size_t size, void *item);
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Work queue handle
  */
 static QueueHandle_t mender_scheduler_work_queue_handle = NULL;
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief High priority work queue handle
+ */
+static QueueHandle_t mender_scheduler_high_priority_work_queue_handle = NULL;
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+/**
+ * @brief List of the works, used to coalesce their periodic executions
+ */
+static mender_scheduler_work_context_t *mender_scheduler_work_list = NULL;
+
+/**
+ * @brief Mutex used to protect the list of the works
+ */
+static SemaphoreHandle_t mender_scheduler_work_list_mutex = NULL;
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Work queue buffer
+ */
+static StaticQueue_t mender_scheduler_work_queue_buffer;
+
+/**
+ * @brief Work queue storage
+ */
+static uint8_t mender_scheduler_work_queue_storage[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH * sizeof(mender_scheduler_work_context_t *)];
+
+/**
+ * @brief Work queue thread buffer
+ */
+static StaticTask_t mender_scheduler_work_queue_thread_buffer;
+
+/**
+ * @brief Work queue thread stack
+ */
+static StackType_t mender_scheduler_work_queue_stack[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(StackType_t)];
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief High priority work queue buffer
+ */
+static StaticQueue_t mender_scheduler_high_priority_work_queue_buffer;
+
+/**
+ * @brief High priority work queue storage
+ */
+static uint8_t
+    mender_scheduler_high_priority_work_queue_storage[CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH * sizeof(mender_scheduler_work_context_t *)];
+
+/**
+ * @brief High priority work queue thread buffer
+ */
+static StaticTask_t mender_scheduler_high_priority_work_queue_thread_buffer;
+
+/**
+ * @brief High priority work queue thread stack
+ */
+static StackType_t mender_scheduler_high_priority_work_queue_stack[CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(StackType_t)];
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+/**
+ * @brief Buffer of the mutex used to protect the list of the works
+ */
+static StaticSemaphore_t mender_scheduler_work_list_mutex_buffer;
+
+/**
+ * @brief Static pool of works
+ */
+static mender_scheduler_work_context_t mender_scheduler_work_pool[CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Flags indicating the works of the static pool which are used
+ */
+static bool mender_scheduler_work_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Static pool of mutexes
+ */
+static StaticSemaphore_t mender_scheduler_mutex_pool[CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT];
+
+/**
+ * @brief Flags indicating the mutexes of the static pool which are used
+ */
+static bool mender_scheduler_mutex_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT];
+
+/**
+ * @brief Static pool of tasks
+ */
+static mender_scheduler_task_context_t mender_scheduler_task_pool[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT];
+
+/**
+ * @brief Flags indicating the tasks of the static pool which are used
+ */
+static bool mender_scheduler_task_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT];
+
+/**
+ * @brief Static pool of queues
+ */
+static mender_scheduler_queue_buffer_t mender_scheduler_queue_pool[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT];
+
+/**
+ * @brief Flags indicating the queues of the static pool which are used
+ */
+static bool mender_scheduler_queue_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT];
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 mender_err_t
 mender_scheduler_init(void) {
 
+    /* Create mutex used to protect the list of the works */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if ((NULL == mender_scheduler_work_list_mutex)
+        && (NULL == (mender_scheduler_work_list_mutex = xSemaphoreCreateMutexStatic(&mender_scheduler_work_list_mutex_buffer)))) {
+#else
+    if ((NULL == mender_scheduler_work_list_mutex) && (NULL == (mender_scheduler_work_list_mutex = xSemaphoreCreateMutex()))) {
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+        mender_log_error("Unable to create mutex");
+        return MENDER_FAIL;
+    }
+
     /* Create and start work queue */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL
+        == (mender_scheduler_work_queue_handle = xQueueCreateStatic(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH,
+                                                                    sizeof(mender_scheduler_work_context_t *),
+                                                                    mender_scheduler_work_queue_storage,
+                                                                    &mender_scheduler_work_queue_buffer))) {
+        mender_log_error("Unable to create work queue");
+        return MENDER_FAIL;
+    }
+    if (NULL
+        == xTaskCreateStatic(mender_scheduler_work_queue_thread,
+                             "mender_scheduler_work_queue",
+                             sizeof(mender_scheduler_work_queue_stack) / sizeof(StackType_t),
+                             &mender_scheduler_work_queue_handle,
+                             CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
+                             mender_scheduler_work_queue_stack,
+                             &mender_scheduler_work_queue_thread_buffer)) {
+        mender_log_error("Unable to create work queue thread");
+        return MENDER_FAIL;
+    }
+#else
     if (NULL == (mender_scheduler_work_queue_handle = xQueueCreate(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH, sizeof(mender_scheduler_work_context_t *)))) {
         mender_log_error("Unable to create work queue");
         return MENDER_FAIL;
@@ -91,12 +410,55 @@ mender_scheduler_init(void) {
         != xTaskCreate(mender_scheduler_work_queue_thread,
                        "mender_scheduler_work_queue",
                        (configSTACK_DEPTH_TYPE)(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
-                       NULL,
+                       &mender_scheduler_work_queue_handle,
                        CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
                        NULL)) {
         mender_log_error("Unable to create work queue thread");
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    /* Create and start high priority work queue */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL
+        == (mender_scheduler_high_priority_work_queue_handle = xQueueCreateStatic(CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH,
+                                                                                  sizeof(mender_scheduler_work_context_t *),
+                                                                                  mender_scheduler_high_priority_work_queue_storage,
+                                                                                  &mender_scheduler_high_priority_work_queue_buffer))) {
+        mender_log_error("Unable to create high priority work queue");
+        return MENDER_FAIL;
+    }
+    if (NULL
+        == xTaskCreateStatic(mender_scheduler_work_queue_thread,
+                             "mender_scheduler_high_priority_work_queue",
+                             sizeof(mender_scheduler_high_priority_work_queue_stack) / sizeof(StackType_t),
+                             &mender_scheduler_high_priority_work_queue_handle,
+                             CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY,
+                             mender_scheduler_high_priority_work_queue_stack,
+                             &mender_scheduler_high_priority_work_queue_thread_buffer)) {
+        mender_log_error("Unable to create high priority work queue thread");
+        return MENDER_FAIL;
+    }
+#else
+    if (NULL
+        == (mender_scheduler_high_priority_work_queue_handle
+            = xQueueCreate(CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH, sizeof(mender_scheduler_work_context_t *)))) {
+        mender_log_error("Unable to create high priority work queue");
+        return MENDER_FAIL;
+    }
+    if (pdPASS
+        != xTaskCreate(mender_scheduler_work_queue_thread,
+                       "mender_scheduler_high_priority_work_queue",
+                       (configSTACK_DEPTH_TYPE)(CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
+                       &mender_scheduler_high_priority_work_queue_handle,
+                       CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY,
+                       NULL)) {
+        mender_log_error("Unable to create high priority work queue thread");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
 
     return MENDER_OK;
 }
@@ -110,23 +472,42 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     assert(NULL != handle);
 
     /* Create work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)malloc(sizeof(mender_scheduler_work_context_t));
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_work_pool, mender_scheduler_work_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT, sizeof(mender_scheduler_work_context_t));
+    if (NULL == work_context) {
+        mender_log_error("Unable to allocate work, the static pool is exhausted");
+        goto FAIL;
+    }
+#else
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_malloc(sizeof(mender_scheduler_work_context_t));
     if (NULL == work_context) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
 
-    /* Copy work parameters */
+    /* Copy work parameters, the name is not copied with the static allocation */
     work_context->params.function = work_params->function;
     work_context->params.period   = work_params->period;
-    if (NULL == (work_context->params.name = strdup(work_params->name))) {
+    work_context->params.priority = work_params->priority;
+    work_context->params.slack    = work_params->slack;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    work_context->params.name = work_params->name;
+#else
+    if (NULL == (work_context->params.name = mender_strdup(work_params->name))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     /* Create semaphore used to protect work function */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL == (work_context->sem_handle = xSemaphoreCreateBinaryStatic(&work_context->sem_buffer))) {
+#else
     if (NULL == (work_context->sem_handle = xSemaphoreCreateBinary())) {
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
         mender_log_error("Unable to create semaphore");
         goto FAIL;
     }
@@ -134,15 +515,53 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     /* Create timer to handle the work periodically */
     if (NULL
         == (work_context->timer_handle
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+            = xTimerCreateStatic(work_context->params.name,
+                                 (work_context->params.period > 0) ? ((1000 * work_context->params.period) / portTICK_PERIOD_MS) : portMAX_DELAY,
+                                 pdTRUE,
+                                 work_context,
+                                 mender_scheduler_timer_callback,
+                                 &work_context->timer_buffer))) {
+#else
             = xTimerCreate(work_context->params.name,
                            (work_context->params.period > 0) ? ((1000 * work_context->params.period) / portTICK_PERIOD_MS) : portMAX_DELAY,
                            pdTRUE,
                            work_context,
                            mender_scheduler_timer_callback))) {
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+        mender_log_error("Unable to create timer");
+        goto FAIL;
+    }
+
+    /* Create timer to handle the work once after a delay */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL
+        == (work_context->delay_timer_handle
+            = xTimerCreateStatic(work_context->params.name, 1, pdFALSE, work_context, mender_scheduler_timer_callback, &work_context->delay_timer_buffer))) {
+#else
+    if (NULL == (work_context->delay_timer_handle = xTimerCreate(work_context->params.name, 1, pdFALSE, work_context, mender_scheduler_timer_callback))) {
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
         mender_log_error("Unable to create timer");
         goto FAIL;
     }
 
+    /* Select the work queue according to the work priority */
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    if (MENDER_SCHEDULER_WORK_PRIORITY_HIGH == work_context->params.priority) {
+        work_context->work_queue_handle = &mender_scheduler_high_priority_work_queue_handle;
+    } else {
+        work_context->work_queue_handle = &mender_scheduler_work_queue_handle;
+    }
+#else
+    work_context->work_queue_handle = &mender_scheduler_work_queue_handle;
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    /* Add the work to the list of the works */
+    xSemaphoreTake(mender_scheduler_work_list_mutex, portMAX_DELAY);
+    work_context->next         = mender_scheduler_work_list;
+    mender_scheduler_work_list = work_context;
+    xSemaphoreGive(mender_scheduler_work_list_mutex);
+
     /* Return handle to the new work */
     *handle = (void *)work_context;
 
@@ -152,16 +571,23 @@ FAIL:
 
     /* Release memory */
     if (NULL != work_context) {
+        if (NULL != work_context->delay_timer_handle) {
+            xTimerDelete(work_context->delay_timer_handle, portMAX_DELAY);
+        }
         if (NULL != work_context->timer_handle) {
             xTimerDelete(work_context->timer_handle, portMAX_DELAY);
         }
         if (NULL != work_context->sem_handle) {
             vSemaphoreDelete(work_context->sem_handle);
         }
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_pool_free(mender_scheduler_work_pool, mender_scheduler_work_pool_used, sizeof(mender_scheduler_work_context_t), work_context);
+#else
         if (NULL != work_context->params.name) {
-            free(work_context->params.name);
+            mender_free(work_context->params.name);
         }
-        free(work_context);
+        mender_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     }
 
     return MENDER_FAIL;
@@ -239,6 +665,56 @@ mender_scheduler_work_execute(void *handle) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_scheduler_work_execute_after(void *handle, uint32_t delay_ms) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Execute the work now if the delay is lower than a tick, the period of the timers can't be null */
+    TickType_t delay = pdMS_TO_TICKS(delay_ms);
+    if (0 == delay) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    /* Keep the delayed execution already scheduled if it is nearer */
+    if ((pdFALSE != xTimerIsTimerActive(work_context->delay_timer_handle))
+        && ((TickType_t)(xTimerGetExpiryTime(work_context->delay_timer_handle) - xTaskGetTickCount()) <= delay)) {
+        return MENDER_OK;
+    }
+
+    /* Start the timer to handle the work once, changing the period of the timer starts it */
+    if (pdPASS != xTimerChangePeriod(work_context->delay_timer_handle, delay, portMAX_DELAY)) {
+        mender_log_error("Unable to start timer");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_execute_at(void *handle, uint64_t uptime_us) {
+
+    assert(NULL != handle);
+    uint64_t now = mender_scheduler_get_uptime_us();
+    uint64_t delay_ms;
+
+    /* Execute the work now if the deadline is reached */
+    if (uptime_us <= now) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    /* Execute the work after the delay remaining until the deadline, rounded up to the millisecond */
+    delay_ms = (uptime_us - now + 999) / 1000;
+    if (delay_ms > UINT32_MAX) {
+        delay_ms = UINT32_MAX;
+    }
+
+    return mender_scheduler_work_execute_after(handle, (uint32_t)delay_ms);
+}
+
 mender_err_t
 mender_scheduler_work_deactivate(void *handle) {
 
@@ -250,9 +726,10 @@ mender_scheduler_work_deactivate(void *handle) {
     /* Check if the work was activated */
     if (true == work_context->activated) {
 
-        /* Stop the timer used to periodically execute the work (if it is running) */
+        /* Stop the timers used to execute the work (if they are running) */
         xTimerStop(work_context->timer_handle, portMAX_DELAY);
-        while (pdFALSE != xTimerIsTimerActive(work_context->timer_handle)) {
+        xTimerStop(work_context->delay_timer_handle, portMAX_DELAY);
+        while ((pdFALSE != xTimerIsTimerActive(work_context->timer_handle)) || (pdFALSE != xTimerIsTimerActive(work_context->delay_timer_handle))) {
             vTaskDelay(1);
         }
 
@@ -277,26 +754,74 @@ mender_scheduler_work_delete(void *handle) {
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
+    /* Remove the work from the list of the works */
+    xSemaphoreTake(mender_scheduler_work_list_mutex, portMAX_DELAY);
+    mender_scheduler_work_context_t **item = &mender_scheduler_work_list;
+    while ((NULL != *item) && (work_context != *item)) {
+        item = (mender_scheduler_work_context_t **)&(*item)->next;
+    }
+    if (NULL != *item) {
+        *item = (mender_scheduler_work_context_t *)work_context->next;
+    }
+    xSemaphoreGive(mender_scheduler_work_list_mutex);
+
     /* Release memory */
+    xTimerDelete(work_context->delay_timer_handle, portMAX_DELAY);
     xTimerDelete(work_context->timer_handle, portMAX_DELAY);
     vSemaphoreDelete(work_context->sem_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_work_pool, mender_scheduler_work_pool_used, sizeof(mender_scheduler_work_context_t), work_context);
+#else
     if (NULL != work_context->params.name) {
-        free(work_context->params.name);
+        mender_free(work_context->params.name);
     }
-    free(work_context);
+    mender_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+mender_err_t
+mender_scheduler_work_get_stats(void *handle, mender_scheduler_work_stats_t *stats) {
+
+    assert(NULL != handle);
+    assert(NULL != stats);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Copy work statistics */
+    memcpy(stats, &work_context->stats, sizeof(mender_scheduler_work_stats_t));
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
 mender_err_t
 mender_scheduler_mutex_create(void **handle) {
 
     assert(NULL != handle);
 
     /* Create mutex */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    StaticSemaphore_t *buffer = (StaticSemaphore_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT, sizeof(StaticSemaphore_t));
+    if (NULL == buffer) {
+        mender_log_error("Unable to allocate mutex, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    if (NULL == (*handle = (void *)xSemaphoreCreateMutexStatic(buffer))) {
+        mender_scheduler_pool_free(mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, sizeof(StaticSemaphore_t), buffer);
+        return MENDER_FAIL;
+    }
+#else
     if (NULL == (*handle = (void *)xSemaphoreCreateMutex())) {
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
@@ -332,8 +857,300 @@ mender_scheduler_mutex_delete(void *handle) {
 
     assert(NULL != handle);
 
-    /* Release memory */
+    /* Release memory, the handle of a mutex created statically points to its buffer */
     vSemaphoreDelete((SemaphoreHandle_t)handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, sizeof(StaticSemaphore_t), handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+
+    /* Check the stack size of the task */
+    if (task_params->stack_size > CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE) {
+        mender_log_error("Unable to create task '%s', its stack size exceeds the stack size of the static pool", task_params->name);
+        return MENDER_FAIL;
+    }
+
+    /* Get task context, the thread and the semaphores of the task context are kept to execute the next tasks */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_task_pool, mender_scheduler_task_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT, sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate task, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+
+    /* Copy task parameters, the name is not copied with the static allocation */
+    task_context->params.function   = task_params->function;
+    task_context->params.arg        = task_params->arg;
+    task_context->params.name       = task_params->name;
+    task_context->params.stack_size = task_params->stack_size;
+    task_context->params.priority   = task_params->priority;
+
+    /* Create the semaphores and the thread the first time the task context is used */
+    if (NULL == task_context->thread_handle) {
+        if ((NULL == (task_context->sem_handle = xSemaphoreCreateBinaryStatic(&task_context->sem_buffer)))
+            || (NULL == (task_context->start_sem_handle = xSemaphoreCreateBinaryStatic(&task_context->start_sem_buffer)))) {
+            mender_log_error("Unable to create semaphore");
+            goto FAIL;
+        }
+        if (NULL
+            == (task_context->thread_handle = xTaskCreateStatic(mender_scheduler_task_thread,
+                                                                "mender_scheduler_task",
+                                                                sizeof(task_context->stack) / sizeof(StackType_t),
+                                                                task_context,
+                                                                task_context->params.priority,
+                                                                task_context->stack,
+                                                                &task_context->thread_buffer))) {
+            mender_log_error("Unable to create thread");
+            goto FAIL;
+        }
+    }
+
+    /* Start the task */
+    vTaskPrioritySet(task_context->thread_handle, task_context->params.priority);
+    xSemaphoreGive(task_context->start_sem_handle);
+
+    /* Return handle to the task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release task context */
+    if (NULL != task_context->start_sem_handle) {
+        vSemaphoreDelete(task_context->start_sem_handle);
+        task_context->start_sem_handle = NULL;
+    }
+    if (NULL != task_context->sem_handle) {
+        vSemaphoreDelete(task_context->sem_handle);
+        task_context->sem_handle = NULL;
+    }
+    mender_scheduler_pool_free(mender_scheduler_task_pool, mender_scheduler_task_pool_used, sizeof(mender_scheduler_task_context_t), task_context);
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait for the end of the task */
+    if (pdPASS != xSemaphoreTake(task_context->sem_handle, portMAX_DELAY)) {
+        mender_log_error("Unable to take semaphore");
+        return MENDER_FAIL;
+    }
+
+    /* Release task context, the thread waits for the next task */
+    mender_scheduler_pool_free(mender_scheduler_task_pool, mender_scheduler_task_pool_used, sizeof(mender_scheduler_task_context_t), task_context);
+
+    return MENDER_OK;
+}
+
+#else
+
+mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+
+    /* Create task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+
+    /* Copy task parameters */
+    task_context->params.function   = task_params->function;
+    task_context->params.arg        = task_params->arg;
+    task_context->params.stack_size = task_params->stack_size;
+    task_context->params.priority   = task_params->priority;
+    if (NULL == (task_context->params.name = mender_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    /* Create semaphore used to indicate the end of the task */
+    if (NULL == (task_context->sem_handle = xSemaphoreCreateBinary())) {
+        mender_log_error("Unable to create semaphore");
+        goto FAIL;
+    }
+
+    /* Create and start thread */
+    if (pdPASS
+        != xTaskCreate(mender_scheduler_task_thread,
+                       task_context->params.name,
+                       (configSTACK_DEPTH_TYPE)(task_context->params.stack_size * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
+                       task_context,
+                       task_context->params.priority,
+                       NULL)) {
+        mender_log_error("Unable to create thread");
+        goto FAIL;
+    }
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != task_context) {
+        if (NULL != task_context->sem_handle) {
+            vSemaphoreDelete(task_context->sem_handle);
+        }
+        if (NULL != task_context->params.name) {
+            mender_free(task_context->params.name);
+        }
+        mender_free(task_context);
+    }
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait for the end of the thread */
+    if (pdPASS != xSemaphoreTake(task_context->sem_handle, portMAX_DELAY)) {
+        mender_log_error("Unable to take semaphore");
+        return MENDER_FAIL;
+    }
+
+    /* Release memory */
+    vSemaphoreDelete(task_context->sem_handle);
+    mender_free(task_context->params.name);
+    mender_free(task_context);
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 != length);
+    assert(0 != item_size);
+    assert(NULL != handle);
+
+    /* Create queue */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (length * item_size > CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE) {
+        mender_log_error("Unable to allocate queue, its size exceeds the storage of the static pool");
+        return MENDER_FAIL;
+    }
+    mender_scheduler_queue_buffer_t *buffer = (mender_scheduler_queue_buffer_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT, sizeof(mender_scheduler_queue_buffer_t));
+    if (NULL == buffer) {
+        mender_log_error("Unable to allocate queue, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    if (NULL == (*handle = (void *)xQueueCreateStatic(length, item_size, buffer->storage, &buffer->buffer))) {
+        mender_scheduler_pool_free(mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, sizeof(mender_scheduler_queue_buffer_t), buffer);
+        return MENDER_FAIL;
+    }
+#else
+    if (NULL == (*handle = (void *)xQueueCreate(length, item_size))) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Send item */
+    if (pdPASS != xQueueSend((QueueHandle_t)handle, item, (delay_ms >= 0) ? (delay_ms / portTICK_PERIOD_MS) : portMAX_DELAY)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Receive item */
+    if (pdPASS != xQueueReceive((QueueHandle_t)handle, item, (delay_ms >= 0) ? (delay_ms / portTICK_PERIOD_MS) : portMAX_DELAY)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Release queue, the handle of a queue created statically points to its buffer */
+    vQueueDelete((QueueHandle_t)handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, sizeof(mender_scheduler_queue_buffer_t), handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+uint64_t
+mender_scheduler_get_uptime_us(void) {
+
+    /* Convert tick count to microseconds */
+    return ((uint64_t)xTaskGetTickCount() * 1000000) / configTICK_RATE_HZ;
+}
+
+void
+mender_scheduler_yield(uint32_t delay_ms) {
+
+    /* Yield to the tasks of the same priority, or delay the task at least one tick */
+    if (0 == delay_ms) {
+        taskYIELD();
+    } else {
+        TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+        vTaskDelay((0 != ticks) ? ticks : 1);
+    }
+}
+
+mender_err_t
+mender_scheduler_notify_wakeup(void) {
+
+    /* Execute the works which periodic execution is due within their slack */
+    mender_scheduler_work_coalesce(NULL);
 
     return MENDER_OK;
 }
@@ -341,12 +1158,18 @@ mender_scheduler_mutex_delete(void *handle) {
 mender_err_t
 mender_scheduler_exit(void) {
 
-    /* Submit empty work to the work queue, this ask the work queue thread to terminate */
+    /* Submit empty work to the work queues, this ask the work queue threads to terminate */
     mender_scheduler_work_context_t *work_context = NULL;
     if (pdPASS != xQueueSend(mender_scheduler_work_queue_handle, &work_context, portMAX_DELAY)) {
         mender_log_error("Unable to submit empty work to the work queue");
         return MENDER_FAIL;
     }
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    if (pdPASS != xQueueSend(mender_scheduler_high_priority_work_queue_handle, &work_context, portMAX_DELAY)) {
+        mender_log_error("Unable to submit empty work to the high priority work queue");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
 
     return MENDER_OK;
 }
@@ -363,32 +1186,69 @@ mender_scheduler_timer_callback(TimerHandle_t handle) {
     /* Exit if the work is already pending or executing */
     if (pdPASS != xSemaphoreTake(work_context->sem_handle, 0)) {
         mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+        if (true == work_context->activated) {
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+            work_context->stats.overruns++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+            MENDER_METRICS_ADD(MENDER_METRICS_SCHEDULER_OVERRUNS, 1);
+        }
         return;
     }
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    work_context->submission_time = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
     /* Submit the work to the work queue */
-    if (pdPASS != xQueueSend(mender_scheduler_work_queue_handle, &work_context, 0)) {
+    if (pdPASS != xQueueSend(*work_context->work_queue_handle, &work_context, 0)) {
         mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        work_context->stats.losses++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
         xSemaphoreGive(work_context->sem_handle);
     }
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    /* Update the high-water mark of the work queue, it is full if the work has been lost */
+    UBaseType_t count = uxQueueMessagesWaiting(*work_context->work_queue_handle);
+    if ((uint32_t)count > work_context->stats.queue_high_water_mark) {
+        work_context->stats.queue_high_water_mark = (uint32_t)count;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
 }
 
 static void
 mender_scheduler_work_queue_thread(void *arg) {
 
-    (void)arg;
-    mender_scheduler_work_context_t *work_context = NULL;
+    assert(NULL != arg);
+    QueueHandle_t                   *work_queue_handle = (QueueHandle_t *)arg;
+    mender_scheduler_work_context_t *work_context      = NULL;
 
     /* Handle work to be executed */
-    while (pdPASS == xQueueReceive(mender_scheduler_work_queue_handle, &work_context, portMAX_DELAY)) {
+    while (pdPASS == xQueueReceive(*work_queue_handle, &work_context, portMAX_DELAY)) {
 
         /* Check if empty work is received from the work queue, this ask the work queue thread to terminate */
         if (NULL == work_context) {
             goto END;
         }
 
+        /* Execute together the other works which periodic execution is due within their slack, the device is awake anyway */
+        mender_scheduler_work_coalesce(work_context);
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        uint64_t start_time = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
         /* Call work function */
-        if (MENDER_DONE == work_context->params.function()) {
+        MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_SCHEDULER_WORK);
+        mender_err_t ret = work_context->params.function();
+        MENDER_TRACE_END(MENDER_TRACE_EVENT_SCHEDULER_WORK);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        /* Record the statistics of the execution */
+        mender_scheduler_work_stats_record(work_context, start_time, mender_scheduler_get_uptime_us());
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+        if (MENDER_DONE == ret) {
 
             /* Work is done, stop timer used to execute the work periodically */
             xTimerStop(work_context->timer_handle, portMAX_DELAY);
@@ -404,9 +1264,133 @@ mender_scheduler_work_queue_thread(void *arg) {
 END:
 
     /* Release memory */
-    vQueueDelete(mender_scheduler_work_queue_handle);
-    mender_scheduler_work_queue_handle = NULL;
+    vQueueDelete(*work_queue_handle);
+    *work_queue_handle = NULL;
 
     /* Terminate work queue thread */
     vTaskDelete(NULL);
 }
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+static void
+mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time) {
+
+    assert(NULL != work_context);
+    uint64_t run_time = stop_time - start_time;
+    uint64_t latency  = start_time - work_context->submission_time;
+    size_t   index    = 0;
+
+    /* Update the number of executions, the run time and the start latency of the work */
+    work_context->stats.executions++;
+    work_context->stats.run_time_total_us += run_time;
+    if (run_time > work_context->stats.run_time_max_us) {
+        work_context->stats.run_time_max_us = (uint32_t)run_time;
+    }
+    work_context->stats.latency_total_us += latency;
+    if (latency > work_context->stats.latency_max_us) {
+        work_context->stats.latency_max_us = (uint32_t)latency;
+    }
+
+    /* Update the run time histogram, the bucket is given by the number of significant bits of the run time in milliseconds */
+    for (uint64_t value = run_time / 1000; (value > 0) && (index < MENDER_SCHEDULER_WORK_STATISTICS_BUCKET_COUNT - 1); value >>= 1) {
+        index++;
+    }
+    work_context->stats.run_time_histogram[index]++;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+static void
+mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context) {
+
+    xSemaphoreTake(mender_scheduler_work_list_mutex, portMAX_DELAY);
+
+    /* Parse the list of the works */
+    mender_scheduler_work_context_t *item = mender_scheduler_work_list;
+    while (NULL != item) {
+
+        /* Check if the periodic execution of the work is due within its slack */
+        if ((work_context != item) && (0 != item->params.slack) && (item->params.period > 0) && (pdFALSE != xTimerIsTimerActive(item->timer_handle))) {
+            TickType_t remaining = xTimerGetExpiryTime(item->timer_handle) - xTaskGetTickCount();
+            if (remaining <= pdMS_TO_TICKS((uint32_t)item->params.period * 10 * item->params.slack)) {
+
+                /* Restart the timer and execute the work now */
+                mender_log_debug("Work '%s' is executed earlier within its slack", item->params.name);
+                xTimerReset(item->timer_handle, portMAX_DELAY);
+                mender_scheduler_timer_callback(item->timer_handle);
+            }
+        }
+        item = (mender_scheduler_work_context_t *)item->next;
+    }
+
+    xSemaphoreGive(mender_scheduler_work_list_mutex);
+}
+
+static void
+mender_scheduler_task_thread(void *arg) {
+
+    assert(NULL != arg);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)arg;
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    /* Wait for the tasks to be started, the thread is never terminated */
+    while (pdPASS == xSemaphoreTake(task_context->start_sem_handle, portMAX_DELAY)) {
+
+        /* Call task function */
+        task_context->params.function(task_context->params.arg);
+
+        /* Indicate the end of the task */
+        xSemaphoreGive(task_context->sem_handle);
+    }
+#else
+    /* Call task function */
+    task_context->params.function(task_context->params.arg);
+
+    /* Indicate the end of the task, the task context must not be used after this point */
+    xSemaphoreGive(task_context->sem_handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Terminate thread */
+    vTaskDelete(NULL);
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+static void *
+mender_scheduler_pool_alloc(void *pool, bool *used, size_t count, size_t size) {
+
+    assert(NULL != pool);
+    assert(NULL != used);
+    void *item = NULL;
+
+    /* Look for an item which is not used, the scheduler is suspended to protect the pool */
+    vTaskSuspendAll();
+    for (size_t index = 0; index < count; index++) {
+        if (false == used[index]) {
+            used[index] = true;
+            item        = (uint8_t *)pool + index * size;
+            break;
+        }
+    }
+    xTaskResumeAll();
+
+    return item;
+}
+
+static void
+mender_scheduler_pool_free(void *pool, bool *used, size_t size, void *item) {
+
+    assert(NULL != pool);
+    assert(NULL != used);
+    assert(NULL != item);
+
+    /* Release the item */
+    vTaskSuspendAll();
+    used[((uint8_t *)item - (uint8_t *)pool) / size] = false;
+    xTaskResumeAll();
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
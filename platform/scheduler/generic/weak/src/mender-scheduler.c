@@ -64,6 +64,26 @@ mender_scheduler_work_execute(void *handle) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_scheduler_work_execute_after(void *handle, uint32_t delay_ms) {
+
+    (void)handle;
+    (void)delay_ms;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_work_execute_at(void *handle, uint64_t uptime_us) {
+
+    (void)handle;
+    (void)uptime_us;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_scheduler_work_deactivate(void *handle) {
 
@@ -82,6 +102,20 @@ mender_scheduler_work_delete(void *handle) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_work_get_stats(void *handle, mender_scheduler_work_stats_t *stats) {
+
+    (void)handle;
+    (void)stats;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
 __attribute__((weak)) mender_err_t
 mender_scheduler_mutex_create(void **handle) {
 
@@ -119,6 +153,89 @@ mender_scheduler_mutex_delete(void *handle) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    (void)task_params;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    (void)length;
+    (void)item_size;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    (void)handle;
+    (void)item;
+    (void)delay_ms;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    (void)handle;
+    (void)item;
+    (void)delay_ms;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_notify_wakeup(void) {
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) uint64_t
+mender_scheduler_get_uptime_us(void) {
+
+    /* Nothing to do */
+    return 0;
+}
+
+__attribute__((weak)) void
+mender_scheduler_yield(uint32_t delay_ms) {
+
+    (void)delay_ms;
+
+    /* Nothing to do */
+}
+
 __attribute__((weak)) mender_err_t
 mender_scheduler_exit(void) {
 
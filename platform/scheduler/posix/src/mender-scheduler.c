@@ -17,15 +17,22 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_SCHEDULER
+
 #include <errno.h>
 #include <math.h>
 #include <mqueue.h>
 #include <pthread.h>
-#include <signal.h>
+#include <sched.h>
 #include <time.h>
 #include <unistd.h>
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-scheduler.h"
+#include "mender-trace.h"
 
 /**
  * @brief Default work queue stack size (kB)
@@ -48,36 +55,268 @@
 #define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH (10)
 #endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH */
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief Default high priority work queue stack size (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE (64)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE */
+
+/**
+ * @brief Default high priority work queue priority
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY (0)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY */
+
+/**
+ * @brief Default high priority work queue length
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH (10)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH */
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Default number of works of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT */
+
+/**
+ * @brief Default number of mutexes of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT (12)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT */
+
+/**
+ * @brief Default number of tasks of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT (3)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT */
+
+/**
+ * @brief Default stack size of the tasks of the static pool (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE */
+
+/**
+ * @brief Default number of queues of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT (2)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT */
+
+/**
+ * @brief Default storage size of the queues of the static pool (bytes)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE (64)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE */
+
+/**
+ * @brief Stack size of the tasks of the static pool (bytes), POSIX threads require at least 16kB
+ */
+#define MENDER_SCHEDULER_STATIC_TASK_STACK_LENGTH \
+    (((CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE > 16) ? CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE : 16) * 1024)
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+/**
+ * @brief Timer, handled by the timer service
+ */
+typedef struct {
+    void    *work_context; /**< Work context submitted when the timer expires */
+    uint64_t deadline;     /**< Deadline of the timer (microseconds of uptime) */
+    uint64_t period;       /**< Period of the timer (microseconds), 0 if the timer expires once */
+    size_t   index;        /**< Position of the timer in the timer heap plus one, 0 if the timer is stopped */
+} mender_scheduler_timer_t;
+
 /**
  * @brief Work context
  */
 typedef struct {
-    mender_scheduler_work_params_t params;       /**< Work parameters */
-    pthread_mutex_t                sem_handle;   /**< Semaphore used to indicate work is pending or executing */
-    timer_t                        timer_handle; /**< Timer used to periodically execute work */
-    bool                           activated;    /**< Flag indicating the work is activated */
+    mender_scheduler_work_params_t params;            /**< Work parameters */
+    pthread_mutex_t                sem_handle;        /**< Semaphore used to indicate work is pending or executing */
+    mender_scheduler_timer_t       timer;             /**< Timer used to periodically execute work */
+    mender_scheduler_timer_t       delay_timer;       /**< Timer used to execute work once after a delay */
+    mqd_t                         *work_queue_handle; /**< Work queue executing the work, chosen according to the work priority */
+    bool                           activated;         /**< Flag indicating the work is activated */
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    mender_scheduler_work_stats_t  stats;             /**< Work statistics */
+    uint64_t                       submission_time;   /**< Uptime of the last submission of the work (microseconds) */
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    void                          *next;              /**< Next work of the list of the works */
 } mender_scheduler_work_context_t;
 
+/**
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;        /**< Task parameters */
+    pthread_t                      thread_handle; /**< Thread handle */
+} mender_scheduler_task_context_t;
+
+/**
+ * @brief Queue context
+ */
+typedef struct {
+    pthread_mutex_t mutex_handle; /**< Mutex used to protect access to the queue */
+    pthread_cond_t  cond_handle;  /**< Condition used to indicate an item has been sent or received */
+    char           *buffer;       /**< Items of the queue */
+    size_t          length;       /**< Maximum number of items in the queue */
+    size_t          item_size;    /**< Size of the items */
+    size_t          first;        /**< Index of the first item in the queue */
+    size_t          count;        /**< Number of items in the queue */
+} mender_scheduler_queue_context_t;
+
 /**
  *
  * @brief Work queue parameters
  */
-#define MENDER_SCHEDULER_WORK_QUEUE_NAME  "/mender-work-queue"
-#define MENDER_SCHEDULER_WORK_QUEUE_PERMS (0644)
+#define MENDER_SCHEDULER_WORK_QUEUE_NAME               "/mender-work-queue"
+#define MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_NAME "/mender-high-priority-work-queue"
+#define MENDER_SCHEDULER_WORK_QUEUE_PERMS              (0644)
 
 /**
  * @brief Function used to handle work context timer when it expires
- * @param timer_data Timer data
+ * @param work_context Work context
  */
-static void mender_scheduler_timer_callback(union sigval timer_data);
+static void mender_scheduler_timer_callback(mender_scheduler_work_context_t *work_context);
 
 /**
- * @brief Thread used to handle work queue
+ * @brief Start or restart a timer
+ * @param timer Timer
+ * @param delay_us Delay before the first expiry (microseconds)
+ * @param keep_nearest true to keep the deadline of the timer if it is running and nearer, false to replace it
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_scheduler_timer_start(mender_scheduler_timer_t *timer, uint64_t delay_us, bool keep_nearest);
+
+/**
+ * @brief Stop a timer, nothing is done if it is not running
+ * @param timer Timer
+ */
+static void mender_scheduler_timer_stop(mender_scheduler_timer_t *timer);
+
+/**
+ * @brief Remove a timer from the timer heap, the mutex of the timer service must be taken
+ * @param timer Timer, running
+ */
+static void mender_scheduler_timer_heap_remove(mender_scheduler_timer_t *timer);
+
+/**
+ * @brief Move a timer of the timer heap up or down until the heap is ordered by deadline, the mutex of the timer service must be taken
+ * @param index Position of the timer in the timer heap
+ */
+static void mender_scheduler_timer_heap_update(size_t index);
+
+/**
+ * @brief Swap two timers of the timer heap, the mutex of the timer service must be taken
+ * @param index1 Position of the first timer in the timer heap
+ * @param index2 Position of the second timer in the timer heap
+ */
+static void mender_scheduler_timer_heap_swap(size_t index1, size_t index2);
+
+/**
+ * @brief Thread used to handle the timers of the works, it sleeps until the nearest deadline and submits the works which timers expired
  * @param arg Not used
  * @return Not used
  */
+static void *mender_scheduler_timer_thread(void *arg);
+
+/**
+ * @brief Create a work queue and start the thread used to handle it
+ * @param name Work queue name
+ * @param length Work queue length
+ * @param stack_size Work queue thread stack size (kB)
+ * @param priority Work queue thread priority
+ * @param work_queue_handle Work queue handle
+ * @param thread_handle Work queue thread handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_scheduler_work_queue_create(
+    char *name, long length, uint32_t stack_size, int32_t priority, mqd_t *work_queue_handle, pthread_t *thread_handle);
+
+/**
+ * @brief Thread used to handle work queue
+ * @param arg Work queue handle
+ * @return Not used
+ */
 static void *mender_scheduler_work_queue_thread(void *arg);
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Function used to record the statistics of an execution of a work
+ * @param work_context Work context
+ * @param start_time Uptime when the execution of the work function started (microseconds)
+ * @param stop_time Uptime when the execution of the work function stopped (microseconds)
+ */
+static void mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+/**
+ * @brief Function used to execute now the works which periodic execution is due within their slack, their timers are restarted
+ * @param work_context Work context which execution wakes up the device, NULL if none
+ */
+static void mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Thread entry point of the tasks
+ * @param arg Task context
+ * @return Not used
+ */
+static void *mender_scheduler_task_thread(void *arg);
+
+/**
+ * @brief Wait for an item to be sent or received in a queue, the mutex of the queue must be taken
+ * @param queue_context Queue context
+ * @param delay_ms Delay to wait, -1 to block indefinitely (without a timeout)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_scheduler_queue_wait(mender_scheduler_queue_context_t *queue_context, int32_t delay_ms);
+
+/**
+ * @brief Release the memory of a queue, its static pool item or its allocated buffers
+ * @param queue_context Queue context
+ */
+static void mender_scheduler_queue_release(mender_scheduler_queue_context_t *queue_context);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Function used to allocate an item of a static pool
+ * @param pool Pool of items
+ * @param used Flags indicating the items of the pool which are used
+ * @param count Number of items of the pool
+ * @param size Size of the items of the pool
+ * @return Item allocated if the function succeeds, NULL if the pool is exhausted
+ */
+static void *mender_scheduler_pool_alloc(void *pool, bool *used, size_t count, size_t size);
+
+/**
+ * @brief Function used to release an item of a static pool
+ * @param pool Pool of items
+ * @param used Flags indicating the items of the pool which are used
+ * @param size Size of the items of the pool
+ * @param item Item to be released
+ */
+static void mender_scheduler_pool_free(void *pool, bool *used, size_t size, void *item);
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Work queue handle
  */
@@ -88,40 +327,157 @@ static mqd_t mender_scheduler_work_queue_handle;
  */
 static pthread_t mender_scheduler_work_queue_thread_handle;
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief High priority work queue handle
+ */
+static mqd_t mender_scheduler_high_priority_work_queue_handle;
+
+/**
+ * @brief High priority work queue thread handle
+ */
+static pthread_t mender_scheduler_high_priority_work_queue_thread_handle;
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+/**
+ * @brief Timer service, the running timers of the works are kept in a min-heap ordered by deadline and handled by a single thread
+ */
+static struct {
+    pthread_mutex_t                   mutex_handle;  /**< Mutex used to protect access to the timers */
+    pthread_cond_t                    cond_handle;   /**< Condition used to indicate the timers have changed */
+    pthread_t                         thread_handle; /**< Timer thread handle */
+    mender_scheduler_timer_t        **heap;          /**< Running timers, the first one has the nearest deadline */
+    size_t                            count;         /**< Number of timers in the timer heap */
+    size_t                            size;          /**< Allocated size of the timer heap */
+    bool                              exit;          /**< Flag used to ask the timer thread to terminate */
+} mender_scheduler_timer_service;
+
+/**
+ * @brief List of the works, used to coalesce their periodic executions
+ */
+static mender_scheduler_work_context_t *mender_scheduler_work_list = NULL;
+
+/**
+ * @brief Mutex used to protect the list of the works, it must be taken before the mutex of the timer service
+ */
+static pthread_mutex_t mender_scheduler_work_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Mutex used to protect the static pools
+ */
+static pthread_mutex_t mender_scheduler_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Static pool of works
+ */
+static mender_scheduler_work_context_t mender_scheduler_work_pool[CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Flags indicating the works of the static pool which are used
+ */
+static bool mender_scheduler_work_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Static timer heap, each work of the static pool has two timers
+ */
+static mender_scheduler_timer_t *mender_scheduler_timer_heap[2 * CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Static pool of mutexes
+ */
+static pthread_mutex_t mender_scheduler_mutex_pool[CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT];
+
+/**
+ * @brief Flags indicating the mutexes of the static pool which are used
+ */
+static bool mender_scheduler_mutex_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT];
+
+/**
+ * @brief Static pool of tasks
+ */
+static mender_scheduler_task_context_t mender_scheduler_task_pool[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT];
+
+/**
+ * @brief Flags indicating the tasks of the static pool which are used
+ */
+static bool mender_scheduler_task_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT];
+
+/**
+ * @brief Stacks of the tasks of the static pool
+ */
+static uint64_t mender_scheduler_task_stacks[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT][MENDER_SCHEDULER_STATIC_TASK_STACK_LENGTH / 8];
+
+/**
+ * @brief Static pool of queues
+ */
+static mender_scheduler_queue_context_t mender_scheduler_queue_pool[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT];
+
+/**
+ * @brief Flags indicating the queues of the static pool which are used
+ */
+static bool mender_scheduler_queue_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT];
+
+/**
+ * @brief Storage of the items of the queues of the static pool, aligned for any item type
+ */
+static uint64_t mender_scheduler_queue_storage[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT][(CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE + 7) / 8];
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 mender_err_t
 mender_scheduler_init(void) {
 
-    int ret;
-
-    /* Create and start work queue */
-    struct mq_attr mq_attr;
-    memset(&mq_attr, 0, sizeof(struct mq_attr));
-    mq_attr.mq_maxmsg  = CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH;
-    mq_attr.mq_msgsize = sizeof(mender_scheduler_work_context_t *);
-    mq_unlink(MENDER_SCHEDULER_WORK_QUEUE_NAME);
-    if ((mender_scheduler_work_queue_handle = mq_open(MENDER_SCHEDULER_WORK_QUEUE_NAME, O_CREAT | O_RDWR, MENDER_SCHEDULER_WORK_QUEUE_PERMS, &mq_attr)) < 0) {
-        mender_log_error("Unable to create work queue (errno=%d)", errno);
+    int                ret;
+    pthread_condattr_t pthread_condattr;
+
+    /* Create and start timer service, the condition uses the monotonic clock of the uptime */
+    memset(&mender_scheduler_timer_service, 0, sizeof(mender_scheduler_timer_service));
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_timer_service.heap = mender_scheduler_timer_heap;
+    mender_scheduler_timer_service.size = 2 * CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT;
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    if (0 != (ret = pthread_mutex_init(&mender_scheduler_timer_service.mutex_handle, NULL))) {
+        mender_log_error("Unable to create timer service mutex (ret=%d)", ret);
         return MENDER_FAIL;
     }
-    pthread_attr_t pthread_attr;
-    if (0 != (ret = pthread_attr_init(&pthread_attr))) {
-        mender_log_error("Unable to initialize work queue thread attributes (ret=%d)", ret);
+    if ((0 != (ret = pthread_condattr_init(&pthread_condattr))) || (0 != (ret = pthread_condattr_setclock(&pthread_condattr, CLOCK_MONOTONIC)))
+        || (0 != (ret = pthread_cond_init(&mender_scheduler_timer_service.cond_handle, &pthread_condattr)))) {
+        mender_log_error("Unable to create timer service condition (ret=%d)", ret);
         return MENDER_FAIL;
     }
-    if (0
-        != (ret = pthread_attr_setstacksize(
-                &pthread_attr, ((CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE > 16) ? CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE : 16) * 1024))) {
-        mender_log_error("Unable to set work queue thread stack size (ret=%d)", ret);
+    pthread_condattr_destroy(&pthread_condattr);
+    if (0 != (ret = pthread_create(&mender_scheduler_timer_service.thread_handle, NULL, mender_scheduler_timer_thread, NULL))) {
+        mender_log_error("Unable to create timer thread (ret=%d)", ret);
         return MENDER_FAIL;
     }
-    if (0 != (ret = pthread_create(&mender_scheduler_work_queue_thread_handle, &pthread_attr, mender_scheduler_work_queue_thread, NULL))) {
-        mender_log_error("Unable to create work queue thread (ret=%d)", ret);
+
+    /* Create and start work queue */
+    if (MENDER_OK
+        != mender_scheduler_work_queue_create(MENDER_SCHEDULER_WORK_QUEUE_NAME,
+                                              CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH,
+                                              CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE,
+                                              CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
+                                              &mender_scheduler_work_queue_handle,
+                                              &mender_scheduler_work_queue_thread_handle)) {
         return MENDER_FAIL;
     }
-    if (0 != (ret = pthread_setschedprio(mender_scheduler_work_queue_thread_handle, CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY))) {
-        mender_log_error("Unable to set work queue thread priority (ret=%d)", ret);
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    /* Create and start high priority work queue */
+    if (MENDER_OK
+        != mender_scheduler_work_queue_create(MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_NAME,
+                                              CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH,
+                                              CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE,
+                                              CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY,
+                                              &mender_scheduler_high_priority_work_queue_handle,
+                                              &mender_scheduler_high_priority_work_queue_thread_handle)) {
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
 
     return MENDER_OK;
 }
@@ -135,20 +491,35 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     assert(NULL != handle);
 
     /* Create work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)malloc(sizeof(mender_scheduler_work_context_t));
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_work_pool, mender_scheduler_work_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT, sizeof(mender_scheduler_work_context_t));
+    if (NULL == work_context) {
+        mender_log_error("Unable to allocate work, the static pool is exhausted");
+        goto FAIL;
+    }
+#else
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_malloc(sizeof(mender_scheduler_work_context_t));
     if (NULL == work_context) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
 
-    /* Copy work parameters */
+    /* Copy work parameters, the name is not copied with the static allocation */
     work_context->params.function = work_params->function;
     work_context->params.period   = work_params->period;
-    if (NULL == (work_context->params.name = strdup(work_params->name))) {
+    work_context->params.priority = work_params->priority;
+    work_context->params.slack    = work_params->slack;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    work_context->params.name = work_params->name;
+#else
+    if (NULL == (work_context->params.name = mender_strdup(work_params->name))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     /* Create semaphore used to protect work function */
     if (0 != pthread_mutex_init(&work_context->sem_handle, NULL)) {
@@ -156,16 +527,26 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
         goto FAIL;
     }
 
-    /* Create timer to handle the work periodically */
-    struct sigevent sev;
-    memset(&sev, 0, sizeof(struct sigevent));
-    sev.sigev_notify          = SIGEV_THREAD;
-    sev.sigev_notify_function = mender_scheduler_timer_callback;
-    sev.sigev_value.sival_ptr = work_context;
-    if (0 != timer_create(CLOCK_REALTIME, &sev, &work_context->timer_handle)) {
-        mender_log_error("Unable to create timer");
-        goto FAIL;
+    /* Initialize timers used to execute the work periodically and once after a delay */
+    work_context->timer.work_context       = work_context;
+    work_context->delay_timer.work_context = work_context;
+
+    /* Select the work queue according to the work priority */
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    if (MENDER_SCHEDULER_WORK_PRIORITY_HIGH == work_context->params.priority) {
+        work_context->work_queue_handle = &mender_scheduler_high_priority_work_queue_handle;
+    } else {
+        work_context->work_queue_handle = &mender_scheduler_work_queue_handle;
     }
+#else
+    work_context->work_queue_handle = &mender_scheduler_work_queue_handle;
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    /* Add the work to the list of the works */
+    pthread_mutex_lock(&mender_scheduler_work_list_mutex);
+    work_context->next         = mender_scheduler_work_list;
+    mender_scheduler_work_list = work_context;
+    pthread_mutex_unlock(&mender_scheduler_work_list_mutex);
 
     /* Return handle to the new work */
     *handle = (void *)work_context;
@@ -176,12 +557,15 @@ FAIL:
 
     /* Release memory */
     if (NULL != work_context) {
-        timer_delete(work_context->timer_handle);
         pthread_mutex_destroy(&work_context->sem_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_pool_free(mender_scheduler_work_pool, mender_scheduler_work_pool_used, sizeof(mender_scheduler_work_context_t), work_context);
+#else
         if (NULL != work_context->params.name) {
-            free(work_context->params.name);
+            mender_free(work_context->params.name);
         }
-        free(work_context);
+        mender_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     }
 
     return MENDER_FAIL;
@@ -205,19 +589,14 @@ mender_scheduler_work_activate(void *handle) {
     if (work_context->params.period > 0) {
 
         /* Start the timer to handle the work */
-        struct itimerspec its;
-        memset(&its, 0, sizeof(struct itimerspec));
-        its.it_value.tv_sec    = work_context->params.period;
-        its.it_interval.tv_sec = work_context->params.period;
-        if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
+        work_context->timer.period = (uint64_t)work_context->params.period * 1000000;
+        if (MENDER_OK != mender_scheduler_timer_start(&work_context->timer, work_context->timer.period, false)) {
             mender_log_error("Unable to start timer");
             return MENDER_FAIL;
         }
 
         /* Execute the work now */
-        union sigval timer_data;
-        timer_data.sival_ptr = (void *)work_context;
-        mender_scheduler_timer_callback(timer_data);
+        mender_scheduler_timer_callback(work_context);
     }
 
     /* Indicate the work has been activated */
@@ -236,15 +615,14 @@ mender_scheduler_work_set_period(void *handle, uint32_t period) {
 
     /* Set timer period */
     work_context->params.period = period;
-    struct itimerspec its;
-    memset(&its, 0, sizeof(struct itimerspec));
     if (work_context->params.period > 0) {
-        its.it_value.tv_sec    = work_context->params.period;
-        its.it_interval.tv_sec = work_context->params.period;
-    }
-    if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
-        mender_log_error("Unable to set timer period");
-        return MENDER_FAIL;
+        work_context->timer.period = (uint64_t)work_context->params.period * 1000000;
+        if (MENDER_OK != mender_scheduler_timer_start(&work_context->timer, work_context->timer.period, false)) {
+            mender_log_error("Unable to set timer period");
+            return MENDER_FAIL;
+        }
+    } else {
+        mender_scheduler_timer_stop(&work_context->timer);
     }
 
     return MENDER_OK;
@@ -259,13 +637,54 @@ mender_scheduler_work_execute(void *handle) {
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
     /* Execute the work now */
-    union sigval timer_data;
-    timer_data.sival_ptr = (void *)work_context;
-    mender_scheduler_timer_callback(timer_data);
+    mender_scheduler_timer_callback(work_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_execute_after(void *handle, uint32_t delay_ms) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Execute the work now if there is no delay */
+    if (0 == delay_ms) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    /* Start the timer to handle the work once, the delayed execution already scheduled is kept if it is nearer */
+    if (MENDER_OK != mender_scheduler_timer_start(&work_context->delay_timer, (uint64_t)delay_ms * 1000, true)) {
+        mender_log_error("Unable to start timer");
+        return MENDER_FAIL;
+    }
 
     return MENDER_OK;
 }
 
+mender_err_t
+mender_scheduler_work_execute_at(void *handle, uint64_t uptime_us) {
+
+    assert(NULL != handle);
+    uint64_t now = mender_scheduler_get_uptime_us();
+    uint64_t delay_ms;
+
+    /* Execute the work now if the deadline is reached */
+    if (uptime_us <= now) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    /* Execute the work after the delay remaining until the deadline, rounded up to the millisecond */
+    delay_ms = (uptime_us - now + 999) / 1000;
+    if (delay_ms > UINT32_MAX) {
+        delay_ms = UINT32_MAX;
+    }
+
+    return mender_scheduler_work_execute_after(handle, (uint32_t)delay_ms);
+}
+
 mender_err_t
 mender_scheduler_work_deactivate(void *handle) {
 
@@ -277,13 +696,9 @@ mender_scheduler_work_deactivate(void *handle) {
     /* Check if the work was activated */
     if (true == work_context->activated) {
 
-        /* Stop the timer used to periodically execute the work (if it is running) */
-        struct itimerspec its;
-        memset(&its, 0, sizeof(struct itimerspec));
-        if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
-            mender_log_error("Unable to stop timer");
-            return MENDER_FAIL;
-        }
+        /* Stop the timers used to execute the work (if they are running) */
+        mender_scheduler_timer_stop(&work_context->timer);
+        mender_scheduler_timer_stop(&work_context->delay_timer);
 
         /* Wait if the work is pending or executing */
         if (0 != pthread_mutex_lock(&work_context->sem_handle)) {
@@ -306,31 +721,80 @@ mender_scheduler_work_delete(void *handle) {
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
+    /* Remove the work from the list of the works */
+    pthread_mutex_lock(&mender_scheduler_work_list_mutex);
+    mender_scheduler_work_context_t **item = &mender_scheduler_work_list;
+    while ((NULL != *item) && (work_context != *item)) {
+        item = (mender_scheduler_work_context_t **)&(*item)->next;
+    }
+    if (NULL != *item) {
+        *item = (mender_scheduler_work_context_t *)work_context->next;
+    }
+    pthread_mutex_unlock(&mender_scheduler_work_list_mutex);
+
     /* Release memory */
-    timer_delete(work_context->timer_handle);
+    mender_scheduler_timer_stop(&work_context->timer);
+    mender_scheduler_timer_stop(&work_context->delay_timer);
     pthread_mutex_destroy(&work_context->sem_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_work_pool, mender_scheduler_work_pool_used, sizeof(mender_scheduler_work_context_t), work_context);
+#else
     if (NULL != work_context->params.name) {
-        free(work_context->params.name);
+        mender_free(work_context->params.name);
     }
-    free(work_context);
+    mender_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+mender_err_t
+mender_scheduler_work_get_stats(void *handle, mender_scheduler_work_stats_t *stats) {
+
+    assert(NULL != handle);
+    assert(NULL != stats);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Copy work statistics */
+    memcpy(stats, &work_context->stats, sizeof(mender_scheduler_work_stats_t));
 
     return MENDER_OK;
 }
 
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
 mender_err_t
 mender_scheduler_mutex_create(void **handle) {
 
     assert(NULL != handle);
 
     /* Create mutex */
-    if (NULL == (*handle = malloc(sizeof(pthread_mutex_t)))) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL
+        == (*handle = mender_scheduler_pool_alloc(
+                mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT, sizeof(pthread_mutex_t)))) {
+        mender_log_error("Unable to allocate mutex, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    if (0 != pthread_mutex_init(*handle, NULL)) {
+        mender_scheduler_pool_free(mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, sizeof(pthread_mutex_t), *handle);
+        *handle = NULL;
+        return MENDER_FAIL;
+    }
+#else
+    if (NULL == (*handle = mender_malloc(sizeof(pthread_mutex_t)))) {
         return MENDER_FAIL;
     }
     if (0 != pthread_mutex_init(*handle, NULL)) {
-        free(*handle);
+        mender_free(*handle);
         *handle = NULL;
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
@@ -377,32 +841,339 @@ mender_scheduler_mutex_delete(void *handle) {
 
     /* Release memory */
     pthread_mutex_destroy((pthread_mutex_t *)handle);
-    free(handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, sizeof(pthread_mutex_t), handle);
+#else
+    mender_free(handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
 
 mender_err_t
-mender_scheduler_exit(void) {
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
 
-    /* Submit empty work to the work queue, this ask the work queue thread to terminate */
-    mender_scheduler_work_context_t *work_context = NULL;
-    if (0 != mq_send(mender_scheduler_work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0)) {
-        mender_log_error("Unable to submit empty work to the work queue");
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+    int ret;
+
+    /* Create task context */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (task_params->stack_size > CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE) {
+        mender_log_error("Unable to create task '%s', its stack size exceeds the stack size of the static pool", task_params->name);
         return MENDER_FAIL;
     }
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_task_pool, mender_scheduler_task_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT, sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate task, the static pool is exhausted");
+        goto FAIL;
+    }
+#else
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+
+    /* Copy task parameters, the name is not copied with the static allocation */
+    task_context->params.function   = task_params->function;
+    task_context->params.arg        = task_params->arg;
+    task_context->params.stack_size = task_params->stack_size;
+    task_context->params.priority   = task_params->priority;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    task_context->params.name = task_params->name;
+#else
+    if (NULL == (task_context->params.name = mender_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Create and start thread */
+    pthread_attr_t pthread_attr;
+    if (0 != (ret = pthread_attr_init(&pthread_attr))) {
+        mender_log_error("Unable to initialize thread attributes (ret=%d)", ret);
+        goto FAIL;
+    }
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (0
+        != (ret = pthread_attr_setstack(
+                &pthread_attr, mender_scheduler_task_stacks[task_context - mender_scheduler_task_pool], MENDER_SCHEDULER_STATIC_TASK_STACK_LENGTH))) {
+        mender_log_error("Unable to set thread stack (ret=%d)", ret);
+        pthread_attr_destroy(&pthread_attr);
+        goto FAIL;
+    }
+#else
+    if (0 != (ret = pthread_attr_setstacksize(&pthread_attr, ((task_context->params.stack_size > 16) ? task_context->params.stack_size : 16) * 1024))) {
+        mender_log_error("Unable to set thread stack size (ret=%d)", ret);
+        pthread_attr_destroy(&pthread_attr);
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    if (0 != (ret = pthread_create(&task_context->thread_handle, &pthread_attr, mender_scheduler_task_thread, task_context))) {
+        mender_log_error("Unable to create thread (ret=%d)", ret);
+        pthread_attr_destroy(&pthread_attr);
+        goto FAIL;
+    }
+    pthread_attr_destroy(&pthread_attr);
+    if (0 != (ret = pthread_setschedprio(task_context->thread_handle, task_context->params.priority))) {
+        mender_log_warning("Unable to set thread priority (ret=%d)", ret);
+    }
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != task_context) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_pool_free(mender_scheduler_task_pool, mender_scheduler_task_pool_used, sizeof(mender_scheduler_task_context_t), task_context);
+#else
+        if (NULL != task_context->params.name) {
+            mender_free(task_context->params.name);
+        }
+        mender_free(task_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    }
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+    int ret;
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait for the end of the thread */
+    if (0 != (ret = pthread_join(task_context->thread_handle, NULL))) {
+        mender_log_error("Unable to join thread (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_task_pool, mender_scheduler_task_pool_used, sizeof(mender_scheduler_task_context_t), task_context);
+#else
+    mender_free(task_context->params.name);
+    mender_free(task_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 != length);
+    assert(0 != item_size);
+    assert(NULL != handle);
+
+    /* Create queue context */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (length * item_size > CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE) {
+        mender_log_error("Unable to allocate queue, its size exceeds the storage of the static pool");
+        return MENDER_FAIL;
+    }
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT, sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        mender_log_error("Unable to allocate queue, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    memset(queue_context, 0, sizeof(mender_scheduler_queue_context_t));
+    queue_context->buffer = (char *)mender_scheduler_queue_storage[queue_context - mender_scheduler_queue_pool];
+#else
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_malloc(sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        return MENDER_FAIL;
+    }
+    memset(queue_context, 0, sizeof(mender_scheduler_queue_context_t));
+    if (NULL == (queue_context->buffer = (char *)mender_malloc(length * item_size))) {
+        mender_free(queue_context);
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    queue_context->length    = length;
+    queue_context->item_size = item_size;
+    if (0 != pthread_mutex_init(&queue_context->mutex_handle, NULL)) {
+        mender_scheduler_queue_release(queue_context);
+        return MENDER_FAIL;
+    }
+    if (0 != pthread_cond_init(&queue_context->cond_handle, NULL)) {
+        pthread_mutex_destroy(&queue_context->mutex_handle);
+        mender_scheduler_queue_release(queue_context);
+        return MENDER_FAIL;
+    }
+
+    /* Return handle to the new queue context */
+    *handle = (void *)queue_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Wait for free space in the queue */
+    pthread_mutex_lock(&queue_context->mutex_handle);
+    while ((MENDER_OK == ret) && (queue_context->count == queue_context->length)) {
+        ret = mender_scheduler_queue_wait(queue_context, delay_ms);
+    }
+
+    /* Copy the item at the end of the queue */
+    if (MENDER_OK == ret) {
+        memcpy(&queue_context->buffer[((queue_context->first + queue_context->count) % queue_context->length) * queue_context->item_size],
+               item,
+               queue_context->item_size);
+        queue_context->count++;
+        pthread_cond_broadcast(&queue_context->cond_handle);
+    }
+    pthread_mutex_unlock(&queue_context->mutex_handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Wait for an item in the queue */
+    pthread_mutex_lock(&queue_context->mutex_handle);
+    while ((MENDER_OK == ret) && (0 == queue_context->count)) {
+        ret = mender_scheduler_queue_wait(queue_context, delay_ms);
+    }
+
+    /* Copy the first item of the queue */
+    if (MENDER_OK == ret) {
+        memcpy(item, &queue_context->buffer[queue_context->first * queue_context->item_size], queue_context->item_size);
+        queue_context->first = (queue_context->first + 1) % queue_context->length;
+        queue_context->count--;
+        pthread_cond_broadcast(&queue_context->cond_handle);
+    }
+    pthread_mutex_unlock(&queue_context->mutex_handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Release memory */
+    pthread_cond_destroy(&queue_context->cond_handle);
+    pthread_mutex_destroy(&queue_context->mutex_handle);
+    mender_scheduler_queue_release(queue_context);
+
+    return MENDER_OK;
+}
+
+uint64_t
+mender_scheduler_get_uptime_us(void) {
+
+    struct timespec now;
+
+    /* Read monotonic clock */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000) + ((uint64_t)now.tv_nsec / 1000);
+}
+
+void
+mender_scheduler_yield(uint32_t delay_ms) {
+
+    /* Sleep or yield to the other threads */
+    if (0 == delay_ms) {
+        sched_yield();
+    } else {
+        usleep((useconds_t)delay_ms * 1000);
+    }
+}
+
+mender_err_t
+mender_scheduler_notify_wakeup(void) {
+
+    /* Execute the works which periodic execution is due within their slack */
+    mender_scheduler_work_coalesce(NULL);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_exit(void) {
+
+    /* Ask the timer thread to terminate and wait end of its execution */
+    pthread_mutex_lock(&mender_scheduler_timer_service.mutex_handle);
+    mender_scheduler_timer_service.exit = true;
+    pthread_cond_signal(&mender_scheduler_timer_service.cond_handle);
+    pthread_mutex_unlock(&mender_scheduler_timer_service.mutex_handle);
+    pthread_join(mender_scheduler_timer_service.thread_handle, NULL);
+    pthread_cond_destroy(&mender_scheduler_timer_service.cond_handle);
+    pthread_mutex_destroy(&mender_scheduler_timer_service.mutex_handle);
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_free(mender_scheduler_timer_service.heap);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    mender_scheduler_timer_service.heap  = NULL;
+    mender_scheduler_timer_service.count = 0;
+    mender_scheduler_timer_service.size  = 0;
+
+    /* Submit empty work to the work queues, this ask the work queue threads to terminate */
+    mender_scheduler_work_context_t *work_context = NULL;
+    if (0 != mq_send(mender_scheduler_work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0)) {
+        mender_log_error("Unable to submit empty work to the work queue");
+        return MENDER_FAIL;
+    }
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    if (0 != mq_send(mender_scheduler_high_priority_work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0)) {
+        mender_log_error("Unable to submit empty work to the high priority work queue");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    /* Wait end of execution of the work queue threads and release memory */
+    pthread_join(mender_scheduler_work_queue_thread_handle, NULL);
+    mq_close(mender_scheduler_work_queue_handle);
+    mq_unlink(MENDER_SCHEDULER_WORK_QUEUE_NAME);
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    pthread_join(mender_scheduler_high_priority_work_queue_thread_handle, NULL);
+    mq_close(mender_scheduler_high_priority_work_queue_handle);
+    mq_unlink(MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_NAME);
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    return MENDER_OK;
+}
+
+static void
+mender_scheduler_timer_callback(mender_scheduler_work_context_t *work_context) {
 
-    /* Wait end of execution of the work queue thread */
-    pthread_join(mender_scheduler_work_queue_thread_handle, NULL);
-
-    return MENDER_OK;
-}
-
-static void
-mender_scheduler_timer_callback(union sigval timer_data) {
-
-    /* Get work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)timer_data.sival_ptr;
     assert(NULL != work_context);
 
     /* Exit if the work is already pending or executing */
@@ -410,39 +1181,281 @@ mender_scheduler_timer_callback(union sigval timer_data) {
     memset(&timeout, 0, sizeof(struct timespec));
     if (0 != pthread_mutex_timedlock(&work_context->sem_handle, &timeout)) {
         mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+        if (true == work_context->activated) {
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+            work_context->stats.overruns++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+            MENDER_METRICS_ADD(MENDER_METRICS_SCHEDULER_OVERRUNS, 1);
+        }
         return;
     }
 
-    /* Submit the work to the work queue */
-    if (0 != mq_send(mender_scheduler_work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0)) {
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    work_context->submission_time = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+    /* Submit the work to the work queue, without waiting if the work queue is full because the timer thread must not be blocked */
+    if (0 != mq_timedsend(*work_context->work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0, &timeout)) {
         mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        work_context->stats.losses++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
         pthread_mutex_unlock(&work_context->sem_handle);
     }
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    /* Update the high-water mark of the work queue, it is full if the work has been lost */
+    struct mq_attr mq_attr;
+    if ((0 == mq_getattr(*work_context->work_queue_handle, &mq_attr)) && ((uint32_t)mq_attr.mq_curmsgs > work_context->stats.queue_high_water_mark)) {
+        work_context->stats.queue_high_water_mark = (uint32_t)mq_attr.mq_curmsgs;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+}
+
+static mender_err_t
+mender_scheduler_timer_start(mender_scheduler_timer_t *timer, uint64_t delay_us, bool keep_nearest) {
+
+    assert(NULL != timer);
+    mender_err_t ret      = MENDER_OK;
+    uint64_t     deadline = mender_scheduler_get_uptime_us() + delay_us;
+
+    pthread_mutex_lock(&mender_scheduler_timer_service.mutex_handle);
+
+    /* Keep the deadline if the timer is running and if it is nearer */
+    if ((0 != timer->index) && (true == keep_nearest) && (timer->deadline <= deadline)) {
+        goto END;
+    }
+
+    /* Insert the timer in the timer heap if it is stopped, the heap is enlarged if it is full (the static timer heap is sized for all the timers) */
+    if (0 == timer->index) {
+        if (mender_scheduler_timer_service.count == mender_scheduler_timer_service.size) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+            mender_log_error("Unable to start timer, the static timer heap is full");
+            ret = MENDER_FAIL;
+            goto END;
+#else
+            size_t                     size = (mender_scheduler_timer_service.size > 0) ? (2 * mender_scheduler_timer_service.size) : 8;
+            mender_scheduler_timer_t **heap;
+            if (NULL == (heap = (mender_scheduler_timer_t **)mender_realloc(mender_scheduler_timer_service.heap, size * sizeof(mender_scheduler_timer_t *)))) {
+                mender_log_error("Unable to allocate memory");
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            mender_scheduler_timer_service.heap = heap;
+            mender_scheduler_timer_service.size = size;
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+        }
+        mender_scheduler_timer_service.heap[mender_scheduler_timer_service.count] = timer;
+        timer->index                                                              = ++mender_scheduler_timer_service.count;
+    }
+
+    /* Set the deadline and restore the order of the timer heap */
+    timer->deadline = deadline;
+    mender_scheduler_timer_heap_update(timer->index - 1);
+
+    /* Wake up the timer thread so that it takes the new deadline into account */
+    pthread_cond_signal(&mender_scheduler_timer_service.cond_handle);
+
+END:
+
+    pthread_mutex_unlock(&mender_scheduler_timer_service.mutex_handle);
+
+    return ret;
+}
+
+static void
+mender_scheduler_timer_stop(mender_scheduler_timer_t *timer) {
+
+    assert(NULL != timer);
+
+    pthread_mutex_lock(&mender_scheduler_timer_service.mutex_handle);
+
+    /* Remove the timer from the timer heap if it is running */
+    if (0 != timer->index) {
+        mender_scheduler_timer_heap_remove(timer);
+    }
+
+    pthread_mutex_unlock(&mender_scheduler_timer_service.mutex_handle);
+}
+
+static void
+mender_scheduler_timer_heap_remove(mender_scheduler_timer_t *timer) {
+
+    assert(NULL != timer);
+    size_t index = timer->index - 1;
+
+    /* The last timer of the heap takes the position of the timer removed */
+    timer->index = 0;
+    mender_scheduler_timer_service.count--;
+    if (index < mender_scheduler_timer_service.count) {
+        mender_scheduler_timer_service.heap[index]        = mender_scheduler_timer_service.heap[mender_scheduler_timer_service.count];
+        mender_scheduler_timer_service.heap[index]->index = index + 1;
+        mender_scheduler_timer_heap_update(index);
+    }
+}
+
+static void
+mender_scheduler_timer_heap_update(size_t index) {
+
+    mender_scheduler_timer_t **heap  = mender_scheduler_timer_service.heap;
+    size_t                     count = mender_scheduler_timer_service.count;
+    size_t                     child;
+
+    /* Move the timer up while its deadline is nearer than the deadline of its parent */
+    while ((index > 0) && (heap[index]->deadline < heap[(index - 1) / 2]->deadline)) {
+        mender_scheduler_timer_heap_swap(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+
+    /* Move the timer down while the deadline of one of its children is nearer */
+    while ((child = 2 * index + 1) < count) {
+        if ((child + 1 < count) && (heap[child + 1]->deadline < heap[child]->deadline)) {
+            child++;
+        }
+        if (heap[index]->deadline <= heap[child]->deadline) {
+            break;
+        }
+        mender_scheduler_timer_heap_swap(index, child);
+        index = child;
+    }
+}
+
+static void
+mender_scheduler_timer_heap_swap(size_t index1, size_t index2) {
+
+    mender_scheduler_timer_t **heap  = mender_scheduler_timer_service.heap;
+    mender_scheduler_timer_t  *timer = heap[index1];
+
+    /* Swap the timers and update their positions */
+    heap[index1]        = heap[index2];
+    heap[index2]        = timer;
+    heap[index1]->index = index1 + 1;
+    heap[index2]->index = index2 + 1;
+}
+
+static void *
+mender_scheduler_timer_thread(void *arg) {
+
+    (void)arg;
+    mender_scheduler_timer_t *timer;
+    uint64_t                  now;
+    struct timespec           timeout;
+
+    pthread_mutex_lock(&mender_scheduler_timer_service.mutex_handle);
+
+    /* Handle the timers until the thread is asked to terminate */
+    while (false == mender_scheduler_timer_service.exit) {
+
+        /* Wait for a timer to be started if none is running */
+        if (0 == mender_scheduler_timer_service.count) {
+            pthread_cond_wait(&mender_scheduler_timer_service.cond_handle, &mender_scheduler_timer_service.mutex_handle);
+            continue;
+        }
+
+        /* Wait until the nearest deadline, the timers may change meanwhile */
+        timer = mender_scheduler_timer_service.heap[0];
+        now   = mender_scheduler_get_uptime_us();
+        if (timer->deadline > now) {
+            timeout.tv_sec  = (time_t)(timer->deadline / 1000000);
+            timeout.tv_nsec = (long)((timer->deadline % 1000000) * 1000);
+            pthread_cond_timedwait(&mender_scheduler_timer_service.cond_handle, &mender_scheduler_timer_service.mutex_handle, &timeout);
+            continue;
+        }
+
+        /* Restart the timer for the next period, expiries missed are not cumulated, or remove it if it expires once */
+        if (timer->period > 0) {
+            timer->deadline += timer->period;
+            if (timer->deadline <= now) {
+                timer->deadline = now + timer->period;
+            }
+            mender_scheduler_timer_heap_update(0);
+        } else {
+            mender_scheduler_timer_heap_remove(timer);
+        }
+
+        /* Submit the work to the work queue, this is done with the mutex taken so that the work can't be deleted meanwhile */
+        mender_scheduler_timer_callback((mender_scheduler_work_context_t *)timer->work_context);
+    }
+
+    pthread_mutex_unlock(&mender_scheduler_timer_service.mutex_handle);
+
+    return NULL;
+}
+
+static mender_err_t
+mender_scheduler_work_queue_create(char *name, long length, uint32_t stack_size, int32_t priority, mqd_t *work_queue_handle, pthread_t *thread_handle) {
+
+    assert(NULL != name);
+    assert(NULL != work_queue_handle);
+    assert(NULL != thread_handle);
+    int ret;
+
+    /* Create and start work queue */
+    struct mq_attr mq_attr;
+    memset(&mq_attr, 0, sizeof(struct mq_attr));
+    mq_attr.mq_maxmsg  = length;
+    mq_attr.mq_msgsize = sizeof(mender_scheduler_work_context_t *);
+    mq_unlink(name);
+    if ((*work_queue_handle = mq_open(name, O_CREAT | O_RDWR, MENDER_SCHEDULER_WORK_QUEUE_PERMS, &mq_attr)) < 0) {
+        mender_log_error("Unable to create work queue (errno=%d)", errno);
+        return MENDER_FAIL;
+    }
+    pthread_attr_t pthread_attr;
+    if (0 != (ret = pthread_attr_init(&pthread_attr))) {
+        mender_log_error("Unable to initialize work queue thread attributes (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+    if (0 != (ret = pthread_attr_setstacksize(&pthread_attr, ((stack_size > 16) ? stack_size : 16) * 1024))) {
+        mender_log_error("Unable to set work queue thread stack size (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+    if (0 != (ret = pthread_create(thread_handle, &pthread_attr, mender_scheduler_work_queue_thread, (void *)work_queue_handle))) {
+        mender_log_error("Unable to create work queue thread (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+    if (0 != (ret = pthread_setschedprio(*thread_handle, priority))) {
+        mender_log_error("Unable to set work queue thread priority (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
 }
 
 __attribute__((noreturn)) static void *
 mender_scheduler_work_queue_thread(void *arg) {
 
-    (void)arg;
-    mender_scheduler_work_context_t *work_context = NULL;
+    assert(NULL != arg);
+    mqd_t                           *work_queue_handle = (mqd_t *)arg;
+    mender_scheduler_work_context_t *work_context      = NULL;
 
     /* Handle work to be executed */
-    while (mq_receive(mender_scheduler_work_queue_handle, (char *)&work_context, sizeof(mender_scheduler_work_context_t *), NULL) > 0) {
+    while (mq_receive(*work_queue_handle, (char *)&work_context, sizeof(mender_scheduler_work_context_t *), NULL) > 0) {
 
         /* Check if empty work is received from the work queue, this ask the work queue thread to terminate */
         if (NULL == work_context) {
             goto END;
         }
 
+        /* Execute together the other works which periodic execution is due within their slack, the device is awake anyway */
+        mender_scheduler_work_coalesce(work_context);
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        uint64_t start_time = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
         /* Call work function */
-        if (MENDER_DONE == work_context->params.function()) {
+        MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_SCHEDULER_WORK);
+        mender_err_t ret = work_context->params.function();
+        MENDER_TRACE_END(MENDER_TRACE_EVENT_SCHEDULER_WORK);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        /* Record the statistics of the execution */
+        mender_scheduler_work_stats_record(work_context, start_time, mender_scheduler_get_uptime_us());
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+        if (MENDER_DONE == ret) {
 
             /* Work is done, stop timer used to execute the work periodically */
-            struct itimerspec its;
-            memset(&its, 0, sizeof(struct itimerspec));
-            if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
-                mender_log_error("Unable to stop timer");
-            }
+            mender_scheduler_timer_stop(&work_context->timer);
         }
 
         /* Release semaphore used to protect the work function */
@@ -451,10 +1464,160 @@ mender_scheduler_work_queue_thread(void *arg) {
 
 END:
 
-    /* Release memory */
-    mq_close(mender_scheduler_work_queue_handle);
-    mq_unlink(MENDER_SCHEDULER_WORK_QUEUE_NAME);
-
     /* Terminate work queue thread */
     pthread_exit(NULL);
 }
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+static void
+mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time) {
+
+    assert(NULL != work_context);
+    uint64_t run_time = stop_time - start_time;
+    uint64_t latency  = start_time - work_context->submission_time;
+    size_t   index    = 0;
+
+    /* Update the number of executions, the run time and the start latency of the work */
+    work_context->stats.executions++;
+    work_context->stats.run_time_total_us += run_time;
+    if (run_time > work_context->stats.run_time_max_us) {
+        work_context->stats.run_time_max_us = (uint32_t)run_time;
+    }
+    work_context->stats.latency_total_us += latency;
+    if (latency > work_context->stats.latency_max_us) {
+        work_context->stats.latency_max_us = (uint32_t)latency;
+    }
+
+    /* Update the run time histogram, the bucket is given by the number of significant bits of the run time in milliseconds */
+    for (uint64_t value = run_time / 1000; (value > 0) && (index < MENDER_SCHEDULER_WORK_STATISTICS_BUCKET_COUNT - 1); value >>= 1) {
+        index++;
+    }
+    work_context->stats.run_time_histogram[index]++;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+static void
+mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context) {
+
+    pthread_mutex_lock(&mender_scheduler_work_list_mutex);
+    pthread_mutex_lock(&mender_scheduler_timer_service.mutex_handle);
+
+    /* Parse the list of the works */
+    uint64_t                         now  = mender_scheduler_get_uptime_us();
+    mender_scheduler_work_context_t *item = mender_scheduler_work_list;
+    while (NULL != item) {
+
+        /* Check if the periodic execution of the work is due within its slack */
+        if ((work_context != item) && (0 != item->params.slack) && (0 != item->timer.index) && (item->timer.period > 0)
+            && (item->timer.deadline <= now + item->timer.period * item->params.slack / 100)) {
+
+            /* Restart the timer and execute the work now */
+            mender_log_debug("Work '%s' is executed earlier within its slack", item->params.name);
+            item->timer.deadline = now + item->timer.period;
+            mender_scheduler_timer_heap_update(item->timer.index - 1);
+            mender_scheduler_timer_callback(item);
+        }
+        item = (mender_scheduler_work_context_t *)item->next;
+    }
+
+    /* Wake up the timer thread so that it takes the new deadlines into account */
+    pthread_cond_signal(&mender_scheduler_timer_service.cond_handle);
+
+    pthread_mutex_unlock(&mender_scheduler_timer_service.mutex_handle);
+    pthread_mutex_unlock(&mender_scheduler_work_list_mutex);
+}
+
+static void *
+mender_scheduler_task_thread(void *arg) {
+
+    assert(NULL != arg);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)arg;
+
+    /* Call task function */
+    task_context->params.function(task_context->params.arg);
+
+    return NULL;
+}
+
+static mender_err_t
+mender_scheduler_queue_wait(mender_scheduler_queue_context_t *queue_context, int32_t delay_ms) {
+
+    assert(NULL != queue_context);
+
+    /* Wait for the condition */
+    if (delay_ms >= 0) {
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_sec += delay_ms / 1000;
+        timeout.tv_nsec += (delay_ms % 1000) * 1000000;
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+        if (0 != pthread_cond_timedwait(&queue_context->cond_handle, &queue_context->mutex_handle, &timeout)) {
+            return MENDER_FAIL;
+        }
+    } else {
+        if (0 != pthread_cond_wait(&queue_context->cond_handle, &queue_context->mutex_handle)) {
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static void
+mender_scheduler_queue_release(mender_scheduler_queue_context_t *queue_context) {
+
+    assert(NULL != queue_context);
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, sizeof(mender_scheduler_queue_context_t), queue_context);
+#else
+    mender_free(queue_context->buffer);
+    mender_free(queue_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+static void *
+mender_scheduler_pool_alloc(void *pool, bool *used, size_t count, size_t size) {
+
+    assert(NULL != pool);
+    assert(NULL != used);
+    void *item = NULL;
+
+    /* Look for an item which is not used */
+    pthread_mutex_lock(&mender_scheduler_pool_mutex);
+    for (size_t index = 0; index < count; index++) {
+        if (false == used[index]) {
+            used[index] = true;
+            item        = (uint8_t *)pool + index * size;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mender_scheduler_pool_mutex);
+
+    return item;
+}
+
+static void
+mender_scheduler_pool_free(void *pool, bool *used, size_t size, void *item) {
+
+    assert(NULL != pool);
+    assert(NULL != used);
+    assert(NULL != item);
+
+    /* Release the item */
+    pthread_mutex_lock(&mender_scheduler_pool_mutex);
+    used[((uint8_t *)item - (uint8_t *)pool) / size] = false;
+    pthread_mutex_unlock(&mender_scheduler_pool_mutex);
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
@@ -17,9 +17,16 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_SCHEDULER
+
 #include <zephyr/kernel.h>
 #include "mender-log.h"
+#include "mender-metrics.h"
 #include "mender-scheduler.h"
+#include "mender-trace.h"
 
 /**
  * @brief Default work queue stack size (kB)
@@ -35,22 +42,120 @@
 #define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY (5)
 #endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY */
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief Default high priority work queue stack size (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE (12)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE */
+
+/**
+ * @brief Default high priority work queue priority
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY (4)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY */
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Default number of works of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT */
+
+/**
+ * @brief Default number of mutexes of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT (12)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT */
+
+/**
+ * @brief Default number of tasks of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT (3)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT */
+
+/**
+ * @brief Default stack size of the tasks of the static pool (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE */
+
+/**
+ * @brief Default number of queues of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT (2)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT */
+
+/**
+ * @brief Default storage size of the queues of the static pool (bytes)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE (64)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE */
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Work context
  */
 typedef struct {
-    mender_scheduler_work_params_t params;       /**< Work parameters */
-    struct k_sem                   sem_handle;   /**< Semaphore used to indicate work is pending or executing */
-    struct k_timer                 timer_handle; /**< Timer used to periodically execute work */
-    struct k_work                  work_handle;  /**< Work handle used to execute the work function */
-    bool                           activated;    /**< Flag indicating the work is activated */
+    mender_scheduler_work_params_t params;             /**< Work parameters */
+    struct k_sem                   sem_handle;         /**< Semaphore used to indicate work is pending or executing */
+    struct k_timer                 timer_handle;       /**< Timer used to periodically execute work */
+    struct k_timer                 delay_timer_handle; /**< Timer used to execute work once after a delay */
+    struct k_work                  work_handle;        /**< Work handle used to execute the work function */
+    struct k_work_q               *work_queue_handle;  /**< Work queue executing the work, chosen according to the work priority */
+    bool                           activated;          /**< Flag indicating the work is activated */
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    mender_scheduler_work_stats_t  stats;              /**< Work statistics */
+    uint64_t                       submission_time;    /**< Uptime of the last submission of the work (microseconds) */
+    atomic_t                      *work_queue_pending; /**< Number of works pending in the work queue executing the work */
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    void                          *next;               /**< Next work of the list of the works */
 } mender_scheduler_work_context_t;
 
+/**
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;        /**< Task parameters */
+    struct k_thread                thread_handle; /**< Thread handle */
+    k_thread_stack_t              *stack;         /**< Thread stack */
+} mender_scheduler_task_context_t;
+
+/**
+ * @brief Queue context
+ */
+typedef struct {
+    struct k_msgq msgq_handle; /**< Message queue handle */
+    char         *buffer;      /**< Message queue buffer */
+} mender_scheduler_queue_context_t;
+
 /**
  * @brief Mender scheduler work queue stack
  */
 K_THREAD_STACK_DEFINE(mender_scheduler_work_queue_stack, CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024);
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief Mender scheduler high priority work queue stack
+ */
+K_THREAD_STACK_DEFINE(mender_scheduler_high_priority_work_queue_stack, CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE * 1024);
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
 /**
  * @brief Function used to handle work context timer when it expires
  * @param handle Timer handler
@@ -63,11 +168,156 @@ static void mender_scheduler_timer_callback(struct k_timer *handle);
  */
 static void mender_scheduler_work_handler(struct k_work *handle);
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Function used to record the statistics of an execution of a work
+ * @param work_context Work context
+ * @param start_time Uptime when the execution of the work function started (microseconds)
+ * @param stop_time Uptime when the execution of the work function stopped (microseconds)
+ */
+static void mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+/**
+ * @brief Function used to execute now the works which periodic execution is due within their slack, their timers are restarted
+ * @param work_context Work context which execution wakes up the device, NULL if none
+ */
+static void mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Thread entry point of the tasks
+ * @param p1 Task context
+ * @param p2 Not used
+ * @param p3 Not used
+ */
+static void mender_scheduler_task_entry(void *p1, void *p2, void *p3);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Function used to allocate an item of a static pool
+ * @param pool Pool of items
+ * @param used Flags indicating the items of the pool which are used
+ * @param count Number of items of the pool
+ * @param size Size of the items (bytes)
+ * @return Item allocated if the function succeeds, NULL if the pool is exhausted
+ */
+static void *mender_scheduler_pool_alloc(void *pool, bool *used, size_t count, size_t size);
+
+/**
+ * @brief Function used to release an item of a static pool
+ * @param pool Pool of items
+ * @param used Flags indicating the items of the pool which are used
+ * @param size Size of the items (bytes)
+ * @param item Item to be released
+ */
+static void mender_scheduler_pool_free(void *pool, bool *used, size_t size, void *item);
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Mender scheduler work queue handle
  */
 static struct k_work_q mender_scheduler_work_queue_handle;
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Number of works pending in the work queue
+ */
+static atomic_t mender_scheduler_work_queue_pending = ATOMIC_INIT(0);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief Mender scheduler high priority work queue handle
+ */
+static struct k_work_q mender_scheduler_high_priority_work_queue_handle;
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Number of works pending in the high priority work queue
+ */
+static atomic_t mender_scheduler_high_priority_work_queue_pending = ATOMIC_INIT(0);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+/**
+ * @brief List of the works, used to coalesce their periodic executions
+ */
+static mender_scheduler_work_context_t *mender_scheduler_work_list = NULL;
+
+/**
+ * @brief Mutex used to protect the list of the works
+ */
+static K_MUTEX_DEFINE(mender_scheduler_work_list_mutex);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Mutex used to protect the static pools
+ */
+static K_MUTEX_DEFINE(mender_scheduler_pool_mutex);
+
+/**
+ * @brief Static pool of works
+ */
+static mender_scheduler_work_context_t mender_scheduler_work_pool[CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Flags indicating the works of the static pool which are used
+ */
+static bool mender_scheduler_work_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT];
+
+/**
+ * @brief Static pool of mutexes
+ */
+static struct k_mutex mender_scheduler_mutex_pool[CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT];
+
+/**
+ * @brief Flags indicating the mutexes of the static pool which are used
+ */
+static bool mender_scheduler_mutex_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT];
+
+/**
+ * @brief Static pool of tasks
+ */
+static mender_scheduler_task_context_t mender_scheduler_task_pool[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT];
+
+/**
+ * @brief Flags indicating the tasks of the static pool which are used
+ */
+static bool mender_scheduler_task_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT];
+
+/**
+ * @brief Stacks of the tasks of the static pool
+ */
+K_THREAD_STACK_ARRAY_DEFINE(mender_scheduler_task_stacks, CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT, CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE * 1024);
+
+/**
+ * @brief Static pool of queues
+ */
+static mender_scheduler_queue_context_t mender_scheduler_queue_pool[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT];
+
+/**
+ * @brief Flags indicating the queues of the static pool which are used
+ */
+static bool mender_scheduler_queue_pool_used[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT];
+
+/**
+ * @brief Storage of the items of the queues of the static pool, aligned for any item type
+ */
+static uint64_t mender_scheduler_queue_storage[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT][(CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE + 7) / 8];
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 mender_err_t
 mender_scheduler_init(void) {
 
@@ -80,6 +330,17 @@ mender_scheduler_init(void) {
                        NULL);
     k_thread_name_set(k_work_queue_thread_get(&mender_scheduler_work_queue_handle), "mender_scheduler_work_queue");
 
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    /* Create and start high priority work queue */
+    k_work_queue_init(&mender_scheduler_high_priority_work_queue_handle);
+    k_work_queue_start(&mender_scheduler_high_priority_work_queue_handle,
+                       mender_scheduler_high_priority_work_queue_stack,
+                       CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_STACK_SIZE * 1024,
+                       CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_PRIORITY,
+                       NULL);
+    k_thread_name_set(k_work_queue_thread_get(&mender_scheduler_high_priority_work_queue_handle), "mender_scheduler_high_priority_work_queue");
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
     return MENDER_OK;
 }
 
@@ -92,20 +353,35 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     assert(NULL != handle);
 
     /* Create work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)malloc(sizeof(mender_scheduler_work_context_t));
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_work_pool, mender_scheduler_work_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_WORK_COUNT, sizeof(mender_scheduler_work_context_t));
+    if (NULL == work_context) {
+        mender_log_error("Unable to allocate work, the static pool is exhausted");
+        goto FAIL;
+    }
+#else
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_malloc(sizeof(mender_scheduler_work_context_t));
     if (NULL == work_context) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
 
-    /* Copy work parameters */
+    /* Copy work parameters, the name is not copied with the static allocation */
     work_context->params.function = work_params->function;
     work_context->params.period   = work_params->period;
-    if (NULL == (work_context->params.name = strdup(work_params->name))) {
+    work_context->params.priority = work_params->priority;
+    work_context->params.slack    = work_params->slack;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    work_context->params.name = work_params->name;
+#else
+    if (NULL == (work_context->params.name = mender_strdup(work_params->name))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     /* Create semaphore used to protect work function */
     if (0 != k_sem_init(&work_context->sem_handle, 0, 1)) {
@@ -117,9 +393,39 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     k_timer_init(&work_context->timer_handle, mender_scheduler_timer_callback, NULL);
     k_timer_user_data_set(&work_context->timer_handle, (void *)work_context);
 
+    /* Create timer to handle the work once after a delay */
+    k_timer_init(&work_context->delay_timer_handle, mender_scheduler_timer_callback, NULL);
+    k_timer_user_data_set(&work_context->delay_timer_handle, (void *)work_context);
+
     /* Create work used to execute work function */
     k_work_init(&work_context->work_handle, mender_scheduler_work_handler);
 
+    /* Select the work queue according to the work priority */
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    if (MENDER_SCHEDULER_WORK_PRIORITY_HIGH == work_context->params.priority) {
+        work_context->work_queue_handle = &mender_scheduler_high_priority_work_queue_handle;
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        work_context->work_queue_pending = &mender_scheduler_high_priority_work_queue_pending;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    } else {
+        work_context->work_queue_handle = &mender_scheduler_work_queue_handle;
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        work_context->work_queue_pending = &mender_scheduler_work_queue_pending;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    }
+#else
+    work_context->work_queue_handle = &mender_scheduler_work_queue_handle;
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    work_context->work_queue_pending = &mender_scheduler_work_queue_pending;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    /* Add the work to the list of the works */
+    k_mutex_lock(&mender_scheduler_work_list_mutex, K_FOREVER);
+    work_context->next         = mender_scheduler_work_list;
+    mender_scheduler_work_list = work_context;
+    k_mutex_unlock(&mender_scheduler_work_list_mutex);
+
     /* Return handle to the new work context */
     *handle = (void *)work_context;
 
@@ -129,10 +435,14 @@ FAIL:
 
     /* Release memory */
     if (NULL != work_context) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_pool_free(mender_scheduler_work_pool, mender_scheduler_work_pool_used, sizeof(mender_scheduler_work_context_t), work_context);
+#else
         if (NULL != work_context->params.name) {
-            free(work_context->params.name);
+            mender_free(work_context->params.name);
         }
-        free(work_context);
+        mender_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     }
 
     return MENDER_FAIL;
@@ -176,6 +486,52 @@ mender_scheduler_work_execute(void *handle) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_scheduler_work_execute_after(void *handle, uint32_t delay_ms) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Execute the work now if there is no delay */
+    if (0 == delay_ms) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    /* Keep the delayed execution already scheduled if it is nearer */
+    uint32_t remaining_ms = k_timer_remaining_get(&work_context->delay_timer_handle);
+    if ((remaining_ms > 0) && (remaining_ms <= delay_ms)) {
+        return MENDER_OK;
+    }
+
+    /* Start the timer to handle the work once */
+    k_timer_start(&work_context->delay_timer_handle, K_MSEC(delay_ms), K_NO_WAIT);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_execute_at(void *handle, uint64_t uptime_us) {
+
+    assert(NULL != handle);
+    uint64_t now = mender_scheduler_get_uptime_us();
+    uint64_t delay_ms;
+
+    /* Execute the work now if the deadline is reached */
+    if (uptime_us <= now) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    /* Execute the work after the delay remaining until the deadline, rounded up to the millisecond */
+    delay_ms = (uptime_us - now + 999) / 1000;
+    if (delay_ms > UINT32_MAX) {
+        delay_ms = UINT32_MAX;
+    }
+
+    return mender_scheduler_work_execute_after(handle, (uint32_t)delay_ms);
+}
+
 mender_err_t
 mender_scheduler_work_set_period(void *handle, uint32_t period) {
 
@@ -187,7 +543,7 @@ mender_scheduler_work_set_period(void *handle, uint32_t period) {
     /* Set timer period */
     work_context->params.period = period;
     if (work_context->params.period > 0) {
-        k_timer_start(&work_context->timer_handle, K_FOREVER, K_MSEC(1000 * work_context->params.period));
+        k_timer_start(&work_context->timer_handle, K_MSEC(1000 * work_context->params.period), K_MSEC(1000 * work_context->params.period));
     } else {
         k_timer_stop(&work_context->timer_handle);
     }
@@ -206,8 +562,9 @@ mender_scheduler_work_deactivate(void *handle) {
     /* Check if the work was activated */
     if (true == work_context->activated) {
 
-        /* Stop the timer used to periodically execute the work (if it is running) */
+        /* Stop the timers used to execute the work (if they are running) */
         k_timer_stop(&work_context->timer_handle);
+        k_timer_stop(&work_context->delay_timer_handle);
 
         /* Wait if the work is pending or executing */
         if (0 != k_sem_take(&work_context->sem_handle, K_FOREVER)) {
@@ -230,29 +587,77 @@ mender_scheduler_work_delete(void *handle) {
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
+    /* Remove the work from the list of the works */
+    k_mutex_lock(&mender_scheduler_work_list_mutex, K_FOREVER);
+    mender_scheduler_work_context_t **item = &mender_scheduler_work_list;
+    while ((NULL != *item) && (work_context != *item)) {
+        item = (mender_scheduler_work_context_t **)&(*item)->next;
+    }
+    if (NULL != *item) {
+        *item = (mender_scheduler_work_context_t *)work_context->next;
+    }
+    k_mutex_unlock(&mender_scheduler_work_list_mutex);
+
     /* Release memory */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_work_pool, mender_scheduler_work_pool_used, sizeof(mender_scheduler_work_context_t), work_context);
+#else
     if (NULL != work_context->params.name) {
-        free(work_context->params.name);
+        mender_free(work_context->params.name);
     }
-    free(work_context);
+    mender_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+mender_err_t
+mender_scheduler_work_get_stats(void *handle, mender_scheduler_work_stats_t *stats) {
+
+    assert(NULL != handle);
+    assert(NULL != stats);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Copy work statistics */
+    memcpy(stats, &work_context->stats, sizeof(mender_scheduler_work_stats_t));
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
 mender_err_t
 mender_scheduler_mutex_create(void **handle) {
 
     assert(NULL != handle);
 
     /* Create mutex */
-    if (NULL == (*handle = malloc(sizeof(struct k_mutex)))) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL
+        == (*handle = mender_scheduler_pool_alloc(
+                mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_MUTEX_COUNT, sizeof(struct k_mutex)))) {
+        mender_log_error("Unable to allocate mutex, the static pool is exhausted");
         return MENDER_FAIL;
     }
     if (0 != k_mutex_init((struct k_mutex *)(*handle))) {
-        free(*handle);
+        mender_scheduler_pool_free(mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, sizeof(struct k_mutex), *handle);
         *handle = NULL;
         return MENDER_FAIL;
     }
+#else
+    if (NULL == (*handle = mender_malloc(sizeof(struct k_mutex)))) {
+        return MENDER_FAIL;
+    }
+    if (0 != k_mutex_init((struct k_mutex *)(*handle))) {
+        mender_free(*handle);
+        *handle = NULL;
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
@@ -289,7 +694,236 @@ mender_scheduler_mutex_delete(void *handle) {
     assert(NULL != handle);
 
     /* Release memory */
-    free(handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_mutex_pool, mender_scheduler_mutex_pool_used, sizeof(struct k_mutex), handle);
+#else
+    mender_free(handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+
+    /* Create task context */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (task_params->stack_size > CONFIG_MENDER_SCHEDULER_STATIC_TASK_STACK_SIZE) {
+        mender_log_error("Unable to create task '%s', its stack size exceeds the stack size of the static pool", task_params->name);
+        return MENDER_FAIL;
+    }
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_task_pool, mender_scheduler_task_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_TASK_COUNT, sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate task, the static pool is exhausted");
+        goto FAIL;
+    }
+#else
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+
+    /* Copy task parameters, the name is not copied with the static allocation */
+    task_context->params.function   = task_params->function;
+    task_context->params.arg        = task_params->arg;
+    task_context->params.stack_size = task_params->stack_size;
+    task_context->params.priority   = task_params->priority;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    task_context->params.name = task_params->name;
+#else
+    if (NULL == (task_context->params.name = mender_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Allocate thread stack */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    task_context->stack = mender_scheduler_task_stacks[task_context - mender_scheduler_task_pool];
+#else
+    if (NULL == (task_context->stack = k_thread_stack_alloc(task_context->params.stack_size * 1024, 0))) {
+        mender_log_error("Unable to allocate thread stack");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Create and start thread */
+    k_tid_t thread = k_thread_create(&task_context->thread_handle,
+                                     task_context->stack,
+                                     task_context->params.stack_size * 1024,
+                                     mender_scheduler_task_entry,
+                                     task_context,
+                                     NULL,
+                                     NULL,
+                                     task_context->params.priority,
+                                     0,
+                                     K_NO_WAIT);
+    k_thread_name_set(thread, task_context->params.name);
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != task_context) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_pool_free(mender_scheduler_task_pool, mender_scheduler_task_pool_used, sizeof(mender_scheduler_task_context_t), task_context);
+#else
+        if (NULL != task_context->params.name) {
+            mender_free(task_context->params.name);
+        }
+        mender_free(task_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    }
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait for the end of the thread */
+    if (0 != k_thread_join(&task_context->thread_handle, K_FOREVER)) {
+        mender_log_error("Unable to join thread");
+        return MENDER_FAIL;
+    }
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_task_pool, mender_scheduler_task_pool_used, sizeof(mender_scheduler_task_context_t), task_context);
+#else
+    k_thread_stack_free(task_context->stack);
+    mender_free(task_context->params.name);
+    mender_free(task_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 != length);
+    assert(0 != item_size);
+    assert(NULL != handle);
+
+    /* Create queue context */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (length * item_size > CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_SIZE) {
+        mender_log_error("Unable to allocate queue, its size exceeds the storage of the static pool");
+        return MENDER_FAIL;
+    }
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_scheduler_pool_alloc(
+        mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_COUNT, sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        mender_log_error("Unable to allocate queue, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    queue_context->buffer = (char *)mender_scheduler_queue_storage[queue_context - mender_scheduler_queue_pool];
+#else
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_malloc(sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        return MENDER_FAIL;
+    }
+    if (NULL == (queue_context->buffer = (char *)mender_malloc(length * item_size))) {
+        mender_free(queue_context);
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Create message queue */
+    k_msgq_init(&queue_context->msgq_handle, queue_context->buffer, item_size, length);
+
+    /* Return handle to the new queue context */
+    *handle = (void *)queue_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Send item */
+    if (0 != k_msgq_put(&((mender_scheduler_queue_context_t *)handle)->msgq_handle, item, (delay_ms >= 0) ? K_MSEC(delay_ms) : K_FOREVER)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Receive item */
+    if (0 != k_msgq_get(&((mender_scheduler_queue_context_t *)handle)->msgq_handle, item, (delay_ms >= 0) ? K_MSEC(delay_ms) : K_FOREVER)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_pool_free(mender_scheduler_queue_pool, mender_scheduler_queue_pool_used, sizeof(mender_scheduler_queue_context_t), handle);
+#else
+    mender_free(((mender_scheduler_queue_context_t *)handle)->buffer);
+    mender_free(handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+uint64_t
+mender_scheduler_get_uptime_us(void) {
+
+    /* Convert uptime ticks to microseconds */
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+void
+mender_scheduler_yield(uint32_t delay_ms) {
+
+    /* Sleep or yield to the threads of the same priority */
+    if (0 == delay_ms) {
+        k_yield();
+    } else {
+        k_msleep((int32_t)delay_ms);
+    }
+}
+
+mender_err_t
+mender_scheduler_notify_wakeup(void) {
+
+    /* Execute the works which periodic execution is due within their slack */
+    mender_scheduler_work_coalesce(NULL);
 
     return MENDER_OK;
 }
@@ -313,12 +947,31 @@ mender_scheduler_timer_callback(struct k_timer *handle) {
     /* Exit if the work is already pending or executing */
     if (0 != k_sem_take(&work_context->sem_handle, K_NO_WAIT)) {
         mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+        if (true == work_context->activated) {
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+            work_context->stats.overruns++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+            MENDER_METRICS_ADD(MENDER_METRICS_SCHEDULER_OVERRUNS, 1);
+        }
         return;
     }
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    /* Update the high-water mark of the work queue */
+    atomic_val_t count = atomic_inc(work_context->work_queue_pending) + 1;
+    if ((uint32_t)count > work_context->stats.queue_high_water_mark) {
+        work_context->stats.queue_high_water_mark = (uint32_t)count;
+    }
+    work_context->submission_time = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
     /* Submit the work to the work queue */
-    if (k_work_submit_to_queue(&mender_scheduler_work_queue_handle, &work_context->work_handle) < 0) {
+    if (k_work_submit_to_queue(work_context->work_queue_handle, &work_context->work_handle) < 0) {
         mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        atomic_dec(work_context->work_queue_pending);
+        work_context->stats.losses++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
         k_sem_give(&work_context->sem_handle);
     }
 }
@@ -332,8 +985,28 @@ mender_scheduler_work_handler(struct k_work *handle) {
     mender_scheduler_work_context_t *work_context = CONTAINER_OF(handle, mender_scheduler_work_context_t, work_handle);
     assert(NULL != work_context);
 
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    /* The work is not pending in the work queue anymore */
+    atomic_dec(work_context->work_queue_pending);
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+    /* Execute together the other works which periodic execution is due within their slack, the device is awake anyway */
+    mender_scheduler_work_coalesce(work_context);
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    uint64_t start_time = mender_scheduler_get_uptime_us();
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
     /* Call work function */
-    if (MENDER_DONE == work_context->params.function()) {
+    MENDER_TRACE_BEGIN(MENDER_TRACE_EVENT_SCHEDULER_WORK);
+    mender_err_t ret = work_context->params.function();
+    MENDER_TRACE_END(MENDER_TRACE_EVENT_SCHEDULER_WORK);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    /* Record the statistics of the execution */
+    mender_scheduler_work_stats_record(work_context, start_time, mender_scheduler_get_uptime_us());
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+    if (MENDER_DONE == ret) {
 
         /* Work is done, stop timer used to execute the work periodically */
         k_timer_stop(&work_context->timer_handle);
@@ -342,3 +1015,111 @@ mender_scheduler_work_handler(struct k_work *handle) {
     /* Release semaphore used to protect the work function */
     k_sem_give(&work_context->sem_handle);
 }
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+static void
+mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time) {
+
+    assert(NULL != work_context);
+    uint64_t run_time = stop_time - start_time;
+    uint64_t latency  = start_time - work_context->submission_time;
+    size_t   index    = 0;
+
+    /* Update the number of executions, the run time and the start latency of the work */
+    work_context->stats.executions++;
+    work_context->stats.run_time_total_us += run_time;
+    if (run_time > work_context->stats.run_time_max_us) {
+        work_context->stats.run_time_max_us = (uint32_t)run_time;
+    }
+    work_context->stats.latency_total_us += latency;
+    if (latency > work_context->stats.latency_max_us) {
+        work_context->stats.latency_max_us = (uint32_t)latency;
+    }
+
+    /* Update the run time histogram, the bucket is given by the number of significant bits of the run time in milliseconds */
+    for (uint64_t value = run_time / 1000; (value > 0) && (index < MENDER_SCHEDULER_WORK_STATISTICS_BUCKET_COUNT - 1); value >>= 1) {
+        index++;
+    }
+    work_context->stats.run_time_histogram[index]++;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+static void
+mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context) {
+
+    k_mutex_lock(&mender_scheduler_work_list_mutex, K_FOREVER);
+
+    /* Parse the list of the works */
+    mender_scheduler_work_context_t *item = mender_scheduler_work_list;
+    while (NULL != item) {
+
+        /* Check if the periodic execution of the work is due within its slack */
+        if ((work_context != item) && (0 != item->params.slack) && (item->params.period > 0)) {
+            uint32_t remaining_ms = k_timer_remaining_get(&item->timer_handle);
+            if ((remaining_ms > 0) && (remaining_ms <= (uint32_t)item->params.period * 10 * item->params.slack)) {
+
+                /* Restart the timer and execute the work now */
+                mender_log_debug("Work '%s' is executed earlier within its slack", item->params.name);
+                k_timer_start(&item->timer_handle, K_MSEC(1000 * item->params.period), K_MSEC(1000 * item->params.period));
+                mender_scheduler_timer_callback(&item->timer_handle);
+            }
+        }
+        item = (mender_scheduler_work_context_t *)item->next;
+    }
+
+    k_mutex_unlock(&mender_scheduler_work_list_mutex);
+}
+
+static void
+mender_scheduler_task_entry(void *p1, void *p2, void *p3) {
+
+    assert(NULL != p1);
+    (void)p2;
+    (void)p3;
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)p1;
+
+    /* Call task function */
+    task_context->params.function(task_context->params.arg);
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+static void *
+mender_scheduler_pool_alloc(void *pool, bool *used, size_t count, size_t size) {
+
+    assert(NULL != pool);
+    assert(NULL != used);
+    void *item = NULL;
+
+    /* Look for an item which is not used */
+    k_mutex_lock(&mender_scheduler_pool_mutex, K_FOREVER);
+    for (size_t index = 0; index < count; index++) {
+        if (false == used[index]) {
+            used[index] = true;
+            item        = (uint8_t *)pool + index * size;
+            break;
+        }
+    }
+    k_mutex_unlock(&mender_scheduler_pool_mutex);
+
+    return item;
+}
+
+static void
+mender_scheduler_pool_free(void *pool, bool *used, size_t size, void *item) {
+
+    assert(NULL != pool);
+    assert(NULL != used);
+    assert(NULL != item);
+
+    /* Release the item */
+    k_mutex_lock(&mender_scheduler_pool_mutex, K_FOREVER);
+    used[((uint8_t *)item - (uint8_t *)pool) / size] = false;
+    k_mutex_unlock(&mender_scheduler_pool_mutex);
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TROUBLESHOOT
+
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
@@ -105,6 +110,8 @@ typedef struct {
     uint8_t                   tx_buffer[CONFIG_MENDER_SHELL_TX_RING_BUFFER_SIZE]; /**< Tx ring buffer */
     struct k_work_q           tx_work_queue_handle;                               /**< Tx work queue handle */
     struct k_work_delayable   tx_work_handle;                                     /**< Tx work handle */
+    struct k_mutex            tx_mutex;                                           /**< Mutex used to read the tx ring buffer */
+    size_t                    sessions;                                           /**< Number of sessions opened */
 } mender_shell_context_t;
 
 /**
@@ -112,25 +119,19 @@ typedef struct {
  */
 static mender_shell_context_t mender_shell_context;
 
+/**
+ * @brief Send data of the tx ring buffer to the shell on the mender server
+ * @param ctx Mender shell context
+ */
+static void mender_shell_tx_flush(mender_shell_context_t *ctx);
+
 static void
 mender_shell_tx_work_handler(struct k_work *work) {
 
     (void)work;
-    uint8_t *buffer;
-    size_t   length;
-
-    /* Retrieve length of data available in the tx ring buffer */
-    if ((length = ring_buf_size_get(&mender_shell_context.tx_ringbuf)) > 0) {
-
-        /* Send data to the shell on the mender server */
-        if (NULL == (buffer = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-        } else {
-            ring_buf_get(&mender_shell_context.tx_ringbuf, buffer, (uint32_t)length);
-            mender_troubleshoot_shell_print(buffer, length);
-            free(buffer);
-        }
-    }
+
+    /* Flush the tx ring buffer */
+    mender_shell_tx_flush(&mender_shell_context);
 }
 
 static int
@@ -161,6 +162,7 @@ mender_shell_transport_api_init(const struct shell_transport *transport, const v
 
     /* Initialize tx work handle */
     k_work_init_delayable(&ctx->tx_work_handle, mender_shell_tx_work_handler);
+    k_mutex_init(&ctx->tx_mutex);
 
     return 0;
 }
@@ -199,7 +201,6 @@ mender_shell_transport_api_write(const struct shell_transport *transport, const
     assert(NULL != data);
     assert(NULL != cnt);
     mender_shell_context_t *ctx = (mender_shell_context_t *)transport->ctx;
-    uint8_t                *buffer;
 
     /* Cancel pending tx work */
     k_work_cancel_delayable(&ctx->tx_work_handle);
@@ -212,18 +213,15 @@ mender_shell_transport_api_write(const struct shell_transport *transport, const
     }
     *cnt = length;
 
-    /* Retrieve length of data available in the tx ring buffer */
-    if ((length = ring_buf_size_get(&mender_shell_context.tx_ringbuf)) > CONFIG_MENDER_SHELL_TX_RING_BUFFER_SIZE / 4) {
-
-        /* Send data to the shell on the mender server */
-        if (NULL == (buffer = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-        } else {
-            ring_buf_get(&ctx->tx_ringbuf, buffer, (uint32_t)length);
-            mender_troubleshoot_shell_print(buffer, length);
-            free(buffer);
-        }
+#ifdef CONFIG_MENDER_SHELL_TX_ADAPTIVE
+    /* Hand data to the troubleshoot add-on immediately, interactive echo is sent at once and bulk output is batched up to the frame size */
+    mender_shell_tx_flush(ctx);
+#else
+    /* Send data when the tx ring buffer is filled enough */
+    if (ring_buf_size_get(&ctx->tx_ringbuf) > CONFIG_MENDER_SHELL_TX_RING_BUFFER_SIZE / 4) {
+        mender_shell_tx_flush(ctx);
     }
+#endif /* CONFIG_MENDER_SHELL_TX_ADAPTIVE */
 
     /* If tx ring buffer is not empty, schedule delayed tx work to flush the ring buffer */
     if (!ring_buf_is_empty(&ctx->tx_ringbuf)) {
@@ -252,6 +250,26 @@ mender_shell_transport_api_read(const struct shell_transport *transport, void *d
     return 0;
 }
 
+static void
+mender_shell_tx_flush(mender_shell_context_t *ctx) {
+
+    assert(NULL != ctx);
+    uint8_t *data;
+    uint32_t length;
+
+    /* Take mutex used to read the tx ring buffer, it is flushed by the shell thread and the tx work queue */
+    k_mutex_lock(&ctx->tx_mutex, K_FOREVER);
+
+    /* Send data to the shell on the mender server, they are read in place, in two parts when they wrap around the end of the ring buffer */
+    while (0 < (length = ring_buf_get_claim(&ctx->tx_ringbuf, &data, CONFIG_MENDER_SHELL_TX_RING_BUFFER_SIZE))) {
+        mender_troubleshoot_shell_print(NULL, data, length);
+        ring_buf_get_finish(&ctx->tx_ringbuf, length);
+    }
+
+    /* Release mutex used to read the tx ring buffer */
+    k_mutex_unlock(&ctx->tx_mutex);
+}
+
 /**
  * @brief Mender shell transport API
  */
@@ -292,13 +310,14 @@ mender_shell_init(void) {
 SYS_INIT(mender_shell_init, POST_KERNEL, 0);
 
 mender_err_t
-mender_shell_open(uint16_t terminal_width, uint16_t terminal_height) {
+mender_shell_open(void *session, uint16_t terminal_width, uint16_t terminal_height) {
 
+    (void)session;
     (void)terminal_height;
     (void)terminal_width;
 
-    /* Start shell */
-    if (!IS_ENABLED(CONFIG_SHELL_AUTOSTART)) {
+    /* Start shell when the first session is opened, it is shared by the sessions */
+    if ((0 == mender_shell_context.sessions++) && (!IS_ENABLED(CONFIG_SHELL_AUTOSTART))) {
         shell_start(&mender_shell);
     }
 
@@ -306,8 +325,9 @@ mender_shell_open(uint16_t terminal_width, uint16_t terminal_height) {
 }
 
 mender_err_t
-mender_shell_resize(uint16_t terminal_width, uint16_t terminal_height) {
+mender_shell_resize(void *session, uint16_t terminal_width, uint16_t terminal_height) {
 
+    (void)session;
     (void)terminal_height;
     (void)terminal_width;
 
@@ -317,8 +337,9 @@ mender_shell_resize(uint16_t terminal_width, uint16_t terminal_height) {
 }
 
 mender_err_t
-mender_shell_write(void *data, size_t length) {
+mender_shell_write(void *session, void *data, size_t length) {
 
+    (void)session;
     mender_err_t ret = MENDER_OK;
 
     /* Check if event handler is defined */
@@ -344,10 +365,12 @@ END:
 }
 
 mender_err_t
-mender_shell_close(void) {
+mender_shell_close(void *session) {
+
+    (void)session;
 
-    /* Stop shell */
-    if (!IS_ENABLED(CONFIG_SHELL_AUTOSTART)) {
+    /* Stop shell when the last session is closed */
+    if ((0 < mender_shell_context.sessions) && (0 == --mender_shell_context.sessions) && (!IS_ENABLED(CONFIG_SHELL_AUTOSTART))) {
         shell_stop(&mender_shell);
     }
 
@@ -17,25 +17,99 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE
+
 #include <nvs_flash.h>
 #include "mender-log.h"
 #include "mender-storage.h"
+#include "mender-storage-cache.h"
 
 /**
  * @brief NVS keys
  * @note According to the ESP-IDF documentation the NVS keys are limited to 15 characters
  * @note https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/storage/nvs_flash.html#keys-and-values
  */
-#define MENDER_STORAGE_NVS_PRIVATE_KEY     "key.der"
-#define MENDER_STORAGE_NVS_PUBLIC_KEY      "pubkey.der"
-#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA "deployment.json"
-#define MENDER_STORAGE_NVS_DEVICE_CONFIG   "config.json"
+#define MENDER_STORAGE_NVS_PRIVATE_KEY          "key.der"
+#define MENDER_STORAGE_NVS_PUBLIC_KEY           "pubkey.der"
+#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA      "deployment.json"
+#define MENDER_STORAGE_NVS_DEVICE_CONFIG        "config.json"
+#define MENDER_STORAGE_NVS_AUTHENTICATION_TOKEN "token.jwt"
+#define MENDER_STORAGE_NVS_INSTALL_CHECKPOINT   "checkpoint.json"
 
 /**
  * @brief NVS storage handle
  */
 static nvs_handle_t mender_storage_nvs_handle;
 
+/**
+ * @brief NVS keys of the storage items
+ */
+static const char *mender_storage_nvs_keys[MENDER_STORAGE_ITEM_COUNT]
+    = { [MENDER_STORAGE_ITEM_PRIVATE_KEY]          = MENDER_STORAGE_NVS_PRIVATE_KEY,
+        [MENDER_STORAGE_ITEM_PUBLIC_KEY]           = MENDER_STORAGE_NVS_PUBLIC_KEY,
+        [MENDER_STORAGE_ITEM_DEPLOYMENT_DATA]      = MENDER_STORAGE_NVS_DEPLOYMENT_DATA,
+        [MENDER_STORAGE_ITEM_DEVICE_CONFIG]        = MENDER_STORAGE_NVS_DEVICE_CONFIG,
+        [MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN] = MENDER_STORAGE_NVS_AUTHENTICATION_TOKEN,
+        [MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT]   = MENDER_STORAGE_NVS_INSTALL_CHECKPOINT };
+
+/**
+ * @brief Check if a storage item is a string, the keys are saved as blobs
+ */
+#define MENDER_STORAGE_NVS_IS_STRING(item) ((MENDER_STORAGE_ITEM_PRIVATE_KEY != (item)) && (MENDER_STORAGE_ITEM_PUBLIC_KEY != (item)))
+
+/**
+ * @brief Size of the storage items in NVS, read once at initialization so that the items are then read in a single pass
+ * @note The size is negative if it is unknown, the item is then probed before it is read, and null if the item is not available
+ */
+static ssize_t mender_storage_nvs_sizes[MENDER_STORAGE_ITEM_COUNT];
+
+/**
+ * @brief Probe the size of a storage item in NVS, the size of the strings includes the NUL terminator
+ * @param item Item
+ * @return Size of the item, 0 if the item is not available, negative value if an error occurred
+ */
+static ssize_t mender_storage_probe_item(mender_storage_item_t item);
+
+/**
+ * @brief Read a storage item from NVS
+ * @param item Item
+ * @param data Data of the item with a NUL terminator not counted in the length
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length);
+
+/**
+ * @brief Write a storage item to NVS, it is saved when the items are committed
+ * @param item Item
+ * @param data Data of the item, NUL terminated
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_write_item(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Erase a storage item from NVS, it is saved when the items are committed
+ * @param item Item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_erase_item(mender_storage_item_t item);
+
+/**
+ * @brief Commit the items written and erased to NVS
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_commit_items(void);
+
+/**
+ * @brief Storage operations used by the cache
+ */
+static const mender_storage_cache_ops_t mender_storage_cache_ops
+    = { .read = mender_storage_read_item, .write = mender_storage_write_item, .erase = mender_storage_erase_item, .commit = mender_storage_commit_items };
+
 mender_err_t
 mender_storage_init(void) {
 
@@ -45,7 +119,27 @@ mender_storage_init(void) {
         return MENDER_FAIL;
     }
 
-    return MENDER_OK;
+    /* Index the size of the items */
+    for (size_t item = 0; item < MENDER_STORAGE_ITEM_COUNT; item++) {
+        mender_storage_nvs_sizes[item] = mender_storage_probe_item((mender_storage_item_t)item);
+    }
+
+    /* Initialize the cache, the items are loaded from NVS when they are read for the first time */
+    return mender_storage_cache_init(&mender_storage_cache_ops);
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Begin the transaction */
+    return mender_storage_cache_begin();
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    /* Commit the transaction */
+    return mender_storage_cache_commit();
 }
 
 mender_err_t
@@ -53,19 +147,25 @@ mender_storage_set_authentication_keys(unsigned char *private_key, size_t privat
 
     assert(NULL != private_key);
     assert(NULL != public_key);
+    mender_err_t ret;
 
-    /* Write keys */
-    if ((ESP_OK != nvs_set_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, private_key, private_key_length))
-        || (ESP_OK != nvs_set_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, public_key, public_key_length))) {
+    /* Write keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
         mender_log_error("Unable to write authentication keys");
-        return MENDER_FAIL;
+        return ret;
     }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if ((MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PRIVATE_KEY, private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PUBLIC_KEY, public_key, public_key_length)))) {
         mender_log_error("Unable to write authentication keys");
-        return MENDER_FAIL;
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to write authentication keys");
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
@@ -75,118 +175,200 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
     assert(NULL != private_key_length);
     assert(NULL != public_key);
     assert(NULL != public_key_length);
-
-    /* Retrieve length of the keys */
-    nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, NULL, private_key_length);
-    nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, NULL, public_key_length);
-    if ((0 == *private_key_length) || (0 == *public_key_length)) {
-        mender_log_info("Authentication keys are not available");
-        return MENDER_NOT_FOUND;
-    }
-
-    /* Allocate memory to copy keys */
-    if (NULL == (*private_key = (unsigned char *)malloc(*private_key_length))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
-    }
-    if (NULL == (*public_key = (unsigned char *)malloc(*public_key_length))) {
-        mender_log_error("Unable to allocate memory");
-        free(*private_key);
-        *private_key = NULL;
-        return MENDER_FAIL;
-    }
+    mender_err_t ret;
 
     /* Read keys */
-    if ((ESP_OK != nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, *private_key, private_key_length))
-        || (ESP_OK != nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, *public_key, public_key_length))) {
-        mender_log_error("Unable to read authentication keys");
-        free(*private_key);
-        *private_key = NULL;
-        free(*public_key);
-        *public_key = NULL;
-        return MENDER_FAIL;
+    if ((MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PRIVATE_KEY, (void **)private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PUBLIC_KEY, (void **)public_key, public_key_length)))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication keys are not available");
+        } else {
+            mender_log_error("Unable to read authentication keys");
+        }
+        mender_free(*private_key);
+        *private_key        = NULL;
+        *private_key_length = 0;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_authentication_keys(void) {
 
-    /* Erase keys */
-    if ((ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY))
-        || (ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY))) {
+    mender_err_t ret;
+
+    /* Erase keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
         mender_log_error("Unable to erase authentication keys");
-        return MENDER_FAIL;
+        return ret;
     }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if ((MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PRIVATE_KEY)))
+        || (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PUBLIC_KEY)))) {
         mender_log_error("Unable to erase authentication keys");
-        return MENDER_FAIL;
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to erase authentication keys");
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_set_deployment_data(char *deployment_data) {
 
     assert(NULL != deployment_data);
+    mender_err_t ret;
 
     /* Write deployment data */
-    if (ESP_OK != nvs_set_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data)) {
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, deployment_data, strlen(deployment_data)))) {
         mender_log_error("Unable to write deployment data");
-        return MENDER_FAIL;
-    }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
-        mender_log_error("Unable to write deployment data");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_get_deployment_data(char **deployment_data) {
 
     assert(NULL != deployment_data);
-    size_t deployment_data_length = 0;
-
-    /* Retrieve length of the deployment data */
-    nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, NULL, &deployment_data_length);
-    if (0 == deployment_data_length) {
-        mender_log_info("Deployment data not available");
-        return MENDER_NOT_FOUND;
-    }
-
-    /* Allocate memory to copy deployment data */
-    if (NULL == (*deployment_data = (char *)malloc(deployment_data_length + 1))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
-    }
+    size_t       deployment_data_length;
+    mender_err_t ret;
 
     /* Read deployment data */
-    if (ESP_OK != nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, *deployment_data, &deployment_data_length)) {
-        mender_log_error("Unable to read deployment data");
-        free(*deployment_data);
-        *deployment_data = NULL;
-        return MENDER_FAIL;
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, (void **)deployment_data, &deployment_data_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Deployment data is not available");
+        } else {
+            mender_log_error("Unable to read deployment data");
+        }
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_deployment_data(void) {
 
+    mender_err_t ret;
+
     /* Delete deployment data */
-    if (ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA)) {
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA))) {
         mender_log_error("Unable to delete deployment data");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
+mender_err_t
+mender_storage_set_authentication_token(char *token) {
+
+    assert(NULL != token);
+    mender_err_t ret;
+
+    /* Write authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, token, strlen(token)))) {
+        mender_log_error("Unable to write authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_authentication_token(char **token) {
+
+    assert(NULL != token);
+    size_t       token_length;
+    mender_err_t ret;
+
+    /* Read authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, (void **)token, &token_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication token is not available");
+        } else {
+            mender_log_error("Unable to read authentication token");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_authentication_token(void) {
+
+    mender_err_t ret;
+
+    /* Delete authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN))) {
+        mender_log_error("Unable to delete authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+mender_err_t
+mender_storage_set_install_checkpoint(char *checkpoint) {
+
+    assert(NULL != checkpoint);
+    mender_err_t ret;
+
+    /* Write install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, checkpoint, strlen(checkpoint)))) {
+        mender_log_error("Unable to write install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_install_checkpoint(char **checkpoint) {
+
+    assert(NULL != checkpoint);
+    size_t       checkpoint_length;
+    mender_err_t ret;
+
+    /* Read install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, (void **)checkpoint, &checkpoint_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Install checkpoint is not available");
+        } else {
+            mender_log_error("Unable to read install checkpoint");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_install_checkpoint(void) {
+
+    mender_err_t ret;
+
+    /* Delete install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT))) {
+        mender_log_error("Unable to delete install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
@@ -194,60 +376,49 @@ mender_err_t
 mender_storage_set_device_config(char *device_config) {
 
     assert(NULL != device_config);
+    mender_err_t ret;
 
     /* Write device configuration */
-    if (ESP_OK != nvs_set_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, device_config)) {
-        mender_log_error("Unable to write device configuration");
-        return MENDER_FAIL;
-    }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEVICE_CONFIG, device_config, strlen(device_config)))) {
         mender_log_error("Unable to write device configuration");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_get_device_config(char **device_config) {
 
     assert(NULL != device_config);
-    size_t device_config_length = 0;
-
-    /* Retrieve length of the device configuration */
-    nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, NULL, &device_config_length);
-    if (0 == device_config_length) {
-        mender_log_info("Device configuration not available");
-        return MENDER_NOT_FOUND;
-    }
-
-    /* Allocate memory to copy device configuration */
-    if (NULL == (*device_config = (char *)malloc(device_config_length + 1))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
-    }
+    size_t       device_config_length;
+    mender_err_t ret;
 
     /* Read device configuration */
-    if (ESP_OK != nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, *device_config, &device_config_length)) {
-        mender_log_error("Unable to read device configuration");
-        free(*device_config);
-        *device_config = NULL;
-        return MENDER_FAIL;
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEVICE_CONFIG, (void **)device_config, &device_config_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Device configuration not available");
+        } else {
+            mender_log_error("Unable to read device configuration");
+        }
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_device_config(void) {
 
+    mender_err_t ret;
+
     /* Delete device configuration */
-    if (ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG)) {
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEVICE_CONFIG))) {
         mender_log_error("Unable to delete device configuration");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
@@ -256,8 +427,127 @@ mender_storage_delete_device_config(void) {
 mender_err_t
 mender_storage_exit(void) {
 
+    mender_err_t ret;
+
+    /* Release the cache, the pending items are written */
+    ret = mender_storage_cache_exit();
+
     /* Close NVS storage */
     nvs_close(mender_storage_nvs_handle);
 
+    return ret;
+}
+
+static ssize_t
+mender_storage_probe_item(mender_storage_item_t item) {
+
+    size_t    size = 0;
+    esp_err_t err;
+
+    /* Retrieve size of the item */
+    if (true == MENDER_STORAGE_NVS_IS_STRING(item)) {
+        err = nvs_get_str(mender_storage_nvs_handle, mender_storage_nvs_keys[item], NULL, &size);
+    } else {
+        err = nvs_get_blob(mender_storage_nvs_handle, mender_storage_nvs_keys[item], NULL, &size);
+    }
+    if (ESP_OK != err) {
+        return (ESP_ERR_NVS_NOT_FOUND == err) ? 0 : -1;
+    }
+
+    return (ssize_t)size;
+}
+
+static mender_err_t
+mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length) {
+
+    assert(NULL != data);
+    assert(NULL != length);
+    size_t    size;
+    esp_err_t err;
+
+    /* Retrieve size of the item from the index, it is probed if it is unknown */
+    if (mender_storage_nvs_sizes[item] < 0) {
+        if ((mender_storage_nvs_sizes[item] = mender_storage_probe_item(item)) < 0) {
+            return MENDER_FAIL;
+        }
+    }
+    if (0 == mender_storage_nvs_sizes[item]) {
+        return MENDER_NOT_FOUND;
+    }
+    size = (size_t)mender_storage_nvs_sizes[item];
+
+    /* Allocate memory to copy the item */
+    if (NULL == (*data = mender_malloc(size + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Read the item in a single pass, it is probed again if the size indexed is not the right one */
+    if (true == MENDER_STORAGE_NVS_IS_STRING(item)) {
+        err = nvs_get_str(mender_storage_nvs_handle, mender_storage_nvs_keys[item], *data, &size);
+    } else {
+        err = nvs_get_blob(mender_storage_nvs_handle, mender_storage_nvs_keys[item], *data, &size);
+    }
+    if (ESP_OK != err) {
+        mender_free(*data);
+        *data = NULL;
+        if (ESP_ERR_NVS_INVALID_LENGTH == err) {
+            mender_storage_nvs_sizes[item] = -1;
+            return mender_storage_read_item(item, data, length);
+        }
+        mender_storage_nvs_sizes[item] = (ESP_ERR_NVS_NOT_FOUND == err) ? 0 : -1;
+        return (ESP_ERR_NVS_NOT_FOUND == err) ? MENDER_NOT_FOUND : MENDER_FAIL;
+    }
+    if ((true == MENDER_STORAGE_NVS_IS_STRING(item)) && (0 != size)) {
+        size--;
+    }
+    ((char *)*data)[size] = '\0';
+    *length               = size;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_write_item(mender_storage_item_t item, void *data, size_t length) {
+
+    assert(NULL != data);
+    esp_err_t err;
+
+    /* Write the item */
+    if (true == MENDER_STORAGE_NVS_IS_STRING(item)) {
+        err = nvs_set_str(mender_storage_nvs_handle, mender_storage_nvs_keys[item], (char *)data);
+    } else {
+        err = nvs_set_blob(mender_storage_nvs_handle, mender_storage_nvs_keys[item], data, length);
+    }
+
+    /* Index the size of the item, it is unknown if it fails */
+    mender_storage_nvs_sizes[item] = (ESP_OK == err) ? (ssize_t)((true == MENDER_STORAGE_NVS_IS_STRING(item)) ? length + 1 : length) : -1;
+
+    return (ESP_OK == err) ? MENDER_OK : MENDER_FAIL;
+}
+
+static mender_err_t
+mender_storage_erase_item(mender_storage_item_t item) {
+
+    esp_err_t err;
+
+    /* Erase the item */
+    if (ESP_OK != (err = nvs_erase_key(mender_storage_nvs_handle, mender_storage_nvs_keys[item]))) {
+        mender_storage_nvs_sizes[item] = (ESP_ERR_NVS_NOT_FOUND == err) ? 0 : -1;
+        return (ESP_ERR_NVS_NOT_FOUND == err) ? MENDER_NOT_FOUND : MENDER_FAIL;
+    }
+    mender_storage_nvs_sizes[item] = 0;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_commit_items(void) {
+
+    /* Commit the items at once */
+    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
@@ -27,6 +27,20 @@ mender_storage_init(void) {
     return MENDER_OK;
 }
 
+__attribute__((weak)) mender_err_t
+mender_storage_begin(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_commit(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
+
 __attribute__((weak)) mender_err_t
 mender_storage_set_authentication_keys(unsigned char *private_key, size_t private_key_length, unsigned char *public_key, size_t public_key_length) {
 
@@ -83,6 +97,60 @@ mender_storage_delete_deployment_data(void) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_storage_set_authentication_token(char *token) {
+
+    (void)token;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_get_authentication_token(char **token) {
+
+    (void)token;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_delete_authentication_token(void) {
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+__attribute__((weak)) mender_err_t
+mender_storage_set_install_checkpoint(char *checkpoint) {
+
+    (void)checkpoint;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_get_install_checkpoint(char **checkpoint) {
+
+    (void)checkpoint;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_delete_install_checkpoint(void) {
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
@@ -0,0 +1,750 @@
+/**
+ * @file      mender-storage.c
+ * @brief     Mender storage interface for Posix platform, append-only log
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "mender-log.h"
+#include "mender-storage.h"
+#include "mender-storage-cache.h"
+
+/**
+ * @brief Default storage path (working directory)
+ */
+#ifndef CONFIG_MENDER_STORAGE_PATH
+#define CONFIG_MENDER_STORAGE_PATH ""
+#endif /* CONFIG_MENDER_STORAGE_PATH */
+
+/**
+ * @brief Default size of the log from which it is compacted (bytes), it is compacted only if most of it is obsolete
+ */
+#ifndef CONFIG_MENDER_STORAGE_LOG_COMPACTION_SIZE
+#define CONFIG_MENDER_STORAGE_LOG_COMPACTION_SIZE (16384)
+#endif /* CONFIG_MENDER_STORAGE_LOG_COMPACTION_SIZE */
+
+/**
+ * @brief Log files, the temporary file is renamed over the log once it has been compacted
+ */
+#define MENDER_STORAGE_LOG_FILE            CONFIG_MENDER_STORAGE_PATH "mender-storage.log"
+#define MENDER_STORAGE_LOG_COMPACTION_FILE CONFIG_MENDER_STORAGE_PATH "mender-storage.log.tmp"
+
+/**
+ * @brief Magic number of the log records
+ */
+#define MENDER_STORAGE_LOG_MAGIC (0x474F4C4DU)
+
+/**
+ * @brief Header of the log records, followed by the data of the item
+ */
+typedef struct {
+    uint32_t magic;    /**< Magic number of the records */
+    uint32_t length;   /**< Length of the data of the item */
+    uint32_t crc;      /**< CRC-32 of the header, computed with a null CRC, and of the data */
+    uint8_t  item;     /**< Item */
+    uint8_t  erased;   /**< Item erased, there is no data */
+    uint16_t reserved; /**< Reserved, must be null */
+} mender_storage_log_header_t;
+
+/**
+ * @brief Index of the log, location of the last record of each item
+ */
+typedef struct {
+    bool   present; /**< Item available */
+    off_t  offset;  /**< Offset of the data of the item in the log */
+    size_t length;  /**< Length of the data of the item */
+} mender_storage_log_entry_t;
+
+/**
+ * @brief Log file descriptor, index, size of the log and size of the records which are not obsolete
+ */
+static int                        mender_storage_log_fd = -1;
+static mender_storage_log_entry_t mender_storage_log_index[MENDER_STORAGE_ITEM_COUNT];
+static off_t                      mender_storage_log_size = 0;
+static off_t                      mender_storage_log_live = 0;
+
+/**
+ * @brief Replay the log to build the index, the log is truncated after the last valid record
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_replay(void);
+
+/**
+ * @brief Append a record to a log file
+ * @param fd Log file descriptor
+ * @param offset Offset of the record
+ * @param item Item
+ * @param data Data of the item, NULL if the item is erased
+ * @param length Length of the data of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_append(int fd, off_t offset, mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Compact the log, only the last record of the items available is kept
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_compact(void);
+
+/**
+ * @brief Compute CRC-32
+ * @param crc Initial CRC, 0 for the first block
+ * @param data Data
+ * @param length Length of the data
+ * @return CRC-32 of the data
+ */
+static uint32_t mender_storage_log_crc32(uint32_t crc, const void *data, size_t length);
+
+/**
+ * @brief Read a storage item from the log
+ * @param item Item
+ * @param data Data of the item with a NUL terminator not counted in the length
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length);
+
+/**
+ * @brief Append a storage item to the log, it is synchronized when the items are committed
+ * @param item Item
+ * @param data Data of the item
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_write_item(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Append the erasure of a storage item to the log, it is synchronized when the items are committed
+ * @param item Item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_erase_item(mender_storage_item_t item);
+
+/**
+ * @brief Synchronize the log once for all the items written and erased, and compact it if required
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_commit_items(void);
+
+/**
+ * @brief Storage operations used by the cache
+ */
+static const mender_storage_cache_ops_t mender_storage_cache_ops
+    = { .read = mender_storage_read_item, .write = mender_storage_write_item, .erase = mender_storage_erase_item, .commit = mender_storage_commit_items };
+
+mender_err_t
+mender_storage_init(void) {
+
+    mender_err_t ret;
+
+    /* Open the log file */
+    if ((mender_storage_log_fd = open(MENDER_STORAGE_LOG_FILE, O_RDWR | O_CREAT, 0600)) < 0) {
+        mender_log_error("Unable to open storage log file '%s'", MENDER_STORAGE_LOG_FILE);
+        return MENDER_FAIL;
+    }
+
+    /* Replay the log to build the index */
+    if (MENDER_OK != (ret = mender_storage_log_replay())) {
+        mender_log_error("Unable to replay storage log");
+        close(mender_storage_log_fd);
+        mender_storage_log_fd = -1;
+        return ret;
+    }
+
+    /* Initialize the cache, the items are read from the log when they are read for the first time */
+    return mender_storage_cache_init(&mender_storage_cache_ops);
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Begin the transaction */
+    return mender_storage_cache_begin();
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    /* Commit the transaction */
+    return mender_storage_cache_commit();
+}
+
+mender_err_t
+mender_storage_set_authentication_keys(unsigned char *private_key, size_t private_key_length, unsigned char *public_key, size_t public_key_length) {
+
+    assert(NULL != private_key);
+    assert(NULL != public_key);
+    mender_err_t ret;
+
+    /* Write keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
+        mender_log_error("Unable to write authentication keys");
+        return ret;
+    }
+    if ((MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PRIVATE_KEY, private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PUBLIC_KEY, public_key, public_key_length)))) {
+        mender_log_error("Unable to write authentication keys");
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to write authentication keys");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_authentication_keys(unsigned char **private_key, size_t *private_key_length, unsigned char **public_key, size_t *public_key_length) {
+
+    assert(NULL != private_key);
+    assert(NULL != private_key_length);
+    assert(NULL != public_key);
+    assert(NULL != public_key_length);
+    mender_err_t ret;
+
+    /* Read keys */
+    if ((MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PRIVATE_KEY, (void **)private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PUBLIC_KEY, (void **)public_key, public_key_length)))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication keys are not available");
+        } else {
+            mender_log_error("Unable to read authentication keys");
+        }
+        mender_free(*private_key);
+        *private_key        = NULL;
+        *private_key_length = 0;
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_authentication_keys(void) {
+
+    mender_err_t ret;
+
+    /* Erase keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
+        mender_log_error("Unable to erase authentication keys");
+        return ret;
+    }
+    if ((MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PRIVATE_KEY)))
+        || (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PUBLIC_KEY)))) {
+        mender_log_error("Unable to erase authentication keys");
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to erase authentication keys");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_set_deployment_data(char *deployment_data) {
+
+    assert(NULL != deployment_data);
+    mender_err_t ret;
+
+    /* Write deployment data */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, deployment_data, strlen(deployment_data)))) {
+        mender_log_error("Unable to write deployment data");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_deployment_data(char **deployment_data) {
+
+    assert(NULL != deployment_data);
+    size_t       deployment_data_length;
+    mender_err_t ret;
+
+    /* Read deployment data */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, (void **)deployment_data, &deployment_data_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Deployment data is not available");
+        } else {
+            mender_log_error("Unable to read deployment data");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_deployment_data(void) {
+
+    mender_err_t ret;
+
+    /* Delete deployment data */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA))) {
+        mender_log_error("Unable to delete deployment data");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_set_authentication_token(char *token) {
+
+    assert(NULL != token);
+    mender_err_t ret;
+
+    /* Write authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, token, strlen(token)))) {
+        mender_log_error("Unable to write authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_authentication_token(char **token) {
+
+    assert(NULL != token);
+    size_t       token_length;
+    mender_err_t ret;
+
+    /* Read authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, (void **)token, &token_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication token is not available");
+        } else {
+            mender_log_error("Unable to read authentication token");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_authentication_token(void) {
+
+    mender_err_t ret;
+
+    /* Delete authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN))) {
+        mender_log_error("Unable to delete authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+mender_err_t
+mender_storage_set_install_checkpoint(char *checkpoint) {
+
+    assert(NULL != checkpoint);
+    mender_err_t ret;
+
+    /* Write install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, checkpoint, strlen(checkpoint)))) {
+        mender_log_error("Unable to write install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_install_checkpoint(char **checkpoint) {
+
+    assert(NULL != checkpoint);
+    size_t       checkpoint_length;
+    mender_err_t ret;
+
+    /* Read install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, (void **)checkpoint, &checkpoint_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Install checkpoint is not available");
+        } else {
+            mender_log_error("Unable to read install checkpoint");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_install_checkpoint(void) {
+
+    mender_err_t ret;
+
+    /* Delete install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT))) {
+        mender_log_error("Unable to delete install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+mender_err_t
+mender_storage_set_device_config(char *device_config) {
+
+    assert(NULL != device_config);
+    mender_err_t ret;
+
+    /* Write device configuration */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEVICE_CONFIG, device_config, strlen(device_config)))) {
+        mender_log_error("Unable to write device configuration");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_device_config(char **device_config) {
+
+    assert(NULL != device_config);
+    size_t       device_config_length;
+    mender_err_t ret;
+
+    /* Read device configuration */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEVICE_CONFIG, (void **)device_config, &device_config_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Device configuration not available");
+        } else {
+            mender_log_error("Unable to read device configuration");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_device_config(void) {
+
+    mender_err_t ret;
+
+    /* Delete device configuration */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEVICE_CONFIG))) {
+        mender_log_error("Unable to delete device configuration");
+        return ret;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+mender_err_t
+mender_storage_exit(void) {
+
+    mender_err_t ret;
+
+    /* Release the cache, the pending items are written */
+    ret = mender_storage_cache_exit();
+
+    /* Close the log file */
+    if (mender_storage_log_fd >= 0) {
+        close(mender_storage_log_fd);
+        mender_storage_log_fd = -1;
+    }
+    memset(mender_storage_log_index, 0, sizeof(mender_storage_log_index));
+    mender_storage_log_size = 0;
+    mender_storage_log_live = 0;
+
+    return ret;
+}
+
+static mender_err_t
+mender_storage_log_replay(void) {
+
+    mender_storage_log_header_t header;
+    uint32_t                    crc;
+    off_t                       offset = 0;
+    off_t                       end;
+    unsigned char              *data = NULL;
+
+    /* Get the size of the log */
+    memset(mender_storage_log_index, 0, sizeof(mender_storage_log_index));
+    mender_storage_log_live = 0;
+    if ((end = lseek(mender_storage_log_fd, 0, SEEK_END)) < 0) {
+        mender_log_error("Unable to get the size of the storage log");
+        return MENDER_FAIL;
+    }
+
+    /* Read the records, the replay stops at the first record incomplete or corrupted */
+    while (offset + (off_t)sizeof(header) <= end) {
+        if (pread(mender_storage_log_fd, &header, sizeof(header), offset) != (ssize_t)sizeof(header)) {
+            break;
+        }
+        if ((MENDER_STORAGE_LOG_MAGIC != header.magic) || (header.item >= MENDER_STORAGE_ITEM_COUNT)
+            || ((off_t)header.length > end - offset - (off_t)sizeof(header)) || ((0 != header.erased) && (0 != header.length))) {
+            break;
+        }
+        if (NULL == (data = (unsigned char *)mender_malloc((0 != header.length) ? header.length : 1))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        if (pread(mender_storage_log_fd, data, header.length, offset + (off_t)sizeof(header)) != (ssize_t)header.length) {
+            mender_free(data);
+            break;
+        }
+        crc        = header.crc;
+        header.crc = 0;
+        crc ^= mender_storage_log_crc32(mender_storage_log_crc32(0, &header, sizeof(header)), data, header.length);
+        mender_free(data);
+        if (0 != crc) {
+            break;
+        }
+
+        /* Update the index */
+        mender_storage_log_entry_t *entry = &mender_storage_log_index[header.item];
+        if (true == entry->present) {
+            mender_storage_log_live -= (off_t)(sizeof(header) + entry->length);
+        }
+        entry->present = (0 == header.erased);
+        entry->offset  = offset + (off_t)sizeof(header);
+        entry->length  = header.length;
+        if (true == entry->present) {
+            mender_storage_log_live += (off_t)(sizeof(header) + entry->length);
+        }
+        offset += (off_t)(sizeof(header) + header.length);
+    }
+
+    /* Drop the end of the log that has not been completely written */
+    if (offset != end) {
+        mender_log_warning("Storage log is truncated at offset %ld", (long)offset);
+        if (0 != ftruncate(mender_storage_log_fd, offset)) {
+            mender_log_error("Unable to truncate storage log");
+            return MENDER_FAIL;
+        }
+    }
+    mender_storage_log_size = offset;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_log_append(int fd, off_t offset, mender_storage_item_t item, void *data, size_t length) {
+
+    mender_storage_log_header_t header
+        = { .magic = MENDER_STORAGE_LOG_MAGIC, .length = (uint32_t)length, .crc = 0, .item = (uint8_t)item, .erased = (NULL == data) ? 1 : 0, .reserved = 0 };
+
+    /* Write the header and the data of the record */
+    header.crc = mender_storage_log_crc32(mender_storage_log_crc32(0, &header, sizeof(header)), data, length);
+    if (pwrite(fd, &header, sizeof(header), offset) != (ssize_t)sizeof(header)) {
+        return MENDER_FAIL;
+    }
+    if ((NULL != data) && (pwrite(fd, data, length, offset + (off_t)sizeof(header)) != (ssize_t)length)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_log_compact(void) {
+
+    mender_storage_log_entry_t index[MENDER_STORAGE_ITEM_COUNT];
+    off_t                      offset = 0;
+    void                      *data;
+    size_t                     length;
+    int                        fd;
+
+    /* Write the items available to the temporary file */
+    if ((fd = open(MENDER_STORAGE_LOG_COMPACTION_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+        mender_log_error("Unable to open file '%s'", MENDER_STORAGE_LOG_COMPACTION_FILE);
+        return MENDER_FAIL;
+    }
+    memset(index, 0, sizeof(index));
+    for (size_t item = 0; item < MENDER_STORAGE_ITEM_COUNT; item++) {
+        if (false == mender_storage_log_index[item].present) {
+            continue;
+        }
+        if (MENDER_OK != mender_storage_read_item((mender_storage_item_t)item, &data, &length)) {
+            goto FAIL;
+        }
+        if (MENDER_OK != mender_storage_log_append(fd, offset, (mender_storage_item_t)item, data, length)) {
+            mender_free(data);
+            goto FAIL;
+        }
+        mender_free(data);
+        index[item].present = true;
+        index[item].offset  = offset + (off_t)sizeof(mender_storage_log_header_t);
+        index[item].length  = length;
+        offset += (off_t)(sizeof(mender_storage_log_header_t) + length);
+    }
+
+    /* Replace the log once the temporary file is synchronized, the previous log remains valid otherwise */
+    if ((0 != fsync(fd)) || (0 != rename(MENDER_STORAGE_LOG_COMPACTION_FILE, MENDER_STORAGE_LOG_FILE))) {
+        goto FAIL;
+    }
+    close(mender_storage_log_fd);
+    mender_storage_log_fd = fd;
+    memcpy(mender_storage_log_index, index, sizeof(index));
+    mender_storage_log_size = offset;
+    mender_storage_log_live = offset;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Drop the temporary file */
+    mender_log_error("Unable to compact storage log");
+    close(fd);
+    unlink(MENDER_STORAGE_LOG_COMPACTION_FILE);
+
+    return MENDER_FAIL;
+}
+
+static uint32_t
+mender_storage_log_crc32(uint32_t crc, const void *data, size_t length) {
+
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    /* Compute CRC-32 (IEEE 802.3, reflected), bit by bit because the records are small */
+    crc = ~crc;
+    for (size_t index = 0; index < length; index++) {
+        crc ^= bytes[index];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+        }
+    }
+
+    return ~crc;
+}
+
+static mender_err_t
+mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length) {
+
+    assert(NULL != data);
+    assert(NULL != length);
+    mender_storage_log_entry_t *entry = &mender_storage_log_index[item];
+
+    /* Check if the item is available */
+    if (false == entry->present) {
+        return MENDER_NOT_FOUND;
+    }
+
+    /* Read the data of the last record of the item */
+    if (NULL == (*data = mender_malloc(entry->length + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (pread(mender_storage_log_fd, *data, entry->length, entry->offset) != (ssize_t)entry->length) {
+        mender_log_error("Unable to read storage log");
+        mender_free(*data);
+        *data = NULL;
+        return MENDER_FAIL;
+    }
+    ((char *)*data)[entry->length] = '\0';
+    *length                        = entry->length;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_write_item(mender_storage_item_t item, void *data, size_t length) {
+
+    assert(NULL != data);
+    mender_storage_log_entry_t *entry = &mender_storage_log_index[item];
+
+    /* Append the record */
+    if (MENDER_OK != mender_storage_log_append(mender_storage_log_fd, mender_storage_log_size, item, data, length)) {
+        mender_log_error("Unable to write storage log");
+        return MENDER_FAIL;
+    }
+
+    /* Update the index */
+    if (true == entry->present) {
+        mender_storage_log_live -= (off_t)(sizeof(mender_storage_log_header_t) + entry->length);
+    }
+    entry->present = true;
+    entry->offset  = mender_storage_log_size + (off_t)sizeof(mender_storage_log_header_t);
+    entry->length  = length;
+    mender_storage_log_size += (off_t)(sizeof(mender_storage_log_header_t) + length);
+    mender_storage_log_live += (off_t)(sizeof(mender_storage_log_header_t) + length);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_erase_item(mender_storage_item_t item) {
+
+    mender_storage_log_entry_t *entry = &mender_storage_log_index[item];
+
+    /* Check if the item is available */
+    if (false == entry->present) {
+        return MENDER_NOT_FOUND;
+    }
+
+    /* Append the record */
+    if (MENDER_OK != mender_storage_log_append(mender_storage_log_fd, mender_storage_log_size, item, NULL, 0)) {
+        mender_log_error("Unable to write storage log");
+        return MENDER_FAIL;
+    }
+
+    /* Update the index */
+    mender_storage_log_live -= (off_t)(sizeof(mender_storage_log_header_t) + entry->length);
+    entry->present = false;
+    entry->length  = 0;
+    mender_storage_log_size += (off_t)sizeof(mender_storage_log_header_t);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_commit_items(void) {
+
+    /* Synchronize the records appended at once */
+    if (0 != fsync(mender_storage_log_fd)) {
+        mender_log_error("Unable to synchronize storage log");
+        return MENDER_FAIL;
+    }
+
+    /* Compact the log if it is large and mostly obsolete, the log remains valid if it fails */
+    if ((mender_storage_log_size >= CONFIG_MENDER_STORAGE_LOG_COMPACTION_SIZE) && (mender_storage_log_size > 2 * mender_storage_log_live)) {
+        mender_storage_log_compact();
+    }
+
+    return MENDER_OK;
+}
@@ -17,9 +17,17 @@
  * limitations under the License.
  */
 
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE
+
+#include <errno.h>
 #include <unistd.h>
 #include "mender-log.h"
 #include "mender-storage.h"
+#include "mender-storage-cache.h"
 
 /**
  * @brief Default storage path (working directory)
@@ -31,16 +39,74 @@
 /**
  * @brief NVS Files
  */
-#define MENDER_STORAGE_NVS_PRIVATE_KEY     CONFIG_MENDER_STORAGE_PATH "key.der"
-#define MENDER_STORAGE_NVS_PUBLIC_KEY      CONFIG_MENDER_STORAGE_PATH "pubkey.der"
-#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA CONFIG_MENDER_STORAGE_PATH "deployment.json"
-#define MENDER_STORAGE_NVS_DEVICE_CONFIG   CONFIG_MENDER_STORAGE_PATH "config.json"
+#define MENDER_STORAGE_NVS_PRIVATE_KEY          CONFIG_MENDER_STORAGE_PATH "key.der"
+#define MENDER_STORAGE_NVS_PUBLIC_KEY           CONFIG_MENDER_STORAGE_PATH "pubkey.der"
+#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA      CONFIG_MENDER_STORAGE_PATH "deployment.json"
+#define MENDER_STORAGE_NVS_DEVICE_CONFIG        CONFIG_MENDER_STORAGE_PATH "config.json"
+#define MENDER_STORAGE_NVS_AUTHENTICATION_TOKEN CONFIG_MENDER_STORAGE_PATH "token.jwt"
+#define MENDER_STORAGE_NVS_INSTALL_CHECKPOINT   CONFIG_MENDER_STORAGE_PATH "checkpoint.json"
+
+/**
+ * @brief Files of the storage items
+ */
+static const char *mender_storage_files[MENDER_STORAGE_ITEM_COUNT]
+    = { [MENDER_STORAGE_ITEM_PRIVATE_KEY]          = MENDER_STORAGE_NVS_PRIVATE_KEY,
+        [MENDER_STORAGE_ITEM_PUBLIC_KEY]           = MENDER_STORAGE_NVS_PUBLIC_KEY,
+        [MENDER_STORAGE_ITEM_DEPLOYMENT_DATA]      = MENDER_STORAGE_NVS_DEPLOYMENT_DATA,
+        [MENDER_STORAGE_ITEM_DEVICE_CONFIG]        = MENDER_STORAGE_NVS_DEVICE_CONFIG,
+        [MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN] = MENDER_STORAGE_NVS_AUTHENTICATION_TOKEN,
+        [MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT]   = MENDER_STORAGE_NVS_INSTALL_CHECKPOINT };
+
+/**
+ * @brief Read a storage item from its file
+ * @param item Item
+ * @param data Data of the item with a NUL terminator not counted in the length
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length);
+
+/**
+ * @brief Write a storage item to its file
+ * @param item Item
+ * @param data Data of the item
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_write_item(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Erase a storage item file
+ * @param item Item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_erase_item(mender_storage_item_t item);
+
+/**
+ * @brief Storage operations used by the cache
+ */
+static const mender_storage_cache_ops_t mender_storage_cache_ops
+    = { .read = mender_storage_read_item, .write = mender_storage_write_item, .erase = mender_storage_erase_item, .commit = NULL };
 
 mender_err_t
 mender_storage_init(void) {
 
-    /* Nothing to do */
-    return MENDER_OK;
+    /* Initialize the cache, the items are loaded from the files when they are read for the first time */
+    return mender_storage_cache_init(&mender_storage_cache_ops);
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Begin the transaction */
+    return mender_storage_cache_begin();
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    /* Commit the transaction */
+    return mender_storage_cache_commit();
 }
 
 mender_err_t
@@ -48,33 +114,25 @@ mender_storage_set_authentication_keys(unsigned char *private_key, size_t privat
 
     assert(NULL != private_key);
     assert(NULL != public_key);
-    FILE *f;
+    mender_err_t ret;
 
-    /* Write private key */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_PRIVATE_KEY, "wb"))) {
+    /* Write keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
         mender_log_error("Unable to write authentication keys");
-        return MENDER_FAIL;
+        return ret;
     }
-    if (fwrite(private_key, sizeof(unsigned char), private_key_length, f) != private_key_length) {
+    if ((MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PRIVATE_KEY, private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PUBLIC_KEY, public_key, public_key_length)))) {
         mender_log_error("Unable to write authentication keys");
-        fclose(f);
-        return MENDER_FAIL;
+        mender_storage_cache_commit();
+        return ret;
     }
-    fclose(f);
-
-    /* Write public key */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_PUBLIC_KEY, "wb"))) {
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
         mender_log_error("Unable to write authentication keys");
-        return MENDER_FAIL;
+        return ret;
     }
-    if (fwrite(public_key, sizeof(unsigned char), public_key_length, f) != public_key_length) {
-        mender_log_error("Unable to write authentication keys");
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    fclose(f);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
@@ -84,155 +142,200 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
     assert(NULL != private_key_length);
     assert(NULL != public_key);
     assert(NULL != public_key_length);
-    long  length;
-    FILE *f;
-
-    /* Read private key */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_PRIVATE_KEY, "rb"))) {
-        mender_log_info("Authentication keys are not available");
-        return MENDER_NOT_FOUND;
-    }
-    fseek(f, 0, SEEK_END);
-    if ((length = ftell(f)) <= 0) {
-        mender_log_info("Authentication keys are not available");
-        fclose(f);
-        return MENDER_NOT_FOUND;
-    }
-    *private_key_length = (size_t)length;
-    fseek(f, 0, SEEK_SET);
-    if (NULL == (*private_key = (unsigned char *)malloc(*private_key_length))) {
-        mender_log_error("Unable to allocate memory");
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    if (fread(*private_key, sizeof(unsigned char), *private_key_length, f) != *private_key_length) {
-        mender_log_error("Unable to read authentication keys");
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    fclose(f);
-
-    /* Read public key */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_PUBLIC_KEY, "rb"))) {
-        mender_log_info("Authentication keys are not available");
-        free(*private_key);
+    mender_err_t ret;
+
+    /* Read keys */
+    if ((MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PRIVATE_KEY, (void **)private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PUBLIC_KEY, (void **)public_key, public_key_length)))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication keys are not available");
+        } else {
+            mender_log_error("Unable to read authentication keys");
+        }
+        mender_free(*private_key);
         *private_key        = NULL;
         *private_key_length = 0;
-        return MENDER_NOT_FOUND;
+        return ret;
     }
-    fseek(f, 0, SEEK_END);
-    if ((length = ftell(f)) <= 0) {
-        mender_log_info("Authentication keys are not available");
-        free(*private_key);
-        *private_key        = NULL;
-        *private_key_length = 0;
-        fclose(f);
-        return MENDER_NOT_FOUND;
-    }
-    *public_key_length = (size_t)length;
-    fseek(f, 0, SEEK_SET);
-    if (NULL == (*public_key = (unsigned char *)malloc(*public_key_length))) {
-        mender_log_error("Unable to allocate memory");
-        free(*private_key);
-        *private_key        = NULL;
-        *private_key_length = 0;
-        *public_key_length  = 0;
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    if (fread(*public_key, sizeof(unsigned char), *public_key_length, f) != *public_key_length) {
-        mender_log_error("Unable to read authentication keys");
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    fclose(f);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_authentication_keys(void) {
 
-    /* Erase keys */
-    if ((0 != unlink(MENDER_STORAGE_NVS_PRIVATE_KEY)) || (0 != unlink(MENDER_STORAGE_NVS_PUBLIC_KEY))) {
+    mender_err_t ret;
+
+    /* Erase keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
         mender_log_error("Unable to erase authentication keys");
-        return MENDER_FAIL;
+        return ret;
+    }
+    if ((MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PRIVATE_KEY)))
+        || (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PUBLIC_KEY)))) {
+        mender_log_error("Unable to erase authentication keys");
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to erase authentication keys");
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_set_deployment_data(char *deployment_data) {
 
     assert(NULL != deployment_data);
-    size_t deployment_data_length = strlen(deployment_data);
-    FILE  *f;
+    mender_err_t ret;
 
     /* Write deployment data */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_DEPLOYMENT_DATA, "wb"))) {
-        mender_log_error("Unable to write deployment data");
-        return MENDER_FAIL;
-    }
-    if (fwrite(deployment_data, sizeof(unsigned char), deployment_data_length, f) != deployment_data_length) {
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, deployment_data, strlen(deployment_data)))) {
         mender_log_error("Unable to write deployment data");
-        fclose(f);
-        return MENDER_FAIL;
+        return ret;
     }
-    fclose(f);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_get_deployment_data(char **deployment_data) {
 
     assert(NULL != deployment_data);
-    size_t deployment_data_length = 0;
-    long   length;
-    FILE  *f;
+    size_t       deployment_data_length;
+    mender_err_t ret;
 
     /* Read deployment data */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_DEPLOYMENT_DATA, "rb"))) {
-        mender_log_info("Deployment data is not available");
-        return MENDER_NOT_FOUND;
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, (void **)deployment_data, &deployment_data_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Deployment data is not available");
+        } else {
+            mender_log_error("Unable to read deployment data");
+        }
+        return ret;
     }
-    fseek(f, 0, SEEK_END);
-    if ((length = ftell(f)) <= 0) {
-        mender_log_info("Deployment data is not available");
-        fclose(f);
-        return MENDER_NOT_FOUND;
-    }
-    deployment_data_length = (size_t)length;
-    fseek(f, 0, SEEK_SET);
-    if (NULL == (*deployment_data = (char *)malloc(deployment_data_length + 1))) {
-        mender_log_error("Unable to allocate memory");
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    if (fread(*deployment_data, sizeof(unsigned char), deployment_data_length, f) != deployment_data_length) {
-        mender_log_error("Unable to read deployment data");
-        fclose(f);
-        return MENDER_FAIL;
-    }
-    (*deployment_data)[deployment_data_length] = '\0';
-    fclose(f);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_deployment_data(void) {
 
+    mender_err_t ret;
+
     /* Delete deployment data */
-    if (0 != unlink(MENDER_STORAGE_NVS_DEPLOYMENT_DATA)) {
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA))) {
         mender_log_error("Unable to delete deployment data");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
+}
+
+mender_err_t
+mender_storage_set_authentication_token(char *token) {
+
+    assert(NULL != token);
+    mender_err_t ret;
+
+    /* Write authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, token, strlen(token)))) {
+        mender_log_error("Unable to write authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_authentication_token(char **token) {
+
+    assert(NULL != token);
+    size_t       token_length;
+    mender_err_t ret;
+
+    /* Read authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, (void **)token, &token_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication token is not available");
+        } else {
+            mender_log_error("Unable to read authentication token");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_authentication_token(void) {
+
+    mender_err_t ret;
+
+    /* Delete authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN))) {
+        mender_log_error("Unable to delete authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+mender_err_t
+mender_storage_set_install_checkpoint(char *checkpoint) {
+
+    assert(NULL != checkpoint);
+    mender_err_t ret;
+
+    /* Write install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, checkpoint, strlen(checkpoint)))) {
+        mender_log_error("Unable to write install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_install_checkpoint(char **checkpoint) {
+
+    assert(NULL != checkpoint);
+    size_t       checkpoint_length;
+    mender_err_t ret;
+
+    /* Read install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, (void **)checkpoint, &checkpoint_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Install checkpoint is not available");
+        } else {
+            mender_log_error("Unable to read install checkpoint");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_install_checkpoint(void) {
+
+    mender_err_t ret;
+
+    /* Delete install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT))) {
+        mender_log_error("Unable to delete install checkpoint");
+        return ret;
+    }
+
+    return ret;
 }
 
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
@@ -240,79 +343,126 @@ mender_err_t
 mender_storage_set_device_config(char *device_config) {
 
     assert(NULL != device_config);
-    size_t device_config_length = strlen(device_config);
-    FILE  *f;
+    mender_err_t ret;
 
     /* Write device configuration */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_DEVICE_CONFIG, "wb"))) {
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEVICE_CONFIG, device_config, strlen(device_config)))) {
         mender_log_error("Unable to write device configuration");
-        return MENDER_FAIL;
-    }
-    if (fwrite(device_config, sizeof(unsigned char), device_config_length, f) != device_config_length) {
-        mender_log_error("Unable to write device configuration");
-        fclose(f);
-        return MENDER_FAIL;
+        return ret;
     }
-    fclose(f);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_get_device_config(char **device_config) {
 
     assert(NULL != device_config);
-    size_t device_config_length = 0;
-    long   length;
-    FILE  *f;
+    size_t       device_config_length;
+    mender_err_t ret;
 
     /* Read device configuration */
-    if (NULL == (f = fopen(MENDER_STORAGE_NVS_DEVICE_CONFIG, "rb"))) {
-        mender_log_info("Device configuration not available");
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEVICE_CONFIG, (void **)device_config, &device_config_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Device configuration not available");
+        } else {
+            mender_log_error("Unable to read device configuration");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_device_config(void) {
+
+    mender_err_t ret;
+
+    /* Delete device configuration */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEVICE_CONFIG))) {
+        mender_log_error("Unable to delete device configuration");
+        return ret;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+mender_err_t
+mender_storage_exit(void) {
+
+    /* Release the cache, the pending items are written */
+    return mender_storage_cache_exit();
+}
+
+static mender_err_t
+mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length) {
+
+    assert(NULL != data);
+    assert(NULL != length);
+    long  size;
+    FILE *f;
+
+    /* Read the item, it is not available if the file is empty */
+    if (NULL == (f = fopen(mender_storage_files[item], "rb"))) {
         return MENDER_NOT_FOUND;
     }
     fseek(f, 0, SEEK_END);
-    if ((length = ftell(f)) <= 0) {
-        mender_log_info("Device configuration not available");
+    if ((size = ftell(f)) <= 0) {
         fclose(f);
         return MENDER_NOT_FOUND;
     }
-    device_config_length = (size_t)length;
     fseek(f, 0, SEEK_SET);
-    if (NULL == (*device_config = (char *)malloc(device_config_length + 1))) {
+    if (NULL == (*data = mender_malloc((size_t)size + 1))) {
         mender_log_error("Unable to allocate memory");
         fclose(f);
         return MENDER_FAIL;
     }
-    if (fread(*device_config, sizeof(unsigned char), device_config_length, f) != device_config_length) {
-        mender_log_error("Unable to read device configuration");
+    if (fread(*data, sizeof(unsigned char), (size_t)size, f) != (size_t)size) {
+        mender_log_error("Unable to read file '%s'", mender_storage_files[item]);
+        mender_free(*data);
+        *data = NULL;
         fclose(f);
         return MENDER_FAIL;
     }
-    (*device_config)[device_config_length] = '\0';
+    ((char *)*data)[size] = '\0';
+    *length               = (size_t)size;
     fclose(f);
 
     return MENDER_OK;
 }
 
-mender_err_t
-mender_storage_delete_device_config(void) {
+static mender_err_t
+mender_storage_write_item(mender_storage_item_t item, void *data, size_t length) {
 
-    /* Delete device configuration */
-    if (0 != unlink(MENDER_STORAGE_NVS_DEVICE_CONFIG)) {
-        mender_log_error("Unable to delete device configuration");
+    assert(NULL != data);
+    FILE *f;
+
+    /* Write the item */
+    if (NULL == (f = fopen(mender_storage_files[item], "wb"))) {
+        mender_log_error("Unable to open file '%s'", mender_storage_files[item]);
+        return MENDER_FAIL;
+    }
+    if (fwrite(data, sizeof(unsigned char), length, f) != length) {
+        mender_log_error("Unable to write file '%s'", mender_storage_files[item]);
+        fclose(f);
         return MENDER_FAIL;
     }
+    fclose(f);
 
     return MENDER_OK;
 }
 
-#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
-#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+static mender_err_t
+mender_storage_erase_item(mender_storage_item_t item) {
 
-mender_err_t
-mender_storage_exit(void) {
+    /* Erase the item */
+    if (0 != unlink(mender_storage_files[item])) {
+        return (ENOENT == errno) ? MENDER_NOT_FOUND : MENDER_FAIL;
+    }
 
-    /* Nothing to do */
     return MENDER_OK;
 }
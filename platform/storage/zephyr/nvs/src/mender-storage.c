@@ -17,11 +17,18 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_STORAGE
+
+#include <errno.h>
 #include <zephyr/drivers/flash.h>
 #include <zephyr/fs/nvs.h>
 #include <zephyr/storage/flash_map.h>
 #include "mender-log.h"
 #include "mender-storage.h"
+#include "mender-storage-cache.h"
 
 /**
  * @brief NVS storage
@@ -33,16 +40,66 @@
 /**
  * @brief NVS keys
  */
-#define MENDER_STORAGE_NVS_PRIVATE_KEY     1
-#define MENDER_STORAGE_NVS_PUBLIC_KEY      2
-#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA 3
-#define MENDER_STORAGE_NVS_DEVICE_CONFIG   4
+#define MENDER_STORAGE_NVS_PRIVATE_KEY          1
+#define MENDER_STORAGE_NVS_PUBLIC_KEY           2
+#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA      3
+#define MENDER_STORAGE_NVS_DEVICE_CONFIG        4
+#define MENDER_STORAGE_NVS_AUTHENTICATION_TOKEN 5
+#define MENDER_STORAGE_NVS_INSTALL_CHECKPOINT   6
 
 /**
  * @brief NVS storage handle
  */
 static struct nvs_fs mender_storage_nvs_handle;
 
+/**
+ * @brief NVS keys of the storage items
+ */
+static const uint16_t mender_storage_nvs_keys[MENDER_STORAGE_ITEM_COUNT]
+    = { [MENDER_STORAGE_ITEM_PRIVATE_KEY]          = MENDER_STORAGE_NVS_PRIVATE_KEY,
+        [MENDER_STORAGE_ITEM_PUBLIC_KEY]           = MENDER_STORAGE_NVS_PUBLIC_KEY,
+        [MENDER_STORAGE_ITEM_DEPLOYMENT_DATA]      = MENDER_STORAGE_NVS_DEPLOYMENT_DATA,
+        [MENDER_STORAGE_ITEM_DEVICE_CONFIG]        = MENDER_STORAGE_NVS_DEVICE_CONFIG,
+        [MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN] = MENDER_STORAGE_NVS_AUTHENTICATION_TOKEN,
+        [MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT]   = MENDER_STORAGE_NVS_INSTALL_CHECKPOINT };
+
+/**
+ * @brief Length of the storage items, read once at initialization so that the items are then read in a single pass
+ * @note The length is negative if it is unknown, the item is then probed before it is read, and null if the item is not available
+ */
+static ssize_t mender_storage_nvs_lengths[MENDER_STORAGE_ITEM_COUNT];
+
+/**
+ * @brief Read a storage item from NVS
+ * @param item Item
+ * @param data Data of the item with a NUL terminator not counted in the length
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not available, error code otherwise
+ */
+static mender_err_t mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length);
+
+/**
+ * @brief Write a storage item to NVS
+ * @param item Item
+ * @param data Data of the item
+ * @param length Length of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_write_item(mender_storage_item_t item, void *data, size_t length);
+
+/**
+ * @brief Erase a storage item from NVS
+ * @param item Item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_erase_item(mender_storage_item_t item);
+
+/**
+ * @brief Storage operations used by the cache
+ */
+static const mender_storage_cache_ops_t mender_storage_cache_ops
+    = { .read = mender_storage_read_item, .write = mender_storage_write_item, .erase = mender_storage_erase_item, .commit = NULL };
+
 mender_err_t
 mender_storage_init(void) {
 
@@ -69,7 +126,28 @@ mender_storage_init(void) {
         return MENDER_FAIL;
     }
 
-    return MENDER_OK;
+    /* Index the length of the items */
+    for (size_t item = 0; item < MENDER_STORAGE_ITEM_COUNT; item++) {
+        result                           = nvs_read(&mender_storage_nvs_handle, mender_storage_nvs_keys[item], NULL, 0);
+        mender_storage_nvs_lengths[item] = (result > 0) ? result : ((0 == result) || (-ENOENT == result)) ? 0 : -1;
+    }
+
+    /* Initialize the cache, the items are loaded from NVS when they are read for the first time */
+    return mender_storage_cache_init(&mender_storage_cache_ops);
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Begin the transaction */
+    return mender_storage_cache_begin();
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    /* Commit the transaction */
+    return mender_storage_cache_commit();
 }
 
 mender_err_t
@@ -77,15 +155,25 @@ mender_storage_set_authentication_keys(unsigned char *private_key, size_t privat
 
     assert(NULL != private_key);
     assert(NULL != public_key);
+    mender_err_t ret;
 
-    /* Write keys */
-    if ((nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, private_key, private_key_length) < 0)
-        || (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, public_key, public_key_length) < 0)) {
+    /* Write keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
         mender_log_error("Unable to write authentication keys");
-        return MENDER_FAIL;
+        return ret;
+    }
+    if ((MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PRIVATE_KEY, private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_PUBLIC_KEY, public_key, public_key_length)))) {
+        mender_log_error("Unable to write authentication keys");
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to write authentication keys");
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
@@ -95,116 +183,200 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
     assert(NULL != private_key_length);
     assert(NULL != public_key);
     assert(NULL != public_key_length);
-    ssize_t ret;
-
-    /* Retrieve length of the keys */
-    if ((ret = nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, NULL, 0)) <= 0) {
-        mender_log_info("Authentication keys are not available");
-        return MENDER_NOT_FOUND;
-    }
-    *private_key_length = (size_t)ret;
-    if ((ret = nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, NULL, 0)) <= 0) {
-        mender_log_info("Authentication keys are not available");
-        return MENDER_NOT_FOUND;
-    }
-    *public_key_length = (size_t)ret;
-
-    /* Allocate memory to copy keys */
-    if (NULL == (*private_key = (unsigned char *)malloc(*private_key_length))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
-    }
-    if (NULL == (*public_key = (unsigned char *)malloc(*public_key_length))) {
-        mender_log_error("Unable to allocate memory");
-        free(*private_key);
-        *private_key = NULL;
-        return MENDER_FAIL;
-    }
+    mender_err_t ret;
 
     /* Read keys */
-    if ((nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, *private_key, *private_key_length) < 0)
-        || (nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, *public_key, *public_key_length) < 0)) {
-        mender_log_error("Unable to read authentication keys");
-        free(*private_key);
-        *private_key = NULL;
-        free(*public_key);
-        *public_key = NULL;
-        return MENDER_FAIL;
+    if ((MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PRIVATE_KEY, (void **)private_key, private_key_length)))
+        || (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_PUBLIC_KEY, (void **)public_key, public_key_length)))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication keys are not available");
+        } else {
+            mender_log_error("Unable to read authentication keys");
+        }
+        mender_free(*private_key);
+        *private_key        = NULL;
+        *private_key_length = 0;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_authentication_keys(void) {
 
-    /* Erase keys */
-    if ((0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY))
-        || (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY))) {
+    mender_err_t ret;
+
+    /* Erase keys at once */
+    if (MENDER_OK != (ret = mender_storage_cache_begin())) {
         mender_log_error("Unable to erase authentication keys");
-        return MENDER_FAIL;
+        return ret;
+    }
+    if ((MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PRIVATE_KEY)))
+        || (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_PUBLIC_KEY)))) {
+        mender_log_error("Unable to erase authentication keys");
+        mender_storage_cache_commit();
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_cache_commit())) {
+        mender_log_error("Unable to erase authentication keys");
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_set_deployment_data(char *deployment_data) {
 
     assert(NULL != deployment_data);
+    mender_err_t ret;
 
     /* Write deployment data */
-    if (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, strlen(deployment_data) + 1) < 0) {
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, deployment_data, strlen(deployment_data) + 1))) {
         mender_log_error("Unable to write deployment data");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_get_deployment_data(char **deployment_data) {
 
     assert(NULL != deployment_data);
-    size_t  deployment_data_length = 0;
-    ssize_t ret;
-
-    /* Retrieve length of the deployment data */
-    if ((ret = nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, NULL, 0)) <= 0) {
-        mender_log_info("Deployment data not available");
-        return MENDER_NOT_FOUND;
-    }
-    deployment_data_length = (size_t)ret;
-
-    /* Allocate memory to copy deployment data */
-    if (NULL == (*deployment_data = (char *)malloc(deployment_data_length))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
-    }
+    size_t       deployment_data_length;
+    mender_err_t ret;
 
     /* Read deployment data */
-    if (nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, *deployment_data, deployment_data_length) < 0) {
-        mender_log_error("Unable to read deployment data");
-        free(*deployment_data);
-        *deployment_data = NULL;
-        return MENDER_FAIL;
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, (void **)deployment_data, &deployment_data_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Deployment data is not available");
+        } else {
+            mender_log_error("Unable to read deployment data");
+        }
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_delete_deployment_data(void) {
 
+    mender_err_t ret;
+
     /* Delete deployment data */
-    if (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA)) {
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA))) {
         mender_log_error("Unable to delete deployment data");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
+mender_err_t
+mender_storage_set_authentication_token(char *token) {
+
+    assert(NULL != token);
+    mender_err_t ret;
+
+    /* Write authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, token, strlen(token) + 1))) {
+        mender_log_error("Unable to write authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_authentication_token(char **token) {
+
+    assert(NULL != token);
+    size_t       token_length;
+    mender_err_t ret;
+
+    /* Read authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN, (void **)token, &token_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Authentication token is not available");
+        } else {
+            mender_log_error("Unable to read authentication token");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_authentication_token(void) {
+
+    mender_err_t ret;
+
+    /* Delete authentication token */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_AUTHENTICATION_TOKEN))) {
+        mender_log_error("Unable to delete authentication token");
+        return ret;
+    }
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT
+
+mender_err_t
+mender_storage_set_install_checkpoint(char *checkpoint) {
+
+    assert(NULL != checkpoint);
+    mender_err_t ret;
+
+    /* Write install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, checkpoint, strlen(checkpoint) + 1))) {
+        mender_log_error("Unable to write install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_get_install_checkpoint(char **checkpoint) {
+
+    assert(NULL != checkpoint);
+    size_t       checkpoint_length;
+    mender_err_t ret;
+
+    /* Read install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT, (void **)checkpoint, &checkpoint_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Install checkpoint is not available");
+        } else {
+            mender_log_error("Unable to read install checkpoint");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_install_checkpoint(void) {
+
+    mender_err_t ret;
+
+    /* Delete install checkpoint */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_INSTALL_CHECKPOINT))) {
+        mender_log_error("Unable to delete install checkpoint");
+        return ret;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_CHECKPOINT */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
@@ -212,65 +384,124 @@ mender_err_t
 mender_storage_set_device_config(char *device_config) {
 
     assert(NULL != device_config);
+    mender_err_t ret;
 
     /* Write device configuration */
-    if (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, device_config, strlen(device_config) + 1) < 0) {
+    if (MENDER_OK != (ret = mender_storage_cache_set(MENDER_STORAGE_ITEM_DEVICE_CONFIG, device_config, strlen(device_config) + 1))) {
         mender_log_error("Unable to write device configuration");
-        return MENDER_FAIL;
+        return ret;
     }
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_storage_get_device_config(char **device_config) {
 
     assert(NULL != device_config);
-    size_t  device_config_length = 0;
+    size_t       device_config_length;
+    mender_err_t ret;
+
+    /* Read device configuration */
+    if (MENDER_OK != (ret = mender_storage_cache_get(MENDER_STORAGE_ITEM_DEVICE_CONFIG, (void **)device_config, &device_config_length))) {
+        if (MENDER_NOT_FOUND == ret) {
+            mender_log_info("Device configuration not available");
+        } else {
+            mender_log_error("Unable to read device configuration");
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_delete_device_config(void) {
+
+    mender_err_t ret;
+
+    /* Delete device configuration */
+    if (MENDER_OK != (ret = mender_storage_cache_delete(MENDER_STORAGE_ITEM_DEVICE_CONFIG))) {
+        mender_log_error("Unable to delete device configuration");
+        return ret;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+mender_err_t
+mender_storage_exit(void) {
+
+    /* Release the cache, the pending items are written */
+    return mender_storage_cache_exit();
+}
+
+static mender_err_t
+mender_storage_read_item(mender_storage_item_t item, void **data, size_t *length) {
+
+    assert(NULL != data);
+    assert(NULL != length);
     ssize_t ret;
 
-    /* Retrieve length of the device configuration */
-    if ((ret = nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, NULL, 0)) <= 0) {
-        mender_log_info("Device configuration not available");
+    /* Retrieve length of the item from the index, it is probed if it is unknown */
+    if (mender_storage_nvs_lengths[item] < 0) {
+        ret                              = nvs_read(&mender_storage_nvs_handle, mender_storage_nvs_keys[item], NULL, 0);
+        mender_storage_nvs_lengths[item] = (ret > 0) ? ret : 0;
+    }
+    if (0 == mender_storage_nvs_lengths[item]) {
         return MENDER_NOT_FOUND;
     }
-    device_config_length = (size_t)ret;
+    *length = (size_t)mender_storage_nvs_lengths[item];
 
-    /* Allocate memory to copy device configuration */
-    if (NULL == (*device_config = (char *)malloc(device_config_length))) {
+    /* Allocate memory to copy the item */
+    if (NULL == (*data = mender_malloc(*length + 1))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
 
-    /* Read device_configuration */
-    if (nvs_read(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, *device_config, device_config_length) < 0) {
-        mender_log_error("Unable to read device configuration");
-        free(*device_config);
-        *device_config = NULL;
-        return MENDER_FAIL;
+    /* Read the item in a single pass, it is probed again if the length indexed is not the right one */
+    if ((ret = nvs_read(&mender_storage_nvs_handle, mender_storage_nvs_keys[item], *data, *length)) != (ssize_t)*length) {
+        mender_free(*data);
+        *data = NULL;
+        if ((ret > 0) && ((size_t)ret != *length)) {
+            mender_storage_nvs_lengths[item] = -1;
+            return mender_storage_read_item(item, data, length);
+        }
+        mender_storage_nvs_lengths[item] = (-ENOENT == ret) ? 0 : -1;
+        return (-ENOENT == ret) ? MENDER_NOT_FOUND : MENDER_FAIL;
     }
+    ((char *)*data)[*length] = '\0';
 
     return MENDER_OK;
 }
 
-mender_err_t
-mender_storage_delete_device_config(void) {
+static mender_err_t
+mender_storage_write_item(mender_storage_item_t item, void *data, size_t length) {
 
-    /* Delete device configuration */
-    if (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG)) {
-        mender_log_error("Unable to delete device configuration");
+    assert(NULL != data);
+
+    /* Write the item, the length is unknown if it fails */
+    if (nvs_write(&mender_storage_nvs_handle, mender_storage_nvs_keys[item], data, length) < 0) {
+        mender_storage_nvs_lengths[item] = -1;
         return MENDER_FAIL;
     }
+    mender_storage_nvs_lengths[item] = (ssize_t)length;
 
     return MENDER_OK;
 }
 
-#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
-#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+static mender_err_t
+mender_storage_erase_item(mender_storage_item_t item) {
 
-mender_err_t
-mender_storage_exit(void) {
+    /* Erase the item, the length is unknown if it fails */
+    if (0 != nvs_delete(&mender_storage_nvs_handle, mender_storage_nvs_keys[item])) {
+        mender_storage_nvs_lengths[item] = -1;
+        return MENDER_FAIL;
+    }
+    mender_storage_nvs_lengths[item] = 0;
 
-    /* Nothing to do */
     return MENDER_OK;
 }
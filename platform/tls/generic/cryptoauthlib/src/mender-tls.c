@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TLS
+
 #include <cryptoauthlib.h>
 #include "mender-log.h"
 #include "mender-tls.h"
@@ -40,11 +45,22 @@ static const uint8_t mender_tls_public_key_x509_header[] = { 0x30, 0x59, 0x30, 0
                                                              0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04 };
 
 /**
- * @brief Public key of the device
+ * @brief Public key of the device, retrieved once because it is computed from the private key by the secure element
  */
 static unsigned char *mender_tls_public_key        = NULL;
 static size_t         mender_tls_public_key_length = 0;
 
+/**
+ * @brief Public key of the device in PEM format, computed once when it is requested
+ */
+static char *mender_tls_public_key_pem = NULL;
+
+/**
+ * @brief Retrieve the public key of the device from the secure element
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_tls_read_public_key(void);
+
 /**
  * @brief Write a buffer of PEM information from a DER encoded buffer
  * @note This function is derived from mbedtls_pem_write_buffer with const header and footer
@@ -104,36 +120,26 @@ mender_tls_init(void) {
         return MENDER_FAIL;
     }
 
+    /* Retrieve the public key while the secure element is awake, it is kept in RAM because it can not change */
+    if ((NULL == mender_tls_public_key) && (MENDER_OK != mender_tls_read_public_key())) {
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
 
 mender_err_t
 mender_tls_init_authentication_keys(bool recommissioning) {
 
-    /* Release memory */
-    if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
-        mender_tls_public_key = NULL;
-    }
-    mender_tls_public_key_length = 0;
-
     /* Check if recommissioning is forced */
     if (true == recommissioning) {
         mender_log_warning("Recommissioning not supported");
     }
 
-    /* Retrieve public key */
-    if (NULL == (mender_tls_public_key = (unsigned char *)malloc(ATCA_PUB_KEY_SIZE))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
+    /* Retrieve public key if it has not been retrieved at initialization, the private key is never changed */
+    if (NULL == mender_tls_public_key) {
+        return mender_tls_read_public_key();
     }
-    if (ATCA_SUCCESS != atcab_get_pubkey(CONFIG_MENDER_TLS_PRIVATE_KEY_ID, (uint8_t *)mender_tls_public_key)) {
-        mender_log_error("Unable to get public key");
-        free(mender_tls_public_key);
-        mender_tls_public_key = NULL;
-        return MENDER_FAIL;
-    }
-    mender_tls_public_key_length = ATCA_PUB_KEY_SIZE;
 
     return MENDER_OK;
 }
@@ -144,23 +150,32 @@ mender_tls_get_public_key_pem(char **public_key) {
     assert(NULL != public_key);
     mender_err_t ret;
 
-    /* Compute size of the public key */
-    size_t olen = 0;
-    mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
-    if (0 == olen) {
-        mender_log_error("Unable to compute public key size");
-        return MENDER_FAIL;
-    }
-    if (NULL == (*public_key = (char *)malloc(olen))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
+    /* Convert public key from DER to PEM format if it has not been done yet */
+    if (NULL == mender_tls_public_key_pem) {
+
+        /* Compute size of the public key */
+        size_t olen = 0;
+        mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
+        if (0 == olen) {
+            mender_log_error("Unable to compute public key size");
+            return MENDER_FAIL;
+        }
+        if (NULL == (mender_tls_public_key_pem = (char *)mender_malloc(olen))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+
+        /* Convert public key from DER to PEM format */
+        if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, mender_tls_public_key_pem, olen, &olen))) {
+            mender_log_error("Unable to convert public key");
+            mender_free(mender_tls_public_key_pem);
+            mender_tls_public_key_pem = NULL;
+            return ret;
+        }
     }
 
-    /* Convert public key from DER to PEM format */
-    if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, *public_key, olen, &olen))) {
-        mender_log_error("Unable to convert public key");
-        return ret;
-    }
+    /* Return public key */
+    *public_key = mender_tls_public_key_pem;
 
     return MENDER_OK;
 }
@@ -179,11 +194,22 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     size_t   index = 0;
     char    *tmp;
 
+#ifdef CONFIG_MENDER_TLS_HOST_SHA256
+    /* Compute digest (sha256) of the payload on the host, only the digest is sent to the device */
+    atcac_sha2_256_ctx sha256_context;
+    if ((ATCA_SUCCESS != atcac_sw_sha2_256_init(&sha256_context))
+        || (ATCA_SUCCESS != atcac_sw_sha2_256_update(&sha256_context, (const uint8_t *)payload, strlen(payload)))
+        || (ATCA_SUCCESS != atcac_sw_sha2_256_finish(&sha256_context, digest))) {
+        mender_log_error("Unable to compute digest of the payload");
+        return MENDER_FAIL;
+    }
+#else
     /* Compute digest (sha256) of the payload */
     if (ATCA_SUCCESS != atcab_hw_sha2_256(payload, strlen(payload), digest)) {
         mender_log_error("Unable to compute digest of the payload");
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_TLS_HOST_SHA256 */
 
     /* Compute signature of the digest value */
     if (ATCA_SUCCESS != atcab_sign(CONFIG_MENDER_TLS_PRIVATE_KEY_ID, digest, sign)) {
@@ -218,7 +244,7 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     index += 32;
 
     /* Encode signature to base64 */
-    if (NULL == (*signature = malloc(2 * index + 1))) {
+    if (NULL == (*signature = mender_malloc(2 * index + 1))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -226,13 +252,13 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     *signature_length = 2 * index;
     if (ATCA_SUCCESS != atcab_base64encode_(asn1, index, *signature, signature_length, mender_tls_atcab_b64rules)) {
         mender_log_error("Unable to convert signature to base64 format");
-        free(*signature);
+        mender_free(*signature);
         *signature = NULL;
         return MENDER_FAIL;
     }
-    if (NULL == (tmp = realloc(*signature, *signature_length + 1))) {
+    if (NULL == (tmp = mender_realloc(*signature, *signature_length + 1))) {
         mender_log_error("Unable to allocate memory");
-        free(*signature);
+        mender_free(*signature);
         *signature = NULL;
         return MENDER_FAIL;
     }
@@ -241,15 +267,174 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     return MENDER_OK;
 }
 
+mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    assert(NULL != handle);
+    atcac_sha2_256_ctx *sha256_context;
+
+    /* Initialize SHA-256 context, the software implementation is used because streaming large data to the device would be too slow */
+    if (NULL == (sha256_context = (atcac_sha2_256_ctx *)mender_malloc(sizeof(atcac_sha2_256_ctx)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (ATCA_SUCCESS != atcac_sw_sha2_256_init(sha256_context)) {
+        mender_log_error("Unable to start digest computation");
+        mender_free(sha256_context);
+        return MENDER_FAIL;
+    }
+
+    /* Return handle */
+    *handle = sha256_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_update(void *handle, void *data, size_t length) {
+
+    assert(NULL != handle);
+
+    /* Update SHA-256 computation */
+    if (ATCA_SUCCESS != atcac_sw_sha2_256_update((atcac_sha2_256_ctx *)handle, (const uint8_t *)data, length)) {
+        mender_log_error("Unable to update digest computation");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+
+    /* Finish SHA-256 computation */
+    if ((NULL != digest) && (ATCA_SUCCESS != atcac_sw_sha2_256_finish((atcac_sha2_256_ctx *)handle, digest))) {
+        mender_log_error("Unable to finish digest computation");
+        ret = MENDER_FAIL;
+    }
+
+    /* Release memory */
+    mender_free(handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_tls_verify_signature(char *public_key, uint8_t *digest, char *signature, size_t signature_length) {
+
+    assert(NULL != public_key);
+    assert(NULL != digest);
+    assert(NULL != signature);
+    mender_err_t ret = MENDER_FAIL;
+    char        *begin;
+    char        *end;
+    char        *encoded = NULL;
+    size_t       encoded_length;
+    uint8_t     *der     = NULL;
+    size_t       der_length;
+    uint8_t      sign[ATCA_ECCP256_SIG_SIZE];
+    size_t       sign_length = ATCA_ECCP256_SIG_SIZE;
+    bool         verified    = false;
+
+    /* Retrieve the base64 content of the public key, line breaks are removed */
+    if ((NULL == (begin = strstr(public_key, "-----BEGIN PUBLIC KEY-----"))) || (NULL == (end = strstr(begin, "-----END PUBLIC KEY-----")))) {
+        mender_log_error("Invalid public key");
+        goto END;
+    }
+    begin += strlen("-----BEGIN PUBLIC KEY-----");
+    if (NULL == (encoded = (char *)mender_malloc(end - begin + 1))) {
+        mender_log_error("Unable to allocate memory");
+        goto END;
+    }
+    encoded_length = 0;
+    for (char *c = begin; c < end; c++) {
+        if (('\r' != *c) && ('\n' != *c)) {
+            encoded[encoded_length] = *c;
+            encoded_length++;
+        }
+    }
+
+    /* Decode public key, only ECDSA P-256 public keys are supported by the device */
+    der_length = encoded_length;
+    if (NULL == (der = (uint8_t *)mender_malloc(der_length))) {
+        mender_log_error("Unable to allocate memory");
+        goto END;
+    }
+    if ((ATCA_SUCCESS != atcab_base64decode_(encoded, encoded_length, der, &der_length, mender_tls_atcab_b64rules))
+        || (sizeof(mender_tls_public_key_x509_header) + ATCA_PUB_KEY_SIZE != der_length)
+        || (0 != memcmp(der, mender_tls_public_key_x509_header, sizeof(mender_tls_public_key_x509_header)))) {
+        mender_log_error("Invalid public key, only ECDSA P-256 public keys are supported");
+        goto END;
+    }
+
+    /* Decode signature, ECDSA signatures of the artifacts are provided in raw format */
+    if ((ATCA_SUCCESS != atcab_base64decode_(signature, signature_length, sign, &sign_length, mender_tls_atcab_b64rules))
+        || (ATCA_ECCP256_SIG_SIZE != sign_length)) {
+        mender_log_error("Invalid signature");
+        goto END;
+    }
+
+    /* Verify signature */
+    if ((ATCA_SUCCESS != atcab_verify_extern(digest, sign, der + sizeof(mender_tls_public_key_x509_header), &verified)) || (true != verified)) {
+        mender_log_error("Unable to verify signature");
+        goto END;
+    }
+    ret = MENDER_OK;
+
+END:
+
+    /* Release memory */
+    if (NULL != encoded) {
+        mender_free(encoded);
+    }
+    if (NULL != der) {
+        mender_free(der);
+    }
+
+    return ret;
+}
+
 mender_err_t
 mender_tls_exit(void) {
 
     /* Release memory */
     if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
+        mender_free(mender_tls_public_key);
         mender_tls_public_key = NULL;
     }
     mender_tls_public_key_length = 0;
+    if (NULL != mender_tls_public_key_pem) {
+        mender_free(mender_tls_public_key_pem);
+        mender_tls_public_key_pem = NULL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_tls_read_public_key(void) {
+
+    /* Release memory */
+    if (NULL != mender_tls_public_key_pem) {
+        mender_free(mender_tls_public_key_pem);
+        mender_tls_public_key_pem = NULL;
+    }
+
+    /* Retrieve public key */
+    if (NULL == (mender_tls_public_key = (unsigned char *)mender_malloc(ATCA_PUB_KEY_SIZE))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (ATCA_SUCCESS != atcab_get_pubkey(CONFIG_MENDER_TLS_PRIVATE_KEY_ID, (uint8_t *)mender_tls_public_key)) {
+        mender_log_error("Unable to get public key");
+        mender_free(mender_tls_public_key);
+        mender_tls_public_key = NULL;
+        return MENDER_FAIL;
+    }
+    mender_tls_public_key_length = ATCA_PUB_KEY_SIZE;
 
     return MENDER_OK;
 }
@@ -284,7 +469,7 @@ mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char
     }
 
     /* Allocate memory to store PEM data */
-    if (NULL == (encode_buf = (unsigned char *)malloc(use_len))) {
+    if (NULL == (encode_buf = (unsigned char *)mender_malloc(use_len))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -331,7 +516,7 @@ END:
 
     /* Release memory */
     if (NULL != encode_buf) {
-        free(encode_buf);
+        mender_free(encode_buf);
     }
 
     return ret;
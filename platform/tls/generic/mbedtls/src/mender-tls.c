@@ -17,17 +17,25 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TLS
+
 #include <mbedtls/base64.h>
 #include <mbedtls/bignum.h>
 #include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
 #include <mbedtls/entropy.h>
 #ifdef MBEDTLS_ERROR_C
 #include <mbedtls/error.h>
 #endif /* MBEDTLS_ERROR_C */
+#include <mbedtls/md.h>
 #include <mbedtls/pk.h>
 #include <mbedtls/rsa.h>
 #include <mbedtls/x509.h>
 #include "mender-log.h"
+#include "mender-scheduler.h"
 #include "mender-storage.h"
 #include "mender-tls.h"
 
@@ -42,6 +50,11 @@
  */
 #define MENDER_TLS_SIGNATURE_LENGTH (512)
 
+/**
+ * @brief ECDSA P-256 signature length (raw format)
+ */
+#define MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH (64)
+
 /**
  * @brief Private and public keys of the device
  */
@@ -50,6 +63,23 @@ static size_t         mender_tls_private_key_length = 0;
 static unsigned char *mender_tls_public_key         = NULL;
 static size_t         mender_tls_public_key_length  = 0;
 
+/**
+ * @brief Public key of the device in PEM format, computed once when it is requested
+ */
+static char *mender_tls_public_key_pem = NULL;
+
+/**
+ * @brief Contexts kept while the TLS module is initialized, the private key is parsed once and the random generator is seeded once
+ */
+static mbedtls_pk_context       *mender_tls_pk_context = NULL;
+static mbedtls_ctr_drbg_context *mender_tls_ctr_drbg   = NULL;
+static mbedtls_entropy_context  *mender_tls_entropy    = NULL;
+
+/**
+ * @brief Mutex used to protect access to the contexts
+ */
+static void *mender_tls_mutex = NULL;
+
 /**
  * @brief Generate authentication keys
  * @param private_key Private key generated
@@ -63,6 +93,12 @@ static mender_err_t mender_tls_generate_authentication_keys(unsigned char **priv
                                                             unsigned char **public_key,
                                                             size_t         *public_key_length);
 
+/**
+ * @brief Parse the private key of the device, the context is kept to sign the payloads
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_tls_parse_private_key(void);
+
 /**
  * @brief Write a buffer of PEM information from a DER encoded buffer
  * @note This function is derived from mbedtls_pem_write_buffer with const header and footer
@@ -75,10 +111,51 @@ static mender_err_t mender_tls_generate_authentication_keys(unsigned char **priv
  */
 static mender_err_t mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char *buf, size_t buf_len, size_t *olen);
 
+/**
+ * @brief Convert ECDSA P-256 signature from raw format (r and s concatenated) to ASN.1 format
+ * @param raw Signature in raw format (MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH bytes)
+ * @param asn1 Signature in ASN.1 format (at least MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH + 8 bytes)
+ * @return Length of the signature in ASN.1 format
+ */
+static size_t mender_tls_ecdsa_signature_to_asn1(uint8_t *raw, uint8_t *asn1);
+
 mender_err_t
 mender_tls_init(void) {
 
-    /* Nothing to do */
+    int ret;
+#ifdef MBEDTLS_ERROR_C
+    char err[128];
+#endif /* MBEDTLS_ERROR_C */
+
+    /* Create mutex used to protect access to the contexts */
+    if (MENDER_OK != mender_scheduler_mutex_create(&mender_tls_mutex)) {
+        mender_log_error("Unable to create mutex");
+        return MENDER_FAIL;
+    }
+
+    /* Initialize mbedtls */
+    if (NULL == (mender_tls_ctr_drbg = (mbedtls_ctr_drbg_context *)mender_malloc(sizeof(mbedtls_ctr_drbg_context)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    mbedtls_ctr_drbg_init(mender_tls_ctr_drbg);
+    if (NULL == (mender_tls_entropy = (mbedtls_entropy_context *)mender_malloc(sizeof(mbedtls_entropy_context)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    mbedtls_entropy_init(mender_tls_entropy);
+
+    /* Setup CRT DRBG */
+    if (0 != (ret = mbedtls_ctr_drbg_seed(mender_tls_ctr_drbg, mbedtls_entropy_func, mender_tls_entropy, (const unsigned char *)"mender", strlen("mender")))) {
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to initialize ctr drbg (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to initialize ctr drbg (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
 
@@ -87,17 +164,32 @@ mender_tls_init_authentication_keys(bool recommissioning) {
 
     mender_err_t ret;
 
+    /* Take mutex used to protect access to the contexts */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_tls_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
     /* Release memory */
+    if (NULL != mender_tls_pk_context) {
+        mbedtls_pk_free(mender_tls_pk_context);
+        mender_free(mender_tls_pk_context);
+        mender_tls_pk_context = NULL;
+    }
     if (NULL != mender_tls_private_key) {
-        free(mender_tls_private_key);
+        mender_free(mender_tls_private_key);
         mender_tls_private_key = NULL;
     }
     mender_tls_private_key_length = 0;
     if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
+        mender_free(mender_tls_public_key);
         mender_tls_public_key = NULL;
     }
     mender_tls_public_key_length = 0;
+    if (NULL != mender_tls_public_key_pem) {
+        mender_free(mender_tls_public_key_pem);
+        mender_tls_public_key_pem = NULL;
+    }
 
     /* Check if recommissioning is forced */
     if (true == recommissioning) {
@@ -120,7 +212,7 @@ mender_tls_init_authentication_keys(bool recommissioning) {
             != (ret = mender_tls_generate_authentication_keys(
                     &mender_tls_private_key, &mender_tls_private_key_length, &mender_tls_public_key, &mender_tls_public_key_length))) {
             mender_log_error("Unable to generate authentication keys");
-            return ret;
+            goto END;
         }
 
         /* Record keys */
@@ -128,10 +220,21 @@ mender_tls_init_authentication_keys(bool recommissioning) {
             != (ret = mender_storage_set_authentication_keys(
                     mender_tls_private_key, mender_tls_private_key_length, mender_tls_public_key, mender_tls_public_key_length))) {
             mender_log_error("Unable to record authentication keys");
-            return ret;
+            goto END;
         }
     }
 
+    /* Parse private key */
+    if (MENDER_OK != (ret = mender_tls_parse_private_key())) {
+        mender_log_error("Unable to parse private key");
+        goto END;
+    }
+
+END:
+
+    /* Release mutex used to protect access to the contexts */
+    mender_scheduler_mutex_give(mender_tls_mutex);
+
     return ret;
 }
 
@@ -141,24 +244,33 @@ mender_tls_get_public_key_pem(char **public_key) {
     assert(NULL != public_key);
     mender_err_t ret;
 
-    /* Compute size of the public key */
-    size_t olen = 0;
-    mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
-    if (0 == olen) {
-        mender_log_error("Unable to compute public key size");
-        return MENDER_FAIL;
-    }
-    if (NULL == (*public_key = (char *)malloc(olen))) {
-        mender_log_error("Unable to allocate memory");
-        return MENDER_FAIL;
-    }
+    /* Convert public key from DER to PEM format if it has not been done yet */
+    if (NULL == mender_tls_public_key_pem) {
 
-    /* Convert public key from DER to PEM format */
-    if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, *public_key, olen, &olen))) {
-        mender_log_error("Unable to convert public key");
-        return ret;
+        /* Compute size of the public key */
+        size_t olen = 0;
+        mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
+        if (0 == olen) {
+            mender_log_error("Unable to compute public key size");
+            return MENDER_FAIL;
+        }
+        if (NULL == (mender_tls_public_key_pem = (char *)mender_malloc(olen))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+
+        /* Convert public key from DER to PEM format */
+        if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, mender_tls_public_key_pem, olen, &olen))) {
+            mender_log_error("Unable to convert public key");
+            mender_free(mender_tls_public_key_pem);
+            mender_tls_public_key_pem = NULL;
+            return ret;
+        }
     }
 
+    /* Return public key */
+    *public_key = mender_tls_public_key_pem;
+
     return MENDER_OK;
 }
 
@@ -168,60 +280,24 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     assert(NULL != payload);
     assert(NULL != signature);
     assert(NULL != signature_length);
-    int                       ret;
-    mbedtls_pk_context       *pk_context = NULL;
-    mbedtls_ctr_drbg_context *ctr_drbg   = NULL;
-    mbedtls_entropy_context  *entropy    = NULL;
-    unsigned char            *sig        = NULL;
-    size_t                    sig_length;
-    char                     *tmp;
+    int            ret;
+    unsigned char *sig = NULL;
+    size_t         sig_length;
+    char          *tmp;
 #ifdef MBEDTLS_ERROR_C
     char err[128];
 #endif /* MBEDTLS_ERROR_C */
 
-    /* Initialize mbedtls */
-    if (NULL == (pk_context = (mbedtls_pk_context *)malloc(sizeof(mbedtls_pk_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_pk_init(pk_context);
-    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)malloc(sizeof(mbedtls_ctr_drbg_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_ctr_drbg_init(ctr_drbg);
-    if (NULL == (entropy = (mbedtls_entropy_context *)malloc(sizeof(mbedtls_entropy_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_entropy_init(entropy);
-
-    /* Setup CRT DRBG */
-    if (0 != (ret = mbedtls_ctr_drbg_seed(ctr_drbg, mbedtls_entropy_func, entropy, (const unsigned char *)"mender", strlen("mender")))) {
-#ifdef MBEDTLS_ERROR_C
-        mbedtls_strerror(ret, err, sizeof(err));
-        mender_log_error("Unable to initialize ctr drbg (-0x%04x: %s)", -ret, err);
-#else
-        mender_log_error("Unable to initialize ctr drbg (-0x%04x)", -ret);
-#endif /* MBEDTLS_ERROR_C */
-        goto END;
+    /* Take mutex used to protect access to the contexts */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_tls_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return MENDER_FAIL;
     }
 
-    /* Parse private key (IMPORTANT NOTE: length must include the ending \0 character) */
-#if MBEDTLS_VERSION_NUMBER >= 0x03000000
-    if (0 != (ret = mbedtls_pk_parse_key(pk_context, mender_tls_private_key, mender_tls_private_key_length, NULL, 0, mbedtls_ctr_drbg_random, ctr_drbg))) {
-#else
-    if (0 != (ret = mbedtls_pk_parse_key(pk_context, mender_tls_private_key, mender_tls_private_key_length, NULL, 0))) {
-#endif /* MBEDTLS_VERSION_NUMBER >= 0x03000000 */
-#ifdef MBEDTLS_ERROR_C
-        mbedtls_strerror(ret, err, sizeof(err));
-        mender_log_error("Unable to parse private key (-0x%04x: %s)", -ret, err);
-#else
-        mender_log_error("Unable to parse private key (-0x%04x)", -ret);
-#endif /* MBEDTLS_ERROR_C */
+    /* Check if the private key is available */
+    if (NULL == mender_tls_pk_context) {
+        mender_log_error("Private key is not available");
+        ret = -1;
         goto END;
     }
 
@@ -237,17 +313,28 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
         goto END;
     }
 
-    /* Compute signature */
-    if (NULL == (sig = (unsigned char *)malloc(MENDER_TLS_SIGNATURE_LENGTH + 1))) {
+    /* Compute signature, ECDSA signatures are encoded in ASN.1 format as expected by the server */
+    if (NULL == (sig = (unsigned char *)mender_malloc(MENDER_TLS_SIGNATURE_LENGTH + 1))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
     }
     sig_length = MENDER_TLS_SIGNATURE_LENGTH + 1;
 #if MBEDTLS_VERSION_NUMBER >= 0x03000000
-    if (0 != (ret = mbedtls_pk_sign(pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest), sig, sig_length, &sig_length, mbedtls_ctr_drbg_random, ctr_drbg))) {
+    if (0
+        != (ret = mbedtls_pk_sign(mender_tls_pk_context,
+                                  MBEDTLS_MD_SHA256,
+                                  digest,
+                                  sizeof(digest),
+                                  sig,
+                                  sig_length,
+                                  &sig_length,
+                                  mbedtls_ctr_drbg_random,
+                                  mender_tls_ctr_drbg))) {
 #else
-    if (0 != (ret = mbedtls_pk_sign(pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest), sig, &sig_length, mbedtls_ctr_drbg_random, ctr_drbg))) {
+    if (0
+        != (ret = mbedtls_pk_sign(
+                mender_tls_pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest), sig, &sig_length, mbedtls_ctr_drbg_random, mender_tls_ctr_drbg))) {
 #endif /* MBEDTLS_VERSION_NUMBER >= 0x03000000 */
 #ifdef MBEDTLS_ERROR_C
         mbedtls_strerror(ret, err, sizeof(err));
@@ -259,7 +346,7 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     }
 
     /* Encode signature to base64 */
-    if (NULL == (*signature = (char *)malloc(MENDER_TLS_SIGNATURE_LENGTH + 1))) {
+    if (NULL == (*signature = (char *)mender_malloc(MENDER_TLS_SIGNATURE_LENGTH + 1))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
@@ -272,14 +359,14 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
 #else
         mender_log_error("Unable to encode signature (-0x%04x)", -ret);
 #endif /* MBEDTLS_ERROR_C */
-        free(*signature);
+        mender_free(*signature);
         *signature = NULL;
         goto END;
     }
     *signature_length = strlen(*signature);
-    if (NULL == (tmp = realloc(*signature, *signature_length + 1))) {
+    if (NULL == (tmp = mender_realloc(*signature, *signature_length + 1))) {
         mender_log_error("Unable to allocate memory");
-        free(*signature);
+        mender_free(*signature);
         *signature = NULL;
         ret        = -1;
         goto END;
@@ -288,23 +375,183 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
 
 END:
 
-    /* Release mbedtls */
-    if (NULL != entropy) {
-        mbedtls_entropy_free(entropy);
-        free(entropy);
+    /* Release mutex used to protect access to the contexts */
+    mender_scheduler_mutex_give(mender_tls_mutex);
+
+    /* Release memory */
+    if (NULL != sig) {
+        mender_free(sig);
+    }
+
+    return (0 != ret) ? MENDER_FAIL : MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    assert(NULL != handle);
+    mbedtls_md_context_t *md_context;
+    int                   ret;
+#ifdef MBEDTLS_ERROR_C
+    char err[128];
+#endif /* MBEDTLS_ERROR_C */
+
+    /* Initialize message digest context */
+    if (NULL == (md_context = (mbedtls_md_context_t *)mender_malloc(sizeof(mbedtls_md_context_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    mbedtls_md_init(md_context);
+
+    /* Setup and start SHA-256 computation */
+    if ((0 != (ret = mbedtls_md_setup(md_context, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0))) || (0 != (ret = mbedtls_md_starts(md_context)))) {
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to start digest computation (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to start digest computation (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        mbedtls_md_free(md_context);
+        mender_free(md_context);
+        return MENDER_FAIL;
+    }
+
+    /* Return handle */
+    *handle = md_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_update(void *handle, void *data, size_t length) {
+
+    assert(NULL != handle);
+    int ret;
+#ifdef MBEDTLS_ERROR_C
+    char err[128];
+#endif /* MBEDTLS_ERROR_C */
+
+    /* Update SHA-256 computation */
+    if (0 != (ret = mbedtls_md_update((mbedtls_md_context_t *)handle, (const unsigned char *)data, length))) {
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to update digest computation (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to update digest computation (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+#ifdef MBEDTLS_ERROR_C
+    char err[128];
+#endif /* MBEDTLS_ERROR_C */
+
+    /* Finish SHA-256 computation */
+    if (NULL != digest) {
+        int result;
+        if (0 != (result = mbedtls_md_finish((mbedtls_md_context_t *)handle, digest))) {
+#ifdef MBEDTLS_ERROR_C
+            mbedtls_strerror(result, err, sizeof(err));
+            mender_log_error("Unable to finish digest computation (-0x%04x: %s)", -result, err);
+#else
+            mender_log_error("Unable to finish digest computation (-0x%04x)", -result);
+#endif /* MBEDTLS_ERROR_C */
+            ret = MENDER_FAIL;
+        }
+    }
+
+    /* Release memory */
+    mbedtls_md_free((mbedtls_md_context_t *)handle);
+    mender_free(handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_tls_verify_signature(char *public_key, uint8_t *digest, char *signature, size_t signature_length) {
+
+    assert(NULL != public_key);
+    assert(NULL != digest);
+    assert(NULL != signature);
+    int                 ret;
+    mbedtls_pk_context *pk_context = NULL;
+    unsigned char      *sig        = NULL;
+    size_t              sig_length;
+#ifdef MBEDTLS_ERROR_C
+    char err[128];
+#endif /* MBEDTLS_ERROR_C */
+
+    /* Initialize mbedtls */
+    if (NULL == (pk_context = (mbedtls_pk_context *)mender_malloc(sizeof(mbedtls_pk_context)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
+    }
+    mbedtls_pk_init(pk_context);
+
+    /* Parse public key (IMPORTANT NOTE: length must include the ending \0 character) */
+    if (0 != (ret = mbedtls_pk_parse_public_key(pk_context, (const unsigned char *)public_key, strlen(public_key) + 1))) {
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to parse public key (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to parse public key (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        goto END;
     }
-    if (NULL != ctr_drbg) {
-        mbedtls_ctr_drbg_free(ctr_drbg);
-        free(ctr_drbg);
+
+    /* Decode signature from base64, extra space is reserved to convert ECDSA signature to ASN.1 format */
+    if (NULL == (sig = (unsigned char *)mender_malloc(signature_length + MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH + 8))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
     }
+    if (0 != (ret = mbedtls_base64_decode(sig, signature_length, &sig_length, (const unsigned char *)signature, signature_length))) {
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to decode signature (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to decode signature (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        goto END;
+    }
+
+    /* ECDSA signatures of the artifacts are provided in raw format, convert them to ASN.1 format expected by mbedtls */
+    if ((0 != mbedtls_pk_can_do(pk_context, MBEDTLS_PK_ECDSA)) && (MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH == sig_length)) {
+        sig_length = mender_tls_ecdsa_signature_to_asn1(sig, sig + sig_length);
+        memmove(sig, sig + MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH, sig_length);
+    }
+
+    /* Verify signature */
+    if (0 != (ret = mbedtls_pk_verify(pk_context, MBEDTLS_MD_SHA256, digest, MENDER_TLS_SHA256_DIGEST_LENGTH, sig, sig_length))) {
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to verify signature (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to verify signature (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        goto END;
+    }
+
+END:
+
+    /* Release mbedtls */
     if (NULL != pk_context) {
         mbedtls_pk_free(pk_context);
-        free(pk_context);
+        mender_free(pk_context);
     }
 
     /* Release memory */
     if (NULL != sig) {
-        free(sig);
+        mender_free(sig);
     }
 
     return (0 != ret) ? MENDER_FAIL : MENDER_OK;
@@ -313,17 +560,40 @@ END:
 mender_err_t
 mender_tls_exit(void) {
 
+    /* Release mbedtls */
+    if (NULL != mender_tls_pk_context) {
+        mbedtls_pk_free(mender_tls_pk_context);
+        mender_free(mender_tls_pk_context);
+        mender_tls_pk_context = NULL;
+    }
+    if (NULL != mender_tls_ctr_drbg) {
+        mbedtls_ctr_drbg_free(mender_tls_ctr_drbg);
+        mender_free(mender_tls_ctr_drbg);
+        mender_tls_ctr_drbg = NULL;
+    }
+    if (NULL != mender_tls_entropy) {
+        mbedtls_entropy_free(mender_tls_entropy);
+        mender_free(mender_tls_entropy);
+        mender_tls_entropy = NULL;
+    }
+
     /* Release memory */
     if (NULL != mender_tls_private_key) {
-        free(mender_tls_private_key);
+        mender_free(mender_tls_private_key);
         mender_tls_private_key = NULL;
     }
     mender_tls_private_key_length = 0;
     if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
+        mender_free(mender_tls_public_key);
         mender_tls_public_key = NULL;
     }
     mender_tls_public_key_length = 0;
+    if (NULL != mender_tls_public_key_pem) {
+        mender_free(mender_tls_public_key_pem);
+        mender_tls_public_key_pem = NULL;
+    }
+    mender_scheduler_mutex_delete(mender_tls_mutex);
+    mender_tls_mutex = NULL;
 
     return MENDER_OK;
 }
@@ -335,49 +605,28 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
     assert(NULL != private_key_length);
     assert(NULL != public_key);
     assert(NULL != public_key_length);
-    int                       ret;
-    mbedtls_pk_context       *pk_context = NULL;
-    mbedtls_ctr_drbg_context *ctr_drbg   = NULL;
-    mbedtls_entropy_context  *entropy    = NULL;
-    unsigned char            *tmp;
+    int                 ret;
+    mbedtls_pk_context *pk_context = NULL;
+    unsigned char      *tmp;
 
 #ifdef MBEDTLS_ERROR_C
     char err[128];
 #endif /* MBEDTLS_ERROR_C */
 
     /* Initialize mbedtls */
-    if (NULL == (pk_context = (mbedtls_pk_context *)malloc(sizeof(mbedtls_pk_context)))) {
+    if (NULL == (pk_context = (mbedtls_pk_context *)mender_malloc(sizeof(mbedtls_pk_context)))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
     }
     mbedtls_pk_init(pk_context);
-    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)malloc(sizeof(mbedtls_ctr_drbg_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_ctr_drbg_init(ctr_drbg);
-    if (NULL == (entropy = (mbedtls_entropy_context *)malloc(sizeof(mbedtls_entropy_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_entropy_init(entropy);
-
-    /* Setup CRT DRBG */
-    if (0 != (ret = mbedtls_ctr_drbg_seed(ctr_drbg, mbedtls_entropy_func, entropy, (const unsigned char *)"mender", strlen("mender")))) {
-#ifdef MBEDTLS_ERROR_C
-        mbedtls_strerror(ret, err, sizeof(err));
-        mender_log_error("Unable to initialize ctr drbg (-0x%04x: %s)", -ret, err);
-#else
-        mender_log_error("Unable to initialize ctr drbg (-0x%04x)", -ret);
-#endif /* MBEDTLS_ERROR_C */
-        goto END;
-    }
 
     /* PK setup */
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_TYPE_ECDSA_P256
+    if (0 != (ret = mbedtls_pk_setup(pk_context, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)))) {
+#else
     if (0 != (ret = mbedtls_pk_setup(pk_context, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA)))) {
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_TYPE_ECDSA_P256 */
 #ifdef MBEDTLS_ERROR_C
         mbedtls_strerror(ret, err, sizeof(err));
         mender_log_error("Unable to setup pk (-0x%04x: %s)", -ret, err);
@@ -388,7 +637,11 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
     }
 
     /* Generate key pair */
-    if (0 != (ret = mbedtls_rsa_gen_key(mbedtls_pk_rsa(*pk_context), mbedtls_ctr_drbg_random, ctr_drbg, 3072, 65537))) {
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_TYPE_ECDSA_P256
+    if (0 != (ret = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(*pk_context), mbedtls_ctr_drbg_random, mender_tls_ctr_drbg))) {
+#else
+    if (0 != (ret = mbedtls_rsa_gen_key(mbedtls_pk_rsa(*pk_context), mbedtls_ctr_drbg_random, mender_tls_ctr_drbg, 3072, 65537))) {
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_TYPE_ECDSA_P256 */
 #ifdef MBEDTLS_ERROR_C
         mbedtls_strerror(ret, err, sizeof(err));
         mender_log_error("Unable to setup pk (-0x%04x: %s)", -ret, err);
@@ -399,7 +652,7 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
     }
 
     /* Export private key */
-    if (NULL == (*private_key = (unsigned char *)malloc(MENDER_TLS_PRIVATE_KEY_LENGTH))) {
+    if (NULL == (*private_key = (unsigned char *)mender_malloc(MENDER_TLS_PRIVATE_KEY_LENGTH))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
@@ -411,15 +664,15 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
 #else
         mender_log_error("Unable to write private key to PEM format (-0x%04x)", -ret);
 #endif /* MBEDTLS_ERROR_C */
-        free(*private_key);
+        mender_free(*private_key);
         *private_key = NULL;
         goto END;
     }
     *private_key_length = (size_t)ret;
     memcpy(*private_key, *private_key + MENDER_TLS_PRIVATE_KEY_LENGTH - *private_key_length, *private_key_length);
-    if (NULL == (tmp = realloc(*private_key, *private_key_length))) {
+    if (NULL == (tmp = mender_realloc(*private_key, *private_key_length))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_free(*private_key);
         *private_key = NULL;
         ret          = -1;
         goto END;
@@ -427,9 +680,9 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
     *private_key = tmp;
 
     /* Export public key */
-    if (NULL == (*public_key = (unsigned char *)malloc(MENDER_TLS_PUBLIC_KEY_LENGTH))) {
+    if (NULL == (*public_key = (unsigned char *)mender_malloc(MENDER_TLS_PUBLIC_KEY_LENGTH))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_free(*private_key);
         *private_key = NULL;
         ret          = -1;
         goto END;
@@ -441,19 +694,19 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
 #else
         mender_log_error("Unable to write public key to PEM format (-0x%04x)", -ret);
 #endif /* MBEDTLS_ERROR_C */
-        free(*private_key);
+        mender_free(*private_key);
         *private_key = NULL;
-        free(*public_key);
+        mender_free(*public_key);
         *public_key = NULL;
         goto END;
     }
     *public_key_length = (size_t)ret;
     memcpy(*public_key, *public_key + MENDER_TLS_PUBLIC_KEY_LENGTH - *public_key_length, *public_key_length);
-    if (NULL == (tmp = realloc(*public_key, *public_key_length))) {
+    if (NULL == (tmp = mender_realloc(*public_key, *public_key_length))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_free(*private_key);
         *private_key = NULL;
-        free(*public_key);
+        mender_free(*public_key);
         *public_key = NULL;
         ret         = -1;
         goto END;
@@ -464,22 +717,52 @@ mender_tls_generate_authentication_keys(unsigned char **private_key, size_t *pri
 END:
 
     /* Release mbedtls */
-    if (NULL != entropy) {
-        mbedtls_entropy_free(entropy);
-        free(entropy);
-    }
-    if (NULL != ctr_drbg) {
-        mbedtls_ctr_drbg_free(ctr_drbg);
-        free(ctr_drbg);
-    }
     if (NULL != pk_context) {
         mbedtls_pk_free(pk_context);
-        free(pk_context);
+        mender_free(pk_context);
     }
 
     return (0 != ret) ? MENDER_FAIL : MENDER_OK;
 }
 
+static mender_err_t
+mender_tls_parse_private_key(void) {
+
+    int ret;
+#ifdef MBEDTLS_ERROR_C
+    char err[128];
+#endif /* MBEDTLS_ERROR_C */
+
+    /* Initialize mbedtls */
+    if (NULL == (mender_tls_pk_context = (mbedtls_pk_context *)mender_malloc(sizeof(mbedtls_pk_context)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    mbedtls_pk_init(mender_tls_pk_context);
+
+    /* Parse private key (IMPORTANT NOTE: length must include the ending \0 character) */
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+    if (0
+        != (ret = mbedtls_pk_parse_key(
+                mender_tls_pk_context, mender_tls_private_key, mender_tls_private_key_length, NULL, 0, mbedtls_ctr_drbg_random, mender_tls_ctr_drbg))) {
+#else
+    if (0 != (ret = mbedtls_pk_parse_key(mender_tls_pk_context, mender_tls_private_key, mender_tls_private_key_length, NULL, 0))) {
+#endif /* MBEDTLS_VERSION_NUMBER >= 0x03000000 */
+#ifdef MBEDTLS_ERROR_C
+        mbedtls_strerror(ret, err, sizeof(err));
+        mender_log_error("Unable to parse private key (-0x%04x: %s)", -ret, err);
+#else
+        mender_log_error("Unable to parse private key (-0x%04x)", -ret);
+#endif /* MBEDTLS_ERROR_C */
+        mbedtls_pk_free(mender_tls_pk_context);
+        mender_free(mender_tls_pk_context);
+        mender_tls_pk_context = NULL;
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 static mender_err_t
 mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char *buf, size_t buf_len, size_t *olen) {
 
@@ -516,7 +799,7 @@ mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char
     }
 
     /* Allocate memory to store PEM data */
-    if (NULL == (encode_buf = (unsigned char *)malloc(use_len))) {
+    if (NULL == (encode_buf = (unsigned char *)mender_malloc(use_len))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -560,8 +843,46 @@ END:
 
     /* Release memory */
     if (NULL != encode_buf) {
-        free(encode_buf);
+        mender_free(encode_buf);
     }
 
     return ret;
 }
+
+static size_t
+mender_tls_ecdsa_signature_to_asn1(uint8_t *raw, uint8_t *asn1) {
+
+    assert(NULL != raw);
+    assert(NULL != asn1);
+    uint8_t *r     = &raw[0];
+    uint8_t *s     = &raw[MENDER_TLS_ECDSA_P256_SIGNATURE_LENGTH / 2];
+    size_t   index = 0;
+
+    /* Convert signature to ASN.1 format, integers are prefixed with a null byte when the most significant bit is set */
+    asn1[index] = 0x30;
+    index++;
+    asn1[index] = 4 + ((0x00 != (r[0] & 0x80)) ? 1 : 0) + 32 + ((0x00 != (s[0] & 0x80)) ? 1 : 0) + 32;
+    index++;
+    asn1[index] = 0x02;
+    index++;
+    asn1[index] = ((0x00 != (r[0] & 0x80)) ? 1 : 0) + 32;
+    index++;
+    if (0x00 != (r[0] & 0x80)) {
+        asn1[index] = 0x00;
+        index++;
+    }
+    memcpy(&asn1[index], r, 32);
+    index += 32;
+    asn1[index] = 0x02;
+    index++;
+    asn1[index] = ((0x00 != (s[0] & 0x80)) ? 1 : 0) + 32;
+    index++;
+    if (0x00 != (s[0] & 0x80)) {
+        asn1[index] = 0x00;
+        index++;
+    }
+    memcpy(&asn1[index], s, 32);
+    index += 32;
+
+    return index;
+}
@@ -55,6 +55,48 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_tls_sha256_update(void *handle, void *data, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    (void)handle;
+    (void)digest;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_tls_verify_signature(char *public_key, uint8_t *digest, char *signature, size_t signature_length) {
+
+    (void)public_key;
+    (void)digest;
+    (void)signature;
+    (void)signature_length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_tls_exit(void) {
 
@@ -0,0 +1,62 @@
+/**
+ * @file      mender-trace.c
+ * @brief     Mender trace interface for ESP-IDF platform, giving the events to SEGGER SystemView through the application tracing
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <SEGGER_SYSVIEW.h>
+#include "mender-trace.h"
+
+/**
+ * @brief Names of the traced operations
+ */
+static const char *mender_trace_names[] = MENDER_TRACE_EVENT_NAMES;
+
+mender_err_t
+mender_trace_init(void) {
+
+    /* Print the identifiers of the operations, they are the user events of SystemView */
+    for (size_t index = 0; index < MENDER_TRACE_EVENT_COUNT; index++) {
+        SEGGER_SYSVIEW_PrintfHost("mender user event %u: %s", (unsigned int)index, mender_trace_names[index]);
+    }
+
+    return MENDER_OK;
+}
+
+void
+mender_trace_begin(mender_trace_event_t event) {
+
+    assert(event < MENDER_TRACE_EVENT_COUNT);
+
+    /* Record the beginning of the user event */
+    SEGGER_SYSVIEW_OnUserStart((unsigned int)event);
+}
+
+void
+mender_trace_end(mender_trace_event_t event) {
+
+    assert(event < MENDER_TRACE_EVENT_COUNT);
+
+    /* Record the end of the user event */
+    SEGGER_SYSVIEW_OnUserStop((unsigned int)event);
+}
+
+mender_err_t
+mender_trace_exit(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file      mender-trace.c
+ * @brief     Mender trace interface for weak platform
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-trace.h"
+
+__attribute__((weak)) mender_err_t
+mender_trace_init(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
+
+__attribute__((weak)) void
+mender_trace_begin(mender_trace_event_t event) {
+
+    (void)event;
+
+    /* Nothing to do */
+}
+
+__attribute__((weak)) void
+mender_trace_end(mender_trace_event_t event) {
+
+    (void)event;
+
+    /* Nothing to do */
+}
+
+__attribute__((weak)) mender_err_t
+mender_trace_exit(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
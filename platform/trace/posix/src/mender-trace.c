@@ -0,0 +1,120 @@
+/**
+ * @file      mender-trace.c
+ * @brief     Mender trace interface for Posix platform, writing a Chrome trace event file which can be opened with Perfetto
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "mender-log.h"
+#include "mender-trace.h"
+
+/**
+ * @brief Default trace file
+ */
+#ifndef CONFIG_MENDER_TRACE_FILE
+#define CONFIG_MENDER_TRACE_FILE "mender-trace.json"
+#endif /* CONFIG_MENDER_TRACE_FILE */
+
+/**
+ * @brief Names of the traced operations
+ */
+static const char *mender_trace_names[] = MENDER_TRACE_EVENT_NAMES;
+
+/**
+ * @brief Trace file, NULL if not opened
+ */
+static FILE *mender_trace_file = NULL;
+
+/**
+ * @brief Mutex used to protect access to the trace file
+ */
+static pthread_mutex_t mender_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Write a trace event
+ * @param event Traced operation
+ * @param phase Phase of the event, 'B' for the beginning and 'E' for the end of the operation
+ */
+static void mender_trace_write(mender_trace_event_t event, char phase);
+
+mender_err_t
+mender_trace_init(void) {
+
+    /* Open the trace file, the array of events is not closed so that the file remains valid if the application is stopped */
+    pthread_mutex_lock(&mender_trace_mutex);
+    if (NULL == (mender_trace_file = fopen(CONFIG_MENDER_TRACE_FILE, "w"))) {
+        pthread_mutex_unlock(&mender_trace_mutex);
+        mender_log_error("Unable to open trace file '%s'", CONFIG_MENDER_TRACE_FILE);
+        return MENDER_FAIL;
+    }
+    fprintf(mender_trace_file, "[\n");
+    pthread_mutex_unlock(&mender_trace_mutex);
+
+    return MENDER_OK;
+}
+
+void
+mender_trace_begin(mender_trace_event_t event) {
+
+    mender_trace_write(event, 'B');
+}
+
+void
+mender_trace_end(mender_trace_event_t event) {
+
+    mender_trace_write(event, 'E');
+}
+
+mender_err_t
+mender_trace_exit(void) {
+
+    /* Close the trace file */
+    pthread_mutex_lock(&mender_trace_mutex);
+    if (NULL != mender_trace_file) {
+        fclose(mender_trace_file);
+        mender_trace_file = NULL;
+    }
+    pthread_mutex_unlock(&mender_trace_mutex);
+
+    return MENDER_OK;
+}
+
+static void
+mender_trace_write(mender_trace_event_t event, char phase) {
+
+    assert(event < MENDER_TRACE_EVENT_COUNT);
+    struct timespec now;
+
+    /* Retrieve the timestamp, the events are given in microseconds */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Write the event, the writes are buffered by the C library */
+    pthread_mutex_lock(&mender_trace_mutex);
+    if (NULL != mender_trace_file) {
+        fprintf(mender_trace_file,
+                "{\"name\":\"%s\",\"cat\":\"mender\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%ld},\n",
+                mender_trace_names[event],
+                phase,
+                (unsigned long long)now.tv_sec * 1000000 + (unsigned long long)now.tv_nsec / 1000,
+                (int)getpid(),
+                (long)syscall(SYS_gettid));
+    }
+    pthread_mutex_unlock(&mender_trace_mutex);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file      mender-trace.c
+ * @brief     Mender trace interface for Zephyr platform, giving the events to the tracing subsystem (SystemView, CTF...)
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/tracing/tracing.h>
+#include "mender-trace.h"
+
+/**
+ * @brief Names of the traced operations
+ */
+static const char *mender_trace_names[] = MENDER_TRACE_EVENT_NAMES;
+
+mender_err_t
+mender_trace_init(void) {
+
+    /* Nothing to do, the tracing subsystem is initialized by the kernel */
+    return MENDER_OK;
+}
+
+void
+mender_trace_begin(mender_trace_event_t event) {
+
+    assert(event < MENDER_TRACE_EVENT_COUNT);
+
+    /* Record a named event, the first argument is the operation and the second one is 0 at the beginning of the operation */
+    sys_trace_named_event(mender_trace_names[event], (uint32_t)event, 0);
+}
+
+void
+mender_trace_end(mender_trace_event_t event) {
+
+    assert(event < MENDER_TRACE_EVENT_COUNT);
+
+    /* Record a named event, the first argument is the operation and the second one is 1 at the end of the operation */
+    sys_trace_named_event(mender_trace_names[event], (uint32_t)event, 1);
+}
+
+mender_err_t
+mender_trace_exit(void) {
+
+    /* Nothing to do */
+    return MENDER_OK;
+}
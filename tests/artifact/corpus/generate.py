@@ -0,0 +1,139 @@
+# @file      generate.py
+# @brief     Generate the seed corpus of the artifact parser, the artifacts have the layouts produced by mender-artifact (format version 3)
+#
+# Copyright joelguittet and mender-mcu-client contributors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Usage: python3 generate.py [output directory], the directory of the script by default
+# The artifacts named "invalid-*" must be rejected by the parser, the others must be accepted
+
+import gzip
+import hashlib
+import io
+import json
+import os
+import sys
+import tarfile
+
+# The TAR files are not padded to a record, as written by mender-artifact
+tarfile.RECORDSIZE = tarfile.BLOCKSIZE
+
+
+def tar(members):
+    """Create a TAR file from a list of (name, data) members, the attributes are fixed so that the output is reproducible"""
+    output = io.BytesIO()
+    with tarfile.open(fileobj=output, mode="w", format=tarfile.PAX_FORMAT) as archive:
+        for name, data in members:
+            info = tarfile.TarInfo(name)
+            info.size = len(data)
+            info.mode = 0o644
+            info.mtime = 1700000000
+            archive.addfile(info, io.BytesIO(data))
+    return output.getvalue()
+
+
+def compress(data, compression):
+    """Compress data, the header of the gzip stream is fixed so that the output is reproducible"""
+    if "gz" == compression:
+        return gzip.compress(data, mtime=0)
+    return data
+
+
+def extension(compression):
+    """Extension of the compressed members"""
+    return ".gz" if "gz" == compression else ""
+
+
+def payload(size, seed):
+    """Payload data, partially compressible"""
+    data = bytearray()
+    counter = 0
+    while len(data) < size:
+        data += hashlib.sha256(b"%d-%d" % (seed, counter // 16)).digest()
+        data += b"mender-mcu-client" * 2
+        counter += 1
+    return bytes(data[:size])
+
+
+def artifact(payloads, compression="gz", manifest_extra=b"", manifest_repeated=False, truncate=None):
+    """Create an artifact, each payload is a (type, meta-data, files) tuple, the files are (name, data) tuples"""
+    version = json.dumps({"format": "mender", "version": 3}).encode()
+
+    # Header tarball
+    header_info = {
+        "payloads": [{"type": payload_type} for payload_type, _, _ in payloads],
+        "artifact_provides": {"artifact_name": "release-1"},
+        "artifact_depends": {"device_type": ["mender-mcu-client"]},
+    }
+    header_members = [("header-info", json.dumps(header_info).encode())]
+    for index, (payload_type, meta_data, _) in enumerate(payloads):
+        type_info = {"type": payload_type, "artifact_provides": {"rootfs-image.version": "release-1"}, "clears_artifact_provides": ["rootfs-image.*"]}
+        header_members.append(("headers/%04u/type-info" % index, json.dumps(type_info).encode()))
+        if meta_data is not None:
+            header_members.append(("headers/%04u/meta-data" % index, json.dumps(meta_data).encode()))
+    header = compress(tar(header_members), compression)
+
+    # Data tarballs
+    data = []
+    checksums = {"version": version, "header.tar" + extension(compression): header}
+    for index, (_, _, files) in enumerate(payloads):
+        data.append(("data/%04u.tar" % index + extension(compression), compress(tar(files), compression)))
+        for name, content in files:
+            checksums["data/%04u/%s" % (index, name)] = content
+
+    # Manifest, sorted by file name
+    manifest = b"".join(b"%s  %s\n" % (hashlib.sha256(content).hexdigest().encode(), name.encode()) for name, content in sorted(checksums.items()))
+    manifest += manifest_extra
+
+    members = [("version", version), ("manifest", manifest)]
+    if manifest_repeated:
+        members.append(("manifest", manifest))
+    members += [("header.tar" + extension(compression), header)] + data
+    output = tar(members)
+    return output[:truncate] if truncate is not None else output
+
+
+def main():
+    directory = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    rootfs = [("rootfs-image", None, [("rootfs.ext4", payload(40 * 1024, 0))])]
+    module = [
+        (
+            "module-image",
+            {"version": 1, "target": "app", "options": {"restart": True}},
+            [
+                ("image.bin", payload(12 * 1024 + 123, 1)),
+                ("empty.bin", b""),
+                ("a-file-name-longer-than-the-one-hundred-characters-of-the-ustar-header-so-that-it-is-given-by-a-pax-record.bin", payload(700, 2)),
+            ],
+        ),
+        ("module-image", None, [("second.bin", payload(511, 3))]),
+    ]
+    corpus = {
+        "rootfs-image.mender": artifact(rootfs),
+        "rootfs-image-uncompressed.mender": artifact(rootfs, compression="none"),
+        "module-image.mender": artifact(module),
+        "module-image-uncompressed.mender": artifact(module, compression="none"),
+        "invalid-truncated.mender": artifact(rootfs, compression="none", truncate=24 * 1024),
+        "invalid-manifest-repeated.mender": artifact(rootfs, compression="none", manifest_repeated=True),
+        "invalid-data-missing.mender": artifact(
+            module, compression="none", manifest_extra=b"%s  data/0001/missing.bin\n" % hashlib.sha256(b"").hexdigest().encode()
+        ),
+    }
+    for name, content in corpus.items():
+        with open(os.path.join(directory, name), "wb") as output:
+            output.write(content)
+
+
+if __name__ == "__main__":
+    main()
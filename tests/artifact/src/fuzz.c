@@ -0,0 +1,96 @@
+/**
+ * @file      fuzz.c
+ * @brief     Artifact parser fuzz target (libFuzzer, AFL++), each input is processed at once then with random split points and the results are compared
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include "harness.h"
+
+/**
+ * @brief Number of rounds with random split points for each input
+ */
+#define FUZZ_RANDOM_ROUNDS (4)
+
+/**
+ * @brief Initialization of the fuzz target
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return 0
+ */
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+/**
+ * @brief Fuzz target, the input is an artifact
+ * @param data Input data
+ * @param size Size of the input data
+ * @return 0
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int
+LLVMFuzzerInitialize(int *argc, char ***argv) {
+
+    (void)argc;
+    (void)argv;
+
+    /* Initialize the harness */
+    if (MENDER_OK != harness_init()) {
+        abort();
+    }
+
+    return 0;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+    harness_result_t reference;
+    harness_result_t result;
+    uint8_t         *artifact;
+    uint32_t         seed = 0x6d656e64 ^ (uint32_t)size;
+
+    /* Copy the input, the parser is given writable data */
+    if (NULL == (artifact = (uint8_t *)malloc((0 != size) ? size : 1))) {
+        abort();
+    }
+    memcpy(artifact, data, size);
+
+    /* Derive the seed of the split points from the end of the input, so that a crash is reproduced with the same input */
+    for (size_t index = (size > 4) ? (size - 4) : 0; index < size; index++) {
+        seed  = (seed << 8) | (seed >> 24);
+        seed ^= data[index];
+    }
+    if (0 == seed) {
+        seed = 1;
+    }
+
+    /* Process the input at once, then with random split points, the parser must deliver the same data and give the same result */
+    harness_process(artifact, size, size, &seed, &reference);
+    for (size_t round = 0; round < FUZZ_RANDOM_ROUNDS; round++) {
+        harness_process(artifact, size, 0, &seed, &result);
+        if ((true == reference.violation) || (true == result.violation) || ((MENDER_OK == reference.ret) != (MENDER_OK == result.ret))
+            || ((MENDER_OK == reference.ret)
+                && ((reference.digest != result.digest) || (reference.files != result.files) || (reference.delivered != result.delivered)))) {
+            abort();
+        }
+    }
+
+    /* Release memory */
+    free(artifact);
+
+    return 0;
+}
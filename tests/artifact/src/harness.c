@@ -0,0 +1,202 @@
+/**
+ * @file      harness.c
+ * @brief     Artifact parser harness, the artifacts are processed with chosen or random split points and the data delivered are checked
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "harness.h"
+#include "mender-artifact.h"
+
+/**
+ * @brief FNV-1a 64 bits offset basis and prime, used to compute the digest of the data delivered
+ */
+#define HARNESS_FNV_OFFSET_BASIS (0xcbf29ce484222325ULL)
+#define HARNESS_FNV_PRIME        (0x100000001b3ULL)
+
+/**
+ * @brief Result of the artifact currently processed
+ */
+static harness_result_t *harness_result = NULL;
+
+/**
+ * @brief Payload file currently delivered, the data must be delivered in order until its end
+ */
+static char   harness_file[CONFIG_MENDER_ARTIFACT_FILE_NAME_LENGTH];
+static size_t harness_file_size  = 0;
+static size_t harness_file_index = 0;
+
+/**
+ * @brief Callback invoked by the parser with the data of the payloads
+ * @param type Type of the payload
+ * @param meta_data Meta-data of the payload, NULL if there is no meta-data
+ * @param filename Name of the file, NULL at the beginning of the payload
+ * @param size Size of the file
+ * @param data Data of the file
+ * @param index Index of the data in the file
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t harness_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+
+/**
+ * @brief Update the digest with new data
+ * @param digest Digest
+ * @param data Data
+ * @param length Length of the data
+ * @return Digest updated
+ */
+static uint64_t harness_hash(uint64_t digest, void *data, size_t length);
+
+/**
+ * @brief Compute the length of the next chunk, between 1 byte and HARNESS_CHUNK_MAX_LENGTH with a logarithmic distribution
+ * @param seed Seed of the pseudo-random generator (xorshift32), updated
+ * @return Length of the chunk
+ */
+static size_t harness_random_length(uint32_t *seed);
+
+mender_err_t
+harness_init(void) {
+
+#ifdef CONFIG_MENDER_CLIENT_HEAP_STATISTICS
+    /* Account the allocations of cJSON to the heap statistics */
+    return mender_utils_heap_init();
+#else
+    return MENDER_OK;
+#endif /* CONFIG_MENDER_CLIENT_HEAP_STATISTICS */
+}
+
+void
+harness_process(uint8_t *data, size_t length, size_t chunk, uint32_t *seed, harness_result_t *result) {
+
+    assert(NULL != seed);
+    assert(NULL != result);
+    mender_artifact_ctx_t *ctx;
+    size_t                 offset = 0;
+
+    /* Initialize result */
+    memset(result, 0, sizeof(harness_result_t));
+    result->digest     = HARNESS_FNV_OFFSET_BASIS;
+    harness_result     = result;
+    harness_file[0]    = '\0';
+    harness_file_size  = 0;
+    harness_file_index = 0;
+
+    /* Create artifact context */
+    if (NULL == (ctx = mender_artifact_create_ctx())) {
+        result->ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Process the artifact chunk by chunk */
+    while ((offset < length) && (MENDER_OK == result->ret)) {
+        size_t size = (0 != chunk) ? chunk : harness_random_length(seed);
+        if (size > length - offset) {
+            size = length - offset;
+        }
+        result->ret  = mender_artifact_process_data(ctx, data + offset, size, &harness_callback);
+        offset      += size;
+    }
+
+    /* Check the artifact is complete, the last payload file must then have been delivered entirely */
+    if (MENDER_OK == result->ret) {
+        result->ret = mender_artifact_check_complete(ctx);
+    }
+    if ((MENDER_OK == result->ret) && (harness_file_index != harness_file_size)) {
+        result->violation = true;
+    }
+
+END:
+
+    /* Release memory */
+    mender_artifact_release_ctx(ctx);
+    harness_result = NULL;
+}
+
+static mender_err_t
+harness_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    assert(NULL != harness_result);
+    assert(NULL != type);
+
+    /* Beginning of the payload, the type and the meta-data are part of the digest */
+    if (NULL == filename) {
+        harness_result->digest = harness_hash(harness_result->digest, type, strlen(type) + 1);
+        if (NULL != meta_data) {
+            char *str;
+            if (NULL == (str = cJSON_PrintUnformatted(meta_data))) {
+                return MENDER_FAIL;
+            }
+            harness_result->digest = harness_hash(harness_result->digest, str, strlen(str) + 1);
+            mender_free(str);
+        }
+        return MENDER_OK;
+    }
+
+    /* Beginning of a file, the previous one must have been delivered entirely */
+    if ((harness_file_index == harness_file_size) || (strcmp(harness_file, filename))) {
+        if ((harness_file_index != harness_file_size) || (0 != index) || (strlen(filename) >= sizeof(harness_file))) {
+            harness_result->violation = true;
+            return MENDER_FAIL;
+        }
+        strcpy(harness_file, filename);
+        harness_file_size      = size;
+        harness_file_index     = 0;
+        harness_result->digest = harness_hash(harness_result->digest, filename, strlen(filename) + 1);
+        harness_result->digest = harness_hash(harness_result->digest, &size, sizeof(size));
+        harness_result->files++;
+    }
+
+    /* The data must follow the previous ones and must not exceed the size of the file */
+    if ((index != harness_file_index) || (size != harness_file_size) || (0 == length) || (length > size - index)) {
+        harness_result->violation = true;
+        return MENDER_FAIL;
+    }
+    harness_result->digest     = harness_hash(harness_result->digest, data, length);
+    harness_result->delivered += length;
+    harness_file_index        += length;
+
+    return MENDER_OK;
+}
+
+static uint64_t
+harness_hash(uint64_t digest, void *data, size_t length) {
+
+    assert(NULL != data);
+
+    /* FNV-1a, the digest does not depend of how the data are split */
+    for (size_t index = 0; index < length; index++) {
+        digest = (digest ^ ((uint8_t *)data)[index]) * HARNESS_FNV_PRIME;
+    }
+
+    return digest;
+}
+
+static size_t
+harness_random_length(uint32_t *seed) {
+
+    assert(NULL != seed);
+    uint32_t value[2];
+
+    /* Draw an exponent then a length below the power of two, short chunks are as likely as long ones */
+    for (size_t index = 0; index < 2; index++) {
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 17;
+        *seed ^= *seed << 5;
+        value[index] = *seed;
+    }
+
+    return 1 + (size_t)(value[1] % ((uint32_t)1 << (value[0] % 17)));
+}
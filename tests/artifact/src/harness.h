@@ -0,0 +1,65 @@
+/**
+ * @file      harness.h
+ * @brief     Artifact parser harness, the artifacts are processed with chosen or random split points and the data delivered are checked
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HARNESS_H__
+#define __HARNESS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Maximum length of the chunks given to the parser when the split points are random (bytes)
+ */
+#define HARNESS_CHUNK_MAX_LENGTH (65536)
+
+/**
+ * @brief Result of the processing of an artifact
+ */
+typedef struct {
+    mender_err_t ret;       /**< MENDER_OK if the artifact has been processed and is complete, error code otherwise */
+    bool         violation; /**< The data delivered by the parser are not contiguous or exceed the size of the files */
+    uint64_t     digest;    /**< Digest of the payloads, the files and the data delivered, it does not depend of the split points */
+    size_t       files;     /**< Number of payload files delivered */
+    size_t       delivered; /**< Length of the payload data delivered (bytes) */
+} harness_result_t;
+
+/**
+ * @brief Function used to initialize the harness, the allocations of cJSON are accounted to the heap statistics
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t harness_init(void);
+
+/**
+ * @brief Function used to process an artifact
+ * @param data Artifact
+ * @param length Length of the artifact
+ * @param chunk Length of the chunks given to the parser, 0 for random lengths up to HARNESS_CHUNK_MAX_LENGTH
+ * @param seed Seed of the random lengths, updated after each one
+ * @param result Result of the processing
+ */
+void harness_process(uint8_t *data, size_t length, size_t chunk, uint32_t *seed, harness_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __HARNESS_H__ */
@@ -0,0 +1,256 @@
+/**
+ * @file      main.c
+ * @brief     Artifact parser benchmark, the artifacts of the corpus are processed with several chunk lengths and random split points
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "harness.h"
+
+/**
+ * @brief Corpus directory used if it is not given on the command line
+ */
+#ifndef HARNESS_CORPUS_DIRECTORY
+#define HARNESS_CORPUS_DIRECTORY "corpus"
+#endif /* HARNESS_CORPUS_DIRECTORY */
+
+/**
+ * @brief Number of rounds with random split points for each artifact
+ */
+#define BENCHMARK_RANDOM_ROUNDS (16)
+
+/**
+ * @brief Maximum number of artifacts in the corpus
+ */
+#define BENCHMARK_ARTIFACTS_MAX (64)
+
+/**
+ * @brief Chunk lengths given to the parser, 0 for random split points (bytes)
+ */
+static const size_t benchmark_chunks[] = { 1, 7, 512, 4096, 65536, 0 };
+
+/**
+ * @brief Compare the names of two artifacts, so that the corpus is processed in a stable order
+ * @param a First name
+ * @param b Second name
+ * @return strcmp result
+ */
+static int benchmark_compare(const void *a, const void *b);
+
+/**
+ * @brief Read an artifact
+ * @param path Path of the artifact
+ * @param data Data of the artifact, to be released by the caller
+ * @param length Length of the artifact
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t benchmark_read(char *path, uint8_t **data, size_t *length);
+
+/**
+ * @brief Process an artifact with all the chunk lengths and check the results, the artifacts named "invalid-*" must be rejected
+ * @param name Name of the artifact
+ * @param data Data of the artifact
+ * @param length Length of the artifact
+ * @return MENDER_OK if the results are as expected, error code otherwise
+ */
+static mender_err_t benchmark_artifact(char *name, uint8_t *data, size_t length);
+
+/**
+ * @brief Get the monotonic time
+ * @return Time (nanoseconds)
+ */
+static uint64_t benchmark_get_time_ns(void);
+
+static int
+benchmark_compare(const void *a, const void *b) {
+
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static mender_err_t
+benchmark_read(char *path, uint8_t **data, size_t *length) {
+
+    assert(NULL != path);
+    assert(NULL != data);
+    assert(NULL != length);
+    FILE        *file;
+    long         size;
+    mender_err_t ret = MENDER_FAIL;
+
+    /* Read the whole file */
+    if (NULL == (file = fopen(path, "rb"))) {
+        printf("Unable to open '%s'\n", path);
+        return MENDER_FAIL;
+    }
+    if ((0 != fseek(file, 0, SEEK_END)) || ((size = ftell(file)) < 0) || (0 != fseek(file, 0, SEEK_SET))) {
+        printf("Unable to get the size of '%s'\n", path);
+        goto END;
+    }
+    if (NULL == (*data = (uint8_t *)malloc((0 != size) ? (size_t)size : 1))) {
+        printf("Unable to allocate memory\n");
+        goto END;
+    }
+    if ((size_t)size != fread(*data, 1, (size_t)size, file)) {
+        printf("Unable to read '%s'\n", path);
+        free(*data);
+        *data = NULL;
+        goto END;
+    }
+    *length = (size_t)size;
+    ret     = MENDER_OK;
+
+END:
+
+    /* Close the file */
+    fclose(file);
+
+    return ret;
+}
+
+static mender_err_t
+benchmark_artifact(char *name, uint8_t *data, size_t length) {
+
+    assert(NULL != name);
+    assert(NULL != data);
+    harness_result_t reference;
+    harness_result_t result;
+    uint32_t         seed  = 0x6d656e64;
+    bool             valid = !mender_utils_strbeginwith(name, "invalid-");
+    mender_err_t     ret   = MENDER_OK;
+
+    /* Process the artifact at once, this is the reference */
+    harness_process(data, length, length, &seed, &reference);
+    if ((true == reference.violation) || (valid != (MENDER_OK == reference.ret))) {
+        printf("%s: unexpected result when processed at once\n", name);
+        return MENDER_FAIL;
+    }
+
+    /* Process the artifact with each chunk length, the random split points are drawn again at each round */
+    for (size_t index = 0; index < sizeof(benchmark_chunks) / sizeof(benchmark_chunks[0]); index++) {
+        size_t                         rounds = (0 != benchmark_chunks[index]) ? 1 : BENCHMARK_RANDOM_ROUNDS;
+        mender_utils_heap_statistics_t before;
+        mender_utils_heap_statistics_t after;
+        uint64_t                       duration    = 0;
+        uint64_t                       allocations = 0;
+        char                           chunk[16];
+        for (size_t round = 0; round < rounds; round++) {
+            mender_utils_get_heap_statistics(MENDER_UTILS_HEAP_SUBSYSTEM_ALL, &before);
+            uint64_t start = benchmark_get_time_ns();
+            harness_process(data, length, benchmark_chunks[index], &seed, &result);
+            duration += benchmark_get_time_ns() - start;
+            mender_utils_get_heap_statistics(MENDER_UTILS_HEAP_SUBSYSTEM_ALL, &after);
+            allocations += after.allocations - before.allocations;
+
+            /* The result must not depend of the split points */
+            if ((true == result.violation) || (valid != (MENDER_OK == result.ret))
+                || ((true == valid)
+                    && ((reference.digest != result.digest) || (reference.files != result.files) || (reference.delivered != result.delivered)))) {
+                printf("%s: unexpected result with chunk length %zu, round %zu\n", name, benchmark_chunks[index], round);
+                ret = MENDER_FAIL;
+            }
+            if (after.current != before.current) {
+                printf("%s: %zu bytes not released with chunk length %zu, round %zu\n", name, after.current - before.current, benchmark_chunks[index], round);
+                ret = MENDER_FAIL;
+            }
+        }
+
+        /* Print the measurements of the valid artifacts, the invalid ones are not processed entirely */
+        if (true == valid) {
+            if (0 != benchmark_chunks[index]) {
+                snprintf(chunk, sizeof(chunk), "%zu", benchmark_chunks[index]);
+            } else {
+                snprintf(chunk, sizeof(chunk), "random");
+            }
+            printf("%-36s chunk %6s: %8.2f ns/byte, %8.1f allocations/MB\n",
+                   name,
+                   chunk,
+                   (double)duration / (double)(rounds * length),
+                   (double)allocations * 1024 * 1024 / (double)(rounds * length));
+        }
+    }
+    if ((MENDER_OK == ret) && (false == valid)) {
+        printf("%-36s rejected with all the chunk lengths\n", name);
+    }
+
+    return ret;
+}
+
+static uint64_t
+benchmark_get_time_ns(void) {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+int
+main(int argc, char **argv) {
+
+    char          *directory = (argc > 1) ? argv[1] : HARNESS_CORPUS_DIRECTORY;
+    char          *names[BENCHMARK_ARTIFACTS_MAX];
+    size_t         count = 0;
+    DIR           *dir;
+    struct dirent *entry;
+    int            ret = EXIT_SUCCESS;
+
+    /* Initialize the harness */
+    if (MENDER_OK != harness_init()) {
+        printf("Unable to initialize the harness\n");
+        return EXIT_FAILURE;
+    }
+
+    /* List the artifacts of the corpus */
+    if (NULL == (dir = opendir(directory))) {
+        printf("Unable to open '%s'\n", directory);
+        return EXIT_FAILURE;
+    }
+    while ((NULL != (entry = readdir(dir))) && (count < BENCHMARK_ARTIFACTS_MAX)) {
+        if (true == mender_utils_strendwith(entry->d_name, ".mender")) {
+            if (NULL == (names[count] = strdup(entry->d_name))) {
+                printf("Unable to allocate memory\n");
+                ret = EXIT_FAILURE;
+                break;
+            }
+            count++;
+        }
+    }
+    closedir(dir);
+    if (0 == count) {
+        printf("No artifact found in '%s'\n", directory);
+        ret = EXIT_FAILURE;
+    }
+    qsort(names, count, sizeof(char *), &benchmark_compare);
+
+    /* Process the artifacts */
+    for (size_t index = 0; index < count; index++) {
+        char     path[1024];
+        uint8_t *data = NULL;
+        size_t   length;
+        snprintf(path, sizeof(path), "%s/%s", directory, names[index]);
+        if ((MENDER_OK != benchmark_read(path, &data, &length)) || (MENDER_OK != benchmark_artifact(names[index], data, length))) {
+            ret = EXIT_FAILURE;
+        }
+        free(data);
+        free(names[index]);
+    }
+
+    return ret;
+}
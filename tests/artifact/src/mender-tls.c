@@ -0,0 +1,185 @@
+/**
+ * @file      mender-tls.c
+ * @brief     Mender TLS interface of the artifact harness, only the SHA-256 digest used to verify the checksums of the artifact is implemented
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_TLS
+
+#include "mender-log.h"
+#include "mender-tls.h"
+
+/**
+ * @brief SHA-256 block size (bytes)
+ */
+#define MENDER_TLS_SHA256_BLOCK_SIZE (64)
+
+/**
+ * @brief SHA-256 context
+ */
+typedef struct {
+    uint32_t state[8];                            /**< Intermediate hash value */
+    uint64_t length;                              /**< Length of the data hashed (bytes) */
+    uint8_t  block[MENDER_TLS_SHA256_BLOCK_SIZE]; /**< Data of the block currently filled */
+    size_t   index;                               /**< Length of the data of the block currently filled (bytes) */
+} mender_tls_sha256_ctx_t;
+
+/**
+ * @brief SHA-256 round constants
+ */
+static const uint32_t mender_tls_sha256_k[64]
+    = { 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+        0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+        0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+        0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+        0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+        0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+/**
+ * @brief Rotate right a 32 bits word
+ * @param x Word
+ * @param n Number of bits
+ * @return Word rotated
+ */
+#define MENDER_TLS_SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * @brief Process a block of data
+ * @param ctx SHA-256 context
+ * @param block Block of data (MENDER_TLS_SHA256_BLOCK_SIZE bytes)
+ */
+static void mender_tls_sha256_process(mender_tls_sha256_ctx_t *ctx, const uint8_t *block);
+
+mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    assert(NULL != handle);
+    mender_tls_sha256_ctx_t *ctx;
+
+    /* Initialize SHA-256 context */
+    if (NULL == (ctx = (mender_tls_sha256_ctx_t *)mender_malloc(sizeof(mender_tls_sha256_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(ctx, 0, sizeof(mender_tls_sha256_ctx_t));
+    ctx->state[0] = 0x6a09e667;
+    ctx->state[1] = 0xbb67ae85;
+    ctx->state[2] = 0x3c6ef372;
+    ctx->state[3] = 0xa54ff53a;
+    ctx->state[4] = 0x510e527f;
+    ctx->state[5] = 0x9b05688c;
+    ctx->state[6] = 0x1f83d9ab;
+    ctx->state[7] = 0x5be0cd19;
+    *handle       = ctx;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_update(void *handle, void *data, size_t length) {
+
+    assert(NULL != handle);
+    mender_tls_sha256_ctx_t *ctx = (mender_tls_sha256_ctx_t *)handle;
+    const uint8_t           *ptr = (const uint8_t *)data;
+
+    /* Fill the block and process it each time it is full */
+    ctx->length += length;
+    while (0 != length) {
+        size_t size = MENDER_TLS_SHA256_BLOCK_SIZE - ctx->index;
+        if (size > length) {
+            size = length;
+        }
+        memcpy(&ctx->block[ctx->index], ptr, size);
+        ctx->index += size;
+        ptr        += size;
+        length     -= size;
+        if (MENDER_TLS_SHA256_BLOCK_SIZE == ctx->index) {
+            mender_tls_sha256_process(ctx, ctx->block);
+            ctx->index = 0;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    assert(NULL != handle);
+    mender_tls_sha256_ctx_t *ctx = (mender_tls_sha256_ctx_t *)handle;
+
+    /* Append the padding and the length of the data (bits), then retrieve the digest */
+    if (NULL != digest) {
+        uint64_t length          = ctx->length * 8;
+        ctx->block[ctx->index++] = 0x80;
+        if (ctx->index > MENDER_TLS_SHA256_BLOCK_SIZE - 8) {
+            memset(&ctx->block[ctx->index], 0, MENDER_TLS_SHA256_BLOCK_SIZE - ctx->index);
+            mender_tls_sha256_process(ctx, ctx->block);
+            ctx->index = 0;
+        }
+        memset(&ctx->block[ctx->index], 0, MENDER_TLS_SHA256_BLOCK_SIZE - 8 - ctx->index);
+        for (size_t index = 0; index < 8; index++) {
+            ctx->block[MENDER_TLS_SHA256_BLOCK_SIZE - 1 - index] = (uint8_t)(length >> (8 * index));
+        }
+        mender_tls_sha256_process(ctx, ctx->block);
+        for (size_t index = 0; index < MENDER_TLS_SHA256_DIGEST_LENGTH; index++) {
+            digest[index] = (uint8_t)(ctx->state[index / 4] >> (24 - 8 * (index % 4)));
+        }
+    }
+
+    /* Release memory */
+    mender_free(ctx);
+
+    return MENDER_OK;
+}
+
+static void
+mender_tls_sha256_process(mender_tls_sha256_ctx_t *ctx, const uint8_t *block) {
+
+    assert(NULL != ctx);
+    assert(NULL != block);
+    uint32_t w[64];
+    uint32_t s[8];
+
+    /* Compute the message schedule */
+    for (size_t index = 0; index < 16; index++) {
+        w[index] = ((uint32_t)block[4 * index] << 24) | ((uint32_t)block[4 * index + 1] << 16) | ((uint32_t)block[4 * index + 2] << 8)
+                   | (uint32_t)block[4 * index + 3];
+    }
+    for (size_t index = 16; index < 64; index++) {
+        uint32_t s0 = MENDER_TLS_SHA256_ROTR(w[index - 15], 7) ^ MENDER_TLS_SHA256_ROTR(w[index - 15], 18) ^ (w[index - 15] >> 3);
+        uint32_t s1 = MENDER_TLS_SHA256_ROTR(w[index - 2], 17) ^ MENDER_TLS_SHA256_ROTR(w[index - 2], 19) ^ (w[index - 2] >> 10);
+        w[index]    = w[index - 16] + s0 + w[index - 7] + s1;
+    }
+
+    /* Compression rounds */
+    memcpy(s, ctx->state, sizeof(s));
+    for (size_t index = 0; index < 64; index++) {
+        uint32_t t1 = s[7] + (MENDER_TLS_SHA256_ROTR(s[4], 6) ^ MENDER_TLS_SHA256_ROTR(s[4], 11) ^ MENDER_TLS_SHA256_ROTR(s[4], 25))
+                      + ((s[4] & s[5]) ^ (~s[4] & s[6])) + mender_tls_sha256_k[index] + w[index];
+        uint32_t t2 = (MENDER_TLS_SHA256_ROTR(s[0], 2) ^ MENDER_TLS_SHA256_ROTR(s[0], 13) ^ MENDER_TLS_SHA256_ROTR(s[0], 22))
+                      + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0]  = t1 + t2;
+    }
+    for (size_t index = 0; index < 8; index++) {
+        ctx->state[index] += s[index];
+    }
+}
@@ -0,0 +1,59 @@
+/* Minimal cJSON subset for local runtime tests only */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "cJSON.h"
+void cJSON_Delete(cJSON *c);
+static cJSON *newitem(void){ cJSON *c=calloc(1,sizeof(cJSON)); return c; }
+static const char *ws(const char *p,const char *e){ while(p<e && (*p==' '||*p=='\n'||*p=='\r'||*p=='\t')) p++; return p; }
+static const char *pval(cJSON *it,const char *p,const char *e);
+static const char *pstr(char **out,const char *p,const char *e){ if(p>=e||*p!='"') return NULL; p++; const char *s=p; while(p<e && *p!='"'){ if(*p=='\\') p++; p++; } if(p>=e) return NULL; size_t n=p-s; *out=malloc(n+1); memcpy(*out,s,n); (*out)[n]=0; return p+1; }
+static const char *pval(cJSON *it,const char *p,const char *e){
+  p=ws(p,e); if(p>=e) return NULL;
+  if(*p=='{'){ it->type=cJSON_Object; p=ws(p+1,e); if(p<e&&*p=='}') return p+1; cJSON *prev=NULL;
+    while(1){ cJSON *c=newitem(); p=ws(p,e); p=pstr(&c->string,p,e); if(!p){cJSON_Delete(c);return NULL;} p=ws(p,e); if(p>=e||*p!=':'){cJSON_Delete(c);return NULL;} p=pval(c,p+1,e); if(!p){cJSON_Delete(c);return NULL;}
+      if(prev){prev->next=c;c->prev=prev;} else it->child=c; prev=c; p=ws(p,e); if(p<e&&*p==','){p++;continue;} if(p<e&&*p=='}') return p+1; return NULL; } }
+  if(*p=='['){ it->type=cJSON_Array; p=ws(p+1,e); if(p<e&&*p==']') return p+1; cJSON *prev=NULL;
+    while(1){ cJSON *c=newitem(); p=pval(c,p,e); if(!p){cJSON_Delete(c);return NULL;} if(prev){prev->next=c;c->prev=prev;} else it->child=c; prev=c; p=ws(p,e); if(p<e&&*p==','){p++;continue;} if(p<e&&*p==']') return p+1; return NULL; } }
+  if(*p=='"'){ it->type=cJSON_String; return pstr(&it->valuestring,p,e); }
+  if(!strncmp(p,"true",4)){it->type=cJSON_True;return p+4;} if(!strncmp(p,"false",5)){it->type=cJSON_False;return p+5;} if(!strncmp(p,"null",4)){it->type=cJSON_NULL;return p+4;}
+  char *end; double d=strtod(p,&end); if(end==p) return NULL; it->type=cJSON_Number; it->valuedouble=d; it->valueint=(int)d; return end; }
+cJSON *cJSON_ParseWithLength(const char *v,size_t n){ cJSON *c=newitem(); if(!pval(c,v,v+n)){cJSON_Delete(c);return NULL;} return c; }
+cJSON *cJSON_Parse(const char *v){ return cJSON_ParseWithLength(v,strlen(v)); }
+void cJSON_Delete(cJSON *c){ while(c){ cJSON *n=c->next; cJSON_Delete(c->child); free(c->string); free(c->valuestring); free(c); c=n; } }
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *const o,const char *const s){ if(!o) return NULL; for(cJSON *c=o->child;c;c=c->next) if(c->string&&!strcmp(c->string,s)) return c; return NULL; }
+cJSON *cJSON_GetObjectItem(const cJSON *const o,const char *const s){ return cJSON_GetObjectItemCaseSensitive(o,s); }
+int cJSON_GetArraySize(const cJSON *a){ int n=0; for(cJSON *c=a?a->child:NULL;c;c=c->next) n++; return n; }
+cJSON *cJSON_GetArrayItem(const cJSON *a,int i){ for(cJSON *c=a?a->child:NULL;c;c=c->next) if(!i--) return c; return NULL; }
+char *cJSON_GetStringValue(const cJSON *const i){ return (i&&i->type==cJSON_String)?i->valuestring:NULL; }
+double cJSON_GetNumberValue(const cJSON *const i){ return i?i->valuedouble:0; }
+cJSON_bool cJSON_IsString(const cJSON *const i){ return i&&i->type==cJSON_String; }
+cJSON_bool cJSON_IsNumber(const cJSON *const i){ return i&&i->type==cJSON_Number; }
+cJSON_bool cJSON_IsArray(const cJSON *const i){ return i&&i->type==cJSON_Array; }
+cJSON_bool cJSON_IsObject(const cJSON *const i){ return i&&i->type==cJSON_Object; }
+cJSON_bool cJSON_IsTrue(const cJSON *const i){ return i&&i->type==cJSON_True; }
+cJSON_bool cJSON_IsBool(const cJSON *const i){ return i&&(i->type==cJSON_True||i->type==cJSON_False); }
+cJSON_bool cJSON_IsNull(const cJSON *const i){ return i&&i->type==cJSON_NULL; }
+cJSON *cJSON_CreateObject(void){ cJSON *c=newitem(); c->type=cJSON_Object; return c; }
+cJSON *cJSON_CreateArray(void){ cJSON *c=newitem(); c->type=cJSON_Array; return c; }
+cJSON *cJSON_CreateString(const char *s){ cJSON *c=newitem(); c->type=cJSON_String; c->valuestring=strdup(s); return c; }
+static void addlast(cJSON *o,cJSON *c){ if(!o->child){o->child=c;return;} cJSON *p=o->child; while(p->next)p=p->next; p->next=c; c->prev=p; }
+cJSON_bool cJSON_AddItemToArray(cJSON *a,cJSON *i){ addlast(a,i); return 1; }
+cJSON_bool cJSON_AddItemToObject(cJSON *o,const char *s,cJSON *i){ i->string=strdup(s); addlast(o,i); return 1; }
+cJSON *cJSON_AddStringToObject(cJSON *const o,const char *const n,const char *const s){ cJSON *c=cJSON_CreateString(s); cJSON_AddItemToObject(o,n,c); return c; }
+cJSON *cJSON_CreateNumber(double n){ cJSON *c=newitem(); c->type=cJSON_Number; c->valuedouble=n; c->valueint=(int)n; return c; }
+cJSON *cJSON_CreateTrue(void){ cJSON *c=newitem(); c->type=cJSON_True; return c; }
+cJSON *cJSON_CreateFalse(void){ cJSON *c=newitem(); c->type=cJSON_False; return c; }
+cJSON *cJSON_CreateNull(void){ cJSON *c=newitem(); c->type=cJSON_NULL; return c; }
+static void *(*hm)(size_t)=NULL; void cJSON_InitHooks(cJSON_Hooks *h){ hm=h?h->malloc_fn:NULL; }
+cJSON *cJSON_AddArrayToObject(cJSON *const o,const char *const n){ cJSON *c=cJSON_CreateArray(); cJSON_AddItemToObject(o,n,c); return c; }
+void cJSON_DeleteItemFromObjectCaseSensitive(cJSON *o,const char *s){ for(cJSON *c=o?o->child:NULL;c;c=c->next) if(c->string&&!strcmp(c->string,s)){ if(c->prev) c->prev->next=c->next; else o->child=c->next; if(c->next) c->next->prev=c->prev; c->next=NULL; cJSON_Delete(c); return; } }
+static void pr(const cJSON *c,char **b,size_t *n){ char t[64]; size_t l;
+#define APP(s) do{ l=strlen(s); *b=realloc(*b,*n+l+1); memcpy(*b+*n,s,l+1); *n+=l; }while(0)
+ switch(c->type&0xff){ case cJSON_Object: case cJSON_Array: { int o=(c->type&0xff)==cJSON_Object; APP(o?"{":"["); for(cJSON *k=c->child;k;k=k->next){ if(o){APP("\"");APP(k->string);APP("\":");} pr(k,b,n); if(k->next)APP(","); } APP(o?"}":"]"); break; }
+ case cJSON_String: APP("\""); APP(c->valuestring); APP("\""); break; case cJSON_Number: snprintf(t,sizeof t,"%.17g",c->valuedouble); APP(t); break;
+ case cJSON_True: APP("true"); break; case cJSON_False: APP("false"); break; default: APP("null"); } }
+char *cJSON_PrintUnformatted(const cJSON *c){ char *b=calloc(1,1); size_t n=0; pr(c,&b,&n); if(hm){ char *r=hm(n+1); memcpy(r,b,n+1); free(b); return r; } return b; }
+char *cJSON_Print(const cJSON *c){ return cJSON_PrintUnformatted(c); }
+
+void cJSON_free(void *p){ free(p); }
@@ -0,0 +1,8 @@
+#ifndef __SEGGER_SYSVIEW_H__
+#define __SEGGER_SYSVIEW_H__
+
+void SEGGER_SYSVIEW_PrintfHost(const char *s, ...);
+void SEGGER_SYSVIEW_OnUserStart(unsigned int id);
+void SEGGER_SYSVIEW_OnUserStop(unsigned int id);
+
+#endif /* __SEGGER_SYSVIEW_H__ */
@@ -5,6 +5,10 @@
 #include <stddef.h>
 #include <esp_err.h>
 
+#define ESP_ERR_NVS_BASE           0x1100
+#define ESP_ERR_NVS_NOT_FOUND      (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH (ESP_ERR_NVS_BASE + 0x0c)
+
 typedef uint32_t nvs_handle_t;
 
 typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
@@ -0,0 +1,13 @@
+#include "SEGGER_SYSVIEW.h"
+
+void
+SEGGER_SYSVIEW_PrintfHost(const char *s, ...) {
+}
+
+void
+SEGGER_SYSVIEW_OnUserStart(unsigned int id) {
+}
+
+void
+SEGGER_SYSVIEW_OnUserStop(unsigned int id) {
+}
@@ -5,11 +5,26 @@ esp_http_client_init(const esp_http_client_config_t *config) {
     return NULL;
 }
 
+esp_err_t
+esp_http_client_set_url(esp_http_client_handle_t client, const char *url) {
+    return ESP_OK;
+}
+
+esp_err_t
+esp_http_client_set_user_data(esp_http_client_handle_t client, void *data) {
+    return ESP_OK;
+}
+
 esp_err_t
 esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
     return ESP_OK;
 }
 
+esp_err_t
+esp_http_client_delete_header(esp_http_client_handle_t client, const char *key) {
+    return ESP_OK;
+}
+
 esp_err_t
 esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
     return ESP_OK;
@@ -35,6 +50,11 @@ esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
     return 0;
 }
 
+int64_t
+esp_http_client_get_content_length(esp_http_client_handle_t client) {
+    return 0;
+}
+
 int
 esp_http_client_get_status_code(esp_http_client_handle_t client) {
     return 0;
@@ -10,6 +10,11 @@ esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
     return ESP_OK;
 }
 
+esp_err_t
+esp_ota_write_with_offset(esp_ota_handle_t handle, const void *data, size_t size, uint32_t offset) {
+    return ESP_OK;
+}
+
 esp_err_t
 esp_ota_end(esp_ota_handle_t handle) {
     return ESP_OK;
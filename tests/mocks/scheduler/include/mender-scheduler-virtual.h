@@ -0,0 +1,43 @@
+/**
+ * @file      mender-scheduler-virtual.h
+ * @brief     Mender scheduler virtual clock interface, the simulations run the client without waiting for the delays
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_SCHEDULER_VIRTUAL_H__
+#define __MENDER_SCHEDULER_VIRTUAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-scheduler.h"
+
+/**
+ * @brief Function used to run the simulation during a duration of the virtual clock
+ * @note The virtual clock jumps to the next deadline (timers of the works, timeouts of the mutexes and queues, delays) once all the works and tasks are waiting
+ * @note The time spent out of the scheduler (network, storage) is not counted, the virtual clock is stopped meanwhile
+ * @note The virtual clock is stopped until this function is called, it stops again at the end of the duration so that the simulation is reproducible
+ * @param duration_us Duration (microseconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_virtual_run(uint64_t duration_us);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_SCHEDULER_VIRTUAL_H__ */
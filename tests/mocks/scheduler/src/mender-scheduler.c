@@ -0,0 +1,1163 @@
+/**
+ * @file      mender-scheduler.c
+ * @brief     Mender scheduler interface for the simulations, the delays are counted with a virtual clock which jumps to the next deadline
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Subsystem the memory allocations are accounted to
+ */
+#define MENDER_UTILS_HEAP_SUBSYSTEM MENDER_UTILS_HEAP_SUBSYSTEM_SCHEDULER
+
+#include <pthread.h>
+#include <sched.h>
+#include "mender-log.h"
+#include "mender-scheduler-virtual.h"
+
+/**
+ * @brief Default work queue length
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH
+#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH (10)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH */
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief Default high priority work queue length
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH
+#define CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH (10)
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH */
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+/**
+ * @brief Deadline of the timers which are stopped and of the waits without a timeout
+ */
+#define MENDER_SCHEDULER_NO_DEADLINE (UINT64_MAX)
+
+/**
+ * @brief Work queue, the works are executed by a thread in the order of their submission
+ */
+typedef struct {
+    void     **works;         /**< Works submitted, ring buffer */
+    size_t     length;        /**< Maximum number of works in the work queue */
+    size_t     first;         /**< Index of the first work in the work queue */
+    size_t     count;         /**< Number of works in the work queue */
+    pthread_t  thread_handle; /**< Thread executing the works */
+} mender_scheduler_work_queue_t;
+
+/**
+ * @brief Work context
+ */
+typedef struct {
+    mender_scheduler_work_params_t params;          /**< Work parameters */
+    bool                           pending;         /**< Flag indicating the work is pending or executing */
+    bool                           blocked;         /**< Flag indicating the work is deactivated, it is not executed anymore */
+    bool                           activated;       /**< Flag indicating the work is activated */
+    uint64_t                       deadline;        /**< Deadline of the periodic execution (microseconds of virtual uptime) */
+    uint64_t                       period;          /**< Period of the periodic execution (microseconds) */
+    uint64_t                       delay_deadline;  /**< Deadline of the execution once after a delay (microseconds of virtual uptime) */
+    mender_scheduler_work_queue_t *work_queue;      /**< Work queue executing the work, chosen according to the work priority */
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    mender_scheduler_work_stats_t  stats;           /**< Work statistics */
+    uint64_t                       submission_time; /**< Virtual uptime of the last submission of the work (microseconds) */
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    void                          *next;            /**< Next work of the list of the works */
+} mender_scheduler_work_context_t;
+
+/**
+ * @brief Mutex context
+ */
+typedef struct {
+    bool locked; /**< Flag indicating the mutex is taken */
+} mender_scheduler_mutex_context_t;
+
+/**
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;        /**< Task parameters */
+    pthread_t                      thread_handle; /**< Thread handle */
+    bool                           done;          /**< Flag indicating the task function has returned */
+} mender_scheduler_task_context_t;
+
+/**
+ * @brief Queue context
+ */
+typedef struct {
+    char  *buffer;    /**< Items of the queue */
+    size_t length;    /**< Maximum number of items in the queue */
+    size_t item_size; /**< Size of the items */
+    size_t first;     /**< Index of the first item in the queue */
+    size_t count;     /**< Number of items in the queue */
+} mender_scheduler_queue_context_t;
+
+/**
+ * @brief Waiter, a thread waiting on the virtual clock until it is woken up or until its deadline is reached
+ */
+typedef struct {
+    uint64_t deadline; /**< Deadline of the wait (microseconds of virtual uptime) */
+    bool     notified; /**< Flag indicating the waiter has been woken up, the clock does not move until it checks again its condition */
+    void    *next;     /**< Next waiter of the list of the waiters */
+} mender_scheduler_waiter_t;
+
+/**
+ * @brief Virtual clock, all the state of the scheduler is protected by its mutex
+ * @note The threads of the works and tasks are counted, the clock only jumps to the next deadline once none of them is running
+ */
+static struct {
+    pthread_mutex_t            mutex_handle; /**< Mutex protecting the scheduler */
+    pthread_cond_t             cond_handle;  /**< Condition broadcast on each change of the scheduler */
+    uint64_t                   now;          /**< Virtual uptime (microseconds), written with the mutex taken and read atomically */
+    uint64_t                   limit;        /**< Virtual uptime at which the clock stops (microseconds) */
+    bool                       stopped;      /**< Flag indicating the clock has reached its limit and that nothing is running */
+    size_t                     busy;         /**< Number of threads of the works and tasks which are running */
+    mender_scheduler_waiter_t *waiters;      /**< List of the waiters */
+    bool                       exit;         /**< Flag used to ask the work queue threads to terminate */
+} mender_scheduler_clock = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, false, 0, NULL, false };
+
+/**
+ * @brief Flag indicating the current thread executes works or a task, it is then counted by the virtual clock
+ */
+static __thread bool mender_scheduler_counted = false;
+
+/**
+ * @brief Work queue
+ */
+static mender_scheduler_work_queue_t mender_scheduler_work_queue;
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+
+/**
+ * @brief High priority work queue
+ */
+static mender_scheduler_work_queue_t mender_scheduler_high_priority_work_queue;
+
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+/**
+ * @brief List of the works, used to find the next deadline
+ */
+static mender_scheduler_work_context_t *mender_scheduler_work_list = NULL;
+
+/**
+ * @brief Function used to wait on the virtual clock, the mutex of the scheduler must be taken
+ * @note The caller checks again its condition when the function returns, the clock may jump meanwhile
+ * @param deadline Deadline of the wait (microseconds of virtual uptime), MENDER_SCHEDULER_NO_DEADLINE to wait without a timeout
+ * @return true if the deadline is not reached, false otherwise
+ */
+static bool mender_scheduler_wait(uint64_t deadline);
+
+/**
+ * @brief Function used to wake up all the waiters, the mutex of the scheduler must be taken
+ */
+static void mender_scheduler_notify(void);
+
+/**
+ * @brief Function used to move the virtual clock to the next deadline if none of the counted threads is running, the mutex of the scheduler must be taken
+ */
+static void mender_scheduler_advance(void);
+
+/**
+ * @brief Function used to submit the works which deadlines are reached, the mutex of the scheduler must be taken
+ * @return true if a work has been submitted, false otherwise
+ */
+static bool mender_scheduler_expire(void);
+
+/**
+ * @brief Function used to submit a work to its work queue, the mutex of the scheduler must be taken
+ * @param work_context Work context
+ * @return true if the work has been submitted, false otherwise
+ */
+static bool mender_scheduler_work_submit(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Work queue thread
+ * @param arg Work queue
+ * @return Not used
+ */
+static void *mender_scheduler_work_queue_thread(void *arg);
+
+/**
+ * @brief Function used to create a work queue and the thread executing its works
+ * @param work_queue Work queue
+ * @param length Maximum number of works in the work queue
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_scheduler_work_queue_create(mender_scheduler_work_queue_t *work_queue, size_t length);
+
+/**
+ * @brief Function used to execute earlier the works which periodic execution is due within their slack, the mutex of the scheduler must be taken
+ * @param work_context Work context being executed, NULL if none
+ */
+static void mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context);
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+/**
+ * @brief Function used to record the statistics of an execution of a work, the mutex of the scheduler must be taken
+ * @param work_context Work context
+ * @param start_time Virtual uptime at the beginning of the execution (microseconds)
+ * @param stop_time Virtual uptime at the end of the execution (microseconds)
+ */
+static void mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+/**
+ * @brief Task thread
+ * @param arg Task context
+ * @return Not used
+ */
+static void *mender_scheduler_task_thread(void *arg);
+
+/**
+ * @brief Function used to compute the deadline of a wait from a delay, the mutex of the scheduler must be taken
+ * @param delay_ms Delay (milliseconds), -1 to wait without a timeout
+ * @return Deadline (microseconds of virtual uptime)
+ */
+static uint64_t mender_scheduler_deadline(int32_t delay_ms);
+
+mender_err_t
+mender_scheduler_init(void) {
+
+    /* Create and start work queue */
+    if (MENDER_OK != mender_scheduler_work_queue_create(&mender_scheduler_work_queue, CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH)) {
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    /* Create and start high priority work queue */
+    if (MENDER_OK != mender_scheduler_work_queue_create(&mender_scheduler_high_priority_work_queue, CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE_LENGTH)) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void **handle) {
+
+    assert(NULL != work_params);
+    assert(NULL != work_params->function);
+    assert(NULL != work_params->name);
+    assert(NULL != handle);
+
+    /* Create work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_malloc(sizeof(mender_scheduler_work_context_t));
+    if (NULL == work_context) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
+
+    /* Copy work parameters */
+    work_context->params.function = work_params->function;
+    work_context->params.period   = work_params->period;
+    work_context->params.priority = work_params->priority;
+    work_context->params.slack    = work_params->slack;
+    if (NULL == (work_context->params.name = mender_strdup(work_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        mender_free(work_context);
+        return MENDER_FAIL;
+    }
+    work_context->deadline       = MENDER_SCHEDULER_NO_DEADLINE;
+    work_context->delay_deadline = MENDER_SCHEDULER_NO_DEADLINE;
+
+    /* Select the work queue according to the work priority */
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    if (MENDER_SCHEDULER_WORK_PRIORITY_HIGH == work_context->params.priority) {
+        work_context->work_queue = &mender_scheduler_high_priority_work_queue;
+    } else {
+        work_context->work_queue = &mender_scheduler_work_queue;
+    }
+#else
+    work_context->work_queue = &mender_scheduler_work_queue;
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+
+    /* Add the work to the list of the works */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    work_context->next         = mender_scheduler_work_list;
+    mender_scheduler_work_list = work_context;
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    /* Return handle to the new work */
+    *handle = (void *)work_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_activate(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+
+    /* Start the periodic execution and execute the work now */
+    work_context->blocked = false;
+    if (work_context->params.period > 0) {
+        work_context->period   = (uint64_t)work_context->params.period * 1000000;
+        work_context->deadline = mender_scheduler_clock.now + work_context->period;
+        mender_scheduler_work_submit(work_context);
+    }
+
+    /* Indicate the work has been activated */
+    work_context->activated = true;
+
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_set_period(void *handle, uint32_t period) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Restart or stop the periodic execution */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    work_context->params.period = period;
+    if (work_context->params.period > 0) {
+        work_context->period   = (uint64_t)work_context->params.period * 1000000;
+        work_context->deadline = mender_scheduler_clock.now + work_context->period;
+    } else {
+        work_context->deadline = MENDER_SCHEDULER_NO_DEADLINE;
+    }
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_execute(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Execute the work now */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_work_submit((mender_scheduler_work_context_t *)handle);
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_execute_after(void *handle, uint32_t delay_ms) {
+
+    assert(NULL != handle);
+
+    /* Execute the work now if there is no delay */
+    if (0 == delay_ms) {
+        return mender_scheduler_work_execute(handle);
+    }
+
+    return mender_scheduler_work_execute_at(handle, mender_scheduler_get_uptime_us() + (uint64_t)delay_ms * 1000);
+}
+
+mender_err_t
+mender_scheduler_work_execute_at(void *handle, uint64_t uptime_us) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Execute the work now if the deadline is reached, the delayed execution already scheduled is kept if it is nearer otherwise */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    if (uptime_us <= mender_scheduler_clock.now) {
+        mender_scheduler_work_submit(work_context);
+    } else if (uptime_us < work_context->delay_deadline) {
+        work_context->delay_deadline = uptime_us;
+    }
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_deactivate(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+
+    /* Check if the work was activated */
+    if (true == work_context->activated) {
+
+        /* Stop the executions of the work */
+        work_context->deadline       = MENDER_SCHEDULER_NO_DEADLINE;
+        work_context->delay_deadline = MENDER_SCHEDULER_NO_DEADLINE;
+
+        /* Wait if the work is pending or executing */
+        while (true == work_context->pending) {
+            mender_scheduler_wait(MENDER_SCHEDULER_NO_DEADLINE);
+        }
+        work_context->blocked = true;
+
+        /* Indicate the work has been deactivated */
+        work_context->activated = false;
+    }
+
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Remove the work from the list of the works */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_work_context_t **item = &mender_scheduler_work_list;
+    while ((NULL != *item) && (work_context != *item)) {
+        item = (mender_scheduler_work_context_t **)&(*item)->next;
+    }
+    if (NULL != *item) {
+        *item = (mender_scheduler_work_context_t *)work_context->next;
+    }
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    /* Release memory */
+    mender_free(work_context->params.name);
+    mender_free(work_context);
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+mender_err_t
+mender_scheduler_work_get_stats(void *handle, mender_scheduler_work_stats_t *stats) {
+
+    assert(NULL != handle);
+    assert(NULL != stats);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Copy work statistics */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    memcpy(stats, &work_context->stats, sizeof(mender_scheduler_work_stats_t));
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+mender_err_t
+mender_scheduler_mutex_create(void **handle) {
+
+    assert(NULL != handle);
+
+    /* Create mutex context */
+    mender_scheduler_mutex_context_t *mutex_context = (mender_scheduler_mutex_context_t *)mender_malloc(sizeof(mender_scheduler_mutex_context_t));
+    if (NULL == mutex_context) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    mutex_context->locked = false;
+
+    /* Return handle to the new mutex */
+    *handle = (void *)mutex_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_mutex_take(void *handle, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get mutex context */
+    mender_scheduler_mutex_context_t *mutex_context = (mender_scheduler_mutex_context_t *)handle;
+
+    /* Wait for the mutex to be given, the delay is counted by the virtual clock */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    uint64_t deadline = mender_scheduler_deadline(delay_ms);
+    while (true == mutex_context->locked) {
+        if (false == mender_scheduler_wait(deadline)) {
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+    mutex_context->locked = true;
+
+END:
+
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_mutex_give(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get mutex context */
+    mender_scheduler_mutex_context_t *mutex_context = (mender_scheduler_mutex_context_t *)handle;
+
+    /* Give the mutex and wake up the waiters */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mutex_context->locked = false;
+    mender_scheduler_notify();
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_mutex_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Release memory */
+    mender_free(handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+    int ret;
+
+    /* Create task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+
+    /* Copy task parameters */
+    task_context->params.function   = task_params->function;
+    task_context->params.arg        = task_params->arg;
+    task_context->params.stack_size = task_params->stack_size;
+    task_context->params.priority   = task_params->priority;
+    if (NULL == (task_context->params.name = mender_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        mender_free(task_context);
+        return MENDER_FAIL;
+    }
+
+    /* Create and start thread, it is counted from now so that the clock does not jump before it runs */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_clock.busy++;
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+    if (0 != (ret = pthread_create(&task_context->thread_handle, NULL, mender_scheduler_task_thread, task_context))) {
+        mender_log_error("Unable to create thread (ret=%d)", ret);
+        pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+        mender_scheduler_clock.busy--;
+        mender_scheduler_advance();
+        pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+        mender_free(task_context->params.name);
+        mender_free(task_context);
+        return MENDER_FAIL;
+    }
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+    int ret;
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait for the end of the task function on the virtual clock, the thread terminates right after */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    while (true != task_context->done) {
+        mender_scheduler_wait(MENDER_SCHEDULER_NO_DEADLINE);
+    }
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+    if (0 != (ret = pthread_join(task_context->thread_handle, NULL))) {
+        mender_log_error("Unable to join thread (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+
+    /* Release memory */
+    mender_free(task_context->params.name);
+    mender_free(task_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 < length);
+    assert(0 < item_size);
+    assert(NULL != handle);
+
+    /* Create queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_malloc(sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memset(queue_context, 0, sizeof(mender_scheduler_queue_context_t));
+    if (NULL == (queue_context->buffer = (char *)mender_malloc(length * item_size))) {
+        mender_log_error("Unable to allocate memory");
+        mender_free(queue_context);
+        return MENDER_FAIL;
+    }
+    queue_context->length    = length;
+    queue_context->item_size = item_size;
+
+    /* Return handle to the new queue */
+    *handle = (void *)queue_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Wait for free space in the queue, the delay is counted by the virtual clock */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    uint64_t deadline = mender_scheduler_deadline(delay_ms);
+    while (queue_context->count >= queue_context->length) {
+        if (false == mender_scheduler_wait(deadline)) {
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+
+    /* Copy the item at the end of the queue and wake up the receivers */
+    memcpy(&queue_context->buffer[((queue_context->first + queue_context->count) % queue_context->length) * queue_context->item_size],
+           item,
+           queue_context->item_size);
+    queue_context->count++;
+    mender_scheduler_notify();
+
+END:
+
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Wait for an item in the queue, the delay is counted by the virtual clock */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    uint64_t deadline = mender_scheduler_deadline(delay_ms);
+    while (0 == queue_context->count) {
+        if (false == mender_scheduler_wait(deadline)) {
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+
+    /* Copy the first item of the queue and wake up the senders */
+    memcpy(item, &queue_context->buffer[queue_context->first * queue_context->item_size], queue_context->item_size);
+    queue_context->first = (queue_context->first + 1) % queue_context->length;
+    queue_context->count--;
+    mender_scheduler_notify();
+
+END:
+
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Release memory */
+    mender_free(queue_context->buffer);
+    mender_free(queue_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_notify_wakeup(void) {
+
+    /* Execute the works which periodic execution is due within their slack */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_work_coalesce(NULL);
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+uint64_t
+mender_scheduler_get_uptime_us(void) {
+
+    /* Read virtual clock, without the mutex of the scheduler because the logs are timestamped while it is taken */
+    return __atomic_load_n(&mender_scheduler_clock.now, __ATOMIC_ACQUIRE);
+}
+
+void
+mender_scheduler_yield(uint32_t delay_ms) {
+
+    /* Yield to the other threads, or sleep on the virtual clock */
+    if (0 == delay_ms) {
+        sched_yield();
+    } else {
+        pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+        uint64_t deadline = mender_scheduler_clock.now + (uint64_t)delay_ms * 1000;
+        while (true == mender_scheduler_wait(deadline)) {
+            /* Woken up before the deadline */
+        }
+        pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+    }
+}
+
+mender_err_t
+mender_scheduler_exit(void) {
+
+    /* Ask the work queue threads to terminate and wait end of their execution */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_clock.exit = true;
+    mender_scheduler_notify();
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+    pthread_join(mender_scheduler_work_queue.thread_handle, NULL);
+    mender_free(mender_scheduler_work_queue.works);
+    mender_scheduler_work_queue.works = NULL;
+#ifdef CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE
+    pthread_join(mender_scheduler_high_priority_work_queue.thread_handle, NULL);
+    mender_free(mender_scheduler_high_priority_work_queue.works);
+    mender_scheduler_high_priority_work_queue.works = NULL;
+#endif /* CONFIG_MENDER_SCHEDULER_HIGH_PRIORITY_WORK_QUEUE */
+    mender_scheduler_clock.exit = false;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_virtual_run(uint64_t duration_us) {
+
+    /* The simulation is driven from a thread which is not counted, it would never let the clock move otherwise */
+    if (true == mender_scheduler_counted) {
+        mender_log_error("Unable to run the simulation from a work or a task");
+        return MENDER_FAIL;
+    }
+
+    /* Move the limit of the clock and wait for it to be reached with nothing running */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_clock.limit   = mender_scheduler_clock.now + duration_us;
+    mender_scheduler_clock.stopped = false;
+    mender_scheduler_advance();
+    while (true != mender_scheduler_clock.stopped) {
+        pthread_cond_wait(&mender_scheduler_clock.cond_handle, &mender_scheduler_clock.mutex_handle);
+    }
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return MENDER_OK;
+}
+
+static bool
+mender_scheduler_wait(uint64_t deadline) {
+
+    mender_scheduler_waiter_t waiter;
+
+    /* Check if the deadline is already reached */
+    if (deadline <= mender_scheduler_clock.now) {
+        return false;
+    }
+
+    /* Register the waiter so that its deadline is taken into account, the clock may jump once the thread is not running anymore */
+    waiter.deadline                = deadline;
+    waiter.notified                = false;
+    waiter.next                    = mender_scheduler_clock.waiters;
+    mender_scheduler_clock.waiters = &waiter;
+    if (true == mender_scheduler_counted) {
+        mender_scheduler_clock.busy--;
+    }
+    mender_scheduler_advance();
+
+    /* Wait to be woken up, the thread may have woken up itself while moving the clock */
+    while (true != waiter.notified) {
+        pthread_cond_wait(&mender_scheduler_clock.cond_handle, &mender_scheduler_clock.mutex_handle);
+    }
+    if (true == mender_scheduler_counted) {
+        mender_scheduler_clock.busy++;
+    }
+
+    /* Remove the waiter */
+    mender_scheduler_waiter_t **item = &mender_scheduler_clock.waiters;
+    while (&waiter != *item) {
+        item = (mender_scheduler_waiter_t **)&(*item)->next;
+    }
+    *item = (mender_scheduler_waiter_t *)waiter.next;
+
+    return (deadline > mender_scheduler_clock.now);
+}
+
+static void
+mender_scheduler_notify(void) {
+
+    /* Wake up all the waiters, they check again their condition */
+    for (mender_scheduler_waiter_t *waiter = mender_scheduler_clock.waiters; NULL != waiter; waiter = (mender_scheduler_waiter_t *)waiter->next) {
+        waiter->notified = true;
+    }
+    pthread_cond_broadcast(&mender_scheduler_clock.cond_handle);
+}
+
+static void
+mender_scheduler_advance(void) {
+
+    /* Nothing to do while a counted thread is running or while a waiter has not checked again its condition, they may change the deadlines */
+    if (0 != mender_scheduler_clock.busy) {
+        return;
+    }
+    for (mender_scheduler_waiter_t *waiter = mender_scheduler_clock.waiters; NULL != waiter; waiter = (mender_scheduler_waiter_t *)waiter->next) {
+        if (true == waiter->notified) {
+            return;
+        }
+    }
+
+    for (;;) {
+
+        /* Find the next deadline, the clock stops at its limit */
+        uint64_t next = mender_scheduler_clock.limit;
+        for (mender_scheduler_work_context_t *item = mender_scheduler_work_list; NULL != item; item = (mender_scheduler_work_context_t *)item->next) {
+            if (item->deadline < next) {
+                next = item->deadline;
+            }
+            if (item->delay_deadline < next) {
+                next = item->delay_deadline;
+            }
+        }
+        for (mender_scheduler_waiter_t *waiter = mender_scheduler_clock.waiters; NULL != waiter; waiter = (mender_scheduler_waiter_t *)waiter->next) {
+            if (waiter->deadline < next) {
+                next = waiter->deadline;
+            }
+        }
+        if (MENDER_SCHEDULER_NO_DEADLINE == next) {
+            return;
+        }
+
+        /* Jump to the next deadline, the clock never goes backward */
+        if (next > mender_scheduler_clock.now) {
+            __atomic_store_n(&mender_scheduler_clock.now, next, __ATOMIC_RELEASE);
+        }
+
+        /* Wake up the threads if a work has been submitted or if a wait has timed out */
+        bool woken = mender_scheduler_expire();
+        for (mender_scheduler_waiter_t *waiter = mender_scheduler_clock.waiters; NULL != waiter; waiter = (mender_scheduler_waiter_t *)waiter->next) {
+            if (waiter->deadline <= mender_scheduler_clock.now) {
+                woken = true;
+            }
+        }
+        if (true == woken) {
+            mender_scheduler_notify();
+            return;
+        }
+
+        /* Indicate the limit is reached once, the simulation is waiting for it */
+        if (mender_scheduler_clock.now >= mender_scheduler_clock.limit) {
+            if (true != mender_scheduler_clock.stopped) {
+                mender_scheduler_clock.stopped = true;
+                mender_scheduler_notify();
+            }
+            return;
+        }
+    }
+}
+
+static bool
+mender_scheduler_expire(void) {
+
+    bool submitted = false;
+
+    /* Parse the list of the works */
+    for (mender_scheduler_work_context_t *item = mender_scheduler_work_list; NULL != item; item = (mender_scheduler_work_context_t *)item->next) {
+
+        /* Periodic execution, the next deadline is computed from the current one to avoid drifting */
+        if (item->deadline <= mender_scheduler_clock.now) {
+            item->deadline += item->period;
+            if (item->deadline <= mender_scheduler_clock.now) {
+                item->deadline = mender_scheduler_clock.now + item->period;
+            }
+            submitted |= mender_scheduler_work_submit(item);
+        }
+
+        /* Execution once after a delay */
+        if (item->delay_deadline <= mender_scheduler_clock.now) {
+            item->delay_deadline = MENDER_SCHEDULER_NO_DEADLINE;
+            submitted |= mender_scheduler_work_submit(item);
+        }
+    }
+
+    return submitted;
+}
+
+static bool
+mender_scheduler_work_submit(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+    mender_scheduler_work_queue_t *work_queue = work_context->work_queue;
+
+    /* Exit if the work is already pending or executing */
+    if ((true == work_context->pending) || (true == work_context->blocked)) {
+        mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        if (true == work_context->activated) {
+            work_context->stats.overruns++;
+        }
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+        return false;
+    }
+
+    /* Submit the work to the work queue, without waiting if the work queue is full */
+    if (work_queue->count >= work_queue->length) {
+        mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        work_context->stats.losses++;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+        return false;
+    }
+    work_queue->works[(work_queue->first + work_queue->count) % work_queue->length] = work_context;
+    work_queue->count++;
+    work_context->pending = true;
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+    work_context->submission_time = mender_scheduler_clock.now;
+    if (work_queue->count > work_context->stats.queue_high_water_mark) {
+        work_context->stats.queue_high_water_mark = (uint32_t)work_queue->count;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+    mender_scheduler_notify();
+
+    return true;
+}
+
+static mender_err_t
+mender_scheduler_work_queue_create(mender_scheduler_work_queue_t *work_queue, size_t length) {
+
+    assert(NULL != work_queue);
+    int ret;
+
+    /* Create work queue */
+    memset(work_queue, 0, sizeof(mender_scheduler_work_queue_t));
+    if (NULL == (work_queue->works = (void **)mender_malloc(length * sizeof(void *)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    work_queue->length = length;
+
+    /* Create and start work queue thread, it is counted from now so that the clock does not jump before it runs */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    mender_scheduler_clock.busy++;
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+    if (0 != (ret = pthread_create(&work_queue->thread_handle, NULL, mender_scheduler_work_queue_thread, work_queue))) {
+        mender_log_error("Unable to create work queue thread (ret=%d)", ret);
+        pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+        mender_scheduler_clock.busy--;
+        mender_scheduler_advance();
+        pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+        mender_free(work_queue->works);
+        work_queue->works = NULL;
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static void *
+mender_scheduler_work_queue_thread(void *arg) {
+
+    assert(NULL != arg);
+    mender_scheduler_work_queue_t *work_queue = (mender_scheduler_work_queue_t *)arg;
+
+    mender_scheduler_counted = true;
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+
+    /* Handle work to be executed */
+    for (;;) {
+
+        /* Wait for a work, the work queue thread terminates once the work queue is empty */
+        while ((0 == work_queue->count) && (true != mender_scheduler_clock.exit)) {
+            mender_scheduler_wait(MENDER_SCHEDULER_NO_DEADLINE);
+        }
+        if (0 == work_queue->count) {
+            goto END;
+        }
+        mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)work_queue->works[work_queue->first];
+        work_queue->first = (work_queue->first + 1) % work_queue->length;
+        work_queue->count--;
+
+        /* Execute together the other works which periodic execution is due within their slack, the device is awake anyway */
+        mender_scheduler_work_coalesce(work_context);
+
+        /* Call work function, the clock only moves if the work waits on the scheduler */
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        uint64_t start_time = mender_scheduler_clock.now;
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+        pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+        mender_err_t ret = work_context->params.function();
+        pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+        /* Record the statistics of the execution */
+        mender_scheduler_work_stats_record(work_context, start_time, mender_scheduler_clock.now);
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+        if (MENDER_DONE == ret) {
+
+            /* Work is done, stop the periodic execution */
+            work_context->deadline = MENDER_SCHEDULER_NO_DEADLINE;
+        }
+
+        /* Indicate the work is not pending anymore */
+        work_context->pending = false;
+        mender_scheduler_notify();
+    }
+
+END:
+
+    /* Terminate work queue thread */
+    mender_scheduler_clock.busy--;
+    mender_scheduler_advance();
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return NULL;
+}
+
+static void
+mender_scheduler_work_coalesce(mender_scheduler_work_context_t *work_context) {
+
+    /* Parse the list of the works */
+    for (mender_scheduler_work_context_t *item = mender_scheduler_work_list; NULL != item; item = (mender_scheduler_work_context_t *)item->next) {
+
+        /* Check if the periodic execution of the work is due within its slack */
+        if ((work_context != item) && (0 != item->params.slack) && (MENDER_SCHEDULER_NO_DEADLINE != item->deadline)
+            && (item->deadline <= mender_scheduler_clock.now + item->period * item->params.slack / 100)) {
+
+            /* Restart the periodic execution and execute the work now */
+            mender_log_debug("Work '%s' is executed earlier within its slack", item->params.name);
+            item->deadline = mender_scheduler_clock.now + item->period;
+            mender_scheduler_work_submit(item);
+        }
+    }
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_WORK_STATISTICS
+
+static void
+mender_scheduler_work_stats_record(mender_scheduler_work_context_t *work_context, uint64_t start_time, uint64_t stop_time) {
+
+    assert(NULL != work_context);
+    uint64_t run_time = stop_time - start_time;
+    uint64_t latency  = start_time - work_context->submission_time;
+    size_t   index    = 0;
+
+    /* Update the number of executions, the run time and the start latency of the work */
+    work_context->stats.executions++;
+    work_context->stats.run_time_total_us += run_time;
+    if (run_time > work_context->stats.run_time_max_us) {
+        work_context->stats.run_time_max_us = (uint32_t)run_time;
+    }
+    work_context->stats.latency_total_us += latency;
+    if (latency > work_context->stats.latency_max_us) {
+        work_context->stats.latency_max_us = (uint32_t)latency;
+    }
+
+    /* Update the run time histogram, the bucket is given by the number of significant bits of the run time in milliseconds */
+    for (uint64_t value = run_time / 1000; (value > 0) && (index < MENDER_SCHEDULER_WORK_STATISTICS_BUCKET_COUNT - 1); value >>= 1) {
+        index++;
+    }
+    work_context->stats.run_time_histogram[index]++;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_STATISTICS */
+
+static void *
+mender_scheduler_task_thread(void *arg) {
+
+    assert(NULL != arg);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)arg;
+
+    /* Call task function, the thread has been counted on its creation */
+    mender_scheduler_counted = true;
+    task_context->params.function(task_context->params.arg);
+
+    /* Indicate the task is done and terminate the thread */
+    pthread_mutex_lock(&mender_scheduler_clock.mutex_handle);
+    task_context->done = true;
+    mender_scheduler_clock.busy--;
+    mender_scheduler_notify();
+    mender_scheduler_advance();
+    pthread_mutex_unlock(&mender_scheduler_clock.mutex_handle);
+
+    return NULL;
+}
+
+static uint64_t
+mender_scheduler_deadline(int32_t delay_ms) {
+
+    /* Wait without a timeout if the delay is negative */
+    if (delay_ms < 0) {
+        return MENDER_SCHEDULER_NO_DEADLINE;
+    }
+
+    return mender_scheduler_clock.now + (uint64_t)delay_ms * 1000;
+}
@@ -5,8 +5,14 @@
 #include <stddef.h>
 #include <stdint.h>
 
+struct stream_flash_ctx {
+    size_t buf_len;
+    size_t buf_bytes;
+    size_t bytes_written;
+};
+
 struct flash_img_context {
-    void *dummy;
+    struct stream_flash_ctx stream;
 };
 
 int flash_img_init(struct flash_img_context *ctx);
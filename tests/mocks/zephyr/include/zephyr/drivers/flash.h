@@ -7,6 +7,7 @@
 #include <zephyr/device.h>
 
 struct flash_pages_info {
+    off_t    start_offset;
     size_t   size;
     uint32_t index;
 };
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/sys_clock.h>
 
@@ -32,6 +33,9 @@ struct k_work_queue_config {
 struct k_work_q {
     void *dummy;
 };
+struct k_msgq {
+    void *dummy;
+};
 
 typedef struct k_thread *k_tid_t;
 
@@ -51,7 +55,10 @@ typedef void (*k_work_handler_t)(struct k_work *work);
 
 #define K_MSEC(ms) ((k_timeout_t) { .ticks = (ms) })
 
-#define K_THREAD_STACK_DEFINE(sym, size) k_thread_stack_t *sym;
+#define K_THREAD_STACK_DEFINE(sym, size)              k_thread_stack_t *sym;
+#define K_THREAD_STACK_ARRAY_DEFINE(sym, nmemb, size) k_thread_stack_t sym[nmemb][size];
+
+#define K_MUTEX_DEFINE(name) struct k_mutex name
 
 k_tid_t k_thread_create(struct k_thread * new_thread,
                         k_thread_stack_t *stack,
@@ -67,6 +74,13 @@ int     k_thread_join(struct k_thread *thread, k_timeout_t timeout);
 int     k_thread_name_set(k_tid_t thread, const char *str);
 void    k_thread_abort(k_tid_t thread);
 
+k_thread_stack_t *k_thread_stack_alloc(size_t size, int flags);
+int               k_thread_stack_free(k_thread_stack_t *stack);
+
+void k_msgq_init(struct k_msgq *msgq, char *buffer, size_t msg_size, uint32_t max_msgs);
+int  k_msgq_put(struct k_msgq *msgq, const void *data, k_timeout_t timeout);
+int  k_msgq_get(struct k_msgq *msgq, void *data, k_timeout_t timeout);
+
 int k_mutex_init(struct k_mutex *mutex);
 int k_mutex_lock(struct k_mutex *mutex, k_timeout_t timeout);
 int k_mutex_unlock(struct k_mutex *mutex);
@@ -75,11 +89,12 @@ int  k_sem_init(struct k_sem *sem, unsigned int initial_count, unsigned int limi
 int  k_sem_take(struct k_sem *sem, k_timeout_t timeout);
 void k_sem_give(struct k_sem *sem);
 
-void  k_timer_init(struct k_timer *timer, k_timer_expiry_t expiry_fn, k_timer_stop_t stop_fn);
-void  k_timer_user_data_set(struct k_timer *timer, void *user_data);
-void *k_timer_user_data_get(const struct k_timer *timer);
-void  k_timer_start(struct k_timer *timer, k_timeout_t duration, k_timeout_t period);
-void  k_timer_stop(struct k_timer *timer);
+void     k_timer_init(struct k_timer *timer, k_timer_expiry_t expiry_fn, k_timer_stop_t stop_fn);
+void     k_timer_user_data_set(struct k_timer *timer, void *user_data);
+void    *k_timer_user_data_get(const struct k_timer *timer);
+void     k_timer_start(struct k_timer *timer, k_timeout_t duration, k_timeout_t period);
+void     k_timer_stop(struct k_timer *timer);
+uint32_t k_timer_remaining_get(struct k_timer *timer);
 
 void k_work_init(struct k_work *work, k_work_handler_t handler);
 void k_work_init_delayable(struct k_work_delayable *dwork, k_work_handler_t handler);
@@ -92,6 +107,8 @@ void    k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack, size
 k_tid_t k_work_queue_thread_get(struct k_work_q *queue);
 
 int64_t k_uptime_get(void);
+int64_t k_uptime_ticks(void);
 int32_t k_msleep(int32_t ms);
+void    k_yield(void);
 
 #endif /* __KERNEL_H__ */
@@ -4,6 +4,7 @@
 #include <zephyr/logging/log_core.h>
 
 #define LOG_MODULE_REGISTER(...)
+#define LOG_MODULE_DECLARE(...)
 
 #define LOG_ERR(...) printf(__VA_ARGS__)
 #define LOG_WRN(...) printf(__VA_ARGS__)
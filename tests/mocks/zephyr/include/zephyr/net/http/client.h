@@ -48,33 +48,65 @@ enum http_final_call {
 struct http_response {
     uint8_t *body_frag_start;
     size_t   body_frag_len;
+    size_t   content_length;
     uint16_t http_status_code;
+    uint8_t  cl_present : 1;
     uint8_t  body_found : 1;
+    uint8_t  message_complete : 1;
+};
+
+struct http_parser {
+    unsigned int flags : 8;
+};
+
+typedef int (*http_data_cb)(struct http_parser *parser, const char *at, size_t length);
+typedef int (*http_cb)(struct http_parser *parser);
+
+struct http_parser_settings {
+    http_cb      on_message_begin;
+    http_data_cb on_url;
+    http_data_cb on_status;
+    http_data_cb on_header_field;
+    http_data_cb on_header_value;
+    http_cb      on_headers_complete;
+    http_data_cb on_body;
+    http_cb      on_message_complete;
+    http_cb      on_chunk_header;
+    http_cb      on_chunk_complete;
 };
 
 struct http_client_internal_data {
+    struct http_parser   parser;
     struct http_response response;
+    void *               user_data;
 };
 
+struct http_request;
+
 typedef void (*http_response_cb_t)(struct http_response *rsp, enum http_final_call final_data, void *user_data);
+typedef int (*http_payload_cb_t)(int sock, struct http_request *req, void *user_data);
 
 struct http_request {
-    struct http_client_internal_data internal;
-    enum http_method                 method;
-    http_response_cb_t               response;
-    uint8_t *                        recv_buf;
-    size_t                           recv_buf_len;
-    const char *                     url;
-    const char *                     protocol;
-    const char **                    header_fields;
-    const char *                     host;
-    const char *                     port;
-    const char *                     payload;
-    size_t                           payload_len;
+    struct http_client_internal_data    internal;
+    enum http_method                    method;
+    http_response_cb_t                  response;
+    const struct http_parser_settings * http_cb;
+    uint8_t *                           recv_buf;
+    size_t                              recv_buf_len;
+    const char *                        url;
+    const char *                        protocol;
+    const char **                       header_fields;
+    const char *                        host;
+    const char *                        port;
+    const char *                        payload;
+    http_payload_cb_t                   payload_cb;
+    size_t                              payload_len;
 };
 
 typedef int (*http_header_cb_t)(int sock, struct http_request *req, void *user_data);
 
 int http_client_req(int sock, struct http_request *req, int32_t timeout, void *user_data);
 
+int http_should_keep_alive(const struct http_parser *parser);
+
 #endif /* __CLIENT_H__ */
@@ -3,10 +3,12 @@
 
 #include <stddef.h>
 
-#define AF_INET  1
-#define AF_INET6 2
+#define AF_UNSPEC 0
+#define AF_INET   1
+#define AF_INET6  2
 
-typedef size_t socklen_t;
+typedef size_t         socklen_t;
+typedef unsigned short sa_family_t;
 
 enum net_ip_protocol {
     IPPROTO_IP     = 0,
@@ -31,7 +33,8 @@ enum net_ip_protocol_secure {
 enum net_sock_type { SOCK_STREAM = 1, SOCK_DGRAM, SOCK_RAW };
 
 struct sockaddr {
-    void *dummy;
+    sa_family_t sa_family;
+    char        data[22];
 };
 
 #endif /* __NET_IP_H__ */
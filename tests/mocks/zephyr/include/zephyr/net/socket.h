@@ -1,27 +1,64 @@
 #ifndef __SOCKET_H__
 #define __SOCKET_H__
 
+#include <sys/types.h>
 #include <zephyr/net/net_ip.h>
 #include <zephyr/sys/util_macro.h>
 
-#define SOL_TLS          282
-#define TLS_SEC_TAG_LIST 1
-#define TLS_HOSTNAME     2
-#define TLS_PEER_VERIFY  5
+#define SOL_TLS           282
+#define TLS_SEC_TAG_LIST  1
+#define TLS_HOSTNAME      2
+#define TLS_PEER_VERIFY   5
+#define TLS_SESSION_CACHE 12
+
+#define TLS_SESSION_CACHE_DISABLED 0
+#define TLS_SESSION_CACHE_ENABLED  1
+
+#define SOL_SOCKET   1
+#define SO_ERROR     4
+#define SO_RCVBUF    8
+#define SO_KEEPALIVE 9
+#define SO_RCVTIMEO  20
+
+#define TCP_NODELAY  1
+#define TCP_KEEPIDLE 2
+
+#define ZSOCK_POLLIN    1
+#define ZSOCK_POLLOUT   4
+#define ZSOCK_POLLERR   8
+#define ZSOCK_POLLHUP   16
+#define ZSOCK_SHUT_RDWR 2
 
 struct zsock_addrinfo {
-    int              ai_family;
-    int              ai_socktype;
-    int              ai_protocol;
-    socklen_t        ai_addrlen;
-    struct sockaddr *ai_addr;
+    struct zsock_addrinfo *ai_next;
+    int                    ai_family;
+    int                    ai_socktype;
+    int                    ai_protocol;
+    socklen_t              ai_addrlen;
+    struct sockaddr       *ai_addr;
+};
+
+struct zsock_timeval {
+    long tv_sec;
+    long tv_usec;
+};
+
+struct zsock_pollfd {
+    int   fd;
+    short events;
+    short revents;
 };
 
-int  zsock_socket(int family, int type, int proto);
-int  zsock_connect(int sock, const struct sockaddr *addr, socklen_t addrlen);
-int  zsock_setsockopt(int sock, int level, int optname, const void *optval, socklen_t optlen);
-int  zsock_getaddrinfo(const char *host, const char *service, const struct zsock_addrinfo *hints, struct zsock_addrinfo **res);
-void zsock_freeaddrinfo(struct zsock_addrinfo *ai);
-int  zsock_close(int sock);
+int     zsock_socket(int family, int type, int proto);
+int     zsock_connect(int sock, const struct sockaddr *addr, socklen_t addrlen);
+int     zsock_setsockopt(int sock, int level, int optname, const void *optval, socklen_t optlen);
+int     zsock_getsockopt(int sock, int level, int optname, void *optval, socklen_t *optlen);
+int     zsock_fcntl(int sock, int cmd, int flags);
+int     zsock_getaddrinfo(const char *host, const char *service, const struct zsock_addrinfo *hints, struct zsock_addrinfo **res);
+void    zsock_freeaddrinfo(struct zsock_addrinfo *ai);
+ssize_t zsock_send(int sock, const void *buf, size_t len, int flags);
+int     zsock_poll(struct zsock_pollfd *fds, int nfds, int timeout);
+int     zsock_shutdown(int sock, int how);
+int     zsock_close(int sock);
 
 #endif /* __SOCKET_H__ */
@@ -1,7 +1,27 @@
 #ifndef __FLASH_MAP_H__
 #define __FLASH_MAP_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define FIXED_PARTITION_EXISTS(label) 1
+#define FIXED_PARTITION_ID(label)     0
 #define FIXED_PARTITION_OFFSET(label) 0
 #define FIXED_PARTITION_DEVICE(label) NULL
 
+struct flash_area {
+    uint8_t fa_id;
+    off_t   fa_off;
+    size_t  fa_size;
+};
+
+int      flash_area_open(uint8_t id, const struct flash_area **fa);
+int      flash_area_read(const struct flash_area *fa, off_t off, void *dst, size_t len);
+int      flash_area_write(const struct flash_area *fa, off_t off, const void *src, size_t len);
+int      flash_area_erase(const struct flash_area *fa, off_t off, size_t len);
+uint32_t flash_area_align(const struct flash_area *fa);
+uint8_t  flash_area_erased_val(const struct flash_area *fa);
+void     flash_area_close(const struct flash_area *fa);
+
 #endif /* __FLASH_MAP_H__ */
@@ -0,0 +1,12 @@
+#ifndef __ATOMIC_H__
+#define __ATOMIC_H__
+
+typedef long     atomic_t;
+typedef atomic_t atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+atomic_val_t atomic_inc(atomic_t *target);
+atomic_val_t atomic_dec(atomic_t *target);
+
+#endif /* __ATOMIC_H__ */
@@ -14,5 +14,7 @@ void     ring_buf_reset(struct ring_buf *buf);
 uint32_t ring_buf_size_get(struct ring_buf *buf);
 uint32_t ring_buf_put(struct ring_buf *buf, const uint8_t *data, uint32_t size);
 uint32_t ring_buf_get(struct ring_buf *buf, uint8_t *data, uint32_t size);
+uint32_t ring_buf_get_claim(struct ring_buf *buf, uint8_t **data, uint32_t size);
+int      ring_buf_get_finish(struct ring_buf *buf, uint32_t size);
 
 #endif /* __RING_BUFFER_H__ */
@@ -3,4 +3,6 @@
 
 #define SYS_FOREVER_MS (-1)
 
+#define k_ticks_to_us_floor64(t) ((uint64_t)(t))
+
 #endif /* __TIME_UNITS_H__ */
@@ -0,0 +1,8 @@
+#ifndef __TRACING_H__
+#define __TRACING_H__
+
+#include <stdint.h>
+
+void sys_trace_named_event(const char *name, uint32_t arg0, uint32_t arg1);
+
+#endif /* __TRACING_H__ */
@@ -0,0 +1,38 @@
+#include <zephyr/storage/flash_map.h>
+
+static const struct flash_area flash_area = { .fa_id = 0, .fa_off = 0, .fa_size = 0x100000 };
+
+int
+flash_area_open(uint8_t id, const struct flash_area **fa) {
+    *fa = &flash_area;
+    return 0;
+}
+
+int
+flash_area_read(const struct flash_area *fa, off_t off, void *dst, size_t len) {
+    return 0;
+}
+
+int
+flash_area_write(const struct flash_area *fa, off_t off, const void *src, size_t len) {
+    return 0;
+}
+
+int
+flash_area_erase(const struct flash_area *fa, off_t off, size_t len) {
+    return 0;
+}
+
+uint32_t
+flash_area_align(const struct flash_area *fa) {
+    return 4;
+}
+
+uint8_t
+flash_area_erased_val(const struct flash_area *fa) {
+    return 0xff;
+}
+
+void
+flash_area_close(const struct flash_area *fa) {
+}
@@ -4,3 +4,8 @@ int
 http_client_req(int sock, struct http_request *req, int32_t timeout, void *user_data) {
     return 0;
 }
+
+int
+http_should_keep_alive(const struct http_parser *parser) {
+    return 0;
+}
@@ -28,6 +28,30 @@ void
 k_thread_abort(k_tid_t thread) {
 }
 
+k_thread_stack_t *
+k_thread_stack_alloc(size_t size, int flags) {
+    return NULL;
+}
+
+int
+k_thread_stack_free(k_thread_stack_t *stack) {
+    return 0;
+}
+
+void
+k_msgq_init(struct k_msgq *msgq, char *buffer, size_t msg_size, uint32_t max_msgs) {
+}
+
+int
+k_msgq_put(struct k_msgq *msgq, const void *data, k_timeout_t timeout) {
+    return 0;
+}
+
+int
+k_msgq_get(struct k_msgq *msgq, void *data, k_timeout_t timeout) {
+    return 0;
+}
+
 int
 k_mutex_init(struct k_mutex *mutex) {
     return 0;
@@ -78,6 +102,11 @@ void
 k_timer_stop(struct k_timer *timer) {
 }
 
+uint32_t
+k_timer_remaining_get(struct k_timer *timer) {
+    return 0;
+}
+
 void
 k_work_init(struct k_work *work, k_work_handler_t handler) {
 }
@@ -119,6 +148,11 @@ k_uptime_get(void) {
     return 0;
 }
 
+int64_t
+k_uptime_ticks(void) {
+    return 0;
+}
+
 int32_t
 k_msleep(int32_t ms) {
     return 0;
@@ -27,3 +27,13 @@ uint32_t
 ring_buf_get(struct ring_buf *buf, uint8_t *data, uint32_t size) {
     return 0;
 }
+
+uint32_t
+ring_buf_get_claim(struct ring_buf *buf, uint8_t **data, uint32_t size) {
+    return 0;
+}
+
+int
+ring_buf_get_finish(struct ring_buf *buf, uint32_t size) {
+    return 0;
+}
@@ -0,0 +1,5 @@
+#include <zephyr/tracing/tracing.h>
+
+void
+sys_trace_named_event(const char *name, uint32_t arg0, uint32_t arg1) {
+}
@@ -0,0 +1,179 @@
+/**
+ * @file      main.c
+ * @brief     Simulation application, the client runs on the virtual clock of the scheduler mock so that days of polling are checked in a few milliseconds
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mender-client.h"
+#include "mender-scheduler-virtual.h"
+#include "mender-storage.h"
+#include "mender-tls.h"
+
+/**
+ * @brief Duration of the simulation (microseconds)
+ */
+#define SIMULATION_DURATION (24ULL * 3600 * 1000000)
+
+/**
+ * @brief Authentication poll interval of the simulation (seconds)
+ */
+#define SIMULATION_AUTHENTICATION_POLL_INTERVAL (60)
+
+/**
+ * @brief Maximum poll interval reached by the backoff, it is the default value of the client (seconds)
+ */
+#define SIMULATION_POLL_BACKOFF_MAX_INTERVAL (14400)
+
+/**
+ * @brief Jitter of the poll interval, it is the default value of the client (percentage)
+ */
+#define SIMULATION_POLL_JITTER (10)
+
+/**
+ * @brief Maximum number of network connections recorded
+ */
+#define SIMULATION_CONNECTIONS_MAX (256)
+
+/**
+ * @brief Virtual uptime of the network connections requested by the client (microseconds)
+ */
+static uint64_t simulation_connections[SIMULATION_CONNECTIONS_MAX];
+static size_t   simulation_connections_count = 0;
+
+/**
+ * @brief Network connect callback, the network is never available so that all the polls fail
+ * @return MENDER_OK if network is connected following the request, error code otherwise
+ */
+static mender_err_t network_connect_cb(void);
+
+/**
+ * @brief Check the polls of the client back off exponentially up to the maximum interval
+ * @return MENDER_OK if the polls are as expected, error code otherwise
+ */
+static mender_err_t simulation_check_backoff(void);
+
+mender_err_t
+mender_tls_init_authentication_keys(bool recommissioning) {
+
+    (void)recommissioning;
+
+    /* The authentication keys are not used, the network is never available */
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_get_deployment_data(char **deployment_data) {
+
+    /* No deployment is pending */
+    *deployment_data = NULL;
+
+    return MENDER_NOT_FOUND;
+}
+
+static mender_err_t
+network_connect_cb(void) {
+
+    /* Record the virtual uptime of the network connection request */
+    if (simulation_connections_count < SIMULATION_CONNECTIONS_MAX) {
+        simulation_connections[simulation_connections_count] = mender_scheduler_get_uptime_us();
+    }
+    simulation_connections_count++;
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+simulation_check_backoff(void) {
+
+    uint64_t expected = SIMULATION_AUTHENTICATION_POLL_INTERVAL;
+    uint64_t total    = 0;
+
+    /* At least the polls up to the maximum interval are expected, they are all recorded */
+    if ((simulation_connections_count < 10) || (simulation_connections_count > SIMULATION_CONNECTIONS_MAX)) {
+        printf("Unexpected number of polls %zu\n", simulation_connections_count);
+        return MENDER_FAIL;
+    }
+
+    /* Check each interval, the jitter is added to the period */
+    for (size_t index = 1; index < simulation_connections_count; index++) {
+        uint64_t interval = (simulation_connections[index] - simulation_connections[index - 1]) / 1000000;
+        uint64_t jitter   = (expected * SIMULATION_POLL_JITTER) / 100;
+        if ((interval + jitter < expected) || (interval > expected + jitter)) {
+            printf("Unexpected interval %llu s before poll %zu, expected %llu s\n", (unsigned long long)interval, index, (unsigned long long)expected);
+            return MENDER_FAIL;
+        }
+        total += interval;
+
+        /* The next interval doubles, up to the maximum interval */
+        expected = (2 * expected < SIMULATION_POLL_BACKOFF_MAX_INTERVAL) ? (2 * expected) : SIMULATION_POLL_BACKOFF_MAX_INTERVAL;
+    }
+
+    /* Check the polls continue until the end of the simulation */
+    if ((SIMULATION_DURATION / 1000000) - total > SIMULATION_POLL_BACKOFF_MAX_INTERVAL + (SIMULATION_POLL_BACKOFF_MAX_INTERVAL * SIMULATION_POLL_JITTER) / 100) {
+        printf("Polls stopped after %llu s\n", (unsigned long long)total);
+        return MENDER_FAIL;
+    }
+    printf("%zu polls checked over %llu s\n", simulation_connections_count, (unsigned long long)(SIMULATION_DURATION / 1000000));
+
+    return MENDER_OK;
+}
+
+int
+main(void) {
+
+    int ret = EXIT_FAILURE;
+
+    /* Initialize mender-client */
+    mender_keystore_t         identity[]              = { { .name = "mac", .value = "00:00:00:00:00:00" }, { .name = NULL, .value = NULL } };
+    mender_client_config_t    mender_client_config    = { .identity                     = identity,
+                                                          .artifact_name                = "simulation",
+                                                          .device_type                  = "simulation",
+                                                          .host                         = "https://localhost",
+                                                          .tenant_token                 = NULL,
+                                                          .authentication_poll_interval = SIMULATION_AUTHENTICATION_POLL_INTERVAL,
+                                                          .update_poll_interval         = 0,
+                                                          .recommissioning              = false };
+    mender_client_callbacks_t mender_client_callbacks = { .network_connect = network_connect_cb };
+    if (MENDER_OK != mender_client_init(&mender_client_config, &mender_client_callbacks)) {
+        printf("Unable to initialize mender-client\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Activate mender-client and run the simulation */
+    if (MENDER_OK != mender_client_activate()) {
+        printf("Unable to activate mender-client\n");
+        goto END;
+    }
+    if (MENDER_OK != mender_scheduler_virtual_run(SIMULATION_DURATION)) {
+        printf("Unable to run the simulation\n");
+        goto END;
+    }
+    mender_client_deactivate();
+
+    /* Check the polls */
+    if (MENDER_OK == simulation_check_backoff()) {
+        ret = EXIT_SUCCESS;
+    }
+
+END:
+
+    /* Release mender-client */
+    mender_client_exit();
+
+    return ret;
+}
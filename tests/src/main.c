@@ -18,6 +18,7 @@
  */
 
 #include <arpa/inet.h>
+#include <dirent.h>
 #include <errno.h>
 #include <getopt.h>
 #include <pthread.h>
@@ -174,6 +175,10 @@ config_updated_cb(mender_keystore_t *configuration) {
         mender_log_info("Device configuration received from the server");
         while ((NULL != configuration[index].name) && (NULL != configuration[index].value)) {
             mender_log_info("Key=%s, value=%s", configuration[index].name, configuration[index].value);
+            /* The download rate limit can be tuned from the server */
+            if (!strcmp(configuration[index].name, "download_rate_limit")) {
+                mender_client_set_download_rate_limit((uint32_t)strtoul(configuration[index].value, NULL, 10));
+            }
             index++;
         }
     }
@@ -309,6 +314,44 @@ file_transfer_close_cb(void *handle) {
     return MENDER_OK;
 }
 
+static mender_err_t
+file_transfer_list_cb(char *path, mender_err_t (*callback)(char *, void *), void *params) {
+
+    assert(NULL != path);
+    assert(NULL != callback);
+    DIR           *dir;
+    struct dirent *entry;
+    char          *entry_path;
+    mender_err_t   ret = MENDER_OK;
+
+    /* Open directory */
+    mender_log_info("Listing directory '%s'", path);
+    if (NULL == (dir = opendir(path))) {
+        mender_log_error("Unable to open directory '%s'", path);
+        return MENDER_FAIL;
+    }
+
+    /* Invoke the callback with the path of each entry */
+    while ((MENDER_OK == ret) && (NULL != (entry = readdir(dir)))) {
+        if ((!strcmp(entry->d_name, ".")) || (!strcmp(entry->d_name, ".."))) {
+            continue;
+        }
+        if (NULL == (entry_path = (char *)malloc(strlen(path) + 1 + strlen(entry->d_name) + 1))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            break;
+        }
+        sprintf(entry_path, "%s%s%s", path, ('/' == path[strlen(path) - 1]) ? "" : "/", entry->d_name);
+        ret = callback(entry_path, params);
+        free(entry_path);
+    }
+
+    /* Close directory */
+    closedir(dir);
+
+    return ret;
+}
+
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER */
 #ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING
 
@@ -330,7 +373,7 @@ port_forwarding_client_thread(void *arg) {
 
     /* Read data from remote host */
     while ((ret = read(handle->socket, data, sizeof(data))) > 0) {
-        mender_troubleshoot_port_forwarding_forward(data, ret);
+        mender_troubleshoot_port_forwarding_forward(handle, data, ret);
     }
 
     return NULL;
@@ -524,42 +567,45 @@ str_replace(char *input, char *search, char *replace) {
 
 /**
  * @brief Shell open callback
+ * @param session Session
  * @param terminal_width Terminal width
  * @param terminal_height Terminal height
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t
-shell_open_cb(uint16_t terminal_width, uint16_t terminal_height) {
+shell_open_cb(void *session, uint16_t terminal_width, uint16_t terminal_height) {
 
     /* Just print terminal size */
-    mender_log_info("Shell connected with width=%d and height=%d", terminal_width, terminal_height);
+    mender_log_info("Shell %p connected with width=%d and height=%d", session, terminal_width, terminal_height);
 
     return MENDER_OK;
 }
 
 /**
  * @brief Shell resize callback
+ * @param session Session
  * @param terminal_width Terminal width
  * @param terminal_height Terminal height
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t
-shell_resize_cb(uint16_t terminal_width, uint16_t terminal_height) {
+shell_resize_cb(void *session, uint16_t terminal_width, uint16_t terminal_height) {
 
     /* Just print terminal size */
-    mender_log_info("Shell resized with width=%d and height=%d", terminal_width, terminal_height);
+    mender_log_info("Shell %p resized with width=%d and height=%d", session, terminal_width, terminal_height);
 
     return MENDER_OK;
 }
 
 /**
  * @brief Shell write data callback
+ * @param session Session
  * @param data Shell data received
  * @param length Length of the data received
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t
-shell_write_cb(void *data, size_t length) {
+shell_write_cb(void *session, void *data, size_t length) {
 
     mender_err_t ret = MENDER_OK;
     char        *buffer, *tmp;
@@ -580,8 +626,8 @@ shell_write_cb(void *data, size_t length) {
     free(buffer);
     buffer = tmp;
 
-    /* Send back the data received */
-    if (MENDER_OK != (ret = mender_troubleshoot_shell_print((void *)buffer, strlen(buffer)))) {
+    /* Send back the data received to the session */
+    if (MENDER_OK != (ret = mender_troubleshoot_shell_print(session, (void *)buffer, strlen(buffer)))) {
         mender_log_error("Unable to print data to the shell");
         ret = MENDER_FAIL;
         goto END;
@@ -599,13 +645,14 @@ END:
 
 /**
  * @brief Shell close callback
+ * @param session Session
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t
-shell_close_cb(void) {
+shell_close_cb(void *session) {
 
     /* Just print disconnected */
-    mender_log_info("Shell disconnected");
+    mender_log_info("Shell %p disconnected", session);
 
     return MENDER_OK;
 }
@@ -768,7 +815,8 @@ main(int argc, char **argv) {
                            .open  = file_transfer_open_cb,
                            .read  = file_transfer_read_cb,
                            .write = file_transfer_write_cb,
-                           .close = file_transfer_close_cb },
+                           .close = file_transfer_close_cb,
+                           .list  = file_transfer_list_cb },
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER */
 #ifdef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARDING
         .port_forwarding = { .connect = port_forwarding_connect_cb, .send = port_forwarding_send_cb, .close = port_forwarding_close_cb },
@@ -784,6 +832,15 @@ main(int argc, char **argv) {
         ret = EXIT_FAILURE;
         goto RELEASE;
     }
+
+    /* Open the troubleshoot connection after the first check for deployment so that it does not delay it */
+    if (MENDER_OK
+        != mender_client_set_addon_activation(
+            (mender_addon_instance_t *)&mender_troubleshoot_addon_instance, MENDER_CLIENT_ADDON_ACTIVATION_AFTER_UPDATE_CHECK, 0)) {
+        mender_log_error("Unable to set mender-troubleshoot add-on activation policy");
+        ret = EXIT_FAILURE;
+        goto RELEASE;
+    }
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
 
     /* Finally activate mender client */